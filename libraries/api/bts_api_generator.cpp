@@ -12,9 +12,11 @@
 #include <boost/algorithm/string/join.hpp>
 #include <boost/tokenizer.hpp>
 
+#include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <list>
+#include <map>
 #include <set>
 
 
@@ -156,6 +158,8 @@ struct method_description
   bool is_const;
   bts::api::method_prerequisites prerequisites; // actually, a bitmask of method_prerequisites
   std::vector<std::string> aliases;
+  bts::api::method_cache_policy cache_policy;
+  bts::api::method_cost_class cost_class;
 };
 typedef std::list<method_description> method_description_list;
 
@@ -193,6 +197,8 @@ private:
   void load_type_map(const fc::variants& json_type_map);
   parameter_description_list load_parameters(const fc::variants& json_parameter_descriptions);
   bts::api::method_prerequisites load_prerequisites(const fc::variant& json_prerequisites);
+  bts::api::method_cache_policy load_cache_policy(const fc::variant& json_cache_policy);
+  bts::api::method_cost_class load_cost_class(const fc::variant& json_cost);
   void load_method_descriptions(const fc::variants& json_method_descriptions);
   std::string generate_signature_for_method(const method_description& method, const std::string& class_name, bool include_default_parameters);
 };
@@ -256,6 +262,17 @@ std::string word_wrap(const std::string& text, const std::string& line_prefix, c
   return result.str();
 }
 
+// FNV-1a; the generated hash_method_name() must compute exactly the same thing
+uint64_t method_name_hash(const std::string& method_name)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : method_name)
+  {
+    hash ^= (uint8_t)c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
 
 api_generator::api_generator(const std::string& classname) :
   _api_classname(classname)
@@ -377,6 +394,30 @@ bts::api::method_prerequisites api_generator::load_prerequisites(const fc::varia
   return (bts::api::method_prerequisites)result;
 }
 
+bts::api::method_cache_policy api_generator::load_cache_policy(const fc::variant& json_cache_policy)
+{
+  std::string policy = json_cache_policy.as_string();
+  if (policy == "never")
+    return bts::api::cache_never;
+  if (policy == "head_block")
+    return bts::api::cache_per_head_block;
+  if (policy == "immutable")
+    return bts::api::cache_immutable;
+  FC_THROW("unknown cache_policy \"${policy}\", expected \"never\", \"head_block\" or \"immutable\"", ("policy", policy));
+}
+
+bts::api::method_cost_class api_generator::load_cost_class(const fc::variant& json_cost)
+{
+  std::string cost = json_cost.as_string();
+  if (cost == "normal")
+    return bts::api::cost_normal;
+  if (cost == "cheap")
+    return bts::api::cost_cheap;
+  if (cost == "expensive")
+    return bts::api::cost_expensive;
+  FC_THROW("unknown cost \"${cost}\", expected \"cheap\", \"normal\" or \"expensive\"", ("cost", cost));
+}
+
 void api_generator::load_method_descriptions(const fc::variants& method_descriptions)
 {
   for (const fc::variant& method_description_variant : method_descriptions)
@@ -404,6 +445,14 @@ void api_generator::load_method_descriptions(const fc::variants& method_descript
       FC_ASSERT(json_method_description.contains("prerequisites"), "method entry missing \"prerequisites\"");
       method.prerequisites = load_prerequisites(json_method_description["prerequisites"]);
 
+      method.cache_policy = bts::api::cache_never;
+      if (json_method_description.contains("cache_policy"))
+        method.cache_policy = load_cache_policy(json_method_description["cache_policy"]);
+
+      method.cost_class = bts::api::cost_normal;
+      if (json_method_description.contains("cost"))
+        method.cost_class = load_cost_class(json_method_description["cost"]);
+
       if (json_method_description.contains("aliases"))
       {
         method.aliases = json_method_description["aliases"].as<std::vector<std::string> >();
@@ -683,6 +732,7 @@ void api_generator::generate_positional_server_implementation_to_stream(const me
 {
   stream << "fc::variant " << server_classname << "::" << method.name << "_positional(fc::rpc::json_connection* json_connection, const fc::variants& parameters)\n";
   stream << "{\n";
+  stream << "  call_recorder recorder(this, \"" << method.name << "\");\n\n";
 
   generate_prerequisite_checks_to_stream(method, stream);
 
@@ -718,6 +768,7 @@ void api_generator::generate_named_server_implementation_to_stream(const method_
 {
   stream << "fc::variant " << server_classname << "::" << method.name << "_named(fc::rpc::json_connection* json_connection, const fc::variant_object& parameters)\n";
   stream << "{\n";
+  stream << "  call_recorder recorder(this, \"" << method.name << "\");\n\n";
 
   generate_prerequisite_checks_to_stream(method, stream);
 
@@ -791,7 +842,9 @@ void api_generator::generate_rpc_server_files(const fc::path& rpc_server_output_
   header_file << "#pragma once\n";
   header_file << "#include <bts/api/api_metadata.hpp>\n";
   header_file << "#include <bts/api/common_api.hpp>\n";
-  header_file << "#include <fc/rpc/json_connection.hpp>\n\n";
+  header_file << "#include <fc/rpc/json_connection.hpp>\n";
+  header_file << "#include <fc/time.hpp>\n";
+  header_file << "#include <exception>\n\n";
   header_file << "namespace bts { namespace rpc_stubs {\n";
   header_file << "  class " << server_classname << "\n";
   header_file << "  {\n";
@@ -802,9 +855,27 @@ void api_generator::generate_rpc_server_files(const fc::path& rpc_server_output_
   header_file << "    virtual void verify_wallet_is_unlocked() const = 0;\n";
   header_file << "    virtual void verify_connected_to_network() const = 0;\n\n";
   header_file << "    virtual void store_method_metadata(const bts::api::method_data& method_metadata) = 0;\n";
+  header_file << "    /** called once for every call of every method below, including calls rejected by a prerequisite */\n";
+  header_file << "    virtual void record_method_call(const char* method_name, const fc::time_point& start_time, bool failed) = 0;\n";
+  header_file << "    /** the hash direct_invoke_positional_method switches on; it has no collisions among the method names and aliases */\n";
+  header_file << "    static uint64_t hash_method_name(const std::string& method_name);\n";
   header_file << "    fc::variant direct_invoke_positional_method(const std::string& method_name, const fc::variants& parameters);\n";
   header_file << "    void register_" << _api_classname << "_methods(const fc::rpc::json_connection_ptr& json_connection);\n\n";
   header_file << "    void register_" << _api_classname << "_method_metadata();\n\n";
+  header_file << "  protected:\n";
+  header_file << "    /** times the generated method it is declared in, and reports it to record_method_call on the way out */\n";
+  header_file << "    class call_recorder\n";
+  header_file << "    {\n";
+  header_file << "    public:\n";
+  header_file << "      call_recorder(" << server_classname << "* server, const char* method_name) :\n";
+  header_file << "        _server(server), _method_name(method_name), _start_time(fc::time_point::now()) {}\n";
+  header_file << "      ~call_recorder() { _server->record_method_call(_method_name, _start_time, std::uncaught_exception()); }\n";
+  header_file << "    private:\n";
+  header_file << "      " << server_classname << "* _server;\n";
+  header_file << "      const char* _method_name;\n";
+  header_file << "      fc::time_point _start_time;\n";
+  header_file << "    };\n\n";
+  header_file << "  public:\n";
   for (const method_description& method : _methods)
   {
     header_file << "    fc::variant " << method.name << "_positional(fc::rpc::json_connection* json_connection, const fc::variants& parameters);\n";
@@ -893,20 +964,55 @@ void api_generator::generate_rpc_server_files(const fc::path& rpc_server_output_
         server_cpp_file << "\"" << alias << "\"";
       }
     }
-    server_cpp_file << "}};\n";
+    server_cpp_file << "},\n";
+    server_cpp_file << "    /* cache policy */ (bts::api::method_cache_policy)" << (int)method.cache_policy << ",\n";
+    server_cpp_file << "    /* cost class */ (bts::api::method_cost_class)" << (int)method.cost_class << "};\n";
       
     server_cpp_file << "  store_method_metadata(" << method.name << "_method_metadata);\n\n";
   }
   server_cpp_file << "}\n\n";
 
   // generate a function for directly invoking a method, probably a stop-gap until we finish migrating all methods to this code
-  server_cpp_file << "fc::variant " << server_classname << "::direct_invoke_positional_method(const std::string& method_name, const fc::variants& parameters)\n";
-  server_cpp_file << "{\n";
+  // it switches on a hash of the name that is checked here to be collision free, so each call costs one hash
+  // and one string compare instead of a compare against every method before it
+  std::map<uint64_t, std::string> name_by_hash;
+  std::ostringstream cases;
   for (const method_description& method : _methods)
   {
-    server_cpp_file << "  if (method_name == \"" << method.name << "\")\n";
-    server_cpp_file << "    return " << method.name << "_positional(nullptr, parameters);\n";
+    std::vector<std::string> names(1, method.name);
+    names.insert(names.end(), method.aliases.begin(), method.aliases.end());
+    for (const std::string& name : names)
+    {
+      const uint64_t hash = method_name_hash(name);
+      auto insert_result = name_by_hash.insert(std::make_pair(hash, name));
+      FC_ASSERT(insert_result.second, "method names ${a} and ${b} have the same hash, change method_name_hash", 
+                ("a", insert_result.first->second)("b", name));
+      cases << "  case 0x" << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << "ULL:\n";
+      cases << "    if (method_name == \"" << name << "\")\n";
+      cases << "      return " << method.name << "_positional(nullptr, parameters);\n";
+      cases << "    break;\n";
+    }
   }
+
+  server_cpp_file << "uint64_t " << server_classname << "::hash_method_name(const std::string& method_name)\n";
+  server_cpp_file << "{\n";
+  server_cpp_file << "  uint64_t hash = 14695981039346656037ULL;\n";
+  server_cpp_file << "  for (char c : method_name)\n";
+  server_cpp_file << "  {\n";
+  server_cpp_file << "    hash ^= (uint8_t)c;\n";
+  server_cpp_file << "    hash *= 1099511628211ULL;\n";
+  server_cpp_file << "  }\n";
+  server_cpp_file << "  return hash;\n";
+  server_cpp_file << "}\n\n";
+
+  server_cpp_file << "fc::variant " << server_classname << "::direct_invoke_positional_method(const std::string& method_name, const fc::variants& parameters)\n";
+  server_cpp_file << "{\n";
+  server_cpp_file << "  switch (hash_method_name(method_name))\n";
+  server_cpp_file << "  {\n";
+  server_cpp_file << cases.str();
+  server_cpp_file << "  default:\n";
+  server_cpp_file << "    break;\n";
+  server_cpp_file << "  }\n";
   server_cpp_file << "  FC_ASSERT(false, \"shouldn't happen\");\n";
   server_cpp_file << "}\n";
 
@@ -14,6 +14,22 @@ namespace bts { namespace api {
     connected_to_network = 8,
   };
 
+  /** how long the HTTP RPC server may reuse a result of the method for the same parameters */
+  enum method_cache_policy
+  {
+    cache_never          = 0, /* depends on the wallet, the network or the clock */
+    cache_per_head_block = 1, /* depends only on the chain state, dropped when a block is applied */
+    cache_immutable      = 2  /* depends only on the parameters */
+  };
+
+  /** how the RPC server admits calls to the method when it is busy, see rpc_server_config */
+  enum method_cost_class
+  {
+    cost_normal          = 0, /* limited and queued with the other normal calls */
+    cost_cheap           = 1, /* answers from memory without waiting, never limited or queued */
+    cost_expensive       = 2  /* scans or rewrites much of the chain or the wallet, limited and queued on its own */
+  };
+
   enum parameter_classification
   {
     required_positional,
@@ -72,11 +88,15 @@ namespace bts { namespace api {
     uint32_t                    prerequisites;
     std::string                 detailed_description;
     std::vector<std::string>    aliases;
+    method_cache_policy         cache_policy;
+    method_cost_class           cost_class;
   };
 
 } } // end namespace bts::api
 
 FC_REFLECT_ENUM(bts::api::method_prerequisites, (no_prerequisites)(json_authenticated)(wallet_open)(wallet_unlocked)(connected_to_network))
+FC_REFLECT_ENUM( bts::api::method_cache_policy, (cache_never)(cache_per_head_block)(cache_immutable) )
+FC_REFLECT_ENUM( bts::api::method_cost_class, (cost_normal)(cost_cheap)(cost_expensive) )
 FC_REFLECT_ENUM( bts::api::parameter_classification, (required_positional)(required_positional_hidden)(optional_positional)(optional_named) )
 FC_REFLECT( bts::api::parameter_data, (name)(type)(classification)(default_value) )
-FC_REFLECT( bts::api::method_data, (name)(description)(return_type)(parameters)(prerequisites)(detailed_description)(aliases) )
+FC_REFLECT( bts::api::method_data, (name)(description)(return_type)(parameters)(prerequisites)(detailed_description)(aliases)(cache_policy)(cost_class) )
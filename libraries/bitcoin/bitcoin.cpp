@@ -10,11 +10,15 @@
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/base58.hpp>
 #include <fc/crypto/hex.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <db_cxx.h>
 #include <openssl/aes.h>
 #include <openssl/evp.h>
 
+#include <memory>
+#include <thread>
+
 namespace bts { namespace bitcoin {
 
 // bitcoin wallet DB key / value blob handling
@@ -196,9 +200,48 @@ static bool private_key_matches_public( fc::ecc::private_key& privkey, std::vect
   return false;
 }
 
+void parallel_derive( size_t count, const std::function<void( size_t )>& derive )
+{
+  const size_t num_threads = std::min<size_t>( std::max( 1u, std::thread::hardware_concurrency() ), count );
+  if( num_threads <= 1 )
+  {
+     for( size_t i = 0; i < count; ++i )
+        derive( i );
+     return;
+  }
+
+  std::vector<std::unique_ptr<fc::thread>> threads;
+  std::vector<fc::future<void>> derived;
+  for( size_t t = 0; t < num_threads; ++t )
+  {
+     threads.emplace_back( new fc::thread( "bitcoin_import_" + std::to_string( t ) ) );
+     derived.push_back( threads.back()->async( [&,t]()
+     {
+        for( size_t i = t; i < count; i += num_threads )
+           derive( i );
+     }, "parallel_derive" ) );
+  }
+
+  // every worker has to finish before the threads go away, so the first error is only rethrown at the end
+  std::exception_ptr derive_error;
+  for( auto& d : derived )
+  {
+     try
+     {
+        d.wait();
+     }
+     catch( ... )
+     {
+        if( !derive_error ) derive_error = std::current_exception();
+     }
+  }
+  if( derive_error ) std::rethrow_exception( derive_error );
+}
+
 static std::vector<fc::ecc::private_key> collect_keys(  wallet_db &db, const std::string& passphrase )
 {
   std::vector<wallet_key> keys;
+  std::vector<std::pair<std::vector<unsigned char>, fc::sha256>> plain_keys;
   std::vector<std::string> names;
   std::vector<std::vector<unsigned char>> mkeys;
   wallet_db_blob key, value;
@@ -223,12 +266,7 @@ static std::vector<fc::ecc::private_key> collect_keys(  wallet_db &db, const std
            value.skip( (seqlen == 0x81) ? 6 : 7 );
            std::vector<unsigned char> privkeydata = value.get_data( 32 );
            fc::sha256 hash( fc::to_hex( (char*)&privkeydata[0], 32 ) );
-           fc::ecc::private_key privkey = fc::ecc::private_key::regenerate( hash );
-           if( private_key_matches_public( privkey, pubkey ) )
-           {
-              wallet_key key( pubkey, privkey );
-              keys.push_back( key );
-           }
+           plain_keys.push_back( std::make_pair( pubkey, hash ) );
         }
         else if( cmd == "ckey" )
         {
@@ -277,11 +315,25 @@ static std::vector<fc::ecc::private_key> collect_keys(  wallet_db &db, const std
 
   std::vector<fc::ecc::private_key> ekeys;
 
-  // decrypt encrypted keys
-  for( auto &key : keys )
+  // check the plain keys against their public keys, the elliptic curve work of which is done in parallel
+  std::vector<std::unique_ptr<wallet_key>> checked_keys( plain_keys.size() );
+  parallel_derive( plain_keys.size(), [&]( size_t i )
   {
+     fc::ecc::private_key privkey = fc::ecc::private_key::regenerate( plain_keys[ i ].second );
+     if( private_key_matches_public( privkey, plain_keys[ i ].first ) )
+        checked_keys[ i ].reset( new wallet_key( plain_keys[ i ].first, privkey ) );
+  } );
+  for( auto &key : checked_keys )
+  {
+     if( key ) keys.push_back( *key );
+  }
+
+  // decrypt encrypted keys, each independently of the others
+  parallel_derive( keys.size(), [&]( size_t i )
+  {
+     auto &key = keys[ i ];
      if( key._encrypted == false )
-        continue;
+        return;
 
      for( auto &mkey : mkeys )
      {
@@ -308,7 +360,7 @@ static std::vector<fc::ecc::private_key> collect_keys(  wallet_db &db, const std
            wlog( "${e}", ("e",e.to_detail_string()) );
         }
      }
-  }
+  } );
 
   // collect all the keys
   for( auto &key : keys )
@@ -1,3 +1,4 @@
+#include <bts/bitcoin/bitcoin.hpp>
 #include <bts/bitcoin/electrum.hpp>
 
 #include <bts/wallet/exceptions.hpp>
@@ -106,9 +107,9 @@ private:
   bts::bitcoin::python_dict_type_t accounts;
   std::vector<fc::ecc::private_key> privatekeys;
 
-  void addkey_v4( int no, int n )
+  // the stretched seed is the same for every key, so it is computed once per wallet
+  std::string stretchseed_v4()
   {
-     // stretch key
      std::string oldseed = seed;
      std::string stretched = seed;
      for( int i=0; i<100000; i++ )
@@ -125,15 +126,14 @@ private:
            stretched = fc::sha256::hash( tmp + oldseed );
         }
      }
+     return stretched;
+  }
 
+  static fc::ecc::private_key derivekey_v4( const fc::sha256& secexp, const std::string& mpks, int no, int n )
+  {
      // compute Hash( 'n:no:' + mpk )
-     std::vector<char> mpk( masterkey.size() / 2);
-     fc::from_hex( masterkey, &mpk[0], mpk.size());
-     std::string mpks(mpk.begin(), mpk.end());
-
      fc::sha256 sequence( fc::sha256::hash( fc::sha256::hash( std::to_string( n ) + ":" + std::to_string ( no ) + ":" + mpks ) ) );
-     fc::sha256 secexp( stretched );
-     privatekeys.push_back( fc::ecc::private_key::generate_from_seed( secexp, sequence ) );
+     return fc::ecc::private_key::generate_from_seed( secexp, sequence );
   }
 
   void derivekeys_v4( const std::string& passphrase )
@@ -165,6 +165,7 @@ private:
               }
            }
 
+           std::vector<std::pair<int, int>> sequences;
            for( auto &type : types.items )
            {
               if( type.first == "0" || type.first == "1" )
@@ -172,10 +173,22 @@ private:
                  python_dict_array_type_t pubkeys = boost::get<python_dict_array_type_t>( type.second );
                  for( unsigned int i = 0; i < pubkeys.items.size(); i++ )
                  {
-                    addkey_v4 ( (type.first == "0") ? 0 : 1, i );
+                    sequences.push_back( std::make_pair( (type.first == "0") ? 0 : 1, i ) );
                  }
               }
            }
+
+           const fc::sha256 secexp( stretchseed_v4() );
+           std::vector<char> mpk( masterkey.size() / 2);
+           fc::from_hex( masterkey, &mpk[0], mpk.size());
+           const std::string mpks(mpk.begin(), mpk.end());
+
+           std::vector<fc::ecc::private_key> keys( sequences.size() );
+           parallel_derive( sequences.size(), [&]( size_t i )
+           {
+              keys[ i ] = derivekey_v4( secexp, mpks, sequences[ i ].first, sequences[ i ].second );
+           } );
+           privatekeys.insert( privatekeys.end(), keys.begin(), keys.end() );
            break;
         }
      }
@@ -3,8 +3,13 @@
 #include <fc/crypto/elliptic.hpp>
 #include <fc/filesystem.hpp>
 
+#include <functional>
+
 namespace bts { namespace bitcoin {
 
 std::vector<fc::ecc::private_key> import_bitcoin_wallet( const fc::path& wallet_dat, const std::string& passphrase );
 
+/** calls derive( i ) for every i below count, spread over a thread per core; for the per key work of the importers */
+void parallel_derive( size_t count, const std::function<void( size_t )>& derive );
+
 } } // bts::bitcoin
@@ -139,23 +139,25 @@ namespace bts { namespace blockchain {
       if( this->amount <= 0 ) FC_CAPTURE_AND_THROW( negative_withdraw, (amount) );
 
       auto pay_to_account_id = abs(this->account_id);
-      auto pay_to_account = eval_state._current_state->get_account_record( pay_to_account_id );
-      if( !pay_to_account ) FC_CAPTURE_AND_THROW( unknown_account_id, (pay_to_account_id) );
-      if( pay_to_account->is_retracted() ) FC_CAPTURE_AND_THROW( account_retracted, (pay_to_account) );
-      if( !pay_to_account->is_delegate() ) FC_CAPTURE_AND_THROW( not_a_delegate, (pay_to_account) );
+      const account_record* current = eval_state._current_state->lookup_account_record( pay_to_account_id );
+      if( current == nullptr ) FC_CAPTURE_AND_THROW( unknown_account_id, (pay_to_account_id) );
+      const account_record& pay_to_account = *current;
+      if( pay_to_account.is_retracted() ) FC_CAPTURE_AND_THROW( account_retracted, (pay_to_account) );
+      if( !pay_to_account.is_delegate() ) FC_CAPTURE_AND_THROW( not_a_delegate, (pay_to_account) );
 
-      auto active_key = pay_to_account->active_key();
+      auto active_key = pay_to_account.active_key();
       if( !eval_state.check_signature( active_key ) )
          FC_CAPTURE_AND_THROW( missing_signature, (active_key) );
 
       eval_state.net_delegate_votes[ pay_to_account_id ].votes_for -= this->amount;
 
-      if( pay_to_account->delegate_info->pay_balance < this->amount )
+      if( pay_to_account.delegate_info->pay_balance < this->amount )
          FC_CAPTURE_AND_THROW( insufficient_funds, (pay_to_account)(amount) );
 
-      pay_to_account->delegate_info->pay_balance -= this->amount;
+      account_record updated_account = pay_to_account;
+      updated_account.delegate_info->pay_balance -= this->amount;
 
-      eval_state._current_state->store_account_record( *pay_to_account );
+      eval_state._current_state->store_account_record( updated_account );
       eval_state.add_balance( asset(this->amount, 0) );
 
    } FC_CAPTURE_AND_RETHROW( (*this) ) }
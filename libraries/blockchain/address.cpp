@@ -1,4 +1,6 @@
 #include <bts/blockchain/address.hpp>
+#include <bts/blockchain/base58_cache.hpp>
+#include <bts/blockchain/hashing.hpp>
 #include <bts/blockchain/withdraw_types.hpp>
 
 #include <fc/crypto/base58.hpp>
@@ -6,20 +8,27 @@
 
 namespace bts {
   namespace blockchain {
+   static base58_cache& address_strings()
+   {
+      static base58_cache cache( BTS_BLOCKCHAIN_BASE58_CACHE_SIZE );
+      return cache;
+   }
+
    address::address(){}
 
    address::address( const std::string& base58str )
    {
-      FC_ASSERT( is_valid( base58str ) );
-      std::string prefix( BTS_ADDRESS_PREFIX );
-      std::vector<char> v = fc::from_base58( base58str.substr( prefix.size() ) );
-      memcpy( (char*)addr._hash, v.data(), std::min<size_t>( v.size()-4, sizeof( addr ) ) );
+      address_strings().decode( base58str, (char*)&addr, sizeof( addr ), [&]()
+      {
+         FC_ASSERT( is_valid( base58str ) );
+         std::string prefix( BTS_ADDRESS_PREFIX );
+         std::vector<char> v = fc::from_base58( base58str.substr( prefix.size() ) );
+         memcpy( (char*)addr._hash, v.data(), std::min<size_t>( v.size()-4, sizeof( addr ) ) );
+      } );
    }
    address::address( const withdraw_condition& condition )
    {
-      fc::sha512::encoder enc;
-      fc::raw::pack( enc, condition );
-      addr = fc::ripemd160::hash( enc.result() );
+      addr = hash_engine::instance().packed_id_hash( condition );
    }
 
    /**
@@ -45,31 +54,34 @@ namespace bts {
    address::address( const fc::ecc::public_key& pub )
    {
        auto dat = pub.serialize();
-       addr = fc::ripemd160::hash( fc::sha512::hash( dat.data, sizeof( dat ) ) );
+       addr = hash_engine::instance().id_hash( dat.data, sizeof( dat ) );
    }
 
    address::address( const pts_address& ptsaddr )
    {
-       addr = fc::ripemd160::hash( (char*)&ptsaddr, sizeof( ptsaddr ) );
+       addr = hash_engine::instance().ripemd160( (char*)&ptsaddr, sizeof( ptsaddr ) );
    }
 
    address::address( const fc::ecc::public_key_data& pub )
    {
-       addr = fc::ripemd160::hash( fc::sha512::hash( pub.data, sizeof( pub ) ) );
+       addr = hash_engine::instance().id_hash( pub.data, sizeof( pub ) );
    }
 
    address::address( const bts::blockchain::public_key_type& pub )
    {
-       addr = fc::ripemd160::hash( fc::sha512::hash( pub.key_data.data, sizeof( pub.key_data ) ) );
+       addr = hash_engine::instance().id_hash( pub.key_data.data, sizeof( pub.key_data ) );
    }
 
    address::operator std::string()const
    {
-        fc::array<char,24> bin_addr;
-        memcpy( (char*)&bin_addr, (char*)&addr, sizeof( addr ) );
-        auto checksum = fc::ripemd160::hash( (char*)&addr, sizeof( addr ) );
-        memcpy( ((char*)&bin_addr)+20, (char*)&checksum._hash[0], 4 );
-        return BTS_ADDRESS_PREFIX + fc::to_base58( bin_addr.data, sizeof( bin_addr ) );
+        return address_strings().encode( (const char*)&addr, sizeof( addr ), [this]()
+        {
+           fc::array<char,24> bin_addr;
+           memcpy( (char*)&bin_addr, (char*)&addr, sizeof( addr ) );
+           auto checksum = fc::ripemd160::hash( (char*)&addr, sizeof( addr ) );
+           memcpy( ((char*)&bin_addr)+20, (char*)&checksum._hash[0], 4 );
+           return BTS_ADDRESS_PREFIX + fc::to_base58( bin_addr.data, sizeof( bin_addr ) );
+        } );
    }
 
 } } // namespace bts::blockchain
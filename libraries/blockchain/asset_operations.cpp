@@ -34,12 +34,12 @@ namespace bts { namespace blockchain {
 
       if( issuer_account_id != asset_record::market_issued_asset )
       {
-         auto issuer_account_record = eval_state._current_state->get_account_record( this->issuer_account_id );
+         const account_record* issuer_account_record = eval_state._current_state->lookup_account_record( this->issuer_account_id );
          if( NOT issuer_account_record )
             FC_CAPTURE_AND_THROW( unknown_account_id, (issuer_account_id) );
 
          if( NOT eval_state.check_signature( issuer_account_record->active_address() ) )
-            FC_CAPTURE_AND_THROW( missing_signature, (issuer_account_record) );
+            FC_CAPTURE_AND_THROW( missing_signature, (*issuer_account_record) );
       }
 
       eval_state.required_fees += asset(eval_state._current_state->get_asset_registration_fee(),0);
@@ -71,7 +71,7 @@ namespace bts { namespace blockchain {
       if( NOT current_asset_record )
          FC_CAPTURE_AND_THROW( unknown_asset_id, (asset_id) );
 
-      auto issuer_account_record = eval_state._current_state->get_account_record( current_asset_record->issuer_account_id );
+      const account_record* issuer_account_record = eval_state._current_state->lookup_account_record( current_asset_record->issuer_account_id );
 
       if( NOT issuer_account_record )
          FC_CAPTURE_AND_THROW( unknown_account_id, (current_asset_record->issuer_account_id) );
@@ -81,7 +81,7 @@ namespace bts { namespace blockchain {
 
       if( this->issuer_account_id != current_asset_record->issuer_account_id )
       {
-          auto new_issuer_account_record = eval_state._current_state->get_account_record( this->issuer_account_id );
+          const account_record* new_issuer_account_record = eval_state._current_state->lookup_account_record( this->issuer_account_id );
 
           if( NOT new_issuer_account_record )
               FC_CAPTURE_AND_THROW( unknown_account_id, (issuer_account_id) );
@@ -112,7 +112,7 @@ namespace bts { namespace blockchain {
       if( NOT current_asset_record )
          FC_CAPTURE_AND_THROW( unknown_asset_id, (amount.asset_id) );
 
-      auto issuer_account_record = eval_state._current_state->get_account_record( current_asset_record->issuer_account_id );
+      const account_record* issuer_account_record = eval_state._current_state->lookup_account_record( current_asset_record->issuer_account_id );
       if( NOT issuer_account_record ) 
          FC_CAPTURE_AND_THROW( unknown_account_id, (current_asset_record->issuer_account_id) );
 
@@ -93,6 +93,9 @@ namespace bts { namespace blockchain {
 //             FC_CAPTURE_AND_THROW( too_may_delegates_in_slate, (slate.supported_delegates.size()) );
 //      }
 
+      if( eval_state._block_slates && eval_state._block_slates->find( slate_id ) )
+         return;
+
       auto current_slate = eval_state._current_state->get_delegate_slate( slate_id );
       if( NOT current_slate )
       {
@@ -236,7 +239,7 @@ namespace bts { namespace blockchain {
       {
          case withdraw_signature_type:
          {
-            auto owner = current_balance_record->condition.as<withdraw_with_signature>().owner;
+            auto owner = current_balance_record->owner();
             if( claim_input_data.size() )
             {
                auto pts_sig = fc::raw::unpack<withdraw_with_pts>( claim_input_data );
@@ -340,10 +343,12 @@ namespace bts { namespace blockchain {
       if( current_balance_record->condition.asset_id == 0 && current_balance_record->condition.delegate_slate_id )
          eval_state.adjust_vote( current_balance_record->condition.delegate_slate_id, -this->amount );
 
-      auto asset_rec = eval_state._current_state->get_asset_record( current_balance_record->condition.asset_id );
+      auto asset_rec = eval_state._current_state->get_asset_record_for_totals( current_balance_record->condition.asset_id );
       FC_ASSERT( asset_rec.valid() );
       if( asset_rec->is_market_issued() )
       {
+         // the yield depends on the totals
+         asset_rec = eval_state._current_state->get_asset_record( current_balance_record->condition.asset_id );
          auto yield = current_balance_record->calculate_yield( eval_state._current_state->now(),
                                                                current_balance_record->balance,
                                                                asset_rec->collected_fees,
@@ -385,7 +390,7 @@ namespace bts { namespace blockchain {
       {
          case withdraw_signature_type:
          {
-            auto owner = current_balance_record->condition.as<withdraw_with_signature>().owner;
+            auto owner = current_balance_record->owner();
             if( claim_input_data.size() )
             {
                auto pts_sig = fc::raw::unpack<withdraw_with_pts>( claim_input_data );
@@ -489,10 +494,12 @@ namespace bts { namespace blockchain {
       if( current_balance_record->condition.asset_id == 0 && current_balance_record->condition.delegate_slate_id )
          eval_state.adjust_vote( current_balance_record->condition.delegate_slate_id, -current_balance_record->balance );
 
-      auto asset_rec = eval_state._current_state->get_asset_record( current_balance_record->condition.asset_id );
+      auto asset_rec = eval_state._current_state->get_asset_record_for_totals( current_balance_record->condition.asset_id );
       FC_ASSERT( asset_rec.valid() );
       if( asset_rec->is_market_issued() )
       {
+         // the yield depends on the totals
+         asset_rec = eval_state._current_state->get_asset_record( current_balance_record->condition.asset_id );
          auto yield = current_balance_record->calculate_yield( eval_state._current_state->now(),
                                                                current_balance_record->balance,
                                                                asset_rec->collected_fees,
@@ -526,7 +533,7 @@ namespace bts { namespace blockchain {
                     ("BTS_BLOCKCHAIN_MIN_BURN_FEE",BTS_BLOCKCHAIN_MIN_BURN_FEE) );
       }
 
-      auto asset_rec = eval_state._current_state->get_asset_record( amount.asset_id );
+      auto asset_rec = eval_state._current_state->get_asset_record_for_totals( amount.asset_id );
       FC_ASSERT( asset_rec.valid() );
 
       FC_ASSERT( !asset_rec->is_market_issued() );
@@ -537,8 +544,7 @@ namespace bts { namespace blockchain {
       eval_state.sub_balance( address(), this->amount );
       if( account_id != 0 ) // you can offer burnt offerings to God if you like... otherwise it must be an account
       {
-          auto account_rec = eval_state._current_state->get_account_record( abs(this->account_id) );
-          FC_ASSERT( account_rec.valid() );
+          FC_ASSERT( eval_state._current_state->lookup_account_record( abs(this->account_id) ) != nullptr );
       }
       eval_state._current_state->store_burn_record( burn_record( burn_record_key( {account_id, eval_state.trx.id()} ), burn_record_value( {amount,message,message_signature} ) ) );
    } FC_CAPTURE_AND_RETHROW( (eval_state) ) }
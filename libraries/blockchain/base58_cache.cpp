@@ -0,0 +1,67 @@
+#include <bts/blockchain/base58_cache.hpp>
+
+#include <cstring>
+
+namespace bts { namespace blockchain {
+
+   const std::string* base58_cache::lru::find( const std::string& key )
+   {
+      const auto itr = index.find( key );
+      if( itr == index.end() )
+         return nullptr;
+      entries.splice( entries.begin(), entries, itr->second );
+      return &itr->second->second;
+   }
+
+   void base58_cache::lru::store( std::string key, std::string mapped, size_t capacity )
+   {
+      if( index.count( key ) )
+         return;
+      entries.emplace_front( std::move( key ), std::move( mapped ) );
+      index[ entries.front().first ] = entries.begin();
+      while( entries.size() > capacity )
+      {
+         index.erase( entries.back().first );
+         entries.pop_back();
+      }
+   }
+
+   base58_cache::base58_cache( size_t capacity )
+   :_capacity( capacity )
+   {
+   }
+
+   std::string base58_cache::encode( const char* data, size_t size, const std::function<std::string()>& encode )
+   {
+      std::string value( data, size );
+      {
+         std::lock_guard<std::mutex> lock( _mutex );
+         const std::string* text = _strings.find( value );
+         if( text != nullptr )
+            return *text;
+      }
+
+      std::string text = encode();
+      std::lock_guard<std::mutex> lock( _mutex );
+      _strings.store( std::move( value ), text, _capacity );
+      return text;
+   }
+
+   void base58_cache::decode( const std::string& text, char* data, size_t size, const std::function<void()>& decode )
+   {
+      {
+         std::lock_guard<std::mutex> lock( _mutex );
+         const std::string* value = _values.find( text );
+         if( value != nullptr && value->size() == size )
+         {
+            memcpy( data, value->data(), size );
+            return;
+         }
+      }
+
+      decode();
+      std::lock_guard<std::mutex> lock( _mutex );
+      _values.store( text, std::string( data, size ), _capacity );
+   }
+
+} } // bts::blockchain
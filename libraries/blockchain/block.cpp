@@ -1,20 +1,17 @@
 #include <bts/blockchain/block.hpp>
+#include <bts/blockchain/hashing.hpp>
 #include <algorithm>
 
 namespace bts { namespace blockchain {
 
    digest_type block_header::digest()const
    {
-      fc::sha256::encoder enc;
-      fc::raw::pack( enc, *this );
-      return enc.result();
+      return hash_engine::instance().packed_sha256( *this );
    }
 
    block_id_type signed_block_header::id()const
    {
-      fc::sha512::encoder enc;
-      fc::raw::pack( enc, *this );
-      return fc::ripemd160::hash( enc.result() );
+      return hash_engine::instance().packed_id_hash( *this );
    }
 
    bool signed_block_header::validate_signee( const fc::ecc::public_key& expected_signee, bool enforce_canonical )const
@@ -41,17 +38,38 @@ namespace bts { namespace blockchain {
 
    digest_type digest_block::calculate_transaction_digest()const
    {
-      fc::sha512::encoder enc;
-      fc::raw::pack( enc, user_transaction_ids );
-      return fc::sha256::hash( enc.result() );
+      const auto& engine = hash_engine::instance();
+      const std::vector<char>& packed_ids = hash_engine::pack( user_transaction_ids );
+      const fc::sha512 inner = engine.sha512( packed_ids.data(), packed_ids.size() );
+      return engine.sha256( inner.data(), sizeof( inner ) );
    }
 
+   /* The transactions are packed into one buffer and their ids hashed in a single batch */
    full_block::operator digest_block()const
    {
       digest_block db( (signed_block_header&)*this );
-      db.user_transaction_ids.reserve( user_transactions.size() );
-      for( auto item : user_transactions )
-         db.user_transaction_ids.push_back( item.id() );
+
+      std::vector<size_t> ends;
+      ends.reserve( user_transactions.size() );
+      std::vector<char> packed;
+      for( const auto& item : user_transactions )
+      {
+         const std::vector<char>& data = hash_engine::pack( item );
+         packed.insert( packed.end(), data.begin(), data.end() );
+         ends.push_back( packed.size() );
+      }
+
+      std::vector<hash_engine::buffer> buffers;
+      buffers.reserve( ends.size() );
+      size_t begin = 0;
+      for( const size_t end : ends )
+      {
+         buffers.push_back( hash_engine::buffer{ packed.data() + begin, end - begin } );
+         begin = end;
+      }
+
+      db.user_transaction_ids.resize( buffers.size() );
+      hash_engine::instance().id_hash( buffers.data(), buffers.size(), db.user_transaction_ids.data() );
       return db;
    }
 
@@ -63,7 +81,7 @@ namespace bts { namespace blockchain {
    bool digest_block::validate_unique()const
    {
       std::unordered_set<transaction_id_type> trx_ids;
-      for( auto id : user_transaction_ids )
+      for( const auto& id : user_transaction_ids )
          if( !trx_ids.insert(id).second ) return false;
       return true;
    }
@@ -0,0 +1,54 @@
+#include <bts/blockchain/block_id_filter.hpp>
+
+#include <fc/crypto/city.hpp>
+
+namespace bts { namespace blockchain {
+
+   namespace
+   {
+      /* about 1% false positives at 10 bits per item */
+      const size_t   bits_per_item = 10;
+      const uint32_t num_hashes    = 7;
+
+      uint64_t hash_id( const block_id_type& id )
+      {
+         return fc::city_hash64( id.data(), id.data_size() );
+      }
+   }
+
+   block_id_filter::block_id_filter( size_t expected_items )
+   : _bits( std::max<size_t>( 1, (expected_items * bits_per_item + 63) / 64 ) ),
+     _size( 0 ),
+     _capacity( expected_items )
+   {
+   }
+
+   /* the bit positions are derived from the one hash by double hashing */
+   void block_id_filter::insert( const block_id_type& id )
+   {
+      const uint64_t hash = hash_id( id );
+      const uint64_t num_bits = _bits.size() * 64;
+      const uint64_t step = (hash >> 32) | 1;
+      for( uint32_t i = 0; i < num_hashes; ++i )
+      {
+         const uint64_t bit = (hash + i * step) % num_bits;
+         _bits[ bit / 64 ] |= uint64_t( 1 ) << (bit % 64);
+      }
+      ++_size;
+   }
+
+   bool block_id_filter::may_contain( const block_id_type& id )const
+   {
+      const uint64_t hash = hash_id( id );
+      const uint64_t num_bits = _bits.size() * 64;
+      const uint64_t step = (hash >> 32) | 1;
+      for( uint32_t i = 0; i < num_hashes; ++i )
+      {
+         const uint64_t bit = (hash + i * step) % num_bits;
+         if( !(_bits[ bit / 64 ] & (uint64_t( 1 ) << (bit % 64))) )
+            return false;
+      }
+      return true;
+   }
+
+} } // bts::blockchain
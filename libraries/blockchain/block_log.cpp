@@ -0,0 +1,249 @@
+#include <bts/blockchain/block_log.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/io/raw.hpp>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <string>
+
+namespace bts { namespace blockchain {
+
+   struct block_log::mapped_file
+   {
+      mapped_file( const fc::path& file, uint64_t size )
+      :mapping( file.string().c_str(), boost::interprocess::read_only ),
+       region( mapping, boost::interprocess::read_only, 0, size ){}
+
+      const char* data()const { return static_cast<const char*>( region.get_address() ); }
+      uint64_t    size()const { return region.get_size(); }
+
+      boost::interprocess::file_mapping  mapping;
+      boost::interprocess::mapped_region region;
+   };
+
+   block_log::block_log()
+   {
+   }
+
+   block_log::~block_log()
+   {
+      close();
+   }
+
+   void block_log::open( const fc::path& file )
+   { try {
+      FC_ASSERT( !is_open() );
+
+      fc::create_directories( file.parent_path() );
+      _path = file;
+      _start = read_start();
+
+      const fc::path data = data_file( _start );
+      _out.open( data.string().c_str(), std::ios::out | std::ios::binary | std::ios::app );
+      FC_ASSERT( _out.is_open(), "unable to open block log ${file}", ("file",data) );
+      _size = _start + fc::file_size( data );
+   } FC_CAPTURE_AND_RETHROW( (file) ) }
+
+   void block_log::open_read_only( const fc::path& file )
+   { try {
+      FC_ASSERT( !is_open() );
+      FC_ASSERT( fc::exists( file ) || fc::exists( file.string() + ".start" ), "no block log at ${file}", ("file",file) );
+
+      _path = file;
+      _read_only = true;
+      _start = read_start();
+      _size = _start + fc::file_size( data_file( _start ) );
+   } FC_CAPTURE_AND_RETHROW( (file) ) }
+
+   void block_log::close()
+   {
+      unmap();
+      if( _out.is_open() )
+         _out.close();
+      _size = 0;
+      _start = 0;
+      _read_only = false;
+   }
+
+   /* The writer renames the start file only once the new data file is complete, so reading the start and
+      then sizing its data file always sees a whole log */
+   bool block_log::refresh()
+   { try {
+      FC_ASSERT( _read_only, "Only a read only block log is refreshed" );
+      const uint64_t start = read_start();
+      const uint64_t size = start + fc::file_size( data_file( start ) );
+      if( size < _size || start < _start )
+         return false;
+
+      if( start != _start )
+      {
+         unmap();
+         _start = start;
+      }
+      _size = size;
+      return true;
+   } FC_CAPTURE_AND_RETHROW() }
+
+   bool block_log::has_record( uint64_t offset )const
+   {
+      if( offset < _start || offset + 4 > _size )
+         return false;
+      const auto map = mapping( offset + 4 );
+      const unsigned char* header = reinterpret_cast<const unsigned char*>( map->data() ) + ( offset - _start );
+      const uint32_t length = uint32_t( header[0] ) | uint32_t( header[1] ) << 8 | uint32_t( header[2] ) << 16 | uint32_t( header[3] ) << 24;
+      return offset + 4 + length <= _size;
+   }
+
+   void block_log::prune( uint64_t offset )
+   { try {
+      FC_ASSERT( is_open(), "Block log is not open!" );
+      FC_ASSERT( !_read_only, "Block log is read only" );
+      FC_ASSERT( offset >= _start && offset <= _size );
+      if( offset == _start )
+         return;
+
+      const fc::path old_data = data_file( _start );
+      const fc::path new_data = data_file( offset );
+      {
+         std::ifstream in( old_data.string().c_str(), std::ios::in | std::ios::binary );
+         in.seekg( offset - _start );
+         std::ofstream out( new_data.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+         std::vector<char> buffer( 1024 * 1024 );
+         while( in )
+         {
+            in.read( buffer.data(), buffer.size() );
+            out.write( buffer.data(), in.gcount() );
+         }
+         out.flush();
+         FC_ASSERT( out.good(), "error writing ${file}", ("file",new_data) );
+      }
+
+      /* renaming the start file switches to the new data file in one step, so a crash leaves one or the other */
+      const fc::path temp_start = start_file().string() + ".tmp";
+      {
+         std::ofstream out( temp_start.string().c_str(), std::ios::out | std::ios::trunc );
+         out << offset;
+         out.flush();
+         FC_ASSERT( out.good(), "error writing ${file}", ("file",temp_start) );
+      }
+      fc::rename( temp_start, start_file() );
+
+      const uint64_t size = _size;
+      const fc::path path = _path;
+      close();
+      fc::remove( old_data );
+      open( path );
+      FC_ASSERT( _start == offset && _size == size );
+   } FC_CAPTURE_AND_RETHROW( (offset) ) }
+
+   uint64_t block_log::append( const full_block& block )
+   { try {
+      FC_ASSERT( is_open(), "Block log is not open!" );
+      FC_ASSERT( !_read_only, "Block log is read only" );
+
+      const std::vector<char> data = fc::raw::pack( block );
+      const uint32_t length = data.size();
+      const char header[4] = { char( length ), char( length >> 8 ), char( length >> 16 ), char( length >> 24 ) };
+
+      const uint64_t offset = _size;
+      _out.write( header, sizeof( header ) );
+      _out.write( data.data(), data.size() );
+      // the caller indexes the offset right after this returns, so the record must have left our buffer
+      _out.flush();
+      FC_ASSERT( _out.good(), "error writing to block log ${file}", ("file",_path) );
+
+      _size += sizeof( header ) + data.size();
+      return offset;
+   } FC_CAPTURE_AND_RETHROW( (block.block_num) ) }
+
+   full_block block_log::read( uint64_t offset )const
+   { try {
+      const char* data = nullptr;
+      uint32_t length = 0;
+      const auto map = record( offset, data, length );
+      fc::datastream<const char*> ds( data, length );
+      full_block block;
+      fc::raw::unpack( ds, block );
+      return block;
+   } FC_CAPTURE_AND_RETHROW( (offset) ) }
+
+   std::vector<char> block_log::read_packed( uint64_t offset )const
+   { try {
+      const char* data = nullptr;
+      uint32_t length = 0;
+      const auto map = record( offset, data, length );
+      return std::vector<char>( data, data + length );
+   } FC_CAPTURE_AND_RETHROW( (offset) ) }
+
+   uint32_t block_log::record_size( uint64_t offset )const
+   { try {
+      const char* data = nullptr;
+      uint32_t length = 0;
+      record( offset, data, length );
+      return length;
+   } FC_CAPTURE_AND_RETHROW( (offset) ) }
+
+   std::shared_ptr<const block_log::mapped_file> block_log::record( uint64_t offset, const char*& data, uint32_t& length )const
+   {
+      FC_ASSERT( is_open(), "Block log is not open!" );
+      if( offset < _start )
+         FC_THROW_EXCEPTION( fc::key_not_found_exception, "block log record at ${offset} was pruned", ("offset",offset) );
+      FC_ASSERT( offset + 4 <= _size, "offset is past the end of the block log" );
+
+      /* the mapping holds the data file, which begins at _start */
+      const uint64_t position = offset - _start;
+      auto map = mapping( offset + 4 );
+
+      const unsigned char* header = reinterpret_cast<const unsigned char*>( map->data() ) + position;
+      length = uint32_t( header[0] ) | uint32_t( header[1] ) << 8 | uint32_t( header[2] ) << 16 | uint32_t( header[3] ) << 24;
+      FC_ASSERT( offset + 4 + length <= _size, "block log record is truncated" );
+
+      if( position + 4 + length > map->size() )
+         map = mapping( offset + 4 + length );
+
+      data = map->data() + position + 4;
+      return map;
+   }
+
+   fc::path block_log::data_file( uint64_t start )const
+   {
+      if( start == 0 )
+         return _path;
+      return fc::path( _path.string() + "." + std::to_string( start ) );
+   }
+
+   fc::path block_log::start_file()const
+   {
+      return fc::path( _path.string() + ".start" );
+   }
+
+   uint64_t block_log::read_start()const
+   {
+      uint64_t start = 0;
+      if( fc::exists( start_file() ) )
+      {
+         std::ifstream in( start_file().string().c_str() );
+         in >> start;
+         FC_ASSERT( !in.fail(), "unreadable ${file}", ("file",start_file()) );
+      }
+      return start;
+   }
+
+   /** the mapping covers the file as it was when mapped; a new one is made once reads reach newer records */
+   std::shared_ptr<const block_log::mapped_file> block_log::mapping( uint64_t end )const
+   {
+      std::lock_guard<std::mutex> lock( _mapping_mutex );
+      if( !_mapping || end - _start > _mapping->size() )
+         _mapping = std::make_shared<const mapped_file>( data_file( _start ), _size - _start );
+      return _mapping;
+   }
+
+   void block_log::unmap()
+   {
+      std::lock_guard<std::mutex> lock( _mapping_mutex );
+      _mapping.reset();
+   }
+
+} } // bts::blockchain
@@ -1,19 +1,28 @@
 //#define DEFAULT_LOGGER "blockchain"
 
+#include <bts/blockchain/account_operations.hpp>
+#include <bts/blockchain/balance_operations.hpp>
 #include <bts/blockchain/chain_database.hpp>
 #include <bts/blockchain/checkpoints.hpp>
 #include <bts/blockchain/config.hpp>
+#include <bts/blockchain/evaluation_profiler.hpp>
 #include <bts/blockchain/pts_config.hpp>
 #include <bts/blockchain/genesis_config.hpp>
 #include <bts/blockchain/genesis_json.hpp>
+#include <bts/blockchain/market_operations.hpp>
 #include <bts/blockchain/market_records.hpp>
 #include <bts/blockchain/operation_factory.hpp>
+#include <bts/blockchain/signature_cache.hpp>
 #include <bts/blockchain/time.hpp>
 
 #include <bts/db/cached_level_map.hpp>
 #include <bts/db/level_map.hpp>
 
+#include <bts/utilities/log.hpp>
+#include <bts/utilities/stall_detector.hpp>
+
 #include <fc/compress/lzma.hpp>
+#include <fc/io/datastream.hpp>
 #include <fc/io/fstream.hpp>
 #include <fc/io/json.hpp>
 #include <fc/io/raw_variant.hpp>
@@ -21,45 +30,1006 @@
 #include <fc/thread/non_preemptable_scope_check.hpp>
 #include <fc/thread/unique_lock.hpp>
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 
-#include <algorithm>
-#include <deque>
-#include <fstream>
-#include <iomanip>
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+
+// the definition of detail::chain_database_impl is moved to a separate file so it can be shared by the market_engine(s)
+#include <bts/blockchain/chain_database_impl.hpp>
+#include <bts/blockchain/market_engine.hpp>
+
+#include <bts/blockchain/fork_blocks.hpp>
+
+namespace bts { namespace blockchain {
+
+   namespace detail
+   {
+      /**
+       *  Runs tasks on worker threads and joins them by blocking the calling thread rather than waiting on
+       *  their futures. An fc wait would yield, and the caller's other fc tasks would then read and write
+       *  the tables the workers are reading. The join cannot be canceled either, so the frame the tasks
+       *  reference outlives them: the destructor joins too, and so covers every way out of that frame.
+       */
+      class worker_join
+      {
+         public:
+            ~worker_join()
+            {
+               wait();
+            }
+
+            template<typename Task>
+            void run( fc::thread& worker, Task task, const char* description )
+            {
+               {
+                  std::lock_guard<std::mutex> guard( _mutex );
+                  ++_started;
+               }
+               try
+               {
+                  worker.async( [this, task]()
+                  {
+                     try
+                     {
+                        task();
+                     }
+                     catch( ... )
+                     {
+                        finished( std::current_exception() );
+                        return;
+                     }
+                     finished( std::exception_ptr() );
+                  }, description );
+               }
+               catch( ... )
+               {
+                  finished( std::exception_ptr() );
+                  throw;
+               }
+            }
+
+            /** blocks until every task has finished, then rethrows the first error one of them threw */
+            void join()
+            {
+               wait();
+               if( _error )
+               {
+                  const std::exception_ptr error = _error;
+                  _error = std::exception_ptr();
+                  std::rethrow_exception( error );
+               }
+            }
+
+         private:
+            void wait()
+            {
+               std::unique_lock<std::mutex> guard( _mutex );
+               _done_signal.wait( guard, [this]{ return _finished == _started; } );
+            }
+
+            void finished( const std::exception_ptr& error )
+            {
+               std::lock_guard<std::mutex> guard( _mutex );
+               if( error && !_error )
+                  _error = error;
+               ++_finished;
+               _done_signal.notify_all();
+            }
+
+            std::mutex              _mutex;
+            std::condition_variable _done_signal;
+            size_t                  _started = 0;
+            size_t                  _finished = 0;
+            std::exception_ptr      _error;
+      };
+
+      /** tables opened with online_upgrade convert legacy records here, a batch at a time, while the node runs */
+      void chain_database_impl::run_online_upgrades()
+      {
+         bool pending = true;
+         while( pending )
+         {
+            pending = false;
+            pending |= _undo_state_db.upgrade_step( BTS_BLOCKCHAIN_DB_ONLINE_UPGRADE_BATCH_SIZE );
+            pending |= _block_id_to_block_record_db.upgrade_step( BTS_BLOCKCHAIN_DB_ONLINE_UPGRADE_BATCH_SIZE );
+            pending |= _id_to_transaction_record_db.upgrade_step( BTS_BLOCKCHAIN_DB_ONLINE_UPGRADE_BATCH_SIZE );
+            pending |= _balance_db.upgrade_step( BTS_BLOCKCHAIN_DB_ONLINE_UPGRADE_BATCH_SIZE );
+            fc::yield();
+         }
+      }
+
+      void chain_database_impl::adjust_asset_totals( const asset_id_type& asset_id, share_type supply_delta,
+                                                     share_type debt_delta, share_type unclaimed_genesis_delta )
+      {
+         if( supply_delta == 0 && debt_delta == 0 && unclaimed_genesis_delta == 0 ) return;
+         if( _deferred_asset_totals.valid() )
+         {
+            asset_totals& deferred = ( *_deferred_asset_totals )[ asset_id ];
+            deferred.supply += supply_delta;
+            deferred.debt += debt_delta;
+            deferred.unclaimed_genesis += unclaimed_genesis_delta;
+            return;
+         }
+         asset_totals totals = get_asset_totals( asset_id );
+         totals.supply += supply_delta;
+         totals.debt += debt_delta;
+         totals.unclaimed_genesis += unclaimed_genesis_delta;
+         _asset_totals_db.store( asset_id, totals );
+      }
+
+      asset_totals chain_database_impl::get_asset_totals( const asset_id_type& asset_id )const
+      {
+         const auto stored = _asset_totals_db.fetch_optional( asset_id );
+         asset_totals totals = stored.valid() ? *stored : asset_totals();
+         if( _deferred_asset_totals.valid() )
+         {
+            const auto itr = _deferred_asset_totals->find( asset_id );
+            if( itr != _deferred_asset_totals->end() )
+            {
+               totals.supply += itr->second.supply;
+               totals.debt += itr->second.debt;
+               totals.unclaimed_genesis += itr->second.unclaimed_genesis;
+            }
+         }
+         return totals;
+      }
+
+      /** bulk stores touch the same few assets' totals for every record, so they are written once at the end */
+      void chain_database_impl::defer_asset_totals()
+      {
+         if( !_deferred_asset_totals.valid() )
+            _deferred_asset_totals = std::map<asset_id_type, asset_totals>();
+      }
+
+      void chain_database_impl::flush_asset_totals()
+      {
+         if( !_deferred_asset_totals.valid() ) return;
+         const std::map<asset_id_type, asset_totals> deferred = std::move( *_deferred_asset_totals );
+         _deferred_asset_totals.reset();
+         for( const auto& item : deferred )
+            adjust_asset_totals( item.first, item.second.supply, item.second.debt, item.second.unclaimed_genesis );
+      }
+
+      void chain_database_impl::write_balance_record( const balance_record& r, const obalance_record& old_rec,
+                                                      const oasset_record& base_asset )
+      {
+         const share_type old_balance = old_rec.valid() ? old_rec->balance : 0;
+         share_type unclaimed_delta = 0;
+         if( r.asset_id() == asset_id_type( 0 ) )
+         {
+            /* the same test as scan_unclaimed_genesis; while the genesis state is being stored there is no base
+             * asset yet, and every balance is unclaimed */
+            const auto is_unclaimed = [&]( const balance_record& rec )
+            {
+               return !base_asset.valid() || rec.last_update <= base_asset->registration_date;
+            };
+            unclaimed_delta = ( is_unclaimed( r ) ? r.balance : 0 )
+                              - ( old_rec.valid() && is_unclaimed( *old_rec ) ? old_rec->balance : 0 );
+         }
+         adjust_asset_totals( r.asset_id(), r.balance - old_balance, 0, unclaimed_delta );
+
+         /* Currently we keep all balance records forever so we know the owner and asset ID on wallet rescan */
+         _balance_db.store( r.id(), r );
+
+         /* The owner is part of the condition the id is derived from, so an entry never goes stale, and undo
+          * only ever restores or zeroes a record; rewriting an existing entry is cheaper than checking for it */
+         const address owner = r.owner();
+         if( owner != address() )
+            _owner_balance_index_db.store( std::make_pair( owner, r.id() ), 0 );
+      }
+
+      asset chain_database_impl::scan_supply( const asset_id_type& asset_id )const
+      {
+          const auto record = self->get_asset_record( asset_id );
+          FC_ASSERT( record.valid() );
+
+          // Add fees
+          asset total( record->collected_fees, asset_id );
+
+          // Add balances
+          for( auto balance_itr = _balance_db.begin(); balance_itr.valid(); ++balance_itr )
+          {
+              const balance_record balance = balance_itr.value();
+              if( balance.asset_id() == total.asset_id )
+                  total += balance.get_balance();
+          }
+
+          // Add ask balances
+          for( auto ask_itr = _ask_db.begin(); ask_itr.valid(); ++ask_itr )
+          {
+              const market_index_key market_index = ask_itr.key();
+              if( market_index.order_price.base_asset_id == total.asset_id )
+              {
+                  const order_record ask = ask_itr.value();
+                  total.amount += ask.balance;
+              }
+          }
+
+          // If base asset
+          if( asset_id == asset_id_type( 0 ) )
+          {
+              // Add short balances
+              for( auto short_itr = _short_db.begin(); short_itr.valid(); ++short_itr )
+              {
+                  const order_record sh = short_itr.value();
+                  total.amount += sh.balance;
+              }
+
+              // Add collateral balances
+              for( auto collateral_itr = _collateral_db.begin(); collateral_itr.valid(); ++collateral_itr )
+              {
+                  const collateral_record collateral = collateral_itr.value();
+                  total.amount += collateral.collateral_balance;
+              }
+
+              // Add pay balances
+              for( auto account_itr = _account_db.begin(); account_itr.valid(); ++account_itr )
+              {
+                  const account_record account = account_itr.value();
+                  if( account.delegate_info.valid() )
+                      total.amount += account.delegate_info->pay_balance;
+              }
+          }
+          else // If non-base asset
+          {
+              // Add bid balances
+              for( auto bid_itr = _bid_db.begin(); bid_itr.valid(); ++bid_itr )
+              {
+                  const market_index_key market_index = bid_itr.key();
+                  if( market_index.order_price.quote_asset_id == total.asset_id )
+                  {
+                      const order_record bid = bid_itr.value();
+                      total.amount += bid.balance;
+                  }
+              }
+          }
+
+          return total;
+      }
+
+      /** the price in units of the assets' precisions, as get_market_price_history has always reported it */
+      static double display_price( const price& p, const asset_record& base, const asset_record& quote )
+      {
+          const fc::uint128 scaled = p.ratio * base.precision / quote.precision;
+          return ( double( scaled.high_bits() ) * 18446744073709551616.0 + double( scaled.low_bits() ) ) / ( BTS_BLOCKCHAIN_MAX_SHARES * 1000 );
+      }
+
+      /** folds one block's market history row into the candles containing it */
+      void chain_database_impl::update_market_candles( const market_history_key& key, const market_history_record& record,
+                                                       const std::vector<uint32_t>& resolutions )
+      {
+          if( key.granularity != market_history_key::each_block || record.volume == 0 || resolutions.empty() )
+              return;
+
+          const auto base = self->get_asset_record( key.base_id );
+          const auto quote = self->get_asset_record( key.quote_id );
+          FC_ASSERT( base.valid() && quote.valid() );
+
+          const double open = display_price( record.opening_price, *base, *quote );
+          const double close = display_price( record.closing_price, *base, *quote );
+          const double highest_bid = display_price( record.highest_bid, *base, *quote );
+          const double lowest_ask = display_price( record.lowest_ask, *base, *quote );
+
+          for( const uint32_t resolution : resolutions )
+          {
+              const market_candle_key candle_key( resolution, key.quote_id, key.base_id,
+                                                  key.timestamp - ( key.timestamp.sec_since_epoch() % resolution ) );
+              auto candle = _market_candle_db.fetch_optional( candle_key );
+              if( !candle.valid() )
+              {
+                  candle = market_candle();
+                  candle->timestamp = candle_key.timestamp;
+                  candle->open = open;
+                  candle->high = std::max( open, close );
+                  candle->low = std::min( open, close );
+                  candle->highest_bid = highest_bid;
+                  candle->lowest_ask = lowest_ask;
+              }
+              else
+              {
+                  candle->high = std::max( candle->high, std::max( open, close ) );
+                  candle->low = std::min( candle->low, std::min( open, close ) );
+                  candle->highest_bid = std::max( candle->highest_bid, highest_bid );
+                  candle->lowest_ask = std::min( candle->lowest_ask, lowest_ask );
+              }
+              candle->close = close;
+              candle->volume += record.volume;
+              _market_candle_db.store( candle_key, *candle );
+          }
+      }
+
+      /**
+       *  Drops the candles of resolutions no longer configured and builds the others from the market history,
+       *  all of them or only those with no candles yet. A rebuilt resolution that saw no trades stays empty
+       *  and is looked for again at the next open, which costs one pass over the history.
+       */
+      void chain_database_impl::rebuild_market_candles( bool missing_only )
+      { try {
+          auto stored = _market_candle_db.begin();
+          while( stored.valid() )
+          {
+              const uint32_t resolution = stored.key().resolution;
+              const bool configured = std::find( _market_candle_resolutions.begin(), _market_candle_resolutions.end(), resolution )
+                                      != _market_candle_resolutions.end();
+              auto batch = _market_candle_db.create_batch();
+              for( ; stored.valid() && stored.key().resolution == resolution; ++stored )
+              {
+                  if( !configured || !missing_only )
+                      batch.remove( stored.key() );
+              }
+              batch.commit();
+          }
+
+          std::vector<uint32_t> resolutions;
+          for( const uint32_t resolution : _market_candle_resolutions )
+          {
+              if( resolution == 0 )
+                  continue;
+              const auto first = _market_candle_db.lower_bound( market_candle_key( resolution ) );
+              if( !missing_only || !first.valid() || first.key().resolution != resolution )
+                  resolutions.push_back( resolution );
+          }
+          if( resolutions.empty() )
+              return;
+
+          const auto start_time = fc::time_point::now();
+          for( auto itr = _market_history_db.begin(); itr.valid(); ++itr )
+              update_market_candles( itr.key(), itr.value(), resolutions );
+          ilog( "Built market candles of ${r} second resolutions in ${t} ms",
+                ("r",resolutions)("t",(fc::time_point::now() - start_time).count() / 1000) );
+      } FC_CAPTURE_AND_RETHROW( (missing_only) ) }
+
+      void chain_database_impl::prune_market_history()
+      { try {
+          if( _market_history_retention_sec == 0 )
+              return;
+          const uint32_t head_time = _head_block_header.timestamp.sec_since_epoch();
+          if( head_time <= _market_history_retention_sec )
+              return;
+          uint32_t prune_before = head_time - _market_history_retention_sec;
+          prune_before -= prune_before % (60*60*24);
+          if( prune_before < _market_history_pruned_until.sec_since_epoch() + BTS_BLOCKCHAIN_MARKET_HISTORY_PRUNE_INTERVAL_SEC )
+              return;
+
+          /* keys order by market, then granularity, then time, so each market's expired block rows come first */
+          const auto start_time = fc::time_point::now();
+          std::vector<market_history_key> expired;
+          auto itr = _market_history_db.begin();
+          while( itr.valid() )
+          {
+              const market_history_key key = itr.key();
+              if( key.granularity == market_history_key::each_block && key.timestamp.sec_since_epoch() < prune_before )
+              {
+                  expired.push_back( key );
+                  ++itr;
+              }
+              else
+              {
+                  itr = _market_history_db.lower_bound( market_history_key( asset_id_type( key.quote_id.value + 1 ), key.base_id ) );
+              }
+          }
+
+          for( size_t i = 0; i < expired.size(); )
+          {
+              auto batch = _market_history_db.create_batch();
+              for( const size_t end = std::min<size_t>( expired.size(), i + 10000 ); i < end; ++i )
+                  batch.remove( expired[ i ] );
+              batch.commit();
+          }
+          _market_history_pruned_until = fc::time_point_sec( prune_before );
+          if( !expired.empty() )
+              ilog( "Pruned ${n} block rows of market history before ${t} in ${ms} ms",
+                    ("n",expired.size())("t",_market_history_pruned_until)("ms",(fc::time_point::now() - start_time).count() / 1000) );
+      } FC_CAPTURE_AND_RETHROW() }
+
+      static std::set<market_transaction_index_key> market_transaction_index_keys( uint32_t block_num,
+                                                                                   const std::vector<market_transaction>& trxs )
+      {
+          std::set<market_transaction_index_key> keys;
+          for( uint32_t i = 0; i < trxs.size(); ++i )
+          {
+              const price& pair = trxs[i].ask_price;
+              keys.insert( market_transaction_index_key( pair.base_asset_id, pair.quote_asset_id, address(), block_num, i ) );
+              keys.insert( market_transaction_index_key( pair.base_asset_id, pair.quote_asset_id, trxs[i].bid_owner, block_num, i ) );
+              keys.insert( market_transaction_index_key( pair.base_asset_id, pair.quote_asset_id, trxs[i].ask_owner, block_num, i ) );
+          }
+          return keys;
+      }
+
+      /** builds the whole index from the stored market transactions, or only when the index has nothing yet */
+      void chain_database_impl::rebuild_market_transaction_index( bool missing_only )
+      { try {
+          if( missing_only && _market_transaction_index_db.begin().valid() )
+              return;
+
+          for( auto itr = _market_transaction_index_db.begin(); itr.valid(); )
+          {
+              auto batch = _market_transaction_index_db.create_batch();
+              for( uint32_t i = 0; itr.valid() && i < 10000; ++itr, ++i )
+                  batch.remove( itr.key() );
+              batch.commit();
+          }
+
+          const auto start_time = fc::time_point::now();
+          for( auto itr = _market_transactions_db.begin(); itr.valid(); ++itr )
+          {
+              auto batch = _market_transaction_index_db.create_batch();
+              for( const auto& key : market_transaction_index_keys( itr.key(), itr.value() ) )
+                  batch.store( key, 0 );
+              batch.commit();
+          }
+          ilog( "Indexed market transactions in ${t} ms", ("t",(fc::time_point::now() - start_time).count() / 1000) );
+      } FC_CAPTURE_AND_RETHROW( (missing_only) ) }
+
+      /** copies every transaction record into _block_transaction_db, or only when it has nothing yet */
+      void chain_database_impl::rebuild_block_transaction_index( bool missing_only )
+      { try {
+          if( missing_only && ( _block_transaction_db.begin().valid() || !_id_to_transaction_record_db.begin().valid() ) )
+              return;
+
+          for( auto itr = _block_transaction_db.begin(); itr.valid(); )
+          {
+              auto batch = _block_transaction_db.create_batch();
+              for( uint32_t i = 0; itr.valid() && i < 10000; ++itr, ++i )
+                  batch.remove( itr.key() );
+              batch.commit();
+          }
+
+          const auto start_time = fc::time_point::now();
+          for( auto itr = _id_to_transaction_record_db.begin(); itr.valid(); )
+          {
+              auto batch = _block_transaction_db.create_batch();
+              for( uint32_t i = 0; itr.valid() && i < 10000; ++itr, ++i )
+              {
+                  const transaction_record record = itr.value();
+                  batch.store( block_transaction_key( record.chain_location ), record );
+              }
+              batch.commit();
+          }
+          ilog( "Grouped transaction records by block in ${t} ms", ("t",(fc::time_point::now() - start_time).count() / 1000) );
+      } FC_CAPTURE_AND_RETHROW( (missing_only) ) }
+
+      oblock_record chain_database_impl::fetch_block_record( const block_id_type& block_id )const
+      {
+          const auto itr = _block_record_cache.find( block_id );
+          if( itr != _block_record_cache.end() )
+          {
+              _block_record_lru.splice( _block_record_lru.begin(), _block_record_lru, itr->second );
+              return *itr->second;
+          }
+
+          const oblock_record record = _block_id_to_block_record_db.fetch_optional( block_id );
+          if( record.valid() )
+              cache_block_record( block_id, *record );
+          return record;
+      }
+
+      void chain_database_impl::store_block_record( const block_id_type& block_id, const block_record& record )
+      {
+          _block_id_to_block_record_db.store( block_id, record );
+          cache_block_record( block_id, record );
+      }
+
+      void chain_database_impl::cache_block_record( const block_id_type& block_id, const block_record& record )const
+      {
+          const auto itr = _block_record_cache.find( block_id );
+          if( itr != _block_record_cache.end() )
+          {
+              *itr->second = record;
+              _block_record_lru.splice( _block_record_lru.begin(), _block_record_lru, itr->second );
+              return;
+          }
+
+          _block_record_lru.push_front( record );
+          _block_record_cache[ block_id ] = _block_record_lru.begin();
+          if( _block_record_lru.size() > BTS_BLOCKCHAIN_BLOCK_RECORD_CACHE_SIZE )
+          {
+              _block_record_cache.erase( _block_record_lru.back().id() );
+              _block_record_lru.pop_back();
+          }
+      }
+
+      void chain_database_impl::uncache_block_record( const block_id_type& block_id )
+      {
+          const auto itr = _block_record_cache.find( block_id );
+          if( itr == _block_record_cache.end() )
+              return;
+          _block_record_lru.erase( itr->second );
+          _block_record_cache.erase( itr );
+      }
+
+      const std::vector<ranked_delegate>& chain_database_impl::delegate_ranking()const
+      { try {
+          if( !_delegate_ranking_valid )
+          {
+              _delegate_ranking.clear();
+              _delegate_ranking.reserve( _delegate_vote_index_db.size() );
+              for( auto itr = _delegate_vote_index_db.begin(); itr.valid(); ++itr )
+              {
+                  const auto record = self->get_account_record( itr.key().delegate_id );
+                  FC_ASSERT( record.valid(), "Unknown delegate ID in votes database.", ("delegate_id",itr.key().delegate_id) );
+                  _delegate_ranking.push_back( ranked_delegate{ itr.key(), std::make_shared<const account_record>( *record ) } );
+              }
+              _delegate_ranking_valid = true;
+          }
+          return _delegate_ranking;
+      } FC_CAPTURE_AND_RETHROW() }
+
+      /** moves the delegate to its new place, or drops it; the record is replaced even when the votes are unchanged */
+      void chain_database_impl::update_delegate_ranking( const oaccount_record& old_rec, const account_record& record )
+      {
+          if( !_delegate_ranking_valid )
+              return;
+
+          const auto position = [ this ]( const vote_del& vote )
+          {
+              return std::lower_bound( _delegate_ranking.begin(), _delegate_ranking.end(), vote,
+                                       []( const ranked_delegate& a, const vote_del& b ) { return a.vote < b; } );
+          };
+
+          if( old_rec.valid() && old_rec->is_delegate() )
+          {
+              const vote_del old_vote( old_rec->net_votes(), old_rec->id );
+              const auto itr = position( old_vote );
+              if( itr != _delegate_ranking.end() && itr->vote == old_vote )
+                  _delegate_ranking.erase( itr );
+          }
+
+          if( !record.is_null() && record.is_delegate() )
+          {
+              const vote_del new_vote( record.net_votes(), record.id );
+              _delegate_ranking.insert( position( new_vote ), ranked_delegate{ new_vote, std::make_shared<const account_record>( record ) } );
+          }
+      }
+
+      const std::vector<account_id_type>& chain_database_impl::active_delegates()const
+      { try {
+          if( !_active_delegates.valid() )
+          {
+              _active_delegates = _property_db.fetch( active_delegate_list_id ).as<std::vector<account_id_type>>();
+              _sorted_active_delegates = *_active_delegates;
+              std::sort( _sorted_active_delegates.begin(), _sorted_active_delegates.end() );
+          }
+          return *_active_delegates;
+      } FC_CAPTURE_AND_RETHROW() }
+
+      const std::vector<account_id_type>& chain_database_impl::sorted_active_delegates()const
+      {
+          active_delegates();
+          return _sorted_active_delegates;
+      }
+
+      const fc::ripemd160& chain_database_impl::random_seed()const
+      { try {
+          if( !_random_seed.valid() )
+              _random_seed = _property_db.fetch( last_random_seed_id ).as<fc::ripemd160>();
+          return *_random_seed;
+      } FC_CAPTURE_AND_RETHROW() }
+
+      void chain_database_impl::clear_property_cache()
+      {
+          _active_delegates.reset();
+          _sorted_active_delegates.clear();
+          _random_seed.reset();
+          _median_feed_prices.clear();
+      }
+
+      asset chain_database_impl::scan_debt( const asset_id_type& asset_id )const
+      {
+          const auto record = self->get_asset_record( asset_id );
+          FC_ASSERT( record.valid() && record->is_market_issued() );
+
+          asset total( 0, asset_id );
+
+          for( auto itr = _collateral_db.begin(); itr.valid(); ++itr )
+          {
+              if( itr.key().order_price.quote_asset_id == asset_id )
+                  total.amount += itr.value().payoff_balance;
+          }
+
+          return total;
+      }
+
+      asset chain_database_impl::scan_unclaimed_genesis()const
+      {
+           auto balance = _balance_db.begin();
+           asset unclaimed_total(0);
+           auto genesis_date = self->get_genesis_timestamp();
+
+           while (balance.valid()) {
+               if (balance.value().last_update <= genesis_date)
+                   unclaimed_total += balance.value().get_balance();
+
+               ++balance;
+           }
+
+           return unclaimed_total;
+      }
+
+      integrity_report chain_database_impl::check_integrity()
+      { try {
+          _integrity_scans.erase( std::remove_if( _integrity_scans.begin(), _integrity_scans.end(),
+                                                  []( const fc::future<void>& scan ) { return scan.ready(); } ),
+                                  _integrity_scans.end() );
+          FC_ASSERT( _integrity_scans.empty(), "an integrity check is already running" );
+          FC_ASSERT( !_unified_store.in_batch() && !_deferred_asset_totals.valid(), "a block is being applied" );
+
+          const auto start_time = fc::time_point::now();
+          integrity_report report;
+          report.block_num = _head_block_header.block_num;
+          report.block_id = _head_block_id;
+          report.checked_at = start_time;
+          /* Everything the scans read or fill is shared with them: a canceled check leaves them running for
+             close() to wait for, after this frame is gone */
+          struct integrity_check
+          {
+              time_point_sec                              genesis_time;
+              std::shared_ptr<const leveldb::Snapshot>    balances;
+              std::shared_ptr<const leveldb::Snapshot>    asks;
+              std::shared_ptr<const leveldb::Snapshot>    bids;
+              std::shared_ptr<const leveldb::Snapshot>    shorts;
+              std::shared_ptr<const leveldb::Snapshot>    collateral;
+              std::shared_ptr<const leveldb::Snapshot>    accounts;
+              std::shared_ptr<const leveldb::Snapshot>    assets;
+              std::shared_ptr<const leveldb::Snapshot>    stored_totals;
+              std::vector<optional<balance_id_type>>      shard_bounds;
+              std::deque<integrity_scan>                  scans;
+              std::map<asset_id_type, asset_totals>       stored;
+          };
+          const auto check = std::make_shared<integrity_check>();
+          check->genesis_time = self->get_genesis_timestamp();
+
+          /* taken without yielding, so every table shows the same block */
+          check->balances = _balance_db.take_snapshot();
+          check->asks = _ask_db.take_snapshot();
+          check->bids = _bid_db.take_snapshot();
+          check->shorts = _short_db.take_snapshot();
+          check->collateral = _collateral_db.take_snapshot();
+          check->accounts = _account_db.take_snapshot();
+          check->assets = _asset_db.take_snapshot();
+          check->stored_totals = _asset_totals_db.take_snapshot();
+
+          start_signature_recovery_threads();
+          const size_t balance_shards = _signature_recovery_threads.size();
+          check->shard_bounds.resize( balance_shards + 1 );
+          for( size_t i = 1; i < balance_shards; ++i )
+          {
+              balance_id_type bound;
+              bound.addr.data()[0] = char( i * 256 / balance_shards );
+              check->shard_bounds[ i ] = bound;
+          }
+
+          const auto run_scan = [&]( const std::function<void( integrity_check&, integrity_scan& )>& scan )
+          {
+              check->scans.emplace_back();
+              integrity_scan& result = check->scans.back();
+              _integrity_scans.push_back( _signature_recovery_threads[ _integrity_scans.size() % _signature_recovery_threads.size() ]->async(
+                                              [check, &result, scan](){ scan( *check, result ); }, "integrity_scan" ) );
+          };
+          const std::atomic<bool>& stop = _stop_integrity_scans;
+
+          for( size_t i = 0; i < balance_shards; ++i )
+          {
+              run_scan( [this, &stop, i]( integrity_check& check, integrity_scan& result )
+              {
+                  for( auto itr = _balance_db.snapshot_range( check.balances, check.shard_bounds[ i ], check.shard_bounds[ i + 1 ] ); itr.valid() && !stop; ++itr )
+                  {
+                      const asset balance = itr.value().get_balance();
+                      if( balance.amount < 0 )
+                          result.errors.push_back( "balance " + string( itr.key() ) + " is negative" );
+                      result.totals[ balance.asset_id ].supply += balance.amount;
+                      if( itr.value().last_update <= check.genesis_time )
+                          result.totals[ balance.asset_id ].unclaimed_genesis += balance.amount;
+                  }
+              } );
+          }
+
+          run_scan( [this, &stop]( integrity_check& check, integrity_scan& result )
+          {
+              for( auto itr = _ask_db.snapshot_range( check.asks ); itr.valid() && !stop; ++itr )
+              {
+                  if( itr.value().balance < 0 )
+                      result.errors.push_back( "ask " + fc::json::to_string( itr.key() ) + " has a negative balance" );
+                  result.totals[ itr.key().order_price.base_asset_id ].supply += itr.value().balance;
+              }
+              for( auto itr = _bid_db.snapshot_range( check.bids ); itr.valid() && !stop; ++itr )
+              {
+                  if( itr.value().balance < 0 )
+                      result.errors.push_back( "bid " + fc::json::to_string( itr.key() ) + " has a negative balance" );
+                  if( itr.key().order_price.quote_asset_id != asset_id_type( 0 ) )
+                      result.totals[ itr.key().order_price.quote_asset_id ].supply += itr.value().balance;
+              }
+              for( auto itr = _short_db.snapshot_range( check.shorts ); itr.valid() && !stop; ++itr )
+              {
+                  if( itr.value().balance < 0 )
+                      result.errors.push_back( "short " + fc::json::to_string( itr.key() ) + " has a negative balance" );
+                  result.totals[ asset_id_type( 0 ) ].supply += itr.value().balance;
+              }
+          } );
+
+          run_scan( [this, &stop]( integrity_check& check, integrity_scan& result )
+          {
+              for( auto itr = _collateral_db.snapshot_range( check.collateral ); itr.valid() && !stop; ++itr )
+              {
+                  const collateral_record& record = itr.value();
+                  if( record.collateral_balance < 0 || record.payoff_balance < 0 )
+                      result.errors.push_back( "collateral " + fc::json::to_string( itr.key() ) + " has a negative balance" );
+                  result.totals[ asset_id_type( 0 ) ].supply += record.collateral_balance;
+                  result.totals[ itr.key().order_price.quote_asset_id ].debt += record.payoff_balance;
+              }
+          } );
+
+          run_scan( [this, &stop]( integrity_check& check, integrity_scan& result )
+          {
+              for( auto itr = _account_db.snapshot_range( check.accounts ); itr.valid() && !stop; ++itr )
+              {
+                  if( !itr.value().delegate_info.valid() )
+                      continue;
+                  if( itr.value().delegate_info->pay_balance < 0 )
+                      result.errors.push_back( "delegate " + itr.value().name + " has a negative pay balance" );
+                  result.totals[ asset_id_type( 0 ) ].supply += itr.value().delegate_info->pay_balance;
+              }
+          } );
+
+          run_scan( [this, &stop]( integrity_check& check, integrity_scan& result )
+          {
+              for( auto itr = _asset_db.snapshot_range( check.assets ); itr.valid() && !stop; ++itr )
+              {
+                  const asset_record& record = itr.value();
+                  if( record.current_share_supply > record.maximum_share_supply )
+                      result.errors.push_back( record.symbol + " supply exceeds its maximum" );
+                  check.stored[ record.id ];
+              }
+              for( auto itr = _asset_totals_db.snapshot_range( check.stored_totals ); itr.valid() && !stop; ++itr )
+                  check.stored[ itr.key() ] = itr.value();
+          } );
+
+          fc::exception_ptr scan_error;
+          for( auto& scan : _integrity_scans )
+          {
+              try
+              {
+                  scan.wait();
+              }
+              catch( const fc::exception& e )
+              {
+                  if( !scan_error )
+                      scan_error = e.dynamic_copy_exception();
+              }
+          }
+          /* scans still running when this task was canceled are left for close() to wait for; they hold check */
+          if( scan_error )
+              scan_error->dynamic_rethrow_exception();
+          _integrity_scans.clear();
+          FC_ASSERT( !_stop_integrity_scans, "the integrity check was stopped" );
+
+          std::map<asset_id_type, asset_totals>& stored = check->stored;
+          std::map<asset_id_type, asset_totals> scanned;
+          for( const auto& scan : check->scans )
+          {
+              for( const auto& item : scan.totals )
+              {
+                  scanned[ item.first ].supply += item.second.supply;
+                  scanned[ item.first ].debt += item.second.debt;
+                  scanned[ item.first ].unclaimed_genesis += item.second.unclaimed_genesis;
+              }
+              report.errors.insert( report.errors.end(), scan.errors.begin(), scan.errors.end() );
+          }
+          for( const auto& item : scanned )
+              stored[ item.first ];
+
+          const auto compare = [&]( const asset_id_type& asset_id, const string& total, share_type stored_amount, share_type scanned_amount )
+          {
+              if( stored_amount == scanned_amount ) return;
+              integrity_drift drift;
+              drift.asset_id = asset_id;
+              drift.total = total;
+              drift.stored = stored_amount;
+              drift.scanned = scanned_amount;
+              report.drift.push_back( drift );
+          };
+          for( const auto& item : stored )
+          {
+              const asset_totals& found = scanned[ item.first ];
+              compare( item.first, "supply", item.second.supply, found.supply );
+              compare( item.first, "debt", item.second.debt, found.debt );
+              if( item.first == asset_id_type( 0 ) )
+                  compare( item.first, "unclaimed_genesis", item.second.unclaimed_genesis, found.unclaimed_genesis );
+          }
+
+          report.elapsed_ms = ( fc::time_point::now() - start_time ).count() / 1000;
+          _last_integrity_report = report;
+          return report;
+      } FC_CAPTURE_AND_RETHROW() }
+
+      void chain_database_impl::integrity_check_loop()
+      {
+          try
+          {
+              const integrity_report report = check_integrity();
+              if( report.ok() )
+                  ilog( "Integrity check at block ${n} passed in ${t} ms", ("n",report.block_num)("t",report.elapsed_ms) );
+              else
+                  wlog( "Integrity check at block ${n} found problems: ${r}", ("n",report.block_num)("r",report) );
+          }
+          catch( const fc::canceled_exception& )
+          {
+              throw;
+          }
+          catch( const fc::exception& e )
+          {
+              wlog( "Integrity check did not complete: ${e}", ("e",e.to_detail_string()) );
+          }
+
+          _integrity_check_loop = fc::schedule( [this](){ integrity_check_loop(); },
+                                                fc::time_point::now() + fc::seconds( _integrity_check_interval_sec ),
+                                                "integrity_check" );
+      }
+
+      void chain_database_impl::wait_for_integrity_scans()
+      {
+          _stop_integrity_scans = true;
+          for( auto& scan : _integrity_scans )
+          {
+              try
+              {
+                  scan.wait();
+              }
+              catch( const fc::exception& )
+              {
+              }
+          }
+          _integrity_scans.clear();
+          _stop_integrity_scans = false;
+      }
+
+      /**
+       *  Runs read, which must touch nothing but LevelDB snapshots and its own captures, on the next worker
+       *  thread, and waits for it. This thread keeps applying blocks and serving other calls meanwhile, and
+       *  concurrent queries spread over the workers.
+       */
+      void chain_database_impl::run_snapshot_read( const std::function<void()>& read, const char* description )
+      {
+          start_signature_recovery_threads();
+          _snapshot_reads.erase( std::remove_if( _snapshot_reads.begin(), _snapshot_reads.end(),
+                                                 []( const fc::future<void>& r ) { return r.ready(); } ),
+                                 _snapshot_reads.end() );
+          fc::future<void> done = _signature_recovery_threads[ _next_snapshot_reader++ % _signature_recovery_threads.size() ]->async( read, description );
+          _snapshot_reads.push_back( done );
+          done.wait();
+      }
+
+      void chain_database_impl::wait_for_snapshot_reads()
+      {
+          for( auto& read : _snapshot_reads )
+          {
+              try
+              {
+                  read.wait();
+              }
+              catch( const fc::exception& )
+              {
+              }
+          }
+          _snapshot_reads.clear();
+      }
+
+      /** the listing token names, or a new one over take_snapshots that token is set to if it is empty */
+      list_cursor chain_database_impl::find_list_cursor( const string& listing, string& token,
+                                                         const std::function<std::vector<std::shared_ptr<const leveldb::Snapshot>>()>& take_snapshots )
+      {
+          const fc::time_point now = fc::time_point::now();
+          for( auto itr = _list_cursors.begin(); itr != _list_cursors.end(); )
+          {
+              if( itr->second.expiration <= now )
+                  itr = _list_cursors.erase( itr );
+              else
+                  ++itr;
+          }
+
+          if( !token.empty() )
+          {
+              const auto itr = _list_cursors.find( token );
+              FC_ASSERT( itr != _list_cursors.end() && itr->second.listing == listing,
+                         "unknown or expired cursor ${token}", ("token",token) );
+              return itr->second;
+          }
 
-// the definition of detail::chain_database_impl is moved to a separate file so it can be shared by the market_engine(s)
-#include <bts/blockchain/chain_database_impl.hpp>
-#include <bts/blockchain/market_engine.hpp>
+          FC_ASSERT( !_unified_store.in_batch(), "a listing cannot start while a block is being applied" );
+          if( _list_cursors.size() >= BTS_BLOCKCHAIN_MAX_LIST_CURSORS )
+          {
+              // the listing left alone the longest makes room
+              _list_cursors.erase( std::min_element( _list_cursors.begin(), _list_cursors.end(),
+                                                     []( const std::pair<const string, list_cursor>& a,
+                                                         const std::pair<const string, list_cursor>& b )
+                                                     { return a.second.expiration < b.second.expiration; } ) );
+          }
 
-#include <bts/blockchain/fork_blocks.hpp>
+          list_cursor cursor;
+          cursor.listing = listing;
+          cursor.snapshots = take_snapshots();
+          cursor.expiration = now + fc::seconds( BTS_BLOCKCHAIN_LIST_CURSOR_TTL_SEC );
+          token = std::to_string( ++_next_list_cursor );
+          _list_cursors[ token ] = cursor;
+          return cursor;
+      }
 
-namespace bts { namespace blockchain {
+      /** moves the listing past last_key, or ends it and clears token if last_key is empty */
+      void chain_database_impl::advance_list_cursor( string& token, std::vector<char> last_key )
+      {
+          const auto itr = _list_cursors.find( token );
+          if( last_key.empty() )
+          {
+              if( itr != _list_cursors.end() )
+                  _list_cursors.erase( itr );
+              token.clear();
+              return;
+          }
+          FC_ASSERT( itr != _list_cursors.end(), "cursor ${token} expired while its page was read", ("token",token) );
+          itr->second.last_key = std::move( last_key );
+          itr->second.expiration = fc::time_point::now() + fc::seconds( BTS_BLOCKCHAIN_LIST_CURSOR_TTL_SEC );
+      }
 
-   namespace detail
-   {
+      /**
+       *  Rebuilds the pool state after the chain changed. The previous evaluations are visited in the
+       *  order they were applied; one that touched nothing the chain or a redone evaluation changed
+       *  would come out the same and is reapplied as is, the others are evaluated again.
+       *
+       *  Reapplied evaluations keep the timestamps of their first evaluation. That only affects the
+       *  pool state; blocks are generated and pushed from fresh evaluations.
+       */
       void chain_database_impl::revalidate_pending()
       {
+            bts::utilities::stall_detector::scope stall_scope( "revalidate_pending" );
             _pending_fee_index.clear();
 
+            std::vector<pending_evaluation> previous = std::move( _revalidation_base );
+            for( auto& evaluation : _pending_evaluations )
+            {
+                evaluation.reusable = false;
+                previous.push_back( std::move( evaluation ) );
+            }
+            _revalidation_base.clear();
+            _pending_evaluations.clear();
+
+            state_access_set changed = std::move( _pending_block_changes );
+            _pending_block_changes.clear();
+
             vector<digest_type> trx_to_discard;
+            std::unordered_set<digest_type> considered;
+            unsigned num_reused = 0;
 
             _pending_trx_state = std::make_shared<pending_chain_state>( self->shared_from_this() );
-            unsigned num_pending_transaction_considered = 0;
-            auto itr = _pending_transaction_db.begin();
-            while( itr.valid() )
+
+            const auto evaluate = [&]( const signed_transaction& trx, const digest_type& trx_id )
             {
-                signed_transaction trx = itr.value();
-                digest_type trx_id = itr.key();
                 assert(trx_id == trx.digest(_chain_id));
                 try
                 {
-                  transaction_evaluation_state_ptr eval_state = self->evaluate_transaction( trx, _relay_fee );
-                  share_type fees = eval_state->get_fees();
-                  _pending_fee_index[ fee_index( fees, trx.id() ) ] = eval_state;
-                  wlog("revalidated pending transaction id ${id} ${i}", ("id", trx_id)("i",trx.id()));
+                  pending_evaluation evaluation = evaluate_pending( trx, _relay_fee );
+                  share_type fees = evaluation.eval_state->get_fees();
+                  const transaction_id_type id = evaluation.eval_state->trx_id();
+                  _pending_fee_index[ fee_index( fees, id ) ] = evaluation.eval_state;
+                  changed.insert( evaluation.writes );
+                  _pending_evaluations.push_back( std::move( evaluation ) );
+                  hot_dlog("revalidated pending transaction id ${id} ${i}", ("id", trx_id)("i",id));
                 }
                 catch ( const fc::canceled_exception& )
                 {
@@ -68,18 +1038,487 @@ namespace bts { namespace blockchain {
                 catch ( const fc::exception& e )
                 {
                   trx_to_discard.push_back(trx_id);
-                  wlog( "discarding invalid transaction: ${id} ${e}",
+                  hot_wlog( "discarding invalid transaction: ${id} ${e}",
                         ("id",trx_id)("e",e.to_detail_string()) );
                 }
+            };
+
+            for( auto& evaluation : previous )
+            {
+                if( !considered.insert( evaluation.id ).second )
+                    continue;
+
+                const auto trx = _pending_transaction_db.fetch_optional( evaluation.id );
+                if( !trx.valid() )
+                {
+                    // confirmed or discarded, so what it changed is no longer part of the pool
+                    changed.insert( evaluation.writes );
+                    continue;
+                }
+
+                if( evaluation.reusable && trx->expiration > self->now() && !evaluation.accesses.intersects( changed ) )
+                {
+                    reapply_pending( evaluation );
+                    _pending_fee_index[ fee_index( evaluation.eval_state->get_fees(), trx->id() ) ] = evaluation.eval_state;
+                    _pending_evaluations.push_back( std::move( evaluation ) );
+                    ++num_reused;
+                    continue;
+                }
+
+                changed.insert( evaluation.writes );
+                evaluate( *trx, evaluation.id );
+            }
+
+            unsigned num_pending_transaction_considered = considered.size();
+            for( auto itr = _pending_transaction_db.begin(); itr.valid(); ++itr )
+            {
+                if( considered.count( itr.key() ) )
+                    continue;
+                evaluate( itr.value(), itr.key() );
                 ++num_pending_transaction_considered;
-                ++itr;
             }
 
             for( const auto& item : trx_to_discard )
-                _pending_transaction_db.remove( item );
-            wlog("revalidate_pending complete, there are now ${pending_count} evaluated transactions, ${num_pending_transaction_considered} raw transactions",
+                remove_pending( item );
+
+            if( _block_template_time.valid() && *_block_template_time > _head_block_header.timestamp )
+            {
+                try
+                {
+                    build_block_template( *_block_template_time );
+                }
+                catch ( const fc::canceled_exception& )
+                {
+                    throw;
+                }
+                catch( const fc::exception& e )
+                {
+                    wlog( "unable to rebuild the block template: ${e}", ("e",e.to_detail_string()) );
+                }
+            }
+
+            wlog("revalidate_pending complete, there are now ${pending_count} evaluated transactions, ${num_pending_transaction_considered} raw transactions, ${num_reused} reused",
                  ("pending_count", _pending_fee_index.size())
-                 ("num_pending_transaction_considered", num_pending_transaction_considered));
+                 ("num_pending_transaction_considered", num_pending_transaction_considered)
+                 ("num_reused", num_reused));
+      }
+
+      pending_evaluation chain_database_impl::evaluate_pending( const signed_transaction& trx, const share_type& required_fees,
+                                                                bool enforce_pool_limits )
+      { try {
+          if( !_pending_trx_state )
+             _pending_trx_state = std::make_shared<pending_chain_state>( self->shared_from_this() );
+
+          pending_evaluation evaluation;
+          evaluation.changes = std::make_shared<pending_chain_state>( _pending_trx_state );
+          evaluation.changes->track_reads();
+          evaluation.eval_state = std::make_shared<transaction_evaluation_state>( evaluation.changes.get(), _chain_id );
+
+          const auto& trx_eval_state = evaluation.eval_state;
+          trx_eval_state->evaluate( trx, false, evaluation.changes->get_head_block_num() > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM );
+          evaluation.id = trx_eval_state->trx_digest( _chain_id );
+          auto fees = trx_eval_state->get_fees() + trx_eval_state->alt_fees_paid.amount;
+          if( fees < required_fees )
+          {
+              hot_wlog("Transaction ${id} needed relay fee ${required_fees} but only had ${fees}", ("id", trx_eval_state->trx_id())("required_fees",required_fees)("fees",fees));
+              FC_CAPTURE_AND_THROW( insufficient_relay_fee, (fees)(required_fees) );
+          }
+          if( enforce_pool_limits )
+             make_room_in_pending_pool( *trx_eval_state, fees );
+
+          note_pending_accesses( evaluation );
+
+          // apply changes from this transaction to _pending_trx_state
+          evaluation.changes->apply_changes();
+
+          return evaluation;
+      } FC_CAPTURE_AND_RETHROW( (trx) ) }
+
+      /**
+       *  Admits a new transaction to the pool, or throws. Its signers must each have room for another
+       *  pending transaction, it may not carry more market operations than one fee pays for, and if the
+       *  pool is over budget with it, the transactions paying the least per byte are evicted, as long as
+       *  they pay less than it does.
+       */
+      void chain_database_impl::make_room_in_pending_pool( const transaction_evaluation_state& eval_state,
+                                                           const share_type& fees )
+      {
+          const size_t market_operations = eval_state.trx.market_operation_count();
+          if( market_operations > BTS_BLOCKCHAIN_MAX_MARKET_OPERATIONS_PER_TRANSACTION )
+             FC_CAPTURE_AND_THROW( too_many_market_operations, (market_operations) );
+
+          for( const address& signer : eval_state.signed_keys )
+          {
+             const auto count = _pending_per_signer.find( signer );
+             if( count != _pending_per_signer.end() && count->second >= BTS_BLOCKCHAIN_MAX_PENDING_TRANSACTIONS_PER_SIGNER )
+                FC_CAPTURE_AND_THROW( too_many_pending_transactions, (signer)(count->second) );
+          }
+
+          const size_t size = eval_state.trx_size();
+          const double fee_rate = double( fees ) / std::max<size_t>( size, 1 );
+          while( _pending_pool_bytes + size > _pending_pool_budget )
+          {
+             if( _pending_by_fee_rate.empty() || _pending_by_fee_rate.begin()->first >= fee_rate )
+                FC_CAPTURE_AND_THROW( pending_pool_full, (fee_rate)(_pending_pool_bytes)(_pending_pool_budget) );
+             evict_pending( _pending_by_fee_rate.begin()->second );
+          }
+      }
+
+      void chain_database_impl::track_pending( const digest_type& id, const transaction_evaluation_state& eval_state,
+                                               const share_type& fees )
+      {
+          if( _pending_pool.count( id ) )
+             return;
+
+          pending_pool_entry& entry = _pending_pool[ id ];
+          entry.size = eval_state.trx_size();
+          entry.fee_rate = double( fees ) / std::max<size_t>( entry.size, 1 );
+          entry.expiration = eval_state.trx.expiration;
+          entry.signers.assign( eval_state.signed_keys.begin(), eval_state.signed_keys.end() );
+
+          _pending_by_fee_rate.emplace( entry.fee_rate, id );
+          _pending_by_expiration.emplace( entry.expiration, id );
+          for( const address& signer : entry.signers )
+             ++_pending_per_signer[ signer ];
+          _pending_pool_bytes += entry.size;
+      }
+
+      /** takes the transaction out of the pool; revalidate_pending drops what it did to the pool state */
+      void chain_database_impl::remove_pending( const digest_type& id )
+      {
+          _pending_transaction_db.remove( id );
+
+          const auto itr = _pending_pool.find( id );
+          if( itr == _pending_pool.end() )
+             return;
+          const pending_pool_entry& entry = itr->second;
+          _pending_by_fee_rate.erase( std::make_pair( entry.fee_rate, id ) );
+          _pending_by_expiration.erase( std::make_pair( entry.expiration, id ) );
+          for( const address& signer : entry.signers )
+          {
+             auto count = _pending_per_signer.find( signer );
+             if( count != _pending_per_signer.end() && --count->second == 0 )
+                _pending_per_signer.erase( count );
+          }
+          _pending_pool_bytes -= entry.size;
+          _pending_pool.erase( itr );
+      }
+
+      /**
+       *  Removes the transaction and frees its evaluation right away. Its writes are noted as changed, so
+       *  revalidate_pending evaluates again whatever built on them.
+       */
+      void chain_database_impl::evict_pending( const digest_type& id )
+      {
+          remove_pending( id );
+
+          const auto evaluation = std::find_if( _pending_evaluations.begin(), _pending_evaluations.end(),
+                                                [&]( const pending_evaluation& e ) { return e.id == id; } );
+          if( evaluation == _pending_evaluations.end() )
+             return;
+          _pending_fee_index.erase( fee_index( evaluation->eval_state->get_fees(), evaluation->eval_state->trx_id() ) );
+          _pending_block_changes.insert( evaluation->writes );
+          _pending_evaluations.erase( evaluation );
+      }
+
+      void chain_database_impl::purge_expired_pending( const time_point_sec& now )
+      {
+          while( !_pending_by_expiration.empty() && _pending_by_expiration.begin()->first <= now )
+             remove_pending( _pending_by_expiration.begin()->second );
+      }
+
+      /**
+       *  Nearly every transaction adds its fee to the base asset record and its votes to delegate
+       *  records, which blocks also change all the time. Where that is all a transaction did to such
+       *  a record, it is kept out of the accesses and replayed as a delta by reapply_pending.
+       *  Must be called before the evaluation is applied to the pool state.
+       */
+      void chain_database_impl::note_pending_accesses( pending_evaluation& evaluation )const
+      {
+          const pending_chain_state& changes = *evaluation.changes;
+          state_access_set reads = *changes.reads();
+          changes.collect_writes( evaluation.writes );
+
+          const auto base_after = changes.assets.find( asset_id_type( 0 ) );
+          const oasset_record base_before = _pending_trx_state->get_asset_record( asset_id_type( 0 ) );
+          if( base_after != changes.assets.end() && base_before.valid() )
+          {
+             asset_record expected = *base_before;
+             expected.collected_fees = base_after->second.collected_fees;
+             if( fc::raw::pack( expected ) == fc::raw::pack( base_after->second ) )
+             {
+                evaluation.base_asset_fees = base_after->second.collected_fees - base_before->collected_fees;
+                reads.assets.erase( asset_id_type( 0 ) );
+                evaluation.writes.assets.erase( asset_id_type( 0 ) );
+             }
+          }
+
+          for( const auto& vote : evaluation.eval_state->net_delegate_votes )
+          {
+             const auto after = changes.accounts.find( vote.first );
+             const oaccount_record before = _pending_trx_state->get_account_record( vote.first );
+             if( after == changes.accounts.end() || !before.valid() || !before->is_delegate() )
+                continue;
+
+             account_record expected = *before;
+             expected.adjust_votes_for( vote.second.votes_for );
+             if( fc::raw::pack( expected ) != fc::raw::pack( after->second ) )
+                continue;
+
+             evaluation.delegate_votes[ vote.first ] = vote.second.votes_for;
+             reads.accounts.erase( vote.first );
+             evaluation.writes.accounts.erase( vote.first );
+             evaluation.writes.account_names.erase( before->name );
+             evaluation.writes.account_addresses.erase( address( before->owner_key ) );
+             for( const auto& item : before->active_key_history )
+                evaluation.writes.account_addresses.erase( address( item.second ) );
+          }
+
+          evaluation.accesses = reads;
+          evaluation.accesses.insert( evaluation.writes );
+      }
+
+      void chain_database_impl::reapply_pending( pending_evaluation& evaluation )
+      { try {
+          pending_chain_state& changes = *evaluation.changes;
+          changes.set_prev_state( _pending_trx_state );
+
+          const auto base = changes.assets.find( asset_id_type( 0 ) );
+          if( base != changes.assets.end() && !evaluation.writes.assets.count( asset_id_type( 0 ) ) )
+          {
+             auto current = _pending_trx_state->get_asset_record( asset_id_type( 0 ) );
+             FC_ASSERT( current.valid() );
+             current->collected_fees += evaluation.base_asset_fees;
+             base->second = *current;
+          }
+
+          for( const auto& vote : evaluation.delegate_votes )
+          {
+             auto current = _pending_trx_state->get_account_record( vote.first );
+             FC_ASSERT( current.valid() && current->is_delegate() );
+             current->adjust_votes_for( vote.second );
+             changes.store_account_record( *current );
+          }
+
+          changes.apply_changes();
+      } FC_CAPTURE_AND_RETHROW( (evaluation.id) ) }
+
+      /** for each key, the last of the pending evaluations seen so far that wrote it */
+      struct pending_writers
+      {
+         std::unordered_map<balance_id_type, size_t>   balances;
+         std::unordered_map<account_id_type, size_t>   accounts;
+         std::unordered_map<string, size_t>            account_names;
+         std::unordered_map<address, size_t>           account_addresses;
+         std::unordered_map<asset_id_type, size_t>     assets;
+         std::unordered_map<string, size_t>            asset_symbols;
+         std::map<market_index_key, size_t>            orders;
+         std::map<feed_index, size_t>                  feeds;
+         std::map<chain_property_type, size_t>         properties;
+         optional<size_t>                              median_prices;
+
+         template<typename Set, typename Map>
+         static void note( const Set& keys, Map& writers, size_t index )
+         {
+            for( const auto& key : keys ) writers[ key ] = index;
+         }
+
+         template<typename Set, typename Map>
+         static void find( const Set& keys, const Map& writers, std::set<size_t>& found )
+         {
+            for( const auto& key : keys )
+            {
+               const auto itr = writers.find( key );
+               if( itr != writers.end() ) found.insert( itr->second );
+            }
+         }
+
+         void note( const state_access_set& writes, size_t index )
+         {
+            note( writes.balances, balances, index );
+            note( writes.accounts, accounts, index );
+            note( writes.account_names, account_names, index );
+            note( writes.account_addresses, account_addresses, index );
+            note( writes.assets, assets, index );
+            note( writes.asset_symbols, asset_symbols, index );
+            note( writes.orders, orders, index );
+            note( writes.feeds, feeds, index );
+            note( writes.properties, properties, index );
+            if( writes.median_prices ) median_prices = index;
+         }
+
+         /** the evaluations that wrote something in accesses */
+         std::set<size_t> find( const state_access_set& accesses )const
+         {
+            std::set<size_t> found;
+            find( accesses.balances, balances, found );
+            find( accesses.accounts, accounts, found );
+            find( accesses.account_names, account_names, found );
+            find( accesses.account_addresses, account_addresses, found );
+            find( accesses.assets, assets, found );
+            find( accesses.asset_symbols, asset_symbols, found );
+            find( accesses.orders, orders, found );
+            find( accesses.feeds, feeds, found );
+            find( accesses.properties, properties, found );
+            if( accesses.median_prices && median_prices.valid() ) found.insert( *median_prices );
+            return found;
+         }
+      };
+
+      /**
+       *  Trying a transaction used to allocate a fresh layer per transaction and tear it down again;
+       *  the scratch layer is cleared instead, which keeps its hash tables' bucket arrays.
+       */
+      void block_template::try_add( const signed_transaction& trx, size_t trx_size, const digest_type& chain_id )
+      {
+          if( !scratch )
+          {
+             scratch = std::make_shared<pending_chain_state>( state );
+             scratch_evaluation = std::make_shared<transaction_evaluation_state>( scratch.get(), chain_id );
+          }
+          scratch->clear();
+
+          scratch_evaluation->evaluate( trx, false, true );
+          scratch->apply_changes();
+          transactions.push_back( trx );
+          transaction_ids.push_back( scratch_evaluation->trx_id() );
+          size += trx_size;
+      }
+
+      /**
+       *  Fills the block for timestamp from the pending evaluations, by fee per byte. A transaction
+       *  that uses the results of other pending transactions is only worth its fee together with
+       *  them, so each is ranked as a package with the pending transactions it depends on that are
+       *  not in the block yet, and the whole package goes in, in pool order.
+       */
+      void chain_database_impl::build_block_template( const time_point_sec& timestamp )
+      { try {
+          const auto start_time = time_point::now();
+
+          auto result = std::make_shared<block_template>();
+          result->head_block_id = _head_block_id;
+          result->timestamp = timestamp;
+          result->state = std::make_shared<pending_chain_state>( self->shared_from_this() );
+          execute_markets( timestamp, result->state );
+
+          const size_t count = _pending_evaluations.size();
+          vector<std::set<size_t>> ancestors( count );
+          vector<share_type> fees( count );
+          vector<size_t> sizes( count );
+          pending_writers writers;
+          for( size_t i = 0; i < count; ++i )
+          {
+             const pending_evaluation& evaluation = _pending_evaluations[ i ];
+             for( const size_t parent : writers.find( evaluation.accesses ) )
+             {
+                ancestors[ i ].insert( parent );
+                ancestors[ i ].insert( ancestors[ parent ].begin(), ancestors[ parent ].end() );
+             }
+             writers.note( evaluation.writes, i );
+             fees[ i ] = evaluation.eval_state->get_fees();
+             sizes[ i ] = evaluation.eval_state->trx_size();
+          }
+
+          vector<bool> done( count, false );
+          const auto package_rate = [&]( size_t i ) -> double
+          {
+             share_type package_fees = fees[ i ];
+             size_t package_size = sizes[ i ];
+             for( const size_t ancestor : ancestors[ i ] )
+             {
+                if( done[ ancestor ] ) continue;
+                package_fees += fees[ ancestor ];
+                package_size += sizes[ ancestor ];
+             }
+             return double( package_fees ) / std::max<size_t>( package_size, 1 );
+          };
+
+          // rates are recomputed when popped, as ancestors going into the block shrink a package
+          std::priority_queue<std::pair<double, size_t>> queue;
+          for( size_t i = 0; i < count; ++i )
+             queue.emplace( package_rate( i ), i );
+
+          while( !queue.empty() )
+          {
+             const auto top = queue.top();
+             queue.pop();
+             const size_t i = top.second;
+             if( done[ i ] ) continue;
+
+             const double rate = package_rate( i );
+             if( rate != top.first )
+             {
+                queue.emplace( rate, i );
+                continue;
+             }
+
+             vector<size_t> package;
+             size_t package_size = 0;
+             for( const size_t ancestor : ancestors[ i ] )
+             {
+                if( done[ ancestor ] ) continue;
+                package.push_back( ancestor );
+                package_size += sizes[ ancestor ];
+             }
+             package.push_back( i );
+             package_size += sizes[ i ];
+
+             // leave it out, but keep going: a smaller package may still fit
+             if( result->size + package_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE )
+                continue;
+
+             for( const size_t member : package )
+             {
+                done[ member ] = true;
+                const signed_transaction& trx = _pending_evaluations[ member ].eval_state->trx;
+                try
+                {
+                   result->try_add( trx, sizes[ member ], _chain_id );
+                }
+                catch ( const fc::canceled_exception& )
+                {
+                   throw;
+                }
+                catch( const fc::exception& e )
+                {
+                   hot_wlog( "Pending transaction was found to be invalid in context of block\n ${trx} \n${e}",
+                         ("trx",fc::json::to_pretty_string(trx))("e",e.to_detail_string()) );
+                }
+             }
+
+             /* Limit the time we spend evaluating transactions */
+             if( time_point::now() - start_time > fc::seconds(5) )
+                break;
+          }
+
+          _block_template = result;
+      } FC_CAPTURE_AND_RETHROW( (timestamp) ) }
+
+      /** adds a newly stored pending transaction to the template if there is room, without reranking */
+      bool chain_database_impl::add_to_block_template( const transaction_evaluation_state& eval_state )
+      {
+          if( !_block_template || _block_template->head_block_id != _head_block_id )
+             return false;
+
+          const signed_transaction& trx = eval_state.trx;
+          const size_t trx_size = eval_state.trx_size();
+          if( _block_template->size + trx_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE )
+             return false;
+
+          try
+          {
+             _block_template->try_add( trx, trx_size, _chain_id );
+          }
+          catch ( const fc::canceled_exception& )
+          {
+             throw;
+          }
+          catch( const fc::exception& e )
+          {
+             hot_wlog( "Pending transaction ${id} does not fit the block template: ${e}", ("id",eval_state.trx_id())("e",e.to_string()) );
+             return false;
+          }
+          return true;
       }
 
       void chain_database_impl::open_database( const fc::path& data_dir )
@@ -93,7 +1532,9 @@ namespace bts { namespace blockchain {
               rebuild_index = true;
           }
 
+          _data_dir = data_dir;
           _property_db.open( data_dir / "index/property_db" );
+          clear_property_cache();
           auto database_version = _property_db.fetch_optional( chain_property_enum::database_version );
           if( !database_version || database_version->as_int64() < BTS_BLOCKCHAIN_DATABASE_VERSION )
           {
@@ -104,63 +1545,432 @@ namespace bts { namespace blockchain {
                 fc::remove_all( data_dir / "index" );
                 fc::create_directories( data_dir / "index" );
                 _property_db.open( data_dir / "index/property_db" );
+                clear_property_cache();
                 rebuild_index = true;
               }
               self->set_property( chain_property_enum::database_version, BTS_BLOCKCHAIN_DATABASE_VERSION );
           }
           else if( database_version && !database_version->is_null() && database_version->as_int64() > BTS_BLOCKCHAIN_DATABASE_VERSION )
           {
-             FC_CAPTURE_AND_THROW( new_database_version, (database_version)(BTS_BLOCKCHAIN_DATABASE_VERSION) );
+             FC_CAPTURE_AND_THROW( new_database_version, (database_version)(BTS_BLOCKCHAIN_DATABASE_VERSION) );
+          }
+          /* Tables read mostly by exact key skip disk reads for missing keys with a bloom filter */
+          bts::db::level_map_options point_lookup_options;
+          point_lookup_options.bloom_filter_bits = BTS_BLOCKCHAIN_DB_BLOOM_FILTER_BITS;
+          /* ...and can serve those reads while a record type upgrade runs, see run_online_upgrades */
+          point_lookup_options.online_upgrade = true;
+
+          if( _use_unified_store )
+          {
+              _market_transactions_db.register_with( _unified_store, market_transactions_table );
+              _fork_number_db.register_with( _unified_store, fork_number_table );
+              _fork_db.register_with( _unified_store, fork_table );
+              _slate_db.register_with( _unified_store, slate_table );
+              _undo_state_db.register_with( _unified_store, undo_state_table );
+              _block_id_to_block_record_db.register_with( _unified_store, block_id_to_block_record_table );
+              _id_to_transaction_record_db.register_with( _unified_store, id_to_transaction_record_table );
+              _pending_transaction_db.register_with( _unified_store, pending_transaction_table );
+              _asset_db.register_with( _unified_store, asset_table );
+              _balance_db.register_with( _unified_store, balance_table );
+              _owner_balance_index_db.register_with( _unified_store, owner_balance_index_table );
+              _asset_totals_db.register_with( _unified_store, asset_totals_table );
+              _burn_db.register_with( _unified_store, burn_table );
+              _account_db.register_with( _unified_store, account_table );
+              _address_to_account_db.register_with( _unified_store, address_to_account_table );
+              _account_index_db.register_with( _unified_store, account_index_table );
+              _symbol_index_db.register_with( _unified_store, symbol_index_table );
+              _delegate_vote_index_db.register_with( _unified_store, delegate_vote_index_table );
+              _slot_record_db.register_with( _unified_store, slot_record_table );
+              _delegate_slot_index_db.register_with( _unified_store, delegate_slot_index_table );
+              _ask_db.register_with( _unified_store, ask_table );
+              _bid_db.register_with( _unified_store, bid_table );
+              _short_db.register_with( _unified_store, short_table );
+              _collateral_db.register_with( _unified_store, collateral_table );
+              _feed_db.register_with( _unified_store, feed_table );
+              _owner_ask_index_db.register_with( _unified_store, owner_ask_index_table );
+              _owner_bid_index_db.register_with( _unified_store, owner_bid_index_table );
+              _owner_short_index_db.register_with( _unified_store, owner_short_index_table );
+              _owner_collateral_index_db.register_with( _unified_store, owner_collateral_index_table );
+              _delegate_feed_index_db.register_with( _unified_store, delegate_feed_index_table );
+              _market_status_db.register_with( _unified_store, market_status_table );
+              _market_history_db.register_with( _unified_store, market_history_table );
+              _market_candle_db.register_with( _unified_store, market_candle_table );
+              _market_transaction_index_db.register_with( _unified_store, market_transaction_index_table );
+              _block_transaction_db.register_with( _unified_store, block_transaction_table );
+
+              _unified_store.open( data_dir / "index/unified_db", point_lookup_options );
+          }
+
+          /* Opening a table replays its log and fills its cache independently of the others, so the tables are
+             opened on the worker threads at once.  The unified store's tables share its state and open in turn */
+          start_signature_recovery_threads();
+          vector<fc::future<void>> table_opens;
+          const auto open_table = [&]( const std::string& name, const std::function<void()>& open )
+          {
+             const auto task = [name, open]()
+             {
+                const auto start_time = fc::time_point::now();
+                open();
+                ilog( "Opened ${name} in ${t} ms", ("name",name)("t",(fc::time_point::now() - start_time).count() / 1000) );
+             };
+             if( _use_unified_store )
+                task();
+             else
+                table_opens.push_back( _signature_recovery_threads[ table_opens.size() % _signature_recovery_threads.size() ]->async( task, "open_table" ) );
+          };
+#define OPEN_INDEX_TABLE( table, file, ... ) \
+          open_table( file, [&](){ open_index_table( table, data_dir / "index" / file, __VA_ARGS__ ); } )
+
+          OPEN_INDEX_TABLE( _market_transactions_db, "market_transactions_db", market_transactions_table );
+          OPEN_INDEX_TABLE( _fork_number_db, "fork_number_db", fork_number_table );
+          OPEN_INDEX_TABLE( _fork_db, "fork_db", fork_table );
+          OPEN_INDEX_TABLE( _slate_db, "slate_db", slate_table );
+#if 0
+          _proposal_db.open( data_dir / "index/proposal_db" );
+          _proposal_vote_db.open( data_dir / "index/proposal_vote_db" );
+#endif
+
+          OPEN_INDEX_TABLE( _undo_state_db, "undo_state_db", undo_state_table, point_lookup_options );
+
+          OPEN_INDEX_TABLE( _block_id_to_block_record_db, "block_id_to_block_record_db", block_id_to_block_record_table, point_lookup_options );
+          open_table( "block_num_to_id_db", [&](){ _block_num_to_id_db.open( data_dir / "raw_chain/block_num_to_id_db" ); } );
+          open_table( "block_log", [&]()
+          {
+             if( _primary_data_dir.valid() )
+                _block_log.open_read_only( *_primary_data_dir / "raw_chain/block_log" );
+             else
+                _block_log.open( data_dir / "raw_chain/block_log" );
+          } );
+          open_table( "block_id_to_block_offset_db", [&](){ _block_id_to_block_offset_db.open( data_dir / "raw_chain/block_id_to_block_offset_db" ); } );
+          load_validated_block();
+          OPEN_INDEX_TABLE( _id_to_transaction_record_db, "id_to_transaction_record_db", id_to_transaction_record_table, point_lookup_options );
+
+
+          OPEN_INDEX_TABLE( _pending_transaction_db, "pending_transaction3_db", pending_transaction_table );
+
+          OPEN_INDEX_TABLE( _asset_db, "asset_db", asset_table );
+          OPEN_INDEX_TABLE( _balance_db, "balance_db", balance_table, point_lookup_options );
+          OPEN_INDEX_TABLE( _owner_balance_index_db, "owner_balance_index_db", owner_balance_index_table );
+          OPEN_INDEX_TABLE( _burn_db, "burn_db", burn_table );
+          open_table( "account_db", [&]()
+          {
+             if( _use_unified_store )
+                 _account_db.open( _unified_store, account_table, true, false, BTS_BLOCKCHAIN_ACCOUNT_DB_CACHE_BUDGET );
+             else
+                 _account_db.open( data_dir / "index/account_db", true, 0, true, false, BTS_BLOCKCHAIN_ACCOUNT_DB_CACHE_BUDGET );
+          } );
+          OPEN_INDEX_TABLE( _address_to_account_db, "address_to_account_db", address_to_account_table );
+
+          OPEN_INDEX_TABLE( _account_index_db, "account_index_db", account_index_table );
+          OPEN_INDEX_TABLE( _symbol_index_db, "symbol_index_db", symbol_index_table );
+          OPEN_INDEX_TABLE( _delegate_vote_index_db, "delegate_vote_index_db", delegate_vote_index_table );
+
+          OPEN_INDEX_TABLE( _slot_record_db, "slot_record_db", slot_record_table );
+          OPEN_INDEX_TABLE( _delegate_slot_index_db, "delegate_slot_index_db", delegate_slot_index_table );
+
+          OPEN_INDEX_TABLE( _ask_db, "ask_db", ask_table );
+          OPEN_INDEX_TABLE( _bid_db, "bid_db", bid_table );
+          OPEN_INDEX_TABLE( _short_db, "short_db", short_table );
+          OPEN_INDEX_TABLE( _collateral_db, "collateral_db", collateral_table );
+          OPEN_INDEX_TABLE( _feed_db, "feed_db", feed_table );
+          OPEN_INDEX_TABLE( _owner_ask_index_db, "owner_ask_index_db", owner_ask_index_table );
+          OPEN_INDEX_TABLE( _owner_bid_index_db, "owner_bid_index_db", owner_bid_index_table );
+          OPEN_INDEX_TABLE( _owner_short_index_db, "owner_short_index_db", owner_short_index_table );
+          OPEN_INDEX_TABLE( _owner_collateral_index_db, "owner_collateral_index_db", owner_collateral_index_table );
+          OPEN_INDEX_TABLE( _delegate_feed_index_db, "delegate_feed_index_db", delegate_feed_index_table );
+
+          OPEN_INDEX_TABLE( _market_status_db, "market_status_db", market_status_table );
+          OPEN_INDEX_TABLE( _market_history_db, "market_history_db", market_history_table );
+          OPEN_INDEX_TABLE( _market_candle_db, "market_candle_db", market_candle_table );
+          OPEN_INDEX_TABLE( _market_transaction_index_db, "market_transaction_index_db", market_transaction_index_table );
+          OPEN_INDEX_TABLE( _block_transaction_db, "block_transaction_db", block_transaction_table );
+          OPEN_INDEX_TABLE( _asset_totals_db, "asset_totals_db", asset_totals_table );
+#undef OPEN_INDEX_TABLE
+
+          // let every open finish, so none is left running against a database we're about to give up on
+          fc::exception_ptr open_error;
+          for( auto& table_open : table_opens )
+          {
+             try
+             {
+                table_open.wait();
+             }
+             catch( const fc::exception& e )
+             {
+                if( !open_error )
+                   open_error = e.dynamic_copy_exception();
+             }
+          }
+          if( open_error )
+             open_error->dynamic_rethrow_exception();
+
+          for( auto itr = _block_num_to_id_db.begin(); itr.valid(); ++itr )
+             index_main_chain_block( itr.key(), itr.value() );
+
+          _pending_trx_state = std::make_shared<pending_chain_state>( self->shared_from_this() );
+
+          if( _address_history_enabled )
+             _address_transaction_index_db.open( data_dir / "index/address_transaction_index_db" );
+          else if( fc::exists( data_dir / "index/address_transaction_index_db" ) )
+             fc::remove_all( data_dir / "index/address_transaction_index_db" ); // it would go stale while off
+
+          index_transactions();
+          index_order_books();
+          index_names();
+          index_known_blocks();
+
+          if( _undo_state_db.is_upgrading() || _block_id_to_block_record_db.is_upgrading()
+              || _id_to_transaction_record_db.is_upgrading() || _balance_db.is_upgrading() )
+             _online_upgrade_task = fc::async( [=](){ run_online_upgrades(); }, "online_db_upgrade" );
+      } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
+      static uint64_t transaction_id_prefix( const transaction_id_type& id )
+      {
+          const unsigned char* bytes = reinterpret_cast<const unsigned char*>( id.data() );
+          uint64_t prefix = 0;
+          for( int i = 0; i < 8; ++i )
+             prefix = ( prefix << 8 ) | bytes[ i ];
+          return prefix;
+      }
+
+      /** builds the in-memory indexes over every transaction record */
+      void chain_database_impl::index_transactions()
+      {
+          _transaction_prefixes.clear();
+          _recent_transaction_prefixes.clear();
+          for( auto itr = _id_to_transaction_record_db.begin(); itr.valid(); ++itr )
+          {
+             const auto val = itr.value();
+             if( val.trx.expiration > self->now() )
+                _unique_transactions.insert( val.trx.expiration, val.trx.digest(_chain_id) );
+
+             transaction_prefix entry;
+             entry.prefix = transaction_id_prefix( itr.key() );
+             entry.location = val.chain_location;
+             _transaction_prefixes.push_back( entry );
+          }
+          // keys come out in id order, so this is only a safeguard
+          std::stable_sort( _transaction_prefixes.begin(), _transaction_prefixes.end() );
+          index_address_history();
+      }
+
+      /** the addresses an explorer would list the transaction under: its signers and the balances and orders it names */
+      static std::set<address> transaction_addresses( const transaction_record& record )
+      {
+          std::set<address> addresses( record.signed_keys.begin(), record.signed_keys.end() );
+          for( const auto& op : record.trx.operations )
+          {
+             switch( operation_type_enum( op.type ) )
+             {
+                case withdraw_op_type:
+                   addresses.insert( op.as<withdraw_operation>().balance_id );
+                   break;
+                case deposit_op_type:
+                {
+                   const auto condition = op.as<deposit_operation>().condition;
+                   addresses.insert( condition.get_address() );
+                   if( withdraw_condition_types( condition.type ) == withdraw_signature_type )
+                      addresses.insert( condition.get_owner() );
+                   break;
+                }
+                case bid_op_type:
+                   addresses.insert( op.as<bid_operation>().bid_index.owner );
+                   break;
+                case ask_op_type:
+                   addresses.insert( op.as<ask_operation>().ask_index.owner );
+                   break;
+                case short_op_v2_type:
+                   addresses.insert( op.as<short_operation>().short_index.owner );
+                   break;
+                case register_account_op_type:
+                {
+                   const auto register_op = op.as<register_account_operation>();
+                   addresses.insert( address( register_op.owner_key ) );
+                   addresses.insert( address( register_op.active_key ) );
+                   break;
+                }
+                default:
+                   break;
+             }
+          }
+          return addresses;
+      }
+
+      /** a snapshot restore or a first start with the index on leaves it empty beside the records, so it is rebuilt */
+      void chain_database_impl::index_address_history()
+      {
+          if( !_address_history_enabled || _address_transaction_index_db.begin().valid() )
+             return;
+
+          const auto start_time = fc::time_point::now();
+          for( auto itr = _id_to_transaction_record_db.begin(); itr.valid(); ++itr )
+             index_transaction_addresses( itr.key(), itr.value() );
+          ilog( "Indexed address history in ${t} ms", ("t",(fc::time_point::now() - start_time).count() / 1000) );
+      }
+
+      void chain_database_impl::index_transaction_addresses( const transaction_id_type& id, const transaction_record& record )
+      {
+          address_transaction_key key;
+          key.block_num = record.chain_location.block_num;
+          key.trx_num = record.chain_location.trx_num;
+          for( const address& owner : transaction_addresses( record ) )
+          {
+             key.owner = owner;
+             _address_transaction_index_db.store( key, id );
           }
-          _market_transactions_db.open( data_dir / "index/market_transactions_db" );
-          _fork_number_db.open( data_dir / "index/fork_number_db" );
-          _fork_db.open( data_dir / "index/fork_db" );
-          _slate_db.open( data_dir / "index/slate_db" );
-#if 0
-          _proposal_db.open( data_dir / "index/proposal_db" );
-          _proposal_vote_db.open( data_dir / "index/proposal_vote_db" );
-#endif
+      }
 
-          _undo_state_db.open( data_dir / "index/undo_state_db" );
+      void chain_database_impl::unindex_transaction_addresses( const transaction_record& record )
+      {
+          address_transaction_key key;
+          key.block_num = record.chain_location.block_num;
+          key.trx_num = record.chain_location.trx_num;
+          for( const address& owner : transaction_addresses( record ) )
+          {
+             key.owner = owner;
+             _address_transaction_index_db.remove( key );
+          }
+      }
 
-          _block_id_to_block_record_db.open( data_dir / "index/block_id_to_block_record_db" );
-          _block_num_to_id_db.open( data_dir / "raw_chain/block_num_to_id_db" );
-          _block_id_to_block_data_db.open( data_dir / "raw_chain/block_id_to_block_data_db" );
-          _id_to_transaction_record_db.open( data_dir / "index/id_to_transaction_record_db" );
+      void chain_database_impl::index_order_books()
+      {
+          _order_books.clear();
+          for( auto itr = _bid_db.begin(); itr.valid(); ++itr )
+             _order_books[ itr.key().order_price.asset_pair() ].bids[ itr.key() ] = itr.value();
+          for( auto itr = _ask_db.begin(); itr.valid(); ++itr )
+             _order_books[ itr.key().order_price.asset_pair() ].asks[ itr.key() ] = itr.value();
+          for( auto itr = _short_db.begin(); itr.valid(); ++itr )
+             _order_books[ itr.key().order_price.asset_pair() ].shorts[ itr.key() ] = itr.value();
+          for( auto itr = _collateral_db.begin(); itr.valid(); ++itr )
+             _order_books[ itr.key().order_price.asset_pair() ].collateral[ itr.key() ] = itr.value();
+      }
 
+      void chain_database_impl::index_names()
+      {
+          _account_name_index.clear();
+          for( auto itr = _account_index_db.begin(); itr.valid(); ++itr )
+             _account_name_index.insert( itr.key(), itr.value().value );
+          _asset_symbol_index.clear();
+          for( auto itr = _symbol_index_db.begin(); itr.valid(); ++itr )
+             _asset_symbol_index.insert( itr.key(), itr.value().value );
+      }
 
-          _pending_transaction_db.open( data_dir / "index/pending_transaction3_db" );
+      void chain_database_impl::index_known_blocks()
+      {
+          std::vector<block_id_type> ids;
+          for( auto itr = _fork_db.begin(); itr.valid(); ++itr )
+             ids.push_back( itr.key() );
+          _known_block_filter = block_id_filter( std::max<size_t>( 2 * ids.size(), BTS_BLOCKCHAIN_KNOWN_BLOCK_FILTER_MIN_ITEMS ) );
+          for( const auto& id : ids )
+             _known_block_filter.insert( id );
+      }
 
-          _asset_db.open( data_dir / "index/asset_db" );
-          _balance_db.open( data_dir / "index/balance_db" );
-          _burn_db.open( data_dir / "index/burn_db" );
-          _account_db.open( data_dir / "index/account_db" );
-          _address_to_account_db.open( data_dir / "index/address_to_account_db" );
+      void chain_database_impl::add_known_block( const block_id_type& id )
+      {
+          if( _known_block_filter.size() == _known_block_filter.capacity() )
+             wlog( "the filter over known block ids is full, it will be resized when the database is next opened" );
+          _known_block_filter.insert( id );
+      }
 
-          _account_index_db.open( data_dir / "index/account_index_db" );
-          _symbol_index_db.open( data_dir / "index/symbol_index_db" );
-          _delegate_vote_index_db.open( data_dir / "index/delegate_vote_index_db" );
+      const order_book& chain_database_impl::get_order_book( const asset_id_type& quote_id, const asset_id_type& base_id )const
+      {
+          static const order_book empty;
+          const auto itr = _order_books.find( std::make_pair( quote_id, base_id ) );
+          return itr != _order_books.end() ? itr->second : empty;
+      }
 
-          _slot_record_db.open( data_dir / "index/slot_record_db" );
+      void chain_database_impl::index_transaction_prefix( const transaction_id_type& id, const transaction_location& location )
+      {
+          transaction_prefix entry;
+          entry.prefix = transaction_id_prefix( id );
+          entry.location = location;
 
-          _ask_db.open( data_dir / "index/ask_db" );
-          _bid_db.open( data_dir / "index/bid_db" );
-          _short_db.open( data_dir / "index/short_db" );
-          _collateral_db.open( data_dir / "index/collateral_db" );
-          _feed_db.open( data_dir / "index/feed_db" );
+          const auto same_location = [&]( const transaction_location& other )
+          {
+             return other.block_num == location.block_num && other.trx_num == location.trx_num;
+          };
+          const auto stored = std::equal_range( _transaction_prefixes.begin(), _transaction_prefixes.end(), entry );
+          for( auto itr = stored.first; itr != stored.second; ++itr )
+             if( same_location( itr->location ) ) return;
+          const auto recent = _recent_transaction_prefixes.equal_range( entry.prefix );
+          for( auto itr = recent.first; itr != recent.second; ++itr )
+             if( same_location( itr->second ) ) return;
+
+          _recent_transaction_prefixes.emplace( entry.prefix, location );
+          if( _recent_transaction_prefixes.size() < BTS_BLOCKCHAIN_TRANSACTION_PREFIX_MERGE_SIZE
+              || _recent_transaction_prefixes.size() < _transaction_prefixes.size() / 8 )
+             return;
+
+          std::vector<transaction_prefix> merged;
+          merged.reserve( _transaction_prefixes.size() + _recent_transaction_prefixes.size() );
+          auto stored_itr = _transaction_prefixes.begin();
+          for( const auto& item : _recent_transaction_prefixes )
+          {
+             while( stored_itr != _transaction_prefixes.end() && stored_itr->prefix <= item.first )
+                merged.push_back( *stored_itr++ );
+             transaction_prefix added;
+             added.prefix = item.first;
+             added.location = item.second;
+             merged.push_back( added );
+          }
+          merged.insert( merged.end(), stored_itr, _transaction_prefixes.end() );
+          _transaction_prefixes = std::move( merged );
+          _recent_transaction_prefixes.clear();
+      }
 
-          _market_status_db.open( data_dir / "index/market_status_db" );
-          _market_history_db.open( data_dir / "index/market_history_db" );
+      void chain_database_impl::unindex_transaction_prefix( const transaction_id_type& id, const transaction_location& location )
+      {
+          const uint64_t prefix = transaction_id_prefix( id );
+          const auto same_location = [&]( const transaction_location& other )
+          {
+             return other.block_num == location.block_num && other.trx_num == location.trx_num;
+          };
 
-          _pending_trx_state = std::make_shared<pending_chain_state>( self->shared_from_this() );
+          const auto recent = _recent_transaction_prefixes.equal_range( prefix );
+          for( auto itr = recent.first; itr != recent.second; ++itr )
+          {
+             if( !same_location( itr->second ) ) continue;
+             _recent_transaction_prefixes.erase( itr );
+             return;
+          }
 
-          for( auto itr = _id_to_transaction_record_db.begin(); itr.valid(); ++itr )
+          transaction_prefix entry;
+          entry.prefix = prefix;
+          const auto stored = std::equal_range( _transaction_prefixes.begin(), _transaction_prefixes.end(), entry );
+          for( auto itr = stored.first; itr != stored.second; ++itr )
           {
-             const auto val = itr.value();
-             if( val.trx.expiration > self->now() )
-                _unique_transactions[val.trx.expiration].insert( val.trx.digest(_chain_id) );
+             if( !same_location( itr->location ) ) continue;
+             _transaction_prefixes.erase( itr );
+             return;
           }
-      } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+      }
+
+      /**
+       *  Returns where the transactions whose ids start like id are. Only the leading bytes of id up
+       *  to its last nonzero one among the first 8 are compared, but always at least 4, which is the
+       *  shortest prefix callers accept.
+       */
+      vector<transaction_location> chain_database_impl::find_transaction_prefix( const transaction_id_type& id )const
+      {
+          const uint64_t prefix = transaction_id_prefix( id );
+          int significant = 8;
+          while( significant > 4 && ( ( prefix >> ( 8 * ( 8 - significant ) ) ) & 0xff ) == 0 )
+             --significant;
+          const uint64_t mask = significant == 8 ? ~uint64_t( 0 ) : ~( ( uint64_t( 1 ) << ( 8 * ( 8 - significant ) ) ) - 1 );
+          const uint64_t low = prefix & mask;
+          const uint64_t high = low | ~mask;
+
+          vector<transaction_location> result;
+          transaction_prefix entry;
+          entry.prefix = low;
+          for( auto itr = std::lower_bound( _transaction_prefixes.begin(), _transaction_prefixes.end(), entry );
+               itr != _transaction_prefixes.end() && itr->prefix <= high; ++itr )
+             result.push_back( itr->location );
+          for( auto itr = _recent_transaction_prefixes.lower_bound( low );
+               itr != _recent_transaction_prefixes.end() && itr->first <= high; ++itr )
+             result.push_back( itr->second );
+          return result;
+      }
 
       static boost::random::mt11213b create_rng( const digest_type& chain_id )
       {
@@ -272,6 +2082,37 @@ namespace bts { namespace blockchain {
               self->store_account_record( entry.second );
       }
 
+      /**
+       *  The genesis balances go into a new database, so instead of store_balance_record for each they are
+       *  written in id order through one batch per table, and the base asset totals are adjusted once.
+       */
+      void chain_database_impl::store_genesis_balances( std::vector<balance_record>& balances )
+      { try {
+          std::sort( balances.begin(), balances.end(), []( const balance_record& a, const balance_record& b )
+          {
+              return a.id() < b.id();
+          } );
+
+          share_type supply = 0;
+          auto balance_batch = _balance_db.create_batch();
+          auto owner_batch = _owner_balance_index_db.create_batch();
+          for( const auto& record : balances )
+          {
+              FC_ASSERT( record.asset_id() == asset_id_type( 0 ) );
+              supply += record.balance;
+              balance_batch.store( record.id(), record );
+
+              const address owner = record.owner();
+              if( owner != address() )
+                  owner_batch.store( std::make_pair( owner, record.id() ), 0 );
+          }
+          balance_batch.commit();
+          owner_batch.commit();
+
+          /* there is no base asset yet, so every genesis balance is unclaimed */
+          adjust_asset_totals( asset_id_type( 0 ), supply, 0, supply );
+      } FC_CAPTURE_AND_RETHROW( (balances.size()) ) }
+
       digest_type chain_database_impl::initialize_genesis( const optional<path>& genesis_file, bool chain_id_only )
       { try {
          digest_type chain_id = self->chain_id();
@@ -295,16 +2136,29 @@ namespace bts { namespace blockchain {
            }
            else if( genesis_file->extension() == ".dat" )
            {
-              fc::ifstream in( *genesis_file );
+              /* the binary file is the packed config, so the chain id is the hash of its bytes and checking it
+               * needs nothing unpacked */
+              const boost::interprocess::file_mapping mapping( genesis_file->string().c_str(), boost::interprocess::read_only );
+              const boost::interprocess::mapped_region region( mapping, boost::interprocess::read_only );
+              const char* const data = static_cast<const char*>( region.get_address() );
+              chain_id = fc::sha256::hash( data, region.get_size() );
+              if( chain_id_only )
+                 return chain_id;
+
+              fc::datastream<const char*> in( data, region.get_size() );
               fc::raw::unpack( in, config );
+              FC_ASSERT( in.remaining() == 0, "Genesis file '${file}' has data after the genesis state.", ("file", *genesis_file) );
            }
            else
            {
               FC_ASSERT( !"Invalid genesis format", " '${format}'", ("format",genesis_file->extension() ) );
            }
-           fc::sha256::encoder enc;
-           fc::raw::pack( enc, config );
-           chain_id = enc.result();
+           if( genesis_file->extension() == ".json" )
+           {
+              fc::sha256::encoder enc;
+              fc::raw::pack( enc, config );
+              chain_id = enc.result();
+           }
          }
          else
          {
@@ -318,8 +2172,9 @@ namespace bts { namespace blockchain {
            fc::raw::pack( enc, config );
            chain_id = enc.result();
    #else
-           config = get_builtin_genesis_block_config();
            chain_id = get_builtin_genesis_block_state_hash();
+           if( !chain_id_only )
+              config = get_builtin_genesis_block_config();
    #endif
          }
 
@@ -406,23 +2261,28 @@ namespace bts { namespace blockchain {
             FC_ASSERT( oslate.valid() );
             add_votes( *oslate, initial.low_bits(), delegate_map );
             cur->second.genesis_info = genesis_record( cur->second.get_balance(), string( addr ) );
-            self->store_balance_record( cur->second );
          }
-         store_delegates( delegate_map );
 
-         _slate_db.set_write_through( true );
-         _account_db.set_write_through( true );
+         std::vector<balance_record> genesis_balances;
+         genesis_balances.reserve( balance_by_address.size() );
+         for( auto& item : balance_by_address )
+            genesis_balances.push_back( std::move( item.second ) );
+         balance_by_address.clear();
 
          asset total;
-         auto itr = _balance_db.begin();
-         while( itr.valid() )
+         for( const auto& record : genesis_balances )
          {
-            auto ind = itr.value().get_balance();
-            FC_ASSERT( ind.amount >= 0, "", ("record",itr.value()) );
+            auto ind = record.get_balance();
+            FC_ASSERT( ind.amount >= 0, "", ("record",record) );
             total += ind;
-            ++itr;
          }
 
+         store_genesis_balances( genesis_balances );
+         store_delegates( delegate_map );
+
+         _slate_db.set_write_through( true );
+         _account_db.set_write_through( true );
+
          int32_t asset_id = 0;
          asset_record base_asset;
          base_asset.id = asset_id;
@@ -468,6 +2328,7 @@ namespace bts { namespace blockchain {
          gen_fork.is_linked = true;
          gen_fork.is_known = true;
          _fork_db.store( block_id_type(), gen_fork );
+         add_known_block( block_id_type() );
 
          self->set_property( chain_property_enum::active_delegate_list_id, fc::variant( self->next_round_active_delegates() ) );
          self->set_property( chain_property_enum::last_asset_id, asset_id );
@@ -480,6 +2341,52 @@ namespace bts { namespace blockchain {
          return _chain_id;
       } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
+      /* Pruning rewrites the kept tail of the block log, so it waits until as many blocks are due as it keeps;
+         the log then never holds more than twice the prune depth. */
+      void chain_database_impl::prune_block_bodies()
+      { try {
+          const uint32_t head_block_num = _head_block_header.block_num;
+          if( _prune_depth == 0 || head_block_num <= _prune_depth || _block_log.is_read_only() )
+              return;
+
+          const uint32_t first_full = self->get_first_full_block_num();
+          const uint32_t keep_from = head_block_num - _prune_depth + 1;
+          if( keep_from <= first_full || keep_from - first_full < _prune_depth )
+              return;
+
+          const auto start_time = fc::time_point::now();
+          for( uint32_t block_num = first_full; block_num < keep_from; ++block_num )
+          {
+              for( const block_id_type& block_id : fetch_blocks_at_number( block_num ) )
+              {
+                  const auto record = _block_id_to_block_record_db.fetch_optional( block_id );
+                  if( record.valid() )
+                  {
+                      for( const transaction_id_type& trx_id : record->user_transaction_ids )
+                      {
+                          const auto trx_record = _id_to_transaction_record_db.fetch_optional( trx_id );
+                          if( !trx_record.valid() || trx_record->chain_location.block_num != block_num )
+                              continue;
+                          unindex_transaction_prefix( trx_id, trx_record->chain_location );
+                          if( _address_history_enabled )
+                             unindex_transaction_addresses( *trx_record );
+                          _id_to_transaction_record_db.remove( trx_id );
+                          _block_transaction_db.remove( block_transaction_key( trx_record->chain_location ) );
+                      }
+                  }
+                  _block_id_to_block_offset_db.remove( block_id );
+              }
+          }
+          self->set_property( first_full_block_num, keep_from );
+
+          const auto keep_offset = _block_id_to_block_offset_db.fetch( self->get_block_id( keep_from ) );
+          const uint64_t size_before = _block_log.size() - _block_log.first_offset();
+          _block_log.prune( keep_offset );
+          ilog( "Pruned the bodies of blocks ${first} through ${last}, freeing ${bytes} bytes of the block log in ${t} ms",
+                ("first",first_full)("last",keep_from - 1)("bytes",size_before - (_block_log.size() - _block_log.first_offset()))
+                ("t",(fc::time_point::now() - start_time).count() / 1000) );
+      } FC_CAPTURE_AND_RETHROW() }
+
       std::vector<block_id_type> chain_database_impl::fetch_blocks_at_number( uint32_t block_num )
       {
          std::vector<block_id_type> current_blocks;
@@ -496,11 +2403,29 @@ namespace bts { namespace blockchain {
          {
             auto id = trx.digest(_chain_id);
        //     confirmed_trx_ids.insert( id );
-            _pending_transaction_db.remove( id );
+            remove_pending( id );
          }
+         purge_expired_pending( blk.timestamp );
 
          _pending_fee_index.clear();
 
+         // revalidate_pending checks these against the changes since; evaluations made on a pool state
+         // that was reset before it ran are not in sequence with them and are always redone
+         if( _revalidation_base.empty() )
+         {
+            _revalidation_base = std::move( _pending_evaluations );
+         }
+         else
+         {
+            for( auto& evaluation : _pending_evaluations )
+            {
+               evaluation.reusable = false;
+               _revalidation_base.push_back( std::move( evaluation ) );
+            }
+         }
+         _pending_evaluations.clear();
+         _block_template.reset();
+
          // this schedules the revalidate-pending-transactions task to execute in this thread
          // as soon as this current task (probably pushing a block) gets around to yielding.
          // This was changed from waiting on the old _revalidate_pending to prevent yielding
@@ -529,18 +2454,16 @@ namespace bts { namespace blockchain {
             std::unordered_set<block_id_type> pending;
             for( const auto& item : next_ids )
             {
-                block_fork_data record = _fork_db.fetch( item );
-                record.is_linked = true;
-                pending.insert( record.next_blocks.begin(), record.next_blocks.end() );
-                //ilog( "store: ${id} => ${data}", ("id",item)("data",record) );
-                _fork_db.store( item, record );
-
-                auto block_record = _block_id_to_block_record_db.fetch(item);
-                if( block_record.block_num > highest_block_num )
+                fork_tree_node& node = fork_node( item );
+                node.data.is_linked = true;
+                node.dirty = true;
+                pending.insert( node.data.next_blocks.begin(), node.data.next_blocks.end() );
+
+                if( node.block_num > highest_block_num )
                 {
-                    highest_block_num = block_record.block_num;
+                    highest_block_num = node.block_num;
                     last_block_id = item;
-                    longest_fork = record;
+                    longest_fork = node.data;
                 }
             }
             next_ids = pending;
@@ -556,17 +2479,78 @@ namespace bts { namespace blockchain {
             std::unordered_set<block_id_type> pending;
             for( const auto& item : next_ids )
             {
-                block_fork_data record = _fork_db.fetch( item );
-                record.is_valid = false;
-                record.invalid_reason = reason;
-                pending.insert( record.next_blocks.begin(), record.next_blocks.end() );
-                //ilog( "store: ${id} => ${data}", ("id",item)("data",record) );
-                _fork_db.store( item, record );
+                fork_tree_node& node = fork_node( item );
+                node.data.is_valid = false;
+                node.data.invalid_reason = reason;
+                node.dirty = true;
+                pending.insert( node.data.next_blocks.begin(), node.data.next_blocks.end() );
             }
             next_ids = pending;
          }
       }
 
+      /**
+       *  Returns the in-memory node for id, loading it from _fork_db if needed, or nullptr if the
+       *  block is not in the fork tree at all. Nodes stay valid until the next flush_fork_tree.
+       */
+      fork_tree_node* chain_database_impl::find_fork_node( const block_id_type& id )
+      {
+         auto itr = _fork_tree.find( id );
+         if( itr != _fork_tree.end() )
+            return &itr->second;
+
+         /* nodes are written to _fork_db before they leave _fork_tree, so an id the filter rules out is unknown */
+         if( !_known_block_filter.may_contain( id ) )
+            return nullptr;
+
+         const auto data = _fork_db.fetch_optional( id );
+         if( !data.valid() )
+            return nullptr;
+
+         fork_tree_node node;
+         node.data = *data;
+         if( id != block_id_type() )
+         {
+            const auto record = _block_id_to_block_record_db.fetch_optional( id );
+            if( record.valid() )
+            {
+               node.previous = record->previous;
+               node.block_num = record->block_num;
+            }
+         }
+         return &_fork_tree.emplace( id, std::move( node ) ).first->second;
+      }
+
+      fork_tree_node& chain_database_impl::fork_node( const block_id_type& id )
+      {
+         fork_tree_node* node = find_fork_node( id );
+         FC_ASSERT( node != nullptr, "block ${id} is not in the fork tree", ("id",id) );
+         return *node;
+      }
+
+      /**
+       *  Writes the nodes changed since the last flush to _fork_db, then drops the ones that are
+       *  too old to be part of a fork we could still switch to.
+       */
+      void chain_database_impl::flush_fork_tree()
+      { try {
+         const uint32_t head_block_num = _head_block_header.block_num;
+         for( auto itr = _fork_tree.begin(); itr != _fork_tree.end(); )
+         {
+            if( itr->second.dirty )
+            {
+               _fork_db.store( itr->first, itr->second.data );
+               add_known_block( itr->first );
+               itr->second.dirty = false;
+            }
+
+            if( itr->second.block_num + BTS_BLOCKCHAIN_MAX_UNDO_HISTORY < head_block_num )
+               itr = _fork_tree.erase( itr );
+            else
+               ++itr;
+         }
+      } FC_CAPTURE_AND_RETHROW() }
+
       /**
        *  Place the block in the block tree, the block tree contains all blocks
        *  and tracks whether they are valid, linked, and current.
@@ -597,13 +2581,27 @@ namespace bts { namespace blockchain {
           //      ("n",block_data.block_num)("id",block_id)("prev",block_data.previous) );
 
           // first of all store this block at the given block number
-          _block_id_to_block_data_db.store( block_id, block_data );
+          auto block_offset = _block_id_to_block_offset_db.fetch_optional( block_id );
+          if( !block_offset.valid() )
+          {
+              if( _block_log.is_read_only() )
+              {
+                  FC_ASSERT( _followed_block_offset.valid(), "A follower only applies blocks from the primary's block log" );
+                  block_offset = *_followed_block_offset;
+              }
+              else
+              {
+                  block_offset = _block_log.append( block_data );
+              }
+              _block_id_to_block_offset_db.store( block_id, *block_offset );
+          }
 
           if( !self->get_block_record( block_id ).valid() ) /* Only insert with latency if not already present */
           {
               auto latency = now - block_data.timestamp;
-              block_record record( block_data, self->get_current_random_seed(), block_data.block_size(), latency );
-              _block_id_to_block_record_db.store( block_id, record );
+              /* the log already holds the packed block, so its size needs no second pass over the block */
+              block_record record( block_data, self->get_current_random_seed(), _block_log.record_size( *block_offset ), latency );
+              store_block_record( block_id, record );
           }
 
           // update the parallel block list
@@ -617,15 +2615,10 @@ namespace bts { namespace blockchain {
           }
 
           // now find how it links in.
-          block_fork_data prev_fork_data;
-          auto prev_itr = _fork_db.find( block_data.previous );
-          if( prev_itr.valid() ) // we already know about its previous
+          fork_tree_node* prev_node = find_fork_node( block_data.previous );
+          if( prev_node ) // we already know about its previous
           {
              ilog( "           we already know about its previous: ${p}", ("p",block_data.previous) );
-             prev_fork_data = prev_itr.value();
-             prev_fork_data.next_blocks.insert(block_id);
-             //ilog( "              ${id} = ${record}", ("id",prev_itr.key())("record",prev_fork_data) );
-             _fork_db.store( prev_itr.key(), prev_fork_data );
           }
           else
           {
@@ -633,62 +2626,64 @@ namespace bts { namespace blockchain {
 
              // create it... we do not know about the previous block so
              // we must create it and assume it is not linked...
-             prev_fork_data.next_blocks.insert(block_id);
-             prev_fork_data.is_linked = block_data.previous == block_id_type(); //false;
-             //ilog( "              ${id} = ${record}", ("id",block_data.previous)("record",prev_fork_data) );
-             _fork_db.store( block_data.previous, prev_fork_data );
+             prev_node = &_fork_tree[ block_data.previous ];
+             prev_node->data.is_linked = block_data.previous == block_id_type(); //false;
           }
+          prev_node->data.next_blocks.insert(block_id);
+          prev_node->dirty = true;
+          const block_fork_data& prev_fork_data = prev_node->data;
 
-          block_fork_data current_fork;
-          auto cur_itr = _fork_db.find( block_id );
-          current_fork.is_known = true;
-          if( cur_itr.valid() )
+          fork_tree_node* cur_node = find_fork_node( block_id );
+          if( cur_node )
           {
-             current_fork = cur_itr.value();
+             block_fork_data& current_fork = cur_node->data;
+             current_fork.is_known = true;
+             cur_node->previous = block_data.previous;
+             cur_node->block_num = block_data.block_num;
+             cur_node->dirty = true;
              ilog( "          current_fork: ${fork}", ("fork",current_fork) );
              ilog( "          prev_fork: ${prev_fork}", ("prev_fork",prev_fork_data) );
              if( !current_fork.is_linked && prev_fork_data.is_linked )
              {
                 // we found the missing link
                 current_fork.is_linked = true;
-                auto longest_fork = recursive_mark_as_linked( current_fork.next_blocks );
-                _fork_db.store( block_id, current_fork );
-                return longest_fork;
+                return recursive_mark_as_linked( current_fork.next_blocks );
              }
+             return std::make_pair(block_id, current_fork);
           }
-          else
-          {
-             current_fork.is_linked = prev_fork_data.is_linked;
-             //ilog( "          current_fork: ${id} = ${fork}", ("id",block_id)("fork",current_fork) );
-          }
-          _fork_db.store( block_id, current_fork );
-          return std::make_pair(block_id, current_fork);
+
+          fork_tree_node& node = _fork_tree[ block_id ];
+          node.data.is_known = true;
+          node.data.is_linked = prev_fork_data.is_linked;
+          node.previous = block_data.previous;
+          node.block_num = block_data.block_num;
+          node.dirty = true;
+          return std::make_pair(block_id, node.data);
       } FC_CAPTURE_AND_RETHROW( (block_id) ) }
 
       void chain_database_impl::mark_invalid(const block_id_type& block_id , const fc::exception& reason)
       {
          // fetch the fork data for block_id, mark it as invalid and
          // then mark every item after it as invalid as well.
-         auto fork_data = _fork_db.fetch( block_id );
-         fork_data.is_valid = false;
-         fork_data.invalid_reason = reason;
-         _fork_db.store( block_id, fork_data );
-         recursive_mark_as_invalid( fork_data.next_blocks, reason );
+         fork_tree_node& node = fork_node( block_id );
+         node.data.is_valid = false;
+         node.data.invalid_reason = reason;
+         node.dirty = true;
+         recursive_mark_as_invalid( node.data.next_blocks, reason );
       }
 
       void chain_database_impl::mark_included( const block_id_type& block_id, bool included )
       { try {
          //ilog( "included: ${block_id} = ${state}", ("block_id",block_id)("state",included) );
-         auto fork_data = _fork_db.fetch( block_id );
+         fork_tree_node& node = fork_node( block_id );
          //if( fork_data.is_included != included )
          {
-            fork_data.is_included = included;
+            node.data.is_included = included;
             if( included )
             {
-               fork_data.is_valid  = true;
+               node.data.is_valid  = true;
             }
-            //ilog( "store: ${id} => ${data}", ("id",block_id)("data",fork_data) );
-            _fork_db.store( block_id, fork_data );
+            node.dirty = true;
          }
          // fetch the fork data for block_id, mark it as included and
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id)("included",included) ) }
@@ -705,39 +2700,502 @@ namespace bts { namespace blockchain {
          }
          for( int32_t i = history.size()-2; i >= 0 ; --i )
          {
-            ilog( "    extend ${i}", ("i",history[i]) );
-            extend_chain( self->get_block( history[i] ) );
+            ilog( "    extend ${i}", ("i",history[i]) );
+            extend_chain( self->get_block( history[i] ) );
+         }
+      } FC_CAPTURE_AND_RETHROW( (block_id) ) }
+
+      /**
+       *  Recovering a key from a signature is the most expensive step of applying a block and every
+       *  signature is independent, so all transaction signers are recovered into the signature_cache on
+       *  worker threads while the calling thread recovers the block signee. The workers hash every
+       *  transaction anyway, so they also compute the ids for the transaction digest into trx_ids.
+       */
+      void chain_database_impl::start_signature_recovery_threads()
+      {
+         if( !_signature_recovery_threads.empty() ) return;
+         const uint32_t count = std::max<uint32_t>( 1, std::min<uint32_t>( std::thread::hardware_concurrency(),
+                                                                           BTS_BLOCKCHAIN_MAX_SIGNATURE_RECOVERY_THREADS ) );
+         for( uint32_t i = 0; i < count; ++i )
+            _signature_recovery_threads.emplace_back( new fc::thread( "signature_recovery_" + std::to_string( i ) ) );
+      }
+
+#define BULK_LOAD_CACHED_DATABASES (_property_db)(_slate_db) \
+                                   (_account_db)(_account_index_db)(_address_to_account_db)(_delegate_vote_index_db) \
+                                   (_asset_db)(_symbol_index_db) \
+                                   (_ask_db)(_bid_db)(_short_db)(_collateral_db) \
+                                   (_feed_db)(_market_status_db)(_market_transactions_db)(_asset_totals_db)
+      void chain_database_impl::set_bulk_load_writer( fc::thread* writer )
+      {
+#define SET_BULK_LOAD_WRITER(r, data, elem) elem.set_async_flush( writer, BTS_BLOCKCHAIN_REINDEX_MAX_DIRTY_RECORDS ); \
+                                            elem.set_write_through( writer == nullptr );
+         BOOST_PP_SEQ_FOR_EACH(SET_BULK_LOAD_WRITER, _, BULK_LOAD_CACHED_DATABASES)
+#undef SET_BULK_LOAD_WRITER
+      }
+
+      void chain_database_impl::flush_bulk_load_caches()
+      {
+#define FLUSH_CACHE(r, data, elem) elem.flush();
+         BOOST_PP_SEQ_FOR_EACH(FLUSH_CACHE, _, BULK_LOAD_CACHED_DATABASES)
+#undef FLUSH_CACHE
+      }
+#undef BULK_LOAD_CACHED_DATABASES
+
+      /* At most BTS_BLOCKCHAIN_REINDEX_PREFETCH_CHUNKS chunks are in flight */
+      void chain_database_impl::push_blocks_pipelined( size_t block_count,
+                                                       const std::function<vector<full_block>( size_t, size_t )>& read_blocks,
+                                                       const std::function<void( const full_block& )>& push,
+                                                       block_pipeline_times& times )
+      {
+         typedef std::shared_ptr<std::vector<full_block>> block_chunk;
+
+         const auto read_chunk = [&]( size_t first, size_t last ) -> block_chunk
+         {
+            const auto read_start = fc::time_point::now();
+            auto blocks = std::make_shared<std::vector<full_block>>( read_blocks( first, last ) );
+            times.read_us += ( fc::time_point::now() - read_start ).count();
+            return blocks;
+         };
+
+         const digest_type chain_id = _chain_id;
+         const bool recover_transaction_signers = !_skip_signature_verification;
+         const uint32_t assume_valid_block_num = std::max( _assume_valid_block_num, _reindexing ? _validated_block_num + 1 : 0 );
+         const auto recover_chunk = [&, chain_id, recover_transaction_signers, assume_valid_block_num]( const block_chunk& blocks )
+         {
+            const auto recover_start = fc::time_point::now();
+            for( const auto& block : *blocks )
+            {
+               const bool enforce_canonical = block.block_num > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM;
+               try
+               {
+                  if( assume_valid_block_num > block.block_num )
+                     continue;
+                  if( CHECKPOINT_BLOCKS.empty() || (--CHECKPOINT_BLOCKS.end())->first <= block.block_num )
+                     signature_cache::instance().recover( block.delegate_signature, block.digest(), enforce_canonical );
+                  if( !recover_transaction_signers )
+                     continue;
+                  for( const auto& trx : block.user_transactions )
+                  {
+                     const auto digest = trx.digest( chain_id );
+                     for( const auto& sig : trx.signatures )
+                        signature_cache::instance().recover( sig, digest, enforce_canonical );
+                  }
+               }
+               catch( ... )
+               {
+                  /* push rejects the block with the usual error */
+               }
+            }
+            times.recover_us += ( fc::time_point::now() - recover_start ).count();
+         };
+
+         fc::thread block_reader( "block_reader" );
+         start_signature_recovery_threads();
+         std::deque<fc::future<block_chunk>> prefetched;
+         size_t next_chunk_start = 0;
+         const auto schedule_next_chunk = [&]()
+         {
+            const size_t first = next_chunk_start;
+            const size_t last = std::min<size_t>( block_count, first + BTS_BLOCKCHAIN_REINDEX_PREFETCH_CHUNK_SIZE );
+            next_chunk_start = last;
+
+            fc::future<block_chunk> read = block_reader.async( [&read_chunk, first, last]()
+            {
+               return read_chunk( first, last );
+            }, "pipeline_read_chunk" );
+
+            const size_t chunk_number = first / BTS_BLOCKCHAIN_REINDEX_PREFETCH_CHUNK_SIZE;
+            fc::thread& recovery_thread = *_signature_recovery_threads[ chunk_number % _signature_recovery_threads.size() ];
+            prefetched.push_back( recovery_thread.async( [&recover_chunk, read]() mutable
+            {
+               const block_chunk blocks = read.wait();
+               recover_chunk( blocks );
+               return blocks;
+            }, "pipeline_recover_chunk" ) );
+         };
+
+         try
+         {
+            while( next_chunk_start < block_count && prefetched.size() < BTS_BLOCKCHAIN_REINDEX_PREFETCH_CHUNKS )
+               schedule_next_chunk();
+
+            while( !prefetched.empty() )
+            {
+               const auto wait_start = fc::time_point::now();
+               const block_chunk blocks = prefetched.front().wait();
+               prefetched.pop_front();
+               times.stall_us += ( fc::time_point::now() - wait_start ).count();
+
+               if( next_chunk_start < block_count )
+                  schedule_next_chunk();
+
+               const auto apply_start = fc::time_point::now();
+               for( const auto& block : *blocks )
+                  push( block );
+               times.apply_us += ( fc::time_point::now() - apply_start ).count();
+            }
+         }
+         catch( ... )
+         {
+            // the prefetch tasks reference the caller's source, they must finish before we unwind
+            for( auto& chunk : prefetched )
+            {
+               try { chunk.wait(); } catch( ... ) {}
+            }
+            throw;
+         }
+      }
+
+      bool chain_database_impl::assume_valid( uint32_t block_num )const
+      {
+         return block_num < _assume_valid_block_num || ( _reindexing && block_num <= _validated_block_num );
+      }
+
+      /* The marker is the packed (block_num, block_id) followed by its sha256, so a torn write is ignored */
+      void chain_database_impl::load_validated_block()
+      {
+         _validated_block_num = _saved_validated_block_num = 0;
+         _validated_block_id = block_id_type();
+         const fc::path file = _data_dir / "raw_chain/validated_block";
+         if( _primary_data_dir.valid() || !fc::exists( file ) )
+            return;
+
+         try
+         {
+            std::ifstream in( file.string().c_str(), std::ios::in | std::ios::binary );
+            const std::vector<char> data( (std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>() );
+            const auto marker = fc::raw::unpack<std::pair<std::pair<uint32_t, block_id_type>, fc::sha256>>( data );
+            FC_ASSERT( fc::sha256::hash( fc::raw::pack( marker.first ) ) == marker.second, "checksum mismatch" );
+            _validated_block_num = _saved_validated_block_num = marker.first.first;
+            _validated_block_id = marker.first.second;
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "ignoring unreadable ${file}: ${e}", ("file",file)("e",e.to_detail_string()) );
+         }
+      }
+
+      void chain_database_impl::save_validated_block()
+      { try {
+         if( _primary_data_dir.valid() || !_block_log.is_open() || _validated_block_num == _saved_validated_block_num )
+            return;
+         // blocks assumed valid are only known to be so once the assume-valid block is reached
+         if( _validated_block_num < _assume_valid_block_num )
+            return;
+
+         const auto marker = std::make_pair( _validated_block_num, _validated_block_id );
+         const auto data = fc::raw::pack( std::make_pair( marker, fc::sha256::hash( fc::raw::pack( marker ) ) ) );
+         const fc::path file = _data_dir / "raw_chain/validated_block";
+         const fc::path incomplete_file = _data_dir / "raw_chain/validated_block.incomplete";
+         {
+            std::ofstream out( incomplete_file.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+            out.write( data.data(), data.size() );
+            out.flush();
+            FC_ASSERT( out.good(), "error writing ${file}", ("file",incomplete_file) );
+         }
+         fc::remove_all( file );
+         fc::rename( incomplete_file, file );
+         _saved_validated_block_num = _validated_block_num;
+      } FC_CAPTURE_AND_RETHROW() }
+
+      void chain_database_impl::recover_signers( const full_block& block_data, bool recover_block_signee,
+                                                 bool recover_transaction_signers,
+                                                 public_key_type& block_signee,
+                                                 vector<transaction_id_type>& trx_ids )
+      {
+         const bool enforce_canonical = block_data.block_num > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM;
+         const auto& trxs = block_data.user_transactions;
+         trx_ids.resize( trxs.size() );
+
+         worker_join workers;
+         if( trxs.size() > 1 )
+         {
+            start_signature_recovery_threads();
+
+            const size_t worker_count = std::min( _signature_recovery_threads.size(), trxs.size() );
+            for( size_t w = 0; w < worker_count; ++w )
+            {
+               workers.run( *_signature_recovery_threads[ w ], [&, w, worker_count]()
+               {
+                  for( size_t i = w; i < trxs.size(); i += worker_count )
+                  {
+                     trx_ids[ i ] = trxs[ i ].id();
+                     if( !recover_transaction_signers )
+                        continue;
+                     try
+                     {
+                        const auto digest = trxs[ i ].digest( _chain_id );
+                        for( const auto& sig : trxs[ i ].signatures )
+                           signature_cache::instance().recover( sig, digest, enforce_canonical );
+                     }
+                     catch( ... )
+                     {
+                        /* leave it to evaluate() to reject the transaction with its usual error */
+                     }
+                  }
+               }, "recover_transaction_signers" );
+            }
+         }
+         else if( trxs.size() == 1 )
+         {
+            trx_ids[ 0 ] = trxs[ 0 ].id();
+         }
+
+         /* an error here leaves through the destructor of workers, which joins them first */
+         if( recover_block_signee )
+            block_signee = signature_cache::instance().recover( block_data.delegate_signature, block_data.digest(),
+                                                                enforce_canonical )->key;
+         workers.join();
+      }
+
+      /** whether two asset records only differ in the totals that markets and transactions add to */
+      static bool same_except_totals( asset_record a, asset_record b )
+      {
+         a.current_share_supply = b.current_share_supply = 0;
+         a.collected_fees = b.collected_fees = 0;
+         return fc::raw::pack( a ) == fc::raw::pack( b );
+      }
+
+      /**
+       *  Applies the changes of a market or transaction executed in its own state to pending_state, if
+       *  they are the changes serial execution would have made, and adds them to merged_writes, which
+       *  holds what everything merged before it changed. Otherwise nothing is applied and false is returned.
+       */
+      static bool merge_parallel_state( locked_pending_state& state, const pending_chain_state_ptr& pending_state,
+                                        state_access_set& merged_writes )
+      {
+         const state_access_set& reads = *state.reads();
+         if( reads.untracked ) return false;
+
+         // any record changed earlier conflicts if it was read in full, totals included, as issuing
+         // checks the supply and withdrawing pays yield out of the fees
+         state_access_set other_reads = reads;
+         other_reads.asset_totals.clear();
+         if( other_reads.overlaps( merged_writes ) ) return false;
+
+         // Markets and transactions that share an asset all add to its fees and supply, and those that
+         // only read it through get_asset_record_for_totals never depend on them, so theirs are merged
+         // as deltas on top of what was merged before, as long as nothing else about the asset changed
+         vector<asset_record> merged_assets;
+         for( const auto& id : reads.asset_totals )
+         {
+            if( !merged_writes.assets.count( id ) ) continue;
+            const auto prior = state.priors()->assets.find( id );
+            if( prior == state.priors()->assets.end() || !prior->second.valid() ) return false;
+            const asset_record& seen = *prior->second;
+            const oasset_record current = pending_state->get_asset_record( id );
+            if( !current.valid() || !same_except_totals( seen, *current ) ) return false;
+
+            const auto written = state.assets.find( id );
+            if( written == state.assets.end() ) continue;
+            if( !same_except_totals( seen, written->second ) ) return false;
+            asset_record merged = *current;
+            merged.current_share_supply += written->second.current_share_supply - seen.current_share_supply;
+            merged.collected_fees       += written->second.collected_fees - seen.collected_fees;
+            merged_assets.push_back( merged );
+         }
+         for( const auto& record : merged_assets )
+            state.assets[ record.id ] = record;
+
+         state.collect_writes( merged_writes );
+         state.apply_changes();
+         return true;
+      }
+
+      /** applies every transaction of the block in order to pending_state, summing their votes in delegate_votes */
+      void chain_database_impl::evaluate_transactions_serially( const full_block& block,
+                                                                const pending_chain_state_ptr& pending_state,
+                                                                map<account_id_type, share_type>& delegate_votes )
+      {
+         uint32_t trx_num = 0;
+         try
+         {
+            // apply changes from each transaction, reusing one evaluation state and its containers
+            const transaction_evaluation_state_ptr trx_eval_state =
+                   std::make_shared<transaction_evaluation_state>(pending_state.get(), _chain_id);
+            trx_eval_state->_block_delegate_votes = &delegate_votes;
+            std::recursive_mutex slate_lock;
+            block_slate_cache slates( *self, slate_lock );
+            trx_eval_state->_block_slates = &slates;
+            const bool skip_signatures = _skip_signature_verification || assume_valid( block.block_num );
+            for( const auto& trx : block.user_transactions )
+            {
+               //ilog( "applying   ${trx}", ("trx",trx) );
+               trx_eval_state->evaluate( trx, skip_signatures,
+                                         block.block_num > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM );
+               //ilog( "evaluation: ${e}", ("e",*trx_eval_state) );
+               // TODO:  capture the evaluation state with a callback for wallets...
+               // summary.transaction_states.emplace_back( std::move(trx_eval_state) );
+
+
+               transaction_location trx_loc( block.block_num, trx_num );
+               //ilog( "store trx location: ${loc}", ("loc",trx_loc) );
+               transaction_record record( trx_loc, *trx_eval_state);
+               pending_state->store_transaction( trx_eval_state->trx_id(), record );
+               ++trx_num;
+            }
+         } FC_RETHROW_EXCEPTIONS( warn, "", ("trx_num",trx_num) )
+      }
+
+      /**
+       *  Each transaction is first evaluated on a worker thread in its own locked_pending_state over
+       *  pending_state, and the results are merged in block order by merge_parallel_state. A transaction
+       *  that read something an earlier one changed, or whose evaluation failed on the worker, is
+       *  evaluated again on the merged state, so the result is always that of serial evaluation.
+       */
+      void chain_database_impl::evaluate_transactions_in_parallel( const full_block& block,
+                                                                   const pending_chain_state_ptr& pending_state,
+                                                                   map<account_id_type, share_type>& delegate_votes )
+      {
+         struct transaction_evaluation
+         {
+            locked_pending_state_ptr              state;
+            transaction_evaluation_state_ptr      eval_state;
+            map<account_id_type, share_type>      delegate_votes;
+         };
+         const auto& trxs = block.user_transactions;
+         vector<transaction_evaluation> evaluations( trxs.size() );
+         const bool skip_signatures = _skip_signature_verification || assume_valid( block.block_num );
+         const bool enforce_canonical = block.block_num > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM;
+
+         start_signature_recovery_threads();
+         std::recursive_mutex chain_lock;
+         block_slate_cache slates( *self, chain_lock );
+         const size_t worker_count = std::min( _signature_recovery_threads.size(), trxs.size() );
+         /* declared last, so it joins the workers before the locals they reference are destroyed */
+         worker_join workers;
+         for( size_t w = 0; w < worker_count; ++w )
+         {
+            workers.run( *_signature_recovery_threads[ w ], [&, w]()
+            {
+               for( size_t i = w; i < trxs.size(); i += worker_count )
+               {
+                  auto& evaluation = evaluations[ i ];
+                  try
+                  {
+                     const auto state = std::make_shared<locked_pending_state>( pending_state, chain_lock );
+                     state->track_reads();
+                     state->capture_prior_values();
+                     const auto eval_state = std::make_shared<transaction_evaluation_state>( state.get(), _chain_id );
+                     eval_state->_block_delegate_votes = &evaluation.delegate_votes;
+                     eval_state->_block_slates = &slates;
+                     eval_state->evaluate( trxs[ i ], skip_signatures, enforce_canonical );
+                     evaluation.eval_state = eval_state;
+                     evaluation.state = state;
+                  }
+                  catch( ... )
+                  {
+                     // evaluated again serially, which reports the error if it happens again
+                  }
+               }
+            }, "evaluate_transactions" );
+         }
+         workers.join();
+
+         state_access_set merged_writes;
+         uint32_t trx_num = 0;
+         try
+         {
+            for( auto& evaluation : evaluations )
+            {
+               if( !evaluation.state || !merge_parallel_state( *evaluation.state, pending_state, merged_writes ) )
+               {
+                  const auto state = std::make_shared<pending_chain_state>( pending_state );
+                  evaluation.eval_state = std::make_shared<transaction_evaluation_state>( state.get(), _chain_id );
+                  evaluation.delegate_votes.clear();
+                  evaluation.eval_state->_block_delegate_votes = &evaluation.delegate_votes;
+                  evaluation.eval_state->_block_slates = &slates;
+                  evaluation.eval_state->evaluate( trxs[ trx_num ], skip_signatures, enforce_canonical );
+                  state->collect_writes( merged_writes );
+                  state->apply_changes();
+               }
+               // votes are only summed, so adding them up per transaction gives the same totals
+               for( const auto& vote : evaluation.delegate_votes )
+                  delegate_votes[ vote.first ] += vote.second;
+
+               transaction_record record( transaction_location( block.block_num, trx_num ), *evaluation.eval_state );
+               pending_state->store_transaction( evaluation.eval_state->trx_id(), record );
+               evaluation = transaction_evaluation();
+               ++trx_num;
+            }
+         } FC_RETHROW_EXCEPTIONS( warn, "", ("trx_num",trx_num) )
+      }
+
+      /** whether two maps hold the same keys with the same packed values, regardless of their order */
+      template<typename Map>
+      static bool same_records( const Map& a, const Map& b )
+      {
+         if( a.size() != b.size() ) return false;
+         for( const auto& item : a )
+         {
+            const auto other = b.find( item.first );
+            if( other == b.end() || fc::raw::pack( item.second ) != fc::raw::pack( other->second ) ) return false;
          }
-      } FC_CAPTURE_AND_RETHROW( (block_id) ) }
+         return true;
+      }
+
+      /** whether two states over the same previous state hold the same changes */
+      static bool same_changes( const pending_chain_state& a, const pending_chain_state& b )
+      {
+         return same_records( a.assets, b.assets ) && same_records( a.slates, b.slates )
+             && same_records( a.accounts, b.accounts ) && same_records( a.balances, b.balances )
+             && same_records( a.account_id_index, b.account_id_index ) && same_records( a.symbol_id_index, b.symbol_id_index )
+             && same_records( a.transactions, b.transactions ) && a.unique_transactions == b.unique_transactions
+             && same_records( a.properties, b.properties ) && same_records( a.key_to_account, b.key_to_account )
+             && same_records( a.bids, b.bids ) && same_records( a.asks, b.asks ) && same_records( a.shorts, b.shorts )
+             && same_records( a.collateral, b.collateral ) && same_records( a.slots, b.slots )
+             && same_records( a.market_history, b.market_history ) && same_records( a.market_statuses, b.market_statuses )
+             && same_records( a.feeds, b.feeds ) && same_records( a.burns, b.burns )
+             && fc::raw::pack( a.recent_operations ) == fc::raw::pack( b.recent_operations )
+             && a._dirty_markets == b._dirty_markets;
+      }
 
       void chain_database_impl::apply_transactions( const full_block& block,
                                                     const pending_chain_state_ptr& pending_state )
       {
          //ilog( "apply transactions from block: ${block_num}  ${trxs}", ("block_num",block.block_num)("trxs",user_transactions) );
-         ilog( "Applying transactions from block: ${n}", ("n",block.block_num) );
-         uint32_t trx_num = 0;
-         try
+         hot_ilog( "Applying transactions from block: ${n}", ("n",block.block_num) );
+
+         // a transaction is only known to be a duplicate once the first copy is stored, which the
+         // workers cannot see, so a block repeating one is evaluated serially and rejected there
+         bool parallel = block.user_transactions.size() >= BTS_BLOCKCHAIN_MIN_PARALLEL_TRANSACTIONS;
+         if( parallel )
          {
-            // apply changes from each transaction
+            std::unordered_set<digest_type> digests;
             for( const auto& trx : block.user_transactions )
-            {
-               //ilog( "applying   ${trx}", ("trx",trx) );
-               transaction_evaluation_state_ptr trx_eval_state =
-                      std::make_shared<transaction_evaluation_state>(pending_state.get(), _chain_id);
-               trx_eval_state->evaluate( trx, _skip_signature_verification, 
-                                         block.block_num > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM );
-               //ilog( "evaluation: ${e}", ("e",*trx_eval_state) );
-               // TODO:  capture the evaluation state with a callback for wallets...
-               // summary.transaction_states.emplace_back( std::move(trx_eval_state) );
+               parallel &= digests.insert( trx.digest( _chain_id ) ).second;
+         }
 
+         map<account_id_type, share_type> delegate_votes;
+         if( !parallel )
+         {
+            evaluate_transactions_serially( block, pending_state, delegate_votes );
+         }
+         else if( !_verify_parallel_transactions )
+         {
+            evaluate_transactions_in_parallel( block, pending_state, delegate_votes );
+         }
+         else
+         {
+            const auto serial_state = std::make_shared<pending_chain_state>( pending_state );
+            map<account_id_type, share_type> serial_votes;
+            evaluate_transactions_serially( block, serial_state, serial_votes );
+
+            const auto parallel_state = std::make_shared<pending_chain_state>( pending_state );
+            evaluate_transactions_in_parallel( block, parallel_state, delegate_votes );
+            FC_ASSERT( same_changes( *serial_state, *parallel_state ) && serial_votes == delegate_votes,
+                       "parallel evaluation of block ${n} differs from serial evaluation", ("n",block.block_num) );
+            parallel_state->apply_changes();
+         }
 
-               transaction_location trx_loc( block.block_num, trx_num );
-               //ilog( "store trx location: ${loc}", ("loc",trx_loc) );
-               transaction_record record( trx_loc, *trx_eval_state);
-               pending_state->store_transaction( trx.id(), record );
-               ++trx_num;
-            }
-         } FC_RETHROW_EXCEPTIONS( warn, "", ("trx_num",trx_num) )
+         // the votes are only summed, so storing each delegate once at the end gives the same records
+         for( const auto& vote : delegate_votes )
+         {
+            auto delegate_record = pending_state->get_account_record( vote.first );
+            FC_ASSERT( delegate_record.valid() && delegate_record->is_delegate() );
+            delegate_record->adjust_votes_for( vote.second );
+            pending_state->store_account_record( *delegate_record );
+         }
       }
 
       // TODO: Need to justify good parameters
@@ -810,25 +3268,34 @@ namespace bts { namespace blockchain {
            if( _head_block_header.block_num < last_checkpoint_block_num )
                  return;  // don't bother saving it...
 
-           pending_chain_state_ptr undo_state = std::make_shared<pending_chain_state>( nullptr );
-           pending_state->get_undo_state( undo_state );
-           _undo_state_db.store( block_id, *undo_state );
+           undo_state_record undo_record;
+           pending_state->get_undo_state( undo_record );
+           _undo_state_db.store( block_id, undo_record );
+
+           _hot_undo_states.emplace_back( block_id, std::move( undo_record ) );
+           if( _hot_undo_states.size() > BTS_BLOCKCHAIN_HOT_UNDO_STATES )
+              _hot_undo_states.pop_front();
+
+           // blocks this far back can no longer be popped, on the main chain or on any fork
            auto block_num = self->get_head_block_num();
            if( int32_t(block_num - BTS_BLOCKCHAIN_MAX_UNDO_HISTORY) > 0 )
            {
-              auto old_id = self->get_block_id( block_num - BTS_BLOCKCHAIN_MAX_UNDO_HISTORY );
-              try {
-                 _undo_state_db.remove( old_id );
-              }
-              catch( const fc::key_not_found_exception& )
+              for( const auto& old_id : fetch_blocks_at_number( block_num - BTS_BLOCKCHAIN_MAX_UNDO_HISTORY ) )
               {
-                 // ignore this...
+                 try {
+                    _undo_state_db.remove( old_id );
+                 }
+                 catch( const fc::key_not_found_exception& )
+                 {
+                    // ignore this...
+                 }
               }
            }
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
 
 
-      void chain_database_impl::verify_header( const full_block& block_data, const public_key_type& block_signee )
+      void chain_database_impl::verify_header( const full_block& block_data, const public_key_type& block_signee,
+                                               vector<transaction_id_type> trx_ids )
       { try {
             // validate preliminaries:
             if( block_data.block_num > 1 && block_data.block_num != _head_block_header.block_num + 1 )
@@ -845,7 +3312,8 @@ namespace bts { namespace blockchain {
             if( block_data.timestamp >  (now + BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC*2) )
                 FC_CAPTURE_AND_THROW( time_in_future, (block_data.timestamp)(now)(delta_seconds) );
 
-            digest_block digest_data(block_data);
+            digest_block digest_data( (const signed_block_header&)block_data );
+            digest_data.user_transaction_ids = std::move( trx_ids );
             if( NOT digest_data.validate_digest() )
               FC_CAPTURE_AND_THROW( invalid_block_digest );
 
@@ -956,54 +3424,759 @@ namespace bts { namespace blockchain {
       {
           if( block_data.block_num % BTS_BLOCKCHAIN_NUM_DELEGATES == 0 )
           {
-             // perform a random shuffle of the sorted delegate list.
+             // perform a random shuffle of the sorted delegate list.
+
+             auto active_del = self->next_round_active_delegates();
+             auto rand_seed = fc::sha256::hash( pending_state->get_current_random_seed() );
+             size_t num_del = active_del.size();
+             for( uint32_t i = 0; i < num_del; ++i )
+             {
+                for( uint32_t x = 0; x < 4 && i < num_del; ++x, ++i )
+                   std::swap( active_del[i], active_del[rand_seed._hash[x]%num_del] );
+                rand_seed = fc::sha256::hash(rand_seed);
+             }
+
+             pending_state->set_active_delegates( active_del );
+          }
+      }
+
+      /**
+       *  Markets are executed in the order of get_dirty_markets. When there are enough of them, each is
+       *  first executed on a worker thread in its own locked_pending_state over pending_state, and the
+       *  results are merged in that same order by merge_parallel_state. A market that read something an
+       *  earlier market changed, or whose execution failed on the worker, is executed again on the
+       *  merged state, so the result is always that of serial execution.
+       */
+      void chain_database_impl::execute_markets( const fc::time_point_sec& timestamp, const pending_chain_state_ptr& pending_state )
+      { try {
+        bts::utilities::stall_detector::scope stall_scope( "execute_markets" );
+        vector<market_transaction> market_transactions;
+
+        // markets whose orders do not cross only have their status updated, which is done right here
+        vector<std::pair<asset_id_type, asset_id_type>> dirty_markets;
+        for( const auto& market_pair : self->get_dirty_markets() )
+        {
+           FC_ASSERT( market_pair.first > market_pair.second );
+           market_engine engine( pending_state, *this );
+           if( engine.orders_cross( market_pair.first, market_pair.second ) )
+              dirty_markets.push_back( market_pair );
+           else
+              engine.execute( market_pair.first, market_pair.second, timestamp );
+        }
+
+        if( dirty_markets.size() < BTS_BLOCKCHAIN_MIN_PARALLEL_MARKETS )
+        {
+           for( const auto& market_pair : dirty_markets )
+           {
+              market_engine engine( pending_state, *this );
+              if( engine.execute( market_pair.first, market_pair.second, timestamp ) )
+              {
+                 market_transactions.insert( market_transactions.end(), engine._market_transactions.begin(), engine._market_transactions.end() );
+              }
+           }
+           pending_state->set_market_transactions( std::move( market_transactions ) );
+           return;
+        }
+
+        struct market_execution
+        {
+           locked_pending_state_ptr      state;
+           bool                          executed = false;
+           vector<market_transaction>    transactions;
+        };
+        vector<market_execution> executions( dirty_markets.size() );
+
+        start_signature_recovery_threads();
+        std::recursive_mutex chain_lock;
+        /* declared last, so it joins the workers before the locals they reference are destroyed */
+        worker_join workers;
+        size_t i = 0;
+        for( const auto& market_pair : dirty_markets )
+        {
+           fc::thread& worker = *_signature_recovery_threads[ i % _signature_recovery_threads.size() ];
+           workers.run( worker, [&, i, market_pair]()
+           {
+              auto& execution = executions[ i ];
+              try
+              {
+                 const auto state = std::make_shared<locked_pending_state>( pending_state, chain_lock );
+                 state->track_reads();
+                 state->capture_prior_values();
+                 market_engine engine( state, *this, &chain_lock );
+                 execution.executed = engine.execute( market_pair.first, market_pair.second, timestamp );
+                 execution.transactions = std::move( engine._market_transactions );
+                 execution.state = state;
+              }
+              catch( ... )
+              {
+                 // executed again serially, which reports the error if it happens again
+              }
+           }, "execute_market" );
+           ++i;
+        }
+        workers.join();
+
+        state_access_set merged_writes;
+        i = 0;
+        for( const auto& market_pair : dirty_markets )
+        {
+           auto& execution = executions[ i++ ];
+           if( !execution.state || !merge_parallel_state( *execution.state, pending_state, merged_writes ) )
+           {
+              const auto state = std::make_shared<pending_chain_state>( pending_state );
+              market_engine engine( state, *this );
+              execution.executed = engine.execute( market_pair.first, market_pair.second, timestamp );
+              execution.transactions = std::move( engine._market_transactions );
+              state->collect_writes( merged_writes );
+              state->apply_changes();
+           }
+           if( execution.executed )
+              market_transactions.insert( market_transactions.end(), execution.transactions.begin(), execution.transactions.end() );
+        }
+
+//        if( pending_block_num < BTSX_MARKET_FORK_2_BLOCK_NUM )
+//            pending_state->set_dirty_markets( pending_state->_dirty_markets );
+
+        pending_state->set_market_transactions( std::move( market_transactions ) );
+      } FC_CAPTURE_AND_RETHROW() }
+
+      /**
+       *  Checks if a snapshot should be made now and starts writing it if so. A snapshot that cannot be
+       *  written is logged; it never fails the block.
+       */
+      void chain_database_impl::handle_snapshots( const full_block& block_data )
+      {
+          if( !self->do_snapshots() ) return;
+          uint32_t prev_block_day = self->now().sec_since_epoch() / 86400;
+          uint32_t new_block_day = block_data.timestamp.sec_since_epoch() / 86400;
+          if( prev_block_day == new_block_day ) return;
+
+          try
+          {
+              start_balance_snapshot();
+          }
+          catch( const fc::exception& e )
+          {
+              wlog( "failed to start balance snapshot: ${e}", ("e",e.to_detail_string()) );
+          }
+      }
+
+      /**
+       *  Takes a snapshot of the balance table at the head block and writes it out on _balance_snapshot_thread.
+       *  If the previous one is still being written this one is skipped and the future of that is returned.
+       */
+      fc::future<void> chain_database_impl::start_balance_snapshot()
+      { try {
+          if( _balance_snapshot_export.valid() && !_balance_snapshot_export.ready() )
+          {
+              wlog( "skipping the balance snapshot at block ${n}, the previous one is still being written",
+                    ("n",_head_block_header.block_num) );
+              return _balance_snapshot_export;
+          }
+
+          const uint32_t block_num = _head_block_header.block_num;
+          const fc::time_point_sec timestamp = self->now();
+          const fc::path filename = self->snapshot_filename( timestamp );
+          const auto balances = _balance_db.take_snapshot();
+
+          if( !_balance_snapshot_thread )
+              _balance_snapshot_thread.reset( new fc::thread( "balance_snapshot" ) );
+          _stop_balance_snapshot = false;
+          _balance_snapshot_export = _balance_snapshot_thread->async( [this, balances, block_num, timestamp, filename]()
+          {
+              try
+              {
+                  write_balance_snapshot( balances, block_num, timestamp, filename );
+              }
+              catch( const fc::exception& e )
+              {
+                  wlog( "failed to write balance snapshot: ${e}", ("e",e.to_detail_string()) );
+                  throw;
+              }
+          }, "balance_snapshot" );
+          return _balance_snapshot_export;
+      } FC_CAPTURE_AND_RETHROW() }
+
+      /** runs on _balance_snapshot_thread and touches nothing but the snapshot and its arguments */
+      void chain_database_impl::write_balance_snapshot( const bts::db::level_map<balance_id_type, balance_record>::snapshot& balances,
+                                                        uint32_t block_num, const fc::time_point_sec& timestamp,
+                                                        const fc::path& filename )const
+      { try {
+          const auto start_time = fc::time_point::now();
+          uint64_t count = 0;
+          {
+              std::ofstream out( filename.string() );
+              FC_ASSERT( out.is_open(), "unable to create balance snapshot ${file}", ("file",filename) );
+              out << "{"
+                  << "\"blocknum\":" << block_num
+                  << ",\"blocktime\":" << timestamp.sec_since_epoch()
+                  << ",\"balances\":[";
+
+              bool first = true;
+              share_type total = 0;
+              for( auto itr = _balance_db.snapshot_range( balances ); itr.valid(); ++itr )
+              {
+                  if( _stop_balance_snapshot )
+                  {
+                      out.close();
+                      fc::remove( filename );
+                      ilog( "Stopped writing the balance snapshot at block ${n}", ("n",block_num) );
+                      return;
+                  }
+
+                  const balance_record record = itr.value();
+                  if( record.condition.type == withdraw_signature_type )
+                  {
+                      total += record.balance;
+                      if( !first ) out << ",";
+                      out << "[\""
+                          << std::string( record.owner() )
+                          << "\","
+                          << record.balance
+                          << "]";
+                      first = false;
+                  }
+
+                  if( ++count % BTS_BLOCKCHAIN_BALANCE_SNAPSHOT_BATCH_SIZE == 0 )
+                  {
+                      if( count % BTS_BLOCKCHAIN_BALANCE_SNAPSHOT_PROGRESS_INTERVAL == 0 )
+                          ilog( "Balance snapshot at block ${n}: ${c} balances read", ("n",block_num)("c",count) );
+                      fc::usleep( fc::milliseconds( BTS_BLOCKCHAIN_BALANCE_SNAPSHOT_PAUSE_MS ) );
+                  }
+              }
+
+              out << "],\"moneysupply\":" << total
+                  << "}";
+              out.flush();
+              FC_ASSERT( out.good(), "error writing balance snapshot ${file}", ("file",filename) );
+          }
+          fc::lzma_compress_file( filename, filename.string() + ".lz" );
+          fc::remove( filename );
+
+          ilog( "Wrote balance snapshot at block ${n} with ${c} balances in ${t} ms",
+                ("n",block_num)("c",count)("t",(fc::time_point::now() - start_time).count() / 1000) );
+      } FC_CAPTURE_AND_RETHROW( (block_num)(filename) ) }
+
+      void chain_database_impl::wait_for_balance_snapshot()
+      {
+          _stop_balance_snapshot = true;
+          if( _balance_snapshot_export.valid() )
+          {
+              try
+              {
+                  _balance_snapshot_export.wait();
+              }
+              catch( const fc::exception& )
+              {
+              }
+          }
+          _balance_snapshot_export = fc::future<void>();
+          _stop_balance_snapshot = false;
+      }
+
+/* Every index table, in snapshot order. Changing the list needs a BTS_BLOCKCHAIN_DATABASE_VERSION bump,
+   which invalidates the snapshots written before it. The raw chain itself is never part of a snapshot. */
+#define INDEX_SNAPSHOT_TABLES (_property_db)(_market_transactions_db)(_slate_db)(_fork_number_db)(_fork_db)(_undo_state_db) \
+                              (_block_id_to_block_record_db)(_id_to_transaction_record_db)(_asset_db)(_symbol_index_db) \
+                              (_balance_db)(_owner_balance_index_db)(_burn_db)(_account_db)(_address_to_account_db) \
+                              (_account_index_db)(_delegate_vote_index_db)(_slot_record_db)(_ask_db)(_bid_db)(_short_db) \
+                              (_collateral_db)(_feed_db)(_market_status_db)(_market_history_db)(_asset_totals_db) \
+                              (_owner_ask_index_db)(_owner_bid_index_db)(_owner_short_index_db)(_owner_collateral_index_db) \
+                              (_delegate_feed_index_db)(_delegate_slot_index_db)
+
+      /*
+       *  An index snapshot is a sequence of records, each a 32 bit length followed by that many bytes:
+       *  the packed index_snapshot_header, then the packed (key, value) pairs of each table in
+       *  INDEX_SNAPSHOT_TABLES order with an empty record ending every table. The sha256 of all of
+       *  that follows as the last 32 bytes of the file.
+       */
+      static void write_snapshot_record( std::ofstream& out, fc::sha256::encoder& checksum, const std::vector<char>& data )
+      {
+          const uint32_t length = data.size();
+          out.write( (const char*)&length, sizeof( length ) );
+          out.write( data.data(), data.size() );
+          checksum.write( (const char*)&length, sizeof( length ) );
+          checksum.write( data.data(), data.size() );
+      }
+
+      /** writes the records from itr to the end of its table; false if stop was set before that */
+      template<typename Iterator>
+      static bool write_snapshot_table( std::ofstream& out, fc::sha256::encoder& checksum, Iterator itr,
+                                        const std::atomic<bool>* stop = nullptr )
+      {
+          for( ; itr.valid(); ++itr )
+          {
+              if( stop != nullptr && *stop )
+                  return false;
+              write_snapshot_record( out, checksum, fc::raw::pack( std::make_pair( itr.key(), itr.value() ) ) );
+          }
+          write_snapshot_record( out, checksum, std::vector<char>() );
+          return true;
+      }
+
+      /** @return false at the end of a table */
+      static bool read_snapshot_record( std::ifstream& in, std::vector<char>& data )
+      {
+          uint32_t length = 0;
+          in.read( (char*)&length, sizeof( length ) );
+          FC_ASSERT( in.good(), "index snapshot is truncated" );
+          data.resize( length );
+          if( length > 0 )
+          {
+              in.read( data.data(), length );
+              FC_ASSERT( in.good(), "index snapshot is truncated" );
+          }
+          return length > 0;
+      }
+
+      template<typename Table>
+      static void read_snapshot_table( std::ifstream& in, Table& table )
+      {
+          typedef typename std::decay<decltype( table.begin().key() )>::type   key_type;
+          typedef typename std::decay<decltype( table.begin().value() )>::type value_type;
+
+          std::vector<char> data;
+          while( read_snapshot_record( in, data ) )
+          {
+              const auto entry = fc::raw::unpack<std::pair<key_type, value_type>>( data );
+              table.store( entry.first, entry.second );
+          }
+      }
+
+      std::map<uint32_t, fc::path> chain_database_impl::list_index_snapshots( const fc::path& data_dir )const
+      {
+          std::map<uint32_t, fc::path> snapshots;
+          const fc::path dir = data_dir / "index_snapshots";
+          if( !fc::is_directory( dir ) )
+              return snapshots;
+
+          for( fc::directory_iterator itr( dir ); itr != fc::directory_iterator(); ++itr )
+          {
+              const fc::path file = *itr;
+              if( file.extension().string() != ".snapshot" )
+                  continue;
+              try
+              {
+                  snapshots[ std::stoul( file.stem().string() ) ] = file;
+              }
+              catch( ... )
+              {
+              }
+          }
+          return snapshots;
+      }
+
+      void chain_database_impl::handle_index_snapshots()
+      {
+          const uint32_t block_num = _head_block_header.block_num;
+          if( _reindexing || block_num == 0 || block_num % BTS_BLOCKCHAIN_INDEX_SNAPSHOT_INTERVAL != 0 )
+              return;
+          if( block_num <= _last_index_snapshot_block )
+              return;
+
+          try
+          {
+              start_index_snapshot();
+          }
+          catch( const fc::exception& e )
+          {
+              wlog( "failed to start index snapshot: ${e}", ("e",e.to_detail_string()) );
+          }
+      }
+
+      /**
+       *  Takes a LevelDB snapshot of every index table at the head block and writes them out on
+       *  _index_snapshot_thread, so push_block only pays for taking the snapshots. If the previous
+       *  index snapshot is still being written this one is skipped.
+       */
+      void chain_database_impl::start_index_snapshot()
+      { try {
+          const uint32_t block_num = _head_block_header.block_num;
+          if( _index_snapshot_write.valid() && !_index_snapshot_write.ready() )
+          {
+              wlog( "skipping the index snapshot at block ${n}, the previous one is still being written", ("n",block_num) );
+              return;
+          }
+          // the records of a table being upgraded are split between two databases, see level_map::snapshot_range
+          if( _undo_state_db.is_upgrading() || _block_id_to_block_record_db.is_upgrading()
+              || _id_to_transaction_record_db.is_upgrading() || _balance_db.is_upgrading() )
+          {
+              wlog( "skipping the index snapshot at block ${n} until the database upgrade finishes", ("n",block_num) );
+              return;
+          }
+
+          index_snapshot_header header;
+          header.database_version = BTS_BLOCKCHAIN_DATABASE_VERSION;
+          header.chain_id = _chain_id;
+          header.block_num = block_num;
+          header.block_id = _head_block_id;
+
+          auto tables = std::make_shared<std::vector<std::shared_ptr<const leveldb::Snapshot>>>();
+#define TAKE_TABLE_SNAPSHOT(r, data, elem) tables->push_back( elem.take_snapshot() );
+          BOOST_PP_SEQ_FOR_EACH(TAKE_TABLE_SNAPSHOT, _, INDEX_SNAPSHOT_TABLES)
+#undef TAKE_TABLE_SNAPSHOT
+          _last_index_snapshot_block = block_num;
+
+          if( !_index_snapshot_thread )
+              _index_snapshot_thread.reset( new fc::thread( "index_snapshot" ) );
+          _stop_index_snapshot = false;
+          const fc::path data_dir = _data_dir;
+          _index_snapshot_write = _index_snapshot_thread->async( [this, header, tables, data_dir]()
+          {
+              try
+              {
+                  write_index_snapshot( header, *tables, data_dir );
+              }
+              catch( const fc::exception& e )
+              {
+                  wlog( "failed to write index snapshot: ${e}", ("e",e.to_detail_string()) );
+                  throw;
+              }
+          }, "index_snapshot" );
+      } FC_CAPTURE_AND_RETHROW() }
+
+      /** runs on _index_snapshot_thread and reads the tables only through the snapshots taken for it */
+      void chain_database_impl::write_index_snapshot( const index_snapshot_header& header,
+                                                      const std::vector<std::shared_ptr<const leveldb::Snapshot>>& tables,
+                                                      const fc::path& data_dir )const
+      { try {
+          const auto start_time = fc::time_point::now();
+          const fc::path dir = data_dir / "index_snapshots";
+          const fc::path incomplete_file = dir / "incomplete";
+          fc::create_directories( dir );
+
+          {
+              std::ofstream out( incomplete_file.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+              FC_ASSERT( out.is_open(), "unable to create index snapshot ${file}", ("file",incomplete_file) );
+
+              fc::sha256::encoder checksum;
+              write_snapshot_record( out, checksum, fc::raw::pack( header ) );
+
+              size_t table = 0;
+              bool complete = true;
+#define WRITE_SNAPSHOT_TABLE(r, data, elem) \
+              complete = complete && write_snapshot_table( out, checksum, elem.snapshot_range( tables[ table++ ] ), &_stop_index_snapshot );
+              BOOST_PP_SEQ_FOR_EACH(WRITE_SNAPSHOT_TABLE, _, INDEX_SNAPSHOT_TABLES)
+#undef WRITE_SNAPSHOT_TABLE
+              if( !complete )
+              {
+                  out.close();
+                  fc::remove( incomplete_file );
+                  ilog( "Stopped writing the index snapshot at block ${n}", ("n",header.block_num) );
+                  return;
+              }
+
+              const fc::sha256 hash = checksum.result();
+              out.write( hash.data(), hash.data_size() );
+              out.flush();
+              FC_ASSERT( out.good(), "error writing index snapshot ${file}", ("file",incomplete_file) );
+          }
+          fc::rename( incomplete_file, dir / ( fc::to_string( header.block_num ) + ".snapshot" ) );
+
+          auto snapshots = list_index_snapshots( data_dir );
+          while( snapshots.size() > BTS_BLOCKCHAIN_INDEX_SNAPSHOTS_KEPT )
+          {
+              fc::remove_all( snapshots.begin()->second );
+              snapshots.erase( snapshots.begin() );
+          }
+
+          ilog( "Wrote index snapshot at block ${n} in ${t} ms",
+                ("n",header.block_num)("t",(fc::time_point::now() - start_time).count() / 1000) );
+      } FC_CAPTURE_AND_RETHROW( (header)(data_dir) ) }
+
+      void chain_database_impl::wait_for_index_snapshot()
+      {
+          _stop_index_snapshot = true;
+          if( _index_snapshot_write.valid() )
+          {
+              try
+              {
+                  _index_snapshot_write.wait();
+              }
+              catch( const fc::exception& )
+              {
+              }
+          }
+          _index_snapshot_write = fc::future<void>();
+          _stop_index_snapshot = false;
+      }
+
+      /** checks the trailing checksum, then leaves in just past the header it returns */
+      static index_snapshot_header read_snapshot_header( std::ifstream& in, const fc::path& file )
+      {
+          FC_ASSERT( in.is_open(), "unable to open index snapshot" );
+
+          fc::sha256 stored_hash;
+          const uint64_t file_size = fc::file_size( file );
+          FC_ASSERT( file_size >= stored_hash.data_size(), "index snapshot is truncated" );
+          {
+              fc::sha256::encoder checksum;
+              std::vector<char> buffer( 1024 * 1024 );
+              uint64_t remaining = file_size - stored_hash.data_size();
+              while( remaining > 0 )
+              {
+                  const size_t length = std::min<uint64_t>( remaining, buffer.size() );
+                  in.read( buffer.data(), length );
+                  FC_ASSERT( in.good(), "index snapshot is truncated" );
+                  checksum.write( buffer.data(), length );
+                  remaining -= length;
+              }
+              in.read( stored_hash.data(), stored_hash.data_size() );
+              FC_ASSERT( in.good() && checksum.result() == stored_hash, "index snapshot checksum mismatch" );
+              in.seekg( 0 );
+          }
+
+          std::vector<char> data;
+          FC_ASSERT( read_snapshot_record( in, data ), "index snapshot has no header" );
+          const auto header = fc::raw::unpack<index_snapshot_header>( data );
+          FC_ASSERT( header.database_version == BTS_BLOCKCHAIN_DATABASE_VERSION, "index snapshot is from another database version",
+                     ("version",header.database_version) );
+          return header;
+      }
+
+      /** expects freshly created, empty index tables; throws if the snapshot does not belong to the raw chain */
+      void chain_database_impl::load_index_snapshot( const fc::path& file )
+      { try {
+          std::ifstream in( file.string().c_str(), std::ios::in | std::ios::binary );
+          const auto header = read_snapshot_header( in, file );
+          const auto main_chain_id = _block_num_to_id_db.fetch_optional( header.block_num );
+          FC_ASSERT( main_chain_id.valid() && *main_chain_id == header.block_id, "index snapshot is not on the stored chain" );
+          FC_ASSERT( _block_id_to_block_offset_db.fetch_optional( header.block_id ).valid(), "index snapshot block is missing" );
+
+#define READ_SNAPSHOT_TABLE(r, data, elem) read_snapshot_table( in, elem );
+          BOOST_PP_SEQ_FOR_EACH(READ_SNAPSHOT_TABLE, _, INDEX_SNAPSHOT_TABLES)
+#undef READ_SNAPSHOT_TABLE
+          clear_property_cache();
+
+          _chain_id = header.chain_id;
+          _head_block_id = header.block_id;
+          _head_block_header = self->get_block_digest( header.block_id );
+          _last_index_snapshot_block = header.block_num;
+          index_transactions();
+          index_order_books();
+          index_names();
+          index_known_blocks();
+          rebuild_market_candles( false );
+          rebuild_market_transaction_index( false );
+          rebuild_block_transaction_index( false );
+          _delegate_ranking_valid = false;
+      } FC_CAPTURE_AND_RETHROW( (file) ) }
+
+      /** @return true with the index at the newest usable snapshot, false with the index closed and empty */
+      bool chain_database_impl::restore_index_snapshot( const fc::path& data_dir )
+      {
+          const auto snapshots = list_index_snapshots( data_dir );
+          for( auto itr = snapshots.rbegin(); itr != snapshots.rend(); ++itr )
+          {
+              try
+              {
+                  open_database( data_dir );
+                  load_index_snapshot( itr->second );
+                  return true;
+              }
+              catch( const fc::exception& e )
+              {
+                  wlog( "unable to restore index snapshot ${file}: ${e}", ("file",itr->second)("e",e.to_detail_string()) );
+              }
+              self->close();
+              fc::remove_all( data_dir / "index" );
+              fc::create_directories( data_dir / "index" );
+          }
+          return false;
+      }
+
+      /** the header of an index snapshot, without reading the rest of the file to check it */
+      static index_snapshot_header peek_snapshot_header( const fc::path& file )
+      {
+          std::ifstream in( file.string().c_str(), std::ios::in | std::ios::binary );
+          FC_ASSERT( in.is_open(), "unable to open index snapshot" );
+          std::vector<char> data;
+          FC_ASSERT( read_snapshot_record( in, data ), "index snapshot has no header" );
+          return fc::raw::unpack<index_snapshot_header>( data );
+      }
+
+      /**
+       *  Loads an index snapshot fetched from another node into freshly created, empty tables. Unlike
+       *  load_index_snapshot there is no raw chain to check it against, so the whole file must hash to
+       *  the trusted snapshot_hash. The block records of the snapshot rebuild the block numbers up to its
+       *  block, whose bodies are absent just as on a pruned node.
+       */
+      void chain_database_impl::bootstrap_index_snapshot( const fc::path& file, const fc::sha256& snapshot_hash )
+      { try {
+          {
+              fc::sha256::encoder file_hash;
+              std::ifstream in( file.string().c_str(), std::ios::in | std::ios::binary );
+              FC_ASSERT( in.is_open(), "unable to open index snapshot" );
+              std::vector<char> buffer( 1024 * 1024 );
+              while( in.read( buffer.data(), buffer.size() ) || in.gcount() > 0 )
+                  file_hash.write( buffer.data(), in.gcount() );
+              FC_ASSERT( file_hash.result() == snapshot_hash, "index snapshot does not match the trusted hash",
+                         ("hash",snapshot_hash) );
+          }
 
-             auto active_del = self->next_round_active_delegates();
-             auto rand_seed = fc::sha256::hash( pending_state->get_current_random_seed() );
-             size_t num_del = active_del.size();
-             for( uint32_t i = 0; i < num_del; ++i )
-             {
-                for( uint32_t x = 0; x < 4 && i < num_del; ++x, ++i )
-                   std::swap( active_del[i], active_del[rand_seed._hash[x]%num_del] );
-                rand_seed = fc::sha256::hash(rand_seed);
-             }
+          std::ifstream in( file.string().c_str(), std::ios::in | std::ios::binary );
+          const auto header = read_snapshot_header( in, file );
+          const auto checkpoint = CHECKPOINT_BLOCKS.find( header.block_num );
+          FC_ASSERT( checkpoint == CHECKPOINT_BLOCKS.end() || checkpoint->second == header.block_id,
+                     "index snapshot is not on the checkpointed chain" );
 
-             pending_state->set_active_delegates( active_del );
+#define READ_SNAPSHOT_TABLE(r, data, elem) read_snapshot_table( in, elem );
+          BOOST_PP_SEQ_FOR_EACH(READ_SNAPSHOT_TABLE, _, INDEX_SNAPSHOT_TABLES)
+#undef READ_SNAPSHOT_TABLE
+          clear_property_cache();
+
+          block_id_type block_id = header.block_id;
+          for( uint32_t block_num = header.block_num; block_num > 0; --block_num )
+          {
+              const auto record = _block_id_to_block_record_db.fetch_optional( block_id );
+              FC_ASSERT( record.valid() && record->block_num == block_num, "index snapshot is missing block ${n}", ("n",block_num) );
+              _block_num_to_id_db.store( block_num, block_id );
+              block_id = record->previous;
           }
-      }
 
-      void chain_database_impl::execute_markets( const fc::time_point_sec& timestamp, const pending_chain_state_ptr& pending_state )
-      { try {
-        vector<market_transaction> market_transactions;
-        const auto dirty_markets = self->get_dirty_markets();
-        for( const auto& market_pair : dirty_markets )
-        {
-           FC_ASSERT( market_pair.first > market_pair.second );
-              market_engine engine( pending_state, *this );
-              if( engine.execute( market_pair.first, market_pair.second, timestamp ) )
-              {
-                 market_transactions.insert( market_transactions.end(), engine._market_transactions.begin(), engine._market_transactions.end() );
-              }
-        }
+          _chain_id = header.chain_id;
+          _head_block_id = header.block_id;
+          _head_block_header = self->get_block_digest( header.block_id );
+          _last_index_snapshot_block = header.block_num;
+          self->set_property( first_full_block_num, header.block_num + 1 );
+          index_transactions();
+          index_order_books();
+          index_names();
+          index_known_blocks();
+          rebuild_market_candles( false );
+          rebuild_market_transaction_index( false );
+          rebuild_block_transaction_index( false );
+          _delegate_ranking_valid = false;
+      } FC_CAPTURE_AND_RETHROW( (file)(snapshot_hash) ) }
+
+      /** a one table index snapshot: the header, the table, and the checksum of both */
+      template<typename Table>
+      static void write_state_dump_table( const fc::path& file, const index_snapshot_header& header, const Table& table )
+      {
+          std::ofstream out( file.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+          FC_ASSERT( out.is_open(), "unable to create ${file}", ("file",file) );
 
-//        if( pending_block_num < BTSX_MARKET_FORK_2_BLOCK_NUM )
-//            pending_state->set_dirty_markets( pending_state->_dirty_markets );
+          fc::sha256::encoder checksum;
+          write_snapshot_record( out, checksum, fc::raw::pack( header ) );
+          write_snapshot_table( out, checksum, table.begin() );
 
-        pending_state->set_market_transactions( std::move( market_transactions ) );
-      } FC_CAPTURE_AND_RETHROW() }
+          const fc::sha256 hash = checksum.result();
+          out.write( hash.data(), hash.data_size() );
+          out.flush();
+          FC_ASSERT( out.good(), "error writing ${file}", ("file",file) );
+      }
 
       /**
-       *  Checks if a snapshot should be made now and creates it if so.
+       *  Every table is streamed to its own file by one of the worker threads. Readers never yield and the
+       *  caller holds _push_block_mutex, so the tables all show the head block while they are written.
        */
-      void chain_database_impl::handle_snapshots( const full_block& block_data ) const
+      void chain_database_impl::write_state_dump( const fc::path& dir, bool binary )
       {
-          if( !self->do_snapshots() ) return;
-          uint32_t prev_block_day = self->now().sec_since_epoch() / 86400;
-          uint32_t new_block_day = block_data.timestamp.sec_since_epoch() / 86400;
-          if( prev_block_day == new_block_day ) return;
-          self->create_snapshot();
+          index_snapshot_header header;
+          header.database_version = BTS_BLOCKCHAIN_DATABASE_VERSION;
+          header.chain_id = _chain_id;
+          header.block_num = _head_block_header.block_num;
+          header.block_id = _head_block_id;
+
+          start_signature_recovery_threads();
+          vector<fc::future<void>> dumps;
+          const auto dump_table = [&]( const fc::path& file, const std::function<void()>& dump )
+          {
+             const auto task = [file, dump]()
+             {
+                const auto start_time = fc::time_point::now();
+                dump();
+                ulog( "Dumped ${p} in ${t} ms", ("p",file)("t",(fc::time_point::now() - start_time).count() / 1000) );
+             };
+             dumps.push_back( _signature_recovery_threads[ dumps.size() % _signature_recovery_threads.size() ]->async( task, "dump_table" ) );
+          };
+
+          if( binary )
+          {
+#define DUMP_BINARY_TABLE(r, data, elem) \
+             dump_table( dir / BOOST_PP_STRINGIZE(elem.bin), [&](){ write_state_dump_table( dir / BOOST_PP_STRINGIZE(elem.bin), header, elem ); } );
+             BOOST_PP_SEQ_FOR_EACH(DUMP_BINARY_TABLE, _, INDEX_SNAPSHOT_TABLES)
+#undef DUMP_BINARY_TABLE
+          }
+          else
+          {
+#define DUMP_JSON_TABLE(r, data, elem) \
+             dump_table( dir / BOOST_PP_STRINGIZE(elem.json), [&](){ elem.export_to_json( dir / BOOST_PP_STRINGIZE(elem.json) ); } );
+             BOOST_PP_SEQ_FOR_EACH(DUMP_JSON_TABLE, _, INDEX_SNAPSHOT_TABLES(_block_num_to_id_db)(_block_id_to_block_offset_db))
+#undef DUMP_JSON_TABLE
+          }
+
+          fc::exception_ptr dump_error;
+          for( auto& dump : dumps )
+          {
+             try
+             {
+                dump.wait();
+             }
+             catch( const fc::exception& e )
+             {
+                if( !dump_error )
+                   dump_error = e.dynamic_copy_exception();
+             }
+          }
+          if( dump_error )
+             dump_error->dynamic_rethrow_exception();
       }
 
+      /**
+       *  Every file is checked before the index is touched. Loading rebuilds the index from empty tables like
+       *  restore_index_snapshot, so it runs on the calling thread: the caches are not safe to fill elsewhere.
+       *  @return the block the dump was taken at, now the head block
+       */
+      uint32_t chain_database_impl::load_state_dump( const fc::path& dir )
+      { try {
+          optional<index_snapshot_header> header;
+#define CHECK_DUMP_TABLE(r, data, elem) \
+          { \
+             std::ifstream in( ( dir / BOOST_PP_STRINGIZE(elem.bin) ).string().c_str(), std::ios::in | std::ios::binary ); \
+             const auto table_header = read_snapshot_header( in, dir / BOOST_PP_STRINGIZE(elem.bin) ); \
+             FC_ASSERT( !header.valid() || fc::raw::pack( *header ) == fc::raw::pack( table_header ), \
+                        "${file} was dumped at another block", ("file",BOOST_PP_STRINGIZE(elem.bin)) ); \
+             header = table_header; \
+          }
+          BOOST_PP_SEQ_FOR_EACH(CHECK_DUMP_TABLE, _, INDEX_SNAPSHOT_TABLES)
+#undef CHECK_DUMP_TABLE
+
+          const auto main_chain_id = _block_num_to_id_db.fetch_optional( header->block_num );
+          FC_ASSERT( main_chain_id.valid() && *main_chain_id == header->block_id, "the state dump is not on the stored chain" );
+          FC_ASSERT( _block_id_to_block_offset_db.fetch_optional( header->block_id ).valid(), "the state dump block is missing" );
+
+          const fc::path data_dir = _data_dir;
+          self->close();
+          fc::remove_all( data_dir / "index" );
+          fc::create_directories( data_dir / "index" );
+          open_database( data_dir );
+
+          std::vector<char> data;
+#define LOAD_DUMP_TABLE(r, data_, elem) \
+          { \
+             std::ifstream in( ( dir / BOOST_PP_STRINGIZE(elem.bin) ).string().c_str(), std::ios::in | std::ios::binary ); \
+             FC_ASSERT( in.is_open() && read_snapshot_record( in, data ), "unable to read ${file}", ("file",BOOST_PP_STRINGIZE(elem.bin)) ); \
+             read_snapshot_table( in, elem ); \
+          }
+          BOOST_PP_SEQ_FOR_EACH(LOAD_DUMP_TABLE, _, INDEX_SNAPSHOT_TABLES)
+#undef LOAD_DUMP_TABLE
+
+          _chain_id = header->chain_id;
+          _head_block_id = header->block_id;
+          _head_block_header = self->get_block_digest( header->block_id );
+          index_transactions();
+          index_order_books();
+          index_names();
+          index_known_blocks();
+          rebuild_market_candles( false );
+          rebuild_market_transaction_index( false );
+          rebuild_block_transaction_index( false );
+          _delegate_ranking_valid = false;
+          return header->block_num;
+      } FC_CAPTURE_AND_RETHROW( (dir) ) }
+#undef INDEX_SNAPSHOT_TABLES
+
       /**
        *  Performs all of the block validation steps and throws if error.
        */
@@ -1013,20 +4186,47 @@ namespace bts { namespace blockchain {
          block_summary summary;
          try
          {
+            /* each step is timed only while someone is listening, see chain_database::set_block_timing_callback */
+            optional<block_timing> timing;
+            fc::time_point step_start;
+            const auto start_step = [&]()
+            {
+               if( timing.valid() ) step_start = fc::time_point::now();
+            };
+            const auto end_step = [&]( fc::microseconds block_timing::* step )
+            {
+               if( timing.valid() ) (*timing).*step = fc::time_point::now() - step_start;
+            };
+            if( _block_timing_callback )
+            {
+               timing = block_timing();
+               timing->block_num = block_data.block_num;
+               timing->block_id = block_id;
+               timing->transaction_count = block_data.user_transactions.size();
+               step_start = fc::time_point::now();
+            }
+            const fc::time_point block_start = step_start;
+
             public_key_type block_signee;
-            if( CHECKPOINT_BLOCKS.size() > 0 && (--CHECKPOINT_BLOCKS.end())->first > block_data.block_num )
+            vector<transaction_id_type> trx_ids;
+            const bool assumed_valid = assume_valid( block_data.block_num );
+            const bool skip_block_signature = assumed_valid
+                                              || ( CHECKPOINT_BLOCKS.size() > 0 && (--CHECKPOINT_BLOCKS.end())->first > block_data.block_num );
+            if( skip_block_signature )
                //Skip signature validation
                block_signee = self->get_slot_signee( block_data.timestamp, self->get_active_delegates() ).active_key();
-            else
-               /* We need the block_signee's key in several places and computing it is expensive, so compute it here and pass it down */
-               block_signee = block_data.signee( block_data.block_num > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM );
+            /* We need the block_signee's key in several places and computing it is expensive, so compute it here and pass it down */
+            recover_signers( block_data, !skip_block_signature, !_skip_signature_verification && !assumed_valid, block_signee, trx_ids );
+            end_step( &block_timing::recover_signers );
 
             auto checkpoint_itr = CHECKPOINT_BLOCKS.find(block_data.block_num);
             if( checkpoint_itr != CHECKPOINT_BLOCKS.end() && checkpoint_itr->second != block_id )
               FC_CAPTURE_AND_THROW( failed_checkpoint_verification, (block_id)(checkpoint_itr->second) );
+            if( block_data.block_num == _assume_valid_block_num && block_id != _assume_valid_block_id )
+              FC_CAPTURE_AND_THROW( failed_checkpoint_verification, (block_id)(_assume_valid_block_id) );
 
             /* Note: Secret is validated later in update_delegate_production_info() */
-            verify_header( block_data, block_signee );
+            verify_header( block_data, block_signee, std::move( trx_ids ) );
 
             summary.block_data = block_data;
 
@@ -1034,6 +4234,7 @@ namespace bts { namespace blockchain {
 
             /* Create a pending state to track changes that would apply as we evaluate the block */
             pending_chain_state_ptr pending_state = std::make_shared<pending_chain_state>( self->shared_from_this() );
+            pending_state->capture_prior_values();
             summary.applied_changes = pending_state;
 
             /** Increment the blocks produced or missed for all delegates. This must be done
@@ -1049,21 +4250,35 @@ namespace bts { namespace blockchain {
 //            if( block_data.block_num < BTSX_MARKET_FORK_2_BLOCK_NUM )
 //                apply_transactions( block_data, pending_state );
 
+            start_step();
             execute_markets( block_data.timestamp, pending_state );
+            end_step( &block_timing::execute_markets );
 
 //            if( block_data.block_num >= BTSX_MARKET_FORK_2_BLOCK_NUM )
+            start_step();
                 apply_transactions( block_data, pending_state );
+            end_step( &block_timing::apply_transactions );
 
             update_active_delegate_list( block_data, pending_state );
 
             update_random_seed( block_data.previous_secret, pending_state );
 
+            /* Everything written to the index from here on reaches the disk in one atomic batch */
+            if( _use_unified_store )
+               _unified_store.begin_batch();
+
+            start_step();
             save_undo_state( block_id, pending_state );
+            end_step( &block_timing::save_undo_state );
 
             // TODO: verify that apply changes can be called any number of
             // times without changing the database other than the first
             // attempt.
+            start_step();
             pending_state->apply_changes();
+            end_step( &block_timing::apply_changes );
+            if( !_pending_evaluations.empty() || !_revalidation_base.empty() )
+               pending_state->collect_writes( _pending_block_changes );
 
             mark_included( block_id, true );
 
@@ -1071,7 +4286,24 @@ namespace bts { namespace blockchain {
 
             clear_pending( block_data );
 
+            if( _unified_store.in_batch() )
+               _unified_store.commit_batch();
+
+            /* The block number table lives in raw_chain, a separate LevelDB that is kept when the index is
+             * rebuilt, so it cannot join the index batch. It is written after the commit so that a block number
+             * only names a block whose state is already on disk; a crash in between leaves the raw chain one
+             * block short of the index, the same window open() has always had (see its TODO). */
             _block_num_to_id_db.store( block_data.block_num, block_id );
+            index_main_chain_block( block_data.block_num, block_id );
+
+            /* a block extends the validated run if it follows its end and its signatures were checked or assumed */
+            if( ( !_skip_signature_verification || assumed_valid ) && block_data.previous == _validated_block_id )
+            {
+               _validated_block_num = block_data.block_num;
+               _validated_block_id = block_id;
+               if( _validated_block_num % BTS_BLOCKCHAIN_VALIDATED_BLOCK_SAVE_INTERVAL == 0 )
+                  save_validated_block();
+            }
 
             // self->sanity_check();
 
@@ -1111,28 +4343,112 @@ namespace bts { namespace blockchain {
 //                    self->store_asset_record( record );
 //                }
 //            }
+
+            if( timing.valid() )
+            {
+               timing->total = fc::time_point::now() - block_start;
+               _block_timing_callback( *timing );
+            }
+
+            if( !_reindexing )
+               prune_block_bodies();
+            prune_market_history();
          }
          catch ( const fc::exception& e )
          {
             wlog( "error applying block: ${e}", ("e",e.to_detail_string() ));
+            /* The table caches have already seen these writes, so the disk must not be left behind them */
+            if( _unified_store.in_batch() )
+               _unified_store.commit_batch();
             mark_invalid( block_id, e );
             throw;
          }
 
          // purge the expired known transactions database, they cannot no longer fork us
-         auto itr = _unique_transactions.begin();
-         while( itr != _unique_transactions.end() && itr->first < self->now() )
-         {
-            itr = _unique_transactions.erase(itr);
-         }
+         _unique_transactions.purge_expired( self->now() );
 
          //Schedule the observer notifications for later; the chain is in a
          //non-premptable state right now, and observers may yield.
-         if( (now() - block_data.timestamp).to_seconds() < BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC )
-           for( chain_observer* o : _observers )
-              fc::async([o,summary]{o->block_applied( summary );}, "call_block_applied_observer");
+         if( !_observers.empty() )
+         {
+            observer_event event;
+            event.applied_block = std::make_shared<const block_summary>( std::move( summary ) );
+            notify_observers( event );
+         }
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block",block_data) ) }
 
+      static void drain_observer_queue( chain_observer* observer, const observer_queue_ptr& queue )
+      {
+         while( !queue->removed && !queue->events.empty() )
+         {
+            const observer_event event = std::move( queue->events.front() );
+            queue->events.pop_front();
+            const uint32_t dropped_blocks = queue->dropped_blocks;
+            const uint32_t dropped_transactions = queue->dropped_transactions;
+            const uint32_t dropped_state_changes = queue->dropped_state_changes;
+            queue->dropped_blocks = queue->dropped_transactions = queue->dropped_state_changes = 0;
+            try
+            {
+               if( dropped_blocks > 0 || dropped_transactions > 0 || dropped_state_changes > 0 )
+                  observer->notifications_dropped( dropped_blocks, dropped_transactions, dropped_state_changes );
+
+               if( event.applied_block )
+                  observer->block_applied( *event.applied_block );
+               else if( event.pending_transaction )
+                  observer->pending_transaction_stored( event.pending_transaction );
+               else
+                  observer->state_changed( event.undo_state );
+            }
+            catch( const fc::canceled_exception& )
+            {
+               throw;
+            }
+            catch( const fc::exception& e )
+            {
+               wlog( "chain observer threw: ${e}", ("e",e.to_detail_string()) );
+            }
+         }
+      }
+
+      /**
+       *  Queues the event for every observer and starts a drain task for each observer that has none
+       *  running. An observer more than BTS_BLOCKCHAIN_MAX_OBSERVER_QUEUE events behind loses its oldest
+       *  pending transaction, or failing that its oldest block_applied, so one that falls behind during
+       *  a sync is told about the newest blocks in order instead of being flooded with every one. It is
+       *  told how many it lost before its next notification.
+       */
+      void chain_database_impl::notify_observers( const observer_event& event )
+      {
+         for( const auto& item : _observers )
+         {
+            chain_observer* const observer = item.first;
+            const observer_queue_ptr& queue = item.second;
+
+            queue->events.push_back( event );
+            if( queue->events.size() > BTS_BLOCKCHAIN_MAX_OBSERVER_QUEUE )
+            {
+               auto oldest = std::find_if( queue->events.begin(), queue->events.end(),
+                                           []( const observer_event& e ) { return !!e.pending_transaction; } );
+               if( oldest == queue->events.end() )
+                  oldest = std::find_if( queue->events.begin(), queue->events.end(),
+                                         []( const observer_event& e ) { return !!e.applied_block; } );
+               if( oldest == queue->events.end() )
+                  oldest = queue->events.begin();
+
+               if( queue->dropped_blocks == 0 && queue->dropped_transactions == 0 && queue->dropped_state_changes == 0 )
+                  wlog( "A chain observer is ${n} notifications behind, dropping the oldest",
+                        ("n",BTS_BLOCKCHAIN_MAX_OBSERVER_QUEUE) );
+               if( oldest->pending_transaction )  ++queue->dropped_transactions;
+               else if( oldest->applied_block )   ++queue->dropped_blocks;
+               else                               ++queue->dropped_state_changes;
+               queue->events.erase( oldest );
+            }
+
+            if( !queue->drain.valid() || queue->drain.ready() )
+               queue->drain = fc::async( [observer, queue]{ drain_observer_queue( observer, queue ); }, "notify_chain_observer" );
+         }
+      }
+
       /**
        * Traverse the previous links of all blocks in fork until we find one that is_included
        *
@@ -1148,15 +4464,20 @@ namespace bts { namespace blockchain {
          block_id_type next_id = id;
          while( true )
          {
-            auto header = self->get_block_header( next_id );
-            //ilog( "header: ${h}", ("h",header) );
-            history.push_back( header.previous );
-            if( header.previous == block_id_type() )
+            fork_tree_node& node = fork_node( next_id );
+            if( node.block_num == 0 )
+            {
+               const auto header = self->get_block_header( next_id );
+               node.previous = header.previous;
+               node.block_num = header.block_num;
+            }
+            history.push_back( node.previous );
+            if( node.previous == block_id_type() )
             {
                ilog( "return: ${h}", ("h",history) );
                return history;
             }
-            auto prev_fork_data = _fork_db.fetch( header.previous );
+            const block_fork_data& prev_fork_data = fork_node( node.previous ).data;
 
             /// this shouldn't happen if the database invariants are properly maintained
             FC_ASSERT( prev_fork_data.is_linked, "we hit a dead end, this fork isn't really linked!" );
@@ -1165,12 +4486,33 @@ namespace bts { namespace blockchain {
                ilog( "return: ${h}", ("h",history) );
                return history;
             }
-            next_id = header.previous;
+            next_id = node.previous;
          }
          ilog( "${h}", ("h",history) );
          return history;
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",id) ) }
 
+      void chain_database_impl::index_main_chain_block( uint32_t block_num, const block_id_type& block_id )
+      {
+         FC_ASSERT( block_num > 0 );
+         if( _main_chain_ids.size() >= block_num )
+            _main_chain_block_nums.erase( _main_chain_ids[ block_num - 1 ] );
+         // reindexing stores the chain again from the start, so a block may replace one already indexed
+         _main_chain_ids.resize( std::max<size_t>( _main_chain_ids.size(), block_num ) );
+         _main_chain_ids[ block_num - 1 ] = block_id;
+         _main_chain_block_nums[ block_id ] = block_num;
+      }
+
+      /** forgets block_num and everything after it */
+      void chain_database_impl::unindex_main_chain_block( uint32_t block_num )
+      {
+         while( _main_chain_ids.size() >= block_num && !_main_chain_ids.empty() )
+         {
+            _main_chain_block_nums.erase( _main_chain_ids.back() );
+            _main_chain_ids.pop_back();
+         }
+      }
+
       void chain_database_impl::pop_block()
       { try {
          if( _head_block_header.block_num == 0 )
@@ -1181,23 +4523,48 @@ namespace bts { namespace blockchain {
 
            // update the is_included flag on the fork data
          mark_included( _head_block_id, false );
+         uncache_block_record( _head_block_id );
 
          // update the block_num_to_block_id index
          _block_num_to_id_db.remove( _head_block_header.block_num );
+         unindex_main_chain_block( _head_block_header.block_num );
+         if( _head_block_id == _validated_block_id )
+         {
+            _validated_block_num = _head_block_header.block_num - 1;
+            _validated_block_id = _head_block_header.previous;
+         }
 
          auto previous_block_id = _head_block_header.previous;
 
-         bts::blockchain::pending_chain_state_ptr undo_state = std::make_shared<bts::blockchain::pending_chain_state>(_undo_state_db.fetch( _head_block_id ));
-         undo_state->set_prev_state( self->shared_from_this() );
+         // the head is normally the newest hot undo state, the database only has to be read after deep reorgs.
+         // Newer entries belong to blocks whose application failed after their undo state was saved.
+         while( !_hot_undo_states.empty() && _hot_undo_states.back().first != _head_block_id )
+            _hot_undo_states.pop_back();
+         bts::blockchain::pending_chain_state_ptr undo_state;
+         if( !_hot_undo_states.empty() )
+         {
+            undo_state = _hot_undo_states.back().second.to_undo_state( self->shared_from_this() );
+            _hot_undo_states.pop_back();
+         }
+         else
+         {
+            undo_state = _undo_state_db.fetch( _head_block_id ).to_undo_state( self->shared_from_this() );
+         }
          undo_state->apply_changes();
+         if( !_pending_evaluations.empty() || !_revalidation_base.empty() )
+            undo_state->collect_writes( _pending_block_changes );
 
          _head_block_id = previous_block_id;
          _head_block_header = self->get_block_header( _head_block_id );
 
          //Schedule the observer notifications for later; the chain is in a
          //non-premptable state right now, and observers may yield.
-         for( chain_observer* o : _observers )
-            fc::async([o,undo_state]{ o->state_changed( undo_state ); }, "call_state_changed_observer");
+         if( !_observers.empty() )
+         {
+            observer_event event;
+            event.undo_state = undo_state;
+            notify_observers( event );
+         }
       } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
    } // namespace detail
@@ -1236,17 +4603,14 @@ namespace bts { namespace blockchain {
     */
    std::vector<account_id_type> chain_database::get_delegates_by_vote( uint32_t first, uint32_t count )const
    { try {
-      auto del_vote_itr = my->_delegate_vote_index_db.begin();
+      const auto& ranking = my->delegate_ranking();
       std::vector<account_id_type> sorted_delegates;
-      sorted_delegates.reserve( count );
-      uint32_t pos = 0;
-      while( sorted_delegates.size() < count && del_vote_itr.valid() )
-      {
-         if( pos >= first )
-            sorted_delegates.push_back( del_vote_itr.key().delegate_id );
-         ++pos;
-         ++del_vote_itr;
-      }
+      if( first >= ranking.size() )
+         return sorted_delegates;
+      const auto last = ranking.begin() + first + std::min<size_t>( count, ranking.size() - first );
+      sorted_delegates.reserve( last - ranking.begin() - first );
+      for( auto itr = ranking.begin() + first; itr != last; ++itr )
+         sorted_delegates.push_back( itr->vote.delegate_id );
       return sorted_delegates;
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
@@ -1255,22 +4619,30 @@ namespace bts { namespace blockchain {
     */
    std::vector<account_record> chain_database::get_delegate_records_by_vote(uint32_t first, uint32_t count )const
    { try {
-      auto del_vote_itr = my->_delegate_vote_index_db.begin();
+      const auto& ranking = my->delegate_ranking();
       std::vector<account_record> sorted_delegates;
-      uint32_t pos = 0;
-      while( sorted_delegates.size() < count && del_vote_itr.valid() )
-      {
-         if( pos >= first )
-            sorted_delegates.push_back( *get_account_record(del_vote_itr.value()) );
-         ++pos;
-         ++del_vote_itr;
-      }
+      if( first >= ranking.size() )
+         return sorted_delegates;
+      const auto last = ranking.begin() + first + std::min<size_t>( count, ranking.size() - first );
+      sorted_delegates.reserve( last - ranking.begin() - first );
+      for( auto itr = ranking.begin() + first; itr != last; ++itr )
+         sorted_delegates.push_back( *itr->record );
       return sorted_delegates;
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
    void chain_database::open( const fc::path& data_dir, fc::optional<fc::path> genesis_file, std::function<void(float)> reindex_status_callback )
    { try {
       bool must_rebuild_index = !fc::exists( data_dir / "index" );
+      if( !must_rebuild_index && my->_use_unified_store != fc::exists( data_dir / "index/unified_db" ) )
+      {
+          ilog( "Index storage layout changed, rebuilding database index..." );
+          must_rebuild_index = true;
+      }
+      if( fc::exists( data_dir / "raw_chain/block_id_to_block_data_db" ) || fc::exists( data_dir / "raw_chain/id_to_data_orig" ) )
+      {
+          ilog( "Moving raw blocks into the block log, rebuilding database index..." );
+          must_rebuild_index = true;
+      }
       std::exception_ptr error_opening_database;
       try
       {
@@ -1298,119 +4670,249 @@ namespace bts { namespace blockchain {
             must_rebuild_index = true;
           }
 
-          if( must_rebuild_index || last_block_num == uint32_t(-1) )
+          if( must_rebuild_index && ( my->_block_log.is_pruned() || fc::exists( data_dir / "raw_chain/state_synced" ) ) )
+             FC_THROW( "The index cannot be rebuilt because old block bodies have been pruned; resync the blockchain instead" );
+
+          /* A follower has no raw chain of its own to reindex from; it starts over and rereads the primary's log */
+          if( my->_primary_data_dir.valid() && ( must_rebuild_index || last_block_num == uint32_t(-1) ) )
+          {
+             close();
+             fc::remove_all( data_dir / "index" );
+             fc::remove_all( data_dir / "raw_chain" );
+             fc::create_directories( data_dir / "index" );
+             my->open_database( data_dir );
+             my->initialize_genesis( genesis_file );
+             set_property( followed_block_log_offset, variant( uint64_t( 0 ) ) );
+             must_rebuild_index = false;
+          }
+
+          /* A missing or stale index is restored from a snapshot when the raw chain is already in its final form */
+          bool restored_from_snapshot = false;
+          if( must_rebuild_index && last_block_num != uint32_t(-1)
+              && !fc::exists( data_dir / "raw_chain/block_id_to_block_data_db" ) && !fc::exists( data_dir / "raw_chain/id_to_data_orig" )
+              && !fc::exists( data_dir / "raw_chain/block_log_orig" ) )
           {
              close();
              fc::remove_all( data_dir / "index" );
              fc::create_directories( data_dir / "index");
-             if( !fc::is_directory(data_dir / "raw_chain/id_to_data_orig") )
-                fc::rename( data_dir / "raw_chain/block_id_to_block_data_db", data_dir / "raw_chain/id_to_data_orig" );
+             restored_from_snapshot = my->restore_index_snapshot( data_dir );
+          }
 
-             //During reindexing we implement stop-and-copy garbage collection on the raw chain
-             decltype(my->_block_id_to_block_data_db) id_to_data_orig;
-             id_to_data_orig.open( data_dir / "raw_chain/id_to_data_orig" );
-             auto orig_chain_size = fc::directory_size( data_dir / "raw_chain/id_to_data_orig" );
+          if( restored_from_snapshot )
+          {
+             std::vector<block_id_type> replay_ids;
+             for( auto itr = my->_block_num_to_id_db.lower_bound( my->_head_block_header.block_num + 1 ); itr.valid(); ++itr )
+                replay_ids.push_back( itr.value() );
 
-             my->open_database( data_dir );
+             std::cout << "Restored index snapshot at block " << my->_head_block_header.block_num
+                       << ", replaying " << replay_ids.size() << " blocks...\n" << std::flush;
+             for( const auto& id : replay_ids )
+             {
+                const auto offset = my->_block_id_to_block_offset_db.fetch_optional( id );
+                if( !offset.valid() )
+                   break;
+                push_block( my->_block_log.read( *offset ) );
+             }
+          }
+          else if( !my->_primary_data_dir.valid() && ( must_rebuild_index || last_block_num == uint32_t(-1) ) )
+          {
+             close();
+             fc::remove_all( data_dir / "index" );
+             fc::create_directories( data_dir / "index");
 
-             const auto set_db_cache_write_through = [ this ]( bool write_through )
+             //During reindexing we implement stop-and-copy garbage collection on the raw chain.
+             //The source is either the block log of a previous run or the LevelDB table older versions kept blocks in.
+             const fc::path legacy_orig_dir = data_dir / "raw_chain/id_to_data_orig";
+             const fc::path log_orig_file = data_dir / "raw_chain/block_log_orig";
+             const fc::path offset_orig_dir = data_dir / "raw_chain/block_id_to_block_offset_orig";
+             if( !fc::is_directory( legacy_orig_dir ) && fc::exists( data_dir / "raw_chain/block_id_to_block_data_db" ) )
+                fc::rename( data_dir / "raw_chain/block_id_to_block_data_db", legacy_orig_dir );
+             const bool from_legacy = fc::is_directory( legacy_orig_dir );
+
+             if( !from_legacy && !fc::exists( log_orig_file ) )
              {
-                 my->_property_db.set_write_through( write_through );
-                 my->_slate_db.set_write_through( write_through );
-
-                 my->_account_db.set_write_through( write_through );
-                 my->_account_index_db.set_write_through( write_through );
-                 my->_address_to_account_db.set_write_through( write_through );
-                 my->_delegate_vote_index_db.set_write_through( write_through );
-
-                 my->_asset_db.set_write_through( write_through );
-                 my->_symbol_index_db.set_write_through( write_through );
-
-                 my->_ask_db.set_write_through( write_through );
-                 my->_bid_db.set_write_through( write_through );
-//                 my->_relative_ask_db.set_write_through( write_through );
-//                 my->_relative_bid_db.set_write_through( write_through );
-                 my->_short_db.set_write_through( write_through );
-                 my->_collateral_db.set_write_through( write_through );
-
-                 my->_feed_db.set_write_through( write_through );
-                 my->_market_status_db.set_write_through( write_through );
-                 my->_market_transactions_db.set_write_through( write_through );
-             };
+                fc::rename( data_dir / "raw_chain/block_log", log_orig_file );
+                fc::rename( data_dir / "raw_chain/block_id_to_block_offset_db", offset_orig_dir );
+             }
+             else
+             {
+                // the original copy is already set aside, rebuild the block log from scratch
+                fc::remove_all( data_dir / "raw_chain/block_log" );
+                fc::remove_all( data_dir / "raw_chain/block_id_to_block_offset_db" );
+             }
+
+             bts::db::level_map<block_id_type, full_block> id_to_data_orig;
+             block_log block_log_orig;
+             bts::db::level_map<block_id_type, uint64_t> id_to_offset_orig;
+             uint64_t orig_chain_size = 0;
+             if( from_legacy )
+             {
+                id_to_data_orig.open( legacy_orig_dir );
+                orig_chain_size = fc::directory_size( legacy_orig_dir );
+             }
+             else
+             {
+                block_log_orig.open( log_orig_file );
+                id_to_offset_orig.open( offset_orig_dir );
+                orig_chain_size = block_log_orig.size() + fc::directory_size( offset_orig_dir );
+             }
+
+             my->open_database( data_dir );
+
+             /* Dirty records are committed on this thread while the next blocks are being evaluated */
+             fc::thread db_writer( "db_writer" );
 
              // For the duration of reindexing, we allow certain databases to postpone flushing until we finish
-             set_db_cache_write_through( false );
+             my->set_bulk_load_writer( &db_writer );
+             my->_reindexing = true;
 
-             my->initialize_genesis( genesis_file );
+             try
+             {
+                my->initialize_genesis( genesis_file );
 
-             map<uint32_t, block_id_type> num_to_id;
-             for (auto itr = my->_block_num_to_id_db.begin(); itr.valid(); ++itr)
-                 num_to_id[itr.key()] = itr.value();
+                map<uint32_t, block_id_type> num_to_id;
+                for (auto itr = my->_block_num_to_id_db.begin(); itr.valid(); ++itr)
+                    num_to_id[itr.key()] = itr.value();
 
-             if( !reindex_status_callback )
-                std::cout << "Please be patient, this will take a few minutes...\r\nRe-indexing database..." << std::flush << std::fixed;
-             else
-                 reindex_status_callback(0);
-
-             uint32_t blocks_indexed = 0;
-             const float total_blocks = num_to_id.size();
-             auto genesis_time = get_genesis_timestamp();
-             auto start_time = blockchain::now();
-
-             auto insert_block = [&](const full_block& block) {
-                 if( blocks_indexed % 200 == 0 ) {
-                     float progress;
-                     if (total_blocks)
-                         progress = blocks_indexed / total_blocks;
-                     else
-                         progress = float(blocks_indexed*BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC) / (start_time - genesis_time).to_seconds();
-                     progress *= 100;
-
-                     if( !reindex_status_callback )
-                         std::cout << "\rRe-indexing database... "
-                                      "Approximately " << std::setprecision(2) << progress << "% complete." << std::flush;
-                     else
-                         reindex_status_callback(progress);
-                 }
+                /* the validated run is only reused if the raw chain still holds its last block */
+                const auto validated_itr = num_to_id.find( my->_validated_block_num );
+                if( validated_itr == num_to_id.end() || validated_itr->second != my->_validated_block_id )
+                {
+                   my->_validated_block_num = 0;
+                   my->_validated_block_id = block_id_type();
+                }
+                else
+                {
+                   std::cout << "Skipping the signature checks of the " << my->_validated_block_num
+                             << " blocks already validated here.\n" << std::flush;
+                }
 
-                 push_block(block);
-                 ++blocks_indexed;
+                /* a raw chain that already has another block at the assume-valid height is verified in full */
+                const auto assumed_itr = num_to_id.find( my->_assume_valid_block_num );
+                if( assumed_itr != num_to_id.end() && assumed_itr->second != my->_assume_valid_block_id )
+                {
+                   wlog( "The stored chain does not contain assume-valid block ${id}; verifying every signature",
+                         ("id",my->_assume_valid_block_id) );
+                   my->_assume_valid_block_num = 0;
+                }
 
-                 if( blocks_indexed % 1000 == 0 )
-                 {
-                     set_db_cache_write_through( true );
-                     set_db_cache_write_through( false );
-                 }
-             };
+                if( !reindex_status_callback )
+                   std::cout << "Please be patient, this will take a few minutes...\r\nRe-indexing database..." << std::flush << std::fixed;
+                else
+                    reindex_status_callback(0);
+
+                uint32_t blocks_indexed = 0;
+                const float total_blocks = num_to_id.size();
+                auto genesis_time = get_genesis_timestamp();
+                auto start_time = blockchain::now();
+                const fc::time_point reindex_start = fc::time_point::now();
+
+                auto insert_block = [&](const full_block& block) {
+                    if( blocks_indexed % 200 == 0 ) {
+                        float progress;
+                        if (total_blocks)
+                            progress = blocks_indexed / total_blocks;
+                        else
+                            progress = float(blocks_indexed*BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC) / (start_time - genesis_time).to_seconds();
+                        progress *= 100;
+
+                        const int64_t elapsed_us = std::max<int64_t>( 1, (fc::time_point::now() - reindex_start).count() );
+                        if( !reindex_status_callback )
+                            std::cout << "\rRe-indexing database... "
+                                         "Approximately " << std::setprecision(2) << progress << "% complete, "
+                                      << std::setprecision(0) << blocks_indexed * 1000000.0 / elapsed_us << " blocks/s." << std::flush;
+                        else
+                            reindex_status_callback(progress);
+                    }
 
-             if (num_to_id.empty()) {
-                 auto block_itr = id_to_data_orig.begin();
-                 while( block_itr.valid() ) {
-                     insert_block(block_itr.value());
-                     ++block_itr;
-                 }
-             }
-             else
-             {
-                 for (const auto& num_id : num_to_id) {
-                     auto oblock = id_to_data_orig.fetch_optional(num_id.second);
-                     if (oblock)
-                         insert_block(*oblock);
-                 }
-             }
+                    push_block(block);
+                    ++blocks_indexed;
 
-             // Re-enable flushing on all cached databases we disabled it on above
-             set_db_cache_write_through( true );
+                    if( blocks_indexed % 1000 == 0 )
+                        my->flush_bulk_load_caches();
+                };
 
-             id_to_data_orig.close();
-             fc::remove_all( data_dir / "raw_chain/id_to_data_orig" );
-             auto final_chain_size = fc::directory_size( data_dir / "raw_chain/block_id_to_block_data_db" );
+                /* Blocks are read in the order they will be pushed: the legacy table by id, the block log by offset */
+                std::vector<block_id_type> legacy_ids;
+                std::vector<uint64_t> log_offsets;
+                if (num_to_id.empty()) {
+                    if( from_legacy )
+                    {
+                        for( auto block_itr = id_to_data_orig.begin(); block_itr.valid(); ++block_itr )
+                            legacy_ids.push_back( block_itr.key() );
+                    }
+                    else
+                    {
+                        for( auto offset_itr = id_to_offset_orig.begin(); offset_itr.valid(); ++offset_itr )
+                            log_offsets.push_back( offset_itr.value() );
+                    }
+                }
+                else
+                {
+                    for (const auto& num_id : num_to_id) {
+                        if( from_legacy )
+                        {
+                            legacy_ids.push_back( num_id.second );
+                        }
+                        else
+                        {
+                            auto offset = id_to_offset_orig.fetch_optional(num_id.second);
+                            if (offset)
+                                log_offsets.push_back( *offset );
+                        }
+                    }
+                }
+                const size_t block_count = from_legacy ? legacy_ids.size() : log_offsets.size();
 
-             std::cout << "\rSuccessfully re-indexed " << blocks_indexed << " blocks in "
-                       << (blockchain::now() - start_time).to_seconds() << " seconds.                          "
-                                                                           "\nBlockchain size changed from "
-                       << orig_chain_size / 1024 / 1024 << "MiB to "
-                       << final_chain_size / 1024 / 1024 << "MiB.\n" << std::flush;
+                block_pipeline_times times;
+                my->push_blocks_pipelined( block_count, [&]( size_t first, size_t last )
+                {
+                    std::vector<full_block> blocks;
+                    blocks.reserve( last - first );
+                    for( size_t i = first; i < last; ++i )
+                    {
+                        if( from_legacy )
+                        {
+                            auto oblock = id_to_data_orig.fetch_optional( legacy_ids[ i ] );
+                            if( oblock )
+                                blocks.push_back( std::move( *oblock ) );
+                        }
+                        else
+                        {
+                            blocks.push_back( block_log_orig.read( log_offsets[ i ] ) );
+                        }
+                    }
+                    return blocks;
+                }, insert_block, times );
+
+                // Re-enable flushing on all cached databases we disabled it on above
+                my->_reindexing = false;
+                my->set_bulk_load_writer( nullptr );
+
+                id_to_data_orig.close();
+                block_log_orig.close();
+                id_to_offset_orig.close();
+                fc::remove_all( legacy_orig_dir );
+                fc::remove_all( log_orig_file );
+                fc::remove_all( offset_orig_dir );
+                auto final_chain_size = my->_block_log.size() + fc::directory_size( data_dir / "raw_chain/block_id_to_block_offset_db" );
+
+                std::cout << "\rSuccessfully re-indexed " << blocks_indexed << " blocks in "
+                          << (blockchain::now() - start_time).to_seconds() << " seconds.                          "
+                                                                              "\nBlockchain size changed from "
+                          << orig_chain_size / 1024 / 1024 << "MiB to "
+                          << final_chain_size / 1024 / 1024 << "MiB.\n" << std::flush;
+                std::cout << std::setprecision(1)
+                          << "Time spent reading blocks: " << times.read_us / 1000000.0 << "s, recovering signatures: "
+                          << times.recover_us / 1000000.0 << "s, applying blocks: " << times.apply_us / 1000000.0
+                          << "s, waiting for prefetched blocks: " << times.stall_us / 1000000.0 << "s.\n" << std::flush;
+             }
+             catch( ... )
+             {
+                my->_reindexing = false;
+                my->set_bulk_load_writer( nullptr );
+                throw;
+             }
           }
           const auto db_chain_id = get_property( bts::blockchain::chain_id ).as<digest_type>();
           const auto genesis_chain_id = my->initialize_genesis( genesis_file, true );
@@ -1418,6 +4920,10 @@ namespace bts { namespace blockchain {
               FC_THROW_EXCEPTION( wrong_chain_id, "Wrong chain ID!", ("database_id",db_chain_id)("genesis_id",genesis_chain_id) );
           my->_chain_id = db_chain_id;
 
+          my->rebuild_market_candles( true );
+          my->rebuild_market_transaction_index( true );
+          my->rebuild_block_transaction_index( true );
+
           //  process the pending transactions to cache by fees
           auto pending_itr = my->_pending_transaction_db.begin();
           wlog( "loading pending trx..." );
@@ -1428,10 +4934,12 @@ namespace bts { namespace blockchain {
                 wlog( " loading pending transaction ${trx}", ("trx",trx) );
                 auto trx_id = trx.id();
                 auto id = trx.digest(my->_chain_id);
-                auto eval_state = evaluate_transaction( trx, my->_relay_fee );
-                share_type fees = eval_state->get_fees();
-                my->_pending_fee_index[ fee_index( fees, trx_id ) ] = eval_state;
+                pending_evaluation evaluation = my->evaluate_pending( trx, my->_relay_fee );
+                share_type fees = evaluation.eval_state->get_fees();
+                my->_pending_fee_index[ fee_index( fees, trx_id ) ] = evaluation.eval_state;
                 my->_pending_transaction_db.store( id, trx );
+                my->track_pending( id, *evaluation.eval_state, fees );
+                my->_pending_evaluations.push_back( std::move( evaluation ) );
              }
              catch ( const fc::exception& e )
              {
@@ -1443,6 +4951,7 @@ namespace bts { namespace blockchain {
       catch (...)
       {
         error_opening_database = std::current_exception();
+        my->_reindexing = false;
       }
 
       if (error_opening_database)
@@ -1455,29 +4964,153 @@ namespace bts { namespace blockchain {
 
    } FC_RETHROW_EXCEPTIONS( warn, "", ("data_dir",data_dir) ) }
 
+   void chain_database::preverify_block( const full_block& block_data )
+   { try {
+      if( my->_skip_signature_verification || my->assume_valid( block_data.block_num ) ) return;
+      my->start_signature_recovery_threads();
+
+      const auto block = std::make_shared<full_block>( block_data );
+      const digest_type chain_id = my->_chain_id;
+      const bool enforce_canonical = block->block_num > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM;
+      auto& thread = *my->_signature_recovery_threads[ my->_next_preverify_thread++ % my->_signature_recovery_threads.size() ];
+
+      // the future is dropped; failures are reported when the block is pushed and verified in order
+      thread.async( [block, chain_id, enforce_canonical]()
+      {
+         try
+         {
+            signature_cache::instance().recover( block->delegate_signature, block->digest(), enforce_canonical );
+            for( const auto& trx : block->user_transactions )
+            {
+               const auto digest = trx.digest( chain_id );
+               for( const auto& sig : trx.signatures )
+                  signature_cache::instance().recover( sig, digest, enforce_canonical );
+            }
+         }
+         catch( ... )
+         {
+         }
+      }, "preverify_block" );
+   } FC_CAPTURE_AND_RETHROW( (block_data.block_num) ) }
+
+   void chain_database::verify_block_header( const full_block& block_data )
+   { try {
+      const bool enforce_canonical = block_data.block_num > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM;
+      const public_key_type block_signee = signature_cache::instance().recover( block_data.delegate_signature, block_data.digest(),
+                                                                                enforce_canonical )->key;
+      vector<transaction_id_type> trx_ids;
+      trx_ids.reserve( block_data.user_transactions.size() );
+      for( const auto& trx : block_data.user_transactions )
+         trx_ids.push_back( trx.id() );
+      my->verify_header( block_data, block_signee, std::move( trx_ids ) );
+   } FC_CAPTURE_AND_RETHROW( (block_data.block_num) ) }
+
+   fc::future<void> chain_database::preverify_transaction( const signed_transaction& trx )
+   { try {
+      if( my->_skip_signature_verification || trx.signatures.empty() )
+      {
+         fc::promise<void>::ptr done( new fc::promise<void>( "preverify_transaction" ) );
+         done->set_value();
+         return done;
+      }
+      my->start_signature_recovery_threads();
+
+      const auto transaction = std::make_shared<signed_transaction>( trx );
+      const digest_type chain_id = my->_chain_id;
+      const bool enforce_canonical = get_head_block_num() > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM;
+      auto& thread = *my->_signature_recovery_threads[ my->_next_preverify_thread++ % my->_signature_recovery_threads.size() ];
+
+      return thread.async( [transaction, chain_id, enforce_canonical]()
+      {
+         try
+         {
+            const auto digest = transaction->digest( chain_id );
+            for( const auto& sig : transaction->signatures )
+               signature_cache::instance().recover( sig, digest, enforce_canonical );
+         }
+         catch( ... )
+         {
+         }
+      }, "preverify_transaction" );
+   } FC_CAPTURE_AND_RETHROW( (trx) ) }
+
    void chain_database::close()
    { try {
+      if( my->_integrity_check_loop.valid() && !my->_integrity_check_loop.ready() )
+      {
+         try
+         {
+            my->_integrity_check_loop.cancel_and_wait( "chain_database closing" );
+         }
+         catch( const fc::canceled_exception& )
+         {
+         }
+      }
+      my->wait_for_integrity_scans();
+      my->wait_for_snapshot_reads();
+      my->wait_for_balance_snapshot();
+      my->wait_for_index_snapshot();
+      my->_list_cursors.clear();
+      my->_delegate_ranking_valid = false;
+      my->_delegate_ranking.clear();
+
+      if( my->_online_upgrade_task.valid() && !my->_online_upgrade_task.ready() )
+      {
+         try
+         {
+            my->_online_upgrade_task.cancel_and_wait( "chain_database closing" );
+         }
+         catch( const fc::canceled_exception& )
+         {
+         }
+      }
+
       my->_market_transactions_db.close();
       my->_fork_number_db.close();
+      if( my->_fork_db.is_open() )
+         my->flush_fork_tree();
+      my->_fork_tree.clear();
       my->_fork_db.close();
       my->_slate_db.close();
       my->_property_db.close();
+      my->clear_property_cache();
 #if 0
       my->_proposal_db.close();
       my->_proposal_vote_db.close();
 #endif
 
       my->_undo_state_db.close();
+      my->_hot_undo_states.clear();
 
       my->_block_num_to_id_db.close();
+      my->_main_chain_ids.clear();
+      my->_main_chain_block_nums.clear();
+      my->_pending_pool.clear();
+      my->_pending_by_fee_rate.clear();
+      my->_pending_by_expiration.clear();
+      my->_pending_per_signer.clear();
+      my->_pending_pool_bytes = 0;
       my->_block_id_to_block_record_db.close();
-      my->_block_id_to_block_data_db.close();
+      my->_block_record_cache.clear();
+      my->_block_record_lru.clear();
+      my->_block_id_to_block_offset_db.close();
+      try
+      {
+         my->save_validated_block();
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "${e}", ("e",e.to_detail_string()) );
+      }
+      my->_block_log.close();
       my->_id_to_transaction_record_db.close();
+      my->_address_transaction_index_db.close();
 
       my->_pending_transaction_db.close();
 
       my->_asset_db.close();
       my->_balance_db.close();
+      my->_owner_balance_index_db.close();
       my->_burn_db.close();
       my->_account_db.close();
       my->_address_to_account_db.close();
@@ -1487,15 +5120,27 @@ namespace bts { namespace blockchain {
       my->_delegate_vote_index_db.close();
 
       my->_slot_record_db.close();
+      my->_delegate_slot_index_db.close();
 
       my->_ask_db.close();
       my->_bid_db.close();
       my->_short_db.close();
       my->_collateral_db.close();
       my->_feed_db.close();
+      my->_owner_ask_index_db.close();
+      my->_owner_bid_index_db.close();
+      my->_owner_short_index_db.close();
+      my->_owner_collateral_index_db.close();
+      my->_delegate_feed_index_db.close();
 
       my->_market_history_db.close();
+      my->_market_candle_db.close();
+      my->_market_transaction_index_db.close();
+      my->_block_transaction_db.close();
       my->_market_status_db.close();
+      my->_asset_totals_db.close();
+
+      my->_unified_store.close();
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
    account_record chain_database::get_delegate_record_for_signee( const public_key_type& block_signee )const
@@ -1553,23 +5198,7 @@ namespace bts { namespace blockchain {
 
    transaction_evaluation_state_ptr chain_database::evaluate_transaction( const signed_transaction& trx, const share_type& required_fees )
    { try {
-      if( !my->_pending_trx_state )
-         my->_pending_trx_state = std::make_shared<pending_chain_state>( shared_from_this() );
-
-      pending_chain_state_ptr          pend_state = std::make_shared<pending_chain_state>(my->_pending_trx_state);
-      transaction_evaluation_state_ptr trx_eval_state = std::make_shared<transaction_evaluation_state>(pend_state.get(), my->_chain_id);
-
-      trx_eval_state->evaluate( trx, false, pend_state->get_head_block_num() > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM );
-      auto fees = trx_eval_state->get_fees() + trx_eval_state->alt_fees_paid.amount;
-      if( fees < required_fees )
-      {
-          wlog("Transaction ${id} needed relay fee ${required_fees} but only had ${fees}", ("id", trx.id())("required_fees",required_fees)("fees",fees));
-          FC_CAPTURE_AND_THROW( insufficient_relay_fee, (fees)(required_fees) );
-      }
-      // apply changes from this transaction to _pending_trx_state
-      pend_state->apply_changes();
-
-      return trx_eval_state;
+      return my->evaluate_pending( trx, required_fees ).eval_state;
    } FC_CAPTURE_AND_RETHROW( (trx) ) }
 
    optional<fc::exception> chain_database::get_transaction_error( const signed_transaction& transaction, const share_type& min_fee )
@@ -1611,7 +5240,7 @@ namespace bts { namespace blockchain {
 
    oblock_record chain_database::get_block_record( const block_id_type& block_id ) const
    { try {
-      return my->_block_id_to_block_record_db.fetch_optional(block_id);
+      return my->fetch_block_record( block_id );
    } FC_CAPTURE_AND_RETHROW( (block_id) ) }
 
    oblock_record chain_database::get_block_record( uint32_t block_num ) const
@@ -1621,15 +5250,37 @@ namespace bts { namespace blockchain {
 
    block_id_type chain_database::get_block_id( uint32_t block_num ) const
    { try {
+      if( block_num > 0 && block_num <= my->_main_chain_ids.size() && my->_main_chain_ids[ block_num - 1 ] != block_id_type() )
+         return my->_main_chain_ids[ block_num - 1 ];
       return my->_block_num_to_id_db.fetch( block_num );
    } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
    vector<transaction_record> chain_database::get_transactions_for_block( const block_id_type& block_id )const
    {
-      auto block_record = my->_block_id_to_block_record_db.fetch(block_id);
+      const auto orecord = my->fetch_block_record( block_id );
+      if( !orecord.valid() )
+         FC_CAPTURE_AND_THROW( fc::key_not_found_exception, (block_id) );
+      const block_record& block_record = *orecord;
       vector<transaction_record> result;
       result.reserve( block_record.user_transaction_ids.size() );
 
+      /* the records are adjacent in _block_transaction_db, read in one pass unless the block is off the main
+         chain or its records are not all there, when each is looked up by id */
+      for( auto itr = my->_block_transaction_db.lower_bound( block_transaction_key( transaction_location( block_record.block_num, 0 ) ) );
+           itr.valid() && result.size() < block_record.user_transaction_ids.size(); ++itr )
+      {
+         const auto key = itr.key();
+         if( key.block_num != block_record.block_num || key.trx_num != result.size() )
+            break;
+         transaction_record record = itr.value();
+         if( record.trx_id() != block_record.user_transaction_ids[ key.trx_num ] )
+            break;
+         result.emplace_back( std::move( record ) );
+      }
+      if( result.size() == block_record.user_transaction_ids.size() )
+         return result;
+      result.clear();
+
       for( const auto& trx_id : block_record.user_transaction_ids )
       {
          auto otrx_record = get_transaction( trx_id );
@@ -1639,20 +5290,43 @@ namespace bts { namespace blockchain {
       return result;
    }
 
+   vector<transaction_record> chain_database::get_address_transactions( const address& owner,
+                                                                       const transaction_location& start,
+                                                                       uint32_t limit )const
+   { try {
+      FC_ASSERT( my->_address_history_enabled, "The address history index is not enabled" );
+      vector<transaction_record> result;
+
+      address_transaction_key key;
+      key.owner = owner;
+      key.block_num = start.block_num;
+      key.trx_num = start.trx_num;
+      for( auto itr = my->_address_transaction_index_db.lower_bound( key );
+           itr.valid() && itr.key().owner == owner && result.size() < limit; ++itr )
+      {
+         const auto record = my->_id_to_transaction_record_db.fetch_optional( itr.value() );
+         if( record.valid() )
+            result.push_back( *record );
+      }
+      return result;
+   } FC_CAPTURE_AND_RETHROW( (owner)(start)(limit) ) }
+
    digest_block chain_database::get_block_digest( const block_id_type& block_id )const
    {
-      return my->_block_id_to_block_record_db.fetch( block_id );
+      const auto record = my->fetch_block_record( block_id );
+      if( !record.valid() )
+         FC_CAPTURE_AND_THROW( fc::key_not_found_exception, (block_id) );
+      return *record;
    }
 
    digest_block chain_database::get_block_digest( uint32_t block_num )const
    {
-      auto block_id = my->_block_num_to_id_db.fetch( block_num );
-      return get_block_digest( block_id );
+      return get_block_digest( get_block_id( block_num ) );
    }
 
    full_block chain_database::get_block( const block_id_type& block_id )const
    { try {
-      return my->_block_id_to_block_data_db.fetch(block_id);
+      return my->_block_log.read( my->_block_id_to_block_offset_db.fetch( block_id ) );
    } FC_CAPTURE_AND_RETHROW( (block_id) ) }
 
    full_block chain_database::get_block( uint32_t block_num )const
@@ -1661,6 +5335,16 @@ namespace bts { namespace blockchain {
       return get_block( block_id );
    } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",block_num) ) }
 
+   std::vector<char> chain_database::get_packed_block( uint32_t block_num )const
+   { try {
+      return get_packed_block( my->_block_num_to_id_db.fetch( block_num ) );
+   } FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
+   std::vector<char> chain_database::get_packed_block( const block_id_type& block_id )const
+   { try {
+      return my->_block_log.read_packed( my->_block_id_to_block_offset_db.fetch( block_id ) );
+   } FC_CAPTURE_AND_RETHROW( (block_id) ) }
+
    signed_block_header chain_database::get_head_block()const
    {
       return my->_head_block_header;
@@ -1709,7 +5393,7 @@ namespace bts { namespace blockchain {
          FC_ASSERT(new_fork_data, "can't get fork data for a block we just successfully pushed");
       }
       else if( longest_fork.second.can_link() &&
-               my->_block_id_to_block_record_db.fetch(longest_fork.first).block_num > my->_head_block_header.block_num )
+               my->fork_node( longest_fork.first ).block_num > my->_head_block_header.block_num )
       {
          try {
             my->switch_to_fork( longest_fork.first );
@@ -1731,7 +5415,10 @@ namespace bts { namespace blockchain {
       auto record = get_block_record( block_id );
       FC_ASSERT( record.valid() );
       record->processing_time = time_point::now() - processing_start_time;
-      my->_block_id_to_block_record_db.store( block_id, *record );
+      my->store_block_record( block_id, *record );
+
+      my->flush_fork_tree();
+      my->handle_index_snapshots();
 
       return *new_fork_data;
    } FC_CAPTURE_AND_RETHROW( (block_data) )  }
@@ -1781,6 +5468,11 @@ namespace bts { namespace blockchain {
       return my->_account_db.fetch_optional( account_id );
    } FC_CAPTURE_AND_RETHROW( (account_id) ) }
 
+   const account_record* chain_database::lookup_account_record( const account_id_type& account_id )const
+   { try {
+      return my->_account_db.fetch_pointer( account_id );
+   } FC_CAPTURE_AND_RETHROW( (account_id) ) }
+
    asset_id_type chain_database::get_asset_id( const string& symbol )const
    { try {
       auto arec = get_asset_record( symbol );
@@ -1811,15 +5503,28 @@ namespace bts { namespace blockchain {
 
    void chain_database::store_asset_record( const asset_record& asset_to_store )
    { try {
+       const oasset_record old_base_asset = asset_to_store.id == asset_id_type( 0 ) ? get_asset_record( asset_to_store.id )
+                                                                                    : oasset_record();
        if( asset_to_store.is_null() )
        {
           my->_asset_db.remove( asset_to_store.id );
           my->_symbol_index_db.remove( asset_to_store.symbol );
+          my->_asset_symbol_index.remove( asset_to_store.symbol );
        }
        else
        {
           my->_asset_db.store( asset_to_store.id, asset_to_store );
           my->_symbol_index_db.store( asset_to_store.symbol, asset_to_store.id );
+          my->_asset_symbol_index.insert( asset_to_store.symbol, asset_to_store.id.value );
+       }
+
+       /* A genesis balance is unclaimed while it is not updated after the base asset's registration date, so if
+        * that date moves every balance is classified anew and the running total is recounted against it */
+       if( old_base_asset.valid() && !asset_to_store.is_null()
+           && old_base_asset->registration_date != asset_to_store.registration_date )
+       {
+          const share_type counted = my->get_asset_totals( asset_to_store.id ).unclaimed_genesis;
+          my->adjust_asset_totals( asset_to_store.id, 0, 0, my->scan_unclaimed_genesis().amount - counted );
        }
    } FC_CAPTURE_AND_RETHROW( (asset_to_store) ) }
 
@@ -1836,43 +5541,113 @@ namespace bts { namespace blockchain {
           my->_balance_db.store( r.id(), r );
        }
 #endif
-       /* Currently we keep all balance records forever so we know the owner and asset ID on wallet rescan */
-       my->_balance_db.store( r.id(), r );
-
+       const oasset_record base_asset = r.asset_id() == asset_id_type( 0 ) ? get_asset_record( asset_id_type( 0 ) )
+                                                                            : oasset_record();
+       my->write_balance_record( r, my->_balance_db.fetch_optional( r.id() ), base_asset );
    } FC_RETHROW_EXCEPTIONS( warn, "", ("record", r) ) }
 
+   /**
+    *  The records are handled in id order: one table iterator finds every previous record with a forward seek
+    *  instead of a lookup each, and the table and its owner index are written sequentially. All the previous
+    *  records are read before the first write, so no iterator is open while the batch grows.
+    */
+   void chain_database::store_balance_records( const unordered_map<balance_id_type, balance_record>& records )
+   { try {
+       if( records.empty() ) return;
+       typedef std::pair<const balance_id_type, balance_record> item_type;
+       vector<const item_type*> sorted;
+       sorted.reserve( records.size() );
+       for( const auto& item : records )
+          sorted.push_back( &item );
+       std::sort( sorted.begin(), sorted.end(), []( const item_type* a, const item_type* b ) { return a->first < b->first; } );
+
+       vector<obalance_record> old_records( sorted.size() );
+       {
+          auto existing = my->_balance_db.lower_bound( sorted.front()->first );
+          for( size_t i = 0; i < sorted.size(); ++i )
+          {
+             if( i > 0 ) existing.seek( sorted[ i ]->first );
+             if( existing.valid() && existing.key() == sorted[ i ]->first )
+                old_records[ i ] = existing.value();
+          }
+       }
+
+       const oasset_record base_asset = get_asset_record( asset_id_type( 0 ) );
+       my->defer_asset_totals();
+       try
+       {
+          for( size_t i = 0; i < sorted.size(); ++i )
+             my->write_balance_record( sorted[ i ]->second, old_records[ i ], base_asset );
+       }
+       catch( ... )
+       {
+          my->flush_asset_totals();
+          throw;
+       }
+       my->flush_asset_totals();
+   } FC_CAPTURE_AND_RETHROW( (records.size()) ) }
+
+   void chain_database::store_order_records( order_type_enum type,
+                                             const map<market_index_key, order_record>& orders )
+   { try {
+       my->defer_asset_totals();
+       try
+       {
+          chain_interface::store_order_records( type, orders );
+       }
+       catch( ... )
+       {
+          my->flush_asset_totals();
+          throw;
+       }
+       my->flush_asset_totals();
+   } FC_CAPTURE_AND_RETHROW( (type)(orders.size()) ) }
+
+   void chain_database::store_collateral_records( const map<market_index_key, collateral_record>& records )
+   { try {
+       my->defer_asset_totals();
+       try
+       {
+          chain_interface::store_collateral_records( records );
+       }
+       catch( ... )
+       {
+          my->flush_asset_totals();
+          throw;
+       }
+       my->flush_asset_totals();
+   } FC_CAPTURE_AND_RETHROW( (records.size()) ) }
+
    void chain_database::store_account_record( const account_record& record_to_store )
    { try {
        oaccount_record old_rec = get_account_record( record_to_store.id );
 
+       const share_type old_pay = old_rec.valid() && old_rec->delegate_info.valid() ? old_rec->delegate_info->pay_balance : 0;
+       share_type new_pay = 0;
+       if( !record_to_store.is_null() && record_to_store.delegate_info.valid() )
+          new_pay = record_to_store.delegate_info->pay_balance;
+       my->adjust_asset_totals( asset_id_type( 0 ), new_pay - old_pay );
+
        if( record_to_store.is_null() && old_rec)
        {
           my->_account_db.remove( record_to_store.id );
           my->_account_index_db.remove( record_to_store.name );
+          my->_account_name_index.remove( record_to_store.name );
 
           for( const auto& item : old_rec->active_key_history )
              my->_address_to_account_db.remove( address(item.second) );
 
           if( old_rec->is_delegate() )
           {
-              auto itr = my->_delegate_vote_index_db.begin();
-              while( itr.valid() )
-              {
-                  ++itr;
-              }
               my->_delegate_vote_index_db.remove( vote_del( old_rec->net_votes(),
                                                             record_to_store.id ) );
-              itr = my->_delegate_vote_index_db.begin();
-              while( itr.valid() )
-              {
-                  ++itr;
-              }
           }
        }
        else if( !record_to_store.is_null() )
        {
           my->_account_db.store( record_to_store.id, record_to_store );
           my->_account_index_db.store( record_to_store.name, record_to_store.id );
+          my->_account_name_index.insert( record_to_store.name, record_to_store.id.value );
 
           for( const auto& item : record_to_store.active_key_history )
           { // re-index all keys for this record
@@ -1894,6 +5669,7 @@ namespace bts { namespace blockchain {
                                                 0/*dummy value*/ );
           }
        }
+       my->update_delegate_ranking( old_rec, record_to_store );
      } FC_RETHROW_EXCEPTIONS( warn, "", ("record", record_to_store) ) }
 
    vector<operation> chain_database::get_recent_operations(operation_type_enum t)
@@ -1923,18 +5699,16 @@ namespace bts { namespace blockchain {
          return trx_rec;
       }
 
-      ilog( "... lower bound...?" );
-      auto itr = my->_id_to_transaction_record_db.lower_bound( trx_id );
-      if( itr.valid() )
-      {
-         auto id = itr.key();
-
-         if( memcmp( (char*)&id, (const char*)&trx_id, 4 ) != 0 )
-            return otransaction_record();
+      const vector<transaction_location> matches = my->find_transaction_prefix( trx_id );
+      if( matches.empty() )
+         return otransaction_record();
+      if( matches.size() > 1 )
+         FC_THROW_EXCEPTION( ambiguous_transaction_id, "Transaction id prefix is ambiguous!",
+                             ("trx_id",trx_id)("matches",matches.size()) );
 
-         return itr.value();
-      }
-      return otransaction_record();
+      const auto block_record = get_block_record( matches.front().block_num );
+      FC_ASSERT( block_record.valid() && matches.front().trx_num < block_record->user_transaction_ids.size() );
+      return my->_id_to_transaction_record_db.fetch_optional( block_record->user_transaction_ids[ matches.front().trx_num ] );
    } FC_CAPTURE_AND_RETHROW( (trx_id)(exact) ) }
 
    void chain_database::store_transaction( const transaction_id_type& record_id,
@@ -1942,18 +5716,35 @@ namespace bts { namespace blockchain {
    { try {
       if( record_to_store.trx.operations.size() == 0 )
       {
+        const auto prev_record = my->_id_to_transaction_record_db.fetch_optional( record_id );
+        if( prev_record.valid() )
+        {
+           my->unindex_transaction_prefix( record_id, prev_record->chain_location );
+           if( my->_address_history_enabled )
+              my->unindex_transaction_addresses( *prev_record );
+           my->_block_transaction_db.remove( block_transaction_key( prev_record->chain_location ) );
+        }
         my->_id_to_transaction_record_db.remove( record_id );
-        my->_unique_transactions[record_to_store.trx.expiration].erase( record_to_store.trx.digest(my->_chain_id) );
+        my->_unique_transactions.erase( record_to_store.trx.expiration, record_to_store.trx_digest(my->_chain_id) );
       }
       else
       {
-        FC_ASSERT( record_id == record_to_store.trx.id() );
+        FC_ASSERT( record_id == record_to_store.trx_id() );
+        if( my->_address_history_enabled )
+        {
+           const auto prev_record = my->_id_to_transaction_record_db.fetch_optional( record_id );
+           if( prev_record.valid() )
+              my->unindex_transaction_addresses( *prev_record );
+           my->index_transaction_addresses( record_id, record_to_store );
+        }
         my->_id_to_transaction_record_db.store( record_id, record_to_store );
+        my->_block_transaction_db.store( block_transaction_key( record_to_store.chain_location ), record_to_store );
+        my->index_transaction_prefix( record_id, record_to_store.chain_location );
         if( record_to_store.trx.expiration > this->now() )
         {
-           auto insert_result = my->_unique_transactions[record_to_store.trx.expiration].insert( record_to_store.trx.digest(my->_chain_id) );
+           const bool inserted = my->_unique_transactions.insert( record_to_store.trx.expiration, record_to_store.trx_digest(my->_chain_id) );
            if (get_head_block_num() >= FORK_25)
-             FC_ASSERT(insert_result.second, "transaction not unique");
+             FC_ASSERT(inserted, "transaction not unique");
         }
       }
    } FC_CAPTURE_AND_RETHROW( (record_id)(record_to_store) ) }
@@ -1988,12 +5779,90 @@ namespace bts { namespace blockchain {
         }
    }
 
+   /** the operations that may add to the balance a transaction pays its fees from; unknown types may */
+   static bool may_pay_fees( const operation& op )
+   {
+      switch( operation_type_enum( op.type.value ) )
+      {
+         case deposit_op_type:
+         case register_account_op_type:
+         case update_account_op_type:
+         case create_asset_op_type:
+         case update_asset_op_type:
+         case submit_proposal_op_type:
+         case vote_proposal_op_type:
+         case add_collateral_op_type:
+         case define_delegate_slate_op_type:
+         case update_feed_op_type:
+         case burn_op_type:
+         case link_account_op_type:
+            return false;
+         default:
+            return true;
+      }
+   }
+
+   bool chain_database::prefilter_transaction( const signed_transaction& trx )
+   { try {
+      transaction_prefilter_stats& stats = my->_prefilter_stats;
+
+      /* a transaction larger than a block can never be included */
+      const size_t trx_size = fc::raw::pack_size( trx );
+      if( trx_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE )
+      {
+         ++stats.oversized;
+         FC_CAPTURE_AND_THROW( oversized_transaction, (trx_size) );
+      }
+
+      const fc::time_point_sec current_time = now();
+      if( current_time >= trx.expiration )
+      {
+         ++stats.expired;
+         FC_CAPTURE_AND_THROW( expired_transaction, (trx.expiration)(current_time) );
+      }
+      if( (current_time + BTS_BLOCKCHAIN_MAX_TRANSACTION_EXPIRATION_SEC) < trx.expiration )
+      {
+         ++stats.invalid_expiration;
+         FC_CAPTURE_AND_THROW( invalid_transaction_expiration, (trx.expiration)(current_time) );
+      }
+
+      const digest_type digest = trx.digest( my->_chain_id );
+      if( my->_pending_transaction_db.find( digest ).valid() )
+      {
+         ++stats.duplicate;
+         return false;
+      }
+      if( is_known_transaction( trx.expiration, digest ) && get_head_block_num() >= FORK_25 )
+      {
+         ++stats.duplicate;
+         FC_CAPTURE_AND_THROW( duplicate_transaction, (trx.id()) );
+      }
+
+      for( const auto& op : trx.operations )
+      {
+         if( !operation_factory::instance().is_registered( op.type.value ) )
+         {
+            ++stats.unsupported_operation;
+            FC_THROW_EXCEPTION( unsupported_chain_operation, "", ("op",op) );
+         }
+      }
+
+      if( my->_relay_fee > 0 && std::none_of( trx.operations.begin(), trx.operations.end(), may_pay_fees ) )
+      {
+         ++stats.insufficient_fee;
+         FC_CAPTURE_AND_THROW( insufficient_relay_fee, (my->_relay_fee) );
+      }
+
+      ++stats.passed;
+      return true;
+   } FC_CAPTURE_AND_RETHROW( (trx) ) }
+
    /** this should throw if the trx is invalid */
    transaction_evaluation_state_ptr chain_database::store_pending_transaction( const signed_transaction& trx, bool override_limits )
    { try {
       auto trx_id = trx.id();
       if (override_limits)
-        wlog("storing new local transaction with id ${id}", ("id", trx_id));
+        hot_wlog("storing new local transaction with id ${id}", ("id", trx_id));
 
       auto id =  trx.digest(my->_chain_id);
       auto current_itr = my->_pending_transaction_db.find(id);
@@ -2010,7 +5879,8 @@ namespace bts { namespace blockchain {
          }
       }
 
-      transaction_evaluation_state_ptr eval_state = evaluate_transaction( trx, relay_fee );
+      pending_evaluation evaluation = my->evaluate_pending( trx, relay_fee, !override_limits );
+      transaction_evaluation_state_ptr eval_state = evaluation.eval_state;
       share_type fees = eval_state->get_fees();
 
       //if( fees < my->_relay_fee )
@@ -2018,6 +5888,16 @@ namespace bts { namespace blockchain {
 
       my->_pending_fee_index[ fee_index( fees, trx_id ) ] = eval_state;
       my->_pending_transaction_db.store( id, trx );
+      my->track_pending( id, *eval_state, fees );
+      my->_pending_evaluations.push_back( std::move( evaluation ) );
+      my->add_to_block_template( *eval_state );
+
+      if( !my->_observers.empty() )
+      {
+         detail::observer_event event;
+         event.pending_transaction = eval_state;
+         my->notify_observers( event );
+      }
 
       return eval_state;
    } FC_RETHROW_EXCEPTIONS( warn, "", ("trx",trx) ) }
@@ -2035,121 +5915,139 @@ namespace bts { namespace blockchain {
 
    full_block chain_database::generate_block( const time_point_sec& timestamp )
    { try {
-      auto start_time = time_point::now();
-
-      pending_chain_state_ptr pending_state = std::make_shared<pending_chain_state>( shared_from_this() );
-//      if( pending_state->get_head_block_num() >= BTSX_MARKET_FORK_2_BLOCK_NUM )
-         my->execute_markets( timestamp, pending_state );
-      auto pending_trx = get_pending_transactions();
+      const auto& block_template = my->_block_template;
+      if( !block_template || block_template->head_block_id != my->_head_block_id || block_template->timestamp != timestamp )
+         my->build_block_template( timestamp );
 
       full_block next_block;
-      size_t block_size = 0;
-      share_type total_fees = 0;
-
-      // TODO: Sort pending transactions by highest fee
-      for( const auto& item : pending_trx )
-      {
-         auto trx_size = item->trx.data_size();
-         if( block_size + trx_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE ) break;
-         block_size += trx_size;
-
-         /* Make modifications to temporary state */
-         auto pending_trx_state = std::make_shared<pending_chain_state>( pending_state );
-         auto trx_eval_state = std::make_shared<transaction_evaluation_state>( pending_trx_state.get(), my->_chain_id );
-
-         try
-         {
-            trx_eval_state->evaluate( item->trx, false, true );
-            // TODO: what about fees in other currencies?
-            total_fees += trx_eval_state->get_fees( 0 );
-            /* Apply temporary state to block state */
-            pending_trx_state->apply_changes();
-            next_block.user_transactions.push_back( item->trx );
-         }
-         catch ( const fc::canceled_exception& )
-         {
-            throw;
-         }
-         catch( const fc::exception& e )
-         {
-            wlog( "Pending transaction was found to be invalid in context of block\n ${trx} \n${e}",
-                  ("trx",fc::json::to_pretty_string(item->trx))("e",e.to_detail_string()) );
-         }
-
-         /* Limit the time we spend evaluating transactions */
-         if( time_point::now() - start_time > fc::seconds(5) )
-            break;
-      }
+      next_block.user_transactions = my->_block_template->transactions;
 
       auto head_block = get_head_block();
 
       next_block.previous           = head_block.block_num ? head_block.id() : block_id_type();
       next_block.block_num          = head_block.block_num + 1;
       next_block.timestamp          = timestamp;
-      next_block.transaction_digest = digest_block( next_block ).calculate_transaction_digest();
+      digest_block digest_data( (const signed_block_header&)next_block );
+      digest_data.user_transaction_ids = my->_block_template->transaction_ids;
+      next_block.transaction_digest = digest_data.calculate_transaction_digest();
 
       return next_block;
    } FC_CAPTURE_AND_RETHROW( (timestamp) ) }
 
-   void chain_database::write_snapshot_header( std::ofstream &out,
-                                              const fc::time_point_sec &timestamp ) const
+   void chain_database::prepare_block_template( const time_point_sec& timestamp )
+   { try {
+      my->_block_template_time = timestamp;
+      const auto& block_template = my->_block_template;
+      if( !block_template || block_template->head_block_id != my->_head_block_id || block_template->timestamp != timestamp )
+         my->build_block_template( timestamp );
+   } FC_CAPTURE_AND_RETHROW( (timestamp) ) }
+
+   bool chain_database::has_block_template( const time_point_sec& timestamp )const
+   {
+      const auto& block_template = my->_block_template;
+      return block_template && block_template->head_block_id == my->_head_block_id && block_template->timestamp == timestamp;
+   }
+
+   pending_chain_state_ptr chain_database::simulate_markets( const time_point_sec& timestamp )
+   { try {
+      const auto state = std::make_shared<pending_chain_state>( shared_from_this() );
+      my->execute_markets( timestamp, state );
+      return state;
+   } FC_CAPTURE_AND_RETHROW( (timestamp) ) }
+
+   void chain_database::create_snapshot() const
+   { try {
+      FC_ASSERT( do_snapshots(), "no snapshot directory is set" );
+      my->start_balance_snapshot().wait();
+   } FC_CAPTURE_AND_RETHROW() }
+
+   void chain_database::add_observer( chain_observer* observer )
    {
-      out << "{"
-          << "\"blocknum\":" << get_head_block_num()
-          << ",\"blocktime\":" << timestamp.sec_since_epoch();
+      my->_observers.emplace( observer, std::make_shared<detail::observer_queue>() );
    }
 
-   share_type chain_database::write_snapshot_balances( std::ofstream &out ) const
+   void chain_database::set_block_timing_callback( std::function<void( const block_timing& )> callback )
    {
-      out << ",\"balances\":[";
-      bool first = true;
-      share_type total = 0;
-      auto balance_record = my->_balance_db.begin();
-      while( balance_record.valid() )
-      {
-        if( balance_record.value().condition.type == withdraw_signature_type ) {
-            const share_type balance = balance_record.value().balance;
-            total += balance;
-            if( !first ) out << ",";
-            out << "[\"" 
-                << std::string( balance_record.value().condition.as<withdraw_with_signature>().owner )
-                << "\","
-                << balance
-                << "]";
-            first = false;
-        }
-        ++balance_record;
-      }
-      out << "]";
-      return total;
+      my->_block_timing_callback = std::move( callback );
+   }
+
+   void chain_database::set_prune_depth( uint32_t blocks )
+   {
+      FC_ASSERT( blocks == 0 || blocks >= BTS_BLOCKCHAIN_MIN_PRUNE_DEPTH,
+                 "At least ${min} blocks must be kept", ("min",BTS_BLOCKCHAIN_MIN_PRUNE_DEPTH) );
+      my->_prune_depth = blocks;
+   }
+
+   uint32_t chain_database::get_first_full_block_num()const
+   {
+      const auto first_full = my->_property_db.fetch_optional( first_full_block_num );
+      return first_full.valid() ? first_full->as<uint32_t>() : 1;
+   }
+
+   void chain_database::set_primary_data_dir( const fc::path& primary_data_dir )
+   {
+      FC_ASSERT( !my->_block_log.is_open(), "A database cannot start following a primary while it is open" );
+      my->_primary_data_dir = primary_data_dir;
    }
 
-   void chain_database::write_snapshot_footer( std::ofstream &out,
-                                               const share_type supply ) const
+   bool chain_database::is_follower()const
    {
-      out << ",\"moneysupply\":" << supply
-          << "}";
+      return my->_primary_data_dir.valid();
    }
 
    /**
-    *  Creates a snapshot in snapshots_dir.
+    *  The primary appends every block it receives, forks and invalid ones included, before applying it, so
+    *  pushing the records in log order reproduces its chain. A record still being written is left for the
+    *  next call.
     */
-   void chain_database::create_snapshot() const
+   uint32_t chain_database::follow_primary( uint32_t max_blocks )
    { try {
-      const fc::time_point_sec timestamp(now());
-      const fc::path filename = snapshot_filename( timestamp );
-      std::ofstream snapshot( filename.string() );
-      write_snapshot_header( snapshot, timestamp );
-      const share_type supply = write_snapshot_balances( snapshot );
-      write_snapshot_footer( snapshot, supply );
-      snapshot.close();
-      fc::lzma_compress_file( filename, filename.string() + ".lz" );
-      fc::remove(filename);
-   } FC_CAPTURE_AND_RETHROW( (now()) ) }
+      FC_ASSERT( is_follower(), "This database does not follow a primary" );
+      FC_ASSERT( my->_block_log.refresh(), "The primary's block log was started over; remove this follower's data directory" );
 
-   void chain_database::add_observer( chain_observer* observer )
+      const auto followed = my->_property_db.fetch_optional( followed_block_log_offset );
+      uint64_t offset = followed.valid() ? followed->as_uint64() : 0;
+      FC_ASSERT( offset >= my->_block_log.first_offset(),
+                 "The primary pruned blocks this follower has not read; remove this follower's data directory" );
+
+      uint32_t blocks_read = 0;
+      while( blocks_read < max_blocks && my->_block_log.has_record( offset ) )
+      {
+         const full_block block = my->_block_log.read( offset );
+         my->_followed_block_offset = offset;
+         try
+         {
+            push_block( block );
+         }
+         catch( const fc::canceled_exception& )
+         {
+            my->_followed_block_offset.reset();
+            throw;
+         }
+         catch( const fc::exception& e )
+         {
+            // the primary rejected it as well, or it is a block we have already
+            wlog( "not following block ${n} ${id}: ${e}", ("n",block.block_num)("id",block.id())("e",e.to_string()) );
+         }
+         my->_followed_block_offset.reset();
+
+         offset = my->_block_log.next_offset( offset );
+         set_property( followed_block_log_offset, variant( offset ) );
+         ++blocks_read;
+      }
+      return blocks_read;
+   } FC_CAPTURE_AND_RETHROW( (max_blocks) ) }
+
+   void chain_database::set_address_history_index( bool enabled )
    {
-      my->_observers.insert(observer);
+      FC_ASSERT( !my->_id_to_transaction_record_db.is_open(), "The address history index cannot be switched while the database is open" );
+      my->_address_history_enabled = enabled;
+   }
+
+   void chain_database::set_unified_store( bool enabled )
+   {
+      FC_ASSERT( !my->_unified_store.is_open(), "The storage layout cannot change while the database is open" );
+      my->_use_unified_store = enabled;
    }
 
    void chain_database::save_snapshots_in( const fc::path &dir )
@@ -2171,29 +6069,67 @@ namespace bts { namespace blockchain {
 
    void chain_database::remove_observer( chain_observer* observer )
    {
-      my->_observers.erase(observer);
+      auto itr = my->_observers.find( observer );
+      if( itr == my->_observers.end() ) return;
+      /* a drain task may be inside this very observer, so stop it from calling again rather than cancel it */
+      itr->second->removed = true;
+      itr->second->events.clear();
+      my->_observers.erase( itr );
+   }
+
+   integrity_report chain_database::check_integrity()const
+   {
+      return my->check_integrity();
    }
 
+   void chain_database::set_integrity_check_interval( uint32_t seconds )
+   { try {
+      if( my->_integrity_check_loop.valid() && !my->_integrity_check_loop.ready() )
+      {
+         try
+         {
+            my->_integrity_check_loop.cancel_and_wait( "integrity check interval changed" );
+         }
+         catch( const fc::canceled_exception& )
+         {
+         }
+      }
+      my->_integrity_check_interval_sec = seconds;
+      if( seconds > 0 )
+         my->_integrity_check_loop = fc::schedule( [this](){ my->integrity_check_loop(); },
+                                                   fc::time_point::now() + fc::seconds( seconds ), "integrity_check" );
+   } FC_CAPTURE_AND_RETHROW( (seconds) ) }
+
    bool chain_database::is_known_block( const block_id_type& block_id )const
    {
-      auto fork_data = get_block_fork_data( block_id );
-      return fork_data && fork_data->is_known;
+      const fork_tree_node* node = my->find_fork_node( block_id );
+      return node && node->data.is_known;
    }
    bool chain_database::is_included_block( const block_id_type& block_id )const
    {
-      auto fork_data = get_block_fork_data( block_id );
-      return fork_data && fork_data->is_included;
+      if( my->_main_chain_block_nums.count( block_id ) )
+         return true;
+      const fork_tree_node* node = my->find_fork_node( block_id );
+      return node && node->data.is_included;
    }
    optional<block_fork_data> chain_database::get_block_fork_data( const block_id_type& id )const
    {
-      return my->_fork_db.fetch_optional(id);
+      const fork_tree_node* node = my->find_fork_node( id );
+      if( !node ) return optional<block_fork_data>();
+      return node->data;
    }
 
    uint32_t chain_database::get_block_num( const block_id_type& block_id )const
    { try {
       if( block_id == block_id_type() )
          return 0;
-      return my->_block_id_to_block_record_db.fetch( block_id ).block_num;
+      const auto itr = my->_main_chain_block_nums.find( block_id );
+      if( itr != my->_main_chain_block_nums.end() )
+         return itr->second;
+      const auto record = my->fetch_block_record( block_id );
+      if( !record.valid() )
+         FC_CAPTURE_AND_THROW( fc::key_not_found_exception, (block_id) );
+      return record->block_num;
    } FC_RETHROW_EXCEPTIONS( warn, "Unable to find block ${block_id}", ("block_id", block_id) ) }
 
     uint32_t chain_database::get_head_block_num()const
@@ -2208,6 +6144,28 @@ namespace bts { namespace blockchain {
 
     map<balance_id_type, balance_record> chain_database::get_balances( const string& first, uint32_t limit )const
     { try {
+        /* the scan may cover the whole table, so it reads a snapshot on a worker thread when it can */
+        if( !my->_unified_store.in_batch() && !my->_balance_db.is_upgrading() )
+        {
+            /* shared, as a canceled caller stops waiting before the worker stops writing */
+            const auto balances = std::make_shared<map<balance_id_type, balance_record>>();
+            const auto snap = my->_balance_db.take_snapshot();
+            chain_database_impl* const impl = my.get();
+            my->run_snapshot_read( [impl, balances, snap, first, limit]()
+            {
+                bool found = false;
+                for( auto itr = impl->_balance_db.snapshot_range( snap ); itr.valid() && balances->size() < limit; ++itr )
+                {
+                    if( found || string( itr.key() ).find( first ) == 0 )
+                    {
+                        (*balances)[ itr.key() ] = itr.value();
+                        found = true;
+                    }
+                }
+            }, "get_balances" );
+            return *balances;
+        }
+
         map<balance_id_type, balance_record> balances;
         bool found = false;
         for( auto itr = my->_balance_db.begin(); itr.valid(); ++itr )
@@ -2226,6 +6184,37 @@ namespace bts { namespace blockchain {
 
     std::vector<account_record> chain_database::get_accounts( const string& first, uint32_t limit )const
     { try {
+       /* the index and the records are read from snapshots taken together, on a worker thread, when possible */
+       if( !my->_unified_store.in_batch() && !my->_account_index_db.is_upgrading() && !my->_account_db.is_upgrading() )
+       {
+          const auto names = std::make_shared<std::vector<account_record>>();
+          const auto index_snap = my->_account_index_db.take_snapshot();
+          const auto accounts_snap = my->_account_db.take_snapshot();
+          chain_database_impl* const impl = my.get();
+          my->run_snapshot_read( [impl, names, index_snap, accounts_snap, first, limit]()
+          {
+             auto itr = impl->_account_index_db.snapshot_range( index_snap );
+             if( first.size() > 0 && isdigit(first[0]) )
+             {
+                int32_t skip = atoi(first.c_str()) - 1;
+                while( skip-- > 0 && (++itr).valid() );
+             }
+             else
+             {
+                itr = impl->_account_index_db.snapshot_range( index_snap, first );
+             }
+
+             for( ; itr.valid() && names->size() < limit; ++itr )
+             {
+                const account_id_type id = itr.value();
+                auto record_itr = impl->_account_db.snapshot_range( accounts_snap, id );
+                FC_ASSERT( record_itr.valid() && record_itr.key() == id, "account ${id} is indexed but missing", ("id",id) );
+                names->push_back( record_itr.value() );
+             }
+          }, "get_accounts" );
+          return *names;
+       }
+
        std::vector<account_record> names;
        auto itr = my->_account_index_db.begin();
 
@@ -2261,6 +6250,129 @@ namespace bts { namespace blockchain {
        return assets;
     } FC_RETHROW_EXCEPTIONS( warn, "", ("first_symbol",first_symbol)("limit",limit) )  }
 
+    vector<string> chain_database::find_account_names( const string& prefix, uint32_t limit )const
+    { try {
+       vector<string> names;
+       for( auto& item : my->_account_name_index.find_prefix( prefix, limit ) )
+          names.push_back( std::move( item.first ) );
+       return names;
+    } FC_CAPTURE_AND_RETHROW( (prefix)(limit) ) }
+
+    vector<string> chain_database::find_asset_symbols( const string& prefix, uint32_t limit )const
+    { try {
+       vector<string> symbols;
+       for( auto& item : my->_asset_symbol_index.find_prefix( prefix, limit ) )
+          symbols.push_back( std::move( item.first ) );
+       return symbols;
+    } FC_CAPTURE_AND_RETHROW( (prefix)(limit) ) }
+
+    balance_page chain_database::list_balances( const string& cursor, uint32_t limit )
+    { try {
+       FC_ASSERT( limit > 0 );
+       balance_page page;
+       page.cursor = cursor;
+       const list_cursor position = my->find_list_cursor( "balances", page.cursor, [&]()
+       {
+          return std::vector<std::shared_ptr<const leveldb::Snapshot>>{ my->_balance_db.take_snapshot() };
+       } );
+       fc::optional<balance_id_type> after;
+       if( !position.last_key.empty() )
+          after = fc::raw::unpack<balance_id_type>( position.last_key );
+
+       /* shared, as a canceled caller stops waiting before the worker stops writing */
+       const auto balances = std::make_shared<vector<balance_record>>();
+       const auto more = std::make_shared<bool>( false );
+       const auto snap = position.snapshots.front();
+       chain_database_impl* const impl = my.get();
+       my->run_snapshot_read( [impl, balances, more, snap, after, limit]()
+       {
+          auto itr = impl->_balance_db.snapshot_range( snap, after );
+          if( after.valid() && itr.valid() && itr.key() == *after )
+             ++itr;
+          for( ; itr.valid() && balances->size() < limit; ++itr )
+             balances->push_back( itr.value() );
+          *more = itr.valid();
+       }, "list_balances" );
+
+       page.balances = std::move( *balances );
+       my->advance_list_cursor( page.cursor, *more ? fc::raw::pack( page.balances.back().id() ) : std::vector<char>() );
+       return page;
+    } FC_CAPTURE_AND_RETHROW( (cursor)(limit) ) }
+
+    /** reads the records of up to limit names of index after the packed name in last_key, see list_balances */
+    template<typename IndexMap, typename RecordMap, typename Record>
+    static bool read_indexed_page( const IndexMap& index, const RecordMap& records, const list_cursor& position,
+                                   uint32_t limit, vector<Record>& page, string& last_name )
+    {
+       fc::optional<string> after;
+       if( !position.last_key.empty() )
+          after = fc::raw::unpack<string>( position.last_key );
+       auto itr = index.snapshot_range( position.snapshots[ 0 ], after );
+       if( after.valid() && itr.valid() && itr.key() == *after )
+          ++itr;
+       for( ; itr.valid() && page.size() < limit; ++itr )
+       {
+          const auto id = itr.value();
+          auto record_itr = records.snapshot_range( position.snapshots[ 1 ], id );
+          FC_ASSERT( record_itr.valid() && record_itr.key() == id, "${id} is indexed but missing", ("id",id) );
+          page.push_back( record_itr.value() );
+          last_name = itr.key();
+       }
+       return itr.valid();
+    }
+
+    account_page chain_database::list_accounts( const string& cursor, uint32_t limit )
+    { try {
+       FC_ASSERT( limit > 0 );
+       account_page page;
+       page.cursor = cursor;
+       const list_cursor position = my->find_list_cursor( "accounts", page.cursor, [&]()
+       {
+          return std::vector<std::shared_ptr<const leveldb::Snapshot>>{ my->_account_index_db.take_snapshot(),
+                                                                        my->_account_db.take_snapshot() };
+       } );
+
+       /* shared, as a canceled caller stops waiting before the worker stops writing */
+       const auto accounts = std::make_shared<vector<account_record>>();
+       const auto last_name = std::make_shared<string>();
+       const auto more = std::make_shared<bool>( false );
+       chain_database_impl* const impl = my.get();
+       my->run_snapshot_read( [impl, accounts, last_name, more, position, limit]()
+       {
+          *more = read_indexed_page( impl->_account_index_db, impl->_account_db, position, limit, *accounts, *last_name );
+       }, "list_accounts" );
+
+       page.accounts = std::move( *accounts );
+       my->advance_list_cursor( page.cursor, *more ? fc::raw::pack( *last_name ) : std::vector<char>() );
+       return page;
+    } FC_CAPTURE_AND_RETHROW( (cursor)(limit) ) }
+
+    asset_page chain_database::list_assets( const string& cursor, uint32_t limit )
+    { try {
+       FC_ASSERT( limit > 0 );
+       asset_page page;
+       page.cursor = cursor;
+       const list_cursor position = my->find_list_cursor( "assets", page.cursor, [&]()
+       {
+          return std::vector<std::shared_ptr<const leveldb::Snapshot>>{ my->_symbol_index_db.take_snapshot(),
+                                                                        my->_asset_db.take_snapshot() };
+       } );
+
+       /* shared, as a canceled caller stops waiting before the worker stops writing */
+       const auto assets = std::make_shared<vector<asset_record>>();
+       const auto last_symbol = std::make_shared<string>();
+       const auto more = std::make_shared<bool>( false );
+       chain_database_impl* const impl = my.get();
+       my->run_snapshot_read( [impl, assets, last_symbol, more, position, limit]()
+       {
+          *more = read_indexed_page( impl->_symbol_index_db, impl->_asset_db, position, limit, *assets, *last_symbol );
+       }, "list_assets" );
+
+       page.assets = std::move( *assets );
+       my->advance_list_cursor( page.cursor, *more ? fc::raw::pack( *last_symbol ) : std::vector<char>() );
+       return page;
+    } FC_CAPTURE_AND_RETHROW( (cursor)(limit) ) }
+
     std::string chain_database::export_fork_graph( uint32_t start_block, uint32_t end_block, const fc::path& filename )const
     {
       FC_ASSERT( start_block >= 0 );
@@ -2338,9 +6450,106 @@ namespace bts { namespace blockchain {
       return std::string();
     }
 
+    /* Written under a temporary name and renamed, so a bootstrap file that exists is complete */
+    uint32_t chain_database::export_blocks( const fc::path& filename, uint32_t first_block, uint32_t last_block )const
+    { try {
+      last_block = std::min( last_block, get_head_block_num() );
+      FC_ASSERT( first_block >= get_first_full_block_num(), "The bodies of the blocks before ${n} have been pruned",
+                 ("n",get_first_full_block_num()) );
+      FC_ASSERT( first_block <= last_block );
+      FC_ASSERT( !fc::exists( filename ), "${file} already exists", ("file",filename) );
+
+      const fc::path temp_file = filename.string() + ".tmp";
+      {
+         std::ofstream out( temp_file.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+         FC_ASSERT( out.is_open(), "unable to open ${file}", ("file",temp_file) );
+         for( uint32_t block_num = first_block; block_num <= last_block; ++block_num )
+         {
+            const std::vector<char> data = get_packed_block( block_num );
+            const uint32_t length = data.size();
+            const char header[4] = { char( length ), char( length >> 8 ), char( length >> 16 ), char( length >> 24 ) };
+            out.write( header, sizeof( header ) );
+            out.write( data.data(), data.size() );
+         }
+         out.flush();
+         FC_ASSERT( out.good(), "error writing ${file}", ("file",temp_file) );
+      }
+      fc::rename( temp_file, filename );
+      return last_block - first_block + 1;
+    } FC_CAPTURE_AND_RETHROW( (filename)(first_block)(last_block) ) }
+
+    uint32_t chain_database::import_blocks( const fc::path& filename, std::function<void(float)> status_callback )
+    { try {
+      FC_ASSERT( !is_follower(), "A follower only applies the blocks of its primary" );
+
+      block_log bootstrap;
+      bootstrap.open_read_only( filename );
+      std::vector<uint64_t> offsets;
+      for( uint64_t offset = bootstrap.first_offset(); bootstrap.has_record( offset ); offset = bootstrap.next_offset( offset ) )
+         offsets.push_back( offset );
+
+      uint32_t blocks_pushed = 0;
+      size_t blocks_seen = 0;
+      const fc::time_point import_start = fc::time_point::now();
+      const auto push = [&]( const full_block& block )
+      {
+         if( ++blocks_seen % 200 == 0 )
+         {
+            const float progress = 100.0f * blocks_seen / offsets.size();
+            const int64_t elapsed_us = std::max<int64_t>( 1, (fc::time_point::now() - import_start).count() );
+            if( !status_callback )
+               std::cout << "\rImporting blocks... " << std::fixed << std::setprecision(2) << progress << "% complete, "
+                         << std::setprecision(0) << blocks_pushed * 1000000.0 / elapsed_us << " blocks/s." << std::flush;
+            else
+               status_callback( progress );
+         }
+
+         if( block.block_num <= get_head_block_num() )
+            return;
+         FC_ASSERT( block.previous == get_head_block_id(), "Block ${n} of ${file} does not follow our head block",
+                    ("n",block.block_num)("file",filename) );
+         push_block( block );
+         FC_ASSERT( get_head_block_id() == block.id(), "Block ${n} of ${file} was rejected", ("n",block.block_num)("file",filename) );
+
+         if( ++blocks_pushed % 1000 == 0 )
+            my->flush_bulk_load_caches();
+      };
+
+      /* Dirty records are committed on this thread while the next blocks are being evaluated */
+      fc::thread db_writer( "db_writer" );
+      my->set_bulk_load_writer( &db_writer );
+      block_pipeline_times times;
+      try
+      {
+         my->push_blocks_pipelined( offsets.size(), [&]( size_t first, size_t last )
+         {
+            std::vector<full_block> blocks;
+            blocks.reserve( last - first );
+            for( size_t i = first; i < last; ++i )
+               blocks.push_back( bootstrap.read( offsets[ i ] ) );
+            return blocks;
+         }, push, times );
+      }
+      catch( ... )
+      {
+         my->set_bulk_load_writer( nullptr );
+         throw;
+      }
+      my->set_bulk_load_writer( nullptr );
+
+      if( !status_callback )
+         std::cout << "\rImported " << blocks_pushed << " blocks in "
+                   << (fc::time_point::now() - import_start).count() / 1000000 << " seconds.                    \n" << std::flush;
+      ilog( "Imported ${n} blocks from ${file}; reading ${r}us, recovering signatures ${s}us, applying ${a}us, waiting ${w}us",
+            ("n",blocks_pushed)("file",filename)("r",int64_t( times.read_us ))("s",int64_t( times.recover_us ))
+            ("a",times.apply_us)("w",times.stall_us) );
+      return blocks_pushed;
+    } FC_CAPTURE_AND_RETHROW( (filename) ) }
+
     std::map<uint32_t, std::vector<fork_record>> chain_database::get_forks_list()const
     {
         std::map<uint32_t, std::vector<fork_record>> fork_blocks;
+        my->flush_fork_tree();
         for( auto iter = my->_fork_db.begin(); iter.valid(); ++iter )
         {
             try
@@ -2396,13 +6605,10 @@ namespace bts { namespace blockchain {
         vector<slot_record> slot_records;
         slot_records.reserve( count );
 
-        for( auto iter = my->_slot_record_db.begin(); iter.valid(); ++iter )
+        for( auto iter = my->_delegate_slot_index_db.lower_bound( std::make_pair( delegate_id, min_timestamp ) );
+             iter.valid() && iter.key().first == delegate_id; ++iter )
         {
-            const auto slot_record = iter.value();
-            if( slot_record.start_time < min_timestamp || slot_record.block_producer_id != delegate_id )
-                continue;
-
-            slot_records.push_back( slot_record );
+            slot_records.push_back( iter.value() );
             if( slot_records.size() >= count )
                 break;
         }
@@ -2417,12 +6623,30 @@ namespace bts { namespace blockchain {
 
    void chain_database::set_property( chain_property_enum property_id,
                                                      const fc::variant& property_value )
-   {
+   { try {
+      if( property_id == active_delegate_list_id )
+      {
+         my->_median_feed_prices.clear();
+         my->_active_delegates.reset();
+         if( !property_value.is_null() )
+         {
+            my->_active_delegates = property_value.as<std::vector<account_id_type>>();
+            my->_sorted_active_delegates = *my->_active_delegates;
+            std::sort( my->_sorted_active_delegates.begin(), my->_sorted_active_delegates.end() );
+         }
+      }
+      else if( property_id == last_random_seed_id )
+      {
+         my->_random_seed.reset();
+         if( !property_value.is_null() )
+            my->_random_seed = property_value.as<fc::ripemd160>();
+      }
+
       if( property_value.is_null() )
          my->_property_db.remove( property_id );
       else
          my->_property_db.store( property_id, property_value );
-   }
+   } FC_CAPTURE_AND_RETHROW( (property_id)(property_value) ) }
 
    digest_type chain_database::chain_id()const
    {
@@ -2539,7 +6763,18 @@ namespace bts { namespace blockchain {
 
    fc::ripemd160 chain_database::get_current_random_seed()const
    {
-      return get_property( last_random_seed_id ).as<fc::ripemd160>();
+      return my->random_seed();
+   }
+
+   vector<account_id_type> chain_database::get_active_delegates()const
+   {
+      return my->active_delegates();
+   }
+
+   bool chain_database::is_active_delegate( const account_id_type& id )const
+   {
+      const auto& sorted = my->sorted_active_delegates();
+      return std::binary_search( sorted.begin(), sorted.end(), id );
    }
 
    oorder_record chain_database::get_bid_record( const market_index_key&  key )const
@@ -2578,34 +6813,95 @@ namespace bts { namespace blockchain {
 
    void chain_database::store_bid_record( const market_index_key& key, const order_record& order )
    {
+      /* bids only count towards the supply of a non-base asset, see calculate_supply */
+      if( key.order_price.quote_asset_id != asset_id_type( 0 ) )
+      {
+         const oorder_record old_order = my->_bid_db.fetch_optional( key );
+         my->adjust_asset_totals( key.order_price.quote_asset_id,
+                                  ( order.is_null() ? 0 : order.balance ) - ( old_order.valid() ? old_order->balance : 0 ) );
+      }
+
+      auto& book = my->_order_books[ key.order_price.asset_pair() ];
       if( order.is_null() )
+      {
          my->_bid_db.remove( key );
+         my->_owner_bid_index_db.remove( std::make_pair( key.owner, key ) );
+         book.bids.erase( key );
+      }
       else
+      {
          my->_bid_db.store( key, order );
+         my->_owner_bid_index_db.store( std::make_pair( key.owner, key ), 0 );
+         book.bids[ key ] = order;
+      }
    }
 
    void chain_database::store_ask_record( const market_index_key& key, const order_record& order )
    {
+      const oorder_record old_order = my->_ask_db.fetch_optional( key );
+      my->adjust_asset_totals( key.order_price.base_asset_id,
+                               ( order.is_null() ? 0 : order.balance ) - ( old_order.valid() ? old_order->balance : 0 ) );
+
+      auto& book = my->_order_books[ key.order_price.asset_pair() ];
       if( order.is_null() )
+      {
          my->_ask_db.remove( key );
+         my->_owner_ask_index_db.remove( std::make_pair( key.owner, key ) );
+         book.asks.erase( key );
+      }
       else
+      {
          my->_ask_db.store( key, order );
+         my->_owner_ask_index_db.store( std::make_pair( key.owner, key ), 0 );
+         book.asks[ key ] = order;
+      }
    }
 
    void chain_database::store_short_record( const market_index_key& key, const order_record& order )
    {
+      const oorder_record old_order = my->_short_db.fetch_optional( key );
+      my->adjust_asset_totals( asset_id_type( 0 ),
+                               ( order.is_null() ? 0 : order.balance ) - ( old_order.valid() ? old_order->balance : 0 ) );
+
+      auto& book = my->_order_books[ key.order_price.asset_pair() ];
       if( order.is_null() )
+      {
          my->_short_db.remove( key );
+         my->_owner_short_index_db.remove( std::make_pair( key.owner, key ) );
+         book.shorts.erase( key );
+      }
       else
+      {
          my->_short_db.store( key, order );
+         my->_owner_short_index_db.store( std::make_pair( key.owner, key ), 0 );
+         book.shorts[ key ] = order;
+      }
    }
 
    void chain_database::store_collateral_record( const market_index_key& key, const collateral_record& collateral )
    {
+      const ocollateral_record old_collateral = my->_collateral_db.fetch_optional( key );
+      const bool is_null = collateral.is_null();
+      my->adjust_asset_totals( asset_id_type( 0 ),
+                               ( is_null ? 0 : collateral.collateral_balance )
+                               - ( old_collateral.valid() ? old_collateral->collateral_balance : 0 ) );
+      my->adjust_asset_totals( key.order_price.quote_asset_id, 0,
+                               ( is_null ? 0 : collateral.payoff_balance )
+                               - ( old_collateral.valid() ? old_collateral->payoff_balance : 0 ) );
+
+      auto& book = my->_order_books[ key.order_price.asset_pair() ];
       if( collateral.is_null() )
+      {
          my->_collateral_db.remove( key );
+         my->_owner_collateral_index_db.remove( std::make_pair( key.owner, key ) );
+         book.collateral.erase( key );
+      }
       else
+      {
          my->_collateral_db.store( key, collateral );
+         my->_owner_collateral_index_db.store( std::make_pair( key.owner, key ), 0 );
+         book.collateral[ key ] = collateral;
+      }
    }
 
    string chain_database::get_asset_symbol( const asset_id_type& asset_id )const
@@ -2956,6 +7252,69 @@ namespace bts { namespace blockchain {
        return orders;
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
+   vector<market_order> chain_database::get_market_orders_by_owner( const address& owner, uint32_t limit, order_type_enum type )const
+   { try {
+       vector<market_order> orders;
+       if( limit == 0 ) return orders;
+
+       const auto first = std::make_pair( owner, market_index_key() );
+
+       if( type == null_order || type == ask_order )
+       {
+           for( auto itr = my->_owner_ask_index_db.lower_bound( first ); itr.valid() && itr.key().first == owner; ++itr )
+           {
+               const auto order = my->_ask_db.fetch_optional( itr.key().second );
+               if( !order.valid() ) continue;
+               orders.push_back( market_order( ask_order, itr.key().second, *order ) );
+               if( orders.size() >= limit )
+                   return orders;
+           }
+       }
+
+       if( type == null_order || type == bid_order )
+       {
+           for( auto itr = my->_owner_bid_index_db.lower_bound( first ); itr.valid() && itr.key().first == owner; ++itr )
+           {
+               const auto order = my->_bid_db.fetch_optional( itr.key().second );
+               if( !order.valid() ) continue;
+               orders.push_back( market_order( bid_order, itr.key().second, *order ) );
+               if( orders.size() >= limit )
+                   return orders;
+           }
+       }
+
+       if( type == null_order || type == short_order )
+       {
+           for( auto itr = my->_owner_short_index_db.lower_bound( first ); itr.valid() && itr.key().first == owner; ++itr )
+           {
+               const auto order = my->_short_db.fetch_optional( itr.key().second );
+               if( !order.valid() ) continue;
+               orders.push_back( market_order( short_order, itr.key().second, *order ) );
+               if( orders.size() >= limit )
+                   return orders;
+           }
+       }
+
+       if( type == null_order || type == cover_order )
+       {
+           for( auto itr = my->_owner_collateral_index_db.lower_bound( first ); itr.valid() && itr.key().first == owner; ++itr )
+           {
+               const auto collateral_rec = my->_collateral_db.fetch_optional( itr.key().second );
+               if( !collateral_rec.valid() ) continue;
+               orders.push_back( market_order( cover_order,
+                                               itr.key().second,
+                                               order_record( collateral_rec->payoff_balance ),
+                                               collateral_rec->collateral_balance,
+                                               collateral_rec->interest_rate,
+                                               collateral_rec->expiration ) );
+               if( orders.size() >= limit )
+                   return orders;
+           }
+       }
+
+       return orders;
+   } FC_CAPTURE_AND_RETHROW( (owner)(limit)(type) ) }
+
    optional<market_order> chain_database::get_market_order( const order_id_type& order_id, order_type_enum type )const
    { try {
        const auto filter = [&]( const market_order& order ) -> bool
@@ -2990,10 +7349,19 @@ namespace bts { namespace blockchain {
 
    void chain_database::store_slot_record( const slot_record& r )
    {
+       const oslot_record old_record = my->_slot_record_db.fetch_optional( r.start_time );
+       if( old_record.valid() && old_record->block_producer_id != r.block_producer_id )
+           my->_delegate_slot_index_db.remove( std::make_pair( old_record->block_producer_id, old_record->start_time ) );
+
        if( r.is_null() )
+       {
            my->_slot_record_db.remove( r.start_time );
+       }
        else
+       {
            my->_slot_record_db.store( r.start_time, r );
+           my->_delegate_slot_index_db.store( std::make_pair( r.block_producer_id, r.start_time ), r );
+       }
    }
 
    oslot_record chain_database::get_slot_record( const time_point_sec& start_time )const
@@ -3006,7 +7374,12 @@ namespace bts { namespace blockchain {
      if( record.volume == 0 )
        my->_market_history_db.remove( key );
      else
+     {
+       /* a block row is only stored once, when its block is applied; storing it again must not count it twice */
+       if( key.granularity == market_history_key::each_block && !my->_market_history_db.fetch_optional( key ).valid() )
+         my->update_market_candles( key, record, my->_market_candle_resolutions );
        my->_market_history_db.store( key, record );
+     }
    }
 
    omarket_history_record chain_database::get_market_history_record(const market_history_key& key) const
@@ -3046,26 +7419,24 @@ namespace bts { namespace blockchain {
                                                                    market_history_key::time_granularity_enum granularity)
    {
       time_point_sec end_time = start_time + duration;
-      auto record_itr = my->_market_history_db.lower_bound( market_history_key(quote_id, base_id, granularity, start_time) );
+      auto record_itr = my->_market_history_db.range( market_history_key( quote_id, base_id, granularity, start_time ),
+                                                      market_history_key( quote_id, base_id, granularity, end_time + 1 ) );
       market_history_points history;
       auto base = get_asset_record(base_id);
       auto quote = get_asset_record(quote_id);
 
       FC_ASSERT( base && quote );
 
-      while( record_itr.valid()
-             && record_itr.key().quote_id == quote_id
-             && record_itr.key().base_id == base_id
-             && record_itr.key().granularity == granularity
-             && record_itr.key().timestamp <= end_time )
+      while( record_itr.valid() )
       {
+        const market_history_record& record = record_itr.value();
         history.push_back( {
                              record_itr.key().timestamp,
-                             fc::variant(string(record_itr.value().highest_bid.ratio * base->precision / quote->precision)).as_double() / (BTS_BLOCKCHAIN_MAX_SHARES*1000),
-                             fc::variant(string(record_itr.value().lowest_ask.ratio * base->precision / quote->precision)).as_double() / (BTS_BLOCKCHAIN_MAX_SHARES*1000),
-                             fc::variant(string(record_itr.value().opening_price.ratio * base->precision / quote->precision)).as_double() / (BTS_BLOCKCHAIN_MAX_SHARES*1000),
-                             fc::variant(string(record_itr.value().closing_price.ratio * base->precision / quote->precision)).as_double() / (BTS_BLOCKCHAIN_MAX_SHARES*1000),
-                             record_itr.value().volume
+                             detail::display_price( record.highest_bid, *base, *quote ),
+                             detail::display_price( record.lowest_ask, *base, *quote ),
+                             detail::display_price( record.opening_price, *base, *quote ),
+                             detail::display_price( record.closing_price, *base, *quote ),
+                             record.volume
                            } );
         ++record_itr;
       }
@@ -3073,23 +7444,165 @@ namespace bts { namespace blockchain {
       return history;
    }
 
+   market_candles chain_database::get_market_candles( const asset_id_type& quote_id,
+                                                      const asset_id_type& base_id,
+                                                      const fc::time_point& start_time,
+                                                      const fc::microseconds& duration,
+                                                      uint32_t resolution )const
+   { try {
+      FC_ASSERT( std::find( my->_market_candle_resolutions.begin(), my->_market_candle_resolutions.end(), resolution )
+                 != my->_market_candle_resolutions.end(), "no candles are kept at this resolution" );
+
+      const time_point_sec start = start_time;
+      const time_point_sec end_time = start_time + duration;
+      market_candles candles;
+      for( auto itr = my->_market_candle_db.range( market_candle_key( resolution, quote_id, base_id, start - ( start.sec_since_epoch() % resolution ) ),
+                                                   market_candle_key( resolution, quote_id, base_id, end_time + 1 ) );
+           itr.valid(); ++itr )
+         candles.push_back( itr.value() );
+      return candles;
+   } FC_CAPTURE_AND_RETHROW( (quote_id)(base_id)(start_time)(duration)(resolution) ) }
+
+   void chain_database::set_market_candle_resolutions( const vector<uint32_t>& resolutions )
+   {
+      FC_ASSERT( std::find( resolutions.begin(), resolutions.end(), 0 ) == resolutions.end(), "a candle must cover some time" );
+      my->_market_candle_resolutions = resolutions;
+   }
+
+   void chain_database::set_market_history_retention( uint32_t seconds )
+   {
+      FC_ASSERT( seconds == 0 || seconds >= BTS_BLOCKCHAIN_MIN_MARKET_HISTORY_RETENTION_SEC,
+                 "At least ${min} seconds of market history must be kept", ("min",BTS_BLOCKCHAIN_MIN_MARKET_HISTORY_RETENTION_SEC) );
+      my->_market_history_retention_sec = seconds;
+   }
+
+   /** adds each order to the level of its price, starting a new level when the price changes */
+   static void add_depth_level( vector<market_depth_level>& levels, const market_order& order )
+   {
+      if( levels.empty() || !( levels.back().order_price == order.get_price() ) )
+      {
+         levels.emplace_back();
+         levels.back().order_price = order.get_price();
+      }
+      market_depth_level& level = levels.back();
+      level.base_quantity += order.get_quantity().amount;
+      level.quote_quantity += order.get_quote_quantity().amount;
+      ++level.orders;
+   }
+
+   market_depth chain_database::get_market_depth( const asset_id_type& quote_id,
+                                                  const asset_id_type& base_id,
+                                                  uint32_t levels )const
+   { try {
+      if( my->_market_depth_block != my->_head_block_id )
+      {
+         my->_market_depth.clear();
+         my->_market_depth_block = my->_head_block_id;
+      }
+
+      const auto market = std::make_pair( quote_id, base_id );
+      auto cached = my->_market_depth.find( market );
+      if( cached == my->_market_depth.end() )
+      {
+         market_depth depth;
+         depth.block_num = my->_head_block_header.block_num;
+         const order_book& book = my->get_order_book( quote_id, base_id );
+         for( auto itr = book.bids.end(); itr != book.bids.begin(); )
+         {
+            --itr;
+            add_depth_level( depth.bids, market_order( bid_order, itr->first, itr->second ) );
+         }
+         for( const auto& item : book.asks )
+            add_depth_level( depth.asks, market_order( ask_order, item.first, item.second ) );
+         cached = my->_market_depth.emplace( market, std::move( depth ) ).first;
+      }
+
+      market_depth result;
+      result.block_num = cached->second.block_num;
+      result.bids.assign( cached->second.bids.begin(), cached->second.bids.begin() + std::min<size_t>( levels, cached->second.bids.size() ) );
+      result.asks.assign( cached->second.asks.begin(), cached->second.asks.begin() + std::min<size_t>( levels, cached->second.asks.size() ) );
+      return result;
+   } FC_CAPTURE_AND_RETHROW( (quote_id)(base_id)(levels) ) }
+
+   vector<market_transaction> chain_database::simulate_market_order( const market_order& order )
+   { try {
+      FC_ASSERT( order.type == bid_order || order.type == ask_order, "only bids and asks can be simulated" );
+      FC_ASSERT( order.state.balance > 0 );
+      if( my->_simulation_books_block != my->_head_block_id )
+      {
+         my->_simulation_books.clear();
+         my->_simulation_books_block = my->_head_block_id;
+      }
+
+      const auto market = order.market_index.order_price.asset_pair();
+      auto cached = my->_simulation_books.find( market );
+      if( cached == my->_simulation_books.end() )
+         cached = my->_simulation_books.emplace( market, my->get_order_book( market.first, market.second ) ).first;
+
+      // the order is only in the book while it is matched, so the copy stays that of the head block
+      auto& orders = order.type == bid_order ? cached->second.bids : cached->second.asks;
+      FC_ASSERT( orders.find( order.market_index ) == orders.end(), "the book already holds an order with this key" );
+      orders[ order.market_index ] = order.state;
+
+      // the engine applies its changes to scratch, which nothing else refers to
+      const auto scratch = std::make_shared<pending_chain_state>( shared_from_this() );
+      detail::market_engine engine( scratch, *my );
+      engine.use_order_book( cached->second );
+      bool executed = false;
+      try
+      {
+         executed = engine.execute( market.first, market.second, now() + BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC );
+      }
+      catch( ... )
+      {
+         orders.erase( order.market_index );
+         throw;
+      }
+      orders.erase( order.market_index );
+
+      if( !executed )
+      {
+         const omarket_status status = scratch->get_market_status( market.first, market.second );
+         if( status.valid() && status->last_error.valid() )
+            status->last_error->dynamic_rethrow_exception();
+      }
+      FC_ASSERT( executed, "the market could not be matched" );
+
+      vector<market_transaction> fills;
+      const address& owner = order.get_owner();
+      for( const auto& mtrx : engine._market_transactions )
+      {
+         if( mtrx.bid_owner == owner || mtrx.ask_owner == owner )
+            fills.push_back( mtrx );
+      }
+      return fills;
+   } FC_CAPTURE_AND_RETHROW( (order) ) }
+
    bool chain_database::is_known_transaction( fc::time_point_sec exp, const digest_type& id )
    {
-      auto itr = my->_unique_transactions.find(exp);
-      if( itr != my->_unique_transactions.end() )
-         return itr->second.find( id ) != itr->second.end();
-      return false;
+      return my->_unique_transactions.contains( exp, id );
    }
    void chain_database::skip_signature_verification( bool state )
    {
       my->_skip_signature_verification = state;
    }
 
+   void chain_database::set_assume_valid_block( uint32_t block_num, const block_id_type& block_id )
+   {
+      my->_assume_valid_block_num = block_num;
+      my->_assume_valid_block_id = block_id;
+   }
+
    void chain_database::set_relay_fee( share_type shares )
    {
       my->_relay_fee = shares;
    }
 
+   void chain_database::set_pending_pool_budget( size_t bytes )
+   {
+      my->_pending_pool_budget = bytes;
+   }
+
    share_type chain_database::get_relay_fee()
    {
       return my->_relay_fee;
@@ -3097,14 +7610,26 @@ namespace bts { namespace blockchain {
 
    void chain_database::set_market_transactions( vector<market_transaction> trxs )
    {
+      const uint32_t block_num = get_head_block_num() + 1;
+      auto batch = my->_market_transaction_index_db.create_batch();
+      const auto previous = my->_market_transactions_db.fetch_optional( block_num );
+      if( previous.valid() )
+      {
+         for( const auto& key : detail::market_transaction_index_keys( block_num, *previous ) )
+            batch.remove( key );
+      }
+
       if( trxs.size() == 0 )
       {
-         my->_market_transactions_db.remove( get_head_block_num()+1 );
+         my->_market_transactions_db.remove( block_num );
       }
       else
       {
-         my->_market_transactions_db.store( get_head_block_num()+1, trxs );
+         for( const auto& key : detail::market_transaction_index_keys( block_num, trxs ) )
+            batch.store( key, 0 );
+         my->_market_transactions_db.store( block_num, trxs );
       }
+      batch.commit();
    }
 
    vector<market_transaction> chain_database::get_market_transactions( uint32_t block_num  )const
@@ -3114,6 +7639,7 @@ namespace bts { namespace blockchain {
       return vector<market_transaction>();
    }
 
+   /** newest first; an owner of address() lists every transaction of the pair */
    vector<order_history_record> chain_database::market_order_history(asset_id_type quote,
                                                                      asset_id_type base,
                                                                      uint32_t skip_count,
@@ -3121,79 +7647,38 @@ namespace bts { namespace blockchain {
                                                                      const address& owner)
    {
       FC_ASSERT(limit <= 10000, "Limit must be at most 10000!");
+      FC_ASSERT(get_head_block_num() > 0, "No blocks have been created yet!");
 
-      auto current_block_num = get_head_block_num();
-      auto get_transactions_from_prior_block = [&]() -> vector<market_transaction> {
-          auto itr = my->_market_transactions_db.lower_bound(current_block_num);
-          if (current_block_num == get_head_block_num())
-              itr = my->_market_transactions_db.last();
-
-          if (itr.valid()) --itr;
-          if (itr.valid())
-          {
-              current_block_num = itr.key();
-              return itr.value();
-          }
-          current_block_num = 1;
-          return vector<market_transaction>();
-      };
-
-      FC_ASSERT(current_block_num > 0, "No blocks have been created yet!");
-      auto orders = get_transactions_from_prior_block();
-
-      std::function<bool(const market_transaction&)> order_is_uninteresting =
-          [&quote,&base,&owner,this](const market_transaction& order) -> bool
+      const auto in_range = [&]( const market_transaction_index_key& key ) -> bool
       {
-          //If it's in the market pair we're interested in, it might be interesting or uninteresting
-          if( order.ask_price.base_asset_id == base
-              && order.ask_price.quote_asset_id == quote ) {
-            //If we're not filtering for a specific owner, it's interesting (not uninteresting)
-            if (owner == address())
-              return false;
-            //If neither the bidder nor the asker is the owner I'm looking for, it's uninteresting
-            return owner != order.bid_owner && owner != order.ask_owner;
-          }
-          //If it's not the market pair we're interested in, it's definitely uninteresting
-          return true;
+          return key.base_id == base && key.quote_id == quote && key.owner == owner;
       };
-      //Filter out orders not in our current market of interest
-      orders.erase(std::remove_if(orders.begin(), orders.end(), order_is_uninteresting), orders.end());
-
-      //While the next entire block of orders should be skipped...
-      while( skip_count > 0 && --current_block_num > 0 && orders.size() <= skip_count ) {
-        ilog("Skipping ${num} block ${block} orders", ("num", orders.size())("block", current_block_num));
-        skip_count -= orders.size();
-        orders = get_transactions_from_prior_block();
-        orders.erase(std::remove_if(orders.begin(), orders.end(), order_is_uninteresting), orders.end());
-      }
 
-      if( current_block_num == 0 && orders.size() <= skip_count )
-        // Skip count is greater or equal to the total number of relevant orders on the blockchain.
-        return vector<order_history_record>();
+      // LevelDB iterators cannot step back from the end, so start from the last key when nothing follows the range
+      auto itr = my->_market_transaction_index_db.lower_bound( market_transaction_index_key( base, quote, owner, uint32_t(-1), uint32_t(-1) ) );
+      if( itr.valid() )
+          --itr;
+      else
+          itr = my->_market_transaction_index_db.last();
 
-      //If there are still some orders from the last block inspected to skip, remove them
-      if( skip_count > 0 )
-        orders.erase(orders.begin(), orders.begin() + skip_count);
-      ilog("Building up order history, got ${num} so far...", ("num", orders.size()));
+      for( ; skip_count > 0 && itr.valid() && in_range( itr.key() ); --itr )
+          --skip_count;
 
       std::vector<order_history_record> results;
-      results.reserve(limit);
-      fc::time_point_sec stamp = get_block_header(current_block_num).timestamp;
-      for( const auto& rec : orders )
-        results.push_back(order_history_record(rec, stamp));
-
-      //While we still need more orders to reach our limit...
-      while( --current_block_num >= 1 && orders.size() < limit )
-      {
-        auto more_orders = get_transactions_from_prior_block();
-        more_orders.erase(std::remove_if(more_orders.begin(), more_orders.end(), order_is_uninteresting), more_orders.end());
-        ilog("Found ${num} more orders in block ${block}...", ("num", more_orders.size())("block", current_block_num));
-        stamp = get_block_header(current_block_num).timestamp;
-        for( const auto& rec : more_orders )
-          if( results.size() < limit )
-            results.push_back(order_history_record(rec, stamp));
-          else
-            return results;
+      uint32_t block_num = 0;
+      vector<market_transaction> block_trxs;
+      fc::time_point_sec stamp;
+      for( ; results.size() < limit && itr.valid() && in_range( itr.key() ); --itr )
+      {
+          const market_transaction_index_key key = itr.key();
+          if( key.block_num != block_num )
+          {
+              block_num = key.block_num;
+              block_trxs = get_market_transactions( block_num );
+              stamp = get_block_header( block_num ).timestamp;
+          }
+          FC_ASSERT( key.index < block_trxs.size(), "market transaction index is out of date", ("key",key) );
+          results.push_back( order_history_record( block_trxs[key.index], stamp ) );
       }
 
       return results;
@@ -3201,10 +7686,26 @@ namespace bts { namespace blockchain {
 
    void chain_database::set_feed( const feed_record& r )
    {
+      my->_median_feed_prices.clear();
       if( r.is_null() )
+      {
          my->_feed_db.remove( r.feed );
+         my->_delegate_feed_index_db.remove( std::make_pair( r.feed.delegate_id, r.feed.feed_id ) );
+      }
       else
-         my->_feed_db.store( r.feed, r );
+      {
+         feed_record record = r;
+         try
+         {
+            record.decoded_price = r.value.as<price>();
+         }
+         catch( ... )
+         { // feeds that are not prices are kept but never counted towards a median
+            record.decoded_price.reset();
+         }
+         my->_feed_db.store( r.feed, record );
+         my->_delegate_feed_index_db.store( std::make_pair( r.feed.delegate_id, r.feed.feed_id ), 0 );
+      }
    }
 
    ofeed_record chain_database::get_feed( const feed_index& i )const
@@ -3213,104 +7714,52 @@ namespace bts { namespace blockchain {
    }
 
    asset chain_database::calculate_supply( const asset_id_type& asset_id )const
-   {
+   { try {
        const auto record = get_asset_record( asset_id );
        FC_ASSERT( record.valid() );
 
-       // Add fees
-       asset total( record->collected_fees, asset_id );
-
-       // Add balances
-       for( auto balance_itr = my->_balance_db.begin(); balance_itr.valid(); ++balance_itr )
-       {
-           const balance_record balance = balance_itr.value();
-           if( balance.asset_id() == total.asset_id )
-               total += balance.get_balance();
-       }
-
-       // Add ask balances
-       for( auto ask_itr = my->_ask_db.begin(); ask_itr.valid(); ++ask_itr )
+       const asset total( record->collected_fees + my->get_asset_totals( asset_id ).supply, asset_id );
+       if( my->_verify_asset_totals )
        {
-           const market_index_key market_index = ask_itr.key();
-           if( market_index.order_price.base_asset_id == total.asset_id )
-           {
-               const order_record ask = ask_itr.value();
-               total.amount += ask.balance;
-           }
-       }
-
-       // If base asset
-       if( asset_id == asset_id_type( 0 ) )
-       {
-           // Add short balances
-           for( auto short_itr = my->_short_db.begin(); short_itr.valid(); ++short_itr )
-           {
-               const order_record sh = short_itr.value();
-               total.amount += sh.balance;
-           }
-
-           // Add collateral balances
-           for( auto collateral_itr = my->_collateral_db.begin(); collateral_itr.valid(); ++collateral_itr )
-           {
-               const collateral_record collateral = collateral_itr.value();
-               total.amount += collateral.collateral_balance;
-           }
-
-           // Add pay balances
-           for( auto account_itr = my->_account_db.begin(); account_itr.valid(); ++account_itr )
-           {
-               const account_record account = account_itr.value();
-               if( account.delegate_info.valid() )
-                   total.amount += account.delegate_info->pay_balance;
-           }
-       }
-       else // If non-base asset
-       {
-           // Add bid balances
-           for( auto bid_itr = my->_bid_db.begin(); bid_itr.valid(); ++bid_itr )
-           {
-               const market_index_key market_index = bid_itr.key();
-               if( market_index.order_price.quote_asset_id == total.asset_id )
-               {
-                   const order_record bid = bid_itr.value();
-                   total.amount += bid.balance;
-               }
-           }
+           const asset scanned = my->scan_supply( asset_id );
+           FC_ASSERT( total == scanned, "Asset supply total has drifted", ("total",total)("scanned",scanned) );
        }
-
        return total;
-   }
+   } FC_CAPTURE_AND_RETHROW( (asset_id) ) }
 
    asset chain_database::calculate_debt( const asset_id_type& asset_id )const
-   {
+   { try {
        const auto record = get_asset_record( asset_id );
        FC_ASSERT( record.valid() && record->is_market_issued() );
 
-       asset total( 0, asset_id );
-
-       for( auto itr = my->_collateral_db.begin(); itr.valid(); ++itr )
+       const asset total( my->get_asset_totals( asset_id ).debt, asset_id );
+       if( my->_verify_asset_totals )
        {
-           if( itr.key().order_price.quote_asset_id == asset_id )
-               total.amount += itr.value().payoff_balance;
+           const asset scanned = my->scan_debt( asset_id );
+           FC_ASSERT( total == scanned, "Asset debt total has drifted", ("total",total)("scanned",scanned) );
        }
-
        return total;
-   }
+   } FC_CAPTURE_AND_RETHROW( (asset_id) ) }
 
    asset chain_database::unclaimed_genesis()
-   {
-        auto balance = my->_balance_db.begin();
-        asset unclaimed_total(0);
-        auto genesis_date = get_genesis_timestamp();
-
-        while (balance.valid()) {
-            if (balance.value().last_update <= genesis_date)
-                unclaimed_total += balance.value().get_balance();
+   { try {
+       const asset total( my->get_asset_totals( asset_id_type( 0 ) ).unclaimed_genesis );
+       if( my->_verify_asset_totals )
+       {
+           const asset scanned = my->scan_unclaimed_genesis();
+           FC_ASSERT( total == scanned, "Unclaimed genesis total has drifted", ("total",total)("scanned",scanned) );
+       }
+       return total;
+   } FC_CAPTURE_AND_RETHROW() }
 
-            ++balance;
-        }
+   void chain_database::verify_asset_totals( bool state )
+   {
+      my->_verify_asset_totals = state;
+   }
 
-        return unclaimed_total;
+   void chain_database::verify_parallel_transactions( bool state )
+   {
+      my->_verify_parallel_transactions = state;
    }
 
    /**
@@ -3318,41 +7767,50 @@ namespace bts { namespace blockchain {
     */
    oprice chain_database::get_median_delegate_price( const asset_id_type& asset_id, const asset_id_type& base_id )const
    { try {
-      auto feed_itr = my->_feed_db.lower_bound( feed_index{asset_id} );
-      vector<account_id_type> active_delegates = get_active_delegates();
-      std::sort(active_delegates.begin(), active_delegates.end());
+      // before the first block now() follows the wall clock, so the result is only stable once there is a head block
+      const bool cacheable = my->_head_block_header.block_num > 0;
+      const auto market = std::make_pair( asset_id, base_id );
+      if( cacheable )
+      {
+         if( my->_median_feed_prices_block != my->_head_block_id )
+         {
+            my->_median_feed_prices.clear();
+            my->_median_feed_prices_block = my->_head_block_id;
+         }
+         const auto cached = my->_median_feed_prices.find( market );
+         if( cached != my->_median_feed_prices.end() )
+            return cached->second;
+      }
+
+      auto feed_itr = my->_feed_db.range( feed_index{asset_id}, feed_index{asset_id + 1} );
+      const auto& active_delegates = my->sorted_active_delegates();
       vector<price> prices;
-      while( feed_itr.valid() && feed_itr.key().feed_id == asset_id )
+      while( feed_itr.valid() )
       {
          feed_index key = feed_itr.key();
          if( std::binary_search(active_delegates.begin(), active_delegates.end(), key.delegate_id) )
          {
-            try {
-               feed_record val = feed_itr.value();
-               // only consider feeds updated in the past day
-               if( (fc::time_point(val.last_update) + fc::days(1)) > fc::time_point(this->now()) )
-               {
-                  prices.push_back( val.value.as<price>() );
-                  if( prices.back().quote_asset_id != asset_id ||
-                      prices.back().base_asset_id != base_id )
-                     prices.pop_back();
-               }
-            }
-            catch ( ... )
-            { // we want to catch any exceptions caused attempted to interpret value as a price and simply ignore
-              // the data feed...
+            const feed_record val = feed_itr.value();
+            // only consider feeds updated in the past day
+            if( val.decoded_price.valid() && (fc::time_point(val.last_update) + fc::days(1)) > fc::time_point(this->now()) )
+            {
+               if( val.decoded_price->quote_asset_id == asset_id && val.decoded_price->base_asset_id == base_id )
+                  prices.push_back( *val.decoded_price );
             }
          }
          ++feed_itr;
       }
-      if( prices.size() < BTS_BLOCKCHAIN_MIN_FEEDS )
-          return oprice();
-      if( prices.size() )
+
+      oprice median;
+      if( prices.size() >= BTS_BLOCKCHAIN_MIN_FEEDS && !prices.empty() )
       {
         std::nth_element( prices.begin(), prices.begin() + prices.size()/2, prices.end() );
-        return prices[prices.size()/2];
+        median = prices[prices.size()/2];
       }
-      return oprice();
+
+      if( cacheable )
+         my->_median_feed_prices[ market ] = median;
+      return median;
    } FC_CAPTURE_AND_RETHROW( (asset_id)(base_id) ) }
 
    vector<feed_record> chain_database::get_feeds_for_asset( const asset_id_type& asset_id, const asset_id_type& base_id )const
@@ -3362,7 +7820,7 @@ namespace bts { namespace blockchain {
       while( feed_itr.valid() && feed_itr.key().feed_id == asset_id )
       {
         auto val = feed_itr.value();
-        if( val.value.as<price>().base_asset_id == base_id )
+        if( val.decoded_price.valid() && val.decoded_price->base_asset_id == base_id )
            feeds.push_back(val);
         ++feed_itr;
       }
@@ -3372,10 +7830,10 @@ namespace bts { namespace blockchain {
    vector<feed_record> chain_database::get_feeds_from_delegate( const account_id_type& delegate_id )const
    {  try {
       vector<feed_record> feeds;
-      const auto assets = get_assets( string(), -1 );
+      const auto first = std::make_pair( delegate_id, feed_id_type( std::numeric_limits<int32_t>::min() ) );
 
-      for( const auto& asset : assets )
-        if( const auto record = my->_feed_db.fetch_optional( feed_index{ asset.id, delegate_id } ) )
+      for( auto itr = my->_delegate_feed_index_db.lower_bound( first ); itr.valid() && itr.key().first == delegate_id; ++itr )
+        if( const auto record = my->_feed_db.fetch_optional( feed_index{ itr.key().second, delegate_id } ) )
           feeds.push_back(*record);
 
       return feeds;
@@ -3404,15 +7862,15 @@ namespace bts { namespace blockchain {
       auto opt_account_record = get_account_record( account_name );
       FC_ASSERT( opt_account_record.valid() );
 
-      auto itr = my->_burn_db.lower_bound( {opt_account_record->id} );
-      while( itr.valid() && itr.key().account_id == opt_account_record->id )
+      auto itr = my->_burn_db.range( {opt_account_record->id}, {opt_account_record->id + 1} );
+      while( itr.valid() )
       {
          results.push_back( burn_record( itr.key(), itr.value() ) );
          ++itr;
       }
 
-      itr = my->_burn_db.lower_bound( {-opt_account_record->id} );
-      while( itr.valid() && abs(itr.key().account_id) == opt_account_record->id )
+      itr = my->_burn_db.range( {-opt_account_record->id}, {-opt_account_record->id + 1} );
+      while( itr.valid() )
       {
          results.push_back( burn_record( itr.key(), itr.value() ) );
          ++itr;
@@ -3423,16 +7881,15 @@ namespace bts { namespace blockchain {
    vector<asset> chain_database::get_balance_for_key( const address& owner_address )const
    {
       map<asset_id_type,share_type> result;
-      auto itr = my->_balance_db.begin();
-      while( itr.valid() )
+      for( auto itr = my->_owner_balance_index_db.lower_bound( std::make_pair( owner_address, balance_id_type() ) );
+           itr.valid() && itr.key().first == owner_address; ++itr )
       {
-         auto value = itr.value();
-         if( value.owner() == owner_address )
+         const auto value = my->_balance_db.fetch_optional( itr.key().second );
+         if( value.valid() )
          {
-            auto balance = value.get_balance();
+            auto balance = value->get_balance();
             result[balance.asset_id] += balance.amount;
          }
-         ++itr;
       }
       vector<asset> asset_result;
       asset_result.reserve(result.size());
@@ -3443,121 +7900,178 @@ namespace bts { namespace blockchain {
       return asset_result;
    }
 
-   void chain_database::dump_state( const fc::path& path )const
+   void chain_database::dump_state( const fc::path& path, const string& format )const
    { try {
+       FC_ASSERT( format == "json" || format == "binary", "unknown state dump format ${format}", ("format",format) );
        const auto dir = fc::absolute( path );
        FC_ASSERT( !fc::exists( dir ) );
        fc::create_directories( dir );
 
-       fc::path next_path;
-       ulog( "This will take a while..." );
-
-       next_path = dir / "_market_transactions_db.json";
-       my->_market_transactions_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_slate_db.json";
-       my->_slate_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_property_db.json";
-       my->_property_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_block_num_to_id_db.json";
-       my->_block_num_to_id_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_block_id_to_block_record_db.json";
-       my->_block_id_to_block_record_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_block_id_to_block_data_db.json";
-       my->_block_id_to_block_data_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_id_to_transaction_record_db.json";
-       my->_id_to_transaction_record_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_asset_db.json";
-       my->_asset_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_balance_db.json";
-       my->_balance_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_burn_db.json";
-       my->_burn_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_account_db.json";
-       my->_account_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       fc::unique_lock<fc::mutex> lock( my->_push_block_mutex );
+       if( format == "json" )
+          ulog( "This will take a while..." );
+       my->write_state_dump( dir, format == "binary" );
+   } FC_CAPTURE_AND_RETHROW( (path)(format) ) }
 
-       next_path = dir / "_address_to_account_db.json";
-       my->_address_to_account_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_account_index_db.json";
-       my->_account_index_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_symbol_index_db.json";
-       my->_symbol_index_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_delegate_vote_index_db.json";
-       my->_delegate_vote_index_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_slot_record_db.json";
-       my->_slot_record_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-
-       next_path = dir / "_ask_db.json";
-       my->_ask_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+   void chain_database::load_state( const fc::path& path )
+   { try {
+       FC_ASSERT( my->_block_num_to_id_db.is_open(), "Database is not open!" );
+       const auto dir = fc::absolute( path );
+       FC_ASSERT( fc::is_directory( dir ), "${dir} is not a state dump", ("dir",dir) );
 
-       next_path = dir / "_bid_db.json";
-       my->_bid_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       uint32_t dump_block_num = 0;
+       {
+          fc::unique_lock<fc::mutex> lock( my->_push_block_mutex );
+          dump_block_num = my->load_state_dump( dir );
+       }
 
-       next_path = dir / "_short_db.json";
-       my->_short_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       /* the raw chain may already hold blocks the dump was taken before */
+       std::vector<block_id_type> replay_ids;
+       for( auto itr = my->_block_num_to_id_db.lower_bound( dump_block_num + 1 ); itr.valid(); ++itr )
+          replay_ids.push_back( itr.value() );
+       ulog( "Loaded state at block ${n}, replaying ${c} blocks...", ("n",dump_block_num)("c",replay_ids.size()) );
+       for( const auto& id : replay_ids )
+       {
+          const auto offset = my->_block_id_to_block_offset_db.fetch_optional( id );
+          if( !offset.valid() )
+             break;
+          push_block( my->_block_log.read( *offset ) );
+       }
 
-       next_path = dir / "_collateral_db.json";
-       my->_collateral_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       /* reloading closed the database, which stopped the background checks */
+       set_integrity_check_interval( my->_integrity_check_interval_sec );
+   } FC_CAPTURE_AND_RETHROW( (path) ) }
 
-       next_path = dir / "_feed_db.json";
-       my->_feed_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+   optional<fc::path> chain_database::get_index_snapshot( uint32_t block_num )const
+   { try {
+      const auto snapshots = my->list_index_snapshots( my->_data_dir );
+      for( auto itr = snapshots.rbegin(); itr != snapshots.rend(); ++itr )
+      {
+         if( block_num != 0 && itr->first != block_num )
+            continue;
+         try
+         {
+            const auto header = peek_snapshot_header( itr->second );
+            const auto main_chain_id = my->_block_num_to_id_db.fetch_optional( header.block_num );
+            if( header.database_version == BTS_BLOCKCHAIN_DATABASE_VERSION && main_chain_id.valid() && *main_chain_id == header.block_id )
+               return itr->second;
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "unable to read index snapshot ${file}: ${e}", ("file",itr->second)("e",e.to_detail_string()) );
+         }
+      }
+      return optional<fc::path>();
+   } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
-       next_path = dir / "_market_status_db.json";
-       my->_market_status_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+   void chain_database::bootstrap_from_index_snapshot( const fc::path& data_dir, const fc::path& file, const fc::sha256& snapshot_hash )
+   { try {
+      FC_ASSERT( !my->_block_num_to_id_db.is_open(), "A database cannot be bootstrapped while it is open" );
+      FC_ASSERT( !fc::exists( data_dir / "index" ) && !fc::exists( data_dir / "raw_chain" ), "${dir} already holds a chain", ("dir",data_dir) );
 
-       next_path = dir / "_market_history_db.json";
-       my->_market_history_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-   } FC_CAPTURE_AND_RETHROW( (path) ) }
+      fc::create_directories( data_dir / "index" );
+      try
+      {
+         my->open_database( data_dir );
+         my->bootstrap_index_snapshot( file, snapshot_hash );
+         std::ofstream marker( ( data_dir / "raw_chain/state_synced" ).string().c_str() );
+         marker << my->_head_block_header.block_num << "\n";
+      }
+      catch( ... )
+      {
+         close();
+         fc::remove_all( data_dir / "index" );
+         fc::remove_all( data_dir / "raw_chain" );
+         throw;
+      }
+      close();
+   } FC_CAPTURE_AND_RETHROW( (data_dir)(file)(snapshot_hash) ) }
 
    fc::variant_object chain_database::get_stats() const
    {
      fc::mutable_variant_object stats;
 #define CHAIN_DB_DATABASES (_market_transactions_db)(_slate_db)(_fork_number_db)(_fork_db)(_property_db)(_undo_state_db) \
-                           (_block_num_to_id_db)(_block_id_to_block_record_db)(_block_id_to_block_data_db) \
+                           (_block_num_to_id_db)(_block_id_to_block_record_db)(_block_id_to_block_offset_db) \
                            (_id_to_transaction_record_db)(_pending_transaction_db)(_pending_fee_index)(_asset_db)(_balance_db) \
                            (_burn_db)(_account_db)(_address_to_account_db)(_account_index_db)(_symbol_index_db)(_delegate_vote_index_db) \
                            (_slot_record_db)(_ask_db)(_bid_db)(_short_db)(_collateral_db)(_feed_db)(_market_status_db)(_market_history_db) \
                            (_recent_operations)
 #define GET_DATABASE_SIZE(r, data, elem) stats[BOOST_PP_STRINGIZE(elem)] = my->elem.size();
      BOOST_PP_SEQ_FOR_EACH(GET_DATABASE_SIZE, _, CHAIN_DB_DATABASES)
+     stats["storage"] = get_storage_stats();
+     if( my->_last_integrity_report.valid() )
+        stats["integrity"] = *my->_last_integrity_report;
+     stats["evaluation"] = evaluation_profiler::instance().get_stats();
+     stats["transaction_prefilter"] = my->_prefilter_stats;
      return stats;
    }
 
+#define CHAIN_DB_TABLES (_market_transactions_db)(_slate_db)(_fork_number_db)(_fork_db)(_property_db)(_undo_state_db) \
+                        (_block_num_to_id_db)(_block_id_to_block_record_db)(_block_id_to_block_offset_db) \
+                        (_id_to_transaction_record_db)(_pending_transaction_db)(_asset_db)(_balance_db)(_owner_balance_index_db) \
+                        (_burn_db)(_account_db)(_address_to_account_db)(_account_index_db)(_symbol_index_db)(_delegate_vote_index_db) \
+                        (_slot_record_db)(_ask_db)(_bid_db)(_short_db)(_collateral_db)(_feed_db)(_market_status_db)(_market_history_db)(_asset_totals_db) \
+                        (_owner_ask_index_db)(_owner_bid_index_db)(_owner_short_index_db)(_owner_collateral_index_db) \
+                        (_delegate_feed_index_db)(_delegate_slot_index_db)(_address_transaction_index_db)
+
+   fc::variant_object chain_database::get_storage_stats() const
+   { try {
+     fc::mutable_variant_object stats;
+#define GET_TABLE_STATS(r, data, elem) stats[BOOST_PP_STRINGIZE(elem)] = my->elem.get_stats();
+     BOOST_PP_SEQ_FOR_EACH(GET_TABLE_STATS, _, CHAIN_DB_TABLES)
+#undef GET_TABLE_STATS
+     return stats;
+   } FC_CAPTURE_AND_RETHROW() }
+
+   template<typename Key, typename Value>
+   static size_t table_cache_memory_usage( const bts::db::level_map<Key, Value>& table )
+   {
+     return 0;
+   }
+
+   template<typename Key, typename Value, typename CacheType>
+   static size_t table_cache_memory_usage( const bts::db::cached_level_map<Key, Value, CacheType>& table )
+   {
+     return table.cache_memory_usage();
+   }
+
+   /** Only sizes and counters kept anyway are read, so this is cheap enough to log periodically */
+   fc::variant_object chain_database::get_memory_stats() const
+   { try {
+     fc::mutable_variant_object table_caches;
+     uint64_t table_cache_bytes = 0;
+#define GET_TABLE_CACHE_BYTES(r, data, elem) \
+     { \
+        const size_t bytes = table_cache_memory_usage( my->elem ); \
+        if( bytes > 0 ) table_caches[BOOST_PP_STRINGIZE(elem)] = bytes; \
+        table_cache_bytes += bytes; \
+     }
+     BOOST_PP_SEQ_FOR_EACH(GET_TABLE_CACHE_BYTES, _, CHAIN_DB_TABLES)
+#undef GET_TABLE_CACHE_BYTES
+
+     uint64_t leveldb_bytes = my->_unified_store.memory_usage();
+#define GET_LEVELDB_BYTES(r, data, elem) leveldb_bytes += my->elem.leveldb_memory_usage();
+     BOOST_PP_SEQ_FOR_EACH(GET_LEVELDB_BYTES, _, CHAIN_DB_TABLES)
+#undef GET_LEVELDB_BYTES
+
+     // the pool itself is on disk; in memory each pending transaction is decoded in its evaluation state
+     const uint64_t evaluation_state_bytes = my->_pending_fee_index.size() * sizeof( transaction_evaluation_state )
+                                             + my->_pending_pool_bytes;
+     fc::mutable_variant_object pending_pool;
+     pending_pool["transactions"] = my->_pending_pool.size();
+     pending_pool["transaction_bytes"] = my->_pending_pool_bytes;
+     pending_pool["evaluation_states"] = my->_pending_fee_index.size();
+     pending_pool["evaluation_state_bytes"] = evaluation_state_bytes;
+
+     fc::mutable_variant_object stats;
+     stats["table_caches"] = table_caches;
+     stats["table_cache_bytes"] = table_cache_bytes;
+     stats["leveldb_bytes"] = leveldb_bytes;
+     stats["pending_pool"] = pending_pool;
+     stats["total_bytes"] = table_cache_bytes + leveldb_bytes + evaluation_state_bytes;
+     return stats;
+   } FC_CAPTURE_AND_RETHROW() }
+#undef CHAIN_DB_TABLES
+
 
 } } // bts::blockchain
@@ -87,9 +87,7 @@ namespace bts { namespace blockchain {
 
    address balance_record::owner()const
    {
-      if( condition.type == withdraw_signature_type )
-         return condition.as<withdraw_with_signature>().owner;
-      return address();
+      return condition.get_owner();
    }
 
    share_type chain_interface::get_account_registration_fee()const
@@ -266,6 +264,30 @@ namespace bts { namespace blockchain {
        //return base_record->collected_fees / (BTS_BLOCKCHAIN_BLOCKS_PER_DAY * 14);
    }
 
+   void chain_interface::store_balance_records( const unordered_map<balance_id_type, balance_record>& records )
+   {
+       for( const auto& item : records )
+           store_balance_record( item.second );
+   }
+
+   void chain_interface::store_order_records( order_type_enum type,
+                                              const map<market_index_key, order_record>& orders )
+   { try {
+       FC_ASSERT( type == bid_order || type == ask_order || type == short_order, "unsupported order type" );
+       for( const auto& item : orders )
+       {
+           if( type == bid_order )      store_bid_record( item.first, item.second );
+           else if( type == ask_order ) store_ask_record( item.first, item.second );
+           else                         store_short_record( item.first, item.second );
+       }
+   } FC_CAPTURE_AND_RETHROW( (type) ) }
+
+   void chain_interface::store_collateral_records( const map<market_index_key, collateral_record>& records )
+   {
+       for( const auto& item : records )
+           store_collateral_record( item.first, item.second );
+   }
+
    void chain_interface::set_dirty_markets( const std::set<std::pair<asset_id_type, asset_id_type>>& d )
    {
        set_property( dirty_markets, fc::variant( d ) );
@@ -0,0 +1,67 @@
+#include <bts/blockchain/evaluation_profiler.hpp>
+
+#include <fc/reflect/variant.hpp>
+
+namespace bts { namespace blockchain {
+
+   static void record( evaluation_profiler::operation_stats& stats, const fc::time_point& start, uint64_t count )
+   {
+      const uint64_t elapsed = ( fc::time_point::now() - start ).count();
+      stats.count += count;
+      stats.total_us += elapsed;
+      ++stats.latency_us[ bts::db::level_map_stats::latency_bucket( elapsed ) ];
+   }
+
+   evaluation_profiler& evaluation_profiler::instance()
+   {
+      static std::unique_ptr<evaluation_profiler> inst( new evaluation_profiler() );
+      return *inst;
+   }
+
+   evaluation_profiler::evaluation_profiler()
+   :_enabled( false )
+   {
+   }
+
+   void evaluation_profiler::set_enabled( bool enabled )
+   {
+      _enabled.store( enabled, std::memory_order_relaxed );
+   }
+
+   void evaluation_profiler::clear()
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _operations.clear();
+      _signature_recovery = operation_stats();
+   }
+
+   void evaluation_profiler::record_operation( operation_type_enum type, const fc::time_point& start,
+                                               uint64_t database_reads, bool failed )
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      auto& stats = _operations[ type ];
+      record( stats, start, 1 );
+      stats.database_reads += database_reads;
+      if( failed ) ++stats.failures;
+   }
+
+   void evaluation_profiler::record_signature_recovery( const fc::time_point& start, size_t signatures )
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      record( _signature_recovery, start, signatures );
+   }
+
+   fc::variant_object evaluation_profiler::get_stats()const
+   {
+      fc::mutable_variant_object operations;
+      fc::mutable_variant_object result;
+      std::lock_guard<std::mutex> lock( _mutex );
+      for( const auto& item : _operations )
+         operations[ fc::variant( item.first ).as_string() ] = item.second;
+      result[ "enabled" ] = enabled();
+      result[ "operations" ] = operations;
+      result[ "signature_recovery" ] = _signature_recovery;
+      return result;
+   }
+
+} } // bts::blockchain
@@ -0,0 +1,296 @@
+#include <bts/blockchain/hashing.hpp>
+
+#include <fc/log/logger.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+#if defined(__x86_64__) && ( defined(__GNUC__) || defined(__clang__) )
+#define BTS_HASHING_SHA_NI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace bts { namespace blockchain {
+
+   namespace {
+
+      void reference_sha256( const hash_engine::buffer* in, size_t count, fc::sha256* out )
+      {
+         for( size_t i = 0; i < count; ++i )
+            out[ i ] = fc::sha256::hash( in[ i ].data, uint32_t( in[ i ].size ) );
+      }
+
+      void reference_sha512( const hash_engine::buffer* in, size_t count, fc::sha512* out )
+      {
+         for( size_t i = 0; i < count; ++i )
+            out[ i ] = fc::sha512::hash( in[ i ].data, uint32_t( in[ i ].size ) );
+      }
+
+      void reference_ripemd160( const hash_engine::buffer* in, size_t count, fc::ripemd160* out )
+      {
+         for( size_t i = 0; i < count; ++i )
+            out[ i ] = fc::ripemd160::hash( in[ i ].data, uint32_t( in[ i ].size ) );
+      }
+
+      bool always_supported() { return true; }
+
+      const hash_engine::backend reference_backend = { "reference", always_supported,
+                                                       reference_sha256, reference_sha512, reference_ripemd160 };
+
+#ifdef BTS_HASHING_SHA_NI
+      /* SHA-256 with the x86 SHA extensions; sha512 and ripemd160 have no such instructions */
+      const uint32_t sha256_round_constants[ 64 ] = {
+         0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+         0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+         0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+         0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+         0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+         0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+         0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+         0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+      };
+
+      bool sha_ni_supported()
+      {
+         unsigned int eax, ebx, ecx, edx;
+         if( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+            return false;
+         const bool ssse3 = ecx & ( 1u << 9 );
+         const bool sse41 = ecx & ( 1u << 19 );
+         if( __get_cpuid_max( 0, nullptr ) < 7 )
+            return false;
+         __cpuid_count( 7, 0, eax, ebx, ecx, edx );
+         const bool sha = ebx & ( 1u << 29 );
+         return ssse3 && sse41 && sha;
+      }
+
+      /** compresses the 64 byte blocks of data into state, which holds the words a..h */
+      __attribute__(( target( "sha,sse4.1,ssse3" ) ))
+      void sha_ni_compress( uint32_t state[ 8 ], const char* data, size_t blocks )
+      {
+         const __m128i byte_swap = _mm_set_epi64x( 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL );
+
+         // the round instructions take the state as ABEF and CDGH
+         __m128i tmp = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*)&state[ 0 ] ), 0xB1 );
+         __m128i state1 = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*)&state[ 4 ] ), 0x1B );
+         __m128i state0 = _mm_alignr_epi8( tmp, state1, 8 );
+         state1 = _mm_blend_epi16( state1, tmp, 0xF0 );
+
+         for( ; blocks > 0; --blocks, data += 64 )
+         {
+            const __m128i abef_save = state0;
+            const __m128i cdgh_save = state1;
+            __m128i w[ 4 ];
+
+            // sixteen groups of four rounds; w holds the next sixteen message words, scheduled in place
+            for( int group = 0; group < 16; ++group )
+            {
+               __m128i& current = w[ group % 4 ];
+               __m128i& next = w[ ( group + 1 ) % 4 ];
+               __m128i& previous = w[ ( group + 3 ) % 4 ];
+               if( group < 4 )
+                  current = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*)( data + 16 * group ) ), byte_swap );
+
+               __m128i msg = _mm_add_epi32( current, _mm_loadu_si128( (const __m128i*)&sha256_round_constants[ 4 * group ] ) );
+               state1 = _mm_sha256rnds2_epu32( state1, state0, msg );
+               if( group >= 3 && group <= 14 )
+               {
+                  next = _mm_add_epi32( next, _mm_alignr_epi8( current, previous, 4 ) );
+                  next = _mm_sha256msg2_epu32( next, current );
+               }
+               msg = _mm_shuffle_epi32( msg, 0x0E );
+               state0 = _mm_sha256rnds2_epu32( state0, state1, msg );
+               if( group >= 1 && group <= 12 )
+                  previous = _mm_sha256msg1_epu32( previous, current );
+            }
+
+            state0 = _mm_add_epi32( state0, abef_save );
+            state1 = _mm_add_epi32( state1, cdgh_save );
+         }
+
+         tmp = _mm_shuffle_epi32( state0, 0x1B );
+         state1 = _mm_shuffle_epi32( state1, 0xB1 );
+         state0 = _mm_blend_epi16( tmp, state1, 0xF0 );
+         state1 = _mm_alignr_epi8( state1, tmp, 8 );
+         _mm_storeu_si128( (__m128i*)&state[ 0 ], state0 );
+         _mm_storeu_si128( (__m128i*)&state[ 4 ], state1 );
+      }
+
+      fc::sha256 sha_ni_hash( const char* data, size_t size )
+      {
+         uint32_t state[ 8 ] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+         const size_t whole_blocks = size / 64;
+         sha_ni_compress( state, data, whole_blocks );
+
+         // the rest of the data, the 0x80 terminator and the big endian bit length fill one or two more blocks
+         char tail[ 128 ] = {};
+         const size_t rest = size % 64;
+         memcpy( tail, data + 64 * whole_blocks, rest );
+         tail[ rest ] = char( 0x80 );
+         const size_t tail_size = rest < 56 ? 64 : 128;
+         const uint64_t bits = uint64_t( size ) * 8;
+         for( int i = 0; i < 8; ++i )
+            tail[ tail_size - 1 - i ] = char( bits >> ( 8 * i ) );
+         sha_ni_compress( state, tail, tail_size / 64 );
+
+         fc::sha256 result;
+         char* out = result.data();
+         for( int i = 0; i < 8; ++i )
+         {
+            out[ 4 * i ]     = char( state[ i ] >> 24 );
+            out[ 4 * i + 1 ] = char( state[ i ] >> 16 );
+            out[ 4 * i + 2 ] = char( state[ i ] >> 8 );
+            out[ 4 * i + 3 ] = char( state[ i ] );
+         }
+         return result;
+      }
+
+      void sha_ni_sha256( const hash_engine::buffer* in, size_t count, fc::sha256* out )
+      {
+         for( size_t i = 0; i < count; ++i )
+            out[ i ] = sha_ni_hash( in[ i ].data, in[ i ].size );
+      }
+
+      const hash_engine::backend sha_ni_backend = { "sha_ni", sha_ni_supported,
+                                                    sha_ni_sha256, reference_sha512, reference_ripemd160 };
+#endif
+
+      /** fastest first; the reference backend is last and always usable */
+      const hash_engine::backend* const backends[] = {
+#ifdef BTS_HASHING_SHA_NI
+         &sha_ni_backend,
+#endif
+         &reference_backend
+      };
+
+      /** compares the backend with the reference on every length up to a few blocks, to cover each padding case */
+      bool passes_self_test( const hash_engine::backend& candidate )
+      {
+         if( &candidate == &reference_backend )
+            return true;
+
+         std::vector<char> data( 300 );
+         for( size_t i = 0; i < data.size(); ++i )
+            data[ i ] = char( i * 131 + 7 );
+
+         std::vector<hash_engine::buffer> buffers;
+         for( size_t size = 0; size <= data.size(); ++size )
+            buffers.push_back( hash_engine::buffer{ data.data(), size } );
+         const std::string abc = "abc";
+         buffers.push_back( hash_engine::buffer{ abc.data(), abc.size() } );
+
+         std::vector<fc::sha256> sha256( buffers.size() ), expected_sha256( buffers.size() );
+         candidate.sha256( buffers.data(), buffers.size(), sha256.data() );
+         reference_backend.sha256( buffers.data(), buffers.size(), expected_sha256.data() );
+         std::vector<fc::sha512> sha512( buffers.size() ), expected_sha512( buffers.size() );
+         candidate.sha512( buffers.data(), buffers.size(), sha512.data() );
+         reference_backend.sha512( buffers.data(), buffers.size(), expected_sha512.data() );
+         std::vector<fc::ripemd160> ripemd160( buffers.size() ), expected_ripemd160( buffers.size() );
+         candidate.ripemd160( buffers.data(), buffers.size(), ripemd160.data() );
+         reference_backend.ripemd160( buffers.data(), buffers.size(), expected_ripemd160.data() );
+
+         return sha256 == expected_sha256 && sha512 == expected_sha512 && ripemd160 == expected_ripemd160;
+      }
+
+      std::atomic<const hash_engine::backend*> current_backend( nullptr );
+
+   } // anonymous namespace
+
+   hash_engine& hash_engine::instance()
+   {
+      static std::unique_ptr<hash_engine> inst( new hash_engine() );
+      return *inst;
+   }
+
+   hash_engine::hash_engine()
+   {
+      for( const auto candidate : backends )
+      {
+         if( !candidate->supported() )
+            continue;
+         if( !passes_self_test( *candidate ) )
+         {
+            elog( "The ${name} hash backend disagrees with the reference hashes and will not be used", ("name",candidate->name) );
+            continue;
+         }
+         current_backend = candidate;
+         break;
+      }
+      ilog( "Hashing with the ${name} backend", ("name",current_backend.load()->name) );
+   }
+
+   const char* hash_engine::backend_name()const
+   {
+      return current_backend.load()->name;
+   }
+
+   bool hash_engine::select_backend( const std::string& name )
+   {
+      for( const auto candidate : backends )
+      {
+         if( name != candidate->name )
+            continue;
+         if( !candidate->supported() || !passes_self_test( *candidate ) )
+            return false;
+         current_backend = candidate;
+         return true;
+      }
+      return false;
+   }
+
+   std::vector<char>& hash_engine::pack_buffer()
+   {
+      static thread_local std::vector<char> data;
+      return data;
+   }
+
+   fc::sha256 hash_engine::sha256( const char* data, size_t size )const
+   {
+      const buffer in{ data, size };
+      fc::sha256 out;
+      current_backend.load()->sha256( &in, 1, &out );
+      return out;
+   }
+
+   fc::sha512 hash_engine::sha512( const char* data, size_t size )const
+   {
+      const buffer in{ data, size };
+      fc::sha512 out;
+      current_backend.load()->sha512( &in, 1, &out );
+      return out;
+   }
+
+   fc::ripemd160 hash_engine::ripemd160( const char* data, size_t size )const
+   {
+      const buffer in{ data, size };
+      fc::ripemd160 out;
+      current_backend.load()->ripemd160( &in, 1, &out );
+      return out;
+   }
+
+   fc::ripemd160 hash_engine::id_hash( const char* data, size_t size )const
+   {
+      const fc::sha512 inner = sha512( data, size );
+      return ripemd160( inner.data(), sizeof( inner ) );
+   }
+
+   void hash_engine::sha256( const buffer* in, size_t count, fc::sha256* out )const
+   {
+      current_backend.load()->sha256( in, count, out );
+   }
+
+   void hash_engine::id_hash( const buffer* in, size_t count, fc::ripemd160* out )const
+   {
+      const backend* const hashes = current_backend.load();
+      std::vector<fc::sha512> inner( count );
+      hashes->sha512( in, count, inner.data() );
+      std::vector<buffer> inner_buffers( count );
+      for( size_t i = 0; i < count; ++i )
+         inner_buffers[ i ] = buffer{ inner[ i ].data(), sizeof( inner[ i ] ) };
+      hashes->ripemd160( inner_buffers.data(), count, out );
+   }
+
+} } // bts::blockchain
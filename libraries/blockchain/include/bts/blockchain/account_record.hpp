@@ -146,3 +146,6 @@ FC_REFLECT( bts::blockchain::burn_record_value, (amount)(message)(signer) )
 FC_REFLECT_DERIVED( bts::blockchain::burn_record, (bts::blockchain::burn_record_key)(bts::blockchain::burn_record_value), BOOST_PP_SEQ_NIL )
 FC_REFLECT_ENUM( bts::blockchain::account_type, (titan_account)(public_account)(multisig_account) )
 FC_REFLECT( bts::blockchain::multisig_meta_info, (required)(owners) )
+
+#include <bts/db/ordered_key.hpp>
+BTS_DB_ORDERED_KEY( bts::blockchain::burn_record_key, (account_id)(transaction_id) )
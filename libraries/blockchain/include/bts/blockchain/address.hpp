@@ -68,3 +68,6 @@ namespace std
 
 #include <fc/reflect/reflect.hpp>
 FC_REFLECT( bts::blockchain::address, (addr) )
+
+#include <bts/db/ordered_key.hpp>
+BTS_DB_ORDERED_KEY( bts::blockchain::address, (addr) )
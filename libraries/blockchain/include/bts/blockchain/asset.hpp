@@ -133,3 +133,6 @@ namespace fc
 #include <fc/reflect/reflect.hpp>
 FC_REFLECT( bts::blockchain::price, (ratio)(quote_asset_id)(base_asset_id) );
 FC_REFLECT( bts::blockchain::asset, (amount)(asset_id) );
+
+#include <bts/db/ordered_key.hpp>
+BTS_DB_ORDERED_KEY( bts::blockchain::price, (quote_asset_id)(base_asset_id)(ratio) )
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace bts { namespace blockchain {
+
+   /**
+    * @class base58_cache
+    *
+    *  Remembers the base58 strings of fixed size values, such as addresses and public keys, and the values
+    *  of strings parsed. API responses list the same few addresses thousands of times, and base58 takes
+    *  time quadratic in the length of the value, so converting each of them once saves most of it.
+    *
+    *  Values are identified by their bytes. The two directions are cached separately, since a string that
+    *  parses need not be the one its value encodes to. The cache is shared by all threads and bounded; the
+    *  least recently used entries are evicted first. Conversions that throw are not cached.
+    */
+   class base58_cache
+   {
+      public:
+         explicit base58_cache( size_t capacity );
+
+         /** @return the string of the size bytes at data, calling encode on a miss */
+         std::string encode( const char* data, size_t size, const std::function<std::string()>& encode );
+         /** copies the size bytes of the value of text to data, calling decode to fill them in on a miss */
+         void        decode( const std::string& text, char* data, size_t size, const std::function<void()>& decode );
+
+      private:
+         /** maps strings to strings, the most recently used first */
+         struct lru
+         {
+            typedef std::list<std::pair<std::string, std::string>> entry_list;
+
+            entry_list                                                       entries;
+            std::unordered_map<std::string, entry_list::iterator>            index;
+
+            const std::string* find( const std::string& key );
+            void               store( std::string key, std::string mapped, size_t capacity );
+         };
+
+         std::mutex _mutex;
+         size_t     _capacity;
+         lru        _strings;
+         lru        _values;
+   };
+
+} } // bts::blockchain
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <bts/blockchain/types.hpp>
+
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+   /**
+    *  A bloom filter over the ids of the blocks in the fork database. Peers advertise every block to every
+    *  node, so most ids asked about are either ones just added, which the fork tree holds, or ones never
+    *  seen; the filter answers the second kind without a LevelDB read. A false positive costs that read,
+    *  there are no false negatives.
+    */
+   class block_id_filter
+   {
+      public:
+         explicit block_id_filter( size_t expected_items = 0 );
+
+         void   insert( const block_id_type& id );
+         bool   may_contain( const block_id_type& id )const;
+
+         /** the ids inserted, and how many fit before the false positive rate exceeds about 1% */
+         size_t size()const     { return _size; }
+         size_t capacity()const { return _capacity; }
+
+      private:
+         std::vector<uint64_t> _bits;
+         size_t                _size;
+         size_t                _capacity;
+   };
+
+} } // bts::blockchain
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <bts/blockchain/block.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+   /**
+    *  @brief append-only file of raw blocks, read through a memory mapping
+    *
+    *  Each record is a 32 bit little endian length followed by the packed full_block. Records are
+    *  never modified, so there is nothing to compact; callers keep the offset returned by append()
+    *  in their own index. A crash can leave a torn record at the end of the file, which is harmless
+    *  because no index entry points at it and later appends simply follow it.
+    *
+    *  prune() drops the records before an offset by copying the rest into a new file named after that
+    *  offset, block_log.<offset>, and then pointing the small block_log.start file at it. Offsets keep
+    *  their meaning across pruning; reading a pruned record throws.
+    *
+    *  Another process may open the log of a running node with open_read_only() and tail it: refresh()
+    *  picks up the records and pruning the writer did since, and has_record() skips a record that is
+    *  still being written.
+    *
+    *  Reads may run on several threads while one thread appends. A reader that finds the mapping too short
+    *  maps the file again and swaps the new mapping in under a lock; readers still using the old one keep it
+    *  alive until they are done, so the returned data never moves under them.
+    */
+   class block_log
+   {
+      public:
+         block_log();
+         ~block_log();
+
+         void        open( const fc::path& file );
+         /** opens the log of another process; append() and prune() are refused */
+         void        open_read_only( const fc::path& file );
+         void        close();
+         bool        is_open()const { return _out.is_open() || _read_only; }
+         bool        is_read_only()const { return _read_only; }
+
+         /** rereads the size and start of a read only log; @return false if the writer started it over */
+         bool        refresh();
+         /** whether the record at offset has been completely written */
+         bool        has_record( uint64_t offset )const;
+         /** the offset of the record following the one at offset */
+         uint64_t    next_offset( uint64_t offset )const { return offset + 4 + record_size( offset ); }
+
+         /** @return the offset to pass to read() */
+         uint64_t    append( const full_block& block );
+         full_block  read( uint64_t offset )const;
+         /** the packed full_block of the record at offset */
+         std::vector<char> read_packed( uint64_t offset )const;
+         /** size of the packed full_block of the record at offset, i.e. its full_block::block_size() */
+         uint32_t    record_size( uint64_t offset )const;
+
+         /** the offset one past the last record, i.e. the logical size of the log including pruned records */
+         uint64_t    size()const { return _size; }
+
+         /** the offset of the first record still held */
+         uint64_t    first_offset()const { return _start; }
+         bool        is_pruned()const { return _start > 0; }
+         /** discards every record before offset, which must be the offset of a record or size() */
+         void        prune( uint64_t offset );
+
+      private:
+         /** the file holding the records from start on */
+         fc::path    data_file( uint64_t start )const;
+         fc::path    start_file()const;
+         uint64_t    read_start()const;
+         struct mapped_file;
+         /** a mapping of the data file covering at least the first end - _start bytes */
+         std::shared_ptr<const mapped_file> mapping( uint64_t end )const;
+         void        unmap();
+         /**
+          *  maps the record at offset and sets its packed block and length
+          *  @return the mapping data points into, which must be held while data is read
+          */
+         std::shared_ptr<const mapped_file> record( uint64_t offset, const char*& data, uint32_t& length )const;
+
+         fc::path                                                   _path;
+         std::ofstream                                              _out;
+         /** set by append() after the record is flushed, so a reader that sees it can map the record */
+         std::atomic<uint64_t>                                      _size{ 0 };
+         uint64_t                                                   _start = 0;
+         bool                                                       _read_only = false;
+         mutable std::mutex                                         _mapping_mutex;
+         mutable std::shared_ptr<const mapped_file>                 _mapping;
+   };
+
+} } // bts::blockchain
@@ -3,6 +3,8 @@
 #include <bts/blockchain/chain_interface.hpp>
 #include <bts/blockchain/pending_chain_state.hpp>
 
+#include <fc/thread/future.hpp>
+
 namespace bts { namespace blockchain {
 
    namespace detail { class chain_database_impl; }
@@ -16,6 +18,76 @@ namespace bts { namespace blockchain {
       pending_chain_state_ptr                       applied_changes;
    };
 
+   /** a total kept up to date block by block that no longer matches the records it sums */
+   struct integrity_drift
+   {
+      asset_id_type                                 asset_id;
+      string                                        total; ///< supply, debt or unclaimed_genesis
+      share_type                                    stored = 0;
+      share_type                                    scanned = 0;
+   };
+
+   struct integrity_report
+   {
+      uint32_t                                      block_num = 0;
+      block_id_type                                 block_id;
+      fc::time_point                                checked_at;
+      uint64_t                                      elapsed_ms = 0;
+      vector<integrity_drift>                       drift;
+      vector<string>                                errors; ///< records no valid chain could contain
+
+      bool ok()const { return drift.empty() && errors.empty(); }
+   };
+
+   /** received transactions turned away by chain_database::prefilter_transaction, by reason */
+   struct transaction_prefilter_stats
+   {
+      uint64_t                                      passed = 0;
+      uint64_t                                      oversized = 0;
+      uint64_t                                      expired = 0;
+      uint64_t                                      invalid_expiration = 0;
+      uint64_t                                      duplicate = 0;
+      uint64_t                                      unsupported_operation = 0;
+      uint64_t                                      insufficient_fee = 0;
+   };
+
+   /** where the time to apply one block went, reported by extend_chain to the block timing callback */
+   struct block_timing
+   {
+      uint32_t                                      block_num = 0;
+      block_id_type                                 block_id;
+      uint32_t                                      transaction_count = 0;
+      fc::microseconds                              recover_signers;
+      fc::microseconds                              execute_markets;
+      fc::microseconds                              apply_transactions;
+      fc::microseconds                              save_undo_state;
+      fc::microseconds                              apply_changes;
+      fc::microseconds                              total; ///< includes the steps not broken out above
+   };
+
+   /**
+    *  One page of a listing read from a snapshot of the tables taken on its first page, so the pages
+    *  fit together however the chain moves on. Pass cursor to get the next page; it is empty after
+    *  the last one, and expires BTS_BLOCKCHAIN_LIST_CURSOR_TTL_SEC after the page it came with.
+    */
+   struct balance_page
+   {
+      vector<balance_record>                        balances;
+      string                                        cursor;
+   };
+
+   struct account_page
+   {
+      vector<account_record>                        accounts;
+      string                                        cursor;
+   };
+
+   struct asset_page
+   {
+      vector<asset_record>                          assets;
+      string                                        cursor;
+   };
+
    struct block_fork_data
    {
       block_fork_data():is_linked(false),is_included(false),is_known(false){}
@@ -83,6 +155,16 @@ namespace bts { namespace blockchain {
           *  This method is called anytime a block is applied to the chain.
           */
          virtual void block_applied( const block_summary& summary ) = 0;
+         /**
+          *  This method is called when a transaction is added to the pending pool.
+          */
+         virtual void pending_transaction_stored( const transaction_evaluation_state_ptr& eval_state ) {}
+         /**
+          *  Called before the next notification once an observer that fell more than
+          *  BTS_BLOCKCHAIN_MAX_OBSERVER_QUEUE notifications behind lost some, with how many of each kind.
+          */
+         virtual void notifications_dropped( uint32_t blocks_applied, uint32_t pending_transactions,
+                                             uint32_t state_changes ) {}
    };
 
    class chain_database : public chain_interface, public std::enable_shared_from_this<chain_database>
@@ -104,12 +186,50 @@ namespace bts { namespace blockchain {
 
          void set_relay_fee( share_type shares );
          share_type get_relay_fee();
+         /** bytes of pending transactions to hold before evicting the cheapest per byte */
+         void set_pending_pool_budget( size_t bytes );
+
+         /** called with the timing of every block applied to the chain; an empty function stops the timing */
+         void set_block_timing_callback( std::function<void( const block_timing& )> callback );
+
+         /**
+          *  Keep the bodies and transaction records of only the last blocks blocks, at least
+          *  BTS_BLOCKCHAIN_MIN_PRUNE_DEPTH; older blocks keep their headers and digests. 0 keeps everything.
+          *  Pruned bodies cannot be served to peers, rescanned by wallets or used to rebuild the index.
+          */
+         void set_prune_depth( uint32_t blocks );
+         /** the first block whose body is still held, 1 unless the chain has been pruned */
+         uint32_t get_first_full_block_num()const;
+
+         /**
+          *  Follow the node running in primary_data_dir instead of receiving blocks; call before open(). Its block
+          *  log is only ever read: blocks are applied from it by follow_primary() and served from it, so only
+          *  this database's own index is written, in the data directory passed to open().
+          */
+         void set_primary_data_dir( const fc::path& primary_data_dir );
+         bool is_follower()const;
+         /** applies up to max_blocks of the blocks the primary committed since the last call; @return the number read */
+         uint32_t follow_primary( uint32_t max_blocks = -1 );
+
+         /** keep an index of the transactions touching each address, for get_address_transactions; call before open() */
+         void set_address_history_index( bool enabled );
+
+         /** store the index tables in a single LevelDB with one atomic write per block; call before open() */
+         void set_unified_store( bool enabled );
 
          void save_snapshots_in( const fc::path &dir );
          bool do_snapshots()const;
          fc::path snapshot_filename( const fc::time_point_sec timestamp ) const;
 
          void sanity_check()const;
+         /**
+          *  Scans LevelDB snapshots of the balance, order, account and asset tables on the worker threads, the
+          *  balances split by key range, and compares what they sum to with the stored asset totals. Blocks keep
+          *  being applied while it runs; the report describes the head block at the time it was called.
+          */
+         integrity_report check_integrity()const;
+         /** runs check_integrity in the background every interval, logging and keeping the last report for get_stats; 0 stops it */
+         void set_integrity_check_interval( uint32_t seconds );
 
          time_point_sec get_genesis_timestamp()const;
 
@@ -122,6 +242,27 @@ namespace bts { namespace blockchain {
           */
          void skip_signature_verification( bool state );
 
+         /**
+          *  Skips the block signee and transaction signature checks of every block before block_num, as
+          *  the checkpoints do for block signees. Block ids chain the headers and each header commits to its
+          *  transactions, so a chain that reaches block_num with block_id holds exactly the blocks assumed
+          *  valid; a chain with another block there is rejected. Blocks from block_num on are fully verified.
+          *  Pass 0 to verify everything.
+          */
+         void set_assume_valid_block( uint32_t block_num, const block_id_type& block_id );
+
+         /**
+          *  calculate_supply, calculate_debt and unclaimed_genesis return running totals. With this
+          *  enabled they also rescan the underlying tables and throw if the totals have drifted.
+          */
+         void verify_asset_totals( bool state );
+
+         /**
+          *  Blocks with many transactions evaluate them in parallel. With this enabled such blocks are
+          *  also evaluated serially, and pushing them throws if the two results differ.
+          */
+         void verify_parallel_transactions( bool state );
+
          /**
           * The state of the blockchain after applying all pending transactions.
           */
@@ -143,6 +284,20 @@ namespace bts { namespace blockchain {
           */
          full_block                  generate_block( const time_point_sec& timestamp );
 
+         /** Builds the block for the given timeslot ahead of time and keeps it current as the chain
+          *  and the pending transactions change, so generate_block can return it immediately.
+          */
+         void                        prepare_block_template( const time_point_sec& timestamp );
+         /** true if generate_block( timestamp ) will return the prepared block, whose markets and
+          *  transactions have already been evaluated on top of the current head block
+          */
+         bool                        has_block_template( const time_point_sec& timestamp )const;
+
+         /** Matches the dirty markets as the block at timestamp would, in a state that is returned
+          *  rather than applied, so its market_transactions show what the block would match.
+          */
+         pending_chain_state_ptr     simulate_markets( const time_point_sec& timestamp );
+
          /**
           *  The chain ID is the hash of the initial_config loaded when the
           *  database was first created.
@@ -155,6 +310,9 @@ namespace bts { namespace blockchain {
          //optional<block_fork_data> is_included_block( const block_id_type& block_id )const;
 
          fc::ripemd160               get_current_random_seed()const override;
+         /** decoded once per change of the property rather than on every call */
+         virtual vector<account_id_type>    get_active_delegates()const override;
+         virtual bool                       is_active_delegate( const account_id_type& id )const override;
 
          account_record              get_delegate_record_for_signee( const public_key_type& block_signee )const;
          account_record              get_block_signee( const block_id_type& block_id )const;
@@ -172,7 +330,13 @@ namespace bts { namespace blockchain {
          digest_block                get_block_digest( uint32_t block_num )const;
          full_block                  get_block( const block_id_type& )const;
          full_block                  get_block( uint32_t block_num )const;
+         /** the block exactly as fc::raw::pack would write it, without decoding it */
+         std::vector<char>           get_packed_block( uint32_t block_num )const;
+         std::vector<char>           get_packed_block( const block_id_type& block_id )const;
          vector<transaction_record>  get_transactions_for_block( const block_id_type& )const;
+         /** up to limit transactions touching owner, in chain order from start; needs set_address_history_index */
+         vector<transaction_record>  get_address_transactions( const address& owner, const transaction_location& start,
+                                                               uint32_t limit )const;
          signed_block_header         get_head_block()const;
          virtual uint32_t            get_head_block_num()const override;
          block_id_type               get_head_block_id()const;
@@ -215,12 +379,39 @@ namespace bts { namespace blockchain {
          vector<asset_record>    get_assets( const string& first_symbol,
                                              uint32_t limit )const;
 
+         /** up to limit account names starting with prefix, in name order, from memory without reading any record */
+         vector<string>          find_account_names( const string& prefix, uint32_t limit )const;
+         /** up to limit asset symbols starting with prefix, in symbol order, see find_account_names */
+         vector<string>          find_asset_symbols( const string& prefix, uint32_t limit )const;
+
+         /** up to limit balances in id order, continuing the listing cursor names or starting one if it is empty */
+         balance_page            list_balances( const string& cursor, uint32_t limit );
+         /** up to limit accounts in name order, see list_balances */
+         account_page            list_accounts( const string& cursor, uint32_t limit );
+         /** up to limit assets in symbol order, see list_balances */
+         asset_page              list_assets( const string& cursor, uint32_t limit );
+
          std::vector<slot_record> get_delegate_slot_records( const account_id_type& delegate_id,
                                                              int64_t start_block_num, uint32_t count )const;
 
          std::map<uint32_t, std::vector<fork_record> > get_forks_list()const;
          std::string export_fork_graph( uint32_t start_block = 1, uint32_t end_block = -1, const fc::path& filename = "" )const;
 
+         /**
+          *  Writes the main chain blocks from first_block through last_block, or the head block, to a new bootstrap
+          *  file in the record format of the block log: a 32 bit little endian length and the packed full_block.
+          *  @return the number of blocks written
+          */
+         uint32_t export_blocks( const fc::path& filename, uint32_t first_block = 1, uint32_t last_block = -1 )const;
+         /**
+          *  Pushes the blocks of a bootstrap file that follow the head block through the pipeline reindexing
+          *  uses, so the next blocks are read and their signatures recovered while one is applied. Blocks before
+          *  the assume-valid block skip their signature checks as usual; the rest are fully verified.
+          *  @param status_callback Called with the percentage of the file processed; without one progress is printed
+          *  @return the number of blocks pushed
+          */
+         uint32_t import_blocks( const fc::path& filename, std::function<void(float)> status_callback = std::function<void(float)>() );
+
          /** should perform any chain reorganization required
           *
           *  @return the pending chain state generated as a result of pushing the block,
@@ -229,6 +420,39 @@ namespace bts { namespace blockchain {
           **/
          block_fork_data push_block(const full_block& block_data);
 
+         /**
+          *  Starts recovering the signatures of a block that will be pushed later on background threads,
+          *  so push_block finds them in the signature_cache. Returns immediately and never changes state.
+          */
+         void preverify_block( const full_block& block_data );
+
+         /**
+          *  Checks the header of a block that builds on the head block without applying it: its number, time,
+          *  digest over its transactions and that it is signed by the delegate of its slot. The transactions
+          *  themselves are not evaluated, so a block that passes may still be rejected by push_block.
+          *
+          *  @throws if the block does not build on the head block or its header is invalid
+          */
+         void verify_block_header( const full_block& block_data );
+
+         /**
+          *  Recovers the signatures of a transaction on a background thread, so a store_pending_transaction
+          *  made once the returned future is ready finds them in the signature_cache. Never changes state,
+          *  and an invalid signature is left for store_pending_transaction to reject.
+          */
+         fc::future<void> preverify_transaction( const signed_transaction& trx );
+
+         /**
+          *  The checks of a received transaction that need neither state nor its signers: its size, its
+          *  expiration, whether it is already known, whether its operations exist, and whether any of them
+          *  can pay the relay fee. Meant to run before preverify_transaction, so spam is turned away for the
+          *  cost of a digest and a lookup. Every outcome is counted in get_stats.
+          *
+          *  @return false if the transaction is already pending
+          *  @throws what evaluating the transaction would throw for the same problem
+          */
+         bool prefilter_transaction( const signed_transaction& trx );
+
          vector<block_id_type> get_fork_history( const block_id_type& id );
 
          /**
@@ -274,6 +498,9 @@ namespace bts { namespace blockchain {
 
          vector<market_order>               get_market_orders( std::function<bool( const market_order& )> filter,
                                                                uint32_t limit = -1, order_type_enum type = null_order )const;
+         /** the orders whose market_index_key names owner, found through an index rather than a scan of the books */
+         vector<market_order>               get_market_orders_by_owner( const address& owner, uint32_t limit = -1,
+                                                                        order_type_enum type = null_order )const;
          optional<market_order>             get_market_order( const order_id_type& order_id, order_type_enum type = null_order )const;
 
          void                               scan_assets( function<void( const asset_record& )> callback );
@@ -291,6 +518,7 @@ namespace bts { namespace blockchain {
          virtual obalance_record            get_balance_record( const balance_id_type& id )const override;
          virtual oaccount_record            get_account_record( const account_id_type& id )const override;
          virtual oaccount_record            get_account_record( const address& owner )const override;
+         virtual const account_record*      lookup_account_record( const account_id_type& id )const override;
 
          virtual oasset_record              get_asset_record( const string& symbol )const override;
          virtual oaccount_record            get_account_record( const string& name )const override;
@@ -299,6 +527,11 @@ namespace bts { namespace blockchain {
          virtual void                       store_balance_record( const balance_record& r )override;
          virtual void                       store_account_record( const account_record& r )override;
 
+         virtual void                       store_balance_records( const unordered_map<balance_id_type, balance_record>& records )override;
+         virtual void                       store_order_records( order_type_enum type,
+                                                                 const map<market_index_key, order_record>& orders )override;
+         virtual void                       store_collateral_records( const map<market_index_key, collateral_record>& records )override;
+
          virtual vector<operation>          get_recent_operations( operation_type_enum t )override;
          virtual void                       store_recent_operation( const operation& o )override;
 
@@ -332,6 +565,31 @@ namespace bts { namespace blockchain {
                                                                       const fc::time_point& start_time,
                                                                       const fc::microseconds& duration,
                                                                       market_history_key::time_granularity_enum granularity );
+         /** candles of the market starting in the time range, read as stored; resolution must be one being kept */
+         market_candles                     get_market_candles( const asset_id_type& quote_id,
+                                                                const asset_id_type& base_id,
+                                                                const fc::time_point& start_time,
+                                                                const fc::microseconds& duration,
+                                                                uint32_t resolution )const;
+         /** seconds each kept candle covers; call before open(), which builds the candles of new resolutions */
+         void                               set_market_candle_resolutions( const vector<uint32_t>& resolutions );
+         /**
+          *  Keep the each_block market history rows of only the last seconds of chain time, at least
+          *  BTS_BLOCKCHAIN_MIN_MARKET_HISTORY_RETENTION_SEC; 0 keeps them all. Rows are dropped a whole day at a
+          *  time once the day has ended, so its each_hour and each_day rows, which fold in every block row as it
+          *  is stored, are final. Candles rebuilt later only cover the block rows still kept.
+          */
+         void                               set_market_history_retention( uint32_t seconds );
+         /** bids and asks of the market summed by price, at most levels of each; every level is kept until the head changes */
+         market_depth                       get_market_depth( const asset_id_type& quote_id,
+                                                              const asset_id_type& base_id,
+                                                              uint32_t levels )const;
+         /**
+          *  The fills a bid or ask would get if it were in the book when the next block matches its market.
+          *  The market is matched on a copy of its committed book, kept until the head changes, in a state
+          *  over the chain that is dropped afterwards; only the fills of the order's owner are returned.
+          */
+         vector<market_transaction>         simulate_market_order( const market_order& order );
 
          virtual void                       set_market_transactions( vector<market_transaction> trxs )override;
          vector<market_transaction>         get_market_transactions( uint32_t block_num  )const;
@@ -351,9 +609,32 @@ namespace bts { namespace blockchain {
          asset                              calculate_debt( const asset_id_type& asset_id )const;
          asset                              unclaimed_genesis();
 
-         void                               dump_state( const fc::path& path )const;
+         /**
+          *  Writes each index table to its own file in the new directory path, all at once on the worker threads.
+          *  "json" is for reading; "binary" files are checksummed index snapshots of one table, for load_state.
+          */
+         void                               dump_state( const fc::path& path, const string& format = "json" )const;
+         /** replaces the index with a binary dump_state taken on this raw chain, then replays the blocks after it */
+         void                               load_state( const fc::path& path );
+         /**
+          *  Writes the balances at the head block to the snapshots directory and waits for it. The balances
+          *  are read from a LevelDB snapshot on a thread of their own, so blocks keep being applied meanwhile.
+          */
          void                               create_snapshot()const;
+         /** the newest index snapshot on the main chain, or the one at block_num if it is not 0 */
+         optional<fc::path>                 get_index_snapshot( uint32_t block_num = 0 )const;
+         /**
+          *  Creates the chain in the empty data_dir from an index snapshot another node wrote, whose file must
+          *  hash to the trusted snapshot_hash. Opening it afterwards continues from the block after the
+          *  snapshot; the earlier block bodies are never fetched, so the index cannot be rebuilt later.
+          */
+         void                               bootstrap_from_index_snapshot( const fc::path& data_dir, const fc::path& file,
+                                                                           const fc::sha256& snapshot_hash );
          fc::variant_object                 get_stats() const;
+         /** per table operation counters and LevelDB properties, cheap enough to poll in production */
+         fc::variant_object                 get_storage_stats() const;
+         /** approximate bytes held by the table caches, LevelDB and the pending pool */
+         fc::variant_object                 get_memory_stats() const;
 
          // TODO: Only call on pending chain state
          virtual void                       set_market_dirty( const asset_id_type& quote_id, const asset_id_type& base_id )override
@@ -362,10 +643,6 @@ namespace bts { namespace blockchain {
          }
 
       private:
-         void write_snapshot_header( std::ofstream &out,
-                                     const fc::time_point_sec &timestamp )const;
-         share_type write_snapshot_balances( std::ofstream &out )const;
-         void write_snapshot_footer( std::ofstream &out, const share_type supply )const;
          unique_ptr<detail::chain_database_impl> my;
          fc::optional<fc::path> snapshots_dir;
    };
@@ -374,5 +651,12 @@ namespace bts { namespace blockchain {
 
 } } // bts::blockchain
 
+FC_REFLECT( bts::blockchain::integrity_drift, (asset_id)(total)(stored)(scanned) )
+FC_REFLECT( bts::blockchain::integrity_report, (block_num)(block_id)(checked_at)(elapsed_ms)(drift)(errors) )
+FC_REFLECT( bts::blockchain::transaction_prefilter_stats, (passed)(oversized)(expired)(invalid_expiration)(duplicate)(unsupported_operation)(insufficient_fee) )
+FC_REFLECT( bts::blockchain::block_timing, (block_num)(block_id)(transaction_count)(recover_signers)(execute_markets)(apply_transactions)(save_undo_state)(apply_changes)(total) )
+FC_REFLECT( bts::blockchain::balance_page, (balances)(cursor) )
+FC_REFLECT( bts::blockchain::account_page, (accounts)(cursor) )
+FC_REFLECT( bts::blockchain::asset_page, (assets)(cursor) )
 FC_REFLECT( bts::blockchain::block_fork_data, (next_blocks)(is_linked)(is_valid)(invalid_reason)(is_included)(is_known) )
 FC_REFLECT( bts::blockchain::fork_record, (block_id)(signing_delegate)(transaction_count)(latency)(size)(timestamp)(is_valid)(invalid_reason)(is_current_fork) )
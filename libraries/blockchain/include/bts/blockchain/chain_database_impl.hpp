@@ -1,6 +1,8 @@
 #pragma once
 //#define DEFAULT_LOGGER "blockchain"
 
+#include <bts/blockchain/block_id_filter.hpp>
+#include <bts/blockchain/block_log.hpp>
 #include <bts/blockchain/chain_database.hpp>
 #include <bts/blockchain/checkpoints.hpp>
 #include <bts/blockchain/config.hpp>
@@ -8,27 +10,37 @@
 #include <bts/blockchain/genesis_config.hpp>
 #include <bts/blockchain/genesis_json.hpp>
 #include <bts/blockchain/market_records.hpp>
+#include <bts/blockchain/name_prefix_index.hpp>
 #include <bts/blockchain/operation_factory.hpp>
 #include <bts/blockchain/time.hpp>
+#include <bts/blockchain/unique_transaction_set.hpp>
 
 #include <bts/db/cached_level_map.hpp>
+#include <bts/db/flat_map.hpp>
 #include <bts/db/level_map.hpp>
+#include <bts/db/unified_store.hpp>
 
 #include <fc/io/fstream.hpp>
 #include <fc/io/json.hpp>
 #include <fc/io/raw_variant.hpp>
 #include <fc/thread/mutex.hpp>
 #include <fc/thread/non_preemptable_scope_check.hpp>
+#include <fc/thread/thread.hpp>
 #include <fc/thread/unique_lock.hpp>
 
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <list>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 
 namespace bts { namespace blockchain {
 
@@ -49,6 +61,41 @@ namespace bts { namespace blockchain {
       }
    };
 
+   /** a delegate's place in the ranking by vote, with the record it was ranked from */
+   struct ranked_delegate
+   {
+      vote_del                              vote;
+      std::shared_ptr<const account_record> record;
+   };
+
+   /**
+    *  Running totals of one asset, adjusted by every store of a record that calculate_supply,
+    *  calculate_debt or unclaimed_genesis would otherwise have to scan for. Undo replays the
+    *  prior records through the same store methods, so the totals follow pop_block as well.
+    */
+   struct asset_totals
+   {
+      share_type supply            = 0; ///< everything calculate_supply counts except the collected fees
+      share_type debt              = 0;
+      share_type unclaimed_genesis = 0; ///< only tracked for the base asset
+   };
+
+   /** what one shard of an integrity check summed, in the terms of asset_totals */
+   struct integrity_scan
+   {
+      std::map<asset_id_type, asset_totals>    totals;
+      vector<string>                           errors;
+   };
+
+   /** leads every index snapshot, see chain_database_impl::write_index_snapshot */
+   struct index_snapshot_header
+   {
+      uint32_t      database_version = 0;
+      digest_type   chain_id;
+      uint32_t      block_num = 0;
+      block_id_type block_id;
+   };
+
    struct fee_index
    {
       fee_index( share_type fees = 0, transaction_id_type trx = transaction_id_type() )
@@ -66,6 +113,206 @@ namespace bts { namespace blockchain {
       }
    };
 
+   /** what the pending pool's limits need to know about a transaction in _pending_transaction_db */
+   struct pending_pool_entry
+   {
+      double                                   fee_rate = 0; /* fees per byte */
+      size_t                                   size = 0;
+      time_point_sec                           expiration;
+      vector<address>                          signers;
+   };
+
+   /** one notification waiting for a chain_observer; exactly one of the pointers is set */
+   struct observer_event
+   {
+      std::shared_ptr<const block_summary>     applied_block;
+      pending_chain_state_ptr                  undo_state;
+      transaction_evaluation_state_ptr         pending_transaction;
+   };
+
+   /**
+    *  Notifications not yet delivered to one chain_observer, drained by a task of its own so a slow
+    *  observer only delays itself. Block summaries are shared by every queue, not copied into each.
+    */
+   struct observer_queue
+   {
+      std::deque<observer_event>               events;
+      fc::future<void>                         drain;
+      bool                                     removed = false;
+      /** events dropped since the observer was last told, see chain_observer::notifications_dropped */
+      uint32_t                                 dropped_blocks = 0;
+      uint32_t                                 dropped_transactions = 0;
+      uint32_t                                 dropped_state_changes = 0;
+   };
+   typedef std::shared_ptr<observer_queue> observer_queue_ptr;
+
+   /** a pending transaction's evaluation on the pool state, kept so revalidate_pending can reuse it */
+   struct pending_evaluation
+   {
+      digest_type                              id;
+      transaction_evaluation_state_ptr         eval_state;
+      /** the transaction's own changes, layered over the pool state */
+      pending_chain_state_ptr                  changes;
+      /** everything it read or wrote, and what it wrote, apart from the accumulations below */
+      state_access_set                         accesses;
+      state_access_set                         writes;
+      /** fees added to the base asset and votes added to delegates, reapplied to the current records on reuse */
+      share_type                               base_asset_fees = 0;
+      std::map<account_id_type, share_type>    delegate_votes;
+      /** false if it was not evaluated in sequence after the evaluations before it */
+      bool                                     reusable = true;
+   };
+
+   /**
+    *  The committed orders of one market, sorted like their tables, kept in step by the
+    *  store_*_record methods of chain_database so market_engine can walk contiguous memory.
+    */
+   struct order_book
+   {
+      bts::db::flat_map<market_index_key, order_record>       bids;
+      bts::db::flat_map<market_index_key, order_record>       asks;
+      bts::db::flat_map<market_index_key, order_record>       shorts;
+      /** keyed by call price, so the positions a feed price crosses are always the highest ones */
+      bts::db::flat_map<market_index_key, collateral_record>  collateral;
+
+      /** the index of the first collateral position whose call price is above feed_price */
+      size_t first_margin_call( const price& feed_price )const
+      {
+         const auto itr = std::partition_point( collateral.begin(), collateral.end(),
+                                                [&]( const std::pair<market_index_key, collateral_record>& item )
+                                                { return !( item.first.order_price > feed_price ); } );
+         return itr - collateral.begin();
+      }
+   };
+
+   /** where a paged listing stopped: the snapshots it reads, the packed key of the last item it returned and when it expires */
+   struct list_cursor
+   {
+      string                                                  listing;
+      std::vector<std::shared_ptr<const leveldb::Snapshot>>  snapshots;
+      std::vector<char>                                       last_key;
+      fc::time_point                                          expiration;
+   };
+
+   /** the first 8 bytes of a transaction id, read big endian so prefixes sort like the ids */
+   struct transaction_prefix
+   {
+      uint64_t                                 prefix = 0;
+      transaction_location                     location;
+
+      friend bool operator < ( const transaction_prefix& a, const transaction_prefix& b )
+      {
+         return a.prefix < b.prefix;
+      }
+   };
+
+   /** where a transaction record is kept in _block_transaction_db: the records of a block are adjacent */
+   struct block_transaction_key
+   {
+      uint32_t                                 block_num = 0;
+      uint32_t                                 trx_num = 0;
+
+      block_transaction_key(){}
+      explicit block_transaction_key( const transaction_location& location )
+      :block_num( location.block_num ),trx_num( location.trx_num ){}
+
+      friend bool operator < ( const block_transaction_key& a, const block_transaction_key& b )
+      {
+         return std::tie( a.block_num, a.trx_num ) < std::tie( b.block_num, b.trx_num );
+      }
+      friend bool operator == ( const block_transaction_key& a, const block_transaction_key& b )
+      {
+         return a.block_num == b.block_num && a.trx_num == b.trx_num;
+      }
+   };
+
+   /** an entry of the address history index: a transaction touching owner, in chain order for each address */
+   struct address_transaction_key
+   {
+      address                                  owner;
+      uint32_t                                 block_num = 0;
+      uint32_t                                 trx_num = 0;
+
+      friend bool operator < ( const address_transaction_key& a, const address_transaction_key& b )
+      {
+         return std::tie( a.owner, a.block_num, a.trx_num ) < std::tie( b.owner, b.block_num, b.trx_num );
+      }
+      friend bool operator == ( const address_transaction_key& a, const address_transaction_key& b )
+      {
+         return a.owner == b.owner && a.block_num == b.block_num && a.trx_num == b.trx_num;
+      }
+   };
+
+   /** a block of the fork tree held in memory */
+   struct fork_tree_node
+   {
+      block_fork_data                          data;
+      /** only known once the block itself is */
+      block_id_type                            previous;
+      uint32_t                                 block_num = 0;
+      /** changed since it was last written to _fork_db */
+      bool                                     dirty = false;
+   };
+
+   /** the next block this node would produce, kept up to date so producing it takes no evaluation */
+   struct block_template
+   {
+      block_id_type                            head_block_id;
+      time_point_sec                           timestamp;
+      /** the markets executed at timestamp, then the included transactions */
+      pending_chain_state_ptr                  state;
+      vector<signed_transaction>               transactions;
+      /** ids of transactions, in the same order, so the digest needs no hashing when the block is produced */
+      vector<transaction_id_type>              transaction_ids;
+      size_t                                   size = 0;
+      /** cleared and reused for every transaction tried on top of state */
+      pending_chain_state_ptr                  scratch;
+      transaction_evaluation_state_ptr         scratch_evaluation;
+
+      /** evaluate trx on top of state and keep its changes if it is valid */
+      void                                     try_add( const signed_transaction& trx, size_t trx_size, const digest_type& chain_id );
+   };
+
+   /** microseconds push_blocks_pipelined spent in each stage, reading and recovering summed over their threads */
+   struct block_pipeline_times
+   {
+      std::atomic<int64_t>                     read_us;
+      std::atomic<int64_t>                     recover_us;
+      int64_t                                  apply_us = 0;
+      int64_t                                  stall_us = 0;
+
+      block_pipeline_times():read_us( 0 ),recover_us( 0 ){}
+   };
+
+} } // bts::blockchain
+
+/* before the tables below instantiate level_map for these keys */
+FC_REFLECT( bts::blockchain::address_transaction_key, (owner)(block_num)(trx_num) )
+BTS_DB_ORDERED_KEY( bts::blockchain::address_transaction_key, (owner)(block_num)(trx_num) )
+FC_REFLECT( bts::blockchain::block_transaction_key, (block_num)(trx_num) )
+BTS_DB_ORDERED_KEY( bts::blockchain::block_transaction_key, (block_num)(trx_num) )
+
+namespace bts { namespace db {
+   /** delegates sort by descending votes, so the votes are stored complemented */
+   template<> struct ordered_key<bts::blockchain::vote_del>
+   {
+      static const bool enabled = true;
+      static void encode( std::string& out, const bts::blockchain::vote_del& value )
+      {
+         ordered_key_encode( out, ~value.votes );
+         ordered_key_encode( out, value.delegate_id );
+      }
+      static void decode( ordered_key_reader& in, bts::blockchain::vote_del& value )
+      {
+         ordered_key_decode( in, value.votes );
+         value.votes = ~value.votes;
+         ordered_key_decode( in, value.delegate_id );
+      }
+   };
+} }
+
+namespace bts { namespace blockchain {
+
    namespace detail
    {
       class chain_database_impl
@@ -82,19 +329,74 @@ namespace bts { namespace blockchain {
             void                                        pop_block();
             void                                        mark_invalid( const block_id_type& id, const fc::exception& reason );
             void                                        mark_included( const block_id_type& id, bool state );
-            void                                        verify_header( const full_block&, const public_key_type& block_signee );
+            void                                        verify_header( const full_block&, const public_key_type& block_signee,
+                                                                       vector<transaction_id_type> trx_ids );
+            void                                        recover_signers( const full_block& block, bool recover_block_signee,
+                                                                         bool recover_transaction_signers,
+                                                                         public_key_type& block_signee,
+                                                                         vector<transaction_id_type>& trx_ids );
+            /** whether the signatures of the block may be skipped as an ancestor of the assume-valid block,
+                or while reindexing, of the validated block */
+            bool                                        assume_valid( uint32_t block_num )const;
+            void                                        load_validated_block();
+            void                                        save_validated_block();
+            void                                        start_signature_recovery_threads();
+            /**
+             *  Passes the blocks read_blocks( first, last ) returns for [0, block_count) to push in order, while
+             *  a reader thread reads the next chunks and the signature recovery threads warm the signature_cache
+             *  for them. read_blocks is only ever called on the reader thread, so its source need not be thread safe.
+             */
+            void                                        push_blocks_pipelined( size_t block_count,
+                                                                               const std::function<vector<full_block>( size_t, size_t )>& read_blocks,
+                                                                               const std::function<void( const full_block& )>& push,
+                                                                               block_pipeline_times& times );
+            /** with a writer, the bulk-loaded tables keep their writes cached and commit them on it; nullptr restores them */
+            void                                        set_bulk_load_writer( fc::thread* writer );
+            void                                        flush_bulk_load_caches();
+
+            void                                        adjust_asset_totals( const asset_id_type& asset_id, share_type supply_delta,
+                                                                             share_type debt_delta = 0, share_type unclaimed_genesis_delta = 0 );
+            asset_totals                                get_asset_totals( const asset_id_type& asset_id )const;
+            void                                        defer_asset_totals();
+            void                                        flush_asset_totals();
+            /** stores r over old_rec, which the caller read, and adjusts the asset totals by the difference */
+            void                                        write_balance_record( const balance_record& r, const obalance_record& old_rec,
+                                                                              const oasset_record& base_asset );
+            /* the full scans the totals replace, used to verify them */
+            asset                                       scan_supply( const asset_id_type& asset_id )const;
+            asset                                       scan_debt( const asset_id_type& asset_id )const;
+            asset                                       scan_unclaimed_genesis()const;
             void                                        apply_transactions( const full_block& block,
                                                                             const pending_chain_state_ptr& );
+            void                                        evaluate_transactions_serially( const full_block& block,
+                                                                                        const pending_chain_state_ptr&,
+                                                                                        map<account_id_type, share_type>& delegate_votes );
+            void                                        evaluate_transactions_in_parallel( const full_block& block,
+                                                                                           const pending_chain_state_ptr&,
+                                                                                           map<account_id_type, share_type>& delegate_votes );
             void                                        pay_delegate( const block_id_type& block_id,
                                                                       const pending_chain_state_ptr&,
                                                                       const public_key_type& block_signee );
             void                                        save_undo_state( const block_id_type& id,
                                                                          const pending_chain_state_ptr& );
+            /** drops the bodies and transaction records of blocks deeper than _prune_depth, once a batch of them is due */
+            void                                        prune_block_bodies();
+
+            /** fills _address_transaction_index_db from every transaction record */
+            void                                        index_address_history();
+            void                                        index_transaction_addresses( const transaction_id_type& id, const transaction_record& record );
+            void                                        unindex_transaction_addresses( const transaction_record& record );
             void                                        update_head_block( const full_block& blk );
             std::vector<block_id_type>                  fetch_blocks_at_number( uint32_t block_num );
+            void                                        index_main_chain_block( uint32_t block_num, const block_id_type& block_id );
+            void                                        unindex_main_chain_block( uint32_t block_num );
             std::pair<block_id_type, block_fork_data>   recursive_mark_as_linked( const std::unordered_set<block_id_type>& ids );
             void                                        recursive_mark_as_invalid( const std::unordered_set<block_id_type>& ids, const fc::exception& reason );
 
+            fork_tree_node*                             find_fork_node( const block_id_type& id );
+            fork_tree_node&                             fork_node( const block_id_type& id );
+            void                                        flush_fork_tree();
+
             void                                        execute_markets(const fc::time_point_sec& timestamp, const pending_chain_state_ptr& pending_state );
             void                                        update_random_seed( const secret_hash_type& new_secret,
                                                                             const pending_chain_state_ptr& pending_state );
@@ -106,9 +408,157 @@ namespace bts { namespace blockchain {
                                                                                          const public_key_type& block_signee );
 
             void                                        revalidate_pending();
-            void                                        handle_snapshots( const full_block& block_data )const;
+            pending_evaluation                          evaluate_pending( const signed_transaction& trx, const share_type& required_fees,
+                                                                          bool enforce_pool_limits = false );
+            void                                        make_room_in_pending_pool( const transaction_evaluation_state& eval_state,
+                                                                                   const share_type& fees );
+            void                                        track_pending( const digest_type& id, const transaction_evaluation_state& eval_state,
+                                                                       const share_type& fees );
+            void                                        remove_pending( const digest_type& id );
+            void                                        evict_pending( const digest_type& id );
+            void                                        purge_expired_pending( const time_point_sec& now );
+            void                                        note_pending_accesses( pending_evaluation& evaluation )const;
+            void                                        reapply_pending( pending_evaluation& evaluation );
+            void                                        build_block_template( const time_point_sec& timestamp );
+            bool                                        add_to_block_template( const transaction_evaluation_state& eval_state );
+            void                                        run_online_upgrades();
+            void                                        update_market_candles( const market_history_key& key, const market_history_record& record,
+                                                                               const std::vector<uint32_t>& resolutions );
+            void                                        rebuild_market_candles( bool missing_only );
+            /** drops the each_block market history rows of the days that ended before the retention window */
+            void                                        prune_market_history();
+            void                                        rebuild_market_transaction_index( bool missing_only );
+            void                                        rebuild_block_transaction_index( bool missing_only );
+            /** _block_id_to_block_record_db through a cache of the last BTS_BLOCKCHAIN_BLOCK_RECORD_CACHE_SIZE blocks used */
+            oblock_record                               fetch_block_record( const block_id_type& block_id )const;
+            void                                        store_block_record( const block_id_type& block_id, const block_record& record );
+            void                                        cache_block_record( const block_id_type& block_id, const block_record& record )const;
+            void                                        uncache_block_record( const block_id_type& block_id );
+            const std::vector<ranked_delegate>&         delegate_ranking()const;
+
+            /** the decoded hot properties, loaded from _property_db on first use */
+            const std::vector<account_id_type>&         active_delegates()const;
+            const std::vector<account_id_type>&         sorted_active_delegates()const;
+            const fc::ripemd160&                        random_seed()const;
+            /** forget the decoded properties; call whenever _property_db changes other than through set_property */
+            void                                        clear_property_cache();
+            void                                        update_delegate_ranking( const oaccount_record& old_rec,
+                                                                                 const account_record& record );
+            integrity_report                            check_integrity();
+            void                                        integrity_check_loop();
+            void                                        wait_for_integrity_scans();
+            void                                        run_snapshot_read( const std::function<void()>& read, const char* description );
+            void                                        wait_for_snapshot_reads();
+            list_cursor                                 find_list_cursor( const string& listing, string& token,
+                                                                          const std::function<std::vector<std::shared_ptr<const leveldb::Snapshot>>()>& take_snapshots );
+            void                                        advance_list_cursor( string& token, std::vector<char> last_key );
+            void                                        handle_snapshots( const full_block& block_data );
+            fc::future<void>                            start_balance_snapshot();
+            void                                        write_balance_snapshot( const bts::db::level_map<balance_id_type, balance_record>::snapshot& balances,
+                                                                                uint32_t block_num, const fc::time_point_sec& timestamp,
+                                                                                const fc::path& filename )const;
+            void                                        wait_for_balance_snapshot();
+            void                                        notify_observers( const observer_event& event );
+
+            void                                        handle_index_snapshots();
+            void                                        start_index_snapshot();
+            void                                        write_index_snapshot( const index_snapshot_header& header,
+                                                                              const std::vector<std::shared_ptr<const leveldb::Snapshot>>& tables,
+                                                                              const fc::path& data_dir )const;
+            void                                        wait_for_index_snapshot();
+            bool                                        restore_index_snapshot( const fc::path& data_dir );
+            void                                        load_index_snapshot( const fc::path& file );
+            void                                        bootstrap_index_snapshot( const fc::path& file, const fc::sha256& snapshot_hash );
+            void                                        write_state_dump( const fc::path& dir, bool binary );
+            uint32_t                                    load_state_dump( const fc::path& dir );
+            std::map<uint32_t, fc::path>                list_index_snapshots( const fc::path& data_dir )const;
+            void                                        index_transactions();
+            void                                        index_order_books();
+            void                                        index_names();
+            void                                        index_known_blocks();
+            /** call whenever id is written to _fork_db */
+            void                                        add_known_block( const block_id_type& id );
+            /** the book of the given market, or an empty one */
+            const order_book&                           get_order_book( const asset_id_type& quote_id, const asset_id_type& base_id )const;
+            void                                        index_transaction_prefix( const transaction_id_type& id, const transaction_location& location );
+            void                                        unindex_transaction_prefix( const transaction_id_type& id, const transaction_location& location );
+            vector<transaction_location>                find_transaction_prefix( const transaction_id_type& id )const;
+
+            /** key prefixes of the index tables when they share _unified_store; never reorder or reuse */
+            enum unified_table_prefix
+            {
+               market_transactions_table      = 1,
+               slate_table                    = 2,
+               fork_number_table              = 3,
+               fork_table                     = 4,
+               undo_state_table               = 5,
+               block_id_to_block_record_table = 6,
+               id_to_transaction_record_table = 7,
+               pending_transaction_table      = 8,
+               asset_table                    = 9,
+               symbol_index_table             = 10,
+               balance_table                  = 11,
+               burn_table                     = 12,
+               account_table                  = 13,
+               address_to_account_table       = 14,
+               account_index_table            = 15,
+               delegate_vote_index_table      = 16,
+               slot_record_table              = 17,
+               ask_table                      = 18,
+               bid_table                      = 19,
+               short_table                    = 20,
+               collateral_table               = 21,
+               feed_table                     = 22,
+               market_status_table            = 23,
+               market_history_table           = 24,
+               owner_balance_index_table      = 25,
+               asset_totals_table             = 26,
+               owner_ask_index_table          = 27,
+               owner_bid_index_table          = 28,
+               owner_short_index_table        = 29,
+               owner_collateral_index_table   = 30,
+               delegate_feed_index_table      = 31,
+               market_candle_table            = 32,
+               market_transaction_index_table = 33,
+               delegate_slot_index_table      = 34,
+               block_transaction_table        = 35
+            };
+
+            /** options only apply when the table has its own database; the unified store is tuned as a whole */
+            template<typename Map>
+            void open_index_table( Map& table, const fc::path& dir, unified_table_prefix prefix,
+                                   const bts::db::level_map_options& options = bts::db::level_map_options() )
+            {
+               if( _use_unified_store )
+                  table.open( _unified_store, prefix );
+               else
+                  table.open( dir, options );
+            }
 
             fc::future<void> _revalidate_pending;
+            fc::future<void> _online_upgrade_task;
+            fc::future<void>                         _integrity_check_loop;
+            uint32_t                                 _integrity_check_interval_sec = 0;
+            /** the table scans of the running check; they read snapshots, so close() must wait for them */
+            std::vector<fc::future<void>>            _integrity_scans;
+            std::atomic<bool>                        _stop_integrity_scans{ false };
+            optional<integrity_report>               _last_integrity_report;
+            /** query scans of snapshots on the worker threads, see run_snapshot_read; close() must wait for them */
+            std::vector<fc::future<void>>            _snapshot_reads;
+            /** the daily balance snapshot being written, see start_balance_snapshot; close() stops and waits for it */
+            fc::future<void>                         _balance_snapshot_export;
+            std::unique_ptr<fc::thread>              _balance_snapshot_thread;
+            std::atomic<bool>                        _stop_balance_snapshot{ false };
+            /** the index snapshot being written, see start_index_snapshot; close() stops and waits for it */
+            fc::future<void>                         _index_snapshot_write;
+            std::unique_ptr<fc::thread>              _index_snapshot_thread;
+            std::atomic<bool>                        _stop_index_snapshot{ false };
+            uint32_t                                 _next_snapshot_reader = 0;
+            /** paged listings in progress by token; they hold snapshots, so close() drops them */
+            map<string, list_cursor>                 _list_cursors;
+            uint64_t                                 _next_list_cursor = 0;
+            std::vector<std::unique_ptr<fc::thread>> _signature_recovery_threads;
+            uint32_t                                 _next_preverify_thread = 0;
             fc::mutex        _push_block_mutex;
 
             /**
@@ -120,46 +570,128 @@ namespace bts { namespace blockchain {
              */
             pending_chain_state_ptr                                                     _pending_trx_state;
 
+            /** the evaluations applied to _pending_trx_state, in order */
+            std::vector<pending_evaluation>                                             _pending_evaluations;
+            /** the evaluations on the pool state clear_pending replaced, and how the chain changed since */
+            std::vector<pending_evaluation>                                             _revalidation_base;
+            state_access_set                                                            _pending_block_changes;
+
+            /** while set, adjust_asset_totals sums the deltas here and flush_asset_totals writes them */
+            optional<std::map<asset_id_type, asset_totals>>                             _deferred_asset_totals;
+
+            std::shared_ptr<block_template>                                             _block_template;
+            /** the slot revalidate_pending rebuilds the template for, set by prepare_block_template */
+            optional<time_point_sec>                                                    _block_template_time;
+
 
             chain_database*                                                             self = nullptr;
-            unordered_set<chain_observer*>                                              _observers;
+            unordered_map<chain_observer*, observer_queue_ptr>                          _observers;
             digest_type                                                                 _chain_id;
             bool                                                                        _skip_signature_verification;
+            /** see chain_database::set_assume_valid_block; 0 when there is none */
+            uint32_t                                                                    _assume_valid_block_num = 0;
+            block_id_type                                                               _assume_valid_block_id;
+            /** the end of the unbroken run of blocks from genesis verified here, kept in raw_chain/validated_block */
+            uint32_t                                                                    _validated_block_num = 0;
+            block_id_type                                                               _validated_block_id;
+            uint32_t                                                                    _saved_validated_block_num = 0;
+            bool                                                                        _verify_asset_totals = false;
+            bool                                                                        _verify_parallel_transactions = false;
+            fc::path                                                                    _data_dir;
+            bool                                                                        _reindexing = false;
+            uint32_t                                                                    _last_index_snapshot_block = 0;
             share_type                                                                  _relay_fee;
+            transaction_prefilter_stats                                                 _prefilter_stats;
+            std::function<void( const block_timing& )>                                  _block_timing_callback;
+
+            /** when enabled, the index tables share one LevelDB so each block is committed with a single write batch */
+            bool                                                                        _use_unified_store = false;
+            bts::db::unified_store                                                      _unified_store;
 
             bts::db::cached_level_map<uint32_t, std::vector<market_transaction>>        _market_transactions_db;
+            /* derived from _market_transactions_db as it is stored; local, not in snapshots */
+            bts::db::level_map<market_transaction_index_key, int>                       _market_transaction_index_db;
+            /* the records of _id_to_transaction_record_db again, by chain location; local, not in snapshots */
+            bts::db::level_map<block_transaction_key, transaction_record>               _block_transaction_db;
             bts::db::cached_level_map<slate_id_type, delegate_slate>                    _slate_db;
             bts::db::level_map<uint32_t, std::vector<block_id_type>>                    _fork_number_db;
             bts::db::level_map<block_id_type,block_fork_data>                           _fork_db;
-            bts::db::cached_level_map<uint32_t, fc::variant>                            _property_db;
+            /** the fork data of recently used blocks; _fork_db is only written by flush_fork_tree */
+            std::unordered_map<block_id_type, fork_tree_node>                           _fork_tree;
+            /** every id in _fork_db, so find_fork_node skips the lookup of ids never seen */
+            block_id_filter                                                             _known_block_filter;
+            bts::db::cached_level_map<uint32_t, fc::variant,
+                                      bts::db::flat_map<uint32_t, fc::variant>>         _property_db;
 #if 0
             bts::db::level_map<proposal_id_type, proposal_record>                       _proposal_db;
             bts::db::level_map<proposal_vote_id_type, proposal_vote>                    _proposal_vote_db;
 #endif
 
             /** the data required to 'undo' the changes a block made to the database */
-            bts::db::level_map<block_id_type,pending_chain_state>                       _undo_state_db;
+            bts::db::level_map<block_id_type,undo_state_record>                         _undo_state_db;
+            /** the undo states of the last BTS_BLOCKCHAIN_HOT_UNDO_STATES blocks applied, oldest first */
+            std::deque<std::pair<block_id_type, undo_state_record>>                     _hot_undo_states;
 
             // blocks in the current 'official' chain.
             bts::db::level_map<uint32_t,block_id_type>                                  _block_num_to_id_db;
+            /** _block_num_to_id_db kept in memory for answering sync requests: block n is _main_chain_ids[n-1] */
+            std::vector<block_id_type>                                                  _main_chain_ids;
+            std::unordered_map<block_id_type, uint32_t>                                 _main_chain_block_nums;
             // all blocks from any fork..
             bts::db::level_map<block_id_type,block_record>                              _block_id_to_block_record_db;
+            /** the records of recently stored and read blocks, most recent first; see fetch_block_record */
+            mutable std::list<block_record>                                             _block_record_lru;
+            mutable std::unordered_map<block_id_type, std::list<block_record>::iterator> _block_record_cache;
+
+            /** raw blocks from any fork, appended to _block_log and located by their offset */
+            block_log                                                                   _block_log;
+            bts::db::level_map<block_id_type,uint64_t>                                  _block_id_to_block_offset_db;
+            /** blocks whose bodies are kept, 0 for all of them, see chain_database::set_prune_depth */
+            uint32_t                                                                    _prune_depth = 0;
+            /** set on a follower, whose _block_log is the primary's, opened read only */
+            optional<fc::path>                                                          _primary_data_dir;
+            /** the primary's offset of the block follow_primary is pushing, which store_and_index records */
+            optional<uint64_t>                                                          _followed_block_offset;
+
+            unique_transaction_set                                                      _unique_transactions;
+            bts::db::level_map<transaction_id_type,transaction_record>                  _id_to_transaction_record_db;
+            /** off unless set_address_history_index enabled it; kept beside the index tables, outside snapshots */
+            bool                                                                        _address_history_enabled = false;
+            bts::db::level_map<address_transaction_key, transaction_id_type>            _address_transaction_index_db;
+            std::map<std::pair<asset_id_type, asset_id_type>, order_book>              _order_books;
 
-            bts::db::level_map<block_id_type,full_block>                                _block_id_to_block_data_db;
+            /** the names of _account_index_db and symbols of _symbol_index_db, for prefix queries */
+            name_prefix_index                                                           _account_name_index;
+            name_prefix_index                                                           _asset_symbol_index;
 
-            map<fc::time_point_sec, unordered_set<digest_type> >                        _unique_transactions;
-            bts::db::level_map<transaction_id_type,transaction_record>                  _id_to_transaction_record_db;
+            /** every transaction record by id prefix, for get_transaction with exact = false */
+            std::vector<transaction_prefix>                                             _transaction_prefixes;
+            /** prefixes stored since the last merge into _transaction_prefixes */
+            std::multimap<uint64_t, transaction_location>                               _recent_transaction_prefixes;
 
             signed_block_header                                                         _head_block_header;
             block_id_type                                                               _head_block_id;
 
             bts::db::level_map<digest_type, signed_transaction>                         _pending_transaction_db;
             std::map<fee_index, transaction_evaluation_state_ptr>                          _pending_fee_index;
-
-            bts::db::cached_level_map<asset_id_type, asset_record>                      _asset_db;
-            bts::db::cached_level_map<string, asset_id_type>                            _symbol_index_db;
+            /** every transaction in _pending_transaction_db, with indexes to evict the cheapest, purge the
+                expired and count those of each signer */
+            std::unordered_map<digest_type, pending_pool_entry>                         _pending_pool;
+            std::set<std::pair<double, digest_type>>                                    _pending_by_fee_rate;
+            std::set<std::pair<time_point_sec, digest_type>>                            _pending_by_expiration;
+            std::unordered_map<address, uint32_t>                                       _pending_per_signer;
+            size_t                                                                      _pending_pool_bytes = 0;
+            size_t                                                                      _pending_pool_budget = BTS_BLOCKCHAIN_PENDING_POOL_BUDGET;
+
+            /* small, read-mostly tables are cached in flat sorted vectors */
+            bts::db::cached_level_map<asset_id_type, asset_record,
+                                      bts::db::flat_map<asset_id_type, asset_record>>   _asset_db;
+            bts::db::cached_level_map<string, asset_id_type,
+                                      bts::db::flat_map<string, asset_id_type>>         _symbol_index_db;
 
             bts::db::level_map<balance_id_type, balance_record>                         _balance_db;
+            /* (owner, balance id) of every balance with a signature owner; balances are never removed */
+            bts::db::level_map<std::pair<address, balance_id_type>, int>                _owner_balance_index_db;
 
             bts::db::level_map<burn_record_key, burn_record_value>                      _burn_db;
 
@@ -168,17 +700,52 @@ namespace bts { namespace blockchain {
 
             bts::db::cached_level_map<string, account_id_type>                          _account_index_db;
             bts::db::cached_level_map<vote_del, int>                                    _delegate_vote_index_db;
+            /* _delegate_vote_index_db in order with the records, built on first use and kept by store_account_record */
+            mutable std::vector<ranked_delegate>                                        _delegate_ranking;
+            mutable bool                                                                _delegate_ranking_valid = false;
 
             bts::db::level_map<time_point_sec, slot_record>                             _slot_record_db;
+            /* (producer, start time) of every slot, for get_delegate_slot_records */
+            bts::db::level_map<std::pair<account_id_type, time_point_sec>, slot_record> _delegate_slot_index_db;
 
             bts::db::cached_level_map<market_index_key, order_record>                   _ask_db;
             bts::db::cached_level_map<market_index_key, order_record>                   _bid_db;
             bts::db::cached_level_map<market_index_key, order_record>                   _short_db;
             bts::db::cached_level_map<market_index_key, collateral_record>              _collateral_db;
             bts::db::cached_level_map<feed_index, feed_record>                          _feed_db;
-
-            bts::db::cached_level_map<std::pair<asset_id_type,asset_id_type>, market_status> _market_status_db;
+            /* (delegate, feed) of every feed, for get_feeds_from_delegate */
+            bts::db::level_map<std::pair<account_id_type, feed_id_type>, int>           _delegate_feed_index_db;
+            /* get_median_delegate_price results for the head block, cleared by set_feed and active delegate changes */
+            mutable map<std::pair<asset_id_type,asset_id_type>, oprice>                 _median_feed_prices;
+            mutable block_id_type                                                       _median_feed_prices_block;
+            /* get_market_depth results with every level, for the head block in _market_depth_block */
+            mutable map<std::pair<asset_id_type,asset_id_type>, market_depth>          _market_depth;
+            mutable block_id_type                                                       _market_depth_block;
+            /* copies of the books simulate_market_order has matched against, for the head block in _simulation_books_block */
+            map<std::pair<asset_id_type,asset_id_type>, order_book>                     _simulation_books;
+            block_id_type                                                               _simulation_books_block;
+            /* active_delegate_list_id in slot order and sorted, and last_random_seed_id, see active_delegates() */
+            mutable optional<std::vector<account_id_type>>                              _active_delegates;
+            mutable std::vector<account_id_type>                                        _sorted_active_delegates;
+            mutable optional<fc::ripemd160>                                             _random_seed;
+            /* (owner, key) of every order in the table above them, for get_market_orders_by_owner */
+            bts::db::level_map<std::pair<address, market_index_key>, int>               _owner_ask_index_db;
+            bts::db::level_map<std::pair<address, market_index_key>, int>               _owner_bid_index_db;
+            bts::db::level_map<std::pair<address, market_index_key>, int>               _owner_short_index_db;
+            bts::db::level_map<std::pair<address, market_index_key>, int>               _owner_collateral_index_db;
+
+            bts::db::cached_level_map<std::pair<asset_id_type,asset_id_type>, market_status,
+                                      bts::db::flat_map<std::pair<asset_id_type,asset_id_type>, market_status>> _market_status_db;
             bts::db::level_map<market_history_key, market_history_record>               _market_history_db;
+            /* rolled up from the each_block rows of _market_history_db as they are stored; local, not in snapshots */
+            bts::db::level_map<market_candle_key, market_candle>                        _market_candle_db;
+            std::vector<uint32_t>                                                       _market_candle_resolutions = BTS_BLOCKCHAIN_MARKET_CANDLE_RESOLUTIONS;
+            /** seconds of each_block market history kept, 0 for all of it, see chain_database::set_market_history_retention */
+            uint32_t                                                                    _market_history_retention_sec = 0;
+            /** each_block rows before this have been pruned */
+            fc::time_point_sec                                                          _market_history_pruned_until;
+            bts::db::cached_level_map<asset_id_type, asset_totals,
+                                      bts::db::flat_map<asset_id_type, asset_totals>>   _asset_totals_db;
 
             std::map<operation_type_enum, std::deque<operation>>                        _recent_operations;
          private:
@@ -186,6 +753,7 @@ namespace bts { namespace blockchain {
                                                  boost::random::mt11213b &prng ) const;
             slate_id_type store_slate( const bts::blockchain::delegate_slate &slate ) const;
             void store_delegates( const std::map<account_id_type, account_record> &delegates ) const;
+            void store_genesis_balances( std::vector<balance_record>& balances );
       };
   } // end namespace bts::blockchain::detail
 } } // end namespace bts::blockchain
@@ -193,3 +761,5 @@ namespace bts { namespace blockchain {
 FC_REFLECT_TYPENAME( std::vector<bts::blockchain::block_id_type> )
 FC_REFLECT( bts::blockchain::vote_del, (votes)(delegate_id) )
 FC_REFLECT( bts::blockchain::fee_index, (_fees)(_trx) )
+FC_REFLECT( bts::blockchain::index_snapshot_header, (database_version)(chain_id)(block_num)(block_id) )
+FC_REFLECT( bts::blockchain::asset_totals, (supply)(debt)(unclaimed_genesis) )
@@ -35,7 +35,9 @@ namespace bts { namespace blockchain {
       confirmation_requirement = 6,
       database_version         = 7, // database version, to know when we need to upgrade
       dirty_markets            = 8,
-      last_feed_id             = 9 // used for allocating new data feeds
+      last_feed_id             = 9, // used for allocating new data feeds
+      first_full_block_num     = 10, // blocks before it have been pruned to their headers, see chain_database::set_prune_depth
+      followed_block_log_offset = 11 // how far a follower has applied the primary's block log, see chain_database::follow_primary
    };
    typedef uint32_t chain_property_type;
 
@@ -60,9 +62,9 @@ namespace bts { namespace blockchain {
          share_type                         get_delegate_registration_fee( uint8_t pay_rate )const;
          share_type                         get_asset_registration_fee( uint8_t symbol_length )const;
 
-         std::vector<account_id_type>       get_active_delegates()const;
+         virtual std::vector<account_id_type> get_active_delegates()const;
          void                               set_active_delegates( const std::vector<account_id_type>& id );
-         bool                               is_active_delegate( const account_id_type& id )const;
+         virtual bool                       is_active_delegate( const account_id_type& id )const;
 
          /** converts an asset + asset_id to a more friendly representation using the symbol name */
          string                             to_pretty_asset( const asset& a )const;
@@ -127,9 +129,23 @@ namespace bts { namespace blockchain {
 
 
          virtual oasset_record              get_asset_record( const asset_id_type& id )const                = 0;
+         /**
+          *  get_asset_record for a caller that only uses the fields other than current_share_supply and
+          *  collected_fees, and at most adds to those totals and stores the record back.
+          */
+         virtual oasset_record              get_asset_record_for_totals( const asset_id_type& id )const
+         {
+            return get_asset_record( id );
+         }
          virtual obalance_record            get_balance_record( const balance_id_type& id )const            = 0;
          virtual oaccount_record            get_account_record( const account_id_type& id )const            = 0;
          virtual oaccount_record            get_account_record( const address& owner )const                 = 0;
+         /**
+          *  What get_account_record( id ) returns, without copying it: nullptr where that is invalid. The
+          *  record belongs to this state and is only valid until the next lookup in or store to it, so
+          *  callers that change it copy it first and store the copy.
+          */
+         virtual const account_record*      lookup_account_record( const account_id_type& id )const         = 0;
 
          virtual bool                       is_known_transaction( fc::time_point_sec, const digest_type& trx_id )       = 0;
 
@@ -154,6 +170,12 @@ namespace bts { namespace blockchain {
          virtual void                       store_balance_record( const balance_record& r )                 = 0;
          virtual void                       store_account_record( const account_record& r )                 = 0;
 
+         /** store a whole table's changes at once; these default to storing the records one by one */
+         virtual void                       store_balance_records( const unordered_map<balance_id_type, balance_record>& records );
+         virtual void                       store_order_records( order_type_enum type,
+                                                                 const map<market_index_key, order_record>& orders );
+         virtual void                       store_collateral_records( const map<market_index_key, collateral_record>& records );
+
          virtual void                       store_recent_operation( const operation& o )                    = 0;
          virtual vector<operation>          get_recent_operations( operation_type_enum t )                  = 0;
 
@@ -199,4 +221,6 @@ FC_REFLECT_ENUM( bts::blockchain::chain_property_enum,
                  (database_version)
                  (dirty_markets)
                  (last_feed_id)
+                 (first_full_block_num)
+                 (followed_block_log_offset)
                  )
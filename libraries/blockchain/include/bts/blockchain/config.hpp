@@ -11,7 +11,7 @@
  *  @brief Defines global constants that determine blockchain behavior
  */
 #define BTS_BLOCKCHAIN_VERSION                              1
-#define BTS_BLOCKCHAIN_DATABASE_VERSION                     152
+#define BTS_BLOCKCHAIN_DATABASE_VERSION                     160
 
 /**
  *  The address prepended to string representation of
@@ -40,6 +40,10 @@
 #define BTS_BLOCKCHAIN_MAX_SLATE_SIZE                       (BTS_BLOCKCHAIN_NUM_DELEGATES + (BTS_BLOCKCHAIN_NUM_DELEGATES/10))
 #define BTS_BLOCKCHAIN_MIN_FEEDS                            ((BTS_BLOCKCHAIN_NUM_DELEGATES/2) + 1)
 #define BTS_BLOCKCHAIN_MAX_UNDO_HISTORY                     (BTS_BLOCKCHAIN_NUM_DELEGATES*4)
+/** the undo states of this many of the most recently applied blocks are also kept in memory, so short reorgs don't read them back */
+#define BTS_BLOCKCHAIN_HOT_UNDO_STATES                      32
+/** a pruning node keeps at least the bodies of every block a pending transaction could still be a duplicate of, twice over */
+#define BTS_BLOCKCHAIN_MIN_PRUNE_DEPTH                      uint32_t(2 * BTS_BLOCKCHAIN_MAX_TRANSACTION_EXPIRATION_SEC / BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC)
 
 #define BTS_BLOCKCHAIN_ENABLE_NEGATIVE_VOTES                false
 
@@ -131,3 +135,155 @@
     block production.
  */
 #define BTS_BLOCKCHAIN_ASSET_REGISTRATION_FEE               (BTS_BLOCKCHAIN_BLOCKS_PER_DAY * 14)
+
+/*
+ *  Everything below tunes this node alone: its caches, worker threads, background jobs and relay
+ *  policy. None of it affects consensus, so nodes may set these differently.
+ */
+
+/**
+ *  Memory budget in bytes for the bounded, lazily-populated cache of the account database.
+ *  Set to 0 to keep every account record resident.
+ */
+#define BTS_BLOCKCHAIN_ACCOUNT_DB_CACHE_BUDGET              (64*1024*1024)
+
+/**
+ *  Default bytes of transactions the pending pool holds before evicting those paying the least fee
+ *  per byte, the most pending transactions any one key may sign, and the most market operations a
+ *  relayed transaction may carry for its single fee.
+ */
+#define BTS_BLOCKCHAIN_PENDING_POOL_BUDGET                  (16*1024*1024)
+#define BTS_BLOCKCHAIN_MAX_PENDING_TRANSACTIONS_PER_SIGNER  100
+#define BTS_BLOCKCHAIN_MAX_MARKET_OPERATIONS_PER_TRANSACTION 100
+
+/**
+ *  Default seconds between the background integrity checks of chain_database::check_integrity; 0 disables
+ *  them. Each check scans every balance and order on the worker threads.
+ */
+#define BTS_BLOCKCHAIN_DEFAULT_INTEGRITY_CHECK_INTERVAL_SEC 3600
+
+/**
+ *  Most notifications queued for a chain_observer that has fallen behind. Past this the oldest
+ *  block_applied is dropped and the observer is told so through notifications_dropped; block_applied
+ *  observers must treat a summary as "the chain reached this block", not as the only call they will
+ *  get for the blocks before it.
+ */
+#define BTS_BLOCKCHAIN_MAX_OBSERVER_QUEUE                   16
+
+/**
+ *  Seconds a paged listing of chain_database::list_balances and the like is kept after its last page
+ *  was read, and the most listings kept at once. Each holds LevelDB snapshots, which keep the versions
+ *  of the records they see on disk.
+ */
+#define BTS_BLOCKCHAIN_LIST_CURSOR_TTL_SEC                  60
+#define BTS_BLOCKCHAIN_MAX_LIST_CURSORS                     64
+
+/**
+ *  Default seconds per candle of the market candle store: 1m, 5m, 15m, 1h, 1d and 1w. Candles start at
+ *  multiples of their resolution since the epoch.
+ */
+#define BTS_BLOCKCHAIN_MARKET_CANDLE_RESOLUTIONS            { 60, 300, 900, 3600, 86400, 604800 }
+
+/**
+ *  A node pruning its each_block market history keeps at least the rows of the blocks it could still undo,
+ *  and looks for days to prune once this much chain time has passed.
+ */
+#define BTS_BLOCKCHAIN_MIN_MARKET_HISTORY_RETENTION_SEC     uint32_t(BTS_BLOCKCHAIN_MAX_UNDO_HISTORY * BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC)
+#define BTS_BLOCKCHAIN_MARKET_HISTORY_PRUNE_INTERVAL_SEC    (60*60)
+
+/**
+ *  Bloom filter bits per key for the index tables that are read mostly by exact key.
+ *  Set to 0 to disable the filters.
+ */
+#define BTS_BLOCKCHAIN_DB_BLOOM_FILTER_BITS                 10
+
+/**
+ *  During reindex, a cached table starts a background flush once this many of its records are dirty.
+ */
+#define BTS_BLOCKCHAIN_REINDEX_MAX_DIRTY_RECORDS            100000
+
+/**
+ *  During reindex, upcoming blocks are read, decoded and have their signatures recovered in chunks
+ *  of this many blocks, with at most BTS_BLOCKCHAIN_REINDEX_PREFETCH_CHUNKS chunks in flight.
+ */
+#define BTS_BLOCKCHAIN_REINDEX_PREFETCH_CHUNK_SIZE          200
+#define BTS_BLOCKCHAIN_REINDEX_PREFETCH_CHUNKS              8
+
+/**
+ *  Number of records an online table upgrade converts before yielding to other tasks.
+ */
+#define BTS_BLOCKCHAIN_DB_ONLINE_UPGRADE_BATCH_SIZE         1000
+
+/**
+ *  Upper bound on the worker threads that recover transaction signers before a block is applied.
+ */
+#define BTS_BLOCKCHAIN_MAX_SIGNATURE_RECOVERY_THREADS       8
+
+/**
+ *  Number of recovered signatures (each with its key and derived addresses) kept by the
+ *  signature_cache, enough for the pending pool plus several full blocks.
+ */
+#define BTS_BLOCKCHAIN_SIGNATURE_CACHE_SIZE                 50000
+
+/**
+ *  Number of base58 strings of addresses, and separately of public keys, kept by their base58_cache
+ *  in each direction.
+ */
+#define BTS_BLOCKCHAIN_BASE58_CACHE_SIZE                    20000
+
+/**
+ *  The filter over known block ids is sized when the database opens for twice the blocks in the fork
+ *  database, and for at least this many. Past that its false positive rate grows until the next open.
+ */
+#define BTS_BLOCKCHAIN_KNOWN_BLOCK_FILTER_MIN_ITEMS         1000000
+
+/**
+ *  Number of decoded block records chain_database keeps for the blocks most recently stored or read, which
+ *  RPC, sync and the delegate slot logic ask about over and over.
+ */
+#define BTS_BLOCKCHAIN_BLOCK_RECORD_CACHE_SIZE              1000
+
+/**
+ *  The daily balance snapshot is written on a thread of its own from a LevelDB snapshot of the balance
+ *  table, so block application never waits for it. It pauses BTS_BLOCKCHAIN_BALANCE_SNAPSHOT_PAUSE_MS
+ *  after every BTS_BLOCKCHAIN_BALANCE_SNAPSHOT_BATCH_SIZE balances to leave the disk to the blocks, and
+ *  logs its progress every BTS_BLOCKCHAIN_BALANCE_SNAPSHOT_PROGRESS_INTERVAL balances.
+ */
+#define BTS_BLOCKCHAIN_BALANCE_SNAPSHOT_BATCH_SIZE          10000
+#define BTS_BLOCKCHAIN_BALANCE_SNAPSHOT_PAUSE_MS            5
+#define BTS_BLOCKCHAIN_BALANCE_SNAPSHOT_PROGRESS_INTERVAL   1000000
+
+/**
+ *  A snapshot of every index table is written whenever the head block number is a multiple of this,
+ *  and the newest BTS_BLOCKCHAIN_INDEX_SNAPSHOTS_KEPT are kept. A missing or damaged index is then
+ *  restored from the newest valid snapshot instead of being rebuilt from genesis.
+ */
+#define BTS_BLOCKCHAIN_INDEX_SNAPSHOT_INTERVAL              10000
+#define BTS_BLOCKCHAIN_INDEX_SNAPSHOTS_KEPT                 2
+
+/**
+ *  The highest block whose ancestors were all verified on this node is saved beside the raw chain
+ *  whenever its number is a multiple of this, and on close. Reindexing the same raw chain then skips
+ *  the signature checks of the blocks up to it.
+ */
+#define BTS_BLOCKCHAIN_VALIDATED_BLOCK_SAVE_INTERVAL        1000
+
+/**
+ *  Transaction id prefixes of new blocks are collected in a small map and merged into the sorted
+ *  prefix array once this many, or an eighth of the array, have accumulated.
+ */
+#define BTS_BLOCKCHAIN_TRANSACTION_PREFIX_MERGE_SIZE        4096
+
+/**
+ *  Blocks with at least this many dirty markets execute them on the worker threads, each market in
+ *  its own state, and merge the results in the serial order. A market whose records were changed by
+ *  an earlier market is executed again serially, so the outcome is always that of serial execution.
+ */
+#define BTS_BLOCKCHAIN_MIN_PARALLEL_MARKETS                 4
+
+/**
+ *  Blocks with at least this many transactions evaluate them on the worker threads, each in its own
+ *  state, and merge the results in block order. A transaction that read something an earlier one
+ *  changed is evaluated again serially, so the outcome is always that of serial evaluation.
+ */
+#define BTS_BLOCKCHAIN_MIN_PARALLEL_TRANSACTIONS            16
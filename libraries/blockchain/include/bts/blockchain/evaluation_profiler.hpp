@@ -0,0 +1,58 @@
+#pragma once
+
+#include <bts/blockchain/operations.hpp>
+#include <bts/db/level_map_stats.hpp>
+
+#include <fc/time.hpp>
+#include <fc/variant_object.hpp>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+namespace bts { namespace blockchain {
+
+   /**
+    * @class evaluation_profiler
+    *
+    *  Counts evaluated operations by type with their latencies and the LevelDB reads they caused,
+    *  plus the time spent recovering transaction signers. Disabled by default; when disabled
+    *  evaluation only pays for one relaxed atomic load per operation.
+    *
+    *  Latencies use the power of two microsecond buckets of bts::db::level_map_stats.
+    */
+   class evaluation_profiler
+   {
+      public:
+         struct operation_stats
+         {
+            uint64_t                 count          = 0;
+            uint64_t                 failures       = 0;
+            uint64_t                 total_us       = 0;
+            uint64_t                 database_reads = 0;
+            std::vector<uint64_t>    latency_us = std::vector<uint64_t>( bts::db::level_map_stats::latency_buckets );
+         };
+
+         static evaluation_profiler& instance();
+
+         bool   enabled()const { return _enabled.load( std::memory_order_relaxed ); }
+         void   set_enabled( bool enabled );
+         void   clear();
+
+         void   record_operation( operation_type_enum type, const fc::time_point& start, uint64_t database_reads, bool failed );
+         void   record_signature_recovery( const fc::time_point& start, size_t signatures );
+
+         fc::variant_object get_stats()const;
+
+      private:
+         evaluation_profiler();
+
+         std::atomic<bool>                          _enabled;
+         mutable std::mutex                         _mutex;
+         std::map<operation_type_enum, operation_stats> _operations;
+         operation_stats                            _signature_recovery; ///< count is the number of signatures
+   };
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::evaluation_profiler::operation_stats, (count)(failures)(total_us)(database_reads)(latency_us) )
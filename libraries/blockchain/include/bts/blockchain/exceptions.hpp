@@ -32,6 +32,7 @@ namespace bts { namespace blockchain {
    FC_DECLARE_DERIVED_EXCEPTION( wrong_chain_id,                    bts::blockchain::blockchain_exception, 30023, "wrong chain id" );
    FC_DECLARE_DERIVED_EXCEPTION( unknown_block,                     bts::blockchain::blockchain_exception, 30024, "unknown block" );
    FC_DECLARE_DERIVED_EXCEPTION( block_older_than_undo_history,     bts::blockchain::blockchain_exception, 30025, "block is older than our undo history allows us to process" );
+   FC_DECLARE_DERIVED_EXCEPTION( ambiguous_transaction_id,          bts::blockchain::blockchain_exception, 30026, "transaction id prefix matches more than one transaction" );
 
    FC_DECLARE_EXCEPTION( evaluation_error, 31000, "Evaluation Error" );
    FC_DECLARE_DERIVED_EXCEPTION( negative_deposit,                  bts::blockchain::evaluation_error, 31001, "negative deposit" );
@@ -84,6 +85,9 @@ namespace bts { namespace blockchain {
    FC_DECLARE_DERIVED_EXCEPTION( negative_fee,                      bts::blockchain::evaluation_error, 36003, "negative fee" );
    FC_DECLARE_DERIVED_EXCEPTION( missing_deposit,                   bts::blockchain::evaluation_error, 36004, "missing deposit" );
    FC_DECLARE_DERIVED_EXCEPTION( insufficient_relay_fee,            bts::blockchain::evaluation_error, 36005, "insufficient relay fee" );
+   FC_DECLARE_DERIVED_EXCEPTION( pending_pool_full,                 bts::blockchain::evaluation_error, 36006, "pending pool full" );
+   FC_DECLARE_DERIVED_EXCEPTION( too_many_pending_transactions,     bts::blockchain::evaluation_error, 36007, "too many pending transactions" );
+   FC_DECLARE_DERIVED_EXCEPTION( too_many_market_operations,        bts::blockchain::evaluation_error, 36008, "too many market operations" );
 
    FC_DECLARE_DERIVED_EXCEPTION( invalid_market,                    bts::blockchain::evaluation_error, 37001, "invalid market" );
    FC_DECLARE_DERIVED_EXCEPTION( unknown_market_order,              bts::blockchain::evaluation_error, 37002, "unknown market order" );
@@ -29,6 +29,8 @@ namespace bts { namespace blockchain {
       feed_index       feed;
       variant          value;
       time_point_sec   last_update;
+      /** value as a price, decoded once when the chain database stores the record; unset if it is not a price */
+      optional<price>  decoded_price;
   };
 
   struct feed_entry
@@ -59,6 +61,9 @@ namespace bts { namespace blockchain {
 } } // bts::blockchain
 
 FC_REFLECT( bts::blockchain::feed_index, (feed_id)(delegate_id) )
-FC_REFLECT( bts::blockchain::feed_record, (feed)(value)(last_update) )
+FC_REFLECT( bts::blockchain::feed_record, (feed)(value)(last_update)(decoded_price) )
 FC_REFLECT( bts::blockchain::feed_entry, (delegate_name)(price)(last_update)(asset_symbol)(median_price) );
 FC_REFLECT( bts::blockchain::update_feed_operation, (feed)(value) )
+
+#include <bts/db/ordered_key.hpp>
+BTS_DB_ORDERED_KEY( bts::blockchain::feed_index, (feed_id)(delegate_id) )
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <fc/crypto/ripemd160.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/crypto/sha512.hpp>
+#include <fc/io/raw.hpp>
+
+#include <string>
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+   /**
+    * @class hash_engine
+    *
+    *  The hashes of the chain primitives all go through here: block ids and digests, transaction ids and
+    *  digests, and the addresses of keys, conditions and pts_addresses. A value is packed into one buffer
+    *  and hashed in a single call instead of being streamed through fc's encoders a member at a time, and
+    *  the batch functions hash many buffers per call so a backend can work on several of them at once.
+    *
+    *  The backend is chosen at first use: the fastest one the cpu supports whose output matches the
+    *  reference backend, fc's OpenSSL hashes, on a set of test vectors.
+    */
+   class hash_engine
+   {
+      public:
+         struct buffer
+         {
+            const char* data;
+            size_t      size;
+         };
+
+         struct backend
+         {
+            const char*  name;
+            bool       (*supported)();
+            void       (*sha256)( const buffer* in, size_t count, fc::sha256* out );
+            void       (*sha512)( const buffer* in, size_t count, fc::sha512* out );
+            void       (*ripemd160)( const buffer* in, size_t count, fc::ripemd160* out );
+         };
+
+         static hash_engine& instance();
+
+         const char*   backend_name()const;
+         /** @return false, keeping the current backend, if name is unknown, unsupported or fails its self test */
+         bool          select_backend( const std::string& name );
+
+         fc::sha256    sha256( const char* data, size_t size )const;
+         fc::sha512    sha512( const char* data, size_t size )const;
+         fc::ripemd160 ripemd160( const char* data, size_t size )const;
+         /** ripemd160 of the sha512 of data, the hash of block and transaction ids and of addresses */
+         fc::ripemd160 id_hash( const char* data, size_t size )const;
+
+         void          sha256( const buffer* in, size_t count, fc::sha256* out )const;
+         void          id_hash( const buffer* in, size_t count, fc::ripemd160* out )const;
+
+         template<typename T>
+         fc::sha256 packed_sha256( const T& value )const
+         {
+            const std::vector<char>& data = pack( value );
+            return sha256( data.data(), data.size() );
+         }
+
+         /** the sha256 of value and then suffix packed, as a transaction digest commits to the chain id */
+         template<typename T, typename U>
+         fc::sha256 packed_sha256( const T& value, const U& suffix )const
+         {
+            std::vector<char>& data = pack_buffer();
+            data.resize( fc::raw::pack_size( value ) + fc::raw::pack_size( suffix ) );
+            fc::datastream<char*> ds( data.data(), data.size() );
+            fc::raw::pack( ds, value );
+            fc::raw::pack( ds, suffix );
+            return sha256( data.data(), data.size() );
+         }
+
+         template<typename T>
+         fc::ripemd160 packed_id_hash( const T& value )const
+         {
+            const std::vector<char>& data = pack( value );
+            return id_hash( data.data(), data.size() );
+         }
+
+         /** packs value into a buffer of the calling thread, which is valid until its next pack */
+         template<typename T>
+         static const std::vector<char>& pack( const T& value )
+         {
+            std::vector<char>& data = pack_buffer();
+            data.resize( fc::raw::pack_size( value ) );
+            fc::datastream<char*> ds( data.data(), data.size() );
+            fc::raw::pack( ds, value );
+            return data;
+         }
+
+      private:
+         hash_engine();
+         static std::vector<char>& pack_buffer();
+   };
+
+} } // bts::blockchain
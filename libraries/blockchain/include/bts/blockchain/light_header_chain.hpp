@@ -0,0 +1,59 @@
+#pragma once
+
+#include <bts/blockchain/block.hpp>
+#include <bts/db/level_map.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+   /**
+    *  @brief the signed block headers of the chain, without the blocks or the state they build
+    *
+    *  A light client keeps this instead of a chain_database. Headers are accepted one at a time on top of
+    *  the head and checked as chain_database checks the header of a block it applies: the number and
+    *  previous id link to the head, the time is on a block interval, after the head and not in the future,
+    *  and the signature recovers to the key of the delegate of its slot.
+    *
+    *  The delegate schedule of a round lives in the chain state, so the caller supplies the signing keys of
+    *  the active delegates in slot order, as blockchain_list_active_delegates reports them from a trusted
+    *  full node. Transactions fetched from a full node are then checked against the transaction digest of
+    *  the header of the block said to include them, with verify_transaction_ids.
+    */
+   class light_header_chain
+   {
+      public:
+         light_header_chain();
+         ~light_header_chain();
+
+         void                            open( const fc::path& dir );
+         void                            close();
+
+         uint32_t                        get_head_block_num()const { return _head.block_num; }
+         block_id_type                   get_head_block_id()const  { return _head_id; }
+         fc::optional<signed_block_header> get_header( uint32_t block_num )const;
+
+         /**
+          *  @param round_signees the signing keys of the active delegates of the header's round, in slot order
+          *  @throws block_numbers_not_sequential, invalid_previous_block_id, invalid_block_time, time_in_past,
+          *          time_in_future or invalid_delegate_signee if the header cannot follow the head
+          */
+         void                            push_header( const signed_block_header& header,
+                                                      const std::vector<public_key_type>& round_signees );
+         /** drops the head, to switch to another fork */
+         void                            pop_header();
+
+         /** @throws invalid_block_digest unless trx_ids are, in order, the transactions of block block_num */
+         void                            verify_transaction_ids( uint32_t block_num,
+                                                                 std::vector<transaction_id_type> trx_ids )const;
+
+      private:
+         /* mutable as level_map::fetch_optional is not const */
+         mutable bts::db::level_map<uint32_t, signed_block_header> _headers;
+         signed_block_header                                       _head;
+         block_id_type                                             _head_id;
+   };
+
+} } // bts::blockchain
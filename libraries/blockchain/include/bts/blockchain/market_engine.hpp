@@ -1,13 +1,78 @@
 #include <bts/blockchain/chain_database_impl.hpp>
 
+#include <mutex>
+
 namespace bts { namespace blockchain { namespace detail {
 
+  /**
+   *  The state one market or transaction is executed in while others are executed over the same
+   *  previous state on other threads. Every read that can reach the previous state holds a lock shared by all
+   *  of them, because neither pending_chain_state nor the database tables may be read concurrently.
+   */
+  class locked_pending_state : public pending_chain_state
+  {
+  public:
+    locked_pending_state( chain_interface_ptr prev_state, std::recursive_mutex& chain_lock )
+    :pending_chain_state( prev_state ),_chain_lock(chain_lock){}
+
+    std::recursive_mutex&          chain_lock()const { return _chain_lock; }
+
+    virtual fc::time_point_sec     now()const override;
+    virtual uint32_t               get_head_block_num()const override;
+    virtual fc::ripemd160          get_current_random_seed()const override;
+    virtual vector<account_id_type> get_active_delegates()const override;
+    virtual bool                   is_active_delegate( const account_id_type& id )const override;
+
+    virtual ofeed_record           get_feed( const feed_index& )const override;
+    virtual oprice                 get_median_delegate_price( const asset_id_type&, const asset_id_type& base_id = 0 )const override;
+    virtual oburn_record           fetch_burn_record( const burn_record_key& key )const override;
+
+    virtual oasset_record          get_asset_record( const asset_id_type& id )const override;
+    virtual oasset_record          get_asset_record_for_totals( const asset_id_type& id )const override;
+    virtual oasset_record          get_asset_record( const string& symbol )const override;
+    virtual obalance_record        get_balance_record( const balance_id_type& id )const override;
+    virtual oaccount_record        get_account_record( const account_id_type& id )const override;
+    virtual oaccount_record        get_account_record( const address& owner )const override;
+    /** copies the record out of the database while holding the lock, the pointer is into that copy */
+    virtual const account_record*  lookup_account_record( const account_id_type& id )const override;
+    virtual oaccount_record        get_account_record( const string& name )const override;
+    virtual odelegate_slate        get_delegate_slate( slate_id_type id )const override;
+
+    virtual bool                   is_known_transaction( fc::time_point_sec exp, const digest_type& trx_id ) override;
+    virtual otransaction_record    get_transaction( const transaction_id_type& trx_id, bool exact = true )const override;
+
+    virtual omarket_status         get_market_status( const asset_id_type& quote_id, const asset_id_type& base_id )override;
+    virtual omarket_order          get_lowest_ask_record( const asset_id_type& quote_id, const asset_id_type& base_id )override;
+    virtual oorder_record          get_bid_record( const market_index_key& )const override;
+    virtual oorder_record          get_ask_record( const market_index_key& )const override;
+    virtual oorder_record          get_short_record( const market_index_key& )const override;
+    virtual ocollateral_record     get_collateral_record( const market_index_key& )const override;
+
+    virtual vector<operation>      get_recent_operations( operation_type_enum t )override;
+    virtual variant                get_property( chain_property_enum property_id )const override;
+    virtual oslot_record           get_slot_record( const time_point_sec& start_time )const override;
+    virtual omarket_history_record get_market_history_record( const market_history_key& key )const override;
+
+  private:
+    std::recursive_mutex&                                      _chain_lock;
+    mutable unordered_map<account_id_type, account_record>     _fetched_accounts;
+  };
+  typedef std::shared_ptr<locked_pending_state> locked_pending_state_ptr;
+
   class market_engine
   {
   public:
-    market_engine( pending_chain_state_ptr ps, chain_database_impl& cdi );
+    /** @param chain_lock held while reading the database directly, see locked_pending_state */
+    market_engine( pending_chain_state_ptr ps, chain_database_impl& cdi, std::recursive_mutex* chain_lock = nullptr );
     /** return true if execute was successful and applied */
     bool execute( asset_id_type quote_id, asset_id_type base_id, const fc::time_point_sec& timestamp );
+    /**
+     *  False if execute would fill no order of the market and only update its status: no margin call
+     *  is due and the highest bid is below the lowest ask. Markets with shorts always count as crossing.
+     */
+    bool orders_cross( asset_id_type quote_id, asset_id_type base_id );
+    /** makes execute and orders_cross match book, which must outlive them, instead of the committed orders */
+    void use_order_book( const order_book& book ) { _book_override = &book; }
 
     void cancel_all_shorts();
 
@@ -27,6 +92,10 @@ namespace bts { namespace blockchain { namespace detail {
     void pay_current_cover( market_transaction& mtrx, asset_record& quote_asset );
     void pay_current_ask( const market_transaction& mtrx, asset_record& base_asset );
 
+    /** orders_cross for the book and feed price execute has loaded */
+    bool book_crosses()const;
+    void store_market_status();
+
     bool get_next_short();
     bool get_next_bid();
     bool get_next_ask();
@@ -60,6 +129,7 @@ namespace bts { namespace blockchain { namespace detail {
     pending_chain_state_ptr       _pending_state;
     pending_chain_state_ptr       _prior_state;
     chain_database_impl&          _db_impl;
+    std::recursive_mutex*         _chain_lock;
 
     optional<market_order>        _current_bid;
     optional<market_order>        _current_ask;
@@ -75,10 +145,16 @@ namespace bts { namespace blockchain { namespace detail {
     vector<market_transaction>    _market_transactions;
 
   private:
-    bts::db::cached_level_map< market_index_key, order_record >::iterator         _bid_itr;
-    bts::db::cached_level_map< market_index_key, order_record >::iterator         _ask_itr;
-    bts::db::cached_level_map< market_index_key, order_record >::iterator         _short_itr;
-    bts::db::cached_level_map< market_index_key, collateral_record >::iterator    _collateral_itr;
+    /** the committed orders of the market being executed; bids, shorts and collateral are taken
+     *  from the highest price down, so those positions count the entries not yet visited */
+    const order_book*             _book = nullptr;
+    size_t                        _bids_left = 0;
+    size_t                        _next_ask = 0;
+    size_t                        _shorts_left = 0;
+    size_t                        _collateral_left = 0;
+    /** collateral positions from this index up have a call price above the feed and can be covered */
+    size_t                        _first_margin_call = 0;
+    const order_book*             _book_override = nullptr;
   };
 
 } } } // end namespace bts::blockchain::detail
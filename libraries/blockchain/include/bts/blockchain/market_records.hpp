@@ -107,6 +107,65 @@ namespace bts { namespace blockchain {
    };
    typedef vector<market_history_point> market_history_points;
 
+   /** one market's candle of the given resolution in seconds, starting at a multiple of it since the epoch */
+   struct market_candle_key
+   {
+       market_candle_key( uint32_t resolution = 0,
+                          asset_id_type quote_id = 0,
+                          asset_id_type base_id = 0,
+                          fc::time_point_sec timestamp = fc::time_point_sec() )
+         : resolution(resolution),
+           quote_id(quote_id),
+           base_id(base_id),
+           timestamp(timestamp)
+       {}
+
+       uint32_t           resolution;
+       asset_id_type      quote_id;
+       asset_id_type      base_id;
+       fc::time_point_sec timestamp;
+
+       bool operator < ( const market_candle_key& other ) const
+       {
+         return std::tie(resolution, quote_id, base_id, timestamp) < std::tie(other.resolution, other.quote_id, other.base_id, other.timestamp);
+       }
+   };
+
+   /**
+    *  Open, high, low and close of the blocks' opening and closing prices, with the extremes of the book, all
+    *  in the units get_market_price_history reports. Stored ready to serve, so a query decodes and returns.
+    */
+   struct market_candle
+   {
+       fc::time_point_sec timestamp;
+       double             open = 0;
+       double             high = 0;
+       double             low = 0;
+       double             close = 0;
+       double             highest_bid = 0;
+       double             lowest_ask = 0;
+       share_type         volume = 0;
+   };
+   typedef vector<market_candle> market_candles;
+
+   /** the orders of one side of a book at one price, added up */
+   struct market_depth_level
+   {
+       price              order_price;
+       /** the base asset the orders buy or sell, and its worth in the quote asset */
+       share_type         base_quantity = 0;
+       share_type         quote_quantity = 0;
+       uint32_t           orders = 0;
+   };
+
+   /** the best price levels of a market as of its head block, bids from the highest and asks from the lowest */
+   struct market_depth
+   {
+       uint32_t                      block_num = 0;
+       vector<market_depth_level>    bids;
+       vector<market_depth_level>    asks;
+   };
+
    struct order_record
    {
       order_record():balance(0){}
@@ -193,6 +252,36 @@ namespace bts { namespace blockchain {
       fc::time_point_sec                        timestamp;
    };
 
+   /**
+    *  Locates one market transaction, the index-th stored for its block, by pair and owner. Every transaction is
+    *  indexed under its bid owner, its ask owner and the null address, so the null owner lists the whole pair.
+    */
+   struct market_transaction_index_key
+   {
+       market_transaction_index_key( asset_id_type base_id = 0,
+                                     asset_id_type quote_id = 0,
+                                     const address& owner = address(),
+                                     uint32_t block_num = 0,
+                                     uint32_t index = 0 )
+         : base_id(base_id),
+           quote_id(quote_id),
+           owner(owner),
+           block_num(block_num),
+           index(index)
+       {}
+
+       asset_id_type      base_id;
+       asset_id_type      quote_id;
+       address            owner;
+       uint32_t           block_num;
+       uint32_t           index;
+
+       bool operator < ( const market_transaction_index_key& other ) const
+       {
+         return std::tie(base_id, quote_id, owner, block_num, index) < std::tie(other.base_id, other.quote_id, other.owner, other.block_num, other.index);
+       }
+   };
+
    struct collateral_record
    {
       collateral_record(share_type c = 0,
@@ -272,8 +361,20 @@ FC_REFLECT( bts::blockchain::market_index_key, (order_price)(owner) )
 FC_REFLECT( bts::blockchain::market_history_record, (highest_bid)(lowest_ask)(opening_price)(closing_price)(volume) )
 FC_REFLECT( bts::blockchain::market_history_key, (quote_id)(base_id)(granularity)(timestamp) )
 FC_REFLECT( bts::blockchain::market_history_point, (timestamp)(highest_bid)(lowest_ask)(opening_price)(closing_price)(volume) )
+FC_REFLECT( bts::blockchain::market_transaction_index_key, (base_id)(quote_id)(owner)(block_num)(index) )
+FC_REFLECT( bts::blockchain::market_candle_key, (resolution)(quote_id)(base_id)(timestamp) )
+FC_REFLECT( bts::blockchain::market_candle, (timestamp)(open)(high)(low)(close)(highest_bid)(lowest_ask)(volume) )
+FC_REFLECT( bts::blockchain::market_depth_level, (order_price)(base_quantity)(quote_quantity)(orders) )
+FC_REFLECT( bts::blockchain::market_depth, (block_num)(bids)(asks) )
 FC_REFLECT( bts::blockchain::order_record, (balance)(short_price_limit)(last_update) )
 FC_REFLECT( bts::blockchain::collateral_record, (collateral_balance)(payoff_balance)(interest_rate)(expiration) )
+
+#include <bts/db/ordered_key.hpp>
+BTS_DB_ORDERED_KEY( bts::blockchain::market_index_key, (order_price)(owner) )
+// history keys compare the base asset first, unlike their reflection
+BTS_DB_ORDERED_KEY( bts::blockchain::market_history_key, (base_id)(quote_id)(granularity)(timestamp) )
+BTS_DB_ORDERED_KEY( bts::blockchain::market_transaction_index_key, (base_id)(quote_id)(owner)(block_num)(index) )
+BTS_DB_ORDERED_KEY( bts::blockchain::market_candle_key, (resolution)(quote_id)(base_id)(timestamp) )
 FC_REFLECT( bts::blockchain::market_order, (type)(market_index)(state)(collateral)(interest_rate)(expiration) )
 FC_REFLECT_TYPENAME( std::vector<bts::blockchain::market_transaction> )
 FC_REFLECT_TYPENAME( bts::blockchain::market_history_key::time_granularity_enum ) // http://en.wikipedia.org/wiki/Voodoo_programminqg
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+   /**
+    *  @brief an in-memory radix tree from names to ids, for prefix queries
+    *
+    *  Each edge is labeled with the run of characters its names share, so a lookup costs the length of the
+    *  prefix and a prefix query the length of the prefix plus the names it returns. chain_database keeps
+    *  one over account names and one over asset symbols, built from their index tables when it opens and
+    *  kept current as records are stored, so completing a name never reads or decodes a record.
+    */
+   class name_prefix_index
+   {
+      public:
+         name_prefix_index();
+         ~name_prefix_index();
+
+         void   clear();
+         /** maps name to id, replacing any id it had; empty names are not indexed */
+         void   insert( const std::string& name, int32_t id );
+         void   remove( const std::string& name );
+         size_t size()const { return _size; }
+
+         /** up to limit names starting with prefix and their ids, in name order */
+         std::vector<std::pair<std::string, int32_t>> find_prefix( const std::string& prefix, uint32_t limit )const;
+
+      private:
+         struct node
+         {
+            std::string                         label;
+            bool                                has_id = false;
+            int32_t                             id = 0;
+            /** ordered by the first character of their labels, which differ */
+            std::vector<std::unique_ptr<node>>  children;
+         };
+         /** the child of parent whose label starts with first, or where it would go */
+         template<typename Node>
+         static auto find_child( Node& parent, char first ) -> decltype( parent.children.begin() );
+         static void           merge_with_only_child( node& n );
+         static void           collect( const node& n, std::string& name, uint32_t limit,
+                                        std::vector<std::pair<std::string, int32_t>>& results );
+
+         node   _root;
+         size_t _size;
+   };
+
+} } // bts::blockchain
@@ -3,6 +3,8 @@
 #include <bts/blockchain/exceptions.hpp>
 #include <bts/blockchain/operations.hpp>
 
+#include <array>
+
 namespace bts { namespace blockchain {
 
    /**
@@ -10,6 +12,9 @@ namespace bts { namespace blockchain {
     *
     *  Enables polymorphic creation and serialization of operation objects in
     *  an manner that can be extended by derived chains.
+    *
+    *  Converters live in a table indexed by the 8 bit operation type, so dispatching an operation
+    *  is an array load and one virtual call.
     */
    class operation_factory
    {
@@ -55,17 +60,19 @@ namespace bts { namespace blockchain {
           template<typename OperationType>
           void   register_operation()
           {
-             FC_ASSERT( _converters.find( OperationType::type ) == _converters.end(), 
-                        "Operation ID already Registered ${id}", ("id",OperationType::type) );
-            _converters[OperationType::type] = std::make_shared< operation_converter<OperationType> >(); 
+             auto& converter = _converters[ uint8_t( OperationType::type ) ];
+             FC_ASSERT( !converter, "Operation ID already Registered ${id}", ("id",OperationType::type) );
+             converter = std::make_shared< operation_converter<OperationType> >();
           }
 
+          bool is_registered( uint8_t type )const { return _converters[ type ] != nullptr; }
+
           void evaluate( transaction_evaluation_state& eval_state, const operation& op )
           {
-             auto itr = _converters.find( uint8_t(op.type) );
-             if( itr == _converters.end() )
+             const auto& converter = _converters[ op.type.value ];
+             if( !converter )
                 FC_THROW_EXCEPTION( bts::blockchain::unsupported_chain_operation, "", ("op",op) );
-             itr->second->evaluate( eval_state, op );
+             converter->evaluate( eval_state, op );
           }
 
           /// defined in operations.cpp
@@ -74,7 +81,7 @@ namespace bts { namespace blockchain {
           void from_variant( const fc::variant& in, bts::blockchain::operation& output );
 
        private:
-          std::unordered_map<int, std::shared_ptr<operation_converter_base> > _converters;
+          std::array<std::shared_ptr<operation_converter_base>, 256> _converters;
    };
 
 } } // bts::blockchain 
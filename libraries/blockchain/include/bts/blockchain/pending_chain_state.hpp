@@ -2,9 +2,55 @@
 #include <bts/blockchain/chain_interface.hpp>
 #include <fc/reflect/reflect.hpp>
 #include <deque>
+#include <set>
+#include <unordered_set>
 
 namespace bts { namespace blockchain {
 
+   struct undo_state_record;
+
+   /**
+    *  Keys of the records a pending state read or wrote, used to tell whether a change to the chain
+    *  can affect the outcome of an earlier evaluation. Accesses that are not tracked by key set the
+    *  untracked flag, which conflicts with any change.
+    */
+   struct state_access_set
+   {
+      bool                                     untracked     = false;
+      bool                                     median_prices = false; ///< all feeds and the active delegates
+      std::unordered_set<balance_id_type>      balances;
+      std::unordered_set<account_id_type>      accounts;
+      std::unordered_set<string>               account_names;
+      std::unordered_set<address>              account_addresses;
+      std::unordered_set<asset_id_type>        assets;
+      std::unordered_set<asset_id_type>        asset_totals; ///< assets only read through get_asset_record_for_totals
+      std::unordered_set<string>               asset_symbols;
+      std::unordered_set<slate_id_type>        slates;
+      std::set<market_index_key>               orders;
+      std::set<feed_index>                     feeds;
+      std::set<chain_property_type>            properties;
+      std::set<std::pair<asset_id_type, asset_id_type>> markets; ///< market statuses
+
+      bool                                     intersects( const state_access_set& other )const;
+      /** like intersects, but only compares the recorded keys */
+      bool                                     overlaps( const state_access_set& other )const;
+      void                                     insert( const state_access_set& other );
+      void                                     clear() { *this = state_access_set(); }
+   };
+
+   /** what the previous state returned for records before a pending state changed them */
+   struct prior_values
+   {
+      unordered_map<asset_id_type, oasset_record>          assets;
+      unordered_map<account_id_type, oaccount_record>      accounts;
+      unordered_map<balance_id_type, obalance_record>      balances;
+      map<market_index_key, oorder_record>                 bids;
+      map<market_index_key, oorder_record>                 asks;
+      map<market_index_key, oorder_record>                 shorts;
+      map<market_index_key, ocollateral_record>            collateral;
+      map<feed_index, ofeed_record>                        feeds;
+   };
+
    class pending_chain_state : public chain_interface, public std::enable_shared_from_this<pending_chain_state>
    {
       public:
@@ -13,7 +59,28 @@ namespace bts { namespace blockchain {
 
          void                           set_prev_state( chain_interface_ptr prev_state );
 
+         /** forget every change, keeping the hash tables' buckets so the state can be reused as a scratch layer */
+         void                           clear();
+
+         /** from now on, record the key of every record read through this state */
+         void                           track_reads() { _reads = std::make_shared<state_access_set>(); }
+         /** the reads recorded since track_reads(), or nullptr */
+         const state_access_set*        reads()const { return _reads.get(); }
+         /** the values captured since capture_prior_values(), or nullptr */
+         const prior_values*            priors()const { return _prior.get(); }
+
+         /**
+          *  From now on, keep what the previous state returns when a record is read through this state
+          *  before it was changed here, so get_undo_state can use it rather than read it again. Only
+          *  valid while the previous state itself does not change.
+          */
+         void                           capture_prior_values() { _prior = std::make_shared<prior_values>(); }
+         /** add the key of every record this state changes */
+         void                           collect_writes( state_access_set& writes )const;
+
          fc::ripemd160                  get_current_random_seed()const override;
+         virtual vector<account_id_type> get_active_delegates()const override;
+         virtual bool                   is_active_delegate( const account_id_type& id )const override;
 
          virtual void                   set_feed( const feed_record&  ) override;
          virtual ofeed_record           get_feed( const feed_index& )const override;
@@ -26,9 +93,12 @@ namespace bts { namespace blockchain {
          virtual oburn_record           fetch_burn_record( const burn_record_key& key )const override;
 
          virtual oasset_record          get_asset_record( const asset_id_type& id )const override;
+         /** records the read in asset_totals rather than assets */
+         virtual oasset_record          get_asset_record_for_totals( const asset_id_type& id )const override;
          virtual obalance_record        get_balance_record( const balance_id_type& id )const override;
          virtual oaccount_record        get_account_record( const account_id_type& id )const override;
          virtual oaccount_record        get_account_record( const address& owner )const override;
+         virtual const account_record*  lookup_account_record( const account_id_type& id )const override;
 
          virtual odelegate_slate        get_delegate_slate( slate_id_type id )const override;
          virtual void                   store_delegate_slate( slate_id_type id, const delegate_slate& slate ) override;
@@ -96,6 +166,8 @@ namespace bts { namespace blockchain {
           * pending state to the previous state.
           */
          virtual void                   get_undo_state( const chain_interface_ptr& undo_state )const;
+         /** the compact form of the above that is stored for every block, see undo_state_record */
+         void                           get_undo_state( undo_state_record& record )const;
 
          /** load the state from a variant */
          virtual void                   from_variant( const variant& v );
@@ -133,13 +205,51 @@ namespace bts { namespace blockchain {
          std::set<std::pair<asset_id_type, asset_id_type>>                 _dirty_markets;
 
          chain_interface_weak_ptr                                          _prev_state;
+
+      private:
+         void                           get_undo_state( pending_chain_state& undo_state, undo_state_record* created )const;
+
+         std::shared_ptr<state_access_set>                                 _reads;
+         std::shared_ptr<prior_values>                                     _prior;
    };
 
    typedef std::shared_ptr<pending_chain_state> pending_chain_state_ptr;
 
+   /**
+    *  The undo state of a block as it is stored: the prior value of every record the block changed,
+    *  and only the key of every record it created. The null placeholders that revert created records
+    *  are rebuilt by to_undo_state() when the block is popped, at which point the chain is still in
+    *  the state the block left it in.
+    */
+   struct undo_state_record
+   {
+      pending_chain_state               prior;
+
+      vector<asset_id_type>             created_assets;
+      vector<slate_id_type>             created_slates;
+      vector<account_id_type>           created_accounts;
+      vector<balance_id_type>           created_balances;
+      vector<transaction_id_type>       created_transactions;
+      vector<market_index_key>          created_bids;
+      vector<market_index_key>          created_asks;
+      vector<market_index_key>          created_shorts;
+      vector<market_index_key>          created_collateral;
+      vector<time_point_sec>            created_slots;
+      vector<std::pair<asset_id_type,asset_id_type>> created_market_statuses;
+      vector<feed_index>                created_feeds;
+      vector<burn_record_key>           created_burns;
+
+      /** expand into the pending state that reverts the block when applied on top of chain */
+      pending_chain_state_ptr           to_undo_state( const chain_interface_ptr& chain )const;
+   };
+
 } } // bts::blockchain
 
 // TODO: Why not reflect all members?
 FC_REFLECT( bts::blockchain::pending_chain_state,
             (assets)(slates)(accounts)(balances)(account_id_index)(symbol_id_index)(transactions)
             (properties)(bids)(asks)(shorts)(collateral)(slots)(market_statuses)(feeds)(burns)(_dirty_markets) )
+FC_REFLECT( bts::blockchain::undo_state_record,
+            (prior)(created_assets)(created_slates)(created_accounts)(created_balances)(created_transactions)
+            (created_bids)(created_asks)(created_shorts)(created_collateral)(created_slots)
+            (created_market_statuses)(created_feeds)(created_burns) )
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <bts/blockchain/address.hpp>
+#include <bts/blockchain/types.hpp>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace bts { namespace blockchain {
+
+   /**
+    * @class signature_cache
+    *
+    *  Remembers the key recovered from a (digest, signature) pair together with the addresses
+    *  that key can sign for. A transaction is evaluated when it enters the pending pool,
+    *  when the pool is revalidated, when a block is generated and when the block is applied, and
+    *  each pass would otherwise repeat the recovery and the address derivations.
+    *
+    *  The cache is shared by all threads and bounded; the oldest entries are evicted first.
+    */
+   class signature_cache
+   {
+      public:
+         struct signer
+         {
+            fc::ecc::public_key_data   key;
+            address                    native_address;
+
+            /** the six legacy pts_address forms of key; they cost six hash chains, so only on first use */
+            const vector<address>&     legacy_addresses()const;
+
+            mutable std::once_flag     _legacy_once;
+            mutable vector<address>    _legacy_addresses;
+         };
+         typedef std::shared_ptr<const signer> signer_ptr;
+
+         static signature_cache& instance();
+
+         /** @return the signer of sig, recovering it on a miss; throws if sig is invalid */
+         signer_ptr recover( const fc::ecc::compact_signature& sig, const digest_type& digest, bool enforce_canonical );
+
+         void   set_capacity( size_t capacity );
+         size_t size()const;
+         void   clear();
+
+      private:
+         signature_cache();
+
+         mutable std::mutex                          _mutex;
+         size_t                                      _capacity;
+         std::unordered_map<std::string, signer_ptr> _signers;
+         std::deque<std::string>                     _insertion_order;
+   };
+
+} } // bts::blockchain
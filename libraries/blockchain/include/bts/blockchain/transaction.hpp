@@ -132,6 +132,8 @@ namespace bts { namespace blockchain {
 
       bool is_cancel()const;
       bool is_claim()const;
+      /** the number of bids, asks, shorts, covers and collateral changes, cancellations included */
+      size_t market_operation_count()const;
    }; // transaction
 
    struct signed_transaction : public transaction
@@ -1,12 +1,37 @@
 #pragma once
 #include <bts/blockchain/types.hpp>
+#include <bts/blockchain/signature_cache.hpp>
 #include <bts/blockchain/transaction.hpp>
 
+#include <mutex>
+#include <unordered_map>
+
 namespace bts { namespace blockchain {
 
    class chain_interface;
    typedef shared_ptr<chain_interface> chain_interface_ptr;
 
+   /**
+    *  The delegate slates of the state a block is applied on, shared by the evaluations of its transactions.
+    *  Applying a block only adds slates, so one found in that state holds for the whole block and later
+    *  lookups skip the pending states in between. Slates defined by the block itself are not kept here.
+    */
+   class block_slate_cache
+   {
+      public:
+         /** @param lock guards the cache and the reads of block_base, which workers may share */
+         block_slate_cache( const chain_interface& block_base, std::recursive_mutex& lock )
+         :_base( block_base ),_lock( lock ){}
+
+         /** the delegates of the slate, or nullptr when the state the block is applied on has no such slate */
+         const vector<signed_int>* find( slate_id_type id );
+
+      private:
+         const chain_interface&                                                  _base;
+         std::recursive_mutex&                                                   _lock;
+         std::unordered_map<slate_id_type, optional<vector<signed_int>>>         _slates;
+   };
+
    /**
     *  While evaluating a transaction there is a lot of intermediate
     *  state that must be tracked.  Any shares withdrawn from the
@@ -33,6 +58,13 @@ namespace bts { namespace blockchain {
          virtual void reset();
 
          virtual void evaluate( const signed_transaction& trx, bool skip_signature_check = false, bool enforce_canonical = false );
+
+         /** trx.id(), computed once; trx must not be changed after evaluate() has copied it in */
+         const transaction_id_type&                 trx_id()const;
+         /** trx.digest( chain_id ), computed once */
+         const digest_type&                         trx_digest( const digest_type& chain_id )const;
+         /** trx.data_size(), computed once */
+         size_t                                     trx_size()const;
          virtual void evaluate_operation( const operation& op );
 
          /** perform any final operations based upon the current state of
@@ -44,7 +76,7 @@ namespace bts { namespace blockchain {
           */
          virtual void validate_required_fee();
          /**
-          * apply collected vote changes
+          * apply collected vote changes, or add them to _block_delegate_votes when that is set
           */
          virtual void update_delegate_votes();
          virtual void verify_delegate_id( account_id_type id )const;
@@ -75,6 +107,7 @@ namespace bts { namespace blockchain {
          void validate_asset( const asset& a )const;
 
          signed_transaction                         trx;
+         /** the native addresses of the signers; check_signature() also accepts their legacy forms */
          unordered_set<address>                     signed_keys;
 
          // increases with funds are withdrawn, decreases when funds are deposited or fees paid
@@ -132,6 +165,20 @@ namespace bts { namespace blockchain {
          bool                                       _skip_signature_check = false;
 
          uint32_t                                   _current_op_index = 0;
+
+         /**
+          *  Set while the transactions of a block are applied: the votes of each transaction are summed
+          *  here by delegate and the block stores every delegate record once, instead of once per transaction.
+          */
+         map<account_id_type, share_type>*          _block_delegate_votes = nullptr;
+         /** set while the transactions of a block are applied, to resolve slates without the pending states */
+         block_slate_cache*                         _block_slates = nullptr;
+
+         mutable optional<transaction_id_type>                     _trx_id;
+         mutable optional<std::pair<digest_type, digest_type>>     _trx_digest; ///< the chain id and the digest
+         mutable optional<size_t>                                  _trx_size;
+         /** the signers behind signed_keys, for matching legacy addresses on demand */
+         vector<signature_cache::signer_ptr>                       _signers;
    };
 
    typedef shared_ptr<transaction_evaluation_state> transaction_evaluation_state_ptr;
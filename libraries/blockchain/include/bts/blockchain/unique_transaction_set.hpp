@@ -0,0 +1,64 @@
+#pragma once
+
+#include <bts/blockchain/types.hpp>
+
+#include <deque>
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+   /**
+    * @class unique_transaction_set
+    *
+    *  The digests of the transactions that have not yet expired, which a block may not include again.
+    *
+    *  Digests are bucketed by expiration, one bucket per BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC, and the buckets
+    *  are kept in time order, so purging the expired digests drops whole buckets from the front; only the
+    *  bucket holding the purge time is filtered digest by digest. Each bucket is an open addressing hash
+    *  table probed linearly from the leading bytes of the digest, which is already uniformly distributed.
+    */
+   class unique_transaction_set
+   {
+      public:
+         /** @return false if the digest was already present */
+         bool   insert( const time_point_sec& expiration, const digest_type& digest );
+         void   erase( const time_point_sec& expiration, const digest_type& digest );
+         bool   contains( const time_point_sec& expiration, const digest_type& digest )const;
+
+         /** drops every digest that expires before now */
+         void   purge_expired( const time_point_sec& now );
+         void   clear();
+         size_t size()const { return _size; }
+
+      private:
+         struct slot
+         {
+            enum state_type : uint8_t { empty, used, erased };
+
+            digest_type       digest;
+            time_point_sec    expiration;
+            state_type        state = empty;
+         };
+
+         struct bucket
+         {
+            std::vector<slot>  slots;
+            size_t             used = 0;
+            size_t             erased = 0;
+
+            /** @return the index of the slot holding the digest, slots.size() if there is none */
+            size_t find( const time_point_sec& expiration, const digest_type& digest )const;
+            bool   insert( const time_point_sec& expiration, const digest_type& digest );
+            void   erase( size_t index );
+            void   rehash( size_t capacity );
+         };
+
+         static uint32_t bucket_number( const time_point_sec& expiration );
+         const bucket*   find_bucket( const time_point_sec& expiration )const;
+
+         std::deque<bucket> _buckets;
+         uint32_t           _first_bucket = 0;
+         size_t             _size = 0;
+   };
+
+} } // bts::blockchain
@@ -45,12 +45,23 @@ namespace bts { namespace blockchain {
          return fc::raw::unpack<WithdrawType>(data);
       }
 
+      /** the hash of the packed condition, computed once and remembered with the condition */
       balance_id_type get_address()const;
 
+      /** the owner of a withdraw_with_signature condition and the null address otherwise, unpacked once */
+      address         get_owner()const;
+
       asset_id_type                                     asset_id;
       slate_id_type                                     delegate_slate_id = 0;
       fc::enum_type<uint8_t, withdraw_condition_types>  type = withdraw_null_type;
       std::vector<char>                                 data;
+
+      /**
+       *  Memos of get_address() and get_owner(), which are neither packed nor reflected. Copies carry them,
+       *  so assign a new condition rather than change the members of one that was already asked.
+       */
+      mutable fc::optional<balance_id_type>             _address;
+      mutable fc::optional<address>                     _owner;
    };
 
    enum memo_flags_enum
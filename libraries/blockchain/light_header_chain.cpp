@@ -0,0 +1,93 @@
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/exceptions.hpp>
+#include <bts/blockchain/fork_blocks.hpp>
+#include <bts/blockchain/light_header_chain.hpp>
+#include <bts/blockchain/time.hpp>
+
+namespace bts { namespace blockchain {
+
+   light_header_chain::light_header_chain()
+   {
+   }
+
+   light_header_chain::~light_header_chain()
+   {
+      close();
+   }
+
+   void light_header_chain::open( const fc::path& dir )
+   { try {
+      _headers.open( dir );
+      _head = signed_block_header();
+      _head_id = block_id_type();
+
+      uint32_t block_num = 0;
+      if( _headers.last( block_num, _head ) )
+         _head_id = _head.id();
+   } FC_CAPTURE_AND_RETHROW( (dir) ) }
+
+   void light_header_chain::close()
+   {
+      if( _headers.is_open() )
+         _headers.close();
+   }
+
+   fc::optional<signed_block_header> light_header_chain::get_header( uint32_t block_num )const
+   {
+      return _headers.fetch_optional( block_num );
+   }
+
+   void light_header_chain::push_header( const signed_block_header& header,
+                                         const std::vector<public_key_type>& round_signees )
+   { try {
+      if( header.block_num != _head.block_num + 1 )
+         FC_CAPTURE_AND_THROW( block_numbers_not_sequential, (header.block_num)(_head.block_num) );
+      if( header.previous != _head_id )
+         FC_CAPTURE_AND_THROW( invalid_previous_block_id, (header.previous)(_head_id) );
+      if( header.timestamp.sec_since_epoch() % BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC != 0 )
+         FC_CAPTURE_AND_THROW( invalid_block_time, (header.timestamp) );
+      if( header.block_num > 1 && header.timestamp <= _head.timestamp )
+         FC_CAPTURE_AND_THROW( time_in_past, (header.timestamp)(_head.timestamp) );
+      const fc::time_point_sec now = bts::blockchain::now();
+      if( header.timestamp > now + BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC * 2 )
+         FC_CAPTURE_AND_THROW( time_in_future, (header.timestamp)(now) );
+
+      FC_ASSERT( round_signees.size() == BTS_BLOCKCHAIN_NUM_DELEGATES );
+      const public_key_type& expected_signee = round_signees[ get_slot_number( header.timestamp ) % BTS_BLOCKCHAIN_NUM_DELEGATES ];
+      const bool enforce_canonical = header.block_num > BTS_CHECK_CANONICAL_SIGNATURE_FORK_BLOCK_NUM;
+      if( !header.validate_signee( expected_signee, enforce_canonical ) )
+         FC_CAPTURE_AND_THROW( invalid_delegate_signee, (expected_signee) );
+
+      _headers.store( header.block_num, header );
+      _head = header;
+      _head_id = header.id();
+   } FC_CAPTURE_AND_RETHROW( (header) ) }
+
+   void light_header_chain::pop_header()
+   { try {
+      FC_ASSERT( _head.block_num > 0, "No headers to pop" );
+      _headers.remove( _head.block_num );
+
+      const uint32_t block_num = _head.block_num - 1;
+      _head = signed_block_header();
+      _head_id = block_id_type();
+      if( block_num > 0 )
+      {
+         _head = _headers.fetch( block_num );
+         _head_id = _head.id();
+      }
+   } FC_CAPTURE_AND_RETHROW() }
+
+   void light_header_chain::verify_transaction_ids( uint32_t block_num, std::vector<transaction_id_type> trx_ids )const
+   { try {
+      const auto header = get_header( block_num );
+      if( !header.valid() )
+         FC_CAPTURE_AND_THROW( unknown_block, (block_num) );
+
+      digest_block digest_data( *header );
+      digest_data.user_transaction_ids = std::move( trx_ids );
+      if( !digest_data.validate_digest() )
+         FC_CAPTURE_AND_THROW( invalid_block_digest, (block_num) );
+   } FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
+} } // bts::blockchain
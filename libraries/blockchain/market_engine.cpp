@@ -5,8 +5,191 @@
 
 namespace bts { namespace blockchain { namespace detail {
 
-  market_engine::market_engine( pending_chain_state_ptr ps, chain_database_impl& cdi )
-  :_pending_state(ps),_db_impl(cdi)
+  fc::time_point_sec locked_pending_state::now()const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::now();
+  }
+
+  uint32_t locked_pending_state::get_head_block_num()const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_head_block_num();
+  }
+
+  fc::ripemd160 locked_pending_state::get_current_random_seed()const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_current_random_seed();
+  }
+
+  vector<account_id_type> locked_pending_state::get_active_delegates()const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_active_delegates();
+  }
+
+  bool locked_pending_state::is_active_delegate( const account_id_type& id )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::is_active_delegate( id );
+  }
+
+  ofeed_record locked_pending_state::get_feed( const feed_index& i )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_feed( i );
+  }
+
+  oprice locked_pending_state::get_median_delegate_price( const asset_id_type& asset_id, const asset_id_type& base_id )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_median_delegate_price( asset_id, base_id );
+  }
+
+  oburn_record locked_pending_state::fetch_burn_record( const burn_record_key& key )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::fetch_burn_record( key );
+  }
+
+  oasset_record locked_pending_state::get_asset_record( const asset_id_type& id )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_asset_record( id );
+  }
+
+  oasset_record locked_pending_state::get_asset_record_for_totals( const asset_id_type& id )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_asset_record_for_totals( id );
+  }
+
+  oasset_record locked_pending_state::get_asset_record( const string& symbol )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_asset_record( symbol );
+  }
+
+  obalance_record locked_pending_state::get_balance_record( const balance_id_type& id )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_balance_record( id );
+  }
+
+  oaccount_record locked_pending_state::get_account_record( const account_id_type& id )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_account_record( id );
+  }
+
+  const account_record* locked_pending_state::lookup_account_record( const account_id_type& id )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      const account_record* record = pending_chain_state::lookup_account_record( id );
+      if( record == nullptr || accounts.count( id ) )
+          return record;
+      return &( _fetched_accounts[ id ] = *record );
+  }
+
+  oaccount_record locked_pending_state::get_account_record( const address& owner )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_account_record( owner );
+  }
+
+  oaccount_record locked_pending_state::get_account_record( const string& name )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_account_record( name );
+  }
+
+  odelegate_slate locked_pending_state::get_delegate_slate( slate_id_type id )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_delegate_slate( id );
+  }
+
+  bool locked_pending_state::is_known_transaction( fc::time_point_sec exp, const digest_type& trx_id )
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::is_known_transaction( exp, trx_id );
+  }
+
+  otransaction_record locked_pending_state::get_transaction( const transaction_id_type& trx_id, bool exact )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_transaction( trx_id, exact );
+  }
+
+  omarket_status locked_pending_state::get_market_status( const asset_id_type& quote_id, const asset_id_type& base_id )
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_market_status( quote_id, base_id );
+  }
+
+  omarket_order locked_pending_state::get_lowest_ask_record( const asset_id_type& quote_id, const asset_id_type& base_id )
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_lowest_ask_record( quote_id, base_id );
+  }
+
+  oorder_record locked_pending_state::get_bid_record( const market_index_key& key )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_bid_record( key );
+  }
+
+  oorder_record locked_pending_state::get_ask_record( const market_index_key& key )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_ask_record( key );
+  }
+
+  oorder_record locked_pending_state::get_short_record( const market_index_key& key )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_short_record( key );
+  }
+
+  ocollateral_record locked_pending_state::get_collateral_record( const market_index_key& key )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_collateral_record( key );
+  }
+
+  vector<operation> locked_pending_state::get_recent_operations( operation_type_enum t )
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_recent_operations( t );
+  }
+
+  variant locked_pending_state::get_property( chain_property_enum property_id )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_property( property_id );
+  }
+
+  oslot_record locked_pending_state::get_slot_record( const time_point_sec& start_time )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_slot_record( start_time );
+  }
+
+  omarket_history_record locked_pending_state::get_market_history_record( const market_history_key& key )const
+  {
+      std::lock_guard<std::recursive_mutex> guard( _chain_lock );
+      return pending_chain_state::get_market_history_record( key );
+  }
+
+  /** a lock on chain_lock, or an empty one when there is none */
+  static std::unique_lock<std::recursive_mutex> lock_chain( std::recursive_mutex* chain_lock )
+  {
+      return chain_lock ? std::unique_lock<std::recursive_mutex>( *chain_lock ) : std::unique_lock<std::recursive_mutex>();
+  }
+
+  market_engine::market_engine( pending_chain_state_ptr ps, chain_database_impl& cdi, std::recursive_mutex* chain_lock )
+  :_pending_state(ps),_db_impl(cdi),_chain_lock(chain_lock)
   {
       _pending_state = std::make_shared<pending_chain_state>( ps );
       _prior_state = ps;
@@ -39,38 +222,26 @@ namespace bts { namespace blockchain { namespace detail {
           _quote_id = quote_id;
           _base_id = base_id;
 
-          oasset_record quote_asset = _pending_state->get_asset_record( _quote_id );
-          oasset_record base_asset = _pending_state->get_asset_record( _base_id );
+          oasset_record quote_asset = _pending_state->get_asset_record_for_totals( _quote_id );
+          oasset_record base_asset = _pending_state->get_asset_record_for_totals( _base_id );
           FC_ASSERT( quote_asset.valid() && base_asset.valid() );
 
-          // The order book is sorted from low to high price. So to get the last item (highest bid),
-          // we need to go to the first item in the next market class and then back up one
-          const price next_pair = (base_id+1 == quote_id) ? price( 0, quote_id+1, 0 ) : price( 0, quote_id, base_id+1 );
-          _bid_itr        = _db_impl._bid_db.lower_bound( market_index_key( next_pair ) );
-          _ask_itr        = _db_impl._ask_db.lower_bound( market_index_key( price( 0, quote_id, base_id) ) );
-          _short_itr      = _db_impl._short_db.lower_bound( market_index_key( next_pair ) );
-          _collateral_itr = _db_impl._collateral_db.lower_bound( market_index_key( next_pair ) );
+          // The books are sorted from low to high price, bids are matched from the highest one down
+          _book            = _book_override ? _book_override : &_db_impl.get_order_book( quote_id, base_id );
+          _bids_left       = _book->bids.size();
+          _next_ask        = 0;
+          _shorts_left     = _book->shorts.size();
+          _collateral_left = _book->collateral.size();
 
           int last_orders_filled = -1;
           asset trading_volume(0, base_id);
           price opening_price, closing_price;
 
-          if( !_ask_itr.valid() )
           {
-            wlog( "ask iter invalid..." );
-            _ask_itr = _db_impl._ask_db.begin();
+              const auto guard = lock_chain( _chain_lock );
+              _feed_price = _db_impl.self->get_median_delegate_price( _quote_id, _base_id );
           }
-
-          if( _bid_itr.valid() )   --_bid_itr;
-          else _bid_itr = _db_impl._bid_db.last();
-
-          if( _collateral_itr.valid() )   --_collateral_itr;
-          else _collateral_itr = _db_impl._collateral_db.last();
-
-          if( _short_itr.valid() )   --_short_itr;
-          else _short_itr = _db_impl._short_db.last();
-
-          _feed_price = _db_impl.self->get_median_delegate_price( _quote_id, _base_id );
+          _first_margin_call = _feed_price.valid() ? _book->first_margin_call( *_feed_price ) : _book->collateral.size();
           // Market issued assets cannot match until the first time there is a median feed
           if( quote_asset->is_market_issued() )
           {
@@ -79,6 +250,14 @@ namespace bts { namespace blockchain { namespace detail {
                   FC_CAPTURE_AND_THROW( insufficient_feeds, (quote_id) );
           }
 
+          // nothing can match, so the orders and fees are left alone and no history is written
+          if( !book_crosses() )
+          {
+              store_market_status();
+              _pending_state->apply_changes();
+              return true;
+          }
+
           // prime the pump, to make sure that margin calls (asks) have a bid to check against.
           get_next_bid(); get_next_ask();
           idump( (_current_bid)(_current_ask) );
@@ -276,15 +455,8 @@ namespace bts { namespace blockchain { namespace detail {
           _pending_state->store_asset_record( *base_asset );
 
           // Update market status and market history
-          {
-              omarket_status market_stat = _pending_state->get_market_status( _quote_id, _base_id );
-              if( !market_stat.valid() ) market_stat = market_status( _quote_id, _base_id );
-              market_stat->update_feed_price( _feed_price );
-              market_stat->last_error.reset();
-              _pending_state->store_market_status( *market_stat );
-
-              update_market_history( trading_volume, opening_price, closing_price, timestamp );
-          }
+          store_market_status();
+          update_market_history( trading_volume, opening_price, closing_price, timestamp );
 
           wlog( "done matching orders" );
           idump( (_current_bid)(_current_ask) );
@@ -304,6 +476,54 @@ namespace bts { namespace blockchain { namespace detail {
     return false;
   } // execute(...)
 
+  bool market_engine::orders_cross( asset_id_type quote_id, asset_id_type base_id )
+  { try {
+      _book = _book_override ? _book_override : &_db_impl.get_order_book( quote_id, base_id );
+      {
+          const auto guard = lock_chain( _chain_lock );
+          _feed_price = _db_impl.self->get_median_delegate_price( quote_id, base_id );
+      }
+      _first_margin_call = _feed_price.valid() ? _book->first_margin_call( *_feed_price ) : _book->collateral.size();
+      return book_crosses();
+  } FC_CAPTURE_AND_RETHROW( (quote_id)(base_id) ) }
+
+  /**
+   *  Follows the first pass of the matching loop in execute: without a bid nothing happens, a due
+   *  margin call or expired cover is always taken, and otherwise the highest bid meets the lowest ask.
+   *  Shorts are matched at prices the feed decides, so any market holding one is left to execute.
+   */
+  bool market_engine::book_crosses()const
+  {
+      if( _book->bids.empty() && _book->shorts.empty() )
+          return false;
+
+      if( !_book->collateral.empty() )
+      {
+          if( _first_margin_call < _book->collateral.size() )
+              return true;
+          if( ( _book->collateral.end() - 1 )->second.expiration <= _pending_state->now() )
+              return true;
+      }
+
+      if( _book->asks.empty() )
+          return false;
+      if( !_book->shorts.empty() )
+          return true;
+
+      const price& highest_bid = ( _book->bids.end() - 1 )->first.order_price;
+      const price& lowest_ask = _book->asks.begin()->first.order_price;
+      return !( highest_bid < lowest_ask );
+  }
+
+  void market_engine::store_market_status()
+  {
+      omarket_status market_stat = _pending_state->get_market_status( _quote_id, _base_id );
+      if( !market_stat.valid() ) market_stat = market_status( _quote_id, _base_id );
+      market_stat->update_feed_price( _feed_price );
+      market_stat->last_error.reset();
+      _pending_state->store_market_status( *market_stat );
+  }
+
   void market_engine::push_market_transaction( const market_transaction& mtrx )
   { try {
       // If not an automatic market cancel
@@ -556,20 +776,15 @@ namespace bts { namespace blockchain { namespace detail {
 
   bool market_engine::get_next_short()
   {
-      if( _short_itr.valid() )
+      if( _shorts_left > 0 )
       {
-        auto bid = market_order( short_order,
-                                 _short_itr.key(),
-                                 _short_itr.value(),
-                                 _short_itr.value().balance,
-                                 _short_itr.key().order_price );
-        if( bid.get_price().quote_asset_id == _quote_id &&
-            bid.get_price().base_asset_id == _base_id )
-        {
-            --_short_itr;
-            _current_bid = bid;
-            return _current_bid.valid();
-        }
+        const auto& item = *( _book->shorts.begin() + --_shorts_left );
+        _current_bid = market_order( short_order,
+                                     item.first,
+                                     item.second,
+                                     item.second.balance,
+                                     item.first.order_price );
+        return _current_bid.valid();
       }
       return false;
   }
@@ -582,19 +797,17 @@ namespace bts { namespace blockchain { namespace detail {
       ++_orders_filled;
       _current_bid.reset();
 
-      if( _bid_itr.valid() )
+      if( _bids_left > 0 )
       {
-        auto bid = market_order( bid_order, _bid_itr.key(), _bid_itr.value() );
-        if( bid.get_price().quote_asset_id == _quote_id &&
-            bid.get_price().base_asset_id == _base_id )
-        {
-            if( _feed_price.valid() && bid.get_price() < *_feed_price && get_next_short() )
-                return _current_bid.valid();
+        const auto& item = *( _book->bids.begin() + ( _bids_left - 1 ) );
+        auto bid = market_order( bid_order, item.first, item.second );
 
-            _current_bid = bid;
-            --_bid_itr;
+        if( _feed_price.valid() && bid.get_price() < *_feed_price && get_next_short() )
             return _current_bid.valid();
-        }
+
+        _current_bid = bid;
+        --_bids_left;
+        return _current_bid.valid();
       }
       get_next_short();
       return _current_bid.valid();
@@ -611,41 +824,33 @@ namespace bts { namespace blockchain { namespace detail {
       /**
       *  Margin calls take priority over all other ask orders
       */
-      while( _current_bid && _collateral_itr.valid() )
+      while( _current_bid && _collateral_left > 0 )
       {
-        const auto cover_ask = market_order( cover_order,
-                                             _collateral_itr.key(),
-                                             order_record(_collateral_itr.value().payoff_balance),
-                                             _collateral_itr.value().collateral_balance,
-                                             _collateral_itr.value().interest_rate,
-                                             _collateral_itr.value().expiration);
-
-        if( cover_ask.get_price().quote_asset_id == _quote_id &&
-            cover_ask.get_price().base_asset_id == _base_id )
+        const size_t position = _collateral_left - 1;
+        const auto& item = *( _book->collateral.begin() + position );
+        _current_collat_record = item.second;
+        // Don't cover unless the price is below the feed price or margin position is expired
+        if( position >= _first_margin_call || _current_collat_record.expiration <= _pending_state->now() )
         {
-            _current_collat_record = _collateral_itr.value();
-            // Don't cover unless the price is below the feed price or margin position is expired
-            if( (_feed_price.valid() && cover_ask.get_price() > *_feed_price)
-                || _current_collat_record.expiration <= _pending_state->now() )
-            {
-                _current_ask = cover_ask;
-                --_collateral_itr;
-                return _current_ask.valid();
-            }
+            _current_ask = market_order( cover_order,
+                                         item.first,
+                                         order_record(item.second.payoff_balance),
+                                         item.second.collateral_balance,
+                                         item.second.interest_rate,
+                                         item.second.expiration);
+            --_collateral_left;
+            return _current_ask.valid();
         }
-        _collateral_itr.reset();
+        // margin calls are taken from the highest price down, so none of the others are due either
+        _collateral_left = 0;
         break;
       }
 
-      if( _ask_itr.valid() )
+      if( _next_ask < _book->asks.size() )
       {
-        const auto ask = market_order( ask_order, _ask_itr.key(), _ask_itr.value() );
-        if( ask.get_price().quote_asset_id == _quote_id &&
-            ask.get_price().base_asset_id == _base_id )
-        {
-            _current_ask = ask;
-        }
-        ++_ask_itr;
+        const auto& item = *( _book->asks.begin() + _next_ask );
+        _current_ask = market_order( ask_order, item.first, item.second );
+        ++_next_ask;
       }
       return _current_ask.valid();
   } FC_CAPTURE_AND_RETHROW() }
@@ -660,6 +865,7 @@ namespace bts { namespace blockchain { namespace detail {
                                              const price& closing_price,
                                              const fc::time_point_sec& timestamp )
   {
+          const auto guard = lock_chain( _chain_lock );
           if( trading_volume.amount > 0 && get_next_bid() && get_next_ask() )
           {
             market_history_key key(_quote_id, _base_id, market_history_key::each_block, _db_impl._head_block_header.timestamp);
@@ -725,18 +931,35 @@ namespace bts { namespace blockchain { namespace detail {
           }
   }
 
+  /**
+   *  The annual rate of apr, ( asset( BTS_BLOCKCHAIN_MAX_SHARES ) * apr ).amount / BTS_BLOCKCHAIN_MAX_SHARES.
+   *  That product rounds down MAX_SHARES * ratio / BTS_PRICE_PRECISION, and BTS_PRICE_PRECISION is
+   *  MAX_SHARES * 1000 (see asset.cpp), so it is exactly ratio / 1000 and needs no big integers. Only a
+   *  result beyond int64, where the big integer conversion has its own rules, takes the general path.
+   */
+  static fc::real128 annual_interest_rate( const price& apr )
+  {
+      static const fc::real128 max_shares( BTS_BLOCKCHAIN_MAX_SHARES );
+      const fc::uint128 scaled = apr.ratio / 1000;
+      if( scaled.high_bits() == 0 && scaled.low_bits() <= uint64_t( INT64_MAX ) )
+          return fc::real128( scaled.low_bits() ) / max_shares;
+      return fc::real128( (asset( BTS_BLOCKCHAIN_MAX_SHARES, apr.base_asset_id ) * apr).amount ) / max_shares;
+  }
+
+  static fc::real128 year_fraction( uint32_t age_seconds )
+  {
+      static const fc::real128 sec_per_year( 365 * 24 * 60 * 60 );
+      return fc::real128( age_seconds ) / sec_per_year;
+  }
+
   asset market_engine::get_interest_paid(const asset& total_amount_paid, const price& apr, uint32_t age_seconds)
   {
       // TOTAL_PAID = DELTA_PRINCIPLE + DELTA_PRINCIPLE * APR * PERCENT_OF_YEAR
       // DELTA_PRINCIPLE = TOTAL_PAID / (1 + APR*PERCENT_OF_YEAR)
       // INTEREST_PAID  = TOTAL_PAID - DELTA_PRINCIPLE
       fc::real128 total_paid( total_amount_paid.amount );
-      fc::real128 apr_n( (asset( BTS_BLOCKCHAIN_MAX_SHARES, apr.base_asset_id ) * apr).amount );
-      fc::real128 apr_d( (asset( BTS_BLOCKCHAIN_MAX_SHARES, apr.base_asset_id ) ).amount );
-      fc::real128 iapr = apr_n / apr_d;
-      fc::real128 age_sec(age_seconds);
-      fc::real128 sec_per_year(365 * 24 * 60 * 60);
-      fc::real128 percent_of_year = age_sec / sec_per_year;
+      fc::real128 iapr = annual_interest_rate( apr );
+      fc::real128 percent_of_year = year_fraction( age_seconds );
 
       fc::real128 delta_principle = total_paid / ( fc::real128(1) + iapr * percent_of_year );
       fc::real128 interest_paid   = total_paid - delta_principle;
@@ -748,12 +971,8 @@ namespace bts { namespace blockchain { namespace detail {
   {
       // INTEREST_OWED = TOTAL_PRINCIPLE * APR * PERCENT_OF_YEAR
       fc::real128 total_principle( principle.amount );
-      fc::real128 apr_n( (asset( BTS_BLOCKCHAIN_MAX_SHARES, apr.base_asset_id ) * apr).amount );
-      fc::real128 apr_d( (asset( BTS_BLOCKCHAIN_MAX_SHARES, apr.base_asset_id ) ).amount );
-      fc::real128 iapr = apr_n / apr_d;
-      fc::real128 age_sec(age_seconds);
-      fc::real128 sec_per_year(365 * 24 * 60 * 60);
-      fc::real128 percent_of_year = age_sec / sec_per_year;
+      fc::real128 iapr = annual_interest_rate( apr );
+      fc::real128 percent_of_year = year_fraction( age_seconds );
 
       fc::real128 interest_owed   = total_principle * iapr * percent_of_year;
 
@@ -0,0 +1,175 @@
+#include <bts/blockchain/name_prefix_index.hpp>
+
+#include <algorithm>
+
+namespace bts { namespace blockchain {
+
+   name_prefix_index::name_prefix_index()
+   :_size( 0 )
+   {
+   }
+
+   name_prefix_index::~name_prefix_index()
+   {
+   }
+
+   void name_prefix_index::clear()
+   {
+      _root.children.clear();
+      _root.has_id = false;
+      _size = 0;
+   }
+
+   template<typename Node>
+   auto name_prefix_index::find_child( Node& parent, char first ) -> decltype( parent.children.begin() )
+   {
+      return std::lower_bound( parent.children.begin(), parent.children.end(), first,
+                               []( const std::unique_ptr<node>& child, char c )
+                               { return static_cast<unsigned char>( child->label[ 0 ] ) < static_cast<unsigned char>( c ); } );
+   }
+
+   void name_prefix_index::insert( const std::string& name, int32_t id )
+   {
+      if( name.empty() )
+         return;
+
+      node* current = &_root;
+      size_t pos = 0;
+      while( pos < name.size() )
+      {
+         auto itr = find_child( *current, name[ pos ] );
+         if( itr == current->children.end() || (*itr)->label[ 0 ] != name[ pos ] )
+         {
+            std::unique_ptr<node> leaf( new node );
+            leaf->label = name.substr( pos );
+            leaf->has_id = true;
+            leaf->id = id;
+            current->children.insert( itr, std::move( leaf ) );
+            ++_size;
+            return;
+         }
+
+         node& child = **itr;
+         size_t common = 0;
+         while( common < child.label.size() && pos + common < name.size() && child.label[ common ] == name[ pos + common ] )
+            ++common;
+         if( common < child.label.size() )
+         {
+            /* the name leaves this edge part way along, so the edge is split where it does */
+            std::unique_ptr<node> middle( new node );
+            middle->label = child.label.substr( 0, common );
+            child.label.erase( 0, common );
+            middle->children.push_back( std::move( *itr ) );
+            *itr = std::move( middle );
+         }
+         current = itr->get();
+         pos += common;
+      }
+
+      if( !current->has_id )
+         ++_size;
+      current->has_id = true;
+      current->id = id;
+   }
+
+   void name_prefix_index::remove( const std::string& name )
+   {
+      node* parent = nullptr;
+      node* current = &_root;
+      size_t pos = 0;
+      while( pos < name.size() )
+      {
+         auto itr = find_child( *current, name[ pos ] );
+         if( itr == current->children.end() )
+            return;
+         node& child = **itr;
+         if( name.compare( pos, child.label.size(), child.label ) != 0 )
+            return;
+         parent = current;
+         current = &child;
+         pos += child.label.size();
+      }
+      if( !current->has_id )
+         return;
+
+      current->has_id = false;
+      --_size;
+
+      /* a node left with no id keeps the tree compact: it goes if it has no children, and is merged
+         into its child if it has one */
+      if( current->children.empty() )
+      {
+         parent->children.erase( find_child( *parent, current->label[ 0 ] ) );
+         if( parent != &_root && !parent->has_id && parent->children.size() == 1 )
+            merge_with_only_child( *parent );
+      }
+      else if( current->children.size() == 1 )
+      {
+         merge_with_only_child( *current );
+      }
+   }
+
+   void name_prefix_index::merge_with_only_child( node& n )
+   {
+      std::unique_ptr<node> child = std::move( n.children.front() );
+      n.label += child->label;
+      n.has_id = child->has_id;
+      n.id = child->id;
+      n.children = std::move( child->children );
+   }
+
+   std::vector<std::pair<std::string, int32_t>> name_prefix_index::find_prefix( const std::string& prefix, uint32_t limit )const
+   {
+      std::vector<std::pair<std::string, int32_t>> results;
+      if( limit == 0 )
+         return results;
+
+      const node* current = &_root;
+      std::string name;
+      size_t pos = 0;
+      while( pos < prefix.size() )
+      {
+         auto itr = find_child( *current, prefix[ pos ] );
+         if( itr == current->children.end() || (*itr)->label[ 0 ] != prefix[ pos ] )
+            return results;
+
+         const node& child = **itr;
+         const size_t remaining = prefix.size() - pos;
+         if( remaining <= child.label.size() )
+         {
+            /* the prefix ends on this edge: every name below it matches if the edge starts with the rest */
+            if( child.label.compare( 0, remaining, prefix, pos, remaining ) != 0 )
+               return results;
+            name += child.label;
+            collect( child, name, limit, results );
+            return results;
+         }
+         if( prefix.compare( pos, child.label.size(), child.label ) != 0 )
+            return results;
+         name += child.label;
+         pos += child.label.size();
+         current = &child;
+      }
+
+      collect( *current, name, limit, results );
+      return results;
+   }
+
+   void name_prefix_index::collect( const node& n, std::string& name, uint32_t limit,
+                                    std::vector<std::pair<std::string, int32_t>>& results )
+   {
+      if( results.size() >= limit )
+         return;
+      if( n.has_id )
+         results.emplace_back( name, n.id );
+      for( const auto& child : n.children )
+      {
+         if( results.size() >= limit )
+            return;
+         name += child->label;
+         collect( *child, name, limit, results );
+         name.resize( name.size() - child->label.size() );
+      }
+   }
+
+} } // bts::blockchain
@@ -92,9 +92,9 @@ namespace bts { namespace blockchain {
 
    void operation_factory::to_variant( const bts::blockchain::operation& in, fc::variant& output )
    { try {
-      auto converter_itr = _converters.find( in.type.value );
-      FC_ASSERT( converter_itr != _converters.end() );
-      converter_itr->second->to_variant( in, output );
+      const auto& converter = _converters[ in.type.value ];
+      FC_ASSERT( converter );
+      converter->to_variant( in, output );
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
    void operation_factory::from_variant( const fc::variant& in, bts::blockchain::operation& output )
@@ -102,9 +102,9 @@ namespace bts { namespace blockchain {
       auto obj = in.get_object();
       output.type = obj["type"].as<operation_type_enum>();
 
-      auto converter_itr = _converters.find( output.type.value );
-      FC_ASSERT( converter_itr != _converters.end() );
-      converter_itr->second->from_variant( in, output );
+      const auto& converter = _converters[ output.type.value ];
+      FC_ASSERT( converter );
+      converter->from_variant( in, output );
    } FC_RETHROW_EXCEPTIONS( warn, "", ("in",in) ) }
 
 #ifndef PTS_SUPPRESS_ASSETS
@@ -2,8 +2,61 @@
 
 #include <bts/blockchain/fork_blocks.hpp>
 
+#include <algorithm>
+
 namespace bts { namespace blockchain {
 
+   template<typename Set>
+   static bool sets_intersect( const Set& a, const Set& b )
+   {
+      if( a.size() > b.size() ) return sets_intersect( b, a );
+      for( const auto& item : a )
+         if( b.count( item ) ) return true;
+      return false;
+   }
+
+   bool state_access_set::intersects( const state_access_set& other )const
+   {
+      if( untracked || other.untracked ) return true;
+      return overlaps( other );
+   }
+
+   bool state_access_set::overlaps( const state_access_set& other )const
+   {
+      if( median_prices && other.median_prices ) return true;
+      return sets_intersect( balances, other.balances )
+          || sets_intersect( accounts, other.accounts )
+          || sets_intersect( account_names, other.account_names )
+          || sets_intersect( account_addresses, other.account_addresses )
+          || sets_intersect( assets, other.assets )
+          || sets_intersect( asset_totals, other.assets )
+          || sets_intersect( assets, other.asset_totals )
+          || sets_intersect( asset_symbols, other.asset_symbols )
+          || sets_intersect( slates, other.slates )
+          || sets_intersect( orders, other.orders )
+          || sets_intersect( feeds, other.feeds )
+          || sets_intersect( properties, other.properties )
+          || sets_intersect( markets, other.markets );
+   }
+
+   void state_access_set::insert( const state_access_set& other )
+   {
+      untracked     |= other.untracked;
+      median_prices |= other.median_prices;
+      balances.insert( other.balances.begin(), other.balances.end() );
+      accounts.insert( other.accounts.begin(), other.accounts.end() );
+      account_names.insert( other.account_names.begin(), other.account_names.end() );
+      account_addresses.insert( other.account_addresses.begin(), other.account_addresses.end() );
+      assets.insert( other.assets.begin(), other.assets.end() );
+      asset_totals.insert( other.asset_totals.begin(), other.asset_totals.end() );
+      asset_symbols.insert( other.asset_symbols.begin(), other.asset_symbols.end() );
+      slates.insert( other.slates.begin(), other.slates.end() );
+      orders.insert( other.orders.begin(), other.orders.end() );
+      feeds.insert( other.feeds.begin(), other.feeds.end() );
+      properties.insert( other.properties.begin(), other.properties.end() );
+      markets.insert( other.markets.begin(), other.markets.end() );
+   }
+
    pending_chain_state::pending_chain_state( chain_interface_ptr prev_state )
    :_prev_state( prev_state )
    {
@@ -24,6 +77,34 @@ namespace bts { namespace blockchain {
       _prev_state = prev_state;
    }
 
+   void pending_chain_state::clear()
+   {
+      market_transactions.clear();
+      assets.clear();
+      slates.clear();
+      accounts.clear();
+      balances.clear();
+      account_id_index.clear();
+      symbol_id_index.clear();
+      transactions.clear();
+      unique_transactions.clear();
+      properties.clear();
+      key_to_account.clear();
+      bids.clear();
+      asks.clear();
+      shorts.clear();
+      collateral.clear();
+      slots.clear();
+      market_history.clear();
+      market_statuses.clear();
+      recent_operations.clear();
+      feeds.clear();
+      burns.clear();
+      _dirty_markets.clear();
+      _reads.reset();
+      _prior.reset();
+   }
+
    uint32_t pending_chain_state::get_head_block_num()const
    {
       const chain_interface_ptr prev_state = _prev_state.lock();
@@ -45,6 +126,30 @@ namespace bts { namespace blockchain {
       return prev_state->get_current_random_seed();
    }
 
+   vector<account_id_type> pending_chain_state::get_active_delegates()const
+   { try {
+      if( _reads ) _reads->properties.insert( active_delegate_list_id );
+      const auto property_itr = properties.find( active_delegate_list_id );
+      if( property_itr != properties.end() ) return property_itr->second.as<vector<account_id_type>>();
+      const chain_interface_ptr prev_state = _prev_state.lock();
+      FC_ASSERT( prev_state );
+      return prev_state->get_active_delegates();
+   } FC_CAPTURE_AND_RETHROW() }
+
+   bool pending_chain_state::is_active_delegate( const account_id_type& id )const
+   { try {
+      if( _reads ) _reads->properties.insert( active_delegate_list_id );
+      const auto property_itr = properties.find( active_delegate_list_id );
+      if( property_itr != properties.end() )
+      {
+         const auto active = property_itr->second.as<vector<account_id_type>>();
+         return active.end() != std::find( active.begin(), active.end(), id );
+      }
+      const chain_interface_ptr prev_state = _prev_state.lock();
+      FC_ASSERT( prev_state );
+      return prev_state->is_active_delegate( id );
+   } FC_CAPTURE_AND_RETHROW( (id) ) }
+
    /**
     *  Based upon the current state of the database, calculate any updates that
     *  should be executed in a deterministic manner.
@@ -63,15 +168,15 @@ namespace bts { namespace blockchain {
       for( const auto& item : properties )      prev_state->set_property( (chain_property_enum)item.first, item.second );
       for( const auto& item : assets )          prev_state->store_asset_record( item.second );
       for( const auto& item : accounts )        prev_state->store_account_record( item.second );
-      for( const auto& item : balances )        prev_state->store_balance_record( item.second );
+      prev_state->store_balance_records( balances );
 #if 0
       for( const auto& item : proposals )       prev_state->store_proposal_record( item.second );
       for( const auto& item : proposal_votes )  prev_state->store_proposal_vote( item.second );
 #endif
-      for( const auto& item : bids )            prev_state->store_bid_record( item.first, item.second );
-      for( const auto& item : asks )            prev_state->store_ask_record( item.first, item.second );
-      for( const auto& item : shorts )          prev_state->store_short_record( item.first, item.second );
-      for( const auto& item : collateral )      prev_state->store_collateral_record( item.first, item.second );
+      prev_state->store_order_records( bid_order, bids );
+      prev_state->store_order_records( ask_order, asks );
+      prev_state->store_order_records( short_order, shorts );
+      prev_state->store_collateral_records( collateral );
       for( const auto& item : transactions )    prev_state->store_transaction( item.first, item.second );
       for( const auto& item : slates )          prev_state->store_delegate_slate( item.first, item.second );
       for( const auto& item : slots )           prev_state->store_slot_record( item.second );
@@ -87,9 +192,31 @@ namespace bts { namespace blockchain {
       prev_state->set_dirty_markets( _dirty_markets );
    }
 
+   /** the names and addresses come from the indexes store_account_record and store_asset_record maintain */
+   void pending_chain_state::collect_writes( state_access_set& writes )const
+   {
+      for( const auto& item : properties )       writes.properties.insert( item.first );
+      for( const auto& item : assets )           writes.assets.insert( item.first );
+      for( const auto& item : symbol_id_index )  writes.asset_symbols.insert( item.first );
+      for( const auto& item : slates )           writes.slates.insert( item.first );
+      for( const auto& item : accounts )         writes.accounts.insert( item.first );
+      for( const auto& item : account_id_index ) writes.account_names.insert( item.first );
+      for( const auto& item : key_to_account )   writes.account_addresses.insert( item.first );
+      for( const auto& item : balances )         writes.balances.insert( item.first );
+      for( const auto& item : bids )             writes.orders.insert( item.first );
+      for( const auto& item : asks )             writes.orders.insert( item.first );
+      for( const auto& item : shorts )           writes.orders.insert( item.first );
+      for( const auto& item : collateral )       writes.orders.insert( item.first );
+      for( const auto& item : feeds )            writes.feeds.insert( item.first );
+      for( const auto& item : market_statuses )  writes.markets.insert( item.first );
+      if( !feeds.empty() || properties.count( active_delegate_list_id ) )
+         writes.median_prices = true;
+   }
+
    otransaction_record pending_chain_state::get_transaction( const transaction_id_type& trx_id,
                                                               bool exact  )const
    {
+      if( _reads ) _reads->untracked = true;
       auto itr = transactions.find( trx_id );
       if( itr != transactions.end() ) return itr->second;
       chain_interface_ptr prev_state = _prev_state.lock();
@@ -124,6 +251,31 @@ namespace bts { namespace blockchain {
    void pending_chain_state::get_undo_state( const chain_interface_ptr& undo_state_arg )const
    {
       auto undo_state = std::dynamic_pointer_cast<pending_chain_state>( undo_state_arg );
+      FC_ASSERT( undo_state );
+      get_undo_state( *undo_state, nullptr );
+   }
+
+   void pending_chain_state::get_undo_state( undo_state_record& record )const
+   {
+      get_undo_state( record.prior, &record );
+   }
+
+   /** the value captured by capture_prior_values(), or else the one fetch returns */
+   template<typename Map, typename Fetch>
+   static typename Map::mapped_type prior_value( const Map* captured, const typename Map::key_type& key, Fetch fetch )
+   {
+      if( captured )
+      {
+         const auto itr = captured->find( key );
+         if( itr != captured->end() ) return itr->second;
+      }
+      return fetch();
+   }
+
+   /** when created is given, records without a prior value are noted there instead of as null placeholders */
+   void pending_chain_state::get_undo_state( pending_chain_state& undo_state_ref, undo_state_record* created )const
+   {
+      pending_chain_state* undo_state = &undo_state_ref;
       chain_interface_ptr prev_state = _prev_state.lock();
       FC_ASSERT( prev_state );
       for( const auto& item : properties )
@@ -133,20 +285,25 @@ namespace bts { namespace blockchain {
       }
       for( const auto& item : assets )
       {
-         auto prev_value = prev_state->get_asset_record( item.first );
+         auto prev_value = prior_value( _prior ? &_prior->assets : nullptr, item.first,
+                                        [&]{ return prev_state->get_asset_record( item.first ); } );
          if( !!prev_value ) undo_state->store_asset_record( *prev_value );
+         else if( created ) created->created_assets.push_back( item.first );
          else undo_state->store_asset_record( item.second.make_null() );
       }
       for( const auto& item : slates )
       {
          auto prev_value = prev_state->get_delegate_slate( item.first );
          if( prev_value ) undo_state->store_delegate_slate( item.first, *prev_value );
+         else if( created ) created->created_slates.push_back( item.first );
          else undo_state->store_delegate_slate( item.first, delegate_slate() );
       }
       for( const auto& item : accounts )
       {
-         auto prev_value = prev_state->get_account_record( item.first );
+         auto prev_value = prior_value( _prior ? &_prior->accounts : nullptr, item.first,
+                                        [&]{ return prev_state->get_account_record( item.first ); } );
          if( !!prev_value ) undo_state->store_account_record( *prev_value );
+         else if( created ) created->created_accounts.push_back( item.first );
          else undo_state->store_account_record( item.second.make_null() );
       }
 #if 0
@@ -165,44 +322,56 @@ namespace bts { namespace blockchain {
 #endif
       for( const auto& item : balances )
       {
-         auto prev_value = prev_state->get_balance_record( item.first );
+         auto prev_value = prior_value( _prior ? &_prior->balances : nullptr, item.first,
+                                        [&]{ return prev_state->get_balance_record( item.first ); } );
          if( !!prev_value ) undo_state->store_balance_record( *prev_value );
+         else if( created ) created->created_balances.push_back( item.first );
          else undo_state->store_balance_record( item.second.make_null() );
       }
       for( const auto& item : transactions )
       {
          auto prev_value = prev_state->get_transaction( item.first );
          if( !!prev_value ) undo_state->store_transaction( item.first, *prev_value );
+         else if( created ) created->created_transactions.push_back( item.first );
          else undo_state->store_transaction( item.first, transaction_record() );
       }
       for( const auto& item : bids )
       {
-         auto prev_value = prev_state->get_bid_record( item.first );
+         auto prev_value = prior_value( _prior ? &_prior->bids : nullptr, item.first,
+                                        [&]{ return prev_state->get_bid_record( item.first ); } );
          if( prev_value.valid() ) undo_state->store_bid_record( item.first, *prev_value );
-         else  undo_state->store_bid_record( item.first, order_record() );
+         else if( created ) created->created_bids.push_back( item.first );
+         else undo_state->store_bid_record( item.first, order_record() );
       }
       for( const auto& item : asks )
       {
-         auto prev_value = prev_state->get_ask_record( item.first );
+         auto prev_value = prior_value( _prior ? &_prior->asks : nullptr, item.first,
+                                        [&]{ return prev_state->get_ask_record( item.first ); } );
          if( prev_value.valid() ) undo_state->store_ask_record( item.first, *prev_value );
-         else  undo_state->store_ask_record( item.first, order_record() );
+         else if( created ) created->created_asks.push_back( item.first );
+         else undo_state->store_ask_record( item.first, order_record() );
       }
       for( const auto& item : shorts )
       {
-         auto prev_value = prev_state->get_short_record( item.first );
+         auto prev_value = prior_value( _prior ? &_prior->shorts : nullptr, item.first,
+                                        [&]{ return prev_state->get_short_record( item.first ); } );
          if( prev_value.valid() ) undo_state->store_short_record( item.first, *prev_value );
-         else  undo_state->store_short_record( item.first, order_record() );
+         else if( created ) created->created_shorts.push_back( item.first );
+         else undo_state->store_short_record( item.first, order_record() );
       }
       for( const auto& item : collateral )
       {
-         auto prev_value = prev_state->get_collateral_record( item.first );
+         auto prev_value = prior_value( _prior ? &_prior->collateral : nullptr, item.first,
+                                        [&]{ return prev_state->get_collateral_record( item.first ); } );
          if( prev_value.valid() ) undo_state->store_collateral_record( item.first, *prev_value );
-         else  undo_state->store_collateral_record( item.first, collateral_record() );
+         else if( created ) created->created_collateral.push_back( item.first );
+         else undo_state->store_collateral_record( item.first, collateral_record() );
       }
       for( const auto& item : slots )
       {
          auto prev_value = prev_state->get_slot_record( item.first );
          if( prev_value ) undo_state->store_slot_record( *prev_value );
+         else if( created ) created->created_slots.push_back( item.first );
          else
          {
              slot_record invalid_slot_record;
@@ -213,6 +382,7 @@ namespace bts { namespace blockchain {
       {
          auto prev_value = prev_state->get_market_status( item.first.first, item.first.second );
          if( prev_value ) undo_state->store_market_status( *prev_value );
+         else if( created ) created->created_market_statuses.push_back( item.first );
          else
          {
             undo_state->store_market_status( market_status() );
@@ -220,13 +390,16 @@ namespace bts { namespace blockchain {
       }
       for( const auto& item : feeds )
       {
-         auto prev_value = prev_state->get_feed( item.first );
+         auto prev_value = prior_value( _prior ? &_prior->feeds : nullptr, item.first,
+                                        [&]{ return prev_state->get_feed( item.first ); } );
          if( prev_value ) undo_state->set_feed( *prev_value );
+         else if( created ) created->created_feeds.push_back( item.first );
          else undo_state->set_feed( feed_record{item.first} );
       }
       for( const auto& item : burns )
       {
-         undo_state->store_burn_record( burn_record( item.first ) );
+         if( created ) created->created_burns.push_back( item.first );
+         else undo_state->store_burn_record( burn_record( item.first ) );
       }
 
       const auto dirty_markets = prev_state->get_dirty_markets();
@@ -235,6 +408,50 @@ namespace bts { namespace blockchain {
       /* NOTE: Recent operations are currently not rewound on undo */
    }
 
+   pending_chain_state_ptr undo_state_record::to_undo_state( const chain_interface_ptr& chain )const
+   { try {
+      pending_chain_state_ptr undo_state = std::make_shared<pending_chain_state>( prior );
+      undo_state->set_prev_state( chain );
+
+      for( const auto& id : created_assets )
+      {
+         const auto current = chain->get_asset_record( id );
+         if( current.valid() ) undo_state->store_asset_record( current->make_null() );
+      }
+      for( const auto& id : created_slates )
+         undo_state->store_delegate_slate( id, delegate_slate() );
+      for( const auto& id : created_accounts )
+      {
+         const auto current = chain->get_account_record( id );
+         if( current.valid() ) undo_state->store_account_record( current->make_null() );
+      }
+      for( const auto& id : created_balances )
+      {
+         const auto current = chain->get_balance_record( id );
+         if( current.valid() ) undo_state->store_balance_record( current->make_null() );
+      }
+      for( const auto& id : created_transactions )
+         undo_state->store_transaction( id, transaction_record() );
+      for( const auto& key : created_bids )
+         undo_state->store_bid_record( key, order_record() );
+      for( const auto& key : created_asks )
+         undo_state->store_ask_record( key, order_record() );
+      for( const auto& key : created_shorts )
+         undo_state->store_short_record( key, order_record() );
+      for( const auto& key : created_collateral )
+         undo_state->store_collateral_record( key, collateral_record() );
+      if( !created_slots.empty() )
+         undo_state->store_slot_record( slot_record() );
+      if( !created_market_statuses.empty() )
+         undo_state->store_market_status( market_status() );
+      for( const auto& index : created_feeds )
+         undo_state->set_feed( feed_record{index} );
+      for( const auto& key : created_burns )
+         undo_state->store_burn_record( burn_record( key ) );
+
+      return undo_state;
+   } FC_CAPTURE_AND_RETHROW() }
+
    /** load the state from a variant */
    void pending_chain_state::from_variant( const fc::variant& v )
    {
@@ -251,17 +468,39 @@ namespace bts { namespace blockchain {
 
    oasset_record pending_chain_state::get_asset_record( const asset_id_type& asset_id )const
    {
+      if( _reads ) _reads->assets.insert( asset_id );
+      chain_interface_ptr prev_state = _prev_state.lock();
+      auto itr = assets.find( asset_id );
+      if( itr != assets.end() )
+        return itr->second;
+      else if( prev_state )
+      {
+        auto result = prev_state->get_asset_record( asset_id );
+        if( _prior ) _prior->assets.emplace( asset_id, result );
+        return result;
+      }
+      return oasset_record();
+   }
+
+   oasset_record pending_chain_state::get_asset_record_for_totals( const asset_id_type& asset_id )const
+   {
+      if( _reads ) _reads->asset_totals.insert( asset_id );
       chain_interface_ptr prev_state = _prev_state.lock();
       auto itr = assets.find( asset_id );
       if( itr != assets.end() )
         return itr->second;
       else if( prev_state )
-        return prev_state->get_asset_record( asset_id );
+      {
+        auto result = prev_state->get_asset_record_for_totals( asset_id );
+        if( _prior ) _prior->assets.emplace( asset_id, result );
+        return result;
+      }
       return oasset_record();
    }
 
    oasset_record pending_chain_state::get_asset_record( const std::string& symbol )const
    {
+      if( _reads ) _reads->asset_symbols.insert( symbol );
       chain_interface_ptr prev_state = _prev_state.lock();
       auto itr = symbol_id_index.find( symbol );
       if( itr != symbol_id_index.end() )
@@ -273,17 +512,23 @@ namespace bts { namespace blockchain {
 
    obalance_record pending_chain_state::get_balance_record( const balance_id_type& balance_id )const
    {
+      if( _reads ) _reads->balances.insert( balance_id );
       chain_interface_ptr prev_state = _prev_state.lock();
       auto itr = balances.find( balance_id );
       if( itr != balances.end() )
         return itr->second;
       else if( prev_state )
-        return prev_state->get_balance_record( balance_id );
+      {
+        auto result = prev_state->get_balance_record( balance_id );
+        if( _prior ) _prior->balances.emplace( balance_id, result );
+        return result;
+      }
       return obalance_record();
    }
 
    odelegate_slate pending_chain_state::get_delegate_slate( slate_id_type id )const
    {
+      if( _reads ) _reads->slates.insert( id );
       chain_interface_ptr prev_state = _prev_state.lock();
       auto itr = slates.find(id);
       if( itr != slates.end() ) return itr->second;
@@ -298,6 +543,7 @@ namespace bts { namespace blockchain {
 
    oaccount_record pending_chain_state::get_account_record( const address& owner )const
    {
+      if( _reads ) _reads->account_addresses.insert( owner );
       auto itr = key_to_account.find(owner);
       if( itr != key_to_account.end() ) return get_account_record( itr->second );
       chain_interface_ptr prev_state = _prev_state.lock();
@@ -307,17 +553,29 @@ namespace bts { namespace blockchain {
 
    oaccount_record pending_chain_state::get_account_record( const account_id_type& account_id )const
    {
-      chain_interface_ptr prev_state = _prev_state.lock();
+      const account_record* record = lookup_account_record( account_id );
+      if( record != nullptr )
+        return *record;
+      return oaccount_record();
+   }
+
+   const account_record* pending_chain_state::lookup_account_record( const account_id_type& account_id )const
+   {
+      if( _reads ) _reads->accounts.insert( account_id );
       auto itr = accounts.find( account_id );
       if( itr != accounts.end() )
-        return itr->second;
-      else if( prev_state )
-        return prev_state->get_account_record( account_id );
-      return oaccount_record();
+        return &itr->second;
+      chain_interface_ptr prev_state = _prev_state.lock();
+      if( !prev_state )
+        return nullptr;
+      const account_record* result = prev_state->lookup_account_record( account_id );
+      if( _prior ) _prior->accounts.emplace( account_id, result != nullptr ? oaccount_record( *result ) : oaccount_record() );
+      return result;
    }
 
    oaccount_record pending_chain_state::get_account_record( const std::string& name )const
    {
+      if( _reads ) _reads->account_names.insert( name );
       chain_interface_ptr prev_state = _prev_state.lock();
       auto itr = account_id_index.find( name );
       if( itr != account_id_index.end() )
@@ -348,6 +606,7 @@ namespace bts { namespace blockchain {
 
    vector<operation> pending_chain_state::get_recent_operations(operation_type_enum t)
    {
+      if( _reads ) _reads->untracked = true;
       const auto& recent_op_queue = recent_operations[t];
       vector<operation> recent_ops(recent_op_queue.size());
       std::copy(recent_op_queue.begin(), recent_op_queue.end(), recent_ops.begin());
@@ -364,6 +623,7 @@ namespace bts { namespace blockchain {
 
    fc::variant pending_chain_state::get_property( chain_property_enum property_id )const
    {
+      if( _reads ) _reads->properties.insert( property_id );
       auto property_itr = properties.find( property_id );
       if( property_itr != properties.end()  ) return property_itr->second;
       chain_interface_ptr prev_state = _prev_state.lock();
@@ -409,15 +669,22 @@ namespace bts { namespace blockchain {
 
    oorder_record pending_chain_state::get_bid_record( const market_index_key& key )const
    {
+      if( _reads ) _reads->orders.insert( key );
       chain_interface_ptr prev_state = _prev_state.lock();
       auto rec_itr = bids.find( key );
       if( rec_itr != bids.end() ) return rec_itr->second;
-      else if( prev_state ) return prev_state->get_bid_record( key );
+      else if( prev_state )
+      {
+        auto result = prev_state->get_bid_record( key );
+        if( _prior ) _prior->bids.emplace( key, result );
+        return result;
+      }
       return oorder_record();
    }
 
    omarket_order pending_chain_state::get_lowest_ask_record( const asset_id_type& quote_id, const asset_id_type& base_id )
    {
+      if( _reads ) _reads->untracked = true;
       chain_interface_ptr prev_state = _prev_state.lock();
       omarket_order result;
       if( prev_state )
@@ -434,28 +701,46 @@ namespace bts { namespace blockchain {
 
    oorder_record pending_chain_state::get_ask_record( const market_index_key& key )const
    {
+      if( _reads ) _reads->orders.insert( key );
       chain_interface_ptr prev_state = _prev_state.lock();
       auto rec_itr = asks.find( key );
       if( rec_itr != asks.end() ) return rec_itr->second;
-      else if( prev_state ) return prev_state->get_ask_record( key );
+      else if( prev_state )
+      {
+        auto result = prev_state->get_ask_record( key );
+        if( _prior ) _prior->asks.emplace( key, result );
+        return result;
+      }
       return oorder_record();
    }
 
    oorder_record pending_chain_state::get_short_record( const market_index_key& key )const
    {
+      if( _reads ) _reads->orders.insert( key );
       chain_interface_ptr prev_state = _prev_state.lock();
       auto rec_itr = shorts.find( key );
       if( rec_itr != shorts.end() ) return rec_itr->second;
-      else if( prev_state ) return prev_state->get_short_record( key );
+      else if( prev_state )
+      {
+        auto result = prev_state->get_short_record( key );
+        if( _prior ) _prior->shorts.emplace( key, result );
+        return result;
+      }
       return oorder_record();
    }
 
    ocollateral_record pending_chain_state::get_collateral_record( const market_index_key& key )const
    {
+      if( _reads ) _reads->orders.insert( key );
       chain_interface_ptr prev_state = _prev_state.lock();
       auto rec_itr = collateral.find( key );
       if( rec_itr != collateral.end() ) return rec_itr->second;
-      else if( prev_state ) return prev_state->get_collateral_record( key );
+      else if( prev_state )
+      {
+        auto result = prev_state->get_collateral_record( key );
+        if( _prior ) _prior->collateral.emplace( key, result );
+        return result;
+      }
       return ocollateral_record();
    }
 
@@ -495,6 +780,7 @@ namespace bts { namespace blockchain {
 
    oslot_record pending_chain_state::get_slot_record( const time_point_sec& start_time )const
    {
+      if( _reads ) _reads->untracked = true;
       chain_interface_ptr prev_state = _prev_state.lock();
       auto itr = slots.find( start_time );
       if( itr != slots.end() ) return itr->second;
@@ -509,6 +795,7 @@ namespace bts { namespace blockchain {
 
    omarket_history_record pending_chain_state::get_market_history_record(const market_history_key& key) const
    {
+     if( _reads ) _reads->untracked = true;
      if( market_history.find(key) != market_history.end() )
        return market_history.find(key)->second;
      return omarket_history_record();
@@ -521,6 +808,7 @@ namespace bts { namespace blockchain {
 
    omarket_status pending_chain_state::get_market_status( const asset_id_type& quote_id, const asset_id_type& base_id )
    {
+      if( _reads ) _reads->markets.insert( std::make_pair( quote_id, base_id ) );
       auto itr = market_statuses.find( std::make_pair(quote_id,base_id) );
       if( itr != market_statuses.end() )
          return itr->second;
@@ -540,15 +828,19 @@ namespace bts { namespace blockchain {
 
    ofeed_record pending_chain_state::get_feed( const feed_index& i )const
    {
+      if( _reads ) _reads->feeds.insert( i );
       auto itr = feeds.find(i);
       if( itr != feeds.end() ) return itr->second;
 
       chain_interface_ptr prev_state = _prev_state.lock();
-      return prev_state->get_feed(i);
+      auto result = prev_state->get_feed(i);
+      if( _prior ) _prior->feeds.emplace( i, result );
+      return result;
    }
 
    oprice pending_chain_state::get_median_delegate_price( const asset_id_type& asset_id, const asset_id_type& base_id  )const
    {
+      if( _reads ) _reads->median_prices = true;
       chain_interface_ptr prev_state = _prev_state.lock();
       return prev_state->get_median_delegate_price( asset_id, base_id );
    }
@@ -560,6 +852,7 @@ namespace bts { namespace blockchain {
 
    oburn_record pending_chain_state::fetch_burn_record( const burn_record_key& key )const
    {
+      if( _reads ) _reads->untracked = true;
       auto itr = burns.find(key);
       if( itr == burns.end() )
       {
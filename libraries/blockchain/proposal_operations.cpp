@@ -6,12 +6,12 @@ namespace bts { namespace blockchain {
 
    void submit_proposal_operation::evaluate( transaction_evaluation_state& eval_state )
    { try {
-       auto delegate_record = eval_state._current_state->get_account_record( submitting_delegate_id );
+       const account_record* delegate_record = eval_state._current_state->lookup_account_record( submitting_delegate_id );
        if( !delegate_record ) 
           FC_CAPTURE_AND_THROW( unknown_account_id, (submitting_delegate_id) );
 
        if( !delegate_record->is_delegate() )
-          FC_CAPTURE_AND_THROW( not_a_delegate, (delegate_record) );
+          FC_CAPTURE_AND_THROW( not_a_delegate, (*delegate_record) );
 
        proposal_record new_proposal;
        new_proposal.id = eval_state._current_state->new_proposal_id();
@@ -1,4 +1,5 @@
 #include <bts/blockchain/exceptions.hpp>
+#include <bts/blockchain/hashing.hpp>
 #include <bts/blockchain/pts_address.hpp>
 
 #include <fc/crypto/base58.hpp>
@@ -27,22 +28,23 @@ namespace bts { namespace blockchain {
 
    pts_address::pts_address( const fc::ecc::public_key& pub, bool compressed, uint8_t version )
    {
+       const auto& engine = hash_engine::instance();
        fc::sha256 sha2;
        if( compressed )
        {
            auto dat = pub.serialize();
-           sha2     = fc::sha256::hash(dat.data, sizeof(dat) );
+           sha2     = engine.sha256(dat.data, sizeof(dat) );
        }
        else
        {
            auto dat = pub.serialize_ecc_point();
-           sha2     = fc::sha256::hash(dat.data, sizeof(dat) );
+           sha2     = engine.sha256(dat.data, sizeof(dat) );
        }
-       auto rep      = fc::ripemd160::hash((char*)&sha2,sizeof(sha2));
+       auto rep      = engine.ripemd160((char*)&sha2,sizeof(sha2));
        addr.data[0]  = version;
        memcpy( addr.data+1, (char*)&rep, sizeof(rep) );
-       auto check    = fc::sha256::hash( addr.data, sizeof(rep)+1 );
-       check = fc::sha256::hash(check); // double
+       auto check    = engine.sha256( addr.data, sizeof(rep)+1 );
+       check = engine.sha256( check.data(), sizeof(check) ); // double
        memcpy( addr.data+1+sizeof(rep), (char*)&check, 4 );
    }
 
@@ -53,8 +55,9 @@ namespace bts { namespace blockchain {
    bool pts_address::is_valid()const
    {
 //       if( addr.data[0]  != 56 ) return false;
-       auto check    = fc::sha256::hash( addr.data, sizeof(fc::ripemd160)+1 );
-       check = fc::sha256::hash(check); // double
+       const auto& engine = hash_engine::instance();
+       auto check    = engine.sha256( addr.data, sizeof(fc::ripemd160)+1 );
+       check = engine.sha256( check.data(), sizeof(check) ); // double
        return memcmp( addr.data+1+sizeof(fc::ripemd160), (char*)&check, 4 ) == 0;
    }
 
@@ -95,7 +98,7 @@ namespace bts { namespace blockchain {
        add( hasher, signature_magic( version ) );
        add( hasher, message );
        fc::sha256 single = hasher.result();
-       return fc::sha256::hash( single.data(), sizeof(single) );
+       return hash_engine::instance().sha256( single.data(), sizeof(single) );
    }
 
 } } // namespace bts
@@ -0,0 +1,92 @@
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/pts_address.hpp>
+#include <bts/blockchain/signature_cache.hpp>
+
+namespace bts { namespace blockchain {
+
+   const vector<address>& signature_cache::signer::legacy_addresses()const
+   {
+      std::call_once( _legacy_once, [this]()
+      {
+         _legacy_addresses.reserve( 6 );
+         _legacy_addresses.push_back( address( pts_address( key, false, 28 ) ) );
+         _legacy_addresses.push_back( address( pts_address( key, true, 28 ) ) );
+         _legacy_addresses.push_back( address( pts_address( key, false, 56 ) ) );
+         _legacy_addresses.push_back( address( pts_address( key, true, 56 ) ) );
+         _legacy_addresses.push_back( address( pts_address( key, false, 0 ) ) );
+         _legacy_addresses.push_back( address( pts_address( key, true, 0 ) ) );
+      } );
+      return _legacy_addresses;
+   }
+
+   signature_cache& signature_cache::instance()
+   {
+      static std::unique_ptr<signature_cache> inst( new signature_cache() );
+      return *inst;
+   }
+
+   signature_cache::signature_cache()
+   :_capacity( BTS_BLOCKCHAIN_SIGNATURE_CACHE_SIZE )
+   {
+   }
+
+   signature_cache::signer_ptr signature_cache::recover( const fc::ecc::compact_signature& sig,
+                                                         const digest_type& digest, bool enforce_canonical )
+   {
+      // the canonical check can reject a signature that recovers fine without it, so it is part of the key
+      std::string cache_key( digest.data(), digest.data_size() );
+      cache_key.append( (const char*)sig.data, sizeof( sig.data ) );
+      cache_key.push_back( enforce_canonical ? 1 : 0 );
+
+      {
+         std::lock_guard<std::mutex> lock( _mutex );
+         auto itr = _signers.find( cache_key );
+         if( itr != _signers.end() )
+            return itr->second;
+      }
+
+      // recover outside the lock so threads do not serialize on it
+      auto result = std::make_shared<signer>();
+      result->key = fc::ecc::public_key( sig, digest, enforce_canonical ).serialize();
+      result->native_address = address( result->key );
+
+      std::lock_guard<std::mutex> lock( _mutex );
+      if( _capacity == 0 )
+         return result;
+      if( _signers.emplace( cache_key, result ).second )
+      {
+         _insertion_order.push_back( std::move( cache_key ) );
+         while( _signers.size() > _capacity )
+         {
+            _signers.erase( _insertion_order.front() );
+            _insertion_order.pop_front();
+         }
+      }
+      return result;
+   }
+
+   void signature_cache::set_capacity( size_t capacity )
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _capacity = capacity;
+      while( _signers.size() > _capacity )
+      {
+         _signers.erase( _insertion_order.front() );
+         _insertion_order.pop_front();
+      }
+   }
+
+   size_t signature_cache::size()const
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      return _signers.size();
+   }
+
+   void signature_cache::clear()
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _signers.clear();
+      _insertion_order.clear();
+   }
+
+} } // bts::blockchain
@@ -3,6 +3,7 @@
 #include <bts/blockchain/balance_operations.hpp>
 #include <bts/blockchain/market_operations.hpp>
 #include <bts/blockchain/feed_operations.hpp>
+#include <bts/blockchain/hashing.hpp>
 #include <bts/blockchain/time.hpp>
 #include <bts/blockchain/transaction.hpp>
 
@@ -12,10 +13,7 @@ namespace bts { namespace blockchain {
 
    digest_type transaction::digest( const digest_type& chain_id )const
    {
-      fc::sha256::encoder enc;
-      fc::raw::pack(enc,*this);
-      fc::raw::pack(enc,chain_id);
-      return enc.result();
+      return hash_engine::instance().packed_sha256( *this, chain_id );
    }
 
    size_t signed_transaction::data_size()const
@@ -27,9 +25,7 @@ namespace bts { namespace blockchain {
 
    transaction_id_type signed_transaction::id()const
    {
-      fc::sha512::encoder enc;
-      fc::raw::pack(enc,*this);
-      return fc::ripemd160::hash( enc.result() );
+      return hash_engine::instance().packed_id_hash( *this );
    }
 
    transaction_id_type signed_transaction::permanent_id()const
@@ -269,6 +265,28 @@ namespace bts { namespace blockchain {
       operations.push_back( update_feed_operation{ feed_index{feed_id,delegate_id}, value } );
    }
 
+   size_t transaction::market_operation_count()const
+   {
+      size_t count = 0;
+      for( const auto& op : operations )
+      {
+          switch( operation_type_enum( op.type ) )
+          {
+              case bid_op_type:
+              case ask_op_type:
+              case short_op_v2_type:
+              case cover_op_type:
+              case add_collateral_op_type:
+              case remove_collateral_op_type:
+                  ++count;
+                  break;
+              default:
+                  break;
+          }
+      }
+      return count;
+   }
+
    bool transaction::is_cancel()const
    {
       for( const auto& op : operations )
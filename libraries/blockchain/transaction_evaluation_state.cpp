@@ -1,9 +1,15 @@
 #include <bts/blockchain/chain_interface.hpp>
+#include <bts/blockchain/evaluation_profiler.hpp>
 #include <bts/blockchain/operation_factory.hpp>
+#include <bts/blockchain/signature_cache.hpp>
 #include <bts/blockchain/transaction_evaluation_state.hpp>
 
 #include <bts/blockchain/fork_blocks.hpp>
 
+#include <bts/db/level_map_stats.hpp>
+
+#include <algorithm>
+
 namespace bts { namespace blockchain {
 
    transaction_evaluation_state::transaction_evaluation_state( chain_interface* current_state, digest_type chain_id )
@@ -15,20 +21,41 @@ namespace bts { namespace blockchain {
    {
    }
 
+   /**
+    *  Returns the state to what a newly constructed one holds, so one state can evaluate many
+    *  transactions in turn. Containers are cleared rather than replaced to keep their storage.
+    */
    void transaction_evaluation_state::reset()
    {
       signed_keys.clear();
+      _signers.clear();
       balance.clear();
       deposits.clear();
       withdraws.clear();
+      yield.clear();
+      deltas.clear();
       net_delegate_votes.clear();
       required_deposits.clear();
+      provided_deposits.clear();
+      required_fees = asset();
+      alt_fees_paid = asset();
       validation_error.reset();
+      _trx_id.reset();
+      _trx_digest.reset();
+      _trx_size.reset();
    }
 
    bool transaction_evaluation_state::check_signature( const address& a )const
    { try {
-      return  _skip_signature_check || signed_keys.find( a ) != signed_keys.end();
+      if( _skip_signature_check || signed_keys.find( a ) != signed_keys.end() )
+         return true;
+      for( const auto& signer : _signers )
+      {
+         const auto& legacy = signer->legacy_addresses();
+         if( std::find( legacy.begin(), legacy.end(), a ) != legacy.end() )
+            return true;
+      }
+      return false;
    } FC_CAPTURE_AND_RETHROW( (a) ) }
 
    bool transaction_evaluation_state::any_parent_has_signed( const string& account_name )const
@@ -68,8 +95,8 @@ namespace bts { namespace blockchain {
 
    void transaction_evaluation_state::verify_delegate_id( account_id_type id )const
    {
-      auto current_account = _current_state->get_account_record( id );
-      if( !current_account ) FC_CAPTURE_AND_THROW( unknown_account_id, (id) );
+      const account_record* current_account = _current_state->lookup_account_record( id );
+      if( current_account == nullptr ) FC_CAPTURE_AND_THROW( unknown_account_id, (id) );
       if( !current_account->is_delegate() ) FC_CAPTURE_AND_THROW( not_a_delegate, (id) );
    }
 
@@ -93,15 +120,28 @@ namespace bts { namespace blockchain {
 
    void transaction_evaluation_state::update_delegate_votes()
    {
-      auto asset_rec = _current_state->get_asset_record( asset_id_type() );
-
       for( const auto& del_vote : net_delegate_votes )
       {
-         auto del_rec = _current_state->get_account_record( del_vote.first );
-         FC_ASSERT( !!del_rec );
-         del_rec->adjust_votes_for( del_vote.second.votes_for );
+         if( _block_delegate_votes != nullptr )
+         {
+            // accounts never stop being delegates, so checking a delegate the first time it is voted for will do
+            auto itr = _block_delegate_votes->find( del_vote.first );
+            if( itr == _block_delegate_votes->end() )
+            {
+               const account_record* del_rec = _current_state->lookup_account_record( del_vote.first );
+               FC_ASSERT( del_rec != nullptr && del_rec->is_delegate() );
+               itr = _block_delegate_votes->emplace( del_vote.first, 0 ).first;
+            }
+            itr->second += del_vote.second.votes_for;
+            continue;
+         }
 
-         _current_state->store_account_record( *del_rec );
+         const account_record* current = _current_state->lookup_account_record( del_vote.first );
+         FC_ASSERT( current != nullptr );
+         account_record del_rec = *current;
+         del_rec.adjust_votes_for( del_vote.second.votes_for );
+
+         _current_state->store_account_record( del_rec );
       }
    }
 
@@ -133,7 +173,7 @@ namespace bts { namespace blockchain {
          if( fee.first == 0 || fee.second == 0 )
            continue;
 
-         auto asset_record = _current_state->get_asset_record( fee.first );
+         auto asset_record = _current_state->get_asset_record_for_totals( fee.first );
          if( !asset_record.valid() ) FC_CAPTURE_AND_THROW( unknown_asset_id, (fee.first) );
 
          if( !asset_record->is_market_issued() )
@@ -155,7 +195,7 @@ namespace bts { namespace blockchain {
          if( fee.second < 0 ) FC_CAPTURE_AND_THROW( negative_fee, (fee) );
          if( fee.second > 0 ) // if a fee was paid...
          {
-            auto asset_record = _current_state->get_asset_record( fee.first );
+            auto asset_record = _current_state->get_asset_record_for_totals( fee.first );
             if( !asset_record )
               FC_CAPTURE_AND_THROW( unknown_asset_id, (fee.first) );
 
@@ -190,27 +230,27 @@ namespace bts { namespace blockchain {
         if( (_current_state->now() + BTS_BLOCKCHAIN_MAX_TRANSACTION_EXPIRATION_SEC) < trx_arg.expiration )
            FC_CAPTURE_AND_THROW( invalid_transaction_expiration, (trx_arg)(_current_state->now()) );
 
-        auto trx_id = trx_arg.id();
+        const auto trx_id = trx_arg.id();
+        const auto digest = trx_arg.digest( _chain_id );
 
-        if( _current_state->is_known_transaction( trx_arg.expiration, trx_arg.digest( _chain_id ) ) )
+        if( _current_state->is_known_transaction( trx_arg.expiration, digest ) )
           if (_current_state->get_head_block_num() >= FORK_25)
             FC_CAPTURE_AND_THROW( duplicate_transaction, (trx_id) );
 
         trx = trx_arg;
+        _trx_id = trx_id;
+        _trx_digest = std::make_pair( _chain_id, digest );
         if( !_skip_signature_check )
         {
-           auto digest = trx_arg.digest( _chain_id );
+           const auto recovery_start = fc::time_point::now();
            for( const auto& sig : trx.signatures )
            {
-              auto key = fc::ecc::public_key( sig, digest, enforce_canonical ).serialize();
-              signed_keys.insert( address(key) );
-              signed_keys.insert( address(pts_address(key,false,28) ) );
-              signed_keys.insert( address(pts_address(key,true,28) )  );
-              signed_keys.insert( address(pts_address(key,false,56) ) );
-              signed_keys.insert( address(pts_address(key,true,56) )  );
-              signed_keys.insert( address(pts_address(key,false,0) )  );
-              signed_keys.insert( address(pts_address(key,true,0) )   );
+              const auto signer = signature_cache::instance().recover( sig, digest, enforce_canonical );
+              signed_keys.insert( signer->native_address );
+              _signers.push_back( signer );
            }
+           if( evaluation_profiler::instance().enabled() )
+              evaluation_profiler::instance().record_signature_recovery( recovery_start, trx.signatures.size() );
         }
         _current_op_index = 0;
         for( const auto& op : trx.operations )
@@ -229,18 +269,75 @@ namespace bts { namespace blockchain {
       }
    } FC_RETHROW_EXCEPTIONS( warn, "", ("trx",trx_arg) ) }
 
+   const transaction_id_type& transaction_evaluation_state::trx_id()const
+   {
+      if( !_trx_id.valid() )
+         _trx_id = trx.id();
+      return *_trx_id;
+   }
+
+   const digest_type& transaction_evaluation_state::trx_digest( const digest_type& chain_id )const
+   {
+      if( !_trx_digest.valid() || _trx_digest->first != chain_id )
+         _trx_digest = std::make_pair( chain_id, trx.digest( chain_id ) );
+      return _trx_digest->second;
+   }
+
+   size_t transaction_evaluation_state::trx_size()const
+   {
+      if( !_trx_size.valid() )
+         _trx_size = trx.data_size();
+      return *_trx_size;
+   }
+
    void transaction_evaluation_state::evaluate_operation( const operation& op )
    {
-      operation_factory::instance().evaluate( *this, op );
+      auto& profiler = evaluation_profiler::instance();
+      if( !profiler.enabled() )
+      {
+         operation_factory::instance().evaluate( *this, op );
+         return;
+      }
+
+      const auto start = fc::time_point::now();
+      const uint64_t reads_before = bts::db::level_map_stats::thread_gets();
+      try
+      {
+         operation_factory::instance().evaluate( *this, op );
+      }
+      catch( ... )
+      {
+         profiler.record_operation( op.type, start, bts::db::level_map_stats::thread_gets() - reads_before, true );
+         throw;
+      }
+      profiler.record_operation( op.type, start, bts::db::level_map_stats::thread_gets() - reads_before, false );
+   }
+
+   const vector<signed_int>* block_slate_cache::find( slate_id_type id )
+   {
+      std::lock_guard<std::recursive_mutex> guard( _lock );
+      auto itr = _slates.find( id );
+      if( itr == _slates.end() )
+      {
+         const odelegate_slate slate = _base.get_delegate_slate( id );
+         itr = _slates.emplace( id, slate.valid() ? slate->supported_delegates : optional<vector<signed_int>>() ).first;
+      }
+      return itr->second.valid() ? &*itr->second : nullptr;
    }
 
    void transaction_evaluation_state::adjust_vote( slate_id_type slate_id, share_type amount )
    {
       if( slate_id )
       {
-         auto slate = _current_state->get_delegate_slate( slate_id );
-         if( !slate ) FC_CAPTURE_AND_THROW( unknown_delegate_slate, (slate_id) );
-         for( const auto& delegate_id : slate->supported_delegates )
+         const vector<signed_int>* delegates = _block_slates ? _block_slates->find( slate_id ) : nullptr;
+         odelegate_slate slate;
+         if( !delegates )
+         {
+            slate = _current_state->get_delegate_slate( slate_id );
+            if( !slate ) FC_CAPTURE_AND_THROW( unknown_delegate_slate, (slate_id) );
+            delegates = &slate->supported_delegates;
+         }
+         for( const auto& delegate_id : *delegates )
          {
             if( BTS_BLOCKCHAIN_ENABLE_NEGATIVE_VOTES && delegate_id < signed_int(0) )
                net_delegate_votes[abs(delegate_id)].votes_for -= amount;
@@ -321,7 +418,7 @@ namespace bts { namespace blockchain {
     */
    void transaction_evaluation_state::validate_asset( const asset& asset_to_validate )const
    {
-      auto asset_rec = _current_state->get_asset_record( asset_to_validate.asset_id );
+      auto asset_rec = _current_state->get_asset_record_for_totals( asset_to_validate.asset_id );
       if( NOT asset_rec )
          FC_CAPTURE_AND_THROW( unknown_asset_id, (asset_to_validate) );
    }
@@ -1,3 +1,4 @@
+#include <bts/blockchain/base58_cache.hpp>
 #include <bts/blockchain/config.hpp>
 #include <bts/blockchain/types.hpp>
 
@@ -7,6 +8,12 @@
 
 namespace bts { namespace blockchain {
 
+    static base58_cache& public_key_strings()
+    {
+       static base58_cache cache( BTS_BLOCKCHAIN_BASE58_CACHE_SIZE );
+       return cache;
+    }
+
     public_key_type::public_key_type():key_data(){};
 
     public_key_type::public_key_type( const fc::ecc::public_key_data& data )
@@ -17,14 +24,17 @@ namespace bts { namespace blockchain {
 
     public_key_type::public_key_type( const std::string& base58str )
     {
-       std::string prefix( BTS_ADDRESS_PREFIX );
-       const size_t prefix_len = prefix.size();
-       FC_ASSERT( base58str.size() > prefix_len );
-       FC_ASSERT( base58str.substr( 0, prefix_len ) ==  prefix , "", ("base58str", base58str) );
-       auto bin = fc::from_base58( base58str.substr( prefix_len ) );
-       auto bin_key = fc::raw::unpack<binary_key>(bin);
-       key_data = bin_key.data;
-       FC_ASSERT( fc::ripemd160::hash( key_data.data, key_data.size() )._hash[0] == bin_key.check );
+       public_key_strings().decode( base58str, key_data.data, key_data.size(), [&]()
+       {
+          std::string prefix( BTS_ADDRESS_PREFIX );
+          const size_t prefix_len = prefix.size();
+          FC_ASSERT( base58str.size() > prefix_len );
+          FC_ASSERT( base58str.substr( 0, prefix_len ) ==  prefix , "", ("base58str", base58str) );
+          auto bin = fc::from_base58( base58str.substr( prefix_len ) );
+          auto bin_key = fc::raw::unpack<binary_key>(bin);
+          key_data = bin_key.data;
+          FC_ASSERT( fc::ripemd160::hash( key_data.data, key_data.size() )._hash[0] == bin_key.check );
+       } );
     };
 
     public_key_type::operator fc::ecc::public_key_data() const
@@ -39,11 +49,14 @@ namespace bts { namespace blockchain {
 
     public_key_type::operator std::string() const
     {
-       binary_key k;
-       k.data = key_data;
-       k.check = fc::ripemd160::hash( k.data.data, k.data.size() )._hash[0];
-       auto data = fc::raw::pack( k );
-       return BTS_ADDRESS_PREFIX + fc::to_base58( data.data(), data.size() );
+       return public_key_strings().encode( key_data.data, key_data.size(), [this]()
+       {
+          binary_key k;
+          k.data = key_data;
+          k.check = fc::ripemd160::hash( k.data.data, k.data.size() )._hash[0];
+          auto data = fc::raw::pack( k );
+          return BTS_ADDRESS_PREFIX + fc::to_base58( data.data(), data.size() );
+       } );
     }
 
     bool operator == ( const public_key_type& p1, const fc::ecc::public_key& p2)
@@ -0,0 +1,182 @@
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/unique_transaction_set.hpp>
+
+#include <cstring>
+
+namespace bts { namespace blockchain {
+
+   namespace
+   {
+      /* the digest is a hash already, so its leading bytes serve as the hash of the slot */
+      size_t first_slot( const digest_type& digest, size_t mask )
+      {
+         uint64_t hash = 0;
+         memcpy( &hash, digest.data(), sizeof( hash ) );
+         return size_t( hash ) & mask;
+      }
+   }
+
+   size_t unique_transaction_set::bucket::find( const time_point_sec& expiration, const digest_type& digest )const
+   {
+      if( slots.empty() )
+         return slots.size();
+
+      const size_t mask = slots.size() - 1;
+      for( size_t index = first_slot( digest, mask ); ; index = ( index + 1 ) & mask )
+      {
+         const slot& current = slots[ index ];
+         if( current.state == slot::empty )
+            return slots.size();
+         if( current.state == slot::used && current.expiration == expiration && current.digest == digest )
+            return index;
+      }
+   }
+
+   /* at most half the slots are used or erased, so every probe sequence reaches an empty slot */
+   bool unique_transaction_set::bucket::insert( const time_point_sec& expiration, const digest_type& digest )
+   {
+      if( find( expiration, digest ) != slots.size() )
+         return false;
+
+      if( 2 * ( used + erased + 1 ) > slots.size() )
+      {
+         size_t capacity = 8;
+         while( capacity < 4 * ( used + 1 ) )
+            capacity *= 2;
+         rehash( capacity );
+      }
+
+      const size_t mask = slots.size() - 1;
+      size_t index = first_slot( digest, mask );
+      while( slots[ index ].state == slot::used )
+         index = ( index + 1 ) & mask;
+
+      slot& free_slot = slots[ index ];
+      if( free_slot.state == slot::erased )
+         --erased;
+      free_slot.digest = digest;
+      free_slot.expiration = expiration;
+      free_slot.state = slot::used;
+      ++used;
+      return true;
+   }
+
+   void unique_transaction_set::bucket::erase( size_t index )
+   {
+      slots[ index ].state = slot::erased;
+      --used;
+      ++erased;
+      if( used == 0 )
+      {
+         std::vector<slot>().swap( slots );
+         erased = 0;
+      }
+   }
+
+   void unique_transaction_set::bucket::rehash( size_t capacity )
+   {
+      std::vector<slot> old_slots( capacity );
+      old_slots.swap( slots );
+      erased = 0;
+
+      const size_t mask = slots.size() - 1;
+      for( const slot& old_slot : old_slots )
+      {
+         if( old_slot.state != slot::used )
+            continue;
+         size_t index = first_slot( old_slot.digest, mask );
+         while( slots[ index ].state != slot::empty )
+            index = ( index + 1 ) & mask;
+         slots[ index ] = old_slot;
+      }
+   }
+
+   uint32_t unique_transaction_set::bucket_number( const time_point_sec& expiration )
+   {
+      return expiration.sec_since_epoch() / BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
+   }
+
+   const unique_transaction_set::bucket* unique_transaction_set::find_bucket( const time_point_sec& expiration )const
+   {
+      const uint32_t number = bucket_number( expiration );
+      if( _buckets.empty() || number < _first_bucket || number - _first_bucket >= _buckets.size() )
+         return nullptr;
+      return &_buckets[ number - _first_bucket ];
+   }
+
+   bool unique_transaction_set::insert( const time_point_sec& expiration, const digest_type& digest )
+   {
+      const uint32_t number = bucket_number( expiration );
+      if( _buckets.empty() )
+      {
+         _first_bucket = number;
+         _buckets.resize( 1 );
+      }
+      else if( number < _first_bucket )
+      {
+         // popping blocks moves the head back, so digests may return that expire before the first bucket
+         _buckets.insert( _buckets.begin(), _first_bucket - number, bucket() );
+         _first_bucket = number;
+      }
+      else if( number - _first_bucket >= _buckets.size() )
+      {
+         _buckets.resize( number - _first_bucket + 1 );
+      }
+
+      if( !_buckets[ number - _first_bucket ].insert( expiration, digest ) )
+         return false;
+      ++_size;
+      return true;
+   }
+
+   void unique_transaction_set::erase( const time_point_sec& expiration, const digest_type& digest )
+   {
+      if( find_bucket( expiration ) == nullptr )
+         return;
+      bucket& owner = _buckets[ bucket_number( expiration ) - _first_bucket ];
+      const size_t index = owner.find( expiration, digest );
+      if( index == owner.slots.size() )
+         return;
+      owner.erase( index );
+      --_size;
+   }
+
+   bool unique_transaction_set::contains( const time_point_sec& expiration, const digest_type& digest )const
+   {
+      const bucket* owner = find_bucket( expiration );
+      return owner != nullptr && owner->find( expiration, digest ) != owner->slots.size();
+   }
+
+   void unique_transaction_set::purge_expired( const time_point_sec& now )
+   {
+      const uint32_t now_bucket = bucket_number( now );
+      while( !_buckets.empty() && _first_bucket < now_bucket )
+      {
+         _size -= _buckets.front().used;
+         _buckets.pop_front();
+         ++_first_bucket;
+      }
+
+      if( _buckets.empty() || _first_bucket != now_bucket )
+         return;
+
+      bucket& current = _buckets.front();
+      for( size_t index = 0; index < current.slots.size() && current.used > 0; ++index )
+      {
+         const slot& candidate = current.slots[ index ];
+         if( candidate.state == slot::used && candidate.expiration < now )
+         {
+            current.erase( index );
+            --_size;
+         }
+      }
+   }
+
+   void unique_transaction_set::clear()
+   {
+      _buckets.clear();
+      _first_bucket = 0;
+      _size = 0;
+   }
+
+} } // bts::blockchain
@@ -33,7 +33,16 @@ namespace bts { namespace blockchain {
 
    balance_id_type withdraw_condition::get_address()const
    {
-      return address( *this );
+      if( !_address.valid() )
+         _address = address( *this );
+      return *_address;
+   }
+
+   address withdraw_condition::get_owner()const
+   {
+      if( !_owner.valid() )
+         _owner = type == withdraw_signature_type ? as<withdraw_with_signature>().owner : address();
+      return *_owner;
    }
 
    omemo_status withdraw_with_signature::decrypt_memo_data( const fc::ecc::private_key& receiver_key )const
@@ -147,6 +156,8 @@ namespace fc {
    {
       using namespace bts::blockchain;
       auto obj = var.get_object();
+      vo._address.reset();
+      vo._owner.reset();
       from_variant( obj["asset_id"], vo.asset_id );
       from_variant( obj["delegate_slate_id"], vo.delegate_slate_id );
       from_variant( obj["type"], vo.type );
@@ -23,9 +23,13 @@
 #include <boost/range/algorithm/max_element.hpp>
 #include <boost/range/algorithm/min_element.hpp>
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 
+/* how many chain-state reads of a batch script are dispatched together */
+#define BTS_CLI_MAX_CONCURRENT_BATCH_COMMANDS 32
+
 #ifdef HAVE_READLINE
 # include <readline/readline.h>
 # include <readline/history.h>
@@ -191,9 +195,12 @@ namespace bts { namespace cli {
               }
             } //parse_and_execute_interactive_command
 
-            bool execute_command_line(const string& line)
-            { try {
+            /** splits a command line into the command and a stream over its arguments; false if the line is empty */
+            bool split_command_line(const string& line, string& command, fc::istream_ptr& argument_stream)
+            {
               string trimmed_line_to_parse(boost::algorithm::trim_copy(line));
+              if (trimmed_line_to_parse.empty())
+                return false;
               /**
                *  On some OS X systems, std::stringstream gets corrupted and does not throw eof
                *  when expected while parsing the command.  Adding EOF (0x04) characater at the
@@ -203,23 +210,28 @@ namespace bts { namespace cli {
                *  @todo figure out how to fix things on these OS X systems.
                */
               trimmed_line_to_parse += string(" ") + char(0x04);
-              if (!trimmed_line_to_parse.empty())
+              string::const_iterator iter = std::find_if(trimmed_line_to_parse.begin(), trimmed_line_to_parse.end(), ::isspace);
+              if (iter != trimmed_line_to_parse.end())
+              {
+                // then there are arguments to this function
+                size_t first_space_pos = iter - trimmed_line_to_parse.begin();
+                command = trimmed_line_to_parse.substr(0, first_space_pos);
+                argument_stream = std::make_shared<fc::stringstream>((trimmed_line_to_parse.substr(first_space_pos + 1)));
+              }
+              else
+              {
+                command = trimmed_line_to_parse;
+                argument_stream = std::make_shared<fc::stringstream>();
+              }
+              return true;
+            }
+
+            bool execute_command_line(const string& line)
+            { try {
+              string command;
+              fc::istream_ptr argument_stream;
+              if (split_command_line(line, command, argument_stream))
               {
-                string::const_iterator iter = std::find_if(trimmed_line_to_parse.begin(), trimmed_line_to_parse.end(), ::isspace);
-                string command;
-                fc::istream_ptr argument_stream;
-                if (iter != trimmed_line_to_parse.end())
-                {
-                  // then there are arguments to this function
-                  size_t first_space_pos = iter - trimmed_line_to_parse.begin();
-                  command = trimmed_line_to_parse.substr(0, first_space_pos);
-                  argument_stream = std::make_shared<fc::stringstream>((trimmed_line_to_parse.substr(first_space_pos + 1)));
-                }
-                else
-                {
-                  command = trimmed_line_to_parse;
-                  argument_stream = std::make_shared<fc::stringstream>();
-                }
                 try
                 {
                   parse_and_execute_interactive_command(command,argument_stream);
@@ -236,6 +248,197 @@ namespace bts { namespace cli {
               return true;
             } FC_RETHROW_EXCEPTIONS( warn, "", ("command",line) ) }
 
+            struct batch_command
+            {
+              string                    line;
+              string                    command;
+              fc::variants              arguments;
+              fc::optional<string>      parse_error;
+              bool                      concurrent = false;
+
+              fc::variant               result;
+              fc::optional<string>      error;
+              fc::microseconds          duration;
+            };
+
+            /** runs one parsed command of a batch, recording its result or error and how long it took */
+            void run_batch_command(batch_command& item)
+            {
+              const auto start = fc::time_point::now();
+              try
+              {
+                item.result = _self->execute_interactive_command(item.command, item.arguments);
+              }
+              catch( const bts::cli::abort_cli_command& )
+              {
+                throw;
+              }
+              catch( const bts::cli::exit_cli_command& )
+              {
+                throw;
+              }
+              catch( const fc::exception& e )
+              {
+                item.error = FILTER_OUTPUT_FOR_TESTS ? "Command failed with exception: " + e.to_string()
+                                                     : e.to_detail_string();
+              }
+              item.duration = fc::time_point::now() - start;
+            }
+
+            void print_batch_command(const batch_command& item)
+            {
+              if (item.parse_error)
+                *_out << *item.parse_error << "\n";
+              else if (item.error)
+                *_out << *item.error << "\n";
+              else
+                _self->format_and_print_result(item.command, item.arguments, item.result);
+            }
+
+            void print_batch_timing(const vector<batch_command>& commands)
+            {
+              struct command_timing
+              {
+                uint32_t         count = 0;
+                fc::microseconds total;
+                fc::microseconds max;
+              };
+              map<string, command_timing> timings;
+              for (const auto& item : commands)
+              {
+                if (item.parse_error)
+                  continue;
+                auto& timing = timings[item.command];
+                ++timing.count;
+                timing.total += item.duration;
+                timing.max = std::max(timing.max, item.duration);
+              }
+
+              vector<std::pair<string, command_timing>> sorted(timings.begin(), timings.end());
+              std::sort(sorted.begin(), sorted.end(), [](const std::pair<string, command_timing>& a,
+                                                         const std::pair<string, command_timing>& b) {
+                return a.second.total > b.second.total;
+              });
+
+              *_out << "\n" << std::left;
+              *_out << std::setw(48) << "COMMAND";
+              *_out << std::setw(10) << "COUNT";
+              *_out << std::setw(16) << "TOTAL (ms)";
+              *_out << std::setw(16) << "AVERAGE (ms)";
+              *_out << std::setw(16) << "MAX (ms)";
+              *_out << "\n";
+              *_out << pretty_line(106) << "\n";
+              for (const auto& item : sorted)
+              {
+                *_out << std::setw(48) << item.first;
+                *_out << std::setw(10) << item.second.count;
+                *_out << std::setw(16) << item.second.total.count() / 1000.0;
+                *_out << std::setw(16) << item.second.total.count() / 1000.0 / item.second.count;
+                *_out << std::setw(16) << item.second.max.count() / 1000.0;
+                *_out << "\n";
+              }
+              *_out << std::right;
+            }
+
+            /**
+             *  Runs a whole script at once. Every line is parsed first; runs of consecutive commands whose
+             *  results depend only on the chain state are then dispatched together, and everything else runs
+             *  one at a time in script order. Results are printed in script order, then a timing report.
+             */
+            void process_batch_commands(std::istream* input_stream)
+            { try {
+              FC_ASSERT( input_stream != nullptr );
+
+              vector<batch_command> commands;
+              string line;
+              while (std::getline(*input_stream, line))
+              {
+                batch_command item;
+                fc::istream_ptr argument_stream;
+                if (!split_command_line(line, item.command, argument_stream))
+                  continue;
+                item.line = line;
+
+                if (item.command != "enable_raw" && item.command != "disable_raw")
+                {
+                  try
+                  {
+                    fc::buffered_istream buffered_argument_stream(argument_stream);
+                    item.arguments = _self->parse_interactive_command(buffered_argument_stream, item.command);
+                    item.concurrent = _rpc_server->get_method_data(item.command).cache_policy != bts::api::cache_never;
+                  }
+                  catch( const rpc::unknown_method& )
+                  {
+                    item.parse_error = "Error: invalid command \"" + item.command + "\"";
+                  }
+                  catch( const bts::cli::abort_cli_command& )
+                  {
+                    throw;
+                  }
+                  catch( const fc::exception& e )
+                  {
+                    item.parse_error = "Error parsing command \"" + item.command + "\": " + e.to_string();
+                  }
+                }
+                commands.push_back(std::move(item));
+              }
+
+              const auto start = fc::time_point::now();
+              size_t next = 0;
+              try
+              {
+                while (next < commands.size() && !_quit)
+                {
+                  batch_command& item = commands[next];
+                  if (item.parse_error)
+                  {
+                    print_batch_command(item);
+                    ++next;
+                  }
+                  else if (item.command == "enable_raw" || item.command == "disable_raw")
+                  {
+                    show_raw_output = item.command == "enable_raw";
+                    ++next;
+                  }
+                  else if (!item.concurrent)
+                  {
+                    run_batch_command(item);
+                    print_batch_command(item);
+                    ++next;
+                  }
+                  else
+                  {
+                    size_t end = next;
+                    while (end < commands.size() && end - next < BTS_CLI_MAX_CONCURRENT_BATCH_COMMANDS
+                           && commands[end].concurrent && !commands[end].parse_error)
+                      ++end;
+
+                    vector<fc::future<void>> tasks;
+                    tasks.reserve(end - next);
+                    for (size_t i = next; i < end; ++i)
+                      tasks.push_back(fc::async([this, &commands, i] { run_batch_command(commands[i]); },
+                                                "CLI batch command"));
+                    for (auto& task : tasks)
+                      task.wait();
+
+                    for (size_t i = next; i < end; ++i)
+                      print_batch_command(commands[i]);
+                    next = end;
+                  }
+                }
+              }
+              catch (const bts::cli::exit_cli_command&)
+              {
+              }
+              catch( const bts::cli::abort_cli_command& )
+              {
+                *_out << "Command aborted\n";
+              }
+
+              commands.resize(next);
+              print_batch_timing(commands);
+              *_out << "Ran " << next << " commands in " << (fc::time_point::now() - start).count() / 1000 << " ms\n";
+            } FC_CAPTURE_AND_RETHROW() }
 
             string get_line( const string& prompt = CLI_PROMPT_SUFFIX, bool no_echo = false)
             {
@@ -908,6 +1111,12 @@ namespace bts { namespace cli {
     my->process_commands(input_stream);
   }
 
+  void cli::process_batch_commands(std::istream* input_stream)
+  {
+    ilog( "starting to process batch commands" );
+    my->process_batch_commands(input_stream);
+  }
+
   cli::~cli()
   {
     try
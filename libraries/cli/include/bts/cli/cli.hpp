@@ -39,6 +39,8 @@ namespace bts { namespace cli {
           void set_daemon_mode(bool enable_daemon_mode);
           void display_status_message(const std::string& message);
           void process_commands(std::istream* input_stream);
+          /** parses all of input_stream, then runs it with independent chain reads dispatched together */
+          void process_batch_commands(std::istream* input_stream);
           void enable_output(bool enable_output);
           void filter_output_for_tests(bool enable_flag);
 
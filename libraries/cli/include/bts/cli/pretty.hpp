@@ -10,6 +10,7 @@
 
 #include <fc/time.hpp>
 
+#include <ostream>
 #include <string>
 
 namespace bts { namespace cli {
@@ -37,6 +38,8 @@ string pretty_delegate_list( const vector<account_record>& delegate_records, cpt
 string pretty_block_list( const vector<block_record>& block_records, cptr client );
 
 string pretty_transaction_list( const vector<pretty_transaction>& transactions, cptr client );
+/** Converts and prints one transaction at a time, taking the layout from the first few instead of the whole list */
+void print_transaction_list( std::ostream& out, const fc::variants& transactions, cptr client );
 string pretty_experimental_transaction_list( const set<pretty_transaction_experimental>& transactions, cptr client );
 
 string pretty_asset_list( const vector<asset_record>& asset_records, cptr client );
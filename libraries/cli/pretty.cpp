@@ -7,6 +7,9 @@
 #include <iostream>
 #include <sstream>
 
+/* how many rows the streaming printers look at before fixing their layout */
+#define BTS_CLI_LAYOUT_SAMPLE_SIZE 256
+
 namespace bts { namespace cli {
 
 bool FILTER_OUTPUT_FOR_TESTS = false;
@@ -453,22 +456,30 @@ string pretty_block_list( const vector<block_record>& block_records, cptr client
     return out.str();
 }
 
-string pretty_transaction_list( const vector<pretty_transaction>& transactions, cptr client )
+/* the flags are decided up front, from the whole list or from a sample of its head */
+struct transaction_list_layout
 {
-    if( transactions.empty() ) return "No transactions found.\n";
-    FC_ASSERT( client != nullptr );
+    bool account_specified = false;
+    bool any_group = false;
+    int  line_size = 166;
+};
 
-    const bool account_specified = !transactions.front().ledger_entries.empty()
+static transaction_list_layout transaction_layout( const vector<pretty_transaction>& transactions )
+{
+    transaction_list_layout layout;
+    layout.account_specified = !transactions.front().ledger_entries.empty()
             && transactions.front().ledger_entries.front().running_balances.size() == 1;
 
-    auto any_group = false;
     for( const auto& transaction : transactions )
-        any_group |= transaction.ledger_entries.size() > 1;
+        layout.any_group |= transaction.ledger_entries.size() > 1;
 
-    std::stringstream out;
-    out << std::left;
+    layout.line_size = !layout.account_specified ? 166 : 190;
+    return layout;
+}
 
-    if( any_group ) out << " ";
+static void print_transaction_header( std::ostream& out, const transaction_list_layout& layout )
+{
+    if( layout.any_group ) out << " ";
 
     out << std::setw( 20 ) << "TIMESTAMP";
     out << std::setw( 10 ) << "BLOCK";
@@ -476,109 +487,159 @@ string pretty_transaction_list( const vector<pretty_transaction>& transactions,
     out << std::setw( 20 ) << "TO";
     out << std::setw( 24 ) << "AMOUNT";
     out << std::setw( 44 ) << "MEMO";
-    if( account_specified ) out << std::setw( 24 ) << "BALANCE";
+    if( layout.account_specified ) out << std::setw( 24 ) << "BALANCE";
     out << std::setw( 20 ) << "FEE";
     out << std::setw(  8 ) << "ID";
     out << "\n";
 
-    const auto line_size = !account_specified ? 166 : 190;
-    out << pretty_line( !any_group ? line_size : line_size + 2 ) << "\n";
+    out << pretty_line( !layout.any_group ? layout.line_size : layout.line_size + 2 ) << "\n";
+}
 
-    auto group = true;
-    for( const auto& transaction : transactions )
+/* group tracks whether the previous transaction was printed as a group */
+static void print_transaction_rows( std::ostream& out, const pretty_transaction& transaction,
+                                    const transaction_list_layout& layout, bool& group, cptr client )
+{
+    const bool account_specified = layout.account_specified;
+    const bool any_group = layout.any_group;
+    const int line_size = layout.line_size;
+
+    const auto prev_group = group;
+    group = transaction.ledger_entries.size() > 1;
+    if( group && !prev_group ) out << pretty_line( line_size + 2, '-' ) << "\n";
+
+    size_t count = 0;
+    for( const auto& entry : transaction.ledger_entries )
     {
-        const auto prev_group = group;
-        group = transaction.ledger_entries.size() > 1;
-        if( group && !prev_group ) out << pretty_line( line_size + 2, '-' ) << "\n";
+        const auto is_pending = !transaction.is_virtual && !transaction.is_confirmed;
 
-        size_t count = 0;
-        for( const auto& entry : transaction.ledger_entries )
-        {
-            const auto is_pending = !transaction.is_virtual && !transaction.is_confirmed;
+        if( group ) out << "|";
+        else if( any_group ) out << " ";
 
-            if( group ) out << "|";
-            else if( any_group ) out << " ";
+        ++count;
+        if( count == 1 )
+        {
+            out << std::setw( 20 ) << pretty_timestamp( transaction.timestamp );
 
-            ++count;
-            if( count == 1 )
+            out << std::setw( 10 );
+            if( !is_pending )
             {
-                out << std::setw( 20 ) << pretty_timestamp( transaction.timestamp );
-
-                out << std::setw( 10 );
-                if( !is_pending )
-                {
-                    out << transaction.block_num;
-                }
-                else if( transaction.error.valid() )
-                {
-                    auto name = string( transaction.error->name() );
-                    name = name.substr( 0, name.find( "_" ) );
-                    boost::to_upper( name );
-                    out << name.substr(0, 9 );
-                }
-                else
-                {
-                    out << "PENDING";
-                }
+                out << transaction.block_num;
+            }
+            else if( transaction.error.valid() )
+            {
+                auto name = string( transaction.error->name() );
+                name = name.substr( 0, name.find( "_" ) );
+                boost::to_upper( name );
+                out << name.substr(0, 9 );
             }
             else
             {
-                out << std::setw( 20 ) << "";
-                out << std::setw( 10 ) << "";
+                out << "PENDING";
             }
+        }
+        else
+        {
+            out << std::setw( 20 ) << "";
+            out << std::setw( 10 ) << "";
+        }
 
-            out << std::setw( 20 ) << pretty_shorten( entry.from_account, 19 );
-            out << std::setw( 20 ) << pretty_shorten( entry.to_account, 19 );
-            out << std::setw( 24 ) << client->get_chain()->to_pretty_asset( entry.amount );
-
-            out << std::setw( 44 ) << pretty_shorten( entry.memo, 43 );
+        out << std::setw( 20 ) << pretty_shorten( entry.from_account, 19 );
+        out << std::setw( 20 ) << pretty_shorten( entry.to_account, 19 );
+        out << std::setw( 24 ) << client->get_chain()->to_pretty_asset( entry.amount );
 
-            if( account_specified )
-            {
-                out << std::setw( 24 );
-                if( !is_pending )
-                {
-                    const string name = entry.running_balances.begin()->first;
-                    out << client->get_chain()->to_pretty_asset( entry.running_balances.at( name ).at( entry.amount.asset_id ) );
-                }
-                else
-                {
-                    out << "N/A";
-                }
-            }
+        out << std::setw( 44 ) << pretty_shorten( entry.memo, 43 );
 
-            if( count == 1 )
+        if( account_specified )
+        {
+            out << std::setw( 24 );
+            if( !is_pending )
             {
-                out << std::setw( 20 );
-                out << client->get_chain()->to_pretty_asset( transaction.fee );
-
-                out << std::setw( 8 );
-                string str;
-                if( transaction.is_virtual )
-                  str = "[" + string(transaction.trx_id).substr(0, 6) + "]";
-                else
-                  str = string(transaction.trx_id).substr(0, 8);
-                if( FILTER_OUTPUT_FOR_TESTS )
-                    out << "<d-ign>" << str << "</d-ign>";
-                else
-                    out << str;
+                const string name = entry.running_balances.begin()->first;
+                out << client->get_chain()->to_pretty_asset( entry.running_balances.at( name ).at( entry.amount.asset_id ) );
             }
             else
             {
-                out << std::setw( 20 ) << "";
-                out << std::setw( 8 ) << "";
+                out << "N/A";
             }
+        }
 
-            if( group ) out << "|";
-            out << "\n";
+        if( count == 1 )
+        {
+            out << std::setw( 20 );
+            out << client->get_chain()->to_pretty_asset( transaction.fee );
+
+            out << std::setw( 8 );
+            string str;
+            if( transaction.is_virtual )
+              str = "[" + string(transaction.trx_id).substr(0, 6) + "]";
+            else
+              str = string(transaction.trx_id).substr(0, 8);
+            if( FILTER_OUTPUT_FOR_TESTS )
+                out << "<d-ign>" << str << "</d-ign>";
+            else
+                out << str;
+        }
+        else
+        {
+            out << std::setw( 20 ) << "";
+            out << std::setw( 8 ) << "";
         }
 
-        if( group ) out << pretty_line( line_size + 2, '-' ) << "\n";
+        if( group ) out << "|";
+        out << "\n";
     }
 
+    if( group ) out << pretty_line( line_size + 2, '-' ) << "\n";
+}
+
+string pretty_transaction_list( const vector<pretty_transaction>& transactions, cptr client )
+{
+    if( transactions.empty() ) return "No transactions found.\n";
+    FC_ASSERT( client != nullptr );
+
+    const auto layout = transaction_layout( transactions );
+
+    std::stringstream out;
+    out << std::left;
+
+    print_transaction_header( out, layout );
+
+    auto group = true;
+    for( const auto& transaction : transactions )
+        print_transaction_rows( out, transaction, layout, group, client );
+
     return out.str();
 }
 
+void print_transaction_list( std::ostream& out, const fc::variants& transactions, cptr client )
+{
+    if( transactions.empty() )
+    {
+        out << "No transactions found.\n";
+        return;
+    }
+    FC_ASSERT( client != nullptr );
+
+    const size_t sample_size = std::min<size_t>( transactions.size(), BTS_CLI_LAYOUT_SAMPLE_SIZE );
+    vector<pretty_transaction> sample;
+    sample.reserve( sample_size );
+    for( size_t i = 0; i < sample_size; ++i )
+        sample.push_back( transactions[ i ].as<pretty_transaction>() );
+
+    const auto layout = transaction_layout( sample );
+
+    out << std::left;
+    print_transaction_header( out, layout );
+
+    auto group = true;
+    for( const auto& transaction : sample )
+        print_transaction_rows( out, transaction, layout, group, client );
+    sample.clear();
+
+    for( size_t i = sample_size; i < transactions.size(); ++i )
+        print_transaction_rows( out, transactions[ i ].as<pretty_transaction>(), layout, group, client );
+}
+
 string pretty_experimental_transaction_list( const set<pretty_transaction_experimental>& transactions, cptr client )
 {
     if( transactions.empty() ) return "No transactions found.\n";
@@ -101,8 +101,7 @@ namespace bts { namespace cli {
 
     _command_to_function["wallet_account_transaction_history"] = []( std::ostream& out, const fc::variants& arguments, const fc::variant& result, cptr client )
     {
-      const auto& transactions = result.as<vector<pretty_transaction>>();
-      out << pretty_transaction_list( transactions, client );
+      print_transaction_list( out, result.get_array(), client );
     };
 
     _command_to_function["wallet_transaction_history_experimental"] = []( std::ostream& out, const fc::variants& arguments, const fc::variant& result, cptr client )
@@ -337,7 +336,7 @@ namespace bts { namespace cli {
 
   void print_result::f_wallet_list_my_accounts(std::ostream& out, const fc::variants& arguments, const fc::variant& result, cptr client )
   {
-    auto accts = result.as<vector<wallet_account_record>>();
+    const auto& accts = result.get_array();
 
     out << std::setw(35) << std::left << "NAME (* delegate)";
     out << std::setw(64) << "KEY";
@@ -347,8 +346,9 @@ namespace bts { namespace cli {
     out << std::setw(25) << "BLOCK PRODUCTION ENABLED";
     out << "\n";
 
-    for(const auto& acct : accts)
+    for(const auto& item : accts)
     {
+      const auto acct = item.as<wallet_account_record>();
       if(acct.is_delegate())
       {
         out << std::setw(35) << pretty_shorten(acct.name, 33) + " *";
@@ -385,7 +385,7 @@ namespace bts { namespace cli {
 
   void print_result::f_wallet_list_accounts(std::ostream& out, const fc::variants& arguments, const fc::variant& result, cptr client )
   {
-    auto accts = result.as<vector<wallet_account_record>>();
+    const auto& accts = result.get_array();
 
     out << std::setw(35) << std::left << "NAME (* delegate)";
     out << std::setw(64) << "KEY";
@@ -394,8 +394,9 @@ namespace bts { namespace cli {
     out << std::setw(15) << "APPROVAL";
     out << "\n";
 
-    for(const auto& acct : accts)
+    for(const auto& item : accts)
     {
+      const auto acct = item.as<wallet_account_record>();
       if(acct.is_delegate())
         out << std::setw(35) << pretty_shorten(acct.name, 33) + " *";
       else
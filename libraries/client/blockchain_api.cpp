@@ -255,6 +255,11 @@ vector<account_record> detail::client_impl::blockchain_list_accounts( const stri
    return _chain_db->get_accounts( first, limit );
 }
 
+vector<string> detail::client_impl::blockchain_find_account_names( const string& prefix, uint32_t limit )const
+{
+   return _chain_db->find_account_names( prefix, limit );
+}
+
 vector<account_record> detail::client_impl::blockchain_list_recently_registered_accounts()const
 {
    vector<operation> account_registrations = _chain_db->get_recent_operations(register_account_op_type);
@@ -276,6 +281,26 @@ vector<asset_record> detail::client_impl::blockchain_list_assets( const string&
    return _chain_db->get_assets( first, limit );
 }
 
+vector<string> detail::client_impl::blockchain_find_asset_symbols( const string& prefix, uint32_t limit )const
+{
+   return _chain_db->find_asset_symbols( prefix, limit );
+}
+
+balance_page detail::client_impl::blockchain_page_balances( const string& cursor, uint32_t limit )const
+{
+   return _chain_db->list_balances( cursor, limit );
+}
+
+account_page detail::client_impl::blockchain_page_accounts( const string& cursor, uint32_t limit )const
+{
+   return _chain_db->list_accounts( cursor, limit );
+}
+
+asset_page detail::client_impl::blockchain_page_assets( const string& cursor, uint32_t limit )const
+{
+   return _chain_db->list_assets( cursor, limit );
+}
+
 variant_object client_impl::blockchain_get_info() const
 {
    auto info = fc::mutable_variant_object();
@@ -421,6 +446,32 @@ std::pair<vector<market_order>,vector<market_order>> client_impl::blockchain_mar
    return std::make_pair(bids, asks);
 }
 
+market_depth client_impl::blockchain_market_depth( const string& quote_symbol,
+                                                  const string& base_symbol,
+                                                  uint32_t levels )const
+{
+   return _chain_db->get_market_depth( _chain_db->get_asset_id(quote_symbol),
+                                       _chain_db->get_asset_id(base_symbol),
+                                       levels );
+}
+
+vector<market_transaction> client_impl::blockchain_market_simulate_order( const string& order_type,
+                                                                         const string& quantity,
+                                                                         const string& quantity_symbol,
+                                                                         const string& quote_price,
+                                                                         const string& quote_symbol )
+{
+   const asset amount = _chain_db->to_ugly_asset( quantity, quantity_symbol );
+   FC_ASSERT( amount.amount > 0, "quantity must be positive" );
+   const price order_price = _chain_db->to_ugly_price( quote_price, quantity_symbol, quote_symbol );
+   if( order_type == "bid" )
+      return _chain_db->simulate_market_order( market_order( bid_order, market_index_key( order_price ),
+                                                             order_record( (amount * order_price).amount ) ) );
+   FC_ASSERT( order_type == "ask", "order_type must be bid or ask", ("order_type",order_type) );
+   return _chain_db->simulate_market_order( market_order( ask_order, market_index_key( order_price ),
+                                                          order_record( amount.amount ) ) );
+}
+
 std::vector<order_history_record> client_impl::blockchain_market_order_history( const std::string &quote_symbol,
                                                                                 const std::string &base_symbol,
                                                                                 uint32_t skip_count,
@@ -445,6 +496,17 @@ market_history_points client_impl::blockchain_market_price_history( const std::s
                                                start_time, duration, granularity );
 }
 
+market_candles client_impl::blockchain_market_candles( const std::string& quote_symbol,
+                                                      const std::string& base_symbol,
+                                                      const fc::time_point& start_time,
+                                                      const fc::microseconds& duration,
+                                                      uint32_t resolution )const
+{
+   return _chain_db->get_market_candles( _chain_db->get_asset_id(quote_symbol),
+                                         _chain_db->get_asset_id(base_symbol),
+                                         start_time, duration, resolution );
+}
+
 map<transaction_id_type, transaction_record> client_impl::blockchain_get_block_transactions( const string& block )const
 {
    vector<transaction_record> transactions;
@@ -460,11 +522,25 @@ map<transaction_id_type, transaction_record> client_impl::blockchain_get_block_t
    return transactions_map;
 }
 
+vector<transaction_record> client_impl::blockchain_list_address_transactions( const string& addr,
+                                                                             uint32_t start_block_num,
+                                                                             uint32_t start_trx_num,
+                                                                             uint32_t limit )const
+{
+   FC_ASSERT( limit > 0 && limit <= 1000, "limit must be between 1 and 1000" );
+   return _chain_db->get_address_transactions( address( addr ), transaction_location( start_block_num, start_trx_num ), limit );
+}
+
 std::string client_impl::blockchain_export_fork_graph( uint32_t start_block, uint32_t end_block, const std::string& filename )const
 {
    return _chain_db->export_fork_graph( start_block, end_block, filename );
 }
 
+uint32_t client_impl::blockchain_export_blocks( const std::string& filename, uint32_t start_block, uint32_t end_block )const
+{
+   return _chain_db->export_blocks( filename, start_block, end_block );
+}
+
 std::map<uint32_t, vector<fork_record>> client_impl::blockchain_list_forks()const
 {
    return _chain_db->get_forks_list();
@@ -498,9 +574,14 @@ bool client_impl::blockchain_verify_signature(const string& signing_account, con
    return rec->active_key() == fc::ecc::public_key(signature, hash);
 }
 
-void client_impl::blockchain_dump_state( const string& path )const
+void client_impl::blockchain_dump_state( const string& path, const string& format )const
+{
+   _chain_db->dump_state( fc::path( path ), format );
+}
+
+void client_impl::blockchain_load_state( const string& path )
 {
-   _chain_db->dump_state( fc::path( path ) );
+   _chain_db->load_state( fc::path( path ) );
 }
 
 vector<bts::blockchain::api_market_status> client_impl::blockchain_list_markets()const
@@ -5,11 +5,14 @@
 #include <bts/client/messages.hpp>
 #include <bts/net/exceptions.hpp>
 #include <bts/net/chain_downloader.hpp>
+#include <bts/net/config.hpp>
 #include <bts/blockchain/chain_database.hpp>
 #include <bts/blockchain/time.hpp>
 #include <bts/blockchain/transaction_evaluation_state.hpp>
 #include <bts/blockchain/exceptions.hpp>
 #include <bts/utilities/git_revision.hpp>
+#include <bts/utilities/log.hpp>
+#include <bts/utilities/stall_detector.hpp>
 #include <bts/rpc/rpc_client.hpp>
 #include <bts/rpc/rpc_server.hpp>
 #include <bts/api/common_api.hpp>
@@ -138,6 +141,17 @@ program_options::variables_map parse_option_variables(int argc, char** argv)
          ("growl-password", program_options::value<std::string>(), "Password for authenticating to a Growl server")
          ("growl-identifier", program_options::value<std::string>(), "A name displayed in growl messages to identify this bitshares_client instance")
          ("snapshot-dir", program_options::value<string>(), "Create daily snapshots of all balances in this directory")
+         ("prune-blocks-older-than", program_options::value<uint32_t>(), "Keep the bodies of only this many recent blocks, dropping older bodies and "
+                                                                         "transaction records; such a node cannot serve or rescan old blocks")
+         ("address-history-index", "Index the transactions touching each address, for blockchain_list_address_transactions")
+         ("follow-primary", program_options::value<string>(), "Serve the chain of the node using this data directory without connecting to the "
+                                                             "network, reading its block log as it grows and never writing to it")
+         ("state-sync-checkpoint", program_options::value<string>(), "Start a new chain from the index snapshot at BLOCK:SHA256 on the chain "
+                                                                     "servers instead of downloading every block; older blocks are never fetched")
+         ("assume-valid", program_options::value<string>(), "Skip the signature checks of the blocks before BLOCK:ID, which must then be "
+                                                            "on the chain; everything after it is fully verified")
+         ("import-blocks", program_options::value<string>(), "Apply the blocks of a bootstrap file written by blockchain_export_blocks "
+                                                             "before connecting to the network")
          ;
 
    program_options::variables_map option_variables;
@@ -597,9 +611,13 @@ void client_impl::delegate_loop()
             FC_ASSERT( (now - *next_block_time) < fc::seconds( BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC ),
                        "You missed your slot at time: ${t}!", ("t",*next_block_time) );
 
+            // a block staged before the slot was evaluated on top of our head already, so all that's
+            // left is to sign it, send it, and only then push it through our own validation
+            const bool staged = _chain_db->has_block_template( *next_block_time );
             full_block next_block = _chain_db->generate_block( *next_block_time );
             _wallet->sign_block( next_block );
-            on_new_block( next_block, next_block.id(), false );
+            if( !staged )
+               on_new_block( next_block, next_block.id(), false );
 
 #ifndef DISABLE_DELEGATE_NETWORK
             _delegate_network.broadcast_block( next_block );
@@ -608,6 +626,8 @@ void client_impl::delegate_loop()
 
             _p2p_node->broadcast( block_message( next_block ) );
             ilog( "Produced block #${n}!", ("n",next_block.block_num) );
+            if( staged )
+               on_new_block( next_block, next_block.id(), false );
          }
          catch ( const fc::canceled_exception& )
          {
@@ -618,6 +638,22 @@ void client_impl::delegate_loop()
             _exception_db.store( e );
          }
       }
+      else
+      {
+         // have the block ready when the slot comes
+         try
+         {
+            _chain_db->prepare_block_template( *next_block_time );
+         }
+         catch ( const fc::canceled_exception& )
+         {
+            throw;
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "Unable to prepare block for time ${t}: ${e}", ("t",*next_block_time)("e",e.to_detail_string()) );
+         }
+      }
    }
 
    uint32_t slot_number = blockchain::get_slot_number( now );
@@ -675,6 +711,8 @@ void client_impl::rebroadcast_pending_loop()
       ~checker() { var = false; }
    } _checker(currently_running);
 #endif // !NDEBUG
+   const fc::microseconds rebroadcast_interval = fc::seconds((int64_t)(BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC * 1.3));
+   const fc::time_point next_rebroadcast_time = fc::time_point::now() + rebroadcast_interval;
    if (_sync_mode)
    {
       wlog("skip rebroadcast_pending while syncing");
@@ -683,11 +721,41 @@ void client_impl::rebroadcast_pending_loop()
    {
       try
       {
-         signed_transactions pending = blockchain_list_pending_transactions();
-         wlog( "rebroadcasting ${trx_count}", ("trx_count",pending.size()) );
-         for( auto trx : pending )
+         std::map<transaction_evaluation_state_ptr, bts::net::message_hash_type> message_ids;
+         std::map<bts::net::message_hash_type, transaction_evaluation_state_ptr> pending_by_message_id;
+         std::vector<bts::net::item_id> pending_items;
+         for (const transaction_evaluation_state_ptr& eval_state : _chain_db->get_pending_transactions())
          {
-            network_broadcast_transaction( trx );
+            auto known_id = _pending_transaction_message_ids.find(eval_state);
+            bts::net::message_hash_type message_id;
+            if (known_id != _pending_transaction_message_ids.end())
+               message_id = known_id->second;
+            else
+               message_id = bts::net::message(trx_message(eval_state->trx)).id();
+            message_ids[eval_state] = message_id;
+            pending_by_message_id[message_id] = eval_state;
+            pending_items.emplace_back(trx_message_type, message_id);
+         }
+         _pending_transaction_message_ids.swap(message_ids);
+
+         // only what our peers may not have seen, spread over the interval in batches that each go out
+         // as one inventory message per peer; they're already pending here, so they aren't evaluated again
+         std::vector<bts::net::item_id> items_to_rebroadcast = _p2p_node->get_items_peers_may_lack(pending_items);
+         wlog( "rebroadcasting ${count} of ${trx_count}", ("count",items_to_rebroadcast.size())("trx_count",pending_items.size()) );
+         const size_t batch_size = (items_to_rebroadcast.size() + BTS_NET_PENDING_REBROADCAST_BATCHES - 1) / BTS_NET_PENDING_REBROADCAST_BATCHES;
+         for (size_t batch_start = 0; batch_start < items_to_rebroadcast.size(); batch_start += batch_size)
+         {
+            if (batch_start > 0)
+            {
+               fc::usleep(fc::microseconds(rebroadcast_interval.count() / BTS_NET_PENDING_REBROADCAST_BATCHES));
+               if (_sync_mode)
+                  break;
+            }
+            const std::vector<bts::net::item_id> batch(items_to_rebroadcast.begin() + batch_start,
+                                                       items_to_rebroadcast.begin() + std::min(batch_start + batch_size, items_to_rebroadcast.size()));
+            // peers may have caught up on some while we waited
+            for (const bts::net::item_id& item : _p2p_node->get_items_peers_may_lack(batch))
+               _p2p_node->broadcast(trx_message(pending_by_message_id[item.item_hash]->trx));
          }
       }
       catch ( const fc::canceled_exception& )
@@ -701,26 +769,149 @@ void client_impl::rebroadcast_pending_loop()
    }
    if (!_rebroadcast_pending_loop_done.canceled())
       _rebroadcast_pending_loop_done = fc::schedule( [=](){ rebroadcast_pending_loop(); },
-      fc::time_point::now() + fc::seconds((int64_t)(BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC * 1.3)),
+      std::max(next_rebroadcast_time, fc::time_point::now()),
       "rebroadcast_pending" );
 }
 
+void client_impl::start_memory_stats_log_loop()
+{
+   if (_config.memory_stats_log_interval_sec == 0)
+      return;
+   if (!_memory_stats_log_loop_done.valid() || _memory_stats_log_loop_done.ready())
+      _memory_stats_log_loop_done = fc::schedule( [=](){ memory_stats_log_loop(); },
+      fc::time_point::now() + fc::seconds(_config.memory_stats_log_interval_sec),
+      "memory_stats_log" );
+}
+
+void client_impl::cancel_memory_stats_log_loop()
+{
+   try
+   {
+      _memory_stats_log_loop_done.cancel_and_wait(__FUNCTION__);
+   }
+   catch (const fc::exception& e)
+   {
+      wlog("Unexpected error from memory_stats_log_loop(): ${e}", ("e", e));
+   }
+}
+
+void client_impl::memory_stats_log_loop()
+{
+   try
+   {
+      ilog( "memory usage: ${stats}", ("stats",fc::json::to_string( debug_memory_stats() )) );
+   }
+   catch ( const fc::exception& e )
+   {
+      wlog( "error collecting memory statistics: ${e}", ("e",e.to_detail_string() ) );
+   }
+   if (!_memory_stats_log_loop_done.canceled())
+      _memory_stats_log_loop_done = fc::schedule( [=](){ memory_stats_log_loop(); },
+      fc::time_point::now() + fc::seconds(_config.memory_stats_log_interval_sec),
+      "memory_stats_log" );
+}
+
+void client_impl::start_stall_heartbeat()
+{
+   bts::utilities::stall_detector::instance().set_threshold( fc::milliseconds( _config.task_stall_threshold_ms ) );
+   if (!_stall_heartbeat_done.valid() || _stall_heartbeat_done.ready())
+      _stall_heartbeat_done = fc::async( [](){ bts::utilities::stall_detector::instance().heartbeat_loop( fc::milliseconds(100) ); },
+                                         "stall_heartbeat" );
+}
+
+void client_impl::cancel_stall_heartbeat()
+{
+   try
+   {
+      _stall_heartbeat_done.cancel_and_wait(__FUNCTION__);
+   }
+   catch (const fc::exception& e)
+   {
+      wlog("Unexpected error from stall_heartbeat: ${e}", ("e", e));
+   }
+}
+
+void client_impl::start_follow_primary_loop()
+{
+   if (!_follow_primary_loop_done.valid() || _follow_primary_loop_done.ready())
+      _follow_primary_loop_done = fc::async( [=](){ follow_primary_loop(); }, "follow_primary" );
+}
+
+void client_impl::cancel_follow_primary_loop()
+{
+   try
+   {
+      _follow_primary_loop_done.cancel_and_wait(__FUNCTION__);
+   }
+   catch (const fc::exception& e)
+   {
+      wlog("Unexpected error from follow_primary_loop(): ${e}", ("e", e));
+   }
+}
+
+/* Blocks are applied in batches so RPC calls are served while a follower catches up */
+void client_impl::follow_primary_loop()
+{
+   const uint32_t batch_size = 1000;
+   uint32_t blocks_read = 0;
+   try
+   {
+      blocks_read = _chain_db->follow_primary( batch_size );
+   }
+   catch ( const fc::canceled_exception& )
+   {
+      throw;
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "error following the primary: ${e}", ("e",e.to_detail_string() ) );
+   }
+   if (!_follow_primary_loop_done.canceled())
+      _follow_primary_loop_done = fc::schedule( [=](){ follow_primary_loop(); },
+      fc::time_point::now() + (blocks_read == batch_size ? fc::microseconds(0) : fc::seconds(1)),
+      "follow_primary" );
+}
+
 ///////////////////////////////////////////////////////
 // Implement chain_client_delegate                   //
 ///////////////////////////////////////////////////////
+void client_impl::on_sync_block_timing(const block_timing& timing)
+{
+   const auto smooth = [](fc::microseconds& average, fc::microseconds measured) {
+      average = average.count() == 0 ? measured : fc::microseconds((average.count() * 7 + measured.count()) / 8);
+   };
+   smooth(_sync_block_timing.recover_signers, timing.recover_signers);
+   smooth(_sync_block_timing.execute_markets, timing.execute_markets);
+   smooth(_sync_block_timing.apply_transactions, timing.apply_transactions);
+   smooth(_sync_block_timing.save_undo_state, timing.save_undo_state);
+   smooth(_sync_block_timing.apply_changes, timing.apply_changes);
+   smooth(_sync_block_timing.total, timing.total);
+   _sync_block_timing.block_num = timing.block_num;
+   _sync_block_timing.block_id = timing.block_id;
+   _sync_block_timing.transaction_count = timing.transaction_count;
+}
+
 block_fork_data client_impl::on_new_block(const full_block& block,
                                           const block_id_type& block_id,
                                           bool sync_mode)
 {
    try
    {
+      // blocks are timed step by step only while syncing, where the breakdown is reported
+      if (sync_mode != _sync_mode)
+      {
+         if (sync_mode)
+            _chain_db->set_block_timing_callback([this](const block_timing& timing) { on_sync_block_timing(timing); });
+         else
+            _chain_db->set_block_timing_callback(std::function<void(const block_timing&)>());
+      }
       _sync_mode = sync_mode;
       if (sync_mode && _remaining_items_to_sync > 0)
          --_remaining_items_to_sync;
       try
       {
          FC_ASSERT( !_simulate_disconnect );
-         ilog("Received a new block from the p2p network, current head block is ${num}, "
+         hot_ilog("Received a new block from the p2p network, current head block is ${num}, "
               "new block is ${block}, current head block is ${num}",
               ("num", _chain_db->get_head_block_num())("block", block)("num", _chain_db->get_head_block_num()));
          fc::optional<block_fork_data> fork_data = _chain_db->get_block_fork_data( block_id );
@@ -738,7 +929,7 @@ block_fork_data client_impl::on_new_block(const full_block& block,
             block_fork_data result = _chain_db->push_block(block);
             if (sync_mode && !result.is_linked)
                FC_THROW_EXCEPTION(bts::blockchain::unlinkable_block, "The blockchain accepted this block, but it isn't linked");
-            ilog("After push_block, current head block is ${num}", ("num", _chain_db->get_head_block_num()));
+            hot_ilog("After push_block, current head block is ${num}", ("num", _chain_db->get_head_block_num()));
 
             fc::time_point_sec now = blockchain::now();
             fc::time_point_sec head_block_timestamp = _chain_db->now();
@@ -778,6 +969,23 @@ block_fork_data client_impl::on_new_block(const full_block& block,
                   else
                      speed_message << "--- currently syncing at an imperceptible rate";
                   ulog(speed_message.str());
+
+                  const fc::variant_object network_stats = _p2p_node->get_sync_stats();
+                  const fc::variant_object per_block = network_stats["per_block"].get_object();
+                  const fc::variant_object queues = network_stats["queues"].get_object();
+                  const auto ms = [](int64_t microseconds) { return double(microseconds) / 1000; };
+                  std::ostringstream breakdown_message;
+                  breakdown_message << std::fixed << std::setprecision(1)
+                                    << "--- per block: fetch " << ms(per_block["fetch_us"].as_int64()) << " ms"
+                                    << ", waiting for earlier blocks " << ms(per_block["backlog_wait_us"].as_int64()) << " ms"
+                                    << ", handling " << ms(per_block["handling_us"].as_int64()) << " ms"
+                                    << " (signatures " << ms(_sync_block_timing.recover_signers.count())
+                                    << ", state " << ms(_sync_block_timing.execute_markets.count() + _sync_block_timing.apply_transactions.count())
+                                    << ", database writes " << ms(_sync_block_timing.save_undo_state.count() + _sync_block_timing.apply_changes.count())
+                                    << "); queued: " << queues["blocks_requested"].as_uint64() << " requested, "
+                                    << queues["blocks_waiting_for_earlier_blocks"].as_uint64() << " waiting, "
+                                    << queues["blocks_being_handled"].as_uint64() << " being handled";
+                  ulog(breakdown_message.str());
                }
                _last_sync_status_message_time = now;
                _last_sync_status_head_block = current_head_block_num;
@@ -800,7 +1008,13 @@ block_fork_data client_impl::on_new_block(const full_block& block,
 
 bool client_impl::on_new_transaction(const signed_transaction& trx)
 {
+   // stateless checks first, their rejections are counted by the chain database rather than stored here
+   if( !_chain_db->prefilter_transaction(trx) )
+      return false;
+
    try {
+      // recover the signers on a worker thread, leaving this thread free for blocks and other transactions meanwhile
+      _chain_db->preverify_transaction(trx).wait();
       // throws exception if invalid trx, don't override limits
       return !!_chain_db->store_pending_transaction(trx, false);
    }
@@ -836,6 +1050,31 @@ bool client_impl::has_item(const bts::net::item_id& id)
    return false;
 }
 
+void client_impl::pre_validate_message(const bts::net::message& message_to_validate)
+{
+   try
+   {
+      if (message_to_validate.msg_type == block_message_type)
+         _chain_db->preverify_block(message_to_validate.as<block_message>().block);
+   }
+   catch (const fc::exception& e)
+   {
+      // the block will be rejected with a proper error when it is handled
+      dlog("unable to pre-validate block: ${e}", ("e", e.to_detail_string()));
+   }
+}
+
+bool client_impl::verify_block_header(const bts::net::message& message_to_verify)
+{
+   if (message_to_verify.msg_type != block_message_type)
+      return false;
+   const block_message block_message_to_verify(message_to_verify.as<block_message>());
+   if (block_message_to_verify.block.previous != _chain_db->get_head_block_id())
+      return false;
+   _chain_db->verify_block_header(block_message_to_verify.block);
+   return true;
+}
+
 bool client_impl::handle_message(const bts::net::message& message_to_handle, bool sync_mode)
 {
    try
@@ -845,7 +1084,7 @@ bool client_impl::handle_message(const bts::net::message& message_to_handle, boo
       case block_message_type:
       {
          block_message block_message_to_handle(message_to_handle.as<block_message>());
-         ilog("CLIENT: just received block ${id}", ("id", block_message_to_handle.block.id()));
+         ilog("CLIENT: just received block ${id}", ("id", block_message_to_handle.block_id));
          bts::blockchain::block_id_type old_head_block = _chain_db->get_head_block_id();
          block_fork_data fork_data = on_new_block(block_message_to_handle.block, block_message_to_handle.block_id, sync_mode);
          return fork_data.is_included ^ (block_message_to_handle.block.previous == old_head_block);  // TODO is this right?
@@ -864,6 +1103,16 @@ bool client_impl::handle_message(const bts::net::message& message_to_handle, boo
       FC_THROW_EXCEPTION(bts::net::insufficient_relay_fee, "Insufficient relay fee; do not propagate!",
                          ("original_exception", original_exception.to_detail_string()));
    }
+   catch (const bts::blockchain::pending_pool_full& original_exception)
+   {
+      FC_THROW_EXCEPTION(bts::net::insufficient_relay_fee, "Pending pool is full; do not propagate!",
+                         ("original_exception", original_exception.to_detail_string()));
+   }
+   catch (const bts::blockchain::too_many_pending_transactions& original_exception)
+   {
+      FC_THROW_EXCEPTION(bts::net::insufficient_relay_fee, "Too many pending transactions from signer; do not propagate!",
+                         ("original_exception", original_exception.to_detail_string()));
+   }
    catch (const bts::blockchain::block_older_than_undo_history& original_exception)
    {
       FC_THROW_EXCEPTION(bts::net::block_older_than_undo_history, "Block is older than undo history, stop fetching blocks!",
@@ -1053,7 +1302,7 @@ std::vector<bts::net::item_hash_t> client_impl::get_blockchain_synopsis(uint32_t
       // if it's <= non_fork_high_block_num, we grab it from the main blockchain;
       // if it's not, we pull it from the fork history
       if (low_block_num <= non_fork_high_block_num)
-         synopsis.push_back(_chain_db->get_block(low_block_num).id());
+         synopsis.push_back(_chain_db->get_block_id(low_block_num));
       else
          synopsis.push_back(fork_history[low_block_num - non_fork_high_block_num - 1]);
       low_block_num += ((true_high_block_num - low_block_num + 2) / 2);
@@ -1067,10 +1316,31 @@ bts::net::message client_impl::get_item(const bts::net::item_id& id)
 {
    if (id.item_type == block_message_type)
    {
-      //   uint32_t block_number = _chain_db->get_block_num(id.item_hash);
-      bts::client::block_message block_message_to_send(_chain_db->get_block(id.item_hash));
-      FC_ASSERT(id.item_hash == block_message_to_send.block_id); //.id());
-      //   block_message_to_send.signature = block_message_to_send.block.delegate_signature;
+      // syncing peers ask for the same blocks over and over, so keep the last ones we sent ready to go
+      auto cached = _served_block_message_index.find(id.item_hash);
+      if (cached != _served_block_message_index.end())
+      {
+         _served_block_messages.splice(_served_block_messages.begin(), _served_block_messages, cached->second);
+         return cached->second->second;
+      }
+
+      // a block_message packs as the block followed by its id, so build it from the stored bytes without decoding
+      bts::net::message block_message_to_send;
+      block_message_to_send.msg_type = block_message_type;
+      block_message_to_send.data = _chain_db->get_packed_block(id.item_hash);
+      const std::vector<char> packed_block_id = fc::raw::pack(id.item_hash);
+      block_message_to_send.data.insert(block_message_to_send.data.end(), packed_block_id.begin(), packed_block_id.end());
+      block_message_to_send.size = (uint32_t)block_message_to_send.data.size();
+
+      _served_block_messages.emplace_front(id.item_hash, block_message_to_send);
+      _served_block_message_index[id.item_hash] = _served_block_messages.begin();
+      _served_block_message_bytes += block_message_to_send.data.size();
+      while (_served_block_message_bytes > BTS_NET_SERVED_BLOCK_CACHE_BYTES && _served_block_messages.size() > 1)
+      {
+         _served_block_message_bytes -= _served_block_messages.back().second.data.size();
+         _served_block_message_index.erase(_served_block_messages.back().first);
+         _served_block_messages.pop_back();
+      }
       return block_message_to_send;
    }
 
@@ -1159,6 +1429,26 @@ fc::time_point_sec client_impl::get_block_time(const bts::net::item_hash_t& bloc
    }
 }
 
+std::vector<bts::blockchain::signed_block_header> client_impl::get_block_headers(const std::vector<bts::net::item_hash_t>& block_ids)
+{
+   std::vector<bts::blockchain::signed_block_header> headers;
+   headers.reserve(block_ids.size());
+   try
+   {
+      for (const bts::net::item_hash_t& block_id : block_ids)
+         headers.push_back(_chain_db->get_block_header(block_id));
+   }
+   catch ( const fc::canceled_exception& )
+   {
+      throw;
+   }
+   catch (const fc::exception&)
+   {
+      // we don't have this one, return the headers before it
+   }
+   return headers;
+}
+
 fc::time_point_sec client_impl::get_blockchain_now()
 {
    ASSERT_TASK_NOT_PREEMPTED();
@@ -1175,6 +1465,11 @@ uint32_t client_impl::estimate_last_known_fork_from_git_revision_timestamp(uint3
    return 0; // there are no forks in the test net
 }
 
+uint32_t client_impl::get_first_full_block_number() const
+{
+   return _chain_db->get_first_full_block_num();
+}
+
 void client_impl::error_encountered(const std::string& message, const fc::oexception& error)
 {
    if (error)
@@ -1281,6 +1576,29 @@ void client::open( const path& data_dir, fc::optional<fc::path> genesis_file_pat
          //FIXME: is it really correct to continue here without rethrowing?
       }
 
+      my->_chain_db->set_unified_store( my->_config.unified_chain_store );
+      my->_chain_db->set_pending_pool_budget( my->_config.pending_pool_budget );
+      my->_chain_db->set_prune_depth( my->_config.prune_blocks_older_than );
+      my->_chain_db->set_address_history_index( my->_config.address_history_index );
+      if( my->_config.follow_primary_data_dir )
+         my->_chain_db->set_primary_data_dir( *my->_config.follow_primary_data_dir );
+      my->_chain_db->set_market_candle_resolutions( my->_config.market_candle_resolutions );
+      my->_chain_db->set_market_history_retention( my->_config.market_history_retention_sec );
+      if( my->_config.assume_valid_block )
+         my->_chain_db->set_assume_valid_block( my->_config.assume_valid_block->first, my->_config.assume_valid_block->second );
+
+      if( my->_config.state_sync && !my->_config.chain_servers.empty() && !fc::exists( data_dir / "chain" ) )
+      {
+         const fc::path snapshot_file = data_dir / "state_sync.snapshot";
+         bts::net::chain_downloader downloader;
+         for( const auto& server : my->_config.chain_servers )
+            downloader.add_chain_server( fc::ip::endpoint::from_string( server ) );
+         downloader.get_state_snapshot( my->_config.state_sync->block_num, my->_config.state_sync->snapshot_hash, snapshot_file ).wait();
+         my->_chain_db->bootstrap_from_index_snapshot( data_dir / "chain", snapshot_file, my->_config.state_sync->snapshot_hash );
+         fc::remove_all( snapshot_file );
+         ulog( "Bootstrapped the chain from the state snapshot at block ${n}", ("n",my->_config.state_sync->block_num) );
+      }
+
       bool attempt_to_recover_database = false;
       try
       {
@@ -1306,9 +1624,11 @@ void client::open( const path& data_dir, fc::optional<fc::path> genesis_file_pat
          fc::remove_all(data_dir / "chain");
          my->_chain_db->open(data_dir / "chain", genesis_file_path, reindex_status_callback);
       }
+      my->_chain_db->set_integrity_check_interval( my->_config.integrity_check_interval_sec );
 
       my->_wallet = std::make_shared<bts::wallet::wallet>( my->_chain_db, my->_config.wallet_enabled );
       my->_wallet->set_data_directory( data_dir / "wallets" );
+      my->_wallet_host = std::make_shared<bts::wallet::wallet_host>( my->_chain_db, data_dir / "wallets" );
 
       if (my->_config.mail_server_enabled)
       {
@@ -1324,6 +1644,8 @@ void client::open( const path& data_dir, fc::optional<fc::path> genesis_file_pat
       my->_p2p_node->set_node_delegate(my.get());
 
       my->start_rebroadcast_pending_loop();
+      my->start_memory_stats_log_loop();
+      my->start_stall_heartbeat();
    } FC_RETHROW_EXCEPTIONS( warn, "", ("data_dir",data_dir) ) }
 
 client::~client()
@@ -1390,6 +1712,14 @@ fc::variant_object version_info()
 
 void client::start_networking(std::function<void()> network_started_callback)
 {
+   if( my->_chain_db->is_follower() )
+   {
+      // a follower gets its blocks from the primary's block log, never from peers
+      ulog( "Following the chain in ${dir}", ("dir",*my->_config.follow_primary_data_dir) );
+      my->start_follow_primary_loop();
+      return;
+   }
+
    //Start chain_downloader if there are chain_servers to connect to; otherwise, just start p2p immediately
    if( !my->_config.chain_servers.empty() )
    {
@@ -1458,9 +1788,45 @@ void client::configure_from_command_line(int argc, char** argv)
    if (option_variables.count("snapshot-dir"))
       my->_chain_db->save_snapshots_in( option_variables["snapshot-dir"].as<string>() );
 
+   if (option_variables.count("prune-blocks-older-than"))
+      my->_config.prune_blocks_older_than = option_variables["prune-blocks-older-than"].as<uint32_t>();
+
+   if (option_variables.count("address-history-index"))
+      my->_config.address_history_index = true;
+
+   if (option_variables.count("follow-primary"))
+      my->_config.follow_primary_data_dir = fc::path( option_variables["follow-primary"].as<string>() );
+
+   if (option_variables.count("state-sync-checkpoint"))
+   {
+      const string checkpoint = option_variables["state-sync-checkpoint"].as<string>();
+      const auto separator = checkpoint.find( ':' );
+      FC_ASSERT( separator != string::npos, "expected BLOCK:SHA256, got ${c}", ("c",checkpoint) );
+      state_sync_checkpoint state_sync;
+      state_sync.block_num = std::stoul( checkpoint.substr( 0, separator ) );
+      state_sync.snapshot_hash = fc::sha256( checkpoint.substr( separator + 1 ) );
+      my->_config.state_sync = state_sync;
+   }
+
+   if (option_variables.count("assume-valid"))
+   {
+      const string assume_valid = option_variables["assume-valid"].as<string>();
+      const auto separator = assume_valid.find( ':' );
+      FC_ASSERT( separator != string::npos, "expected BLOCK:ID, got ${a}", ("a",assume_valid) );
+      my->_config.assume_valid_block = std::make_pair( uint32_t( std::stoul( assume_valid.substr( 0, separator ) ) ),
+                                                       block_id_type( assume_valid.substr( separator + 1 ) ) );
+   }
+
    my->_enable_ulog = option_variables["ulog"].as<bool>();
    this->open( datadir, genesis_file_path );
 
+   if (option_variables.count("import-blocks"))
+   {
+      const fc::path bootstrap_file = option_variables["import-blocks"].as<string>();
+      const uint32_t imported = my->_chain_db->import_blocks( bootstrap_file );
+      ulog( "Imported ${n} blocks from ${file}", ("n",imported)("file",bootstrap_file) );
+   }
+
    if (option_variables.count("min-delegate-connection-count"))
       my->_min_delegate_connection_count = option_variables["min-delegate-connection-count"].as<uint32_t>();
 
@@ -1826,7 +2192,7 @@ void client_impl::debug_update_logging_config()
 }
 
 //This function is here insetad of in general_api.cpp because it needs extract_commands_from_log_file()
-void client_impl::execute_script(const fc::path& script_filename) const
+void client_impl::execute_script(const fc::path& script_filename, bool batch) const
 {
    if (_cli)
    {
@@ -1834,7 +2200,10 @@ void client_impl::execute_script(const fc::path& script_filename) const
          FC_THROW_EXCEPTION(fc::file_not_found_exception, "Script file not found!");
       string input_commands = extract_commands_from_log_file(script_filename);
       std::stringstream input_stream(input_commands);
-      _cli->process_commands( &input_stream );
+      if (batch)
+         _cli->process_batch_commands( &input_stream );
+      else
+         _cli->process_commands( &input_stream );
       _cli->process_commands( &std::cin );
    }
 }
@@ -1,6 +1,8 @@
+#include <bts/blockchain/evaluation_profiler.hpp>
 #include <bts/blockchain/time.hpp>
 #include <bts/client/client.hpp>
 #include <bts/client/client_impl.hpp>
+#include <bts/utilities/stall_detector.hpp>
 
 namespace bts { namespace client { namespace detail {
 
@@ -113,6 +115,78 @@ fc::variant_object client_impl::debug_get_call_statistics() const
    return _p2p_node->get_call_statistics();
 }
 
+fc::variant_object client_impl::debug_get_storage_statistics() const
+{
+   return _chain_db->get_storage_stats();
+}
+
+fc::variant_object client_impl::debug_get_rpc_cache_statistics() const
+{
+   return _rpc_server->get_call_cache_stats();
+}
+
+fc::variant_object client_impl::debug_memory_stats() const
+{
+   const fc::variant_object chain = _chain_db->get_memory_stats();
+   uint64_t total_bytes = chain["total_bytes"].as_uint64();
+
+   fc::mutable_variant_object stats;
+   stats["chain"] = chain;
+   if( _p2p_node )
+   {
+      const fc::variant_object network = _p2p_node->get_memory_stats();
+      total_bytes += network["total_bytes"].as_uint64();
+      stats["network"] = network;
+   }
+
+   if( _wallet && _wallet->is_open() )
+   {
+      const fc::variant_object wallet = _wallet->get_memory_stats();
+      total_bytes += wallet["total_bytes"].as_uint64();
+      stats["wallet"] = wallet;
+   }
+   if( _wallet_host )
+   {
+      fc::mutable_variant_object hosted_wallets;
+      for( const string& wallet_name : _wallet_host->list_wallets() )
+      {
+         const fc::variant_object wallet = _wallet_host->get_wallet( wallet_name )->get_memory_stats();
+         total_bytes += wallet["total_bytes"].as_uint64();
+         hosted_wallets[ wallet_name ] = wallet;
+      }
+      stats["hosted_wallets"] = hosted_wallets;
+   }
+
+   const uint64_t rpc_call_cache_bytes = _rpc_server ? _rpc_server->get_call_cache_memory_usage() : 0;
+   total_bytes += rpc_call_cache_bytes;
+   stats["rpc_call_cache_bytes"] = rpc_call_cache_bytes;
+   stats["total_bytes"] = total_bytes;
+   return stats;
+}
+
+fc::variant_object client_impl::debug_rpc_stats() const
+{
+   return _rpc_server->get_method_stats();
+}
+
+void client_impl::debug_enable_evaluation_profiling( bool enable_flag )
+{
+   auto& profiler = bts::blockchain::evaluation_profiler::instance();
+   if( enable_flag && !profiler.enabled() )
+      profiler.clear();
+   profiler.set_enabled( enable_flag );
+}
+
+fc::variant_object client_impl::debug_get_evaluation_statistics() const
+{
+   return bts::blockchain::evaluation_profiler::instance().get_stats();
+}
+
+fc::variant_object client_impl::debug_get_task_statistics() const
+{
+   return bts::utilities::stall_detector::instance().get_stats();
+}
+
 fc::variant_object client_impl::debug_verify_delegate_votes() const
 {
    return _chain_db->find_delegate_vote_discrepancies();
@@ -1,5 +1,6 @@
 #pragma once
 #include <bts/blockchain/chain_database.hpp>
+#include <bts/blockchain/config.hpp>
 #include <bts/wallet/wallet.hpp>
 #include <bts/net/node.hpp>
 #include <bts/rpc/rpc_client_api.hpp>
@@ -49,6 +50,14 @@ namespace bts { namespace client {
       fc::ip::endpoint httpd_endpoint;
       fc::path         htdocs;
 
+      /** calls of each cost class that may run at once and that may wait for a turn, see bts::api::method_cost_class */
+      uint32_t         max_normal_calls = 16;
+      uint32_t         max_queued_normal_calls = 256;
+      uint32_t         max_expensive_calls = 1;
+      uint32_t         max_queued_expensive_calls = 4;
+      /** a call still waiting for its turn after this long is rejected */
+      uint32_t         call_queue_timeout_ms = 10000;
+
       bool is_valid() const; /* Currently just checks if rpc port is set */
     };
 
@@ -63,6 +72,13 @@ namespace bts { namespace client {
         uint16_t listen_port;
     };
 
+    /** an index snapshot a new node may start from instead of downloading and applying the whole chain */
+    struct state_sync_checkpoint
+    {
+        uint32_t    block_num = 0;
+        fc::sha256  snapshot_hash; // of the whole snapshot file, as chain_server sends it
+    };
+
     struct config
     {
        config( ) :
@@ -77,6 +93,15 @@ namespace bts { namespace client {
           wallet_enabled(true),
           ignore_console(false),
           use_upnp(true),
+          unified_chain_store(false),
+          pending_pool_budget(BTS_BLOCKCHAIN_PENDING_POOL_BUDGET),
+          prune_blocks_older_than(0),
+          address_history_index(false),
+          integrity_check_interval_sec(BTS_BLOCKCHAIN_DEFAULT_INTEGRITY_CHECK_INTERVAL_SEC),
+          memory_stats_log_interval_sec(600),
+          task_stall_threshold_ms(500),
+          market_candle_resolutions(BTS_BLOCKCHAIN_MARKET_CANDLE_RESOLUTIONS),
+          market_history_retention_sec(0),
           maximum_number_of_connections(BTS_NET_DEFAULT_MAX_CONNECTIONS) ,
           delegate_server( fc::ip::endpoint::from_string("0.0.0.0:0") ),
           default_delegate_peers( vector<string>({"178.62.50.61:9988"}) )
@@ -100,6 +125,18 @@ namespace bts { namespace client {
           bool                wallet_enabled;
           bool                ignore_console;
           bool                use_upnp;
+          bool                unified_chain_store;
+          uint64_t            pending_pool_budget; // bytes of pending transactions to keep
+          uint32_t            prune_blocks_older_than; // blocks whose bodies are kept, 0 keeps them all
+          bool                address_history_index; // index transactions by address for explorers
+          uint32_t            integrity_check_interval_sec; // 0 disables the background integrity checks
+          uint32_t            memory_stats_log_interval_sec; // 0 disables logging debug_memory_stats
+          uint32_t            task_stall_threshold_ms; // log tasks that run this long without yielding, 0 disables logging
+          optional<fc::path>  follow_primary_data_dir; // serve the chain of the node using this data directory
+          optional<state_sync_checkpoint> state_sync; // bootstrap an empty chain from this snapshot on the chain servers
+          optional<std::pair<uint32_t, block_id_type>> assume_valid_block; // signatures before this block are not checked
+          vector<uint32_t>    market_candle_resolutions; // seconds per candle of each kept resolution
+          uint32_t            market_history_retention_sec; // seconds of per-block market history kept, 0 keeps it all
           optional<fc::path>  genesis_config;
           uint16_t            maximum_number_of_connections;
           fc::logging_config  logging;
@@ -196,11 +233,25 @@ namespace bts { namespace client {
 extern const std::string BTS_MESSAGE_MAGIC;
 
 FC_REFLECT(bts::client::client_notification, (timestamp)(message)(signature) )
-FC_REFLECT( bts::client::rpc_server_config, (enable)(rpc_user)(rpc_password)(rpc_endpoint)(httpd_endpoint)(htdocs) )
+FC_REFLECT( bts::client::rpc_server_config, (enable)(rpc_user)(rpc_password)(rpc_endpoint)(httpd_endpoint)(htdocs)
+            (max_normal_calls)(max_queued_normal_calls)(max_expensive_calls)(max_queued_expensive_calls)(call_queue_timeout_ms) )
 FC_REFLECT( bts::client::chain_server_config, (enabled)(listen_port) )
+FC_REFLECT( bts::client::state_sync_checkpoint, (block_num)(snapshot_hash) )
 FC_REFLECT( bts::client::config,
             (rpc)(default_peers)(chain_servers)(chain_server)(mail_server_enabled)
             (wallet_enabled)(ignore_console)(logging)
+            (unified_chain_store)
+            (pending_pool_budget)
+            (prune_blocks_older_than)
+            (address_history_index)
+            (integrity_check_interval_sec)
+            (memory_stats_log_interval_sec)
+            (task_stall_threshold_ms)
+            (follow_primary_data_dir)
+            (state_sync)
+            (assume_valid_block)
+            (market_candle_resolutions)
+            (market_history_retention_sec)
             (delegate_server)
             (default_delegate_peers)
             (growl_notify_endpoint)
@@ -5,6 +5,7 @@
 #include <bts/db/level_map.hpp>
 #include <bts/net/upnp.hpp>
 #include <bts/net/chain_server.hpp>
+#include <bts/wallet/wallet_host.hpp>
 
 #include <fc/log/appender.hpp>
 
@@ -16,6 +17,8 @@
 #include <boost/accumulators/statistics/rolling_mean.hpp>
 
 #include <iostream>
+#include <list>
+#include <map>
 #include <fstream>
 
 // delegate network breaks win32
@@ -151,6 +154,9 @@ public:
    {
       cancel_blocks_too_old_monitor_task();
       cancel_rebroadcast_pending_loop();
+      cancel_memory_stats_log_loop();
+      cancel_stall_heartbeat();
+      cancel_follow_primary_loop();
       if( _chain_downloader_future.valid() && !_chain_downloader_future.ready() )
          _chain_downloader_future.cancel_and_wait(__FUNCTION__);
       _rpc_server.reset(); // this needs to shut down before the _p2p_node because several RPC requests will try to dereference _p2p_node.  Shutting down _rpc_server kills all active/pending requests
@@ -190,11 +196,28 @@ public:
    void rebroadcast_pending_loop();
    fc::future<void> _rebroadcast_pending_loop_done;
 
+   void start_memory_stats_log_loop();
+   void cancel_memory_stats_log_loop();
+   void start_stall_heartbeat();
+   void cancel_stall_heartbeat();
+   void memory_stats_log_loop();
+   fc::future<void> _memory_stats_log_loop_done;
+   fc::future<void> _stall_heartbeat_done;
+
+   void start_follow_primary_loop();
+   void cancel_follow_primary_loop();
+   void follow_primary_loop();
+   fc::future<void> _follow_primary_loop_done;
+   /** message ids of the pending transactions as of the last rebroadcast, so they're only hashed once */
+   std::map<transaction_evaluation_state_ptr, bts::net::message_hash_type> _pending_transaction_message_ids;
+
    void configure_rpc_server(config& cfg,
                              const program_options::variables_map& option_variables);
    void configure_chain_server(config& cfg,
                                const program_options::variables_map& option_variables);
 
+   /** folds the timing of a block applied during sync into _sync_block_timing */
+   void on_sync_block_timing(const block_timing& timing);
    block_fork_data on_new_block(const full_block& block,
                                 const block_id_type& block_id,
                                 bool sync_mode);
@@ -207,6 +230,8 @@ public:
    // @{
    virtual bool has_item(const bts::net::item_id& id) override;
    virtual bool handle_message(const bts::net::message&, bool sync_mode) override;
+   virtual void pre_validate_message(const bts::net::message&) override;
+   virtual bool verify_block_header(const bts::net::message&) override;
    virtual std::vector<bts::net::item_hash_t> get_item_ids(uint32_t item_type,
                                                            const vector<bts::net::item_hash_t>& blockchain_synopsis,
                                                            uint32_t& remaining_item_count,
@@ -224,9 +249,11 @@ public:
    virtual void connection_count_changed(uint32_t c) override;
    virtual uint32_t get_block_number(const bts::net::item_hash_t& block_id) override;
    virtual fc::time_point_sec get_block_time(const bts::net::item_hash_t& block_id) override;
+   virtual std::vector<bts::blockchain::signed_block_header> get_block_headers(const std::vector<bts::net::item_hash_t>& block_ids) override;
    virtual fc::time_point_sec get_blockchain_now() override;
    virtual bts::net::item_hash_t get_head_block_id() const override;
    virtual uint32_t estimate_last_known_fork_from_git_revision_timestamp(uint32_t unix_timestamp) const override;
+   virtual uint32_t get_first_full_block_number() const override;
    virtual void error_encountered(const std::string& message, const fc::oexception& error) override;
    /// @}
 
@@ -256,7 +283,17 @@ public:
    std::unique_ptr<bts::net::upnp_service>                 _upnp_service = nullptr;
    chain_database_ptr                                      _chain_db = nullptr;
    unordered_map<transaction_id_type, signed_transaction>  _pending_trxs;
+
+   /** block_messages recently served to peers, already packed, most recently used first; see get_item() */
+   ///@{
+   typedef std::list<std::pair<block_id_type, bts::net::message> > served_block_message_list;
+   served_block_message_list                               _served_block_messages;
+   unordered_map<block_id_type, served_block_message_list::iterator> _served_block_message_index;
+   size_t                                                  _served_block_message_bytes = 0;
+   ///@}
    wallet_ptr                                              _wallet = nullptr;
+   /** further wallets served at once, see the wallet_host_* methods */
+   bts::wallet::wallet_host_ptr                            _wallet_host = nullptr;
    std::shared_ptr<bts::mail::server>                      _mail_server = nullptr;
    std::shared_ptr<bts::mail::client>                      _mail_client = nullptr;
    fc::future<void>                                        _delegate_loop_complete;
@@ -266,6 +303,8 @@ public:
    uint32_t                                                _last_sync_status_head_block;
    uint32_t                                                _remaining_items_to_sync;
    boost::accumulators::accumulator_set<double, boost::accumulators::stats<boost::accumulators::tag::rolling_mean> > _sync_speed_accumulator;
+   /** time per block spent in each step of applying it during sync, smoothed over the last blocks */
+   block_timing                                            _sync_block_timing;
 
    fc::future<void>                                        _chain_downloader_future;
    bool                                                    _chain_downloader_running = false;
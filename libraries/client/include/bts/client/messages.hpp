@@ -7,7 +7,9 @@ namespace bts { namespace client {
    enum message_type_enum
    {
       trx_message_type          = 1000,
-      block_message_type        = 1001
+      block_message_type        = 1001,
+      compact_block_message_type = 1002,
+      block_headers_message_type = 1003
    };
 
    struct trx_message
@@ -34,8 +36,51 @@ namespace bts { namespace client {
 
    };
 
+   /**
+    *  A block_message with its transactions replaced by their ids, sent instead of the block_message
+    *  to peers that asked for it.  The receiver rebuilds the block_message from transactions it has
+    *  already relayed and fetches the full block_message if any are missing.
+    */
+   struct compact_block_message
+   {
+      static const message_type_enum type;
+
+      compact_block_message(){}
+      compact_block_message( const block_message& full, const fc::uint160_t& full_message_hash )
+      :block_header(full.block),block_id(full.block_id),block_message_hash(full_message_hash)
+      {
+         transaction_ids.reserve( full.block.user_transactions.size() );
+         for( const auto& trx : full.block.user_transactions )
+            transaction_ids.push_back( trx.id() );
+      }
+
+      bts::blockchain::signed_block_header               block_header;
+      std::vector<bts::blockchain::transaction_id_type>  transaction_ids;
+      bts::blockchain::block_id_type                     block_id;
+      /** id of the block_message this stands for, which is what the receiver requested */
+      fc::uint160_t                                      block_message_hash;
+   };
+
+   /**
+    *  Reply to a fetch_items_message of block_headers_message_type, whose hashes are block ids.  Holds the
+    *  headers of the requested blocks in the order asked for, stopping at the first block the sender
+    *  doesn't have, so a syncing node can check the chain it was offered before downloading any bodies.
+    */
+   struct block_headers_message
+   {
+      static const message_type_enum type;
+
+      block_headers_message(){}
+      block_headers_message( std::vector<bts::blockchain::signed_block_header> headers )
+      :headers( std::move( headers ) ){}
+
+      std::vector<bts::blockchain::signed_block_header> headers;
+   };
+
 } } // bts::client
 
-FC_REFLECT_ENUM( bts::client::message_type_enum, (trx_message_type)(block_message_type) )
+FC_REFLECT_ENUM( bts::client::message_type_enum, (trx_message_type)(block_message_type)(compact_block_message_type)(block_headers_message_type) )
 FC_REFLECT( bts::client::trx_message, (trx) )
 FC_REFLECT( bts::client::block_message, (block)(block_id) )
+FC_REFLECT( bts::client::compact_block_message, (block_header)(transaction_ids)(block_id)(block_message_hash) )
+FC_REFLECT( bts::client::block_headers_message, (headers) )
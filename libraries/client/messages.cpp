@@ -3,5 +3,7 @@ namespace bts { namespace client {
 
    const message_type_enum trx_message::type                 = message_type_enum::trx_message_type;
    const message_type_enum block_message::type               = message_type_enum::block_message_type;
+   const message_type_enum compact_block_message::type       = message_type_enum::compact_block_message_type;
+   const message_type_enum block_headers_message::type       = message_type_enum::block_headers_message_type;
 
 } } // bts::client
@@ -59,6 +59,11 @@ bts::net::message_propagation_data detail::client_impl::network_get_transaction_
    FC_THROW_EXCEPTION(fc::invalid_operation_exception, "get_transaction_propagation_data only valid in p2p mode");
 }
 
+fc::variant_object detail::client_impl::network_get_block_propagation_statistics()
+{
+   return _p2p_node->get_block_propagation_statistics();
+}
+
 bts::net::message_propagation_data detail::client_impl::network_get_block_propagation_data(const block_id_type& block_id)
 {
    return _p2p_node->get_block_propagation_data(block_id);
@@ -75,6 +80,24 @@ fc::variant_object client_impl::network_get_usage_stats() const
    return _p2p_node->network_get_usage_stats();
 }
 
+fc::variant_object client_impl::network_get_sync_stats() const
+{
+   fc::mutable_variant_object block_application;
+   block_application["recover_signers_us"] = _sync_block_timing.recover_signers.count();
+   block_application["execute_markets_us"] = _sync_block_timing.execute_markets.count();
+   block_application["apply_transactions_us"] = _sync_block_timing.apply_transactions.count();
+   block_application["save_undo_state_us"] = _sync_block_timing.save_undo_state.count();
+   block_application["apply_changes_us"] = _sync_block_timing.apply_changes.count();
+   block_application["total_us"] = _sync_block_timing.total.count();
+
+   fc::mutable_variant_object result;
+   result["syncing"] = _sync_mode;
+   result["remaining_blocks"] = _remaining_items_to_sync;
+   result["network"] = _p2p_node->get_sync_stats();
+   result["block_application"] = block_application;
+   return result;
+}
+
 vector<bts::net::potential_peer_record> client_impl::network_list_potential_peers()const
 {
    return _p2p_node->get_potential_peers();
@@ -201,6 +201,32 @@ wallet_transaction_record detail::client_impl::wallet_transfer_from(
     return record;
 }
 
+vector<wallet_transaction_record> detail::client_impl::wallet_transfer_batch(
+        const string& paying_account_name,
+        const vector<bts::wallet::transfer_request>& transfers,
+        const vote_selection_method& selection_method )
+{
+    const auto builders = _wallet->transfer_batch(paying_account_name, transfers, selection_method);
+
+    vector<wallet_transaction_record> records;
+    records.reserve(builders.size());
+    for( const auto& builder : builders )
+    {
+        records.push_back(builder->transaction_record);
+        network_broadcast_transaction(builder->transaction_record.trx);
+    }
+    for( size_t i = 0; i < builders.size(); ++i )
+    {
+        const auto recipient = _wallet->get_account(transfers[i].to_account_name);
+        for( auto&& notice : builders[i]->encrypted_notifications() )
+            _mail_client->send_encrypted_message(std::move(notice),
+                                                 paying_account_name,
+                                                 transfers[i].to_account_name,
+                                                 recipient.owner_key);
+    }
+    return records;
+}
+
 wallet_transaction_record detail::client_impl::wallet_asset_create(
         const string& symbol,
         const string& asset_name,
@@ -241,6 +267,36 @@ vector<string> detail::client_impl::wallet_list() const
   return _wallet->list();
 }
 
+void detail::client_impl::wallet_host_open( const string& wallet_name, const string& passphrase )
+{ try {
+  const string trimmed_name = fc::trim( wallet_name );
+  FC_ASSERT( !_wallet->is_open() || _wallet->get_wallet_name() != trimmed_name, "Wallet is already open!" );
+  _wallet_host->open_wallet( trimmed_name, passphrase );
+} FC_RETHROW_EXCEPTIONS( warn, "", ("wallet_name",wallet_name) ) }
+
+void detail::client_impl::wallet_host_close( const string& wallet_name )
+{ try {
+  _wallet_host->close_wallet( fc::trim( wallet_name ) );
+} FC_RETHROW_EXCEPTIONS( warn, "", ("wallet_name",wallet_name) ) }
+
+vector<string> detail::client_impl::wallet_host_list() const
+{
+  return _wallet_host->list_wallets();
+}
+
+account_balance_summary_type detail::client_impl::wallet_host_account_balance( const string& wallet_name,
+                                                                              const string& account_name )const
+{ try {
+  return _wallet_host->get_wallet( wallet_name )->get_account_balances( account_name );
+} FC_RETHROW_EXCEPTIONS( warn, "", ("wallet_name",wallet_name)("account_name",account_name) ) }
+
+vector<pretty_transaction> detail::client_impl::wallet_host_account_transaction_history( const string& wallet_name,
+                                                                                         const string& account_name,
+                                                                                         int32_t limit )const
+{ try {
+  return _wallet_host->get_wallet( wallet_name )->get_pretty_transaction_history( account_name, 0, -1, "", limit );
+} FC_RETHROW_EXCEPTIONS( warn, "", ("wallet_name",wallet_name)("account_name",account_name)("limit",limit) ) }
+
 vector<wallet_account_record> detail::client_impl::wallet_list_accounts() const
 {
   return _wallet->list_accounts();
@@ -284,19 +340,7 @@ vector<pretty_transaction> detail::client_impl::wallet_account_transaction_histo
                                                                                     uint32_t start_block_num,
                                                                                     uint32_t end_block_num )const
 { try {
-  const auto history = _wallet->get_pretty_transaction_history( account_name, start_block_num, end_block_num, asset_symbol );
-  if( limit == 0 || abs( limit ) >= history.size() )
-  {
-      return history;
-  }
-  else if( limit > 0 )
-  {
-      return vector<pretty_transaction>( history.begin(), history.begin() + limit );
-  }
-  else
-  {
-      return vector<pretty_transaction>( history.end() - abs( limit ), history.end() );
-  }
+  return _wallet->get_pretty_transaction_history( account_name, start_block_num, end_block_num, asset_symbol, limit );
 } FC_RETHROW_EXCEPTIONS( warn, "") }
 
 void detail::client_impl::wallet_remove_transaction( const string& transaction_id )
@@ -1,30 +1,83 @@
 #pragma once
+#include <bts/db/flat_map.hpp>
 #include <bts/db/level_map.hpp>
 #include <fc/thread/thread.hpp>
+#include <list>
 #include <map>
+#include <type_traits>
 
 namespace bts { namespace db {
 
+   /** whether iterators into a CacheType stay valid while other entries are inserted and erased */
+   template<typename CacheType>
+   struct cache_keeps_iterators : std::true_type {};
+
+   template<typename Key, typename Value, typename Compare>
+   struct cache_keeps_iterators<flat_map<Key,Value,Compare>> : std::false_type {};
+
+   /**
+    *  Keeps an in-memory copy of a level_map.
+    *
+    *  By default every record is loaded into the cache when the database is opened. If a non-zero
+    *  cache_budget is passed to open(), records are instead loaded on first access and the least
+    *  recently used ones are evicted once the packed size of the cached values exceeds the budget.
+    *  Records that have not been flushed yet are never evicted. In that mode iteration is served
+    *  by the underlying LevelDB iterator, so begin/find/lower_bound/last keep their semantics.
+    *
+    *  Records may be stored and removed while iterating. With a CacheType such as flat_map, whose
+    *  iterators do not survive that, an iterator over the cache remembers the key it is at and seeks
+    *  to it again after the cache changed; if that record was removed it moves on to the next one.
+    */
    template<typename Key, typename Value, class CacheType = std::map<Key,Value>>
    class cached_level_map
    {
       public:
-        void open( const fc::path& dir, bool create = true, size_t leveldb_cache_size = 0, bool write_through = true, bool sync_on_write = false )
+        void open( const fc::path& dir, bool create = true, size_t leveldb_cache_size = 0, bool write_through = true,
+                   bool sync_on_write = false, size_t cache_budget = 0 )
+        {
+            level_map_options options;
+            options.create = create;
+            options.cache_size = leveldb_cache_size;
+            open( dir, options, write_through, sync_on_write, cache_budget );
+        }
+
+        void open( const fc::path& dir, const level_map_options& options, bool write_through = true,
+                   bool sync_on_write = false, size_t cache_budget = 0 )
         { try {
-            _db.open( dir, create, leveldb_cache_size );
-            for( auto itr = _db.begin(); itr.valid(); ++itr )
-                _cache[ itr.key() ] = itr.value();
+            _db.open( dir, options );
+            _cache_budget = cache_budget;
+            if( !is_bounded() ) preload();
+            _write_through = write_through;
+            _sync_on_write = sync_on_write;
+        } FC_CAPTURE_AND_RETHROW( (dir)(options)(write_through)(sync_on_write)(cache_budget) ) }
+
+        void register_with( unified_store& store, uint8_t prefix )const
+        {
+            _db.register_with( store, prefix );
+        }
+
+        /** opens this table inside a shared store, see level_map::open */
+        void open( unified_store& store, uint8_t prefix, bool write_through = true, bool sync_on_write = false,
+                   size_t cache_budget = 0 )
+        { try {
+            _db.open( store, prefix );
+            _cache_budget = cache_budget;
+            if( !is_bounded() ) preload();
             _write_through = write_through;
             _sync_on_write = sync_on_write;
-        } FC_CAPTURE_AND_RETHROW( (dir)(create)(leveldb_cache_size)(write_through)(sync_on_write) ) }
+        } FC_CAPTURE_AND_RETHROW( (prefix)(write_through)(sync_on_write)(cache_budget) ) }
 
         void close()
         { try {
-            flush();
+            flush_dirty();
             _db.close();
             _cache.clear();
+            ++_cache_version;
             _dirty_store.clear();
             _dirty_remove.clear();
+            _lru.clear();
+            _lru_index.clear();
+            _cache_bytes = 0;
         } FC_CAPTURE_AND_RETHROW() }
 
         void set_write_through( bool write_through )
@@ -34,70 +87,123 @@ namespace bts { namespace db {
             _write_through = write_through;
         } FC_CAPTURE_AND_RETHROW( (write_through) ) }
 
+        /** writes the dirty records; with async flushing enabled this only waits for the previous flush */
         void flush()
         { try {
-            typename level_map<Key, Value>::write_batch batch = _db.create_batch( _sync_on_write );
-            for( const auto& key : _dirty_store )
-                batch.store( key, _cache.at( key ) );
-            for( const auto& key : _dirty_remove )
-                batch.remove( key );
-            batch.commit();
-
-            _dirty_store.clear();
-            _dirty_remove.clear();
+            flush_dirty( _writer != nullptr );
         } FC_CAPTURE_AND_RETHROW() }
 
+        /**
+         *  While writer is set, flush() snapshots the dirty records into a batch that writer commits in
+         *  the background, and at most one such batch is in flight. With max_dirty > 0 a flush is
+         *  started as soon as that many records are dirty, so a slow disk throttles the producer.
+         *  Reads and writes that need the database wait for the in-flight batch first. Pass nullptr to
+         *  return to synchronous flushing; writer must outlive any batch it was given.
+         */
+        void set_async_flush( fc::thread* writer, size_t max_dirty = 0 )
+        { try {
+            wait_for_flush();
+            _writer = writer;
+            _max_dirty = max_dirty;
+        } FC_CAPTURE_AND_RETHROW( (max_dirty) ) }
+
+        /** @return true if the cache only holds a bounded subset of the database */
+        bool is_bounded()const { return _cache_budget > 0; }
+
         fc::optional<Value> fetch_optional( const Key& key )const
         { try {
-            const auto itr = _cache.find( key );
-            if( itr != _cache.end() )
-                return itr->second;
+            const Value* value = fetch_pointer( key );
+            if( value != nullptr )
+                return *value;
             return fc::optional<Value>();
         } FC_CAPTURE_AND_RETHROW( (key) ) }
 
-        Value fetch( const Key& key )const
+        /**
+         *  fetch_optional without the copy: the cached value, or nullptr if there is none. It is only valid
+         *  until the next call that changes this map, which when bounded includes any fetch or iteration.
+         */
+        const Value* fetch_pointer( const Key& key )const
         { try {
-            const auto itr = _cache.find( key );
+            auto itr = _cache.find( key );
             if( itr != _cache.end() )
-                return itr->second;
+            {
+                ++_cache_hits;
+                if( is_bounded() ) touch( key, itr->second );
+                return &itr->second;
+            }
+            ++_cache_misses;
+            if( !load( key ) )
+                return nullptr;
+            itr = _cache.find( key );
+            FC_ASSERT( itr != _cache.end() );
+            return &itr->second;
+        } FC_CAPTURE_AND_RETHROW( (key) ) }
+
+        Value fetch( const Key& key )const
+        { try {
+            const auto value = fetch_optional( key );
+            if( value.valid() )
+                return *value;
             FC_CAPTURE_AND_THROW( fc::key_not_found_exception, (key) );
         } FC_CAPTURE_AND_RETHROW( (key) ) }
 
         void store( const Key& key, const Value& value )
         { try {
             _cache[ key ] = value;
+            ++_cache_version;
             if( _write_through )
             {
+                wait_for_flush();
                 _db.store( key, value, _sync_on_write );
             }
             else
             {
                 _dirty_store.insert( key );
                 _dirty_remove.erase( key );
+                if( dirty_limit_reached() ) flush();
+            }
+            if( is_bounded() )
+            {
+                touch( key, value );
+                evict();
             }
         } FC_CAPTURE_AND_RETHROW( (key)(value) ) }
 
         void remove( const Key& key )
         { try {
             _cache.erase( key );
+            ++_cache_version;
+            if( is_bounded() ) forget( key );
             if( _write_through )
             {
+                wait_for_flush();
                 _db.remove( key, _sync_on_write );
             }
             else
             {
                 _dirty_store.erase( key );
                 _dirty_remove.insert( key );
+                if( dirty_limit_reached() ) flush();
             }
         } FC_CAPTURE_AND_RETHROW( (key) ) }
 
         size_t size()const
         { try {
+            if( is_bounded() )
+            {
+                flush_dirty();
+                return _db.size();
+            }
             return _cache.size();
         } FC_CAPTURE_AND_RETHROW() }
 
         bool last( Key& key )const
         { try {
+            if( is_bounded() )
+            {
+                flush_dirty();
+                return _db.last( key );
+            }
             const auto ritr = _cache.crbegin();
             if( ritr != _cache.crend() )
             {
@@ -109,6 +215,11 @@ namespace bts { namespace db {
 
         bool last( Key& key, Value& value )
         { try {
+            if( is_bounded() )
+            {
+                flush_dirty();
+                return _db.last( key, value );
+            }
             const auto ritr = _cache.crbegin();
             if( ritr != _cache.crend() )
             {
@@ -123,24 +234,68 @@ namespace bts { namespace db {
         {
            public:
              iterator(){}
-             bool valid()const { return _it != _end; }
+             bool valid()const
+             {
+                if( _point.valid() ) return true;
+                if( _use_db ) return _db_it.valid();
+                reseek();
+                return _it != _end;
+             }
+
+             Key key()const
+             {
+                if( _point.valid() ) return _point->first;
+                if( _use_db ) return _db_it.key();
+                reseek();
+                return _it->first;
+             }
+
+             Value value()const
+             {
+                if( _point.valid() ) return _point->second;
+                if( _use_db ) return _db_it.value();
+                reseek();
+                return _it->second;
+             }
 
-             Key   key()const { return _it->first; }
-             Value value()const { return _it->second; }
+             iterator& operator++()
+             {
+                if( _use_db )
+                {
+                   seek_from_point();
+                   ++_db_it;
+                }
+                else
+                {
+                   reseek();
+                   // if the record it was at was removed, reseek already moved on to the next one
+                   if( !_at.valid() || ( _it != _end && !( *_at < _it->first ) ) )
+                      ++_it;
+                   track();
+                }
+                return *this;
+             }
 
-             iterator& operator++()    { ++_it; return *this; }
              iterator  operator++(int) {
                 auto backup = *this;
-                ++_it;
+                operator++();
                 return backup;
              }
 
              iterator& operator--()
              {
-                if( _it == _begin )
-                   _it = _end;
+                if( _use_db )
+                {
+                   seek_from_point();
+                   --_db_it;
+                }
                 else
-                   --_it;
+                {
+                   reseek();
+                   if( _it == _begin ) _it = _end;
+                   else                --_it;
+                   track();
+                }
                 return *this;
              }
 
@@ -150,7 +305,13 @@ namespace bts { namespace db {
                 return backup;
              }
 
-             void reset() { _it = _end; }
+             void reset()
+             {
+                _it = _end;
+                _at.reset();
+                _point.reset();
+                _db_it = typename level_map<Key,Value>::iterator();
+             }
 
            protected:
              friend class cached_level_map;
@@ -158,46 +319,306 @@ namespace bts { namespace db {
              :_it(it),_begin(begin),_end(end)
              { }
 
-             typename CacheType::const_iterator _it;
-             typename CacheType::const_iterator _begin;
-             typename CacheType::const_iterator _end;
+             /** an iterator over the cache of map that finds its position again if the cache changes */
+             iterator( const cached_level_map* map, typename CacheType::const_iterator it, const fc::optional<Key>& upper )
+             :_it(it),_begin(map->_cache.begin()),_end(upper.valid() ? map->_cache.lower_bound( *upper ) : map->_cache.end()),
+              _map(map),_upper(upper)
+             {
+                track();
+             }
+
+             /** remembers the current key and the cache version it was found in */
+             void track()
+             {
+                if( _map == nullptr ) return;
+                _version = _map->_cache_version;
+                if( _it != _end ) _at = _it->first;
+                else              _at.reset();
+             }
+
+             void reseek()const
+             {
+                if( _map == nullptr || _version == _map->_cache_version ) return;
+                const CacheType& cache = _map->_cache;
+                _begin = cache.begin();
+                _end = _upper.valid() ? cache.lower_bound( *_upper ) : cache.end();
+                _it = _at.valid() ? cache.lower_bound( *_at ) : _end;
+                _version = _map->_cache_version;
+             }
+
+             iterator( const typename level_map<Key,Value>::iterator& db_it )
+             :_use_db(true),_db_it(db_it)
+             { }
+
+             /** a single record answered by the cache; a LevelDB iterator is only created if the caller moves */
+             iterator( const level_map<Key,Value>* db, const Key& key, const Value& value )
+             :_use_db(true),_db(db),_point( std::make_pair( key, value ) )
+             { }
+
+             void seek_from_point()
+             {
+                if( !_point.valid() ) return;
+                _db_it = _db->lower_bound( _point->first );
+                _point.reset();
+             }
+
+             mutable typename CacheType::const_iterator _it;
+             mutable typename CacheType::const_iterator _begin;
+             mutable typename CacheType::const_iterator _end;
+
+             /** only set for a cache whose iterators are invalidated by changes, see cache_keeps_iterators */
+             const cached_level_map*                    _map = nullptr;
+             mutable uint64_t                           _version = 0;
+             fc::optional<Key>                          _at;
+             fc::optional<Key>                          _upper;
+
+             bool                                       _use_db = false;
+             typename level_map<Key,Value>::iterator    _db_it;
+             const level_map<Key,Value>*                _db = nullptr;
+             fc::optional<std::pair<Key,Value>>         _point;
         };
 
         iterator begin()const
         {
-           return iterator( _cache.begin(), _cache.begin(), _cache.end() );
+           if( is_bounded() )
+           {
+              flush_dirty();
+              return iterator( _db.begin() );
+           }
+           return cache_iterator( _cache.begin() );
         }
 
         iterator last()
         {
+           if( is_bounded() )
+           {
+              flush_dirty();
+              return iterator( _db.last() );
+           }
            if( _cache.empty() )
-              return iterator( _cache.end(), _cache.begin(), _cache.end() );
-           return iterator( --_cache.end(), _cache.begin(), _cache.end() );
+              return cache_iterator( _cache.end() );
+           return cache_iterator( --_cache.end() );
         }
 
         iterator find( const Key& key )
         {
-           return iterator( _cache.find(key), _cache.begin(), _cache.end() );
+           if( is_bounded() )
+           {
+              flush_dirty();
+              const auto value = fetch_optional( key );
+              if( value.valid() )
+                 return iterator( &_db, key, *value );
+              return iterator( typename level_map<Key,Value>::iterator() );
+           }
+           return cache_iterator( _cache.find(key) );
         }
 
         iterator lower_bound( const Key& key )
         {
-           return iterator( _cache.lower_bound(key), _cache.begin(), _cache.end() );
+           if( is_bounded() )
+           {
+              flush_dirty();
+              return iterator( _db.lower_bound( key ) );
+           }
+           return cache_iterator( _cache.lower_bound(key) );
+        }
+
+        /** approximate bytes held by the cache: the packed values when bounded, else the fixed size of each entry */
+        size_t cache_memory_usage()const
+        {
+            if( is_bounded() )
+                return _cache_bytes + _lru_index.size() * ( 2 * sizeof( Key ) + 6 * sizeof( void* ) );
+            return _cache.size() * ( sizeof( Key ) + sizeof( Value ) + 4 * sizeof( void* ) );
+        }
+
+        uint64_t leveldb_memory_usage()const { return _db.leveldb_memory_usage(); }
+
+        /** counters of the underlying level_map, with hits and misses counted at the cache */
+        level_map_stats get_stats()const
+        { try {
+            level_map_stats result = _db.get_stats();
+            result.hits = _cache_hits;
+            result.misses = _cache_misses;
+            result.cache_entries = _cache.size();
+            if( is_bounded() ) result.cache_bytes = _cache_bytes;
+            return result;
+        } FC_CAPTURE_AND_RETHROW() }
+
+        /** iterates the keys in [lower, upper), see level_map::range */
+        iterator range( const Key& lower, const Key& upper )const
+        {
+           FC_ASSERT( !( upper < lower ) );
+           if( is_bounded() )
+           {
+              flush_dirty();
+              return iterator( _db.range( lower, upper ) );
+           }
+           return cache_iterator( _cache.lower_bound( lower ), upper );
+        }
+
+        /** records that are not flushed yet would be missing from the snapshot, so there must be none */
+        typename level_map<Key, Value>::snapshot take_snapshot()const
+        { try {
+            wait_for_flush();
+            FC_ASSERT( _dirty_store.empty() && _dirty_remove.empty(), "unflushed records would be missing from the snapshot" );
+            return _db.take_snapshot();
+        } FC_CAPTURE_AND_RETHROW() }
+
+        /** reads LevelDB directly, bypassing the cache, see level_map::snapshot_range */
+        typename level_map<Key, Value>::iterator snapshot_range( const typename level_map<Key, Value>::snapshot& snap,
+                                                                 const fc::optional<Key>& lower = fc::optional<Key>(),
+                                                                 const fc::optional<Key>& upper = fc::optional<Key>() )const
+        {
+            return _db.snapshot_range( snap, lower, upper );
         }
 
         // TODO: Iterate over cache instead
         void export_to_json( const fc::path& path )const
         { try {
+            if( is_bounded() ) flush_dirty();
             _db.export_to_json( path );
         } FC_CAPTURE_AND_RETHROW( (path) ) }
 
       private:
-        level_map<Key, Value>    _db;
-        CacheType                _cache;
-        std::set<Key>            _dirty_store;
-        std::set<Key>            _dirty_remove;
-        bool                     _write_through = true;
-        bool                     _sync_on_write = false;
+        iterator cache_iterator( typename CacheType::const_iterator it, const fc::optional<Key>& upper = fc::optional<Key>() )const
+        {
+           if( cache_keeps_iterators<CacheType>::value )
+              return iterator( it, _cache.begin(), upper.valid() ? _cache.lower_bound( *upper ) : _cache.end() );
+           return iterator( this, it, upper );
+        }
+
+        void preload()
+        {
+            for( auto itr = _db.begin(); itr.valid(); ++itr )
+                _cache[ itr.key() ] = itr.value();
+            ++_cache_version;
+        }
+
+        void flush_dirty( bool async = false )const
+        {
+            wait_for_flush();
+            if( _dirty_store.empty() && _dirty_remove.empty() )
+                return;
+
+            typename level_map<Key, Value>::write_batch batch = _db.create_batch( _sync_on_write );
+            for( const auto& key : _dirty_store )
+                batch.store( key, _cache.at( key ) );
+            for( const auto& key : _dirty_remove )
+                batch.remove( key );
+            if( async )
+                _pending_flush = batch.commit_async( *_writer );
+            else
+                batch.commit();
+
+            _dirty_store.clear();
+            _dirty_remove.clear();
+
+            if( is_bounded() ) evict();
+        }
+
+        void wait_for_flush()const
+        {
+            if( !_pending_flush.valid() ) return;
+            auto pending = _pending_flush;
+            _pending_flush = fc::future<void>();
+            pending.wait();
+        }
+
+        bool dirty_limit_reached()const
+        {
+            return _max_dirty > 0 && _dirty_store.size() + _dirty_remove.size() >= _max_dirty;
+        }
+
+        /** @return true if key was read from LevelDB into the cache */
+        bool load( const Key& key )const
+        {
+            if( !is_bounded() || _dirty_remove.count( key ) )
+                return false;
+
+            wait_for_flush();
+
+            auto value = _db.fetch_optional( key );
+            if( !value.valid() )
+                return false;
+            touch( key, *value );
+            _cache[ key ] = std::move( *value );
+            ++_cache_version;
+            evict();
+            return true;
+        }
+
+        /** moves key to the front of the LRU list and updates its accounted size */
+        void touch( const Key& key, const Value& value )const
+        {
+            const size_t value_size = fc::raw::pack_size( value );
+            auto itr = _lru_index.find( key );
+            if( itr != _lru_index.end() )
+            {
+                _cache_bytes -= itr->second.second;
+                _lru.splice( _lru.begin(), _lru, itr->second.first );
+                itr->second.second = value_size;
+            }
+            else
+            {
+                _lru.push_front( key );
+                _lru_index[ key ] = std::make_pair( _lru.begin(), value_size );
+            }
+            _cache_bytes += value_size;
+        }
+
+        void forget( const Key& key )const
+        {
+            auto itr = _lru_index.find( key );
+            if( itr == _lru_index.end() ) return;
+            _cache_bytes -= itr->second.second;
+            _lru.erase( itr->second.first );
+            _lru_index.erase( itr );
+        }
+
+        /**
+         *  drops least recently used records that have already been written to LevelDB, always keeping the
+         *  most recently used one so a record just fetched stays in the cache
+         */
+        void evict()const
+        {
+            auto ritr = _lru.rbegin();
+            while( _cache_bytes > _cache_budget && ritr != _lru.rend() )
+            {
+                const Key& key = *ritr;
+                if( _dirty_store.count( key ) || &key == &_lru.front() )
+                {
+                    ++ritr;
+                    continue;
+                }
+                const auto index_itr = _lru_index.find( key );
+                _cache_bytes -= index_itr->second.second;
+                _cache.erase( key );
+                ++_cache_version;
+                ritr = typename std::list<Key>::reverse_iterator( _lru.erase( std::next( ritr ).base() ) );
+                _lru_index.erase( index_itr );
+            }
+        }
+
+        typedef std::list<Key> lru_list;
+
+        mutable level_map<Key, Value>    _db;
+        mutable CacheType                _cache;
+        mutable std::set<Key>            _dirty_store;
+        mutable std::set<Key>            _dirty_remove;
+        bool                             _write_through = true;
+        bool                             _sync_on_write = false;
+        fc::thread*                      _writer = nullptr;
+        size_t                           _max_dirty = 0;
+        mutable fc::future<void>         _pending_flush;
+        mutable uint64_t                 _cache_hits = 0;
+        mutable uint64_t                 _cache_misses = 0;
+        /** bumped on every change to _cache, so iterators into it know to seek again */
+        mutable uint64_t                 _cache_version = 0;
+
+        size_t                                                                  _cache_budget = 0;
+        mutable size_t                                                          _cache_bytes = 0;
+        mutable lru_list                                                        _lru;
+        mutable std::map<Key, std::pair<typename lru_list::iterator, size_t>>   _lru_index;
    };
 
 } }
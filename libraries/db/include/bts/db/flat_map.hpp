@@ -0,0 +1,135 @@
+#pragma once
+
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace bts { namespace db {
+
+   /**
+    *  @brief a std::map replacement that keeps its entries in one sorted, contiguous vector
+    *
+    *  Intended as the CacheType of cached_level_map for small, read-mostly tables. Lookup and
+    *  iteration touch far fewer cache lines than a red-black tree and there is no per-entry
+    *  allocation, at the cost of O(n) inserts and removes. Like std::vector, any insert or
+    *  erase invalidates outstanding iterators.
+    */
+   template<typename Key, typename Value, typename Compare = std::less<Key>>
+   class flat_map
+   {
+      public:
+         typedef Key                                             key_type;
+         typedef Value                                           mapped_type;
+         typedef std::pair<Key,Value>                            value_type;
+         typedef std::vector<value_type>                         container_type;
+         typedef typename container_type::size_type              size_type;
+         typedef typename container_type::iterator               iterator;
+         typedef typename container_type::const_iterator         const_iterator;
+         typedef typename container_type::reverse_iterator       reverse_iterator;
+         typedef typename container_type::const_reverse_iterator const_reverse_iterator;
+
+         iterator               begin()        { return _items.begin(); }
+         const_iterator         begin()const   { return _items.begin(); }
+         iterator               end()          { return _items.end(); }
+         const_iterator         end()const     { return _items.end(); }
+         const_iterator         cbegin()const  { return _items.cbegin(); }
+         const_iterator         cend()const    { return _items.cend(); }
+         reverse_iterator       rbegin()       { return _items.rbegin(); }
+         reverse_iterator       rend()         { return _items.rend(); }
+         const_reverse_iterator crbegin()const { return _items.crbegin(); }
+         const_reverse_iterator crend()const   { return _items.crend(); }
+
+         bool      empty()const { return _items.empty(); }
+         size_type size()const  { return _items.size(); }
+         void      clear()      { _items.clear(); }
+         void      reserve( size_type n ) { _items.reserve( n ); }
+
+         iterator lower_bound( const Key& key )
+         {
+            return std::lower_bound( _items.begin(), _items.end(), key, key_less() );
+         }
+         const_iterator lower_bound( const Key& key )const
+         {
+            return std::lower_bound( _items.begin(), _items.end(), key, key_less() );
+         }
+
+         iterator upper_bound( const Key& key )
+         {
+            return std::upper_bound( _items.begin(), _items.end(), key, key_less() );
+         }
+         const_iterator upper_bound( const Key& key )const
+         {
+            return std::upper_bound( _items.begin(), _items.end(), key, key_less() );
+         }
+
+         iterator find( const Key& key )
+         {
+            auto itr = lower_bound( key );
+            if( itr != _items.end() && !Compare()( key, itr->first ) ) return itr;
+            return _items.end();
+         }
+         const_iterator find( const Key& key )const
+         {
+            auto itr = lower_bound( key );
+            if( itr != _items.end() && !Compare()( key, itr->first ) ) return itr;
+            return _items.end();
+         }
+
+         size_type count( const Key& key )const { return find( key ) != end() ? 1 : 0; }
+
+         Value& at( const Key& key )
+         {
+            auto itr = find( key );
+            FC_ASSERT( itr != _items.end(), "key not found in flat_map" );
+            return itr->second;
+         }
+         const Value& at( const Key& key )const
+         {
+            auto itr = find( key );
+            FC_ASSERT( itr != _items.end(), "key not found in flat_map" );
+            return itr->second;
+         }
+
+         Value& operator[]( const Key& key )
+         {
+            auto itr = lower_bound( key );
+            if( itr == _items.end() || Compare()( key, itr->first ) )
+               itr = _items.insert( itr, value_type( key, Value() ) );
+            return itr->second;
+         }
+
+         std::pair<iterator,bool> insert( const value_type& item )
+         {
+            auto itr = lower_bound( item.first );
+            if( itr != _items.end() && !Compare()( item.first, itr->first ) )
+               return std::make_pair( itr, false );
+            return std::make_pair( _items.insert( itr, item ), true );
+         }
+
+         iterator erase( const_iterator itr )
+         {
+            return _items.erase( _items.begin() + ( itr - _items.cbegin() ) );
+         }
+
+         size_type erase( const Key& key )
+         {
+            auto itr = find( key );
+            if( itr == _items.end() ) return 0;
+            _items.erase( itr );
+            return 1;
+         }
+
+      private:
+         struct key_less
+         {
+            bool operator()( const value_type& item, const Key& key )const { return Compare()( item.first, key ); }
+            bool operator()( const Key& key, const value_type& item )const { return Compare()( key, item.first ); }
+         };
+
+         container_type _items;
+   };
+
+} } // bts::db
@@ -6,12 +6,16 @@
 #include <leveldb/write_batch.h>
 
 #include <bts/db/exception.hpp>
+#include <bts/db/level_map_options.hpp>
+#include <bts/db/level_map_stats.hpp>
+#include <bts/db/unified_store.hpp>
 #include <bts/db/upgrade_leveldb.hpp>
 
 #include <fc/filesystem.hpp>
 #include <fc/io/json.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/reflect/reflect.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <fstream>
 
@@ -21,82 +25,140 @@ namespace bts { namespace db {
 
   /**
    *  @brief implements a high-level API on top of Level DB that stores items using fc::raw / reflection
+   *
+   *  A map either owns its own LevelDB instance or lives inside a unified_store, in which case every
+   *  key is stored behind the one byte prefix of the table. Keys are stored as described by key_format.
    */
   template<typename Key, typename Value>
   class level_map
   {
      public:
         void open( const fc::path& dir, bool create = true, size_t cache_size = 0 )
+        {
+           level_map_options options;
+           options.create = create;
+           options.cache_size = cache_size;
+           open( dir, options );
+        }
+
+        /**
+         *  With options.online_upgrade, a table holding an older record type is not converted here.
+         *  Instead new and converted records go to a sibling "<dir>-upgrade" database, reads fall back
+         *  to the old database and decode the legacy format, iterators merge the records of both in key
+         *  order, and upgrade_step() moves the remaining records over. Once it finishes the new database
+         *  replaces the old one on the next open.
+         */
+        void open( const fc::path& dir, const level_map_options& options )
         { try {
            ldb::Options opts;
-           opts.comparator = &_comparer;
-           opts.create_if_missing = create;
-           opts.max_open_files = 64;
-           opts.compression = leveldb::kNoCompression;
+           opts.comparator = key_format<Key>::comparator();
+           apply_level_map_options( options, opts, _cache, _filter_policy );
+
+           _read_options.verify_checksums = true;
+           _iter_options.verify_checksums = true;
+           _iter_options.fill_cache = false;
+           _sync_options.sync = true;
 
-           if( cache_size > 0 )
+           const char* record_type = fc::get_typename<Value>::name();
+           const fc::path upgrade_dir = fc::path( dir.string() + "-upgrade" );
+           if( fc::exists( upgrade_dir / "UPGRADE_COMPLETE" ) )
            {
-               opts.write_buffer_size = cache_size / 4; // up to two write buffers may be held in memory simultaneously
-               _cache.reset( leveldb::NewLRUCache( cache_size / 2 ) );
-               opts.block_cache = _cache.get();
+              fc::remove_all( dir );
+              fc::rename( upgrade_dir, dir );
            }
+           if( fc::exists( dir / "UPGRADE_COMPLETE" ) )
+              fc::remove( dir / "UPGRADE_COMPLETE" );
+           prepare_key_format( dir, opts, ordered_keys() );
 
-           if( ldb::kMajorVersion > 1 || ( leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16 ) )
+           // an interrupted online upgrade must be resumed even if it is no longer requested
+           fc::optional<upgrade_record_function> converter;
+           if( options.online_upgrade || fc::exists( upgrade_dir ) )
+              converter = find_online_upgrade( dir, record_type );
+
+           if( !converter.valid() )
            {
-               // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
-               // on corruption in later versions.
-               opts.paranoid_checks = true;
+              _db.reset( open_db( opts, dir ) );
+              try_upgrade_db( dir, _db.get(), record_type, sizeof( Value ) );
+              return;
            }
 
+           _upgrade.reset( new upgrade_state );
+           _upgrade->source.reset( open_db( opts, dir ) );
+           _upgrade->convert = *converter;
+           _upgrade->dir = upgrade_dir;
+           prepare_key_format( upgrade_dir, opts, ordered_keys() );
+           _db.reset( open_db( opts, upgrade_dir ) );
+           write_record_type( upgrade_dir, record_type, sizeof( Value ) );
+        } FC_CAPTURE_AND_RETHROW( (dir)(options) ) }
+
+        /** registers the key ordering of this table with store; must be called before store is opened */
+        void register_with( unified_store& store, uint8_t prefix )const
+        {
+           store.register_table<Key>( prefix );
+        }
+
+        /** opens this table inside a shared store, all keys are stored behind prefix */
+        void open( unified_store& store, uint8_t prefix )
+        { try {
+           FC_ASSERT( store.is_open(), "Unified store is not open!" );
+           FC_ASSERT( store.is_registered( prefix ), "Table prefix was not registered before the store was opened" );
+
            _read_options.verify_checksums = true;
            _iter_options.verify_checksums = true;
            _iter_options.fill_cache = false;
            _sync_options.sync = true;
 
-           // Given path must exist to succeed toNativeAnsiPath
-           fc::create_directories( dir );
-           std::string ldbPath = dir.to_native_ansi_path();
-
-           ldb::DB* ndb = nullptr;
-           auto ntrxstat = ldb::DB::Open( opts, ldbPath.c_str(), &ndb );
-           if( !ntrxstat.ok() )
-           {
-               FC_THROW_EXCEPTION( db_in_use_exception, "Unable to open database ${db}\n\t${msg}",
-                                   ("db",dir)("msg",ntrxstat.ToString()) );
-           }
-           _db.reset( ndb );
-
-           try_upgrade_db( dir, ndb, fc::get_typename<Value>::name(), sizeof( Value ) );
-        } FC_CAPTURE_AND_RETHROW( (dir)(create)(cache_size) ) }
+           _store = &store;
+           _prefix = std::string( 1, char( prefix ) );
+        } FC_CAPTURE_AND_RETHROW( (prefix) ) }
 
         bool is_open()const
         {
+          if( _store != nullptr ) return _store->is_open();
           return !!_db;
         }
 
         void close()
         {
+          _upgrade.reset();
           _db.reset();
           _cache.reset();
+          _filter_policy.reset();
+          _store = nullptr;
+          _prefix.clear();
+        }
+
+        /** LevelDB memory of this table; 0 for a table of a unified_store, whose memory the store reports */
+        uint64_t leveldb_memory_usage()const
+        {
+          if( _store != nullptr || !_db ) return 0;
+          return approximate_memory_usage( *_db );
         }
 
         fc::optional<Value> fetch_optional( const Key& k )
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           auto itr = find( k );
-           if( itr.valid() ) return itr.value();
-           return fc::optional<Value>();
+           std::string& buffer = read_buffer();
+           auto status = get( pack_key( k ), buffer );
+           if( status.IsNotFound() )
+              return fc::optional<Value>();
+           if( !status.ok() )
+           {
+               FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", status.ToString() ) );
+           }
+           fc::datastream<const char*> ds(buffer.data(), buffer.size());
+           Value tmp;
+           fc::raw::unpack(ds, tmp);
+           return tmp;
         } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
         Value fetch( const Key& k )
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::vector<char> kslice = fc::raw::pack( k );
-           ldb::Slice ks( kslice.data(), kslice.size() );
-           std::string value;
-           auto status = _db->Get( _read_options, ks, &value );
+           std::string& buffer = read_buffer();
+           auto status = get( pack_key( k ), buffer );
            if( status.IsNotFound() )
            {
              FC_THROW_EXCEPTION( fc::key_not_found_exception, "unable to find key ${key}", ("key",k) );
@@ -105,54 +167,214 @@ namespace bts { namespace db {
            {
                FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", status.ToString() ) );
            }
-           fc::datastream<const char*> ds(value.c_str(), value.size());
+           fc::datastream<const char*> ds(buffer.data(), buffer.size());
            Value tmp;
            fc::raw::unpack(ds, tmp);
            return tmp;
         } FC_RETHROW_EXCEPTIONS( warn, "error fetching key ${key}", ("key",k) ); }
 
+        /**
+         *  Decodes the key and value straight from the LevelDB slices and keeps the decoded copy until
+         *  the iterator is moved, so repeated key()/value() calls at one position unpack only once.
+         *  Copies share the underlying LevelDB position but cache independently.
+         *
+         *  During an online upgrade the iterator walks the new and the legacy database side by side,
+         *  like LevelDB merges its own levels: the current record is the nearer of the two in the
+         *  direction of travel, the new one wins when both hold a key, and legacy values are converted
+         *  as they are read. Both LevelDB iterators are created together and read a consistent view.
+         */
         class iterator
         {
            public:
              iterator(){}
              bool valid()const
              {
-                return _it && _it->Valid();
+                if( !_it ) return false;
+                const ldb::Iterator& it = current();
+                if( !it.Valid() || !it.key().starts_with( _prefix ) ) return false;
+                if( _upper_key ) return it.key().compare( *_upper_key ) < 0;
+                return !_upper || key() < *_upper;
+             }
+
+             const Key& key()const
+             {
+                 if( !_key.valid() )
+                 {
+                     const ldb::Slice raw_key = current().key();
+                     Key tmp_key;
+                     key_format<Key>::unpack( raw_key.data() + _prefix.size(), raw_key.size() - _prefix.size(), tmp_key );
+                     _key = std::move( tmp_key );
+                 }
+                 return *_key;
              }
 
-             Key key()const
+             const Value& value()const
              {
-                 Key tmp_key;
-                 fc::datastream<const char*> ds2( _it->key().data(), _it->key().size() );
-                 fc::raw::unpack( ds2, tmp_key );
-                 return tmp_key;
+               if( !_value.valid() )
+               {
+                   Value tmp_val;
+                   if( _at_legacy )
+                   {
+                       const std::string converted = _legacy->convert( _legacy->it->value() );
+                       fc::datastream<const char*> ds( converted.data(), converted.size() );
+                       fc::raw::unpack( ds, tmp_val );
+                   }
+                   else
+                   {
+                       fc::datastream<const char*> ds( _it->value().data(), _it->value().size() );
+                       fc::raw::unpack( ds, tmp_val );
+                   }
+                   _value = std::move( tmp_val );
+               }
+               return *_value;
+             }
+
+             iterator& operator++()
+             {
+                invalidate();
+                if( !_legacy )
+                {
+                   _it->Next();
+                   return *this;
+                }
+                const std::string current_key = current().key().ToString();
+                if( _backward )
+                {
+                   seek_after( *_it, current_key );
+                   seek_after( *_legacy->it, current_key );
+                }
+                else
+                {
+                   skip_if_at( *_it, current_key, true );
+                   skip_if_at( *_legacy->it, current_key, true );
+                }
+                settle( false );
+                return *this;
              }
 
-             Value value()const
+             /** moves to the first key not less than key, reusing the LevelDB iterator and the view it reads */
+             iterator& seek( const Key& key )
              {
-               Value tmp_val;
-               fc::datastream<const char*> ds( _it->value().data(), _it->value().size() );
-               fc::raw::unpack( ds, tmp_val );
-               return tmp_val;
+                invalidate();
+                std::string packed = _prefix;
+                key_format<Key>::pack( packed, key );
+                _it->Seek( packed );
+                if( _legacy )
+                   _legacy->it->Seek( packed );
+                settle( false );
+                return *this;
              }
 
-             iterator& operator++()    { _it->Next(); return *this; }
-             iterator& operator--()    { _it->Prev(); return *this; }
+             iterator& operator--()
+             {
+                invalidate();
+                if( !_legacy )
+                {
+                   _it->Prev();
+                   return *this;
+                }
+                const std::string current_key = current().key().ToString();
+                if( !_backward )
+                {
+                   seek_before( *_it, current_key );
+                   seek_before( *_legacy->it, current_key );
+                }
+                else
+                {
+                   skip_if_at( *_it, current_key, false );
+                   skip_if_at( *_legacy->it, current_key, false );
+                }
+                settle( true );
+                return *this;
+             }
 
            protected:
              friend class level_map;
-             iterator( ldb::Iterator* it )
-             :_it(it){}
+             iterator( ldb::Iterator* it, const std::string& prefix )
+             :_it(it),_prefix(prefix){}
+
+             void invalidate()
+             {
+                _key.reset();
+                _value.reset();
+             }
+
+             /** the legacy database of an online upgrade; it is kept open until its iterator is gone */
+             struct legacy_records
+             {
+                std::shared_ptr<ldb::DB>        db;
+                std::unique_ptr<ldb::Iterator>  it;
+                upgrade_record_function         convert;
+             };
+
+             const ldb::Iterator& current()const { return _at_legacy ? *_legacy->it : *_it; }
+
+             static int compare( const ldb::Slice& a, const ldb::Slice& b )
+             {
+                return key_format<Key>::comparator()->Compare( a, b );
+             }
+
+             /** after positioning both iterators at or past the same key, picks the nearer record */
+             void settle( bool backward )
+             {
+                _backward = backward;
+                if( !_legacy ) return;
+                const ldb::Iterator& legacy = *_legacy->it;
+                if( !legacy.Valid() )       _at_legacy = false;
+                else if( !_it->Valid() )    _at_legacy = true;
+                else
+                {
+                   const int order = compare( legacy.key(), _it->key() );
+                   _at_legacy = backward ? order > 0 : order < 0;
+                }
+             }
+
+             static void seek_after( ldb::Iterator& it, const std::string& key )
+             {
+                it.Seek( key );
+                if( it.Valid() && compare( it.key(), key ) == 0 ) it.Next();
+             }
+
+             static void seek_before( ldb::Iterator& it, const std::string& key )
+             {
+                it.Seek( key );
+                if( it.Valid() ) it.Prev();
+                else             it.SeekToLast();
+             }
+
+             static void skip_if_at( ldb::Iterator& it, const std::string& key, bool forward )
+             {
+                if( !it.Valid() || compare( it.key(), key ) != 0 ) return;
+                if( forward ) it.Next();
+                else          it.Prev();
+             }
 
+             /** destroyed after _it, a LevelDB iterator must not outlive the snapshot it reads */
+             std::shared_ptr<const ldb::Snapshot> _snapshot;
              std::shared_ptr<ldb::Iterator> _it;
+             std::shared_ptr<legacy_records> _legacy;
+             bool                           _at_legacy = false;
+             bool                           _backward = false;
+             std::string                    _prefix;
+             std::shared_ptr<const Key>     _upper;
+             /** the stored upper bound of a table with ordered keys, which bounds the scan without decoding */
+             std::shared_ptr<const std::string> _upper_key;
+             mutable fc::optional<Key>      _key;
+             mutable fc::optional<Value>    _value;
         };
 
         iterator begin() const
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           iterator itr( _db->NewIterator( _iter_options ) );
-           itr._it->SeekToFirst();
+           iterator itr = new_iterator();
+           if( _prefix.empty() )
+              itr._it->SeekToFirst();
+           else
+              itr._it->Seek( _prefix );
+           if( itr._legacy )
+              itr._legacy->it->SeekToFirst();
+           itr.settle( false );
 
            if( itr._it->status().IsNotFound() )
            {
@@ -181,22 +403,27 @@ namespace bts { namespace db {
             * memory allocation to seralize the key.
             */
            fc::array<char,256+sizeof(Key)>  stack_buffer;
+           std::string                      heap_buffer;
 
-           size_t pack_size = fc::raw::pack_size(key);
-           if( pack_size <= stack_buffer.size() )
+           size_t pack_size = key_format<Key>::ordered ? 0 : _prefix.size() + fc::raw::pack_size(key);
+           if( !key_format<Key>::ordered && pack_size <= stack_buffer.size() )
            {
               fc::datastream<char*> ds( stack_buffer.data, stack_buffer.size() );
+              ds.write( _prefix.data(), _prefix.size() );
               fc::raw::pack( ds ,key );
               key_slice = ldb::Slice( stack_buffer.data, pack_size );
            }
            else
            {
-              auto kslice = fc::raw::pack( key );
-              key_slice = ldb::Slice( kslice.data(), kslice.size() );
+              heap_buffer = pack_key( key );
+              key_slice = ldb::Slice( heap_buffer );
            }
 
-           iterator itr( _db->NewIterator( _iter_options ) );
+           iterator itr = new_iterator();
            itr._it->Seek( key_slice );
+           if( itr._legacy )
+              itr._legacy->it->Seek( key_slice );
+           itr.settle( false );
            if( itr.valid() && itr.key() == key )
            {
               return itr;
@@ -208,55 +435,96 @@ namespace bts { namespace db {
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::vector<char> kslice = fc::raw::pack( key );
-           ldb::Slice key_slice( kslice.data(), kslice.size() );
-
-           iterator itr( _db->NewIterator( _iter_options ) );
-           itr._it->Seek( key_slice );
+           iterator itr = new_iterator();
+           const std::string packed = pack_key( key );
+           itr._it->Seek( packed );
+           if( itr._legacy )
+              itr._legacy->it->Seek( packed );
+           itr.settle( false );
            return itr;
         } FC_RETHROW_EXCEPTIONS( warn, "error finding ${key}", ("key",key) ) }
 
+        /**
+         *  Iterates the keys in [lower, upper); the iterator becomes invalid at the upper bound, so bounded
+         *  scans need no key test of their own. Values are only decoded when value() is called.
+         */
+        iterator range( const Key& lower, const Key& upper )const
+        { try {
+           iterator itr = lower_bound( lower );
+           set_upper_bound( itr, upper );
+           return itr;
+        } FC_RETHROW_EXCEPTIONS( warn, "error finding range ${lower} - ${upper}", ("lower",lower)("upper",upper) ) }
+
+        /** a point in time view of the database, released when the last copy and iterator reading it are gone */
+        typedef std::shared_ptr<const ldb::Snapshot> snapshot;
+
+        /** a table in the middle of an online upgrade still has records in the old database and cannot be snapshot */
+        snapshot take_snapshot()const
+        { try {
+           FC_ASSERT( is_open(), "Database is not open!" );
+           FC_ASSERT( !_upgrade, "a table being upgraded cannot be read from a snapshot" );
+           ldb::DB* db = raw_db();
+           return snapshot( db->GetSnapshot(), [db]( const ldb::Snapshot* snap ) { db->ReleaseSnapshot( snap ); } );
+        } FC_RETHROW_EXCEPTIONS( warn, "error taking snapshot" ) }
+
+        /**
+         *  Like range(), but reads the table as it was when snap was taken, so the scan may run on another
+         *  thread while this one keeps writing. Missing bounds extend to the ends of the table. A snapshot of
+         *  a unified_store table does not hold the writes of a batch still open.
+         */
+        iterator snapshot_range( const snapshot& snap, const fc::optional<Key>& lower = fc::optional<Key>(),
+                                 const fc::optional<Key>& upper = fc::optional<Key>() )const
+        { try {
+           FC_ASSERT( is_open(), "Database is not open!" );
+           FC_ASSERT( snap != nullptr );
+
+           ldb::ReadOptions options = _iter_options;
+           options.snapshot = snap.get();
+           iterator itr( raw_db()->NewIterator( options ), _prefix );
+           itr._snapshot = snap;
+           if( lower.valid() )
+              itr._it->Seek( pack_key( *lower ) );
+           else if( _prefix.empty() )
+              itr._it->SeekToFirst();
+           else
+              itr._it->Seek( _prefix );
+           if( upper.valid() )
+              set_upper_bound( itr, *upper );
+           return itr;
+        } FC_RETHROW_EXCEPTIONS( warn, "error reading snapshot" ) }
+
         iterator last( )const
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           iterator itr( _db->NewIterator( _iter_options ) );
-           itr._it->SeekToLast();
+           iterator itr = new_iterator();
+           seek_to_last( *itr._it );
+           if( itr._legacy )
+              itr._legacy->it->SeekToLast();
+           itr.settle( true );
            return itr;
         } FC_RETHROW_EXCEPTIONS( warn, "error finding last" ) }
 
         bool last( Key& k )
         { try {
-           FC_ASSERT( is_open(), "Database is not open!" );
-
-           std::unique_ptr<ldb::Iterator> it( _db->NewIterator( _iter_options ) );
-           FC_ASSERT( it != nullptr );
-           it->SeekToLast();
-           if( !it->Valid() )
+           const iterator itr = last();
+           if( !itr.valid() )
            {
              return false;
            }
-           fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-           fc::raw::unpack( ds2, k );
+           k = itr.key();
            return true;
         } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" ); }
 
         bool last( Key& k, Value& v )
         { try {
-           FC_ASSERT( is_open(), "Database is not open!" );
-
-           std::unique_ptr<ldb::Iterator> it( _db->NewIterator( _iter_options ) );
-           FC_ASSERT( it != nullptr );
-           it->SeekToLast();
-           if( !it->Valid() )
+           const iterator itr = last();
+           if( !itr.valid() )
            {
              return false;
            }
-           fc::datastream<const char*> ds( it->value().data(), it->value().size() );
-           fc::raw::unpack( ds, v );
-
-           fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-           fc::raw::unpack( ds2, k );
+           k = itr.key();
+           v = itr.value();
            return true;
         } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" ); }
 
@@ -275,6 +543,9 @@ namespace bts { namespace db {
                 leveldb::WriteBatch   _batch;
                 level_map*            _map = nullptr;
                 leveldb::WriteOptions _write_options;
+                size_t                _operations = 0;
+                /** keys removed while an online upgrade is running, they must leave the old database too */
+                std::vector<std::string> _upgrade_removes;
 
                 friend class level_map;
                 write_batch( level_map* map, bool sync = false ) : _map(map)
@@ -304,37 +575,78 @@ namespace bts { namespace db {
                   {
                     FC_ASSERT(_map->is_open(), "Database is not open!");
 
-                    ldb::Status status = _map->_db->Write( _write_options, &_batch );
+                    if( _operations == 0 ) return;
+
+                    _map->remove_from_upgrade_source( _upgrade_removes );
+                    ldb::Status status = _map->_store != nullptr ? _map->_store->write( _batch, _write_options.sync )
+                                                                 : _map->_db->Write( _write_options, &_batch );
                     if (status.IsNotFound())
                       FC_THROW_EXCEPTION(fc::key_not_found_exception, "unable to find key while applying batch");
                     if (!status.ok())
                       FC_THROW_EXCEPTION(db_exception, "database error while applying batch: ${msg}", ("msg", status.ToString()));
                     _batch.Clear();
+                    _operations = 0;
                   }
                   FC_RETHROW_EXCEPTIONS(warn, "error applying batch");
                 }
 
+                /**
+                 *  Hands the accumulated operations to writer and returns immediately; callers must not write
+                 *  the same keys again before the returned future completes. While the map's unified_store has
+                 *  a batch open the operations join it instead, and the future returned is already complete.
+                 */
+                fc::future<void> commit_async( fc::thread& writer )
+                { try {
+                  FC_ASSERT(_map->is_open(), "Database is not open!");
+
+                  if( _map->_store != nullptr && _map->_store->in_batch() )
+                  {
+                     commit();
+                     fc::promise<void>::ptr done( new fc::promise<void>( "level_map_async_commit" ) );
+                     done->set_value();
+                     return fc::future<void>( done );
+                  }
+
+                  _map->remove_from_upgrade_source( _upgrade_removes );
+
+                  auto batch = std::make_shared<leveldb::WriteBatch>();
+                  std::swap( *batch, _batch );
+                  _operations = 0;
+
+                  ldb::DB* db = _map->raw_db();
+                  const leveldb::WriteOptions write_options = _write_options;
+                  return writer.async( [batch, db, write_options]()
+                  {
+                     const ldb::Status status = db->Write( write_options, batch.get() );
+                     if( !status.ok() )
+                        FC_THROW_EXCEPTION( db_exception, "database error while applying batch: ${msg}", ("msg", status.ToString()) );
+                  }, "level_map_async_commit" );
+                } FC_RETHROW_EXCEPTIONS(warn, "error scheduling batch") }
+
                 void abort()
                 {
                   _batch.Clear();
+                  _operations = 0;
+                  _upgrade_removes.clear();
                 }
 
                 void store( const Key& k, const Value& v )
                 {
-                  std::vector<char> kslice = fc::raw::pack(k);
-                  ldb::Slice ks(kslice.data(), kslice.size());
-
                   auto vec = fc::raw::pack(v);
                   ldb::Slice vs(vec.data(), vec.size());
 
-                  _batch.Put(ks, vs);
+                  _batch.Put(_map->pack_key(k), vs);
+                  ++_operations;
+                  _map->_stats.record_store( vec.size() );
                 }
 
                 void remove( const Key& k )
                 {
-                  std::vector<char> kslice = fc::raw::pack(k);
-                  ldb::Slice ks(kslice.data(), kslice.size());
-                  _batch.Delete(ks);
+                  _batch.Delete(_map->pack_key(k));
+                  if( _map->_upgrade )
+                     _upgrade_removes.push_back( _map->pack_key(k) );
+                  ++_operations;
+                  _map->_stats.record_remove();
                 }
         };
 
@@ -347,26 +659,30 @@ namespace bts { namespace db {
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::vector<char> kslice = fc::raw::pack( k );
-           ldb::Slice ks( kslice.data(), kslice.size() );
+           const std::string ks = pack_key( k );
 
            auto vec = fc::raw::pack(v);
            ldb::Slice vs( vec.data(), vec.size() );
 
-           auto status = _db->Put( sync ? _sync_options : _write_options, ks, vs );
+           auto status = _store != nullptr ? _store->put( ks, vs, sync )
+                                           : _db->Put( sync ? _sync_options : _write_options, ks, vs );
            if( !status.ok() )
            {
                FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", status.ToString() ) );
            }
+           _stats.record_store( vec.size() );
         } FC_RETHROW_EXCEPTIONS( warn, "error storing ${key} = ${value}", ("key",k)("value",v) ); }
 
         void remove( const Key& k, bool sync = false )
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::vector<char> kslice = fc::raw::pack( k );
-           ldb::Slice ks( kslice.data(), kslice.size() );
-           auto status = _db->Delete( sync ? _sync_options : _write_options, ks );
+           const std::string ks = pack_key( k );
+           // delete the legacy record first so a crash in between cannot resurrect it
+           remove_from_upgrade_source( std::vector<std::string>( 1, ks ) );
+           auto status = _store != nullptr ? _store->remove( ks, sync )
+                                           : _db->Delete( sync ? _sync_options : _write_options, ks );
+           _stats.record_remove();
            if( status.IsNotFound() )
            {
              FC_THROW_EXCEPTION( fc::key_not_found_exception, "unable to find key ${key}", ("key",k) );
@@ -396,6 +712,74 @@ namespace bts { namespace db {
             fs.write( "]", 1 );
         } FC_CAPTURE_AND_RETHROW( (path) ) }
 
+        bool is_upgrading()const { return !!_upgrade; }
+
+        /**
+         *  Converts up to max_records legacy records of an online upgrade, see open().
+         *  @return true while records remain, so callers can loop and yield in between
+         */
+        bool upgrade_step( size_t max_records )const
+        { try {
+           if( !_upgrade ) return false;
+
+           std::unique_ptr<ldb::Iterator> it( _upgrade->source->NewIterator( _iter_options ) );
+           ldb::WriteBatch converted;
+           ldb::WriteBatch removed;
+           std::string existing;
+           size_t count = 0;
+           for( it->SeekToFirst(); it->Valid() && count < max_records; it->Next(), ++count )
+           {
+              // records written since the upgrade started are already in the new format
+              if( _db->Get( _read_options, it->key(), &existing ).IsNotFound() )
+                 converted.Put( it->key(), _upgrade->convert( it->value() ) );
+              removed.Delete( it->key() );
+           }
+           if( !it->status().ok() )
+              FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", it->status().ToString() ) );
+           const bool done = !it->Valid();
+           it.reset();
+
+           // converted records are written before their legacy copies are dropped, so a crash at any
+           // point leaves every record readable and the next step simply resumes
+           auto status = _db->Write( _sync_options, &converted );
+           if( status.ok() ) status = _upgrade->source->Write( _write_options, &removed );
+           if( !status.ok() )
+              FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", status.ToString() ) );
+
+           _stats.record_converted( count );
+           if( !done ) return true;
+
+           _upgrade->source.reset();
+           std::ofstream( ( _upgrade->dir / "UPGRADE_COMPLETE" ).string() );
+           ilog( "Finished upgrading database ${db}", ("db",_upgrade->dir) );
+           _upgrade.reset();
+           return false;
+        } FC_CAPTURE_AND_RETHROW( (max_records) ) }
+
+        /** operation counters since the map was created, plus LevelDB's own view of the table */
+        level_map_stats get_stats()const
+        { try {
+           level_map_stats result = _stats.stats();
+           result.upgrade_in_progress = is_upgrading();
+           if( !is_open() ) return result;
+
+           raw_db()->GetProperty( "leveldb.stats", &result.leveldb_stats );
+
+           std::unique_ptr<ldb::Iterator> first( raw_db()->NewIterator( _iter_options ) );
+           std::unique_ptr<ldb::Iterator> last( raw_db()->NewIterator( _iter_options ) );
+           if( _prefix.empty() ) first->SeekToFirst();
+           else first->Seek( _prefix );
+           seek_to_last( *last );
+           if( first->Valid() && last->Valid() && first->key().starts_with( _prefix ) && last->key().starts_with( _prefix ) )
+           {
+              const std::string first_key = first->key().ToString();
+              const std::string last_key = last->key().ToString();
+              const ldb::Range range( first_key, last_key );
+              raw_db()->GetApproximateSizes( &range, 1, &result.approximate_size );
+           }
+           return result;
+        } FC_CAPTURE_AND_RETHROW() }
+
         // note: this loops through all the items in the database, so it's not exactly fast.  it's intended for debugging, nothing else.
         size_t size() const
         {
@@ -410,35 +794,209 @@ namespace bts { namespace db {
         }
 
      private:
-        class key_compare : public leveldb::Comparator
-        {
-          public:
-            int Compare( const leveldb::Slice& a, const leveldb::Slice& b )const
-            {
-               Key ak,bk;
-               fc::datastream<const char*> dsa( a.data(), a.size() );
-               fc::raw::unpack( dsa, ak );
-               fc::datastream<const char*> dsb( b.data(), b.size() );
-               fc::raw::unpack( dsb, bk );
-
-               if( ak  < bk ) return -1;
-               if( ak == bk ) return 0;
-               return 1;
-            }
+        typedef std::integral_constant<bool, key_format<Key>::ordered> ordered_keys;
 
-            const char* Name()const { return "key_compare"; }
-            void FindShortestSeparator( std::string*, const leveldb::Slice& )const{}
-            void FindShortSuccessor( std::string* )const{};
+        struct upgrade_state
+        {
+           /** shared with the iterators reading it, see iterator::legacy_records */
+           std::shared_ptr<leveldb::DB> source;
+           upgrade_record_function      convert;
+           fc::path                     dir;
         };
 
+        ldb::DB* open_db( const ldb::Options& opts, const fc::path& dir )const
+        {
+           // Given path must exist to succeed toNativeAnsiPath
+           fc::create_directories( dir );
+           std::string ldbPath = dir.to_native_ansi_path();
+
+           ldb::DB* ndb = nullptr;
+           auto ntrxstat = ldb::DB::Open( opts, ldbPath.c_str(), &ndb );
+           if( !ntrxstat.ok() )
+           {
+               FC_THROW_EXCEPTION( db_in_use_exception, "Unable to open database ${db}\n\t${msg}",
+                                   ("db",dir)("msg",ntrxstat.ToString()) );
+           }
+           return ndb;
+        }
+
+        /**
+         *  an unpositioned iterator over this table, which also reads the uncommitted writes of an open
+         *  unified_store batch and the legacy records of an online upgrade
+         */
+        iterator new_iterator()const
+        {
+           iterator itr( _store != nullptr ? _store->new_iterator( _iter_options ) : _db->NewIterator( _iter_options ), _prefix );
+           if( _upgrade )
+           {
+              itr._legacy = std::make_shared<typename iterator::legacy_records>();
+              itr._legacy->db = _upgrade->source;
+              itr._legacy->it.reset( _upgrade->source->NewIterator( _iter_options ) );
+              itr._legacy->convert = _upgrade->convert;
+           }
+           return itr;
+        }
+
+        void remove_from_upgrade_source( const std::vector<std::string>& keys )const
+        {
+           if( !_upgrade ) return;
+           for( const auto& key : keys )
+           {
+              const auto status = _upgrade->source->Delete( _write_options, key );
+              if( !status.ok() )
+                 FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", status.ToString() ) );
+           }
+        }
+
+        ldb::DB* raw_db()const
+        {
+           return _store != nullptr ? _store->db() : _db.get();
+        }
+
+        std::string pack_key( const Key& k )const
+        {
+           std::string result = _prefix;
+           key_format<Key>::pack( result, k );
+           return result;
+        }
+
+        void set_upper_bound( iterator& itr, const Key& upper )const
+        {
+           itr._upper = std::make_shared<const Key>( upper );
+           if( key_format<Key>::ordered )
+              itr._upper_key = std::make_shared<const std::string>( pack_key( upper ) );
+        }
+
+        void prepare_key_format( const fc::path& dir, const ldb::Options& opts, std::false_type )const {}
+
+        /**
+         *  Tables of a key type with an ordered_key encoding used to store their keys packed with fc::raw.
+         *  Such a table is copied once into "<dir>-rekey" with its keys encoded anew, which then replaces it;
+         *  a crash before the copy completes restarts it, one after it finishes the swap on the next open.
+         */
+        void prepare_key_format( const fc::path& dir, const ldb::Options& opts, std::true_type )const
+        { try {
+           const fc::path rekey_dir = fc::path( dir.string() + "-rekey" );
+           if( fc::exists( rekey_dir / "REKEY_COMPLETE" ) )
+           {
+              fc::remove_all( dir );
+              fc::rename( rekey_dir, dir );
+              fc::remove( dir / "REKEY_COMPLETE" );
+              return;
+           }
+           if( fc::exists( rekey_dir ) )
+              fc::remove_all( rekey_dir );
+           if( has_ordered_keys( dir ) )
+              return;
+           if( !fc::exists( dir / "CURRENT" ) )
+           {
+              // marked before LevelDB creates it, so a new table is never taken for a legacy one
+              fc::create_directories( dir );
+              write_ordered_keys_marker( dir );
+              return;
+           }
+
+           ilog( "Re-encoding the keys of database ${db}", ("db",dir) );
+           ldb::Options legacy_opts = opts;
+           legacy_opts.comparator = key_format<Key, false>::comparator();
+           legacy_opts.create_if_missing = false;
+           std::unique_ptr<ldb::DB> legacy( open_db( legacy_opts, dir ) );
+           ldb::Options rekeyed_opts = opts;
+           rekeyed_opts.create_if_missing = true;
+           std::unique_ptr<ldb::DB> rekeyed( open_db( rekeyed_opts, rekey_dir ) );
+
+           std::unique_ptr<ldb::Iterator> it( legacy->NewIterator( _iter_options ) );
+           ldb::WriteBatch batch;
+           ldb::Status status;
+           size_t count = 0;
+           Key key;
+           std::string encoded;
+           for( it->SeekToFirst(); it->Valid() && status.ok(); it->Next() )
+           {
+              key_format<Key, false>::unpack( it->key().data(), it->key().size(), key );
+              encoded.clear();
+              key_format<Key>::pack( encoded, key );
+              batch.Put( encoded, it->value() );
+              if( ++count % 10000 == 0 )
+              {
+                 status = rekeyed->Write( _write_options, &batch );
+                 batch.Clear();
+              }
+           }
+           if( status.ok() ) status = it->status();
+           if( status.ok() ) status = rekeyed->Write( _sync_options, &batch );
+           if( !status.ok() )
+              FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", status.ToString() ) );
+           it.reset();
+           legacy.reset();
+           rekeyed.reset();
+
+           if( fc::exists( dir / "RECORD_TYPE" ) )
+              fc::copy( dir / "RECORD_TYPE", rekey_dir / "RECORD_TYPE" );
+           write_ordered_keys_marker( rekey_dir );
+           std::ofstream( ( rekey_dir / "REKEY_COMPLETE" ).string() );
+           fc::remove_all( dir );
+           fc::rename( rekey_dir, dir );
+           fc::remove( dir / "REKEY_COMPLETE" );
+           ilog( "Re-encoded ${n} keys of database ${db}", ("n",count)("db",dir) );
+        } FC_CAPTURE_AND_RETHROW( (dir) ) }
+
+        ldb::Status get( const std::string& key, std::string& value )const
+        {
+           const bool timed = level_map_counters::sample_latency();
+           const fc::time_point start = timed ? fc::time_point::now() : fc::time_point();
+           auto status = _store != nullptr ? _store->get( _read_options, key, &value )
+                                           : _db->Get( _read_options, key, &value );
+           if( status.IsNotFound() && _upgrade )
+           {
+              status = _upgrade->source->Get( _read_options, key, &value );
+              if( status.ok() )
+                 value = _upgrade->convert( value );
+           }
+           _stats.record_get( status.ok(), status.ok() ? value.size() : 0 );
+           if( timed )
+              _stats.record_latency( ( fc::time_point::now() - start ).count() );
+           return status;
+        }
+
+        /**
+         *  Reused by fetch so point reads do not allocate once the buffer has grown to the largest record.
+         *  Each thread has its own, as tables are read from worker threads too.
+         */
+        static std::string& read_buffer()
+        {
+           static thread_local std::string buffer;
+           return buffer;
+        }
+
+        /** seeking to the first key of the next table stops at the last key of this one */
+        void seek_to_last( ldb::Iterator& it )const
+        {
+           if( !_prefix.empty() && uint8_t( _prefix[0] ) != 0xff )
+           {
+              it.Seek( std::string( 1, char( uint8_t( _prefix[0] ) + 1 ) ) );
+              if( it.Valid() )
+              {
+                 it.Prev();
+                 return;
+              }
+           }
+           it.SeekToLast();
+        }
+
         std::unique_ptr<leveldb::DB>    _db;
         std::unique_ptr<leveldb::Cache> _cache;
-        key_compare                     _comparer;
+        std::unique_ptr<const leveldb::FilterPolicy> _filter_policy;
+        unified_store*                  _store = nullptr;
+        std::string                     _prefix;
+        mutable std::unique_ptr<upgrade_state> _upgrade;
 
         ldb::ReadOptions                _read_options;
         ldb::ReadOptions                _iter_options;
         ldb::WriteOptions               _write_options;
         ldb::WriteOptions               _sync_options;
+
+        mutable level_map_counters      _stats;
   };
 
 } } // bts::db
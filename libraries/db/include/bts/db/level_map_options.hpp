@@ -0,0 +1,76 @@
+#pragma once
+
+#include <leveldb/cache.h>
+#include <leveldb/db.h>
+#include <leveldb/filter_policy.h>
+#include <leveldb/options.h>
+
+#include <fc/reflect/reflect.hpp>
+
+#include <memory>
+#include <string>
+
+namespace bts { namespace db {
+
+  /**
+   *  @brief storage tuning for a single LevelDB instance
+   *
+   *  Only affects the on-disk representation and memory use, never the data returned by a table,
+   *  so every option can be changed between runs on an existing database.
+   */
+  struct level_map_options
+  {
+     bool     create            = true;
+     /** total memory for write buffers and the block cache, 0 keeps the LevelDB defaults */
+     size_t   cache_size        = 0;
+     /** Snappy-compress blocks; worth it for large, rarely read records such as raw blocks */
+     bool     compress          = false;
+     /** bits per key of the bloom filter, 0 disables it; 10 skips ~99% of disk reads for missing keys */
+     int      bloom_filter_bits = 0;
+     int      max_open_files    = 64;
+     /** convert a legacy record type in the background instead of while opening, see level_map::open */
+     bool     online_upgrade    = false;
+  };
+
+  /** fills opts from options; the cache and filter policy must outlive the database they are opened with */
+  inline void apply_level_map_options( const level_map_options& options, leveldb::Options& opts,
+                                       std::unique_ptr<leveldb::Cache>& cache,
+                                       std::unique_ptr<const leveldb::FilterPolicy>& filter_policy )
+  {
+     opts.create_if_missing = options.create;
+     opts.max_open_files = options.max_open_files;
+     opts.compression = options.compress ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+
+     if( options.cache_size > 0 )
+     {
+         opts.write_buffer_size = options.cache_size / 4; // up to two write buffers may be held in memory simultaneously
+         cache.reset( leveldb::NewLRUCache( options.cache_size / 2 ) );
+         opts.block_cache = cache.get();
+     }
+
+     if( options.bloom_filter_bits > 0 )
+     {
+         filter_policy.reset( leveldb::NewBloomFilterPolicy( options.bloom_filter_bits ) );
+         opts.filter_policy = filter_policy.get();
+     }
+
+     if( leveldb::kMajorVersion > 1 || ( leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16 ) )
+     {
+         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
+         // on corruption in later versions.
+         opts.paranoid_checks = true;
+     }
+  }
+
+  /** the memtables and block cache of db as LevelDB estimates them, 0 where LevelDB is too old to tell */
+  inline uint64_t approximate_memory_usage( leveldb::DB& db )
+  {
+     std::string value;
+     if( !db.GetProperty( "leveldb.approximate-memory-usage", &value ) )
+        return 0;
+     return std::stoull( value );
+  }
+
+} } // bts::db
+
+FC_REFLECT( bts::db::level_map_options, (create)(cache_size)(compress)(bloom_filter_bits)(max_open_files)(online_upgrade) )
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <fc/optional.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace bts { namespace db {
+
+  /**
+   *  @brief operation counters kept by every level_map and cached_level_map
+   *
+   *  Counting is a handful of integer increments per call. Latencies are bucketed by powers of two
+   *  microseconds: bucket i counts reads that took less than 2^i us, the last bucket everything slower.
+   *  Only one get in latency_sample_interval is timed, so the buckets add up to a fraction of gets.
+   */
+  struct level_map_stats
+  {
+     enum { latency_buckets = 16, latency_sample_interval = 16 };
+
+     uint64_t                    gets          = 0;
+     uint64_t                    hits          = 0;
+     uint64_t                    misses        = 0;
+     uint64_t                    stores        = 0;
+     uint64_t                    removes       = 0;
+     uint64_t                    bytes_read    = 0;
+     uint64_t                    bytes_written = 0;
+     std::vector<uint64_t>       get_latency_us = std::vector<uint64_t>( latency_buckets );
+
+     /** only reported by cached_level_map; hits and misses then count cache lookups */
+     fc::optional<uint64_t>      cache_entries;
+     fc::optional<uint64_t>      cache_bytes;
+
+     /** sampled from LevelDB when the stats are requested; shared by every table of a unified_store */
+     uint64_t                    approximate_size = 0;
+     std::string                 leveldb_stats;
+
+     /** progress of an online record type upgrade, see level_map::upgrade_step */
+     bool                        upgrade_in_progress       = false;
+     uint64_t                    upgrade_records_converted = 0;
+
+     static size_t latency_bucket( uint64_t elapsed_us )
+     {
+        size_t bucket = 0;
+        while( elapsed_us > 0 && bucket + 1 < latency_buckets )
+        {
+           elapsed_us >>= 1;
+           ++bucket;
+        }
+        return bucket;
+     }
+
+     /** gets of every table made by the calling thread, for attributing reads to the work that caused them */
+     static uint64_t& thread_gets()
+     {
+        static thread_local uint64_t count = 0;
+        return count;
+     }
+  };
+
+  /**
+   *  The live counters behind level_map_stats. Tables are read from worker threads as well as the chain
+   *  thread, so every counter is a relaxed atomic; stats() copies them out.
+   */
+  class level_map_counters
+  {
+     public:
+        /** whether the calling thread should time its next get, see level_map_stats::latency_sample_interval */
+        static bool sample_latency()
+        {
+           return level_map_stats::thread_gets() % level_map_stats::latency_sample_interval == 0;
+        }
+
+        void record_get( bool found, size_t size )
+        {
+           ++level_map_stats::thread_gets();
+           _gets.fetch_add( 1, std::memory_order_relaxed );
+           ( found ? _hits : _misses ).fetch_add( 1, std::memory_order_relaxed );
+           _bytes_read.fetch_add( size, std::memory_order_relaxed );
+        }
+
+        void record_latency( int64_t elapsed_us )
+        {
+           _get_latency_us[ level_map_stats::latency_bucket( std::max<int64_t>( elapsed_us, 0 ) ) ].fetch_add( 1, std::memory_order_relaxed );
+        }
+
+        void record_store( size_t size )
+        {
+           _stores.fetch_add( 1, std::memory_order_relaxed );
+           _bytes_written.fetch_add( size, std::memory_order_relaxed );
+        }
+
+        void record_remove()                        { _removes.fetch_add( 1, std::memory_order_relaxed ); }
+        void record_converted( uint64_t count )     { _upgrade_records_converted.fetch_add( count, std::memory_order_relaxed ); }
+
+        level_map_stats stats()const
+        {
+           level_map_stats result;
+           result.gets          = _gets.load( std::memory_order_relaxed );
+           result.hits          = _hits.load( std::memory_order_relaxed );
+           result.misses        = _misses.load( std::memory_order_relaxed );
+           result.stores        = _stores.load( std::memory_order_relaxed );
+           result.removes       = _removes.load( std::memory_order_relaxed );
+           result.bytes_read    = _bytes_read.load( std::memory_order_relaxed );
+           result.bytes_written = _bytes_written.load( std::memory_order_relaxed );
+           for( size_t i = 0; i < level_map_stats::latency_buckets; ++i )
+              result.get_latency_us[ i ] = _get_latency_us[ i ].load( std::memory_order_relaxed );
+           result.upgrade_records_converted = _upgrade_records_converted.load( std::memory_order_relaxed );
+           return result;
+        }
+
+     private:
+        std::atomic<uint64_t>   _gets{ 0 };
+        std::atomic<uint64_t>   _hits{ 0 };
+        std::atomic<uint64_t>   _misses{ 0 };
+        std::atomic<uint64_t>   _stores{ 0 };
+        std::atomic<uint64_t>   _removes{ 0 };
+        std::atomic<uint64_t>   _bytes_read{ 0 };
+        std::atomic<uint64_t>   _bytes_written{ 0 };
+        std::atomic<uint64_t>   _upgrade_records_converted{ 0 };
+        std::array<std::atomic<uint64_t>, level_map_stats::latency_buckets> _get_latency_us{};
+  };
+
+} } // bts::db
+
+FC_REFLECT( bts::db::level_map_stats,
+            (gets)(hits)(misses)(stores)(removes)(bytes_read)(bytes_written)(get_latency_us)
+            (cache_entries)(cache_bytes)(approximate_size)(leveldb_stats)
+            (upgrade_in_progress)(upgrade_records_converted) )
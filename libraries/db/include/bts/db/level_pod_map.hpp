@@ -2,6 +2,7 @@
 #include <bts/db/exception.hpp>
 #include <leveldb/db.h>
 #include <leveldb/comparator.h>
+#include <leveldb/write_batch.h>
 #include <fc/filesystem.hpp>
 #include <fc/reflect/reflect.hpp>
 #include <fc/io/raw.hpp>
@@ -237,6 +238,66 @@ namespace bts { namespace db {
            }
         } FC_RETHROW_EXCEPTIONS( warn, "error storing ${key} = ${value}", ("key",k)("value",v) ); }
 
+        /** batched, atomic writes, committed when the batch goes out of scope; see level_map::write_batch */
+        class write_batch
+        {
+            private:
+                leveldb::WriteBatch   _batch;
+                level_pod_map*        _map = nullptr;
+                size_t                _operations = 0;
+
+                friend class level_pod_map;
+                write_batch( level_pod_map* map ) : _map(map) {}
+            public:
+                ~write_batch()
+                {
+                  try
+                  {
+                    commit();
+                  }
+                  catch (const fc::exception&)
+                  {
+                    // we're in a destructor, nothing we can do...
+                  }
+                }
+
+                void commit()
+                {
+                  try
+                  {
+                    FC_ASSERT(_map->is_open(), "Database is not open!");
+
+                    if( _operations == 0 ) return;
+
+                    ldb::Status status = _map->_db->Write( ldb::WriteOptions(), &_batch );
+                    if (!status.ok())
+                      FC_THROW_EXCEPTION(db_exception, "database error while applying batch: ${msg}", ("msg", status.ToString()));
+                    _batch.Clear();
+                    _operations = 0;
+                  }
+                  FC_RETHROW_EXCEPTIONS(warn, "error applying batch");
+                }
+
+                void store( const Key& k, const Value& v )
+                {
+                  auto vec = fc::raw::pack(v);
+                  _batch.Put( ldb::Slice( (char*)&k, sizeof(k) ), ldb::Slice( vec.data(), vec.size() ) );
+                  ++_operations;
+                }
+
+                void remove( const Key& k )
+                {
+                  _batch.Delete( ldb::Slice( (char*)&k, sizeof(k) ) );
+                  ++_operations;
+                }
+        };
+
+        write_batch create_batch()
+        {
+          FC_ASSERT( is_open(), "Database is not open!" );
+          return write_batch( this );
+        }
+
         void remove( const Key& k, bool sync = false )
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <fc/crypto/ripemd160.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/io/varint.hpp>
+#include <fc/time.hpp>
+#include <fc/uint128.hpp>
+
+#include <boost/preprocessor/seq/for_each.hpp>
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace bts { namespace db {
+
+  /** reads an ordered key encoding back, see ordered_key */
+  class ordered_key_reader
+  {
+     public:
+        ordered_key_reader( const char* data, size_t size ) : _pos( data ), _end( data + size ){}
+
+        void read( char* out, size_t size )
+        {
+           FC_ASSERT( size <= size_t( _end - _pos ), "truncated ordered key" );
+           memcpy( out, _pos, size );
+           _pos += size;
+        }
+
+        uint8_t get()
+        {
+           FC_ASSERT( _pos != _end, "truncated ordered key" );
+           return uint8_t( *_pos++ );
+        }
+
+     private:
+        const char* _pos;
+        const char* _end;
+  };
+
+  /**
+   *  @brief a binary key encoding whose bytewise order is the order of Key::operator<
+   *
+   *  Tables whose key type has one are stored with LevelDB's bytewise comparator, so LevelDB compares keys
+   *  with memcmp instead of unpacking both of them, and can shorten the keys of its index blocks.
+   *
+   *  Integers are big endian with the sign bit flipped, hashes are their bytes and strings escape each zero
+   *  byte as 0x00 0xff and end with 0x00 0x00. Pairs and structs declared with BTS_DB_ORDERED_KEY concatenate
+   *  their members. Specializations provide encode() and decode(); enabled is false for every other type.
+   */
+  template<typename Key, typename Enable = void>
+  struct ordered_key
+  {
+     static const bool enabled = false;
+  };
+
+  template<typename Key>
+  void ordered_key_encode( std::string& out, const Key& key )
+  {
+     static_assert( ordered_key<Key>::enabled, "type has no ordered key encoding" );
+     ordered_key<Key>::encode( out, key );
+  }
+
+  template<typename Key>
+  void ordered_key_decode( ordered_key_reader& in, Key& key )
+  {
+     static_assert( ordered_key<Key>::enabled, "type has no ordered key encoding" );
+     ordered_key<Key>::decode( in, key );
+  }
+
+  template<typename Int>
+  struct ordered_key<Int, typename std::enable_if<std::is_integral<Int>::value && !std::is_same<Int, bool>::value>::type>
+  {
+     typedef typename std::make_unsigned<Int>::type bits_type;
+     static const bool     enabled = true;
+     static const bits_type sign_bit = std::is_signed<Int>::value ? bits_type( bits_type( 1 ) << ( 8 * sizeof( Int ) - 1 ) ) : 0;
+
+     static void encode( std::string& out, const Int& value )
+     {
+        const bits_type bits = bits_type( value ) ^ sign_bit;
+        for( int shift = 8 * ( sizeof( Int ) - 1 ); shift >= 0; shift -= 8 )
+           out.push_back( char( uint8_t( bits >> shift ) ) );
+     }
+
+     static void decode( ordered_key_reader& in, Int& value )
+     {
+        bits_type bits = 0;
+        for( size_t i = 0; i < sizeof( Int ); ++i )
+           bits = bits_type( ( uint64_t( bits ) << 8 ) | in.get() );
+        value = Int( bits_type( bits ^ sign_bit ) );
+     }
+  };
+
+  template<typename Enum>
+  struct ordered_key<Enum, typename std::enable_if<std::is_enum<Enum>::value>::type>
+  {
+     typedef typename std::underlying_type<Enum>::type int_type;
+     static const bool enabled = true;
+
+     static void encode( std::string& out, const Enum& value ) { ordered_key_encode( out, int_type( value ) ); }
+     static void decode( ordered_key_reader& in, Enum& value )
+     {
+        int_type tmp = 0;
+        ordered_key_decode( in, tmp );
+        value = Enum( tmp );
+     }
+  };
+
+  template<>
+  struct ordered_key<fc::signed_int>
+  {
+     static const bool enabled = true;
+     static void encode( std::string& out, const fc::signed_int& value ) { ordered_key_encode( out, value.value ); }
+     static void decode( ordered_key_reader& in, fc::signed_int& value ) { ordered_key_decode( in, value.value ); }
+  };
+
+  template<>
+  struct ordered_key<fc::unsigned_int>
+  {
+     static const bool enabled = true;
+     static void encode( std::string& out, const fc::unsigned_int& value ) { ordered_key_encode( out, value.value ); }
+     static void decode( ordered_key_reader& in, fc::unsigned_int& value ) { ordered_key_decode( in, value.value ); }
+  };
+
+  template<>
+  struct ordered_key<fc::uint128>
+  {
+     static const bool enabled = true;
+     static void encode( std::string& out, const fc::uint128& value )
+     {
+        ordered_key_encode( out, value.hi );
+        ordered_key_encode( out, value.lo );
+     }
+     static void decode( ordered_key_reader& in, fc::uint128& value )
+     {
+        ordered_key_decode( in, value.hi );
+        ordered_key_decode( in, value.lo );
+     }
+  };
+
+  template<>
+  struct ordered_key<fc::time_point_sec>
+  {
+     static const bool enabled = true;
+     static void encode( std::string& out, const fc::time_point_sec& value ) { ordered_key_encode( out, value.sec_since_epoch() ); }
+     static void decode( ordered_key_reader& in, fc::time_point_sec& value )
+     {
+        uint32_t seconds = 0;
+        ordered_key_decode( in, seconds );
+        value = fc::time_point_sec( seconds );
+     }
+  };
+
+  template<>
+  struct ordered_key<fc::time_point>
+  {
+     static const bool enabled = true;
+     static void encode( std::string& out, const fc::time_point& value ) { ordered_key_encode( out, value.time_since_epoch().count() ); }
+     static void decode( ordered_key_reader& in, fc::time_point& value )
+     {
+        int64_t microseconds = 0;
+        ordered_key_decode( in, microseconds );
+        value = fc::time_point( fc::microseconds( microseconds ) );
+     }
+  };
+
+  /** hashes compare with memcmp, so their bytes are already in order */
+  template<typename Hash>
+  struct ordered_key<Hash, typename std::enable_if<std::is_same<Hash, fc::ripemd160>::value || std::is_same<Hash, fc::sha256>::value>::type>
+  {
+     static const bool enabled = true;
+     static void encode( std::string& out, const Hash& value ) { out.append( value.data(), value.data_size() ); }
+     static void decode( ordered_key_reader& in, Hash& value ) { in.read( value.data(), value.data_size() ); }
+  };
+
+  template<>
+  struct ordered_key<std::string>
+  {
+     static const bool enabled = true;
+
+     static void encode( std::string& out, const std::string& value )
+     {
+        for( const char c : value )
+        {
+           out.push_back( c );
+           if( c == 0 ) out.push_back( char( 0xff ) );
+        }
+        out.push_back( 0 );
+        out.push_back( 0 );
+     }
+
+     static void decode( ordered_key_reader& in, std::string& value )
+     {
+        value.clear();
+        for( uint8_t c = in.get(); ; c = in.get() )
+        {
+           if( c == 0 && in.get() == 0 ) return;
+           value.push_back( char( c ) );
+        }
+     }
+  };
+
+  template<typename First, typename Second>
+  struct ordered_key<std::pair<First, Second>>
+  {
+     static const bool enabled = ordered_key<First>::enabled && ordered_key<Second>::enabled;
+
+     static void encode( std::string& out, const std::pair<First, Second>& value )
+     {
+        ordered_key_encode( out, value.first );
+        ordered_key_encode( out, value.second );
+     }
+     static void decode( ordered_key_reader& in, std::pair<First, Second>& value )
+     {
+        ordered_key_decode( in, value.first );
+        ordered_key_decode( in, value.second );
+     }
+  };
+
+} } // bts::db
+
+#define BTS_DB_ORDERED_KEY_ENCODE_MEMBER( r, data, member ) bts::db::ordered_key_encode( out, value.member );
+#define BTS_DB_ORDERED_KEY_DECODE_MEMBER( r, data, member ) bts::db::ordered_key_decode( in, value.member );
+
+/**
+ *  Gives TYPE an ordered key encoding that concatenates MEMBERS, which must be listed in the order
+ *  TYPE::operator< compares them. That is usually, but not always, the order of its FC_REFLECT.
+ */
+#define BTS_DB_ORDERED_KEY( TYPE, MEMBERS ) \
+namespace bts { namespace db { \
+  template<> struct ordered_key<TYPE> \
+  { \
+     static const bool enabled = true; \
+     static void encode( std::string& out, const TYPE& value ) \
+     { \
+        BOOST_PP_SEQ_FOR_EACH( BTS_DB_ORDERED_KEY_ENCODE_MEMBER, _, MEMBERS ) \
+     } \
+     static void decode( ordered_key_reader& in, TYPE& value ) \
+     { \
+        BOOST_PP_SEQ_FOR_EACH( BTS_DB_ORDERED_KEY_DECODE_MEMBER, _, MEMBERS ) \
+     } \
+  }; \
+} }
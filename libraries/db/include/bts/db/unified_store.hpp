@@ -0,0 +1,186 @@
+#pragma once
+
+#include <leveldb/cache.h>
+#include <leveldb/comparator.h>
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+
+#include <bts/db/exception.hpp>
+#include <bts/db/level_map_options.hpp>
+#include <bts/db/ordered_key.hpp>
+
+#include <fc/filesystem.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/optional.hpp>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace bts { namespace db {
+
+  /**
+   *  @brief orders LevelDB keys by unpacking them with fc::raw and comparing them with Key::operator<
+   */
+  template<typename Key>
+  class packed_key_compare : public leveldb::Comparator
+  {
+    public:
+      int Compare( const leveldb::Slice& a, const leveldb::Slice& b )const
+      {
+         Key ak,bk;
+         fc::datastream<const char*> dsa( a.data(), a.size() );
+         fc::raw::unpack( dsa, ak );
+         fc::datastream<const char*> dsb( b.data(), b.size() );
+         fc::raw::unpack( dsb, bk );
+
+         if( ak  < bk ) return -1;
+         if( ak == bk ) return 0;
+         return 1;
+      }
+
+      const char* Name()const { return "key_compare"; }
+      void FindShortestSeparator( std::string*, const leveldb::Slice& )const{}
+      void FindShortSuccessor( std::string* )const{};
+  };
+
+  /**
+   *  How tables store keys of type Key: in their ordered_key encoding under LevelDB's bytewise comparator
+   *  when the type has one, packed with fc::raw under packed_key_compare otherwise.
+   */
+  template<typename Key, bool Ordered = ordered_key<Key>::enabled>
+  struct key_format
+  {
+     static const bool ordered = false;
+
+     static void pack( std::string& out, const Key& key )
+     {
+        const auto packed = fc::raw::pack( key );
+        out.append( packed.data(), packed.size() );
+     }
+
+     static void unpack( const char* data, size_t size, Key& key )
+     {
+        fc::datastream<const char*> ds( data, size );
+        fc::raw::unpack( ds, key );
+     }
+
+     static const leveldb::Comparator* comparator()
+     {
+        static const packed_key_compare<Key> compare;
+        return &compare;
+     }
+  };
+
+  template<typename Key>
+  struct key_format<Key, true>
+  {
+     static const bool ordered = true;
+
+     static void pack( std::string& out, const Key& key ) { ordered_key_encode( out, key ); }
+
+     static void unpack( const char* data, size_t size, Key& key )
+     {
+        ordered_key_reader in( data, size );
+        ordered_key_decode( in, key );
+     }
+
+     static const leveldb::Comparator* comparator() { return leveldb::BytewiseComparator(); }
+  };
+
+  /**
+   *  @brief a single LevelDB instance shared by several level_map tables
+   *
+   *  Each table owns a one byte key prefix. Tables must be registered before open() because
+   *  LevelDB may compare the keys of any table during compaction.
+   *
+   *  Between begin_batch() and commit_batch() the writes of every table are accumulated into a
+   *  single WriteBatch, so they reach the disk atomically with one WAL append. Point reads made
+   *  through get() and iterators made by new_iterator() see the uncommitted writes.
+   */
+  class unified_store
+  {
+     public:
+        template<typename Key>
+        void register_table( uint8_t prefix )
+        {
+           FC_ASSERT( !is_open(), "Tables must be registered before the store is opened" );
+           _comparer._tables[ prefix ] = key_format<Key>::comparator();
+        }
+        bool is_registered( uint8_t prefix )const;
+
+        void open( const fc::path& dir, const level_map_options& options = level_map_options() );
+        void close();
+        bool is_open()const { return !!_db; }
+
+        void begin_batch();
+        void commit_batch( bool sync = false );
+        bool in_batch()const { return _in_batch; }
+
+        leveldb::Status get( const leveldb::ReadOptions& opts, const leveldb::Slice& key, std::string* value )const;
+        /**
+         *  Iterates the committed data merged with the writes of the open batch as they were when the
+         *  iterator was made. An iterator reading a snapshot only sees the committed data.
+         */
+        leveldb::Iterator* new_iterator( const leveldb::ReadOptions& opts )const;
+        leveldb::Status put( const leveldb::Slice& key, const leveldb::Slice& value, bool sync = false );
+        leveldb::Status remove( const leveldb::Slice& key, bool sync = false );
+
+        /** applies batch directly, or folds it into the open store batch */
+        leveldb::Status write( leveldb::WriteBatch& batch, bool sync = false );
+
+        leveldb::DB* db()const { return _db.get(); }
+        uint64_t memory_usage()const { return _db ? approximate_memory_usage( *_db ) : 0; }
+
+     private:
+        /** compares the prefix byte first, then hands the rest of the key to the table's comparator */
+        class prefix_compare : public leveldb::Comparator
+        {
+           public:
+             int Compare( const leveldb::Slice& a, const leveldb::Slice& b )const;
+
+             /** renamed when the key formats of the tables changed, so older stores fail to open */
+             const char* Name()const { return "unified_prefix_compare_v2"; }
+             void FindShortestSeparator( std::string*, const leveldb::Slice& )const{}
+             void FindShortSuccessor( std::string* )const{};
+
+             std::map<uint8_t, const leveldb::Comparator*> _tables;
+        };
+
+        class batch_replayer;
+        class pending_iterator;
+
+        /** one uncommitted write; a removal has an invalid value */
+        struct pending_write
+        {
+           uint64_t                    sequence = 0;
+           fc::optional<std::string>   value;
+        };
+
+        struct pending_less
+        {
+           const prefix_compare* compare;
+           bool operator()( const std::string& a, const std::string& b )const { return compare->Compare( a, b ) < 0; }
+        };
+        /**
+         *  The uncommitted writes in the store's key order, oldest first for each key. While an iterator reads
+         *  the map a write is added as a new version rather than replacing the last one, so the iterator keeps
+         *  seeing the writes made before it without the map being copied.
+         */
+        typedef std::map<std::string, std::deque<pending_write>, pending_less> pending_map;
+
+        void add_pending( const leveldb::Slice& key, fc::optional<std::string> value );
+
+        std::unique_ptr<leveldb::DB>                        _db;
+        std::unique_ptr<leveldb::Cache>                     _cache;
+        std::unique_ptr<const leveldb::FilterPolicy>        _filter_policy;
+        prefix_compare                                      _comparer;
+
+        bool                                                _in_batch = false;
+        leveldb::WriteBatch                                 _batch;
+        std::shared_ptr<pending_map>                        _pending;
+        uint64_t                                            _next_sequence = 0;
+  };
+
+} } // bts::db
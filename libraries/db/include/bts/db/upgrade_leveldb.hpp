@@ -4,6 +4,7 @@
 #include <fc/reflect/reflect.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/exception/exception.hpp>
+#include <fc/optional.hpp>
 #include <functional>
 #include <map>
 
@@ -28,6 +29,10 @@ namespace fc { class path; }
  *   (databases with modified key types cannot currently be upgraded).
  * - The database versioning code requires that fc::get_typename is defined for
  *   all value types which are to be versioned.
+ *
+ * Tables opened with level_map_options::online_upgrade are instead converted in the
+ * background: the node starts immediately, reads decode records of either format, and
+ * level_map::upgrade_step() moves batches of records into the new format.
  */
 
 /*
@@ -71,14 +76,18 @@ namespace fc { class path; }
 namespace bts { namespace db {
 
     typedef std::function<void(leveldb::DB*)> upgrade_db_function; 
+    /** converts one packed record of a legacy type into the packed current type */
+    typedef std::function<std::string(const leveldb::Slice&)> upgrade_record_function;
 
     class upgrade_db_mapper
     {
         public:
           static  upgrade_db_mapper& instance();
           int32_t add_type( const std::string& type_name, const upgrade_db_function& function);
+          int32_t add_record_type( const std::string& type_name, const upgrade_record_function& function );
 
-          std::map<std::string,upgrade_db_function> _upgrade_db_function_registry;
+          std::map<std::string,upgrade_db_function>     _upgrade_db_function_registry;
+          std::map<std::string,upgrade_record_function> _upgrade_record_function_registry;
     };
 
     #define REGISTER_DB_OBJECT(TYPE,VERSIONNUM) \
@@ -107,9 +116,27 @@ namespace bts { namespace db {
             dbase_itr->Next(); \
           } /*while*/ \
         } \
+        std::string UpgradeRecord ## TYPE ## VERSIONNUM(const leveldb::Slice& old_slice) \
+        { \
+          TYPE ## VERSIONNUM old_value; \
+          fc::datastream<const char*> dstream( old_slice.data(), old_slice.size() ); \
+          fc::raw::unpack( dstream, old_value ); \
+          TYPE new_value(old_value); \
+          auto vec = fc::raw::pack(new_value); \
+          return std::string( vec.data(), vec.size() ); \
+        } \
         static int dummyResult ## TYPE ## VERSIONNUM  = \
-          upgrade_db_mapper::instance()->add_type(fc::get_typename<TYPE ## VERSIONNUM>::name(), UpgradeDb ## TYPE ## VERSIONNUM);
+          upgrade_db_mapper::instance().add_type(fc::get_typename<TYPE ## VERSIONNUM>::name(), UpgradeDb ## TYPE ## VERSIONNUM) + \
+          upgrade_db_mapper::instance().add_record_type(fc::get_typename<TYPE ## VERSIONNUM>::name(), UpgradeRecord ## TYPE ## VERSIONNUM);
 
     void try_upgrade_db( const fc::path& dir, leveldb::DB* dbase, const char* record_type, size_t record_type_size );
 
+    /** @return the record converter if dir holds an older record type that has one registered */
+    fc::optional<upgrade_record_function> find_online_upgrade( const fc::path& dir, const char* record_type );
+    void write_record_type( const fc::path& dir, const char* record_type, size_t record_type_size );
+
+    /** whether dir holds keys in their ordered_key encoding, rather than packed with fc::raw */
+    bool has_ordered_keys( const fc::path& dir );
+    void write_ordered_keys_marker( const fc::path& dir );
+
 } } // namespace db
@@ -0,0 +1,330 @@
+#include <bts/db/unified_store.hpp>
+
+#include <fc/log/logger.hpp>
+
+#include <iterator>
+
+namespace bts { namespace db {
+
+    class unified_store::batch_replayer : public leveldb::WriteBatch::Handler
+    {
+       public:
+          batch_replayer( unified_store& store ) : _store(store){}
+
+          virtual void Put( const leveldb::Slice& key, const leveldb::Slice& value )override
+          {
+             _store.put( key, value );
+          }
+
+          virtual void Delete( const leveldb::Slice& key )override
+          {
+             _store.remove( key );
+          }
+
+       private:
+          unified_store& _store;
+    };
+
+    /**
+     *  Merges the committed records with the pending writes: the nearer of the two in the direction of travel
+     *  is current, a pending write shadows the committed record of its key, and a pending removal hides it.
+     *  Only the writes sequenced before the iterator was made are seen.
+     */
+    class unified_store::pending_iterator : public leveldb::Iterator
+    {
+       public:
+          pending_iterator( leveldb::Iterator* base, const leveldb::Comparator* compare,
+                            std::shared_ptr<const pending_map> pending, uint64_t sequence )
+          :_base(base),_compare(compare),_pending(std::move(pending)),_sequence(sequence),_it(_pending->end()){}
+
+          virtual bool Valid()const override { return _base->Valid() || _it != _pending->end(); }
+
+          virtual void SeekToFirst()override
+          {
+             _base->SeekToFirst();
+             _it = _pending->begin();
+             settle( false );
+          }
+
+          virtual void SeekToLast()override
+          {
+             _base->SeekToLast();
+             _it = _pending->empty() ? _pending->end() : std::prev( _pending->end() );
+             settle( true );
+          }
+
+          virtual void Seek( const leveldb::Slice& target )override
+          {
+             _base->Seek( target );
+             _it = _pending->lower_bound( target.ToString() );
+             settle( false );
+          }
+
+          virtual void Next()override
+          {
+             const std::string current = key().ToString();
+             if( _backward )
+             {
+                _base->Seek( current );
+                if( _base->Valid() && _compare->Compare( _base->key(), current ) == 0 ) _base->Next();
+                _it = _pending->upper_bound( current );
+             }
+             else
+             {
+                if( _base->Valid() && _compare->Compare( _base->key(), current ) == 0 ) _base->Next();
+                if( _it != _pending->end() && _compare->Compare( _it->first, current ) == 0 ) ++_it;
+             }
+             settle( false );
+          }
+
+          virtual void Prev()override
+          {
+             const std::string current = key().ToString();
+             if( !_backward )
+             {
+                _base->Seek( current );
+                if( _base->Valid() ) _base->Prev();
+                else                 _base->SeekToLast();
+                _it = _pending->lower_bound( current );
+                step_back();
+             }
+             else
+             {
+                if( _base->Valid() && _compare->Compare( _base->key(), current ) == 0 ) _base->Prev();
+                if( _it != _pending->end() && _compare->Compare( _it->first, current ) == 0 ) step_back();
+             }
+             settle( true );
+          }
+
+          virtual leveldb::Slice key()const override   { return _at_pending ? leveldb::Slice( _it->first ) : _base->key(); }
+          virtual leveldb::Slice value()const override { return _at_pending ? leveldb::Slice( *_write->value ) : _base->value(); }
+          virtual leveldb::Status status()const override { return _base->status(); }
+
+       private:
+          /** the last write of the key at it made before this iterator, or nullptr if there is none */
+          const pending_write* visible( pending_map::const_iterator it )const
+          {
+             for( auto write = it->second.rbegin(); write != it->second.rend(); ++write )
+                if( write->sequence < _sequence )
+                   return &*write;
+             return nullptr;
+          }
+
+          /** moves the pending position back one key, off the map when it is at the first */
+          void step_back()
+          {
+             if( _it == _pending->begin() ) _it = _pending->end();
+             else                           --_it;
+          }
+
+          /** with both positions at or past the same key, picks the nearer record and skips removed keys */
+          void settle( bool backward )
+          {
+             _backward = backward;
+             while( _it != _pending->end() )
+             {
+                int order = 0;
+                if( _base->Valid() )
+                {
+                   order = _compare->Compare( _it->first, _base->key() );
+                   if( backward ) order = -order;
+                }
+                if( order > 0 )
+                   break;
+
+                _write = visible( _it );
+                if( _write != nullptr && _write->value.valid() )
+                {
+                   _at_pending = true;
+                   return;
+                }
+
+                if( _write != nullptr && order == 0 && _base->Valid() )
+                {
+                   if( backward ) _base->Prev();
+                   else           _base->Next();
+                }
+                if( backward ) step_back();
+                else           ++_it;
+             }
+             _at_pending = false;
+          }
+
+          std::unique_ptr<leveldb::Iterator>  _base;
+          const leveldb::Comparator*          _compare;
+          std::shared_ptr<const pending_map>  _pending;
+          uint64_t                            _sequence;
+          pending_map::const_iterator         _it;
+          const pending_write*                _write = nullptr;
+          bool                                _at_pending = false;
+          bool                                _backward = false;
+    };
+
+    int unified_store::prefix_compare::Compare( const leveldb::Slice& a, const leveldb::Slice& b )const
+    {
+       if( a.size() == 0 || b.size() == 0 )
+          return int( a.size() ) - int( b.size() );
+
+       const uint8_t prefix_a = a[0];
+       const uint8_t prefix_b = b[0];
+       if( prefix_a != prefix_b )
+          return prefix_a < prefix_b ? -1 : 1;
+
+       const leveldb::Slice rest_a( a.data() + 1, a.size() - 1 );
+       const leveldb::Slice rest_b( b.data() + 1, b.size() - 1 );
+
+       // a bare prefix sorts before every key of its table; level_map uses it to seek to the first key
+       if( rest_a.size() == 0 || rest_b.size() == 0 )
+          return int( rest_a.size() ) - int( rest_b.size() );
+
+       const auto itr = _tables.find( prefix_a );
+       if( itr == _tables.end() )
+          return rest_a.compare( rest_b );
+       return itr->second->Compare( rest_a, rest_b );
+    }
+
+    bool unified_store::is_registered( uint8_t prefix )const
+    {
+       return _comparer._tables.find( prefix ) != _comparer._tables.end();
+    }
+
+    void unified_store::open( const fc::path& dir, const level_map_options& options )
+    { try {
+       FC_ASSERT( !is_open() );
+
+       leveldb::Options opts;
+       opts.comparator = &_comparer;
+       apply_level_map_options( options, opts, _cache, _filter_policy );
+
+       fc::create_directories( dir );
+       std::string ldb_path = dir.to_native_ansi_path();
+
+       leveldb::DB* ndb = nullptr;
+       const auto status = leveldb::DB::Open( opts, ldb_path.c_str(), &ndb );
+       if( !status.ok() )
+       {
+           FC_THROW_EXCEPTION( db_in_use_exception, "Unable to open database ${db}\n\t${msg}",
+                               ("db",dir)("msg",status.ToString()) );
+       }
+       _db.reset( ndb );
+    } FC_CAPTURE_AND_RETHROW( (dir)(options) ) }
+
+    void unified_store::close()
+    {
+       if( _in_batch )
+       {
+          try
+          {
+             commit_batch();
+          }
+          catch( const fc::exception& e )
+          {
+             elog( "unable to commit pending write batch while closing store: ${e}", ("e",e.to_detail_string()) );
+          }
+       }
+       _db.reset();
+       _cache.reset();
+       _filter_policy.reset();
+    }
+
+    void unified_store::begin_batch()
+    {
+       FC_ASSERT( is_open(), "Database is not open!" );
+       FC_ASSERT( !_in_batch, "A write batch is already in progress" );
+       _in_batch = true;
+    }
+
+    void unified_store::commit_batch( bool sync )
+    { try {
+       FC_ASSERT( is_open(), "Database is not open!" );
+       FC_ASSERT( _in_batch, "No write batch is in progress" );
+
+       _in_batch = false;
+       leveldb::WriteOptions write_options;
+       write_options.sync = sync;
+       const auto status = _db->Write( write_options, &_batch );
+       _batch.Clear();
+       _pending.reset();
+       if( !status.ok() )
+          FC_THROW_EXCEPTION( db_exception, "database error while applying batch: ${msg}", ("msg", status.ToString()) );
+    } FC_CAPTURE_AND_RETHROW( (sync) ) }
+
+    leveldb::Status unified_store::get( const leveldb::ReadOptions& opts, const leveldb::Slice& key, std::string* value )const
+    {
+       if( _in_batch && _pending )
+       {
+          const auto itr = _pending->find( key.ToString() );
+          if( itr != _pending->end() )
+          {
+             const pending_write& write = itr->second.back();
+             if( !write.value.valid() )
+                return leveldb::Status::NotFound( key );
+             *value = *write.value;
+             return leveldb::Status::OK();
+          }
+       }
+       return _db->Get( opts, key, value );
+    }
+
+    leveldb::Iterator* unified_store::new_iterator( const leveldb::ReadOptions& opts )const
+    {
+       leveldb::Iterator* base = _db->NewIterator( opts );
+       if( !_in_batch || !_pending || opts.snapshot != nullptr )
+          return base;
+       return new pending_iterator( base, &_comparer, _pending, _next_sequence );
+    }
+
+    void unified_store::add_pending( const leveldb::Slice& key, fc::optional<std::string> value )
+    {
+       if( !_pending )
+          _pending = std::make_shared<pending_map>( pending_less{ &_comparer } );
+
+       std::deque<pending_write>& writes = ( *_pending )[ key.ToString() ];
+       // with no iterator reading the map, older versions of the key can no longer be seen
+       if( _pending.unique() && !writes.empty() )
+          writes.erase( writes.begin(), std::prev( writes.end() ) );
+       else
+          writes.emplace_back();
+       writes.back().sequence = _next_sequence++;
+       writes.back().value = std::move( value );
+    }
+
+    leveldb::Status unified_store::put( const leveldb::Slice& key, const leveldb::Slice& value, bool sync )
+    {
+       if( _in_batch )
+       {
+          _batch.Put( key, value );
+          add_pending( key, value.ToString() );
+          return leveldb::Status::OK();
+       }
+       leveldb::WriteOptions write_options;
+       write_options.sync = sync;
+       return _db->Put( write_options, key, value );
+    }
+
+    leveldb::Status unified_store::remove( const leveldb::Slice& key, bool sync )
+    {
+       if( _in_batch )
+       {
+          _batch.Delete( key );
+          add_pending( key, fc::optional<std::string>() );
+          return leveldb::Status::OK();
+       }
+       leveldb::WriteOptions write_options;
+       write_options.sync = sync;
+       return _db->Delete( write_options, key );
+    }
+
+    leveldb::Status unified_store::write( leveldb::WriteBatch& batch, bool sync )
+    {
+       if( _in_batch )
+       {
+          batch_replayer replayer( *this );
+          return batch.Iterate( &replayer );
+       }
+       leveldb::WriteOptions write_options;
+       write_options.sync = sync;
+       return _db->Write( write_options, &batch );
+    }
+
+} } // bts::db
@@ -21,12 +21,17 @@ namespace bts { namespace db {
     }
 
 
-    // this code has no bitshares dependencies, and it
-    // could be moved to fc, if fc ever adds a leveldb dependency
-    void try_upgrade_db( const fc::path& dir, leveldb::DB* dbase, const char* record_type, size_t record_type_size )
+    int32_t upgrade_db_mapper::add_record_type( const std::string& type_name, const upgrade_record_function& function )
     {
-      size_t old_record_type_size = 0;
-      std::string old_record_type;
+        _upgrade_record_function_registry[type_name] = function;
+        return 0;
+    }
+
+    /** @return false if dir holds a record type that can never be upgraded */
+    static bool stored_record_type( const fc::path& dir, const char* record_type,
+                                    std::string& old_record_type, size_t& old_record_type_size )
+    {
+      old_record_type_size = 0;
       fc::path record_type_filename = dir / "RECORD_TYPE";
       //if no RECORD_TYPE file exists
       if ( !boost::filesystem::exists( record_type_filename ) )
@@ -44,7 +49,7 @@ namespace bts { namespace db {
         if( 'v' != old_record_type[last_char] )
         {
           //ilog("Database ${db} is not upgradeable",("db",dir.to_native_ansi_path()));
-          return;
+          return false;
         }
 
         ++last_char;
@@ -59,6 +64,54 @@ namespace bts { namespace db {
         old_record_type = buffer;
         is >> old_record_type_size;
       }
+      return true;
+    }
+
+    void write_record_type( const fc::path& dir, const char* record_type, size_t record_type_size )
+    {
+      boost::filesystem::ofstream os( dir / "RECORD_TYPE" );
+      os << record_type << std::endl;
+      os << record_type_size;
+    }
+
+    bool has_ordered_keys( const fc::path& dir )
+    {
+      return boost::filesystem::exists( dir / "KEY_FORMAT" );
+    }
+
+    void write_ordered_keys_marker( const fc::path& dir )
+    {
+      boost::filesystem::ofstream os( dir / "KEY_FORMAT" );
+      os << "ordered" << std::endl;
+    }
+
+    fc::optional<upgrade_record_function> find_online_upgrade( const fc::path& dir, const char* record_type )
+    {
+      std::string old_record_type;
+      size_t old_record_type_size = 0;
+      if( !stored_record_type( dir, record_type, old_record_type, old_record_type_size ) || old_record_type == record_type )
+        return fc::optional<upgrade_record_function>();
+
+      const auto& registry = upgrade_db_mapper::instance()._upgrade_record_function_registry;
+      auto upgrade_function_itr = registry.find( old_record_type );
+      if( upgrade_function_itr == registry.end() )
+        return fc::optional<upgrade_record_function>();
+
+      ilog("Upgrading database ${db} from ${old} to ${new} in the background",("db",dir.preferred_string())
+                                                                              ("old",old_record_type)
+                                                                              ("new",record_type));
+      return upgrade_function_itr->second;
+    }
+
+    // this code has no bitshares dependencies, and it
+    // could be moved to fc, if fc ever adds a leveldb dependency
+    void try_upgrade_db( const fc::path& dir, leveldb::DB* dbase, const char* record_type, size_t record_type_size )
+    {
+      size_t old_record_type_size = 0;
+      std::string old_record_type;
+      if( !stored_record_type( dir, record_type, old_record_type, old_record_type_size ) )
+        return;
+
       if (old_record_type != record_type)
       {
         //check if upgrade function in registry
@@ -69,9 +122,7 @@ namespace bts { namespace db {
                                                                 ("old",old_record_type)
                                                                 ("new",record_type));
           //update database's RECORD_TYPE to new record type name
-          boost::filesystem::ofstream os(record_type_filename);
-          os << record_type << std::endl;
-          os << record_type_size;
+          write_record_type( dir, record_type, record_type_size );
           //upgrade the database using upgrade function
           upgrade_function_itr->second(dbase);
         }
@@ -83,9 +134,7 @@ namespace bts { namespace db {
       }
       else if (old_record_type_size == 0) //if record type file never created, create it now
       {
-        boost::filesystem::ofstream os(record_type_filename);
-          os << record_type << std::endl;
-          os << record_type_size;
+        write_record_type( dir, record_type, record_type_size );
       }
       else if (old_record_type_size != record_type_size)
       {
@@ -9,7 +9,9 @@
 #include <fc/io/json.hpp>
 #include <fc/network/tcp_socket.hpp>
 
+#include <atomic>
 #include <queue>
+#include <thread>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -34,6 +36,7 @@ using namespace boost::multi_index;
 namespace detail {
 #define BTS_MAIL_CLIENT_DATABASE_VERSION 1
 #define BTS_MAIL_CLIENT_MAX_INVENTORY_SIZE 1000
+#define BTS_MAIL_CLIENT_MAX_CONCURRENT_FETCHES 8
 
 struct mail_record {
     mail_record(string sender = string(),
@@ -131,7 +134,7 @@ public:
 
     job_queue _transmit_message_jobs;
     fc::future<void> _transmit_message_worker;
-    fc::thread _proof_of_work_thread;
+    vector<std::unique_ptr<fc::thread>> _proof_of_work_threads;
 
     fc::future<void> _archive_indexing_future;
     fc::thread _archive_indexing_thread;
@@ -180,9 +183,12 @@ public:
         : self(self),
           _wallet(wallet),
           _chain(chain),
-          _proof_of_work_thread("Mail client proof-of-work thread"),
           _archive_indexing_thread("Mail client indexing thread")
-    {}
+    {
+        const unsigned num_threads = std::max( 1u, std::thread::hardware_concurrency() );
+        for (unsigned i = 0; i < num_threads; ++i)
+            _proof_of_work_threads.emplace_back(new fc::thread("Mail client proof-of-work thread " + std::to_string(i)));
+    }
     ~client_impl(){
         _proof_of_work_worker.cancel_and_wait("Mail client destroyed");
         _archive_indexing_future.cancel_and_wait();
@@ -363,28 +369,50 @@ public:
                 return;
             }
 
-            std::unique_ptr<fc::future<void>> slave_handle_uptr(new fc::future<void>());
-            fc::future<void>* slave_handle = slave_handle_uptr.get();
+            //Each round stamps the message anew, then every thread searches its own nonces: thread t takes t, t+n, ...
+            const uint64_t num_threads = _proof_of_work_threads.size();
             while (_processing_db.fetch(message_id).status != client::canceled &&
                    email->content.id() > email->proof_of_work_target) {
                 email->content.timestamp = blockchain::now();
                 _processing_db.store(email->id, *email);
 
+                const message content = email->content;
+                const message_id_type target = email->proof_of_work_target;
+                std::atomic<bool> found(false);
+                std::atomic<uint64_t> found_nonce(0);
+                vector<fc::future<void>> slaves;
                 try {
-                    *slave_handle = _proof_of_work_thread.async([email, slave_handle] {
-                        fc::time_point start_time = fc::time_point::now();
-                        while (!slave_handle->canceled() &&
-                               fc::time_point::now() - start_time < fc::seconds(1) &&
-                               email->content.id() > email->proof_of_work_target)
-                            ++email->content.nonce;
-                    }, "Mail client proof-of-work worker");
-
-                    slave_handle->wait();
+                    for (uint64_t t = 0; t < num_threads; ++t) {
+                        slaves.push_back(_proof_of_work_threads[t]->async([&content, &target, &found, &found_nonce, t, num_threads] {
+                            const uint64_t tries_per_batch = 4096;
+                            fc::time_point start_time = fc::time_point::now();
+                            uint64_t next_nonce = t;
+                            while (!found && fc::time_point::now() - start_time < fc::seconds(1)) {
+                                const auto nonce = content.find_nonce(target, next_nonce, num_threads, tries_per_batch);
+                                if (nonce && !found.exchange(true))
+                                    found_nonce = *nonce;
+                                next_nonce += num_threads * tries_per_batch;
+                            }
+                        }, "Mail client proof-of-work worker"));
+                    }
+
+                    for (auto& slave : slaves)
+                        slave.wait();
                 } catch (fc::canceled_exception&) {
-                    slave_handle->cancel();
-                    _proof_of_work_thread.quit();
+                    found = true;
+                    for (auto& slave : slaves) {
+                        try {
+                            slave.wait();
+                        } catch (...) {
+                        }
+                    }
+                    for (auto& thread : _proof_of_work_threads)
+                        thread->quit();
                     throw;
                 }
+
+                if (found)
+                    email->content.nonce = found_nonce;
             }
 
             if (_processing_db.fetch(message_id).status == client::canceled) {
@@ -436,12 +464,19 @@ public:
                         return;
                     }
 
+                    //Send the store and the read-back together so each server costs one round trip, not two
                     mutable_variant_object request;
                     request["id"] = 0;
                     request["method"] = "mail_store_message";
                     request["params"] = vector<variant>({variant(email.content)});
-
                     fc::json::to_stream(sock, variant_object(request));
+
+                    mutable_variant_object verify_request;
+                    verify_request["id"] = 1;
+                    verify_request["method"] = "mail_fetch_message";
+                    verify_request["params"] = vector<variant>({variant(email.content.id())});
+                    fc::json::to_stream(sock, variant_object(verify_request));
+
                     string raw_response;
                     fc::getline(sock, raw_response);
                     variant_object response = fc::json::from_string(raw_response).as<variant_object>();
@@ -472,11 +507,6 @@ public:
                         return;
                     }
 
-                    request["id"] = 1;
-                    request["method"] = "mail_fetch_message";
-                    request["params"] = vector<variant>({variant(email.content.id())});
-
-                    fc::json::to_stream(sock, variant_object(request));
                     fc::getline(sock, raw_response);
                     response = fc::json::from_string(raw_response).as<variant_object>();
 
@@ -623,14 +653,134 @@ public:
             _inbox.remove(message_id);
     }
 
+    void wait_for_tasks(vector<fc::future<void>>& tasks, fc::microseconds timeout, const char* description) {
+        auto timeout_future = fc::schedule([=] {
+            elog("Timed out ${what}.", ("what", description));
+            ulog("Timed out ${what}.", ("what", description));
+            for (auto task_future : tasks)
+                task_future.cancel();
+        }, fc::time_point::now() + timeout, "Mail client fetcher timeout");
+
+        while (!tasks.empty()) {
+            try {
+                tasks.back().wait();
+            } catch (fc::canceled_exception&) {
+                //Timed out; keep whatever the other tasks got before the timeout
+            }
+            tasks.pop_back();
+        }
+
+        timeout_future.cancel("Finished fetching");
+    }
+
+    variant_object call_server(tcp_socket& sock, const mail_server_endpoint& server,
+                               int64_t id, const string& method, vector<variant>&& params) {
+        mutable_variant_object request;
+        request["id"] = id;
+        request["method"] = method;
+        request["params"] = std::move(params);
+
+        fc::json::to_stream(sock, variant_object(request));
+        string raw_response;
+        fc::getline(sock, raw_response);
+        variant_object response = fc::json::from_string(raw_response).as<variant_object>();
+
+        if (response["id"].as_int64() != id)
+            wlog("Server response has wrong ID... attempting to press on. Expected: ${id}; got: ${r}",
+                 ("id", id)("r", response["id"]));
+        if (response.contains("error"))
+            FC_THROW("Server ${server} gave error ${error} on request ${request}",
+                     ("server", server)("error", response["error"])("request", request));
+        return response;
+    }
+
+    /** Pages through one server's inventory for owner, starting at since. */
+    inventory_type fetch_server_inventory(const mail_server_endpoint& server, const address& owner,
+                                          fc::time_point since) {
+        inventory_type inventory;
+        tcp_socket sock;
+
+        try {
+            sock.connect_to(server.second);
+
+            size_t received = BTS_MAIL_CLIENT_MAX_INVENTORY_SIZE;
+            while (received == BTS_MAIL_CLIENT_MAX_INVENTORY_SIZE) {
+                auto response = call_server(sock, server, 0, "mail_fetch_inventory",
+                                            vector<variant>({variant(owner),
+                                                             variant(since),
+                                                             variant(BTS_MAIL_CLIENT_MAX_INVENTORY_SIZE)}));
+                inventory_type results = response["result"].as<inventory_type>();
+                received = results.size();
+                if (!results.empty())
+                    since = results.back().first + fc::microseconds(1);
+                inventory.insert(inventory.end(), results.begin(), results.end());
+            }
+        } catch (fc::canceled_exception&) {
+            throw;
+        } catch (fc::exception& e) {
+            elog("Failed to fetch inventory from mail server ${server}: ${e}",
+                 ("server", server)("e", e.to_detail_string()));
+        }
+
+        return inventory;
+    }
+
+    void store_received_message(const wallet_account_record& account, message&& ciphertext,
+                                const mail_server_list& servers) {
+        message plaintext = _wallet->mail_open(account.account_address, ciphertext);
+        email_header header;
+        header.id = ciphertext.id();
+        if (plaintext.type == mail::email) {
+            signed_email_message email = plaintext.as<signed_email_message>();
+            try {
+               header.sender = _wallet->get_key_label(email.from());
+            } catch (fc::exception& e) {
+               header.sender = "INVALID SIGNATURE";
+            }
+            header.subject = std::move(email.subject);
+        } else if (plaintext.type == mail::transaction_notice) {
+            transaction_notice_message notice = plaintext.as<transaction_notice_message>();
+            try {
+               header.sender = _wallet->get_key_label(notice.from());
+            } catch (fc::exception& e) {
+               header.sender = "INVALID SIGNATURE";
+            }
+            header.subject = "Transaction Notification";
+            _wallet->scan_transaction(notice.trx.id().str(), true);
+            self->new_transaction_notifier(notice);
+        }
+        header.recipient = account.name;
+        header.timestamp = plaintext.timestamp;
+        mail_archive_record record(std::move(ciphertext), header, account.account_address);
+        bool new_mail = false;
+
+        if (auto optional_record = _archive.fetch_optional(header.id)) {
+            record = *optional_record;
+            if (record.status == client::accepted) {
+                //We sent this message, but it's still newly received mail
+                new_mail = true;
+                record.status = client::received;
+            }
+        } else
+            new_mail = true;
+
+        record.mail_servers.insert(servers.begin(), servers.end());
+
+        _archive.store(header.id, record);
+        _mail_index.insert(header);
+
+        if (new_mail) {
+            _inbox.store(header.id, header);
+            ++_messages_in;
+        }
+    }
+
     int check_new_mail(bool get_old_messages) {
         auto accounts = _wallet->list_my_accounts();
         _messages_in = 0;
 
         for (wallet_account_record account : accounts) {
             auto servers = get_mail_servers_for_recipient(account.name);
-            vector<fc::future<void>> fetch_tasks;
-            fetch_tasks.reserve(servers.size());
 
             auto last_check_time = account.registration_date;
             fc::time_point_sec check_time = _chain->now();
@@ -638,134 +788,76 @@ public:
             if (!get_old_messages && (op = _property_db.fetch_optional("last_fetch/" + account.name)))
                 last_check_time = op->as<fc::time_point_sec>();
 
-            for (mail_server_endpoint server : servers) {
-                fetch_tasks.push_back(fc::async([=] {
-                    //TODO: This whole design needs to be rethought. This is just a simplistic first effort.
-                    //Right now we get the inventory, then download and store ALL of it locally.
-                    //Downloading is done synchronously, with one message downloaded before the next starts.
-                    //No deduplication of effort is done; i.e. if a given message is on three servers, we'll download
-                    //it three times.
-                    tcp_socket sock;
-
-                    try {
-                        sock.connect_to(server.second);
-                    } catch (fc::exception& e) {
-                        elog("Failed to connect to mail server ${server}: ${e}",
-                             ("server", server)("e", e.to_detail_string()));
-                        return;
-                    }
-
-                    int received = BTS_MAIL_CLIENT_MAX_INVENTORY_SIZE;
-                    while (received == BTS_MAIL_CLIENT_MAX_INVENTORY_SIZE) {
-                        mutable_variant_object request;
-                        request["id"] = 0;
-                        request["method"] = "mail_fetch_inventory";
-                        request["params"] = vector<variant>({variant(address(account.account_address)),
-                                                             variant(last_check_time),
-                                                             variant(BTS_MAIL_CLIENT_MAX_INVENTORY_SIZE)});
-
-                        fc::json::to_stream(sock, variant_object(request));
-                        string raw_response;
-                        fc::getline(sock, raw_response);
-                        variant_object response = fc::json::from_string(raw_response).as<variant_object>();
-
-                        if (response["id"].as_int64() != 0)
-                            wlog("Server response has wrong ID... attempting to press on. Expected: 0; got: ${r}",
-                                 ("r", response["id"]));
-                        if (response.contains("error")) {
-                            elog("Server ${server} gave error ${error} on request ${request}",
-                                 ("server", server)("error", response["error"])("request", request));
-                            sock.close();
-                            return;
-                        }
-
-                        inventory_type results = response["result"].as<inventory_type>();
-                        received = results.size();
-
-                        for (std::pair<fc::time_point, message_id_type> email : results) {
-                            request["id"] = 1;
-                            request["method"] = "mail_fetch_message";
-                            request["params"] = vector<variant>({variant(email.second)});
-
-                            fc::json::to_stream(sock, variant_object(request));
-                            fc::getline(sock, raw_response);
-                            response = fc::json::from_string(raw_response).as<variant_object>();
-
-                            if (response["id"].as_int64() != 1)
-                                wlog("Server response has wrong ID... attempting to press on. Expected: 1; got: ${r}",
-                                     ("r", response["id"]));
-                            if (response.contains("error")) {
-                                elog("Server ${server} gave error ${error} on request ${request}",
-                                     ("server", server)("error", response["error"])("request", request));
-                                sock.close();
-                                return;
-                            }
+            //Poll every server's inventory at once, then merge them so a message held by several servers is
+            //downloaded only once, from whichever of its holders answers.
+            std::map<message_id_type, mail_server_list> holders;
+            vector<fc::future<void>> inventory_tasks;
+            inventory_tasks.reserve(servers.size());
+            for (mail_server_endpoint server : servers)
+                inventory_tasks.push_back(fc::async([&, server] {
+                    for (const auto& item : fetch_server_inventory(server, account.account_address, last_check_time))
+                        holders[item.second].insert(server);
+                }, "Mail client inventory fetcher"));
+            wait_for_tasks(inventory_tasks, fc::seconds(60), "fetching mail inventories");
+
+            std::queue<std::pair<message_id_type, mail_server_list>> fetch_jobs;
+            for (auto& holder : holders) {
+                auto record = _archive.fetch_optional(holder.first);
+                if (record && record->status == client::received) {
+                    //Already downloaded; just remember the new holders
+                    record->mail_servers.insert(holder.second.begin(), holder.second.end());
+                    _archive.store(holder.first, *record);
+                    continue;
+                }
+                fetch_jobs.push(std::move(holder));
+            }
 
-                            message ciphertext = response["result"].as<message>();
-                            message plaintext = _wallet->mail_open(account.account_address, ciphertext);
-                            email_header header;
-                            header.id = ciphertext.id();
-                            if (plaintext.type == mail::email) {
-                                signed_email_message email = plaintext.as<signed_email_message>();
-                                try {
-                                   header.sender = _wallet->get_key_label(email.from());
-                                } catch (fc::exception& e) {
-                                   header.sender = "INVALID SIGNATURE";
-                                }
-                                header.subject = std::move(email.subject);
-                            } else if (plaintext.type == mail::transaction_notice) {
-                                transaction_notice_message notice = plaintext.as<transaction_notice_message>();
+            //A fixed pool of fetchers drains the queue, each keeping one connection open per server it uses
+            vector<fc::future<void>> fetch_tasks;
+            size_t fetcher_count = std::min<size_t>(BTS_MAIL_CLIENT_MAX_CONCURRENT_FETCHES, fetch_jobs.size());
+            fetch_tasks.reserve(fetcher_count);
+            for (size_t i = 0; i < fetcher_count; ++i)
+                fetch_tasks.push_back(fc::async([&] {
+                    std::map<string, std::shared_ptr<tcp_socket>> connections;
+                    while (!fetch_jobs.empty()) {
+                        auto job = std::move(fetch_jobs.front());
+                        fetch_jobs.pop();
+
+                        for (const mail_server_endpoint& server : job.second) {
+                            auto connection = connections.find(server.first);
+                            if (connection == connections.end()) {
+                                auto sock = std::make_shared<tcp_socket>();
                                 try {
-                                   header.sender = _wallet->get_key_label(notice.from());
+                                    sock->connect_to(server.second);
+                                } catch (fc::canceled_exception&) {
+                                    throw;
                                 } catch (fc::exception& e) {
-                                   header.sender = "INVALID SIGNATURE";
+                                    elog("Failed to connect to mail server ${server}: ${e}",
+                                         ("server", server)("e", e.to_detail_string()));
+                                    sock.reset();
                                 }
-                                header.subject = "Transaction Notification";
-                                _wallet->scan_transaction(notice.trx.id().str(), true);
-                                self->new_transaction_notifier(notice);
+                                connection = connections.insert(std::make_pair(server.first, sock)).first;
                             }
-                            header.recipient = account.name;
-                            header.timestamp = plaintext.timestamp;
-                            mail_archive_record record(std::move(ciphertext), header, account.account_address);
-                            bool new_mail = false;
-
-                            if (auto optional_record = _archive.fetch_optional(email.second)) {
-                                record = *optional_record;
-                                if (record.status == client::accepted) {
-                                    //We sent this message, but it's still newly received mail
-                                    new_mail = true;
-                                    record.status = client::received;
-                                }
-                            } else
-                                new_mail = true;
-
-                            record.mail_servers.insert(std::move(server));
-
-                            _archive.store(email.second, record);
-                            _mail_index.insert(header);
-
-                            if (new_mail) {
-                                _inbox.store(header.id, header);
-                                ++_messages_in;
+                            if (!connection->second)
+                                continue;
+
+                            try {
+                                auto response = call_server(*connection->second, server, 1, "mail_fetch_message",
+                                                            vector<variant>({variant(job.first)}));
+                                store_received_message(account, response["result"].as<message>(), job.second);
+                                break;
+                            } catch (fc::canceled_exception&) {
+                                throw;
+                            } catch (fc::exception& e) {
+                                elog("Failed to fetch message ${id} from mail server ${server}: ${e}",
+                                     ("id", job.first)("server", server)("e", e.to_detail_string()));
+                                connection->second.reset();
                             }
                         }
                     }
                 }, "Mail client fetcher"));
-            }
-
-            auto timeout_future = fc::schedule([=] {
-                elog("Timed out fetching new mail.");
-                ulog("Timed out fetching new mail.");
-                for (auto task_future : fetch_tasks)
-                    task_future.cancel();
-            }, fc::time_point::now() + fc::seconds(60), "Mail client fetcher timeout");
-
-            while (!fetch_tasks.empty()) {
-                fetch_tasks.back().wait();
-                fetch_tasks.pop_back();
-            }
+            wait_for_tasks(fetch_tasks, fc::seconds(60), "fetching new mail");
 
-            timeout_future.cancel("Finished fetching");
             _property_db.store("last_fetch/" + account.name, variant(check_time));
         }
 
@@ -91,6 +91,12 @@ namespace bts { namespace mail {
       message():nonce(0),timestamp(fc::time_point::now()){}
 
       message_id_type   id()const;
+      /**
+       *  Tries max_tries nonces, first_nonce and every step-th one after it, for one with an id() no greater
+       *  than target. The message is packed once; only the nonce bytes of the packed copy change between hashes.
+       */
+      fc::optional<uint64_t> find_nonce( const message_id_type& target, uint64_t first_nonce, uint64_t step,
+                                         uint64_t max_tries )const;
       encrypted_message encrypt( const fc::ecc::private_key& onetimekey,
                                  const fc::ecc::public_key&  receiver_public_key )const;
 
@@ -1,6 +1,8 @@
 #include <bts/mail/message.hpp>
 #include <fc/crypto/aes.hpp>
 
+#include <cstring>
+
 namespace bts { namespace mail {
    const message_type signed_email_message::type       = email;
    const message_type transaction_notice_message::type = transaction_notice;
@@ -37,6 +39,24 @@ namespace bts { namespace mail {
       return enc.result();
    }
 
+   fc::optional<uint64_t> message::find_nonce( const message_id_type& target, uint64_t first_nonce, uint64_t step,
+                                               uint64_t max_tries )const
+   {
+      /* the nonce is packed as its raw bytes right after the type and recipient */
+      vector<char> packed = fc::raw::pack( *this );
+      const size_t nonce_offset = fc::raw::pack_size( type ) + fc::raw::pack_size( recipient );
+      FC_ASSERT( nonce_offset + sizeof( nonce ) <= packed.size() );
+
+      uint64_t candidate = first_nonce;
+      for( uint64_t i = 0; i < max_tries; ++i, candidate += step )
+      {
+         memcpy( packed.data() + nonce_offset, &candidate, sizeof( candidate ) );
+         if( !( fc::ripemd160::hash( packed.data(), packed.size() ) > target ) )
+            return candidate;
+      }
+      return fc::optional<uint64_t>();
+   }
+
    encrypted_message message::encrypt( const fc::ecc::private_key& onetimekey,
                                        const fc::ecc::public_key&  receiver_public_key )const
    {
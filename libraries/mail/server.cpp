@@ -7,6 +7,8 @@
 #include <fc/crypto/ripemd160.hpp>
 #include <fc/time.hpp>
 
+#include <unordered_map>
+
 namespace bts { namespace mail {
 
 struct mail_index
@@ -26,6 +28,24 @@ bool operator == ( const mail_index& a, const mail_index& b )
    return a.owner == b.owner && a.received == b.received;
 }
 
+/** the inventory ordered by arrival, so expired messages are a prefix of it */
+struct mail_expiry_index
+{
+   fc::time_point              received;
+   bts::blockchain::address    owner;
+};
+
+bool operator < ( const mail_expiry_index& a, const mail_expiry_index& b )
+{
+   if( a.received < b.received ) return true;
+   if( a.received == b.received ) return a.owner < b.owner;
+   return false;
+}
+bool operator == ( const mail_expiry_index& a, const mail_expiry_index& b )
+{
+   return a.received == b.received && a.owner == b.owner;
+}
+
 }  } // bts::mail
 
 namespace bts { namespace mail {
@@ -41,6 +61,21 @@ namespace bts { namespace mail {
             {
                _mail_inventory_db.open( data_dir / "mail_inventory_db" );
                _mail_data_db.open( data_dir / "mail_data_db" );
+               _mail_expiry_db.open( data_dir / "mail_expiry_db" );
+
+               /* Servers from before the expiry index get it built from the inventory */
+               const bool index_expiry = !_mail_expiry_db.begin().valid();
+               auto expiry_batch = _mail_expiry_db.create_batch();
+               for( auto itr = _mail_inventory_db.begin(); itr.valid(); ++itr )
+               {
+                  const auto key = itr.key();
+                  _latest_received[ key.owner ] = key.received;
+                  if( index_expiry )
+                     expiry_batch.store( mail_expiry_index{ key.received, key.owner }, itr.value() );
+               }
+               expiry_batch.commit();
+
+               expire_messages();
             }
 
             ~server_impl()
@@ -48,6 +83,7 @@ namespace bts { namespace mail {
                try {
                   _mail_inventory_db.close();
                   _mail_data_db.close();
+                  _mail_expiry_db.close();
                } 
                catch ( const fc::exception& e )
                {
@@ -67,10 +103,44 @@ namespace bts { namespace mail {
                if( _mail_data_db.fetch_optional(inventory_id) )
                   FC_THROW_EXCEPTION( message_already_stored, "Message already stored on server." );
 
-               _mail_inventory_db.store( mail_index{msg.recipient,fc::time_point::now()}, inventory_id );
+               const auto now = fc::time_point::now();
+               if( now - _last_expiry > BTS_MAIL_EXPIRY_INTERVAL )
+                  expire_messages();
+
+               /* The message is written before the indexes that point to it, each in one write */
                _mail_data_db.store( inventory_id, msg );
+               _mail_inventory_db.store( mail_index{msg.recipient,now}, inventory_id );
+               _mail_expiry_db.store( mail_expiry_index{now,msg.recipient}, inventory_id );
+               _latest_received[ msg.recipient ] = now;
             } FC_CAPTURE_AND_RETHROW( (msg) ) }
 
+            /** removes the messages received more than BTS_MAIL_MESSAGE_RETENTION ago, in one batch per database */
+            void expire_messages()
+            { try {
+               _last_expiry = fc::time_point::now();
+               const auto cutoff = _last_expiry - BTS_MAIL_MESSAGE_RETENTION;
+
+               auto inventory_batch = _mail_inventory_db.create_batch();
+               auto data_batch = _mail_data_db.create_batch();
+               auto expiry_batch = _mail_expiry_db.create_batch();
+               for( auto itr = _mail_expiry_db.begin(); itr.valid(); ++itr )
+               {
+                  const auto key = itr.key();
+                  if( !(key.received < cutoff) ) break;
+
+                  inventory_batch.remove( mail_index{ key.owner, key.received } );
+                  data_batch.remove( itr.value() );
+                  expiry_batch.remove( key );
+
+                  const auto latest_itr = _latest_received.find( key.owner );
+                  if( latest_itr != _latest_received.end() && latest_itr->second == key.received )
+                     _latest_received.erase( latest_itr );
+               }
+               expiry_batch.commit();
+               inventory_batch.commit();
+               data_batch.commit();
+            } FC_CAPTURE_AND_RETHROW() }
+
             inventory_type fetch_inventory( const bts::blockchain::address& owner, 
                                             const fc::time_point& start, 
                                             uint32_t limit = BTS_MAIL_INVENTORY_FETCH_LIMIT )
@@ -79,8 +149,13 @@ namespace bts { namespace mail {
                   limit = BTS_MAIL_INVENTORY_FETCH_LIMIT;
 
                inventory_type result;
-               result.reserve( limit );
 
+               /* Most polls are for owners with nothing newer than start, which memory answers */
+               const auto latest_itr = _latest_received.find( owner );
+               if( latest_itr == _latest_received.end() || latest_itr->second < start )
+                  return result;
+
+               result.reserve( limit );
                auto itr = _mail_inventory_db.lower_bound( mail_index{ owner, start } );
                while( itr.valid() && result.size() < limit )
                {
@@ -123,6 +198,11 @@ namespace bts { namespace mail {
          private:
             bts::db::level_pod_map< mail_index, message_id_type >   _mail_inventory_db;
             bts::db::level_map< message_id_type, message >          _mail_data_db;
+            bts::db::level_pod_map< mail_expiry_index, message_id_type > _mail_expiry_db;
+
+            /** when each owner's newest stored message arrived; an owner without one has no mail */
+            std::unordered_map< bts::blockchain::address, fc::time_point > _latest_received;
+            fc::time_point                                          _last_expiry;
       };
 
    } // namespace detail
@@ -160,3 +240,4 @@ namespace bts { namespace mail {
 } } // bts::mail
 
 FC_REFLECT( bts::mail::mail_index, (owner)(received) );
+FC_REFLECT( bts::mail::mail_expiry_index, (received)(owner) );
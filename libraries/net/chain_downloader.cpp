@@ -6,6 +6,14 @@
 #include <fc/io/raw_variant.hpp>
 #include <fc/thread/thread.hpp>
 
+#include <bts/net/config.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <set>
+
 namespace bts { namespace net {
 
     namespace detail {
@@ -49,13 +57,246 @@ namespace bts { namespace net {
               }
           } FC_RETHROW_EXCEPTIONS(error, "") }
 
+          /** @return a connection to server that speaks our protocol, or null if it can't be reached */
+          std::unique_ptr<fc::tcp_socket> connect_to(const fc::ip::endpoint& server)
+          {
+              std::unique_ptr<fc::tcp_socket> socket(new fc::tcp_socket);
+              try
+              {
+                  ilog("Attempting to connect to chain server ${s}", ("s",server));
+                  socket->connect_to(server);
+                  uint32_t protocol_version = -1;
+                  fc::raw::unpack(*socket, protocol_version);
+                  if (protocol_version == PROTOCOL_VERSION)
+                      return socket;
+                  wlog("Can't talk to chain server; he's using protocol ${srv} and I'm using ${cli}!",
+                       ("srv", protocol_version)("cli", PROTOCOL_VERSION));
+                  fc::raw::pack(*socket, finish);
+              }
+              catch ( const fc::canceled_exception& )
+              {
+                  throw;
+              }
+              catch (const fc::exception& e) {
+                  wlog("Failed to connect to chain_server: ${e}", ("e", e.to_detail_string()));
+              }
+              socket->close();
+              return std::unique_ptr<fc::tcp_socket>();
+          }
+
+          /**
+           * State shared by the fetch_chunks workers of get_all_blocks.  Everything runs on one thread, so
+           * the workers only interleave while waiting on their sockets.
+           */
+          struct parallel_fetch
+          {
+              uint32_t                                          next_chunk_start;   /// first block of the next chunk nobody has taken
+              uint32_t                                          end_of_chain;       /// once a server runs out of blocks, nothing at or past here exists
+              std::set<uint32_t>                                chunks_to_retry;    /// starts of chunks whose worker failed
+              std::map<uint32_t, std::vector<blockchain::full_block> > fetched_chunks; /// by first block, waiting to be delivered
+              uint32_t                                          next_block_to_deliver;
+              uint32_t                                          highest_block_seen;
+          };
+
+          /** takes chunks from fetch until there are none left, fetching each from server with get_blocks_in_range */
+          void fetch_chunks(const fc::ip::endpoint& server, parallel_fetch& fetch, fc::time_point& last_progress)
+          {
+              std::unique_ptr<fc::tcp_socket> socket = connect_to(server);
+              FC_ASSERT(socket, "unable to connect to chain server ${server}", ("server", server));
+              last_progress = fc::time_point::now();
+
+              for (;;) {
+                  // don't run too far ahead of the blocks the callback has taken
+                  while (fetch.next_chunk_start >= fetch.next_block_to_deliver +
+                                                   BTS_NET_CHAIN_DOWNLOADER_CHUNK_SIZE * BTS_NET_CHAIN_DOWNLOADER_MAX_BUFFERED_CHUNKS &&
+                         fetch.chunks_to_retry.empty()) {
+                      last_progress = fc::time_point::now();
+                      fc::usleep(fc::milliseconds(50));
+                  }
+
+                  uint32_t chunk_start;
+                  if (!fetch.chunks_to_retry.empty()) {
+                      chunk_start = *fetch.chunks_to_retry.begin();
+                      fetch.chunks_to_retry.erase(fetch.chunks_to_retry.begin());
+                  } else if (fetch.next_chunk_start < fetch.end_of_chain) {
+                      chunk_start = fetch.next_chunk_start;
+                      fetch.next_chunk_start += BTS_NET_CHAIN_DOWNLOADER_CHUNK_SIZE;
+                  } else
+                      break;
+
+                  try {
+                      const uint32_t chunk_end = chunk_start + BTS_NET_CHAIN_DOWNLOADER_CHUNK_SIZE - 1;
+                      fc::raw::pack(*socket, get_blocks_in_range);
+                      fc::raw::pack(*socket, chunk_start);
+                      fc::raw::pack(*socket, chunk_end);
+
+                      uint32_t block_count = 0;
+                      fc::raw::unpack(*socket, block_count);
+                      std::vector<blockchain::full_block> blocks(block_count);
+                      for (blockchain::full_block& block : blocks) {
+                          fc::raw::unpack(*socket, block);
+                          last_progress = fc::time_point::now();
+                      }
+                      if (block_count < BTS_NET_CHAIN_DOWNLOADER_CHUNK_SIZE)
+                          fetch.end_of_chain = std::min(fetch.end_of_chain, chunk_start + block_count);
+                      if (block_count > 0) {
+                          fetch.highest_block_seen = std::max(fetch.highest_block_seen, blocks.back().block_num);
+                          fetch.fetched_chunks[chunk_start] = std::move(blocks);
+                      }
+                  } catch (...) {
+                      fetch.chunks_to_retry.insert(chunk_start);
+                      throw;
+                  }
+              }
+
+              fc::raw::pack(*socket, finish);
+              socket->close();
+          }
+
+          /** fetches chunks from every server at once, calling back in block order; @return the next block to get */
+          uint32_t get_blocks_in_parallel(const std::function<void (const blockchain::full_block&, uint32_t)>& new_block_callback,
+                                          uint32_t first_block_number)
+          {
+              parallel_fetch fetch;
+              fetch.next_chunk_start = first_block_number;
+              fetch.end_of_chain = std::numeric_limits<uint32_t>::max();
+              fetch.next_block_to_deliver = first_block_number;
+              fetch.highest_block_seen = first_block_number;
+
+              std::vector<fc::future<void>> workers;
+              std::vector<fc::time_point> last_progress(_chain_servers.size(), fc::time_point::now());
+              for (size_t i = 0; i < _chain_servers.size(); ++i) {
+                  const fc::ip::endpoint server = _chain_servers[i];
+                  fc::time_point& worker_progress = last_progress[i];
+                  workers.push_back(fc::async([this, server, &fetch, &worker_progress]{ fetch_chunks(server, fetch, worker_progress); },
+                                              "chain_downloader fetch_chunks"));
+              }
+
+              uint32_t blocks_in = 0;
+              auto start_time = fc::time_point::now();
+              try {
+                  for (;;) {
+                      bool any_worker_running = false;
+                      for (size_t i = 0; i < workers.size(); ++i) {
+                          if (workers[i].ready())
+                              continue;
+                          if (fc::time_point::now() - last_progress[i] > fc::seconds(BTS_NET_CHAIN_DOWNLOADER_TIMEOUT_SEC)) {
+                              wlog("Chain server ${s} stalled, fetching its blocks elsewhere", ("s", _chain_servers[i]));
+                              workers[i].cancel_and_wait("Timed out");
+                              continue;
+                          }
+                          any_worker_running = true;
+                      }
+
+                      auto chunk = fetch.fetched_chunks.begin();
+                      if (chunk != fetch.fetched_chunks.end() && chunk->first == fetch.next_block_to_deliver) {
+                          std::vector<blockchain::full_block> blocks = std::move(chunk->second);
+                          fetch.fetched_chunks.erase(chunk);
+                          for (const blockchain::full_block& block : blocks) {
+                              new_block_callback(block, fetch.highest_block_seen - block.block_num);
+                              ++blocks_in;
+                          }
+                          fetch.next_block_to_deliver += (uint32_t)blocks.size();
+                          // the workers couldn't run while the callback had the thread, so that isn't their stall
+                          std::fill(last_progress.begin(), last_progress.end(), fc::time_point::now());
+                          // a short chunk is the end of the chain
+                          if (blocks.size() < BTS_NET_CHAIN_DOWNLOADER_CHUNK_SIZE)
+                              break;
+                          continue;
+                      }
+                      if (!any_worker_running || fetch.next_block_to_deliver >= fetch.end_of_chain)
+                          break;
+                      fc::usleep(fc::milliseconds(50));
+                  }
+              } catch (...) {
+                  for (fc::future<void>& worker : workers)
+                      if (!worker.ready())
+                          worker.cancel_and_wait("chain_downloader stopping");
+                  throw;
+              }
+              for (fc::future<void>& worker : workers)
+                  if (!worker.ready())
+                      worker.cancel_and_wait("chain_downloader finished");
+
+              ulog("Finished fast-syncing ${num} blocks from ${servers} servers at ${rate} blocks/sec.",
+                   ("num", blocks_in)("servers", workers.size())
+                   ("rate", blocks_in/std::max(0.001, (fc::time_point::now() - start_time).count() / 1000000.0)));
+              return fetch.next_block_to_deliver;
+          }
+
+          /** downloads the snapshot from server into file; @return false if the server lacks it or it has another hash */
+          bool fetch_state_snapshot(const fc::ip::endpoint& server, uint32_t block_num, const fc::sha256& snapshot_hash,
+                                    const fc::path& file)
+          {
+              std::unique_ptr<fc::tcp_socket> socket = connect_to(server);
+              if (!socket)
+                  return false;
+
+              fc::raw::pack(*socket, get_state_snapshot);
+              fc::raw::pack(*socket, block_num);
+              uint64_t remaining = 0;
+              fc::raw::unpack(*socket, remaining);
+              if (remaining == 0) {
+                  wlog("Chain server ${s} has no index snapshot at block ${n}", ("s", server)("n", block_num));
+                  fc::raw::pack(*socket, finish);
+                  socket->close();
+                  return false;
+              }
+
+              ulog("Downloading a ${mb} MiB state snapshot from ${s}", ("mb", remaining / 1024 / 1024)("s", server));
+              std::ofstream out(file.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+              FC_ASSERT(out.is_open(), "unable to create ${file}", ("file", file));
+              fc::sha256::encoder file_hash;
+              std::vector<char> buffer(BTS_NET_CHAIN_SERVER_WRITE_SIZE);
+              while (remaining > 0) {
+                  const size_t length = std::min<uint64_t>(remaining, buffer.size());
+                  socket->read(buffer.data(), length);
+                  out.write(buffer.data(), length);
+                  file_hash.write(buffer.data(), length);
+                  remaining -= length;
+              }
+              out.flush();
+              FC_ASSERT(out.good(), "error writing ${file}", ("file", file));
+              fc::raw::pack(*socket, finish);
+              socket->close();
+
+              if (file_hash.result() != snapshot_hash) {
+                  wlog("The state snapshot from ${s} does not match the trusted hash", ("s", server));
+                  return false;
+              }
+              return true;
+          }
+
+          void get_state_snapshot(uint32_t block_num, const fc::sha256& snapshot_hash, const fc::path& file)
+          { try {
+              for (const fc::ip::endpoint& server : _chain_servers) {
+                  try {
+                      if (fetch_state_snapshot(server, block_num, snapshot_hash, file))
+                          return;
+                  } catch (const fc::canceled_exception&) {
+                      throw;
+                  } catch (const fc::exception& e) {
+                      wlog("Failed to get a state snapshot from ${s}: ${e}", ("s", server)("e", e.to_detail_string()));
+                  }
+              }
+              FC_THROW("No chain server has a state snapshot at block ${n} matching the trusted hash", ("n", block_num));
+          } FC_CAPTURE_AND_RETHROW((block_num)(snapshot_hash)(file)) }
+
           void get_all_blocks(std::function<void (const blockchain::full_block&, uint32_t)> new_block_callback,
                               uint32_t first_block_number)
           { try {
               if (!new_block_callback)
                   return;
 
+              // when a server fails us, the next one picks up after the last block we got
+              uint32_t next_block_number = first_block_number;
+              if (next_block_number == 0) next_block_number = 1;
+
+              // the bulk of the chain comes from all servers at once.  Servers that don't know get_blocks_in_range
+              // hang up, leaving their chunks to the others, or to the stream below if none of them know it
+              next_block_number = get_blocks_in_parallel(new_block_callback, next_block_number);
               fc::future<void> work_future;
+              // then stream whatever remains, and the blocks produced meanwhile, from one server at a time
               while(!_chain_servers.empty()) {
                  try {
                     fc::time_point checkpoint = fc::time_point::now();
@@ -65,13 +306,13 @@ namespace bts { namespace net {
                        checkpoint = fc::time_point::now();
                        FC_ASSERT(_client_socket->is_open(), "unable to connect to any chain server");
                        ilog("Connected to ${remote}; requesting blocks after ${num}",
-                            ("remote", _client_socket->remote_endpoint())("num", first_block_number));
+                            ("remote", _client_socket->remote_endpoint())("num", next_block_number));
 
-                       ulog("Starting fast-sync of blocks from ${num}", ("num", first_block_number));
+                       ulog("Starting fast-sync of blocks from ${num}", ("num", next_block_number));
                        auto start_time = fc::time_point::now();
 
                        fc::raw::pack(*_client_socket, get_blocks_from_number);
-                       fc::raw::pack(*_client_socket, first_block_number);
+                       fc::raw::pack(*_client_socket, next_block_number);
 
                        uint32_t blocks_to_retrieve = 0;
                        uint32_t blocks_in = 0;
@@ -88,6 +329,7 @@ namespace bts { namespace net {
                            new_block_callback(block, blocks_to_retrieve);
                            --blocks_to_retrieve;
                            ++blocks_in;
+                           next_block_number = block.block_num + 1;
 
                            if(blocks_to_retrieve == 0) {
                                fc::raw::unpack(*_client_socket, blocks_to_retrieve);
@@ -157,4 +399,10 @@ namespace bts { namespace net {
         return fc::async([=]{my->get_all_blocks(new_block_callback, first_block_number);}, "get_all_blocks");
     }
 
+    fc::future<void> chain_downloader::get_state_snapshot(uint32_t block_num, const fc::sha256& snapshot_hash,
+                                                          const fc::path& file)
+    {
+        return fc::async([=]{my->get_state_snapshot(block_num, snapshot_hash, file);}, "get_state_snapshot");
+    }
+
   } } //namespace bts::blockchain
@@ -1,11 +1,13 @@
 #include <bts/net/stcp_socket.hpp>
 #include <bts/net/chain_server.hpp>
 #include <bts/net/chain_server_commands.hpp>
+#include <bts/net/config.hpp>
 
 #include <fc/io/raw_variant.hpp>
 #include <fc/thread/thread.hpp>
 #include <fc/network/ip.hpp>
 
+#include <fstream>
 #include <thread>
 
 namespace bts { namespace net {
@@ -70,6 +72,23 @@ namespace bts { namespace net {
                 }
             }
 
+            /** sends blocks first_block through last_block, gathering them into large writes */
+            void send_blocks(fc::tcp_socket& connection_socket, uint32_t first_block, uint32_t last_block, bool headers_only) {
+                std::vector<char> buffer;
+                buffer.reserve(BTS_NET_CHAIN_SERVER_WRITE_SIZE);
+                for (uint32_t block_number = first_block; block_number <= last_block; ++block_number) {
+                    // the stored bytes are what packing the decoded block would produce
+                    const auto packed = headers_only ? fc::raw::pack(_chain_db->get_block_header(block_number))
+                                                     : _chain_db->get_packed_block(block_number);
+                    buffer.insert(buffer.end(), packed.begin(), packed.end());
+                    if (buffer.size() >= BTS_NET_CHAIN_SERVER_WRITE_SIZE || block_number == last_block) {
+                        connection_socket.write(buffer.data(), buffer.size());
+                        buffer.clear();
+                        fc::yield();
+                    }
+                }
+            }
+
             void handle_get_blocks_from_number(fc::tcp_socket& connection_socket) {
               try {
                 uint32_t start_block;
@@ -84,11 +103,8 @@ namespace bts { namespace net {
 
                     ilog("Sending blocks from ${start} to ${finish} to ${remote}",
                          ("start", start_block)("finish", end_block)("remote", connection_socket.remote_endpoint()));
-                    for (; start_block <= end_block; ++start_block) {
-                        fc::raw::pack(connection_socket, _chain_db->get_block(start_block));
-                        if (start_block % 10 == 0)
-                            fc::yield();
-                    }
+                    send_blocks(connection_socket, start_block, end_block, false);
+                    start_block = end_block + 1;
                     end_block = start_block;
                 }
 
@@ -97,6 +113,56 @@ namespace bts { namespace net {
               } FC_RETHROW_EXCEPTIONS(error, "", ("remote_endpoint", connection_socket.remote_endpoint()))
             }
 
+            void handle_get_range(fc::tcp_socket& connection_socket, bool headers_only) {
+              try {
+                uint32_t first_block;
+                uint32_t last_block;
+                fc::raw::unpack(connection_socket, first_block);
+                fc::raw::unpack(connection_socket, last_block);
+                if (first_block == 0) first_block = 1;
+                last_block = std::min(last_block, _chain_db->get_head_block_num());
+
+                const uint32_t blocks_to_send = last_block >= first_block ? last_block - first_block + 1 : 0;
+                fc::raw::pack(connection_socket, blocks_to_send);
+                if (blocks_to_send == 0)
+                    return;
+
+                ilog("Sending ${what} from ${start} to ${finish} to ${remote}",
+                     ("what", headers_only ? "block headers" : "blocks")("start", first_block)("finish", last_block)
+                     ("remote", connection_socket.remote_endpoint()));
+                send_blocks(connection_socket, first_block, last_block, headers_only);
+              } FC_RETHROW_EXCEPTIONS(error, "", ("remote_endpoint", connection_socket.remote_endpoint()))
+            }
+
+            void handle_get_state_snapshot(fc::tcp_socket& connection_socket) {
+              try {
+                uint32_t block_num;
+                fc::raw::unpack(connection_socket, block_num);
+
+                // the file stays readable through the open stream if the snapshot is rotated out meanwhile
+                std::ifstream in;
+                const auto file = _chain_db->get_index_snapshot(block_num);
+                if (file.valid())
+                    in.open(file->string().c_str(), std::ios::in | std::ios::binary);
+                const uint64_t file_size = in.is_open() ? fc::file_size(*file) : 0;
+                fc::raw::pack(connection_socket, file_size);
+                if (file_size == 0)
+                    return;
+
+                ilog("Sending index snapshot ${file} to ${remote}", ("file", *file)("remote", connection_socket.remote_endpoint()));
+                std::vector<char> buffer(BTS_NET_CHAIN_SERVER_WRITE_SIZE);
+                uint64_t remaining = file_size;
+                while (remaining > 0) {
+                    const size_t length = std::min<uint64_t>(remaining, buffer.size());
+                    in.read(buffer.data(), length);
+                    FC_ASSERT(in.good(), "error reading index snapshot ${file}", ("file", *file));
+                    connection_socket.write(buffer.data(), length);
+                    remaining -= length;
+                    fc::yield();
+                }
+              } FC_RETHROW_EXCEPTIONS(error, "", ("remote_endpoint", connection_socket.remote_endpoint()))
+            }
+
             void serve_client(fc::tcp_socket* connection_socket) {
               try {
                 FC_ASSERT(connection_socket->is_open());
@@ -111,6 +177,15 @@ namespace bts { namespace net {
                       case get_blocks_from_number:
                         handle_get_blocks_from_number(*connection_socket);
                         break;
+                      case get_blocks_in_range:
+                        handle_get_range(*connection_socket, false);
+                        break;
+                      case get_block_headers_in_range:
+                        handle_get_range(*connection_socket, true);
+                        break;
+                      case get_state_snapshot:
+                        handle_get_state_snapshot(*connection_socket);
+                        break;
                       case finish:
                         break;
                     }
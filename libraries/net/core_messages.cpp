@@ -2,6 +2,8 @@
 
 #include <bts/client/messages.hpp>
 
+#include <fc/compress/lzma.hpp>
+
 namespace bts { namespace net {
 
   const core_message_type_enum item_ids_inventory_message::type              = core_message_type_enum::item_ids_inventory_message_type;
@@ -21,6 +23,17 @@ namespace bts { namespace net {
   const core_message_type_enum check_firewall_reply_message::type            = core_message_type_enum::check_firewall_reply_message_type;
   const core_message_type_enum get_current_connections_request_message::type = core_message_type_enum::get_current_connections_request_message_type;
   const core_message_type_enum get_current_connections_reply_message::type   = core_message_type_enum::get_current_connections_reply_message_type;
+  const core_message_type_enum compressed_message::type                      = core_message_type_enum::compressed_message_type;
+
+  compressed_message::compressed_message(uint32_t msg_type, const std::vector<char>& uncompressed_data) :
+    msg_type(msg_type),
+    compressed_data(fc::lzma_compress(uncompressed_data))
+  {}
+
+  std::vector<char> compressed_message::decompress() const
+  {
+    return fc::lzma_decompress(compressed_data);
+  }
 
 } } // bts::client
 
@@ -2,6 +2,8 @@
 
 #include <bts/blockchain/block.hpp>
 
+#include <fc/crypto/sha256.hpp>
+#include <fc/filesystem.hpp>
 #include <fc/thread/future.hpp>
 #include <fc/network/ip.hpp>
 
@@ -41,17 +43,31 @@ namespace bts { namespace net {
         void add_chain_servers(const std::vector<fc::ip::endpoint>& servers);
 
         /**
-         * @brief Asynchronously retrieve all new blocks from one of the available chain_server nodes
+         * @brief Asynchronously retrieve all new blocks from the available chain_server nodes
          * @param new_block_callback Callback function taking the newly downloaded block and the count of blocks remaining
          * @param first_block_number The first block number to download. Defaults to 0, which means to download all
          * blocks in chain.
          * @return A future monitoring the function downloading blocks. When this future completes, all blocks have
          * been downloaded.
          *
+         * Ranges of blocks are fetched from all servers at once and handed to new_block_callback in order; the count
+         * of blocks remaining is then an estimate based on the highest block fetched so far.
+         *
          * If new_block_callback is unset, a valid future is still returned, but nothing will be done and the
          * function monitored by the future will return immediately.
          */
         fc::future<void> get_all_blocks(std::function<void (const blockchain::full_block&, uint32_t)> new_block_callback,
                                         uint32_t first_block_number);
+
+        /**
+         * @brief Asynchronously download an index snapshot to bootstrap a new chain database from
+         * @param block_num The block the snapshot was taken at
+         * @param snapshot_hash The sha256 of the whole snapshot file, from a source the caller trusts
+         * @param file Where to write the snapshot
+         * @return A future which completes once file holds a snapshot with that hash, or fails if no server has one
+         *
+         * Each server is asked in turn; a download that does not hash to snapshot_hash is discarded.
+         */
+        fc::future<void> get_state_snapshot(uint32_t block_num, const fc::sha256& snapshot_hash, const fc::path& file);
     };
 } } //namespace bts::net
@@ -26,6 +26,20 @@ namespace bts { namespace net {
      *      full_block objects. When the server has finished sending these blocks, it repeats the procedure for
      *      any new blocks which have been made in the interim, so another count is sent, followed by that number
      *      of blocks. When the server sends a count of 0, there are no blocks, and the command is complete.
+     *      A client that lost its connection resumes by sending this command again with the next block it needs.
+     * * get_blocks_in_range
+     *      This command takes two arguments, the numbers of the first and last blocks to retrieve. The server responds
+     *      with a uint32_t count of the blocks it will send, which stops at its head block, followed by the blocks
+     *      encoded as for get_blocks_from_number. The command is then complete.
+     * * get_block_headers_in_range
+     *      As get_blocks_in_range, but the server sends packed signed_block_headers instead of full blocks.
+     * * get_state_snapshot
+     *      This command takes one argument, the number of the block of the index snapshot to retrieve, or 0 for the
+     *      newest one the server has on its main chain. The server responds with a uint64_t size of the snapshot
+     *      file, which is 0 if it has no such snapshot, followed by that many bytes of the file. The command is then
+     *      complete. The client checks the file against a hash it trusts; see chain_database::get_index_snapshot.
+     *
+     * Servers that predate a command close the connection when they receive it.
      *
      * All block numbers are of type uint32_t
      */
@@ -12,9 +12,12 @@ const static uint32_t PROTOCOL_VERSION = 0;
 namespace bts { namespace net { namespace detail {
     enum chain_server_commands {
         finish = 0,
-        get_blocks_from_number
+        get_blocks_from_number,
+        get_blocks_in_range,
+        get_block_headers_in_range,
+        get_state_snapshot
     };
 } } } //namespace bts::net::detail
 
-FC_REFLECT_ENUM(bts::net::detail::chain_server_commands, (finish)(get_blocks_from_number))
+FC_REFLECT_ENUM(bts::net::detail::chain_server_commands, (finish)(get_blocks_from_number)(get_blocks_in_range)(get_block_headers_in_range)(get_state_snapshot))
 FC_REFLECT_TYPENAME(bts::net::detail::chain_server_commands)
@@ -34,6 +34,13 @@
 
 #define BTS_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES        (1024 * 1024)
 
+/**
+ * When several messages are waiting in a peer's send queue, they are written to
+ * the socket together until the batch reaches this many bytes.  A message larger
+ * than this still goes out, on its own.
+ */
+#define BTS_NET_MAX_COALESCED_SEND_SIZE                 (64 * 1024)
+
 /**
  * We prevent a peer from offering us a list of blocks which, if we fetched them
  * all, would result in a blockchain that extended into the future.
@@ -47,4 +54,160 @@
 
 #define BTS_NET_MAX_INVENTORY_SIZE_IN_MINUTES           2
 
+/**
+ * Items we advertise to each peer are remembered in a filter of about 30 bits per
+ * item of this capacity, rather than as a set of ids.  When more than this are
+ * advertised within BTS_NET_MAX_INVENTORY_SIZE_IN_MINUTES the older half is
+ * forgotten early, which at worst makes us advertise an item to a peer twice.
+ */
+#define BTS_NET_INVENTORY_FILTER_CAPACITY               4000
+
+/**
+ * New transactions are advertised to peers in batches gathered over this many
+ * milliseconds, so a burst costs each peer one inventory message instead of one
+ * per transaction.  Blocks are advertised immediately, along with any
+ * transactions waiting at the time.
+ */
+#define BTS_NET_INVENTORY_BATCH_INTERVAL_MS             200
+
+/**
+ * The client periodically rebroadcasts the pending transactions its peers may
+ * not have seen, in this many batches spread over the rebroadcast interval.
+ */
+#define BTS_NET_PENDING_REBROADCAST_BATCHES             10
+
+/**
+ * The propagation steps of this many of the most recent blocks are kept for
+ * node::get_block_propagation_data() and get_block_propagation_statistics().
+ */
+#define BTS_NET_BLOCK_PROPAGATION_TRACE_COUNT           1000
+
+/**
+ * Received messages wait in one queue per priority class (blocks and sync,
+ * inventory, transactions, address gossip) and are handled by a single task.
+ * In each round a class may handle up to its budget here before the classes
+ * below it get a turn, so spam in a lower class can't delay blocks for long
+ * and a busy higher class can't starve the others.
+ */
+#define BTS_NET_RECEIVED_MESSAGE_PRIORITY_BUDGETS       { 16, 8, 4, 1 }
+
+/**
+ * We stop reading from a peer while this many of its messages are waiting to
+ * be handled, so a flooding peer is throttled instead of filling our memory.
+ */
+#define BTS_NET_MAX_QUEUED_RECEIVED_MESSAGES_PER_PEER   100
+
+/**
+ * Up to this many received transactions are being validated by the client at
+ * once.  Their signatures are recovered on the blockchain's worker threads, so
+ * this many can keep that many cores busy; past it, handling more messages
+ * waits for the oldest validation to finish.
+ */
+#define BTS_NET_MAX_CONCURRENT_TRANSACTION_VALIDATIONS  16
+
+/**
+ * When choosing peers to connect to, we prefer the ones that performed best
+ * last time, but one connection in this many goes to a random candidate so we
+ * keep discovering new peers and don't all converge on the same ones.
+ */
+#define BTS_NET_RANDOM_PEER_CONNECTION_INTERVAL         3
+
+/**
+ * When ranking peers we haven't measured, assume they are this slow.  This is
+ * about the round trip time halfway around the world, so we try unknown
+ * peers ahead of ones we know to be far away or slow.
+ */
+#define BTS_NET_UNMEASURED_PEER_ROUND_TRIP_DELAY_MS     300
+
+/**
+ * Changes to the peer database are written to disk at most this often, in one
+ * batch, rather than on every connection attempt.
+ */
+#define BTS_NET_PEER_DATABASE_FLUSH_INTERVAL_SEC        60
+
+/**
+ * The client keeps the block messages it most recently sent to peers, packed
+ * and ready to send again, up to this many bytes.
+ */
+#define BTS_NET_SERVED_BLOCK_CACHE_BYTES                (32*1024*1024)
+
+/**
+ * The chain_server gathers consecutive blocks into writes of about this many
+ * bytes, instead of one write per block.
+ */
+#define BTS_NET_CHAIN_SERVER_WRITE_SIZE                 (256*1024)
+
+/**
+ * The chain_downloader splits the chain into ranges of this many blocks and
+ * fetches them from all its chain servers at once, keeping at most
+ * BTS_NET_CHAIN_DOWNLOADER_MAX_BUFFERED_CHUNKS ranges ahead of the block being
+ * applied.  A server that sends nothing for BTS_NET_CHAIN_DOWNLOADER_TIMEOUT_SEC
+ * is dropped and its range fetched from another.
+ */
+#define BTS_NET_CHAIN_DOWNLOADER_CHUNK_SIZE             500
+#define BTS_NET_CHAIN_DOWNLOADER_MAX_BUFFERED_CHUNKS    8
+#define BTS_NET_CHAIN_DOWNLOADER_TIMEOUT_SEC            5
+
 #define BTS_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING      100
+
+/**
+ * During sync we keep enough blocks requested from each peer to cover its round
+ * trip at the rate it delivers them, so a distant peer is never left idle waiting
+ * for our next request, but never more than this many.  The sync blocks we buffer
+ * may grow to the sum of these windows, up to BTS_NET_MAX_SYNC_BLOCKS_TO_PREFETCH.
+ */
+#define BTS_NET_MAX_SYNC_REQUEST_WINDOW                 1000
+#define BTS_NET_MAX_SYNC_BLOCKS_TO_PREFETCH             10000
+
+/**
+ * During sync, peers that support it are first asked for the headers of the blocks
+ * they offer, this many at a time, and only blocks whose headers have been checked
+ * are downloaded from them.
+ */
+#define BTS_NET_MAX_BLOCK_HEADERS_PER_REQUEST           1000
+
+/**
+ * A peer that hasn't answered a block header request in this many seconds is
+ * treated as not supporting them, and we fetch its sync blocks directly.
+ */
+#define BTS_NET_BLOCK_HEADERS_REQUEST_TIMEOUT_SEC       30
+
+/**
+ * When a peer has delivered none of the sync blocks we asked it for in this many
+ * seconds, those blocks are requested again from other peers that have them, so one
+ * slow peer cannot hold back the blocks behind it.  A peer that never answers is
+ * still disconnected by the ordinary request timeout.
+ */
+#define BTS_NET_SYNC_BLOCK_STALL_TIMEOUT_SEC            3
+
+/**
+ * Blocks smaller than this are sent uncompressed even to peers that support
+ * compression; below it LZMA's framing eats most of the savings.
+ */
+#define BTS_NET_MIN_COMPRESSED_MESSAGE_SIZE             1024
+
+/**
+ * Size of each of the encrypt and decrypt buffers of an stcp_socket, and so the most
+ * it moves per socket call.  Large enough that a typical block goes out and comes in
+ * with a couple of system calls instead of dozens; it costs twice this per connection.
+ */
+#define BTS_NET_STCP_BUFFER_SIZE                        (64 * 1024)
+
+/**
+ * Inbound connections are admitted to the node only once their hello message has been
+ * verified.  Until then the key exchange and the recovery of the hello's signature run
+ * on this many dedicated threads, so a burst of connection attempts costs the node thread
+ * no CPU, at most this many connections wait unverified, and any of them that has not
+ * sent a valid hello in the given number of seconds is dropped.
+ */
+#define BTS_NET_HANDSHAKE_THREADS                       2
+#define BTS_NET_MAX_UNVERIFIED_INBOUND_CONNECTIONS      32
+#define BTS_NET_INBOUND_HANDSHAKE_TIMEOUT_SEC           10
+
+/**
+ * Guaranteed shares of the upload limit for the traffic classes that get the least of
+ * the rest (see traffic_shaper), so handshakes and keepalives still go out and peers
+ * that are catching up still make progress while we relay a burst of new blocks.
+ */
+#define BTS_NET_DEFAULT_GOSSIP_MINIMUM_UPLOAD_RATE        (4 * 1024)
+#define BTS_NET_DEFAULT_SYNC_SERVING_MINIMUM_UPLOAD_RATE  (16 * 1024)
@@ -58,6 +58,7 @@ namespace bts { namespace net {
     check_firewall_reply_message_type            = 5015,
     get_current_connections_request_message_type = 5016,
     get_current_connections_reply_message_type   = 5017,
+    compressed_message_type                      = 5018,
     core_message_type_last                       = 5099
   };
 
@@ -324,6 +325,25 @@ namespace bts { namespace net {
     static const core_message_type_enum type;
   };
 
+  /**
+   *  Wraps another message whose data has been compressed with LZMA.  Only sent to peers
+   *  that announced "compression" in their hello user_data; the receiver decompresses it
+   *  and handles the inner message as though it had arrived directly, so the inner
+   *  message's id (the hash of its uncompressed data) is unchanged.
+   */
+  struct compressed_message
+  {
+    static const core_message_type_enum type;
+
+    uint32_t          msg_type;
+    std::vector<char> compressed_data;
+
+    compressed_message() : msg_type(0) {}
+    compressed_message(uint32_t msg_type, const std::vector<char>& uncompressed_data);
+
+    std::vector<char> decompress() const;
+  };
+
   struct current_connection_data
   {
     uint32_t           connection_duration; // in seconds
@@ -372,6 +392,7 @@ FC_REFLECT_ENUM( bts::net::core_message_type_enum,
                  (check_firewall_reply_message_type)
                  (get_current_connections_request_message_type)
                  (get_current_connections_reply_message_type)
+                 (compressed_message_type)
                  (core_message_type_last) )
 FC_REFLECT( bts::net::item_id, (item_type)
                                (item_hash) )
@@ -437,6 +458,8 @@ FC_REFLECT_ENUM(bts::net::firewall_check_result, (unable_to_check)
 FC_REFLECT(bts::net::check_firewall_message, (node_id)(endpoint_to_check))
 FC_REFLECT(bts::net::check_firewall_reply_message, (node_id)(endpoint_checked)(result))
 FC_REFLECT_EMPTY(bts::net::get_current_connections_request_message)
+FC_REFLECT(bts::net::compressed_message, (msg_type)
+                                         (compressed_data))
 FC_REFLECT(bts::net::current_connection_data, (connection_duration)
                                               (remote_endpoint)
                                               (node_id)
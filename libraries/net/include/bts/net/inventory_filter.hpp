@@ -0,0 +1,91 @@
+#pragma once
+
+#include <bts/net/core_messages.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace bts { namespace net {
+
+  /**
+   *  @brief approximate set of item ids, for remembering what we've advertised to a peer
+   *
+   *  A pair of Bloom filters: items go into the current one, lookups check both, and rotate()
+   *  drops the older one.  Takes a couple of bytes per item instead of a container node, at the
+   *  cost of contains() sometimes answering true for an item never inserted -- about one time in
+   *  a thousand while each filter holds at most its capacity.  Only use it where such a false
+   *  positive is harmless, like skipping an advertisement the peer will get from someone else.
+   */
+  class inventory_filter
+  {
+  public:
+    explicit inventory_filter( size_t capacity ) :
+      _capacity( capacity ),
+      _bits( ( capacity * bits_per_item + 63 ) / 64 * 64 ),
+      _current( _bits / 64 ),
+      _previous( _bits / 64 ),
+      _current_size( 0 ),
+      _previous_size( 0 )
+    {}
+
+    void insert( const item_id& item )
+    {
+      uint64_t first, step;
+      hashes( item, first, step );
+      for( unsigned i = 0; i < hash_count; ++i, first += step )
+        _current[ ( first % _bits ) / 64 ] |= uint64_t( 1 ) << ( first % 64 );
+      ++_current_size;
+    }
+
+    bool contains( const item_id& item ) const
+    {
+      return contains( _current, item ) || contains( _previous, item );
+    }
+
+    /** forgets everything inserted before the previous rotate() */
+    void rotate()
+    {
+      _previous.swap( _current );
+      std::fill( _current.begin(), _current.end(), 0 );
+      _previous_size = _current_size;
+      _current_size = 0;
+    }
+
+    /** past this, false positives climb quickly and the caller should rotate() */
+    bool full() const { return _current_size >= _capacity; }
+
+    /** number of insertions the filter still remembers, counting repeats */
+    size_t size() const { return _current_size + _previous_size; }
+
+  private:
+    enum { bits_per_item = 15, hash_count = 10 }; // ~0.1% false positives at capacity
+
+    /** the item hash is already uniformly distributed, so its words serve as the hash functions */
+    static void hashes( const item_id& item, uint64_t& first, uint64_t& step )
+    {
+      uint64_t words[2];
+      memcpy( words, item.item_hash.data(), sizeof( words ) );
+      first = words[0] ^ item.item_type;
+      step = words[1] | 1;
+    }
+
+    bool contains( const std::vector<uint64_t>& filter, const item_id& item ) const
+    {
+      uint64_t first, step;
+      hashes( item, first, step );
+      for( unsigned i = 0; i < hash_count; ++i, first += step )
+        if( !( filter[ ( first % _bits ) / 64 ] & ( uint64_t( 1 ) << ( first % 64 ) ) ) )
+          return false;
+      return true;
+    }
+
+    size_t                _capacity;
+    uint64_t              _bits;
+    std::vector<uint64_t> _current;
+    std::vector<uint64_t> _previous;
+    size_t                _current_size;
+    size_t                _previous_size;
+  };
+
+} } // bts::net
@@ -33,10 +33,10 @@ namespace bts { namespace net {
      message(){}
 
      message( message&& m )
-     :message_header(m),data( std::move(m.data) ){}
+     :message_header(m),data( std::move(m.data) ),_id( m._id ),_id_computed( m._id_computed ){}
 
      message( const message& m )
-     :message_header(m),data( m.data ){}
+     :message_header(m),data( m.data ),_id( m._id ),_id_computed( m._id_computed ){}
 
      /**
       *  Assumes that T::type specifies the message type
@@ -49,13 +49,23 @@ namespace bts { namespace net {
         size     = (uint32_t)data.size();
      }
 
-     fc::uint160_t id()const
+     /**
+      *  The hash of data, computed on the first call and carried along by copies, so a message passed
+      *  from the socket through the queues, the cache and the inventory is only hashed once.  Code that
+      *  changes data after calling this must call reset_id().
+      */
+     message_hash_type id()const
      {
-        return fc::ripemd160::hash( data.data(), (uint32_t)data.size() );
+        if( !_id_computed )
+        {
+           _id = fc::ripemd160::hash( data.data(), (uint32_t)data.size() );
+           _id_computed = true;
+        }
+        return _id;
      }
 
+     void reset_id() { _id_computed = false; }
 
-    
      /**
       *  Automatically checks the type and deserializes T in the
       *  opposite process from the constructor.
@@ -85,6 +95,10 @@ namespace bts { namespace net {
               ("msg_type", msg_type)
               );
      }
+
+   private:
+     mutable message_hash_type _id;
+     mutable bool              _id_computed = false;
   };
 
 } } // bts::net
@@ -1,5 +1,6 @@
 #pragma once
 #include <fc/network/tcp_socket.hpp>
+#include <fc/thread/thread.hpp>
 #include <bts/net/message.hpp>
 
 namespace bts { namespace net {
@@ -23,11 +24,13 @@ namespace bts { namespace net {
     message_oriented_connection(message_oriented_connection_delegate* delegate = nullptr);
     ~message_oriented_connection();
     fc::tcp_socket& get_socket();
-    void accept();
+    void accept( fc::thread* key_exchange_thread = nullptr );
     void bind(const fc::ip::endpoint& local_endpoint);
     void connect_to(const fc::ip::endpoint& remote_endpoint);
 
     void send_message(const message& message_to_send);
+    /** sends the messages with a single encrypted write; the peer reads them as if sent one at a time */
+    void send_messages(const std::vector<const message*>& messages_to_send);
     void close_connection();
     void destroy_connection();
 
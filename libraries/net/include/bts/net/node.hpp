@@ -7,6 +7,8 @@
 #include <bts/net/peer_database.hpp>
 
 #include <list>
+#include <map>
+#include <random>
 
 namespace bts { namespace net {
 
@@ -28,6 +30,15 @@ namespace bts { namespace net {
     fc::time_point received_time;
     fc::time_point validated_time;
     node_id_t originating_peer;
+
+    /// only traced for blocks passed to us in normal operation, and zero for steps that
+    /// didn't happen (a block we produced was never advertised to us or fetched)
+    /// @{
+    fc::time_point first_inventory_time; /// when a peer first advertised it
+    fc::time_point fetch_requested_time; /// when we asked a peer for it
+    fc::time_point validation_start_time; /// when we handed it to the client
+    fc::time_point first_relay_time; /// when we first advertised it onwards
+    /// @}
   };
 
    /**
@@ -56,6 +67,22 @@ namespace bts { namespace net {
           */
          virtual bool handle_message( const message&, bool sync_mode ) = 0;
 
+         /**
+          *  Called for each sync item as soon as it is received, possibly long before it can be passed
+          *  to handle_message() in chain order. The delegate may start stateless checks (such as
+          *  signature recovery) in the background; it must not change any state or throw.
+          */
+         virtual void pre_validate_message( const message& ) {}
+
+         /**
+          *  Checks whatever can be checked of a block without applying it, so it can be relayed while it is.
+          *
+          *  @returns true if the block builds on our head block and its header is valid, false if the
+          *           delegate can't tell without applying it
+          *  @throws exception if the block is known to be invalid
+          */
+         virtual bool verify_block_header( const message& ) { return false; }
+
          /**
           *  Assuming all data elements are ordered in some way, this method should
           *  return up to limit ids that occur *after* from_id.
@@ -114,6 +141,12 @@ namespace bts { namespace net {
           */
          virtual fc::time_point_sec get_block_time(const item_hash_t& block_id) = 0;
 
+         /**
+          * Returns the headers of the given blocks in the same order, stopping at the first
+          * block we don't know about.
+          */
+         virtual std::vector<bts::blockchain::signed_block_header> get_block_headers(const std::vector<item_hash_t>& block_ids) = 0;
+
          /** returns bts::blockchain::now() */
          virtual fc::time_point_sec get_blockchain_now() = 0;
 
@@ -121,6 +154,9 @@ namespace bts { namespace net {
 
          virtual uint32_t estimate_last_known_fork_from_git_revision_timestamp(uint32_t unix_timestamp) const = 0;
 
+         /** the first block whose full body we can serve; older blocks have been pruned to their headers */
+         virtual uint32_t get_first_full_block_number() const { return 1; }
+
          virtual void error_encountered(const std::string& message, const fc::oexception& error) = 0;
    };
 
@@ -216,6 +252,12 @@ namespace bts { namespace net {
          */
         virtual void  broadcast( const message& item_to_broadcast );
 
+        /**
+         *  @return the items that some connected peer in sync with us has neither advertised to us nor
+         *  been sent an advertisement for recently, or all of them if we have no such peers
+         */
+        virtual std::vector<item_id> get_items_peers_may_lack( const std::vector<item_id>& items ) const;
+
         /**
          *  Node starts the process of fetching all items after item_id of the
          *  given item_type.   During this process messages are not broadcast.
@@ -228,6 +270,11 @@ namespace bts { namespace net {
         fc::variant_object get_advanced_node_parameters();
         message_propagation_data get_transaction_propagation_data(const bts::blockchain::transaction_id_type& transaction_id);
         message_propagation_data get_block_propagation_data(const bts::blockchain::block_id_type& block_id);
+        /**
+         * Percentiles, in microseconds, of how long the recently traced blocks took between the
+         * steps recorded in their message_propagation_data, and from their timestamp to reaching us
+         */
+        fc::variant_object get_block_propagation_statistics();
         node_id_t get_node_id() const;
         void set_allowed_peers(const std::vector<node_id_t>& allowed_peers);
 
@@ -241,6 +288,13 @@ namespace bts { namespace net {
 
         fc::variant_object network_get_info() const;
         fc::variant_object network_get_usage_stats() const;
+        /** approximate bytes held by the message cache, the sync block backlog and the peers' send queues */
+        fc::variant_object get_memory_stats() const;
+        /**
+         * time per sync block spent being fetched, waiting for the blocks before it and being handled by the
+         * client, smoothed over the last blocks, with the depth of the queues between and each peer's share
+         */
+        fc::variant_object get_sync_stats() const;
 
         std::vector<potential_peer_record> get_potential_peers() const;
 
@@ -250,11 +304,27 @@ namespace bts { namespace net {
         std::unique_ptr<detail::node_impl, detail::node_impl_deleter> my;
    };
 
+    /** a simulated connection from one node delegate to another */
+    struct simulated_link
+    {
+      fc::microseconds latency;
+      uint64_t         bytes_per_second = 0; /// 0 for unlimited
+      double           loss_rate = 0;        /// fraction of messages lost and sent again a round trip later
+    };
+
+    /**
+     * Stands in for the p2p network in tests.  broadcast() hands messages straight to every node delegate.
+     *
+     * Delegates can also be joined by links, making it a discrete-event network simulation: broadcast_from()
+     * sends a message over the origin's links, every delegate that accepts it relays it over its others, and
+     * run() delivers the messages in order of simulated arrival without waiting in real time.  The real time
+     * a delegate spends in handle_message() is added to the simulated time before it relays.
+     */
     class simulated_network : public node
     {
     public:
       ~simulated_network();
-      simulated_network(const std::string& user_agent) : node(user_agent) {}
+      simulated_network(const std::string& user_agent);
       void      listen_to_p2p_network() override {}
       void      connect_to_p2p_network() override {}
       void      connect_to(const fc::ip::endpoint& ep) override {}
@@ -263,13 +333,39 @@ namespace bts { namespace net {
 
       void      sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers) override {}
       void      broadcast(const message& item_to_broadcast) override;
+      std::vector<item_id> get_items_peers_may_lack(const std::vector<item_id>& items) const override { return items; }
       void      add_node_delegate(node_delegate* node_delegate_to_add);
 
-      virtual uint32_t get_connection_count() const override { return 8; }
+      /** links a and b both ways; both must have been added */
+      void      connect_node_delegates(node_delegate* a, node_delegate* b, const simulated_link& link);
+      /** origin already has the message; it is scheduled over origin's links, to be delivered by run() */
+      void      broadcast_from(node_delegate* origin, const message& item_to_broadcast);
+      /** schedules a message from one linked delegate to the other, which won't relay it, as in sync */
+      void      send_to(node_delegate* from, node_delegate* to, const message& item_to_send);
+      /** delivers scheduled messages until there are none left; @return the simulated time */
+      fc::microseconds run();
+      /** simulated time from broadcast_from() until each delegate that got the message got it */
+      std::vector<fc::microseconds> get_delivery_delays(const message_hash_type& message_id) const;
+      void      set_random_seed(uint32_t seed);
+
+      void      set_connection_count(uint32_t count) { connection_count = count; }
+      virtual uint32_t get_connection_count() const override { return connection_count; }
     private:
       struct node_info;
+      struct scheduled_delivery;
       void message_sender(node_info* destination_node);
+      node_info* find_node(node_delegate* delegate) const;
+      void schedule(node_info* from, node_info* to, const message& item, fc::microseconds send_time, bool relay);
+      void deliver(const scheduled_delivery& delivery);
       std::list<node_info*> network_nodes;
+      uint32_t connection_count;
+
+      fc::microseconds simulated_time;
+      uint64_t next_delivery_sequence;
+      std::vector<scheduled_delivery> scheduled_deliveries; /// a heap, soonest first
+      std::map<message_hash_type, fc::microseconds> broadcast_times;
+      std::map<message_hash_type, std::vector<fc::microseconds>> delivery_delays;
+      std::mt19937 random_generator;
     };
 
 
@@ -278,4 +374,5 @@ namespace bts { namespace net {
 
 } } // bts::net
 
-FC_REFLECT(bts::net::message_propagation_data, (received_time)(validated_time)(originating_peer));
+FC_REFLECT(bts::net::message_propagation_data, (received_time)(validated_time)(originating_peer)
+                                               (first_inventory_time)(fetch_requested_time)(validation_start_time)(first_relay_time));
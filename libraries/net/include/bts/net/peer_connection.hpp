@@ -5,6 +5,8 @@
 #include <bts/net/message_oriented_connection.hpp>
 #include <bts/net/stcp_socket.hpp>
 #include <bts/net/config.hpp>
+#include <bts/net/inventory_filter.hpp>
+#include <bts/net/traffic_shaper.hpp>
 #include <bts/client/messages.hpp>
 
 #include <boost/tuple/tuple.hpp>
@@ -18,6 +20,7 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 
+#include <map>
 #include <queue>
 #include <boost/container/deque.hpp>
 
@@ -30,6 +33,8 @@ namespace bts { namespace net
       virtual void on_message(peer_connection* originating_peer,
                               const message& received_message) = 0;
       virtual void on_connection_closed(peer_connection* originating_peer) = 0;
+      /** paces the messages peers send, nullptr to send them as fast as the socket allows */
+      virtual traffic_shaper* get_traffic_shaper() { return nullptr; }
     };
 
     class peer_connection;
@@ -75,25 +80,30 @@ namespace bts { namespace net
       {
         message        message_to_send;
         size_t         message_send_time_field_offset;
+        traffic_class  message_traffic_class;
         fc::time_point enqueue_time;
         fc::time_point transmission_start_time;
         fc::time_point transmission_finish_time;
 
         queued_message(message message_to_send, 
                        size_t message_send_time_field_offset = (size_t)-1, 
+                       traffic_class message_traffic_class = traffic_class::gossip,
                        fc::time_point enqueue_time = fc::time_point::now()) :
           message_to_send(std::move(message_to_send)),
           message_send_time_field_offset(message_send_time_field_offset),
+          message_traffic_class(message_traffic_class),
           enqueue_time(enqueue_time)
         {}
       };
       size_t _total_queued_messages_size;
-      std::queue<queued_message, std::list<queued_message> > _queued_messages;
+      boost::container::deque<queued_message> _queued_messages;
       fc::future<void> _send_queued_messages_done;
     public:
       fc::time_point connection_initiation_time;
       fc::time_point connection_closed_time;
       fc::time_point connection_terminated_time;
+      /** when the node next checks this connection's timeouts, maximum() if no check is scheduled */
+      fc::time_point next_timeout_check;
       peer_connection_direction direction;
       //connection_state state;
       firewalled_state is_firewalled;
@@ -148,10 +158,17 @@ namespace bts { namespace net
       bool we_need_sync_items_from_peer;
       fc::optional<boost::tuple<item_id, fc::time_point> > item_ids_requested_from_peer; /// we check this to detect a timed-out request and in busy()
       item_to_time_map_type sync_items_requested_from_peer; /// ids of blocks we've requested from this peer during sync.  fetch from another peer if this peer disconnects
+      fc::microseconds sync_block_delivery_time; /// moving average of the time this peer takes per sync block, zero until it has delivered one
+      fc::time_point last_sync_block_received_time;
+      uint32_t sync_request_window; /// how many sync blocks we last decided to keep requested from this peer
       uint32_t last_block_number_delegate_has_seen; /// the number of the last block this peer has told us about that the delegate knows (ids_of_items_to_get[0] should be the id of block [this value + 1])
       item_hash_t last_block_delegate_has_seen; /// the hash of the last block  this peer has told us about that the peer knows
       fc::time_point_sec last_block_time_delegate_has_seen;
       bool inhibit_fetching_sync_blocks;
+      bool supports_block_headers; /// they answer block header requests, so we check the headers of the blocks they offer before fetching them
+      uint32_t first_full_block_number; /// they pruned the bodies of older blocks, so we don't sync those from them
+      std::vector<item_hash_t> block_headers_requested_from_peer; /// ids of the blocks whose headers we're waiting for
+      fc::time_point block_headers_request_time;
       /// @}
 
       /// non-synchronization state data
@@ -172,17 +189,38 @@ namespace bts { namespace net
                                                                           boost::multi_index::ordered_non_unique<boost::multi_index::tag<timestamp_index>,
                                                                                                                  boost::multi_index::member<timestamped_item_id, fc::time_point_sec, &timestamped_item_id::timestamp> > > > timestamped_items_set_type;
       timestamped_items_set_type inventory_peer_advertised_to_us;
-      timestamped_items_set_type inventory_advertised_to_peer;
+      inventory_filter inventory_advertised_to_peer; /// approximate, see inventory_filter
+      fc::time_point inventory_advertised_to_peer_rotation_time;
 
       item_to_time_map_type items_requested_from_peer;  /// items we've requested from this peer during normal operation.  fetch from another peer if this peer disconnects
       /// @}
 
+      /// traffic counters, reported by node::get_connected_peers()
+      /// @{
+      struct message_counts
+      {
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+      };
+      std::map<uint32_t, message_counts> messages_sent_by_type; /// by msg_type as it goes on the wire, so compressed messages count as compressed_message
+      std::map<uint32_t, message_counts> messages_received_by_type;
+      uint32_t blocks_served; /// blocks we sent in reply to this peer's requests
+      uint32_t sync_blocks_received; /// blocks this peer delivered to us during sync
+      uint32_t blocks_delivered_first; /// new blocks this peer delivered to us before any other peer did
+      /// @}
+
       // if they're flooding us with transactions, we set this to avoid fetching for a few seconds to let the
       // blockchain catch up
       fc::time_point transaction_fetching_inhibited_until;
 
       uint32_t last_known_fork_block_number;
 
+      bool supports_compact_blocks; /// they understand compact_block_message, so we fetch new blocks from them that way
+      bool supports_compression; /// they understand compressed_message, so we compress large blocks we send them
+
+      unsigned received_messages_queued; /// messages from this peer waiting in the node's priority queues
+      fc::promise<void>::ptr received_messages_drained_promise; /// set while our read loop waits for received_messages_queued to go down
+
       fc::future<void> accept_or_connect_task_done;
 
 #ifndef NDEBUG
@@ -198,13 +236,19 @@ namespace bts { namespace net
       virtual ~peer_connection();
 
       fc::tcp_socket& get_socket();
-      void accept_connection();
+      /** the cryptography of the key exchange runs on key_exchange_thread, if given */
+      void accept_connection( fc::thread* key_exchange_thread = nullptr );
       void connect_to(const fc::ip::endpoint& remote_endpoint, fc::optional<fc::ip::endpoint> local_endpoint = fc::optional<fc::ip::endpoint>());
 
       void on_message(message_oriented_connection* originating_connection, const message& received_message) override;
       void on_connection_closed(message_oriented_connection* originating_connection) override;
 
       void send_message(const message& message_to_send, size_t message_send_time_field_offset = (size_t)-1);
+      /** the traffic class a message is sent as by default: blocks and transactions are relayed, the rest is gossip */
+      static traffic_class traffic_class_of(const message& message_to_classify);
+      /** sends the message as the given traffic class instead of the one its type implies */
+      void send_message(const message& message_to_send, traffic_class message_traffic_class,
+                        size_t message_send_time_field_offset = (size_t)-1);
       void close_connection();
       void destroy_connection();
 
@@ -214,6 +258,11 @@ namespace bts { namespace net
       fc::time_point get_last_message_sent_time() const;
       fc::time_point get_last_message_received_time() const;
 
+      size_t get_queued_message_count() const;
+      size_t get_total_queued_messages_size() const;
+      /** how long the oldest message not yet sent has been waiting, zero if none are */
+      fc::microseconds get_oldest_queued_message_age() const;
+
       fc::optional<fc::ip::endpoint> get_remote_endpoint();
       fc::ip::endpoint get_local_endpoint();
       void set_remote_endpoint(fc::optional<fc::ip::endpoint> new_remote_endpoint);
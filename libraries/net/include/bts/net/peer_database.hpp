@@ -30,9 +30,27 @@ namespace bts { namespace net {
     uint32_t                          number_of_failed_connection_attempts;
     fc::optional<fc::exception>       last_error;
 
+    /// how the peer performed while we were connected, zero until measured.  The times are
+    /// smoothed across connections, the throughput is from the last one and the count adds up
+    /// @{
+    fc::microseconds                  round_trip_delay;
+    fc::microseconds                  sync_block_delivery_time;
+    uint32_t                          bytes_received_per_second;
+    uint32_t                          number_of_blocks_delivered_first; /// new blocks we got from this peer before any other
+    /// @}
+
+    /**
+     * Lower is better: the round trip time in milliseconds plus the sync block delivery time,
+     * stretched by failed connection attempts and shrunk by how often the peer was first to
+     * give us a new block
+     */
+    double selection_cost() const;
+
     potential_peer_record() :
       number_of_successful_connection_attempts(0),
-    number_of_failed_connection_attempts(0){}
+      number_of_failed_connection_attempts(0),
+      bytes_received_per_second(0),
+      number_of_blocks_delivered_first(0){}
 
     potential_peer_record(fc::ip::endpoint endpoint,
                           fc::time_point_sec last_seen_time = fc::time_point_sec(),
@@ -41,7 +59,9 @@ namespace bts { namespace net {
       last_seen_time(last_seen_time),
       last_connection_disposition(last_connection_disposition),
       number_of_successful_connection_attempts(0),
-      number_of_failed_connection_attempts(0)
+      number_of_failed_connection_attempts(0),
+      bytes_received_per_second(0),
+      number_of_blocks_delivered_first(0)
     {}  
   };
 
@@ -87,9 +107,16 @@ namespace bts { namespace net {
 
     std::vector<potential_peer_record> get_all()const;
 
+    /** changes are written to disk in batches, this writes the pending ones now */
+    void flush();
+
     typedef detail::peer_database_iterator iterator;
+    /// most recently seen first
     iterator begin() const;
     iterator end() const;
+    /// lowest potential_peer_record::selection_cost() first
+    iterator begin_by_selection_cost() const;
+    iterator end_by_selection_cost() const;
     size_t size() const;
   private:
     std::unique_ptr<detail::peer_database_impl> my;
@@ -98,4 +125,5 @@ namespace bts { namespace net {
 } } // end namespace bts::net
 
 FC_REFLECT_ENUM(bts::net::potential_peer_last_connection_disposition, (never_attempted_to_connect)(last_connection_failed)(last_connection_rejected)(last_connection_handshaking_failed)(last_connection_succeeded))
-FC_REFLECT(bts::net::potential_peer_record, (endpoint)(last_seen_time)(last_connection_disposition)(last_connection_attempt_time)(number_of_successful_connection_attempts)(number_of_failed_connection_attempts)(last_error) )
+FC_REFLECT(bts::net::potential_peer_record, (endpoint)(last_seen_time)(last_connection_disposition)(last_connection_attempt_time)(number_of_successful_connection_attempts)(number_of_failed_connection_attempts)(last_error)
+                                      (round_trip_delay)(sync_block_delivery_time)(bytes_received_per_second)(number_of_blocks_delivered_first) )
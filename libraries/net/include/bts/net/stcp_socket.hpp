@@ -2,6 +2,7 @@
 #include <fc/network/tcp_socket.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/elliptic.hpp>
+#include <fc/thread/thread.hpp>
 
 namespace bts { namespace net {
 
@@ -15,7 +16,8 @@ class stcp_socket : public virtual fc::iostream
     stcp_socket();
     ~stcp_socket();
     fc::tcp_socket&  get_socket() { return _sock; }
-    void             accept();
+    /** the key generation and ECDH of the exchange run on key_exchange_thread, if given */
+    void             accept( fc::thread* key_exchange_thread = nullptr );
 
     void             connect_to( const fc::ip::endpoint& remote_endpoint );
     void             bind( const fc::ip::endpoint& local_endpoint );
@@ -33,7 +35,7 @@ class stcp_socket : public virtual fc::iostream
     void             get( char& c ) { read( &c, 1 ); }
     fc::sha512       get_shared_secret() const { return _shared_secret; }
   private:
-    void do_key_exchange();
+    void do_key_exchange( fc::thread* key_exchange_thread = nullptr );
 
     fc::sha512           _shared_secret;
     fc::ecc::private_key _priv_key;
@@ -0,0 +1,118 @@
+#pragma once
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace bts { namespace net {
+
+  /**
+   *  @brief a hierarchical timer wheel holding values until their deadline
+   *
+   *  Time is divided into ticks of the given resolution.  Level 0 has one slot per tick for the next
+   *  64 ticks, level 1 one slot per 64 ticks for the next 64^2 ticks, and so on; a value whose deadline
+   *  is further away than the last level reaches waits in the last level.  When expire() passes the
+   *  start of a higher level slot, the values in it move down to the level that now covers them, so
+   *  scheduling is constant time and expiring only touches values that are due or about to be.
+   *
+   *  Values are not removed when the deadline they wait for changes; users keep their own record of
+   *  the current deadline and ignore the values that expire for a stale one.
+   */
+  template<typename T>
+  class timer_wheel
+  {
+     public:
+        timer_wheel( const fc::microseconds& resolution = fc::seconds( 1 ) )
+        :_resolution( resolution.count() ),_current_tick( 0 ),_size( 0 ),_started( false ){}
+
+        /** @param deadline the value expires at the first call to expire() at or after it */
+        void schedule( const fc::time_point& deadline, const T& value )
+        {
+           const int64_t since_epoch = deadline.time_since_epoch().count();
+           uint64_t tick = since_epoch <= 0 ? 0 : uint64_t( ( since_epoch + _resolution - 1 ) / _resolution );
+           if( !_started )
+           {
+              _current_tick = uint64_t( std::max<int64_t>( fc::time_point::now().time_since_epoch().count(), 0 ) / _resolution );
+              _started = true;
+           }
+           insert( entry{ std::max( tick, _current_tick ), value } );
+           ++_size;
+        }
+
+        /** removes and returns the values whose deadline is at or before now, earliest tick first */
+        std::vector<T> expire( const fc::time_point& now )
+        {
+           std::vector<T> expired;
+           const int64_t since_epoch = now.time_since_epoch().count();
+           if( !_started || since_epoch < 0 )
+              return expired;
+           const uint64_t now_tick = uint64_t( since_epoch / _resolution );
+           for( ; _size > 0 && _current_tick <= now_tick; ++_current_tick )
+           {
+              // higher levels first, so their values can still drop into the lower slots due at this tick
+              for( unsigned level = levels - 1; level > 0; --level )
+                 if( _current_tick % ( uint64_t( 1 ) << ( slot_bits * level ) ) == 0 )
+                    cascade( level );
+
+              std::vector<entry>& due = _slots[ 0 ][ _current_tick & slot_mask ];
+              for( entry& item : due )
+                 expired.push_back( std::move( item.value ) );
+              _size -= due.size();
+              due.clear();
+           }
+           if( _size == 0 && _current_tick <= now_tick )
+              _current_tick = now_tick + 1;
+           return expired;
+        }
+
+        size_t size()const { return _size; }
+
+        void clear()
+        {
+           for( auto& level : _slots )
+              for( auto& slot : level )
+                 slot.clear();
+           _size = 0;
+           _started = false;
+        }
+
+     private:
+        static const unsigned slot_bits = 6;
+        static const unsigned levels    = 4;
+        static const uint64_t slot_mask = ( uint64_t( 1 ) << slot_bits ) - 1;
+
+        struct entry
+        {
+           uint64_t tick;
+           T        value;
+        };
+
+        void insert( entry&& item )
+        {
+           const uint64_t delta = item.tick - _current_tick;
+           unsigned level = 0;
+           while( level + 1 < levels && delta >= ( uint64_t( 1 ) << ( slot_bits * ( level + 1 ) ) ) )
+              ++level;
+           // past the reach of the last level, wait in its furthest slot and be placed again from there
+           const uint64_t reach = uint64_t( 1 ) << ( slot_bits * levels );
+           const uint64_t slot_tick = delta >= reach ? _current_tick + reach - 1 : item.tick;
+           _slots[ level ][ ( slot_tick >> ( slot_bits * level ) ) & slot_mask ].push_back( std::move( item ) );
+        }
+
+        void cascade( unsigned level )
+        {
+           std::vector<entry> moving;
+           moving.swap( _slots[ level ][ ( _current_tick >> ( slot_bits * level ) ) & slot_mask ] );
+           for( entry& item : moving )
+              insert( std::move( item ) );
+        }
+
+        int64_t                                                      _resolution;
+        uint64_t                                                     _current_tick;
+        size_t                                                       _size;
+        bool                                                         _started;
+        std::array<std::array<std::vector<entry>, 1 << slot_bits>, levels> _slots;
+  };
+
+} } // bts::net
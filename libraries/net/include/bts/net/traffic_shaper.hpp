@@ -0,0 +1,72 @@
+#pragma once
+#include <fc/time.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <fc/variant_object.hpp>
+
+#include <array>
+
+namespace bts { namespace net {
+
+  /** the kinds of traffic we send, which share our upload bandwidth */
+  enum class traffic_class : uint8_t
+  {
+    block_relay,       ///< new blocks from our message cache, which delegates need to see quickly
+    transaction_relay, ///< transactions we pass on
+    sync_serving,      ///< old blocks and block headers for peers that are catching up
+    gossip             ///< everything else: inventory, item ids, addresses, handshakes
+  };
+  static const unsigned traffic_class_count = 4;
+
+  /**
+   *  @brief divides the upload limit between traffic classes with token buckets
+   *
+   *  Each class has a bucket that fills at its guaranteed minimum rate and holds at most one second of it.
+   *  What the minimums leave of the total rate, plus what overflows the full buckets, goes to a shared
+   *  bucket.  A class sends from its own bucket while it has tokens, and otherwise from the shared one
+   *  unless a class of higher priority is waiting for it, so a busy low priority class can never hold
+   *  back a higher one beyond its minimum.  Buckets may go into debt by one message, so a message larger
+   *  than a bucket is sent as soon as the bucket has anything in it.
+   *
+   *  The shaper only schedules whole messages and does no I/O; the fc::rate_limiting_group on the
+   *  sockets still enforces the limit itself.  With no total rate set every message goes out at once.
+   */
+  class traffic_shaper
+  {
+    public:
+      traffic_shaper();
+
+      /** @param bytes_per_second the upload limit to share out, 0 for unlimited */
+      void     set_total_rate( uint32_t bytes_per_second );
+      uint32_t get_total_rate()const { return _total_rate; }
+
+      /** a class with a greater priority is served first from the shared bucket */
+      void set_class_parameters( traffic_class cls, uint32_t minimum_bytes_per_second, uint32_t priority );
+
+      /** puts the calling task to sleep until the class may send this many bytes, and takes them */
+      void wait_to_send( traffic_class cls, size_t bytes );
+
+      /** reads "<class>_minimum_upload_rate" and "<class>_upload_priority" entries, ignoring the others */
+      void               set_parameters( const fc::variant_object& params );
+      fc::variant_object get_parameters()const;
+
+    private:
+      struct bucket
+      {
+        double   tokens = 0;
+        uint32_t minimum_rate = 0;
+        uint32_t priority = 0;
+        uint32_t tasks_waiting = 0;
+      };
+
+      void refill();
+      bool higher_priority_waiting( traffic_class cls )const;
+
+      std::array<bucket, traffic_class_count> _classes;
+      double                                  _shared_tokens;
+      uint32_t                                _total_rate;
+      fc::time_point                          _last_refill_time;
+  };
+
+} } // bts::net
+
+FC_REFLECT_ENUM( bts::net::traffic_class, (block_relay)(transaction_relay)(sync_serving)(gossip) )
@@ -47,7 +47,7 @@ namespace bts { namespace net {
       void start_read_loop();
     public:
       fc::tcp_socket& get_socket();
-      void accept();
+      void accept( fc::thread* key_exchange_thread );
       void connect_to(const fc::ip::endpoint& remote_endpoint);
       void bind(const fc::ip::endpoint& local_endpoint);
 
@@ -55,7 +55,7 @@ namespace bts { namespace net {
                                        message_oriented_connection_delegate* delegate = nullptr);
       ~message_oriented_connection_impl();
 
-      void send_message(const message& message_to_send);
+      void send_messages(const std::vector<const message*>& messages_to_send);
       void close_connection();
       void destroy_connection();
 
@@ -92,10 +92,10 @@ namespace bts { namespace net {
       return _sock.get_socket();
     }
 
-    void message_oriented_connection_impl::accept()
+    void message_oriented_connection_impl::accept( fc::thread* key_exchange_thread )
     {
       VERIFY_CORRECT_THREAD();
-      _sock.accept();
+      _sock.accept( key_exchange_thread );
       assert(!_read_loop_done.valid()); // check to be sure we never launch two read loops
       _read_loop_done = fc::async([=](){ read_loop(); }, "message read_loop");
     }
@@ -203,7 +203,7 @@ namespace bts { namespace net {
         throw *exception_to_rethrow;
     }
 
-    void message_oriented_connection_impl::send_message(const message& message_to_send)
+    void message_oriented_connection_impl::send_messages(const std::vector<const message*>& messages_to_send)
     {
       VERIFY_CORRECT_THREAD();
 #if 0 // this gets too verbose
@@ -232,13 +232,22 @@ namespace bts { namespace net {
 
       try
       {
-        size_t size_of_message_and_header = sizeof(message_header) + message_to_send.size;
-        //pad the message we send to a multiple of 16 bytes
-        size_t size_with_padding = 16 * ((size_of_message_and_header + 15) / 16);
-        std::unique_ptr<char[]> padded_message(new char[size_with_padding]);
-        memcpy(padded_message.get(), (char*)&message_to_send, sizeof(message_header));
-        memcpy(padded_message.get() + sizeof(message_header), message_to_send.data.data(), message_to_send.size );
-        _sock.write(padded_message.get(), size_with_padding);
+        //pad each message we send to a multiple of 16 bytes, the receiver reads them one at a time
+        size_t size_with_padding = 0;
+        for (const message* message_to_send : messages_to_send)
+          size_with_padding += 16 * ((sizeof(message_header) + message_to_send->size + 15) / 16);
+        std::unique_ptr<char[]> padded_messages(new char[size_with_padding]);
+        size_t offset = 0;
+        for (const message* message_to_send : messages_to_send)
+        {
+          const size_t size_of_message_and_header = sizeof(message_header) + message_to_send->size;
+          memcpy(padded_messages.get() + offset, (const char*)message_to_send, sizeof(message_header));
+          memcpy(padded_messages.get() + offset + sizeof(message_header), message_to_send->data.data(), message_to_send->size);
+          const size_t padded_size = 16 * ((size_of_message_and_header + 15) / 16);
+          memset(padded_messages.get() + offset + size_of_message_and_header, 0, padded_size - size_of_message_and_header);
+          offset += padded_size;
+        }
+        _sock.write(padded_messages.get(), size_with_padding);
         _sock.flush();
         _bytes_sent += size_with_padding;
         _last_message_sent_time = fc::time_point::now();
@@ -326,9 +335,9 @@ namespace bts { namespace net {
     return my->get_socket();
   }
 
-  void message_oriented_connection::accept()
+  void message_oriented_connection::accept( fc::thread* key_exchange_thread )
   {
-    my->accept();
+    my->accept( key_exchange_thread );
   }
 
   void message_oriented_connection::connect_to(const fc::ip::endpoint& remote_endpoint)
@@ -343,7 +352,12 @@ namespace bts { namespace net {
 
   void message_oriented_connection::send_message(const message& message_to_send)
   {
-    my->send_message(message_to_send);
+    my->send_messages(std::vector<const message*>{&message_to_send});
+  }
+
+  void message_oriented_connection::send_messages(const std::vector<const message*>& messages_to_send)
+  {
+    my->send_messages(messages_to_send);
   }
 
   void message_oriented_connection::close_connection()
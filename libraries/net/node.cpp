@@ -2,11 +2,14 @@
 #include <iomanip>
 #include <deque>
 #include <unordered_set>
+#include <set>
+#include <queue>
 #include <list>
 #include <forward_list>
 #include <iostream>
 #include <algorithm>
 #include <tuple>
+#include <limits>
 #include <boost/tuple/tuple.hpp>
 #include <boost/circular_buffer.hpp>
 
@@ -49,12 +52,15 @@
 #include <bts/net/peer_database.hpp>
 #include <bts/net/peer_connection.hpp>
 #include <bts/net/stcp_socket.hpp>
+#include <bts/net/timer_wheel.hpp>
 #include <bts/net/config.hpp>
 #include <bts/net/exceptions.hpp>
 
 #include <bts/client/messages.hpp>
 
 #include <bts/utilities/git_revision.hpp>
+#include <bts/utilities/log.hpp>
+#include <bts/utilities/stall_detector.hpp>
 #include <fc/git_revision.hpp>
 
 //#define ENABLE_DEBUG_ULOGS
@@ -98,6 +104,15 @@ namespace bts { namespace net {
   namespace detail
   {
     namespace bmi = boost::multi_index;
+
+    /** a running average of the time per sync block, weighted 7:1 towards the blocks before */
+    static fc::microseconds smooth_sync_time( fc::microseconds average, fc::microseconds measured )
+    {
+      if( average.count() == 0 )
+        return measured;
+      return fc::microseconds( ( average.count() * 7 + measured.count() ) / 8 );
+    }
+
     class blockchain_tied_message_cache
     {
     private:
@@ -150,8 +165,19 @@ namespace bts { namespace net {
       void cache_message( const message& message_to_cache, const message_hash_type& hash_of_message_to_cache,
                         const message_propagation_data& propagation_data, const fc::uint160_t& message_content_hash );
       message get_message( const message_hash_type& hash_of_message_to_lookup );
+      bool has_message( const message_hash_type& hash_of_message_to_lookup ) const;
+      void erase_message( const message_hash_type& hash_of_message_to_erase );
+      fc::optional<message> find_message_by_contents( const fc::uint160_t& hash_of_message_contents_to_lookup ) const;
       message_propagation_data get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const;
       size_t size() const { return _message_cache.size(); }
+      /** approximate bytes of the cached messages and their index entries */
+      size_t memory_usage() const
+      {
+        size_t bytes = 0;
+        for( const message_info& info : _message_cache )
+          bytes += sizeof( message_info ) + info.message_body.data.size() + 6 * sizeof( void* );
+        return bytes;
+      }
     };
 
     void blockchain_tied_message_cache::block_accepted()
@@ -183,6 +209,25 @@ namespace bts { namespace net {
       FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
     }
 
+    bool blockchain_tied_message_cache::has_message( const message_hash_type& hash_of_message_to_lookup ) const
+    {
+      return _message_cache.get<message_hash_index>().find( hash_of_message_to_lookup ) != _message_cache.get<message_hash_index>().end();
+    }
+
+    void blockchain_tied_message_cache::erase_message( const message_hash_type& hash_of_message_to_erase )
+    {
+      _message_cache.get<message_hash_index>().erase( hash_of_message_to_erase );
+    }
+
+    fc::optional<message> blockchain_tied_message_cache::find_message_by_contents( const fc::uint160_t& hash_of_message_contents_to_lookup ) const
+    {
+      message_cache_container::index<message_contents_hash_index>::type::const_iterator iter =
+         _message_cache.get<message_contents_hash_index>().find(hash_of_message_contents_to_lookup );
+      if( iter != _message_cache.get<message_contents_hash_index>().end() )
+        return iter->message_body;
+      return fc::optional<message>();
+    }
+
     message_propagation_data blockchain_tied_message_cache::get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const
     {
       if( hash_of_message_contents_to_lookup != fc::uint160_t() )
@@ -258,6 +303,8 @@ namespace bts { namespace net { namespace detail {
                                                                                        boost::accumulators::tag::count> > call_stats_accumulator;
 #define NODE_DELEGATE_METHOD_NAMES (has_item) \
                                    (handle_message) \
+                                   (pre_validate_message) \
+                                   (verify_block_header) \
                                    (get_item_ids) \
                                    (get_item) \
                                    (get_chain_id) \
@@ -266,8 +313,10 @@ namespace bts { namespace net { namespace detail {
                                    (connection_count_changed) \
                                    (get_block_number) \
                                    (get_block_time) \
+                                   (get_block_headers) \
                                    (get_head_block_id) \
                                    (estimate_last_known_fork_from_git_revision_timestamp) \
+                                   (get_first_full_block_number) \
                                    (error_encountered)
 
 #define DECLARE_ACCUMULATOR(r, data, method_name) \
@@ -350,6 +399,8 @@ namespace bts { namespace net { namespace detail {
 
       bool has_item( const net::item_id& id ) override;
       bool handle_message( const message&, bool sync_mode ) override;
+      void pre_validate_message( const message& ) override;
+      bool verify_block_header( const message& ) override;
       std::vector<item_hash_t> get_item_ids(uint32_t item_type,
                                             const std::vector<item_hash_t>& blockchain_synopsis,
                                             uint32_t& remaining_item_count,
@@ -363,9 +414,11 @@ namespace bts { namespace net { namespace detail {
       void     connection_count_changed( uint32_t c ) override;
       uint32_t get_block_number(const item_hash_t& block_id) override;
       fc::time_point_sec get_block_time(const item_hash_t& block_id) override;
+      std::vector<bts::blockchain::signed_block_header> get_block_headers(const std::vector<item_hash_t>& block_ids) override;
       fc::time_point_sec get_blockchain_now() override;
       item_hash_t get_head_block_id() const override;
       uint32_t estimate_last_known_fork_from_git_revision_timestamp(uint32_t unix_timestamp) const;
+      uint32_t get_first_full_block_number() const override;
       void error_encountered(const std::string& message, const fc::oexception& error) override;
     };
 
@@ -410,12 +463,55 @@ namespace bts { namespace net { namespace detail {
 
       active_sync_requests_map              _active_sync_requests; /// list of sync blocks we've asked for from peers but have not yet received
       std::list<bts::client::block_message> _new_received_sync_items; /// list of sync blocks we've just received but haven't yet tried to process
-      std::list<bts::client::block_message> _received_sync_items; /// list of sync blocks we've received, but can't yet process because we are still missing blocks that come earlier in the chain
+      typedef std::unordered_map<bts::blockchain::block_id_type, bts::client::block_message> received_sync_items_map;
+      received_sync_items_map _received_sync_items; /// sync blocks we've received, but can't yet process because we are still missing blocks that come earlier in the chain, by block id
+      std::map<item_hash_t, bts::blockchain::block_header> _validated_sync_block_headers; /// headers of offered sync blocks that have passed on_block_headers_message's checks, by block id
+      std::unordered_map<bts::blockchain::block_id_type, fc::time_point> _sync_item_received_times; /// when each block in the sync backlog arrived
+      // @}
+
+      /// per block time spent in each stage of sync, smoothed over the last blocks, see get_sync_stats()
+      // @{
+      uint64_t         _sync_blocks_handled = 0;
+      fc::microseconds _sync_block_fetch_time;        /// from the request, or the block before it, until the block arrives
+      fc::microseconds _sync_block_backlog_wait_time; /// from arrival until the blocks before it are handled
+      fc::microseconds _sync_block_handling_time;     /// handing it to the client, which pushes it
       // @}
 
       fc::future<void> _process_backlog_of_sync_blocks_done;
       bool _suspend_fetching_sync_blocks;
 
+      /// messages received but not yet handled, see on_message()
+      // @{
+      enum received_message_priority
+      {
+        block_priority,
+        inventory_priority,
+        transaction_priority,
+        gossip_priority,
+        received_message_priority_count
+      };
+      struct received_message_queue
+      {
+        std::map<peer_connection_ptr, std::deque<message> > messages_by_peer;
+        std::deque<peer_connection_ptr> peers_in_turn; /// peers with messages in this queue, the front one is handled next
+      };
+      received_message_queue _received_message_queues[received_message_priority_count];
+      fc::future<void> _process_received_messages_done;
+      // @}
+
+      /// the steps recent blocks took on their way to and through us, by block_message hash
+      // @{
+      struct block_propagation_trace
+      {
+        bts::blockchain::block_id_type block_id;
+        fc::time_point_sec             block_timestamp;
+        message_propagation_data       data;
+      };
+      std::map<message_hash_type, block_propagation_trace> _block_propagation_traces;
+      std::deque<message_hash_type>                        _block_propagation_trace_order; /// oldest first, for expiring traces
+      block_propagation_trace& trace_block( const message_hash_type& message_hash );
+      // @}
+
       /// used by the task that fetches items during normal operation
       // @{
       fc::promise<void>::ptr _retrigger_fetch_item_loop_promise;
@@ -471,6 +567,9 @@ namespace bts { namespace net { namespace detail {
       /** Stores all connections which have not yet finished key exchange or are still sending initial handshaking messages
        * back and forth (not yet ready to initiate syncing) */
       std::unordered_set<peer_connection_ptr>                     _handshaking_connections;
+      /** stores inbound connections that are still negotiating their keys or haven't yet sent us a hello message
+       * with a valid signature; they are moved to _handshaking_connections once they have */
+      std::unordered_set<peer_connection_ptr>                     _unverified_inbound_connections;
       /** stores fully established connections we're either syncing with or in normal operation with */
       std::unordered_set<peer_connection_ptr>                     _active_connections;
       /** stores connections we've closed (sent closing message, not actually closed), but are still waiting for the remote end to close before we delete them */
@@ -487,11 +586,23 @@ namespace bts { namespace net { namespace detail {
       blockchain_tied_message_cache _message_cache; /// cache message we have received and might be required to provide to other peers via inventory requests
 
       fc::rate_limiting_group _rate_limiter;
+      /** divides the upload limit of _rate_limiter between the kinds of messages we send */
+      traffic_shaper          _traffic_shaper;
+
+      /** the peers by the time terminate_inactive_connections_loop() should next check their timeouts */
+      timer_wheel<std::weak_ptr<peer_connection> > _peer_timeout_checks;
+
+      /** run the key exchanges and hello signature checks of new connections, see next_handshake_thread() */
+      std::vector<std::unique_ptr<fc::thread> > _handshake_threads;
+      size_t                                    _next_handshake_thread;
 
       uint32_t _last_reported_number_of_connections; // number of connections last reported to the client (to avoid sending duplicate messages)
 
       bool _peer_advertising_disabled;
 
+      /** relay new blocks that build on our head as soon as their header checks out, before applying them */
+      bool _fast_block_relay;
+
       fc::future<void> _fetch_updated_peer_lists_loop_done;
 
       boost::circular_buffer<uint32_t> _average_network_read_speed_seconds;
@@ -507,6 +618,8 @@ namespace bts { namespace net { namespace detail {
       fc::future<void> _bandwidth_monitor_loop_done;
 
       fc::future<void> _dump_node_status_task_done;
+      /** measures how long the tasks of this thread go without yielding, see bts::utilities::stall_detector */
+      fc::future<void> _stall_heartbeat_done;
 
       /* We have two alternate paths through the schedule_peer_for_deletion code -- one that 
        * uses a mutex to prevent one fiber from adding items to the queue while another is deleting
@@ -534,18 +647,21 @@ namespace bts { namespace net { namespace detail {
       unsigned _maximum_blocks_per_peer_during_syncing;
 
       std::list<fc::future<void> > _handle_message_calls_in_progress;
+      std::list<fc::future<void> > _transaction_validations_in_progress; /// ordinary messages handed to the delegate, see process_ordinary_message()
 
       node_impl(const std::string& user_agent);
       virtual ~node_impl();
 
       void save_node_configuration();
 
+      void record_peer_performance( const peer_connection_ptr& peer, potential_peer_record& record );
       void p2p_network_connect_loop();
       void trigger_p2p_network_connect_loop();
 
       bool have_already_received_sync_item( const item_hash_t& item_hash );
       void request_sync_item_from_peer( const peer_connection_ptr& peer, const item_hash_t& item_to_request );
       void request_sync_items_from_peer( const peer_connection_ptr& peer, const std::vector<item_hash_t>& items_to_request );
+      void request_block_headers_from_peer( const peer_connection_ptr& peer, const std::vector<item_hash_t>& block_ids );
       void fetch_sync_items_loop();
       void trigger_fetch_sync_items_loop();
 
@@ -557,6 +673,9 @@ namespace bts { namespace net { namespace detail {
       void trigger_advertise_inventory_loop();
 
       void terminate_inactive_connections_loop();
+      void schedule_timeout_check( const peer_connection_ptr& peer, const fc::time_point& check_time );
+      static uint32_t active_peer_disconnect_timeout_sec();
+      static uint32_t active_peer_ignored_request_timeout_sec();
 
       void fetch_updated_peer_lists_loop();
       void update_bandwidth_data(uint32_t bytes_read_this_second, uint32_t bytes_written_this_second);
@@ -571,6 +690,8 @@ namespace bts { namespace net { namespace detail {
       bool merge_address_info_with_potential_peer_database( const std::vector<address_info> addresses );
       void display_current_connections();
       uint32_t calculate_unsynced_block_count_from_all_peers();
+      uint32_t sync_request_window( const peer_connection_ptr& peer, const fc::microseconds& fastest_delivery_time ) const;
+      uint32_t sync_prefetch_limit() const;
       std::vector<item_hash_t> create_blockchain_synopsis_for_peer( const peer_connection* peer );
       void fetch_next_batch_of_item_ids_from_peer( peer_connection* peer, bool reset_fork_tracking_data_for_peer = false );
 
@@ -579,6 +700,12 @@ namespace bts { namespace net { namespace detail {
 
       void on_message( peer_connection* originating_peer,
                        const message& received_message ) override;
+      void handle_message( peer_connection* originating_peer,
+                           const message& received_message );
+      fc::optional<received_message_priority> get_received_message_priority( uint32_t msg_type ) const;
+      void process_received_messages();
+      void trigger_process_received_messages();
+      void discard_received_messages( const peer_connection_ptr& peer );
 
       void on_hello_message( peer_connection* originating_peer,
                              const hello_message& hello_message_received );
@@ -632,15 +759,22 @@ namespace bts { namespace net { namespace detail {
                                                     const get_current_connections_reply_message& get_current_connections_reply_message_received);
 
       void on_connection_closed( peer_connection* originating_peer ) override;
+      traffic_shaper* get_traffic_shaper() override { return &_traffic_shaper; }
 
       void send_sync_block_to_node_delegate(const bts::client::block_message& block_message_to_send);
       void process_backlog_of_sync_blocks();
       void trigger_process_backlog_of_sync_blocks();
       void process_block_during_sync( peer_connection* originating_peer, const bts::client::block_message& block_message, const message_hash_type& message_hash );
-      void process_block_during_normal_operation( peer_connection* originating_peer, const bts::client::block_message& block_message, const message_hash_type& message_hash );
+      void process_block_during_normal_operation( peer_connection* originating_peer, const message& message_to_process,
+                                                  const bts::client::block_message& block_message, const message_hash_type& message_hash );
       void process_block_message( peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash );
+      void on_compact_block_message( peer_connection* originating_peer, const bts::client::compact_block_message& compact_block_message_received );
+      void on_compressed_message( peer_connection* originating_peer, const compressed_message& compressed_message_received );
+      void on_block_headers_message( peer_connection* originating_peer, const bts::client::block_headers_message& block_headers_message_received );
 
       void process_ordinary_message( peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash );
+      void validate_ordinary_message( const peer_connection_ptr& originating_peer,
+                                      const message& message_to_process, const fc::time_point& message_receive_time );
 
       void start_synchronizing();
       void start_synchronizing_with_peer( const peer_connection_ptr& peer );
@@ -649,6 +783,7 @@ namespace bts { namespace net { namespace detail {
 
       void close();
 
+      fc::thread& next_handshake_thread();
       void accept_connection_task( peer_connection_ptr new_peer );
       void accept_loop();
       void send_hello_message( const peer_connection_ptr& peer );
@@ -689,6 +824,7 @@ namespace bts { namespace net { namespace detail {
 
       void broadcast(const message& item_to_broadcast, const message_propagation_data& propagation_data);
       void broadcast(const message& item_to_broadcast);
+      std::vector<item_id> get_items_peers_may_lack(const std::vector<item_id>& items) const;
       void sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers);
       bool is_connected() const;
       std::vector<potential_peer_record> get_potential_peers() const;
@@ -697,6 +833,7 @@ namespace bts { namespace net { namespace detail {
       fc::variant_object         get_advanced_node_parameters();
       message_propagation_data   get_transaction_propagation_data( const bts::blockchain::transaction_id_type& transaction_id );
       message_propagation_data   get_block_propagation_data( const bts::blockchain::block_id_type& block_id );
+      fc::variant_object         get_block_propagation_statistics();
 
       node_id_t                  get_node_id() const;
       void                       set_allowed_peers( const std::vector<node_id_t>& allowed_peers );
@@ -707,6 +844,8 @@ namespace bts { namespace net { namespace detail {
 
       fc::variant_object         network_get_info() const;
       fc::variant_object         network_get_usage_stats() const;
+      fc::variant_object         get_memory_stats() const;
+      fc::variant_object         get_sync_stats() const;
 
       bool is_hard_fork_block(uint32_t block_number) const;
       uint32_t get_next_known_hard_fork_block_number(uint32_t block_number) const;
@@ -762,8 +901,10 @@ namespace bts { namespace net { namespace detail {
       _most_recent_blocks_accepted(_maximum_number_of_connections),
       _total_number_of_unfetched_items(0),
       _rate_limiter(0, 0),
+      _next_handshake_thread(0),
       _last_reported_number_of_connections(0),
       _peer_advertising_disabled(false),
+      _fast_block_relay(false),
       _average_network_read_speed_seconds(60),
       _average_network_write_speed_seconds(60),
       _average_network_read_speed_minutes(60),
@@ -793,6 +934,7 @@ namespace bts { namespace net { namespace detail {
         if (updated_peer_record)
         {
           updated_peer_record->last_seen_time = fc::time_point::now();
+          record_peer_performance(active_peer, *updated_peer_record);
           _potential_peer_db.update_entry(*updated_peer_record);
         }
       }
@@ -831,6 +973,28 @@ namespace bts { namespace net { namespace detail {
       }
     }
 
+    void node_impl::record_peer_performance( const peer_connection_ptr& peer, potential_peer_record& record )
+    {
+      VERIFY_CORRECT_THREAD();
+      const auto smooth = []( fc::microseconds previous, fc::microseconds measured ) {
+        if( measured.count() <= 0 )
+          return previous;
+        if( previous.count() <= 0 )
+          return measured;
+        return fc::microseconds( ( previous.count() * 3 + measured.count() ) / 4 );
+      };
+      record.round_trip_delay = smooth( record.round_trip_delay, peer->round_trip_delay );
+      record.sync_block_delivery_time = smooth( record.sync_block_delivery_time, peer->sync_block_delivery_time );
+
+      const int64_t seconds_connected = ( fc::time_point::now() - peer->get_connection_time() ).to_seconds();
+      if( seconds_connected > 0 )
+        record.bytes_received_per_second = (uint32_t)std::min<uint64_t>( peer->get_total_bytes_received() / seconds_connected,
+                                                                         std::numeric_limits<uint32_t>::max() );
+      record.number_of_blocks_delivered_first += peer->blocks_delivered_first;
+      // the counter is added to the record once per connection
+      peer->blocks_delivered_first = 0;
+    }
+
     void node_impl::p2p_network_connect_loop()
     {
       VERIFY_CORRECT_THREAD();
@@ -867,9 +1031,8 @@ namespace bts { namespace net { namespace detail {
             bool initiated_connection_this_pass = false;
             _potential_peer_database_updated = false;
 
-            for( peer_database::iterator iter = _potential_peer_db.begin();
-                 iter != _potential_peer_db.end() && is_wanting_new_connections();
-                 ++iter )
+            std::vector<potential_peer_record> candidates; // best first
+            for( peer_database::iterator iter = _potential_peer_db.begin_by_selection_cost(); iter != _potential_peer_db.end_by_selection_cost(); ++iter )
             {
               fc::microseconds delay_until_retry = fc::seconds((iter->number_of_failed_connection_attempts + 1 ) * _peer_connection_retry_timeout);
 
@@ -878,10 +1041,18 @@ namespace bts { namespace net { namespace detail {
                      iter->last_connection_disposition != last_connection_rejected &&
                      iter->last_connection_disposition != last_connection_handshaking_failed) ||
                     (fc::time_point::now() - iter->last_connection_attempt_time) > delay_until_retry ) )
-              {
-                connect_to( iter->endpoint );
-                initiated_connection_this_pass = true;
-              }
+                candidates.push_back( *iter );
+            }
+
+            // every few connections go to a random candidate instead of the best one
+            for( size_t connections_initiated = 0; !candidates.empty() && is_wanting_new_connections(); ++connections_initiated )
+            {
+              size_t candidate_index = 0;
+              if( connections_initiated % BTS_NET_RANDOM_PEER_CONNECTION_INTERVAL == BTS_NET_RANDOM_PEER_CONNECTION_INTERVAL - 1 )
+                candidate_index = rand() % candidates.size();
+              connect_to( candidates[candidate_index].endpoint );
+              candidates.erase( candidates.begin() + candidate_index );
+              initiated_connection_this_pass = true;
             }
 
             if( !initiated_connection_this_pass && !_potential_peer_database_updated )
@@ -942,8 +1113,7 @@ namespace bts { namespace net { namespace detail {
     bool node_impl::have_already_received_sync_item( const item_hash_t& item_hash )
     {
       VERIFY_CORRECT_THREAD();
-      return std::find_if(_received_sync_items.begin(), _received_sync_items.end(),
-                          [&item_hash]( const bts::client::block_message& message ) { return message.block_id == item_hash; } ) != _received_sync_items.end() ||
+      return _received_sync_items.find(item_hash) != _received_sync_items.end() ||
              std::find_if(_new_received_sync_items.begin(), _new_received_sync_items.end(),
                           [&item_hash]( const bts::client::block_message& message ) { return message.block_id == item_hash; } ) != _new_received_sync_items.end();                          ;
     }
@@ -955,6 +1125,7 @@ namespace bts { namespace net { namespace detail {
       item_id item_id_to_request( bts::client::block_message_type, item_to_request );
       _active_sync_requests.insert( active_sync_requests_map::value_type(item_to_request, fc::time_point::now() ) );
       peer->sync_items_requested_from_peer.insert( peer_connection::item_to_time_map_type::value_type(item_id_to_request, fc::time_point::now() ) );
+      schedule_timeout_check( peer, fc::time_point::now() + fc::seconds(active_peer_ignored_request_timeout_sec()) );
       std::vector<item_hash_t> items_to_fetch;
       peer->send_message( fetch_items_message(item_id_to_request.item_type, std::vector<item_hash_t>{item_id_to_request.item_hash} ) );
     }
@@ -966,13 +1137,24 @@ namespace bts { namespace net { namespace detail {
             ("item_count", items_to_request.size())("items_to_request", items_to_request)("endpoint", peer->get_remote_endpoint()) );
       for (const item_hash_t& item_to_request : items_to_request)
       {
-        _active_sync_requests.insert( active_sync_requests_map::value_type(item_to_request, fc::time_point::now() ) );
+        _active_sync_requests[item_to_request] = fc::time_point::now();
         item_id item_id_to_request( bts::client::block_message_type, item_to_request );
         peer->sync_items_requested_from_peer.insert( peer_connection::item_to_time_map_type::value_type(item_id_to_request, fc::time_point::now() ) );
       }
+      schedule_timeout_check( peer, fc::time_point::now() + fc::seconds(active_peer_ignored_request_timeout_sec()) );
       peer->send_message(fetch_items_message(bts::client::block_message_type, items_to_request));
     }
 
+    void node_impl::request_block_headers_from_peer( const peer_connection_ptr& peer, const std::vector<item_hash_t>& block_ids )
+    {
+      VERIFY_CORRECT_THREAD();
+      dlog( "requesting ${count} block header(s) starting with ${first} from peer ${endpoint}",
+            ("count", block_ids.size())("first", block_ids.front())("endpoint", peer->get_remote_endpoint()) );
+      peer->block_headers_requested_from_peer = block_ids;
+      peer->block_headers_request_time = fc::time_point::now();
+      peer->send_message(fetch_items_message(bts::client::block_headers_message_type, block_ids));
+    }
+
     void node_impl::fetch_sync_items_loop()
     {
       VERIFY_CORRECT_THREAD();
@@ -980,46 +1162,136 @@ namespace bts { namespace net { namespace detail {
       {
         _sync_items_to_fetch_updated = false;
         dlog( "beginning another iteration of the sync items loop" );
+        bool block_header_requests_outstanding = false;
 
         if (!_suspend_fetching_sync_blocks)
         {
           std::map<peer_connection_ptr, std::vector<item_hash_t> > sync_item_requests_to_send;
+          std::map<peer_connection_ptr, std::vector<item_hash_t> > block_header_requests_to_send;
+          // pruning peers can't give us blocks older than their first full block
+          const uint32_t next_block_number = _delegate->get_block_number(_delegate->get_head_block_id()) + 1;
 
           {
             ASSERT_TASK_NOT_PREEMPTED();
+            // peers that serve block headers are asked for the headers of the blocks they offer, and
+            // we download only blocks whose headers have checked out
+            const fc::time_point block_header_request_timeout_threshold = fc::time_point::now() - fc::seconds(BTS_NET_BLOCK_HEADERS_REQUEST_TIMEOUT_SEC);
+            for( const peer_connection_ptr& peer : _active_connections )
+            {
+              if( !peer->we_need_sync_items_from_peer || !peer->supports_block_headers )
+                continue;
+              if( !peer->block_headers_requested_from_peer.empty() )
+              {
+                if( peer->block_headers_request_time < block_header_request_timeout_threshold )
+                {
+                  wlog( "peer ${endpoint} didn't answer our block header request, fetching its sync blocks without their headers",
+                        ("endpoint", peer->get_remote_endpoint()) );
+                  peer->supports_block_headers = false;
+                  peer->block_headers_requested_from_peer.clear();
+                }
+                else
+                  block_header_requests_outstanding = true;
+                continue;
+              }
+              // the first run of its blocks whose headers we haven't checked yet
+              std::vector<item_hash_t> block_ids;
+              for( const item_hash_t& item_hash : peer->ids_of_items_to_get )
+              {
+                if( _validated_sync_block_headers.find(item_hash) == _validated_sync_block_headers.end() )
+                {
+                  block_ids.push_back(item_hash);
+                  if( block_ids.size() >= BTS_NET_MAX_BLOCK_HEADERS_PER_REQUEST )
+                    break;
+                }
+                else if( !block_ids.empty() )
+                  break;
+              }
+              if( !block_ids.empty() )
+              {
+                block_header_requests_to_send[peer] = block_ids;
+                block_header_requests_outstanding = true;
+              }
+            }
+
             std::set<item_hash_t> sync_items_to_request;
+            const fc::time_point stall_threshold = fc::time_point::now() - fc::seconds(BTS_NET_SYNC_BLOCK_STALL_TIMEOUT_SEC);
 
-            // for each idle peer that we're syncing with
+            // blocks held by a peer that has delivered nothing since the stall threshold, and that no
+            // other peer is already fetching, may be requested again from someone else
+            std::set<item_hash_t> stalled_items;
+            std::set<item_hash_t> items_in_flight;
+            for( const peer_connection_ptr& peer : _active_connections )
+            {
+              fc::time_point last_progress = peer->last_sync_block_received_time;
+              for( const peer_connection::item_to_time_map_type::value_type& item_and_time : peer->sync_items_requested_from_peer )
+                last_progress = std::max(last_progress, item_and_time.second);
+              std::set<item_hash_t>& items = last_progress < stall_threshold ? stalled_items : items_in_flight;
+              for( const peer_connection::item_to_time_map_type::value_type& item_and_time : peer->sync_items_requested_from_peer )
+                items.insert(item_and_time.first.item_hash);
+            }
+            for( const item_hash_t& item_hash : items_in_flight )
+              stalled_items.erase(item_hash);
+
+            // the peers we're syncing with that have drained at least half of their request window, fastest
+            // first so they get the earliest blocks.  Peers that haven't delivered a sync block yet sort first
+            // so they get measured.  Topping the window up before it empties keeps blocks arriving while our
+            // next request is on its way.
+            std::vector<peer_connection_ptr> sync_peers;
             for( const peer_connection_ptr& peer : _active_connections )
+              if( peer->we_need_sync_items_from_peer && peer->items_requested_from_peer.empty() && !peer->inhibit_fetching_sync_blocks &&
+                  peer->first_full_block_number <= next_block_number )
+                sync_peers.push_back(peer);
+            std::stable_sort(sync_peers.begin(), sync_peers.end(),
+                             [](const peer_connection_ptr& a, const peer_connection_ptr& b) { return a->sync_block_delivery_time < b->sync_block_delivery_time; });
+            fc::microseconds fastest_delivery_time;
+            for( const peer_connection_ptr& peer : sync_peers )
+              if( peer->sync_block_delivery_time.count() > 0 )
+              {
+                fastest_delivery_time = peer->sync_block_delivery_time;
+                break;
+              }
+
+            for( const peer_connection_ptr& peer : sync_peers )
             {
-              if( peer->we_need_sync_items_from_peer &&
-                  sync_item_requests_to_send.find(peer) == sync_item_requests_to_send.end() && // if we've already scheduled a request for this peer, don't consider scheduling another
-                  peer->idle() )
+              peer->sync_request_window = sync_request_window(peer, fastest_delivery_time);
+              const uint32_t in_flight = (uint32_t)peer->sync_items_requested_from_peer.size();
+              if( in_flight > peer->sync_request_window / 2 )
+                continue;
+              const uint32_t batch_size = peer->sync_request_window - in_flight;
+
+              // loop through the items it has that we don't yet have on our blockchain
+              for( unsigned i = 0; i < peer->ids_of_items_to_get.size(); ++i )
               {
-                if (!peer->inhibit_fetching_sync_blocks)
+                item_hash_t item_to_potentially_request = peer->ids_of_items_to_get[i];
+                // headers are checked in order, so nothing past this one has been checked either
+                if( peer->supports_block_headers &&
+                    _validated_sync_block_headers.find(item_to_potentially_request) == _validated_sync_block_headers.end() )
+                  break;
+                // we've requested it in a previous iteration and we're still waiting for it to arrive, unless its peer has stalled
+                bool stalled = stalled_items.find(item_to_potentially_request) != stalled_items.end();
+                bool requested_and_waiting = !stalled &&
+                                             _active_sync_requests.find(item_to_potentially_request) != _active_sync_requests.end();
+                // if we don't already have this item in our temporary storage and we haven't requested from another syncing peer
+                if( !have_already_received_sync_item(item_to_potentially_request) && // already got it, but for some reson it's still in our list of items to fetch
+                    sync_items_to_request.find(item_to_potentially_request) == sync_items_to_request.end() &&  // we have already decided to request it from another peer during this iteration
+                    !requested_and_waiting )
                 {
-                  // loop through the items it has that we don't yet have on our blockchain
-                  for( unsigned i = 0; i < peer->ids_of_items_to_get.size(); ++i )
-                  {
-                    item_hash_t item_to_potentially_request = peer->ids_of_items_to_get[i];
-                    // if we don't already have this item in our temporary storage and we haven't requested from another syncing peer
-                    if( !have_already_received_sync_item(item_to_potentially_request) && // already got it, but for some reson it's still in our list of items to fetch
-                        sync_items_to_request.find(item_to_potentially_request) == sync_items_to_request.end() &&  // we have already decided to request it from another peer during this iteration
-                        _active_sync_requests.find(item_to_potentially_request) == _active_sync_requests.end() ) // we've requested it in a previous iteration and we're still waiting for it to arrive
-                    {
-                      // then schedule a request from this peer
-                      sync_item_requests_to_send[peer].push_back(item_to_potentially_request);
-                      sync_items_to_request.insert( item_to_potentially_request );
-                      if (sync_item_requests_to_send[peer].size() >= _maximum_blocks_per_peer_during_syncing)
-                        break;
-                    }
-                  }
+                  if( stalled )
+                    dlog( "sync item ${item_hash} is overdue, requesting it again from peer ${endpoint}",
+                          ("item_hash", item_to_potentially_request)("endpoint", peer->get_remote_endpoint()) );
+                  // then schedule a request from this peer
+                  sync_item_requests_to_send[peer].push_back(item_to_potentially_request);
+                  sync_items_to_request.insert( item_to_potentially_request );
+                  if (sync_item_requests_to_send[peer].size() >= batch_size)
+                    break;
                 }
               }
             }
           } // end non-preemptable section
 
           // make all the requests we scheduled in the loop above
+          for( auto block_header_request : block_header_requests_to_send )
+            request_block_headers_from_peer( block_header_request.first, block_header_request.second );
           for( auto sync_item_request : sync_item_requests_to_send )
             request_sync_items_from_peer( sync_item_request.first, sync_item_request.second );
           sync_item_requests_to_send.clear();
@@ -1031,7 +1303,18 @@ namespace bts { namespace net { namespace detail {
         {
           dlog( "no sync items to fetch right now, going to sleep" );
           _retrigger_fetch_sync_items_loop_promise = fc::promise<void>::ptr( new fc::promise<void>("bts::net::retrigger_fetch_sync_items_loop") );
-          _retrigger_fetch_sync_items_loop_promise->wait();
+          try
+          {
+            // while requests are outstanding, wake up to re-request any that stall
+            if( _active_sync_requests.empty() && !block_header_requests_outstanding )
+              _retrigger_fetch_sync_items_loop_promise->wait();
+            else
+              _retrigger_fetch_sync_items_loop_promise->wait(fc::seconds(BTS_NET_SYNC_BLOCK_STALL_TIMEOUT_SEC));
+          }
+          catch (const fc::timeout_exception&)
+          {
+            dlog("Resuming fetch_sync_items_loop to check for stalled sync items");
+          }
           _retrigger_fetch_sync_items_loop_promise.reset();
         }
       } // while( !canceled )
@@ -1084,6 +1367,7 @@ namespace bts { namespace net { namespace detail {
               {
                 dlog( "requesting item ${hash} from peer ${endpoint}", ("hash", iter->item.item_hash )("endpoint", peer->get_remote_endpoint() ) );
                 peer->items_requested_from_peer.insert( peer_connection::item_to_time_map_type::value_type(iter->item, fc::time_point::now() ) );
+                schedule_timeout_check( peer, fc::time_point::now() + fc::seconds(active_peer_ignored_request_timeout_sec()) );
                 item_id item_id_to_fetch = iter->item;
                 iter = _items_to_fetch.erase( iter );
                 item_fetched = true;
@@ -1097,8 +1381,20 @@ namespace bts { namespace net { namespace detail {
         }
 
         for( const auto& peer_and_item : fetch_messages_to_send )
-          peer_and_item.first->send_message(fetch_items_message(peer_and_item.second.item_type,
+        {
+          // the request stays recorded under the block_message id; only the reply's form changes
+          uint32_t item_type_to_request = peer_and_item.second.item_type;
+          if( item_type_to_request == bts::client::block_message_type )
+          {
+            block_propagation_trace& trace = trace_block( peer_and_item.second.item_hash );
+            if( trace.data.fetch_requested_time == fc::time_point() )
+              trace.data.fetch_requested_time = fc::time_point::now();
+          }
+          if( item_type_to_request == bts::client::block_message_type && peer_and_item.first->supports_compact_blocks )
+            item_type_to_request = bts::client::compact_block_message_type;
+          peer_and_item.first->send_message(fetch_items_message(item_type_to_request,
                                                                 std::vector<item_hash_t>{peer_and_item.second.item_hash}));
+        }
         fetch_messages_to_send.clear();
 
         if( !_items_to_fetch_updated )
@@ -1135,6 +1431,28 @@ namespace bts { namespace net { namespace detail {
       while( !_advertise_inventory_loop_done.canceled() )
       {
         dlog( "beginning an iteration of advertise inventory" );
+        // let transactions gather for a moment so they go out in one message per peer.  A block
+        // cuts the wait short, it shouldn't be held up
+        const auto new_inventory_has_block = [this]() {
+          for( const item_id& new_item : _new_inventory )
+            if( new_item.item_type == bts::client::block_message_type )
+              return true;
+          return false;
+        };
+        const fc::time_point batch_deadline = fc::time_point::now() + fc::milliseconds(BTS_NET_INVENTORY_BATCH_INTERVAL_MS);
+        while( !new_inventory_has_block() && fc::time_point::now() < batch_deadline )
+        {
+          _retrigger_advertise_inventory_loop_promise = fc::promise<void>::ptr( new fc::promise<void>("bts::net::retrigger_advertise_inventory_loop") );
+          try
+          {
+            _retrigger_advertise_inventory_loop_promise->wait(batch_deadline - fc::time_point::now());
+          }
+          catch (const fc::timeout_exception&)
+          {
+          }
+          _retrigger_advertise_inventory_loop_promise.reset();
+        }
+
         // swap inventory into local variable, clearing the node's copy
         std::unordered_set<item_id> inventory_to_advertise;
         inventory_to_advertise.swap( _new_inventory );
@@ -1155,20 +1473,26 @@ namespace bts { namespace net { namespace detail {
             // group the items we need to send by type, because we'll need to send one inventory message per type
             unsigned total_items_to_send_to_this_peer = 0;
             for( const item_id& item_to_advertise : inventory_to_advertise )
-              if( peer->inventory_advertised_to_peer.find(item_to_advertise) == peer->inventory_advertised_to_peer.end() &&
+              if( !peer->inventory_advertised_to_peer.contains(item_to_advertise) &&
                   peer->inventory_peer_advertised_to_us.find(item_to_advertise) == peer->inventory_peer_advertised_to_us.end() )
               {
                 items_to_advertise_by_type[item_to_advertise.item_type].push_back( item_to_advertise.item_hash );
-                peer->inventory_advertised_to_peer.insert(peer_connection::timestamped_item_id(item_to_advertise, fc::time_point::now()));
+                peer->inventory_advertised_to_peer.insert(item_to_advertise);
                 ++total_items_to_send_to_this_peer;
                 if (item_to_advertise.item_type == trx_message_type)
                   testnetlog("advertising transaction ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
-                dlog("advertising item ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
+                hot_dlog("advertising item ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
               }
-              dlog("advertising ${count} new item(s) of ${types} type(s) to peer ${endpoint}",
+              hot_dlog("advertising ${count} new item(s) of ${types} type(s) to peer ${endpoint}",
                    ("count", total_items_to_send_to_this_peer)("types", items_to_advertise_by_type.size())("endpoint", peer->get_remote_endpoint()) );
             for( auto items_group : items_to_advertise_by_type )
               inventory_messages_to_send.push_back( std::make_pair(peer, item_ids_inventory_message(items_group.first, items_group.second)) );
+            for( const item_hash_t& block_message_hash : items_to_advertise_by_type[bts::client::block_message_type] )
+            {
+              block_propagation_trace& trace = trace_block( block_message_hash );
+              if( trace.data.first_relay_time == fc::time_point() )
+                trace.data.first_relay_time = fc::time_point::now();
+            }
           }
           peer->clear_old_inventory();
         }
@@ -1193,6 +1517,26 @@ namespace bts { namespace net { namespace detail {
         _retrigger_advertise_inventory_loop_promise->set_value();
     }
 
+    /** a check at or before check_time; an earlier check already scheduled stands, and schedules the next one itself */
+    void node_impl::schedule_timeout_check( const peer_connection_ptr& peer, const fc::time_point& check_time )
+    {
+      VERIFY_CORRECT_THREAD();
+      if( peer->next_timeout_check <= check_time )
+        return;
+      peer->next_timeout_check = check_time;
+      _peer_timeout_checks.schedule( check_time, peer );
+    }
+
+    uint32_t node_impl::active_peer_disconnect_timeout_sec()
+    {
+      return std::max<uint32_t>(5 * BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC / 2, 30);
+    }
+
+    uint32_t node_impl::active_peer_ignored_request_timeout_sec()
+    {
+      return std::max<uint32_t>(BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC / 4, 10);
+    }
+
     void node_impl::terminate_inactive_connections_loop()
     {
       VERIFY_CORRECT_THREAD();
@@ -1210,110 +1554,181 @@ namespace bts { namespace net { namespace detail {
       // This might not be so bad because it could make us initiate more connections and
       // reconnect with the rest of the network, or it might just futher isolate us.
 
+      const fc::time_point now = fc::time_point::now();
       uint32_t handshaking_timeout = _peer_inactivity_timeout;
-      fc::time_point handshaking_disconnect_threshold = fc::time_point::now() - fc::seconds(handshaking_timeout);
-      for( const peer_connection_ptr handshaking_peer : _handshaking_connections )
-        if( handshaking_peer->connection_initiation_time < handshaking_disconnect_threshold &&
-            handshaking_peer->get_last_message_received_time() < handshaking_disconnect_threshold &&
-            handshaking_peer->get_last_message_sent_time() < handshaking_disconnect_threshold )
-        {
-          wlog( "Forcibly disconnecting from handshaking peer ${peer} due to inactivity of at least ${timeout} seconds",
-                ( "peer", handshaking_peer->get_remote_endpoint() )("timeout", handshaking_timeout ) );
-          wlog("Peer's negotiating status: ${status}, bytes sent: ${sent}, bytes received: ${received}",
-                ("status", handshaking_peer->negotiation_status)
-                ("sent", handshaking_peer->get_total_bytes_sent())
-                ("received", handshaking_peer->get_total_bytes_received()));
-          handshaking_peer->connection_closed_error = fc::exception(FC_LOG_MESSAGE(warn, "Terminating handshaking connection due to inactivity of ${timeout} seconds.  Negotiating status: ${status}, bytes sent: ${sent}, bytes received: ${received}",
-                                                                                    ("peer", handshaking_peer->get_remote_endpoint())
-                                                                                    ("timeout", handshaking_timeout)
-                                                                                    ("status", handshaking_peer->negotiation_status)
-                                                                                    ("sent", handshaking_peer->get_total_bytes_sent())
-                                                                                    ("received", handshaking_peer->get_total_bytes_received())));
-          peers_to_disconnect_forcibly.push_back( handshaking_peer );
-        }
+      fc::time_point handshaking_disconnect_threshold = now - fc::seconds(handshaking_timeout);
+      fc::time_point unverified_disconnect_threshold = now - fc::seconds(BTS_NET_INBOUND_HANDSHAKE_TIMEOUT_SEC);
 
       // timeout for any active peers is two block intervals
-      uint32_t active_disconnect_timeout = std::max<uint32_t>(5 * BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC / 2, 30);
+      uint32_t active_disconnect_timeout = active_peer_disconnect_timeout_sec();
       uint32_t active_send_keepalive_timeount = std::max<uint32_t>(active_disconnect_timeout / 2, 11);
-      uint32_t active_ignored_request_timeount = std::max<uint32_t>(BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC / 4, 10);
-      fc::time_point active_disconnect_threshold = fc::time_point::now() - fc::seconds(active_disconnect_timeout);
-      fc::time_point active_send_keepalive_threshold = fc::time_point::now() - fc::seconds(active_send_keepalive_timeount);
-      fc::time_point active_ignored_request_threshold = fc::time_point::now() - fc::seconds(active_ignored_request_timeount);
-      for( const peer_connection_ptr& active_peer : _active_connections )
+      uint32_t active_ignored_request_timeount = active_peer_ignored_request_timeout_sec();
+      fc::time_point active_disconnect_threshold = now - fc::seconds(active_disconnect_timeout);
+      fc::time_point active_send_keepalive_threshold = now - fc::seconds(active_send_keepalive_timeount);
+      fc::time_point active_ignored_request_threshold = now - fc::seconds(active_ignored_request_timeount);
+
+      fc::time_point closing_disconnect_threshold = now - fc::seconds(BTS_NET_PEER_DISCONNECT_TIMEOUT);
+
+      uint32_t failed_terminate_timeout_seconds = 120;
+      fc::time_point failed_terminate_threshold = now - fc::seconds(failed_terminate_timeout_seconds);
+
+      // only the peers whose earliest deadline has passed are checked.  Each check works out the peer's
+      // next deadline from its current timestamps and schedules itself again for then
+      for( const std::weak_ptr<peer_connection>& weak_peer : _peer_timeout_checks.expire( now ) )
       {
-        if( active_peer->connection_initiation_time < active_disconnect_threshold &&
-            active_peer->get_last_message_received_time() < active_disconnect_threshold )
+        peer_connection_ptr peer = weak_peer.lock();
+        if( !peer || peer->next_timeout_check > now )
+          continue; // the peer is gone, or this check was superseded by an earlier one
+        peer->next_timeout_check = fc::time_point::maximum();
+        fc::time_point next_check = fc::time_point::maximum();
+
+        if( _unverified_inbound_connections.find( peer ) != _unverified_inbound_connections.end() )
         {
-          wlog( "Closing connection with peer ${peer} due to inactivity of at least ${timeout} seconds",
-                ( "peer", active_peer->get_remote_endpoint() )("timeout", active_disconnect_timeout ) );
-          peers_to_disconnect_gently.push_back( active_peer );
+          const peer_connection_ptr& unverified_peer = peer;
+          if( unverified_peer->connection_initiation_time < unverified_disconnect_threshold )
+          {
+            wlog( "Forcibly disconnecting from inbound peer ${peer} which hasn't completed its handshake in ${timeout} seconds",
+                  ( "peer", unverified_peer->get_remote_endpoint() )("timeout", BTS_NET_INBOUND_HANDSHAKE_TIMEOUT_SEC ) );
+            unverified_peer->connection_closed_error = fc::exception(FC_LOG_MESSAGE(warn, "Terminating inbound connection that didn't complete its handshake in ${timeout} seconds",
+                                                                                     ("timeout", BTS_NET_INBOUND_HANDSHAKE_TIMEOUT_SEC)));
+            peers_to_disconnect_forcibly.push_back( unverified_peer );
+          }
+          else
+            next_check = unverified_peer->connection_initiation_time + fc::seconds(BTS_NET_INBOUND_HANDSHAKE_TIMEOUT_SEC);
         }
-        else
+        else if( _handshaking_connections.find( peer ) != _handshaking_connections.end() )
         {
-          bool disconnect_due_to_request_timeout = false;
-          for (const peer_connection::item_to_time_map_type::value_type& item_and_time : active_peer->sync_items_requested_from_peer)
-            if (item_and_time.second < active_ignored_request_threshold)
-            {
-              wlog("Disconnecting peer ${peer} because they didn't respond to my request for sync item ${id}",
-                    ("peer", active_peer->get_remote_endpoint())("id", item_and_time.first.item_hash));
-              disconnect_due_to_request_timeout = true;
-              break;
-            }
-          if (!disconnect_due_to_request_timeout &&
-              active_peer->item_ids_requested_from_peer &&
-              active_peer->item_ids_requested_from_peer->get<1>() < active_ignored_request_threshold)
+          const peer_connection_ptr& handshaking_peer = peer;
+          if( handshaking_peer->connection_initiation_time < handshaking_disconnect_threshold &&
+              handshaking_peer->get_last_message_received_time() < handshaking_disconnect_threshold &&
+              handshaking_peer->get_last_message_sent_time() < handshaking_disconnect_threshold )
+          {
+            wlog( "Forcibly disconnecting from handshaking peer ${peer} due to inactivity of at least ${timeout} seconds",
+                  ( "peer", handshaking_peer->get_remote_endpoint() )("timeout", handshaking_timeout ) );
+            wlog("Peer's negotiating status: ${status}, bytes sent: ${sent}, bytes received: ${received}",
+                  ("status", handshaking_peer->negotiation_status)
+                  ("sent", handshaking_peer->get_total_bytes_sent())
+                  ("received", handshaking_peer->get_total_bytes_received()));
+            handshaking_peer->connection_closed_error = fc::exception(FC_LOG_MESSAGE(warn, "Terminating handshaking connection due to inactivity of ${timeout} seconds.  Negotiating status: ${status}, bytes sent: ${sent}, bytes received: ${received}",
+                                                                                      ("peer", handshaking_peer->get_remote_endpoint())
+                                                                                      ("timeout", handshaking_timeout)
+                                                                                      ("status", handshaking_peer->negotiation_status)
+                                                                                      ("sent", handshaking_peer->get_total_bytes_sent())
+                                                                                      ("received", handshaking_peer->get_total_bytes_received())));
+            peers_to_disconnect_forcibly.push_back( handshaking_peer );
+          }
+          else
+            next_check = std::max(handshaking_peer->connection_initiation_time,
+                                  std::max(handshaking_peer->get_last_message_received_time(),
+                                           handshaking_peer->get_last_message_sent_time())) + fc::seconds(handshaking_timeout);
+        }
+        else if( _active_connections.find( peer ) != _active_connections.end() )
+        {
+          const peer_connection_ptr& active_peer = peer;
+          const fc::time_point last_activity = std::max(active_peer->connection_initiation_time, active_peer->get_last_message_received_time());
+          if( active_peer->connection_initiation_time < active_disconnect_threshold &&
+              active_peer->get_last_message_received_time() < active_disconnect_threshold )
+          {
+            wlog( "Closing connection with peer ${peer} due to inactivity of at least ${timeout} seconds",
+                  ( "peer", active_peer->get_remote_endpoint() )("timeout", active_disconnect_timeout ) );
+            peers_to_disconnect_gently.push_back( active_peer );
+          }
+          else
+          {
+            // the oldest outstanding request decides when the peer has ignored us for too long
+            fc::time_point oldest_request = fc::time_point::maximum();
+            bool disconnect_due_to_request_timeout = false;
+            for (const peer_connection::item_to_time_map_type::value_type& item_and_time : active_peer->sync_items_requested_from_peer)
             {
-              wlog("Disconnecting peer ${peer} because they didn't respond to my request for sync item ids after ${id}",
-                    ("peer", active_peer->get_remote_endpoint())
-                    ("id", active_peer->item_ids_requested_from_peer->get<0>().item_hash));
-              disconnect_due_to_request_timeout = true;
-            }
-          if (!disconnect_due_to_request_timeout)
-            for (const peer_connection::item_to_time_map_type::value_type& item_and_time : active_peer->items_requested_from_peer)
               if (item_and_time.second < active_ignored_request_threshold)
               {
-                wlog("Disconnecting peer ${peer} because they didn't respond to my request for item ${id}",
+                wlog("Disconnecting peer ${peer} because they didn't respond to my request for sync item ${id}",
                       ("peer", active_peer->get_remote_endpoint())("id", item_and_time.first.item_hash));
                 disconnect_due_to_request_timeout = true;
                 break;
               }
-          if (disconnect_due_to_request_timeout)
-          {
-            // we should probably disconnect nicely and give them a reason, but right now the logic
-            // for rescheduling the requests only executes when the connection is fully closed,
-            // and we want to get those requests rescheduled as soon as possible
-            peers_to_disconnect_forcibly.push_back(active_peer);
+              oldest_request = std::min(oldest_request, item_and_time.second);
+            }
+            if (!disconnect_due_to_request_timeout &&
+                active_peer->item_ids_requested_from_peer)
+            {
+              if (active_peer->item_ids_requested_from_peer->get<1>() < active_ignored_request_threshold)
+              {
+                wlog("Disconnecting peer ${peer} because they didn't respond to my request for sync item ids after ${id}",
+                      ("peer", active_peer->get_remote_endpoint())
+                      ("id", active_peer->item_ids_requested_from_peer->get<0>().item_hash));
+                disconnect_due_to_request_timeout = true;
+              }
+              oldest_request = std::min(oldest_request, active_peer->item_ids_requested_from_peer->get<1>());
+            }
+            if (!disconnect_due_to_request_timeout)
+              for (const peer_connection::item_to_time_map_type::value_type& item_and_time : active_peer->items_requested_from_peer)
+              {
+                if (item_and_time.second < active_ignored_request_threshold)
+                {
+                  wlog("Disconnecting peer ${peer} because they didn't respond to my request for item ${id}",
+                        ("peer", active_peer->get_remote_endpoint())("id", item_and_time.first.item_hash));
+                  disconnect_due_to_request_timeout = true;
+                  break;
+                }
+                oldest_request = std::min(oldest_request, item_and_time.second);
+              }
+            if (disconnect_due_to_request_timeout)
+            {
+              // we should probably disconnect nicely and give them a reason, but right now the logic
+              // for rescheduling the requests only executes when the connection is fully closed,
+              // and we want to get those requests rescheduled as soon as possible
+              peers_to_disconnect_forcibly.push_back(active_peer);
+            }
+            else
+            {
+              fc::time_point next_keepalive = last_activity + fc::seconds(active_send_keepalive_timeount);
+              if (active_peer->connection_initiation_time < active_send_keepalive_threshold &&
+                  active_peer->get_last_message_received_time() < active_send_keepalive_threshold)
+              {
+                wlog( "Sending a keepalive message to peer ${peer} who hasn't sent us any messages in the last ${timeout} seconds",
+                      ( "peer", active_peer->get_remote_endpoint() )("timeout", active_send_keepalive_timeount ) );
+                peers_to_send_keep_alive.push_back(active_peer);
+                // keep asking as often as this loop runs until they answer or time out
+                next_keepalive = now + fc::seconds(BTS_NET_PEER_HANDSHAKE_INACTIVITY_TIMEOUT / 2);
+              }
+              next_check = std::min(last_activity + fc::seconds(active_disconnect_timeout), next_keepalive);
+              if (oldest_request != fc::time_point::maximum())
+                next_check = std::min(next_check, oldest_request + fc::seconds(active_ignored_request_timeount));
+            }
           }
-          else if (active_peer->connection_initiation_time < active_send_keepalive_threshold &&
-                    active_peer->get_last_message_received_time() < active_send_keepalive_threshold)
+        }
+        else if( _closing_connections.find( peer ) != _closing_connections.end() )
+        {
+          const peer_connection_ptr& closing_peer = peer;
+          if( closing_peer->connection_closed_time < closing_disconnect_threshold )
           {
-            wlog( "Sending a keepalive message to peer ${peer} who hasn't sent us any messages in the last ${timeout} seconds",
-                  ( "peer", active_peer->get_remote_endpoint() )("timeout", active_send_keepalive_timeount ) );
-            peers_to_send_keep_alive.push_back(active_peer);
+            // we asked this peer to close their connectoin to us at least BTS_NET_PEER_DISCONNECT_TIMEOUT
+            // seconds ago, but they haven't done it yet.  Terminate the connection now
+            wlog( "Forcibly disconnecting peer ${peer} who failed to close their conneciton in a timely manner",
+                  ( "peer", closing_peer->get_remote_endpoint() ) );
+            peers_to_disconnect_forcibly.push_back( closing_peer );
           }
+          else
+            next_check = closing_peer->connection_closed_time + fc::seconds(BTS_NET_PEER_DISCONNECT_TIMEOUT);
         }
-      }
-
-      fc::time_point closing_disconnect_threshold = fc::time_point::now() - fc::seconds(BTS_NET_PEER_DISCONNECT_TIMEOUT);
-      for( const peer_connection_ptr& closing_peer : _closing_connections )
-        if( closing_peer->connection_closed_time < closing_disconnect_threshold )
+        else if( _terminating_connections.find( peer ) != _terminating_connections.end() )
         {
-          // we asked this peer to close their connectoin to us at least BTS_NET_PEER_DISCONNECT_TIMEOUT
-          // seconds ago, but they haven't done it yet.  Terminate the connection now
-          wlog( "Forcibly disconnecting peer ${peer} who failed to close their conneciton in a timely manner",
-                ( "peer", closing_peer->get_remote_endpoint() ) );
-          peers_to_disconnect_forcibly.push_back( closing_peer );
+          if (peer->get_connection_terminated_time() != fc::time_point::min() &&
+              peer->get_connection_terminated_time() < failed_terminate_threshold)
+          {
+            wlog("Terminating connection with peer ${peer}, closing the connection didn't work", ("peer", peer->get_remote_endpoint()));
+            peers_to_terminate.push_back(peer);
+          }
+          else if (peer->get_connection_terminated_time() != fc::time_point::min())
+            next_check = peer->get_connection_terminated_time() + fc::seconds(failed_terminate_timeout_seconds);
+          else
+            next_check = now + fc::seconds(failed_terminate_timeout_seconds);
         }
 
-      uint32_t failed_terminate_timeout_seconds = 120;
-      fc::time_point failed_terminate_threshold = fc::time_point::now() - fc::seconds(failed_terminate_timeout_seconds);
-      for (const peer_connection_ptr& peer : _terminating_connections )
-        if (peer->get_connection_terminated_time() != fc::time_point::min() &&
-            peer->get_connection_terminated_time() < failed_terminate_threshold)
-        {
-          wlog("Terminating connection with peer ${peer}, closing the connection didn't work", ("peer", peer->get_remote_endpoint()));
-          peers_to_terminate.push_back(peer);
-        }
+        if( next_check != fc::time_point::maximum() )
+          schedule_timeout_check( peer, next_check );
+      }
 
       for( const peer_connection_ptr& peer : peers_to_disconnect_gently )
       {
@@ -1458,6 +1873,7 @@ namespace bts { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
 
       assert(_handshaking_connections.find(peer_to_delete) == _handshaking_connections.end());
+      assert(_unverified_inbound_connections.find(peer_to_delete) == _unverified_inbound_connections.end());
       assert(_active_connections.find(peer_to_delete) == _active_connections.end());
       assert(_closing_connections.find(peer_to_delete) == _closing_connections.end());
       assert(_terminating_connections.find(peer_to_delete) == _terminating_connections.end());
@@ -1582,6 +1998,165 @@ namespace bts { namespace net { namespace detail {
     }
 
     void node_impl::on_message( peer_connection* originating_peer, const message& received_message )
+    {
+      VERIFY_CORRECT_THREAD();
+      if( received_message.msg_type != core_message_type_enum::hello_message_type &&
+          _unverified_inbound_connections.find( originating_peer->shared_from_this() ) != _unverified_inbound_connections.end() )
+      {
+        wlog( "Disconnecting from inbound peer ${peer} which sent a ${type} message before a valid hello message",
+              ( "peer", originating_peer->get_remote_endpoint() )( "type", received_message.msg_type ) );
+        disconnect_from_peer( originating_peer, "You must send a valid hello message first" );
+        return;
+      }
+      fc::optional<received_message_priority> priority = get_received_message_priority( received_message.msg_type );
+      if( !priority )
+      {
+        handle_message( originating_peer, received_message );
+        return;
+      }
+
+      peer_connection_ptr originating_peer_ptr = originating_peer->shared_from_this();
+      received_message_queue& queue = _received_message_queues[*priority];
+      std::deque<message>& peer_messages = queue.messages_by_peer[originating_peer_ptr];
+      if( peer_messages.empty() )
+        queue.peers_in_turn.push_back( originating_peer_ptr );
+      peer_messages.push_back( received_message );
+      ++originating_peer->received_messages_queued;
+      trigger_process_received_messages();
+
+      if( originating_peer->received_messages_queued >= BTS_NET_MAX_QUEUED_RECEIVED_MESSAGES_PER_PEER )
+      {
+        // hold up this peer's read loop, the way handling each message before reading the next used to
+        dlog( "peer ${endpoint} has ${count} messages waiting to be handled, pausing reads from it",
+              ( "endpoint", originating_peer->get_remote_endpoint() )( "count", originating_peer->received_messages_queued ) );
+        originating_peer->received_messages_drained_promise = fc::promise<void>::ptr( new fc::promise<void>( "bts::net::received_messages_drained" ) );
+        originating_peer->received_messages_drained_promise->wait();
+      }
+    }
+
+    /**
+     * Messages that drive the connection itself are handled as they arrive; the rest are queued
+     * by priority.  Compressed messages are unwrapped first and queued by what they contain.
+     */
+    fc::optional<node_impl::received_message_priority> node_impl::get_received_message_priority( uint32_t msg_type ) const
+    {
+      switch( msg_type )
+      {
+      case bts::client::message_type_enum::block_message_type:
+      case bts::client::message_type_enum::compact_block_message_type:
+      case bts::client::message_type_enum::block_headers_message_type:
+      case core_message_type_enum::fetch_blockchain_item_ids_message_type:
+      case core_message_type_enum::blockchain_item_ids_inventory_message_type:
+      case core_message_type_enum::fetch_items_message_type:
+      case core_message_type_enum::item_not_available_message_type:
+        return block_priority;
+      case core_message_type_enum::item_ids_inventory_message_type:
+        return inventory_priority;
+      case core_message_type_enum::address_request_message_type:
+      case core_message_type_enum::address_message_type:
+        return gossip_priority;
+      default:
+        if( msg_type < core_message_type_enum::core_message_type_first ||
+            msg_type > core_message_type_enum::core_message_type_last )
+          return transaction_priority;
+        return fc::optional<received_message_priority>();
+      }
+    }
+
+    void node_impl::process_received_messages()
+    {
+      VERIFY_CORRECT_THREAD();
+      static const unsigned budgets[received_message_priority_count] = BTS_NET_RECEIVED_MESSAGE_PRIORITY_BUDGETS;
+      unsigned remaining_budgets[received_message_priority_count];
+      std::copy( budgets, budgets + received_message_priority_count, remaining_budgets );
+
+      for( ;; )
+      {
+        // take the most urgent message whose class still has budget this round, starting a new
+        // round once every class with messages waiting has used its budget
+        int priority = 0;
+        bool any_queued = false;
+        for( ; priority < received_message_priority_count; ++priority )
+        {
+          any_queued = any_queued || !_received_message_queues[priority].peers_in_turn.empty();
+          if( remaining_budgets[priority] && !_received_message_queues[priority].peers_in_turn.empty() )
+            break;
+        }
+        if( !any_queued )
+          return;
+        if( priority == received_message_priority_count )
+        {
+          std::copy( budgets, budgets + received_message_priority_count, remaining_budgets );
+          continue;
+        }
+        --remaining_budgets[priority];
+
+        // peers take turns within a class, so one of them sending a lot can't crowd out the others
+        received_message_queue& queue = _received_message_queues[priority];
+        peer_connection_ptr peer = queue.peers_in_turn.front();
+        queue.peers_in_turn.pop_front();
+        auto peer_messages_iter = queue.messages_by_peer.find( peer );
+        message message_to_handle = std::move( peer_messages_iter->second.front() );
+        peer_messages_iter->second.pop_front();
+        if( peer_messages_iter->second.empty() )
+          queue.messages_by_peer.erase( peer_messages_iter );
+        else
+          queue.peers_in_turn.push_back( peer );
+
+        --peer->received_messages_queued;
+        if( peer->received_messages_drained_promise &&
+            peer->received_messages_queued < BTS_NET_MAX_QUEUED_RECEIVED_MESSAGES_PER_PEER )
+        {
+          peer->received_messages_drained_promise->set_value();
+          peer->received_messages_drained_promise.reset();
+        }
+
+        if( peer->negotiation_status == peer_connection::connection_negotiation_status::closed )
+          continue;
+        try
+        {
+          handle_message( peer.get(), message_to_handle );
+        }
+        catch ( const fc::canceled_exception& )
+        {
+          throw;
+        }
+        catch ( const fc::exception& e )
+        {
+          // this used to end the peer's read loop, which closed the connection
+          wlog( "error handling message from peer ${endpoint}, closing the connection: ${e}",
+                ( "endpoint", peer->get_remote_endpoint() )( "e", e.to_detail_string() ) );
+          peer->close_connection();
+        }
+      }
+    }
+
+    void node_impl::trigger_process_received_messages()
+    {
+      VERIFY_CORRECT_THREAD();
+      if( !_node_is_shutting_down &&
+          ( !_process_received_messages_done.valid() || _process_received_messages_done.ready() ) )
+        _process_received_messages_done = fc::async( [=](){ process_received_messages(); }, "process_received_messages" );
+    }
+
+    void node_impl::discard_received_messages( const peer_connection_ptr& peer )
+    {
+      VERIFY_CORRECT_THREAD();
+      for( received_message_queue& queue : _received_message_queues )
+      {
+        if( queue.messages_by_peer.erase( peer ) )
+          queue.peers_in_turn.erase( std::remove( queue.peers_in_turn.begin(), queue.peers_in_turn.end(), peer ),
+                                     queue.peers_in_turn.end() );
+      }
+      peer->received_messages_queued = 0;
+      if( peer->received_messages_drained_promise )
+      {
+        peer->received_messages_drained_promise->set_value();
+        peer->received_messages_drained_promise.reset();
+      }
+    }
+
+    void node_impl::handle_message( peer_connection* originating_peer, const message& received_message )
     {
       VERIFY_CORRECT_THREAD();
       message_hash_type message_hash = received_message.id();
@@ -1625,6 +2200,15 @@ namespace bts { namespace net { namespace detail {
       case bts::client::message_type_enum::block_message_type:
         process_block_message( originating_peer, received_message, message_hash );
         break;
+      case bts::client::message_type_enum::compact_block_message_type:
+        on_compact_block_message( originating_peer, received_message.as<bts::client::compact_block_message>() );
+        break;
+      case bts::client::message_type_enum::block_headers_message_type:
+        on_block_headers_message( originating_peer, received_message.as<bts::client::block_headers_message>() );
+        break;
+      case core_message_type_enum::compressed_message_type:
+        on_compressed_message( originating_peer, received_message.as<compressed_message>() );
+        break;
       case core_message_type_enum::current_time_request_message_type:
         on_current_time_request_message( originating_peer, received_message.as<current_time_request_message>() );
         break;
@@ -1688,6 +2272,15 @@ namespace bts { namespace net { namespace detail {
       if (!_hard_fork_block_numbers.empty())
         user_data["last_known_fork_block_number"] = _hard_fork_block_numbers.back();
 
+      user_data["compact_blocks"] = true;
+      user_data["compression"] = "lzma";
+      user_data["block_headers"] = true;
+
+      // only pruning nodes say so, since every older node serves every block
+      const uint32_t first_full_block_number = _delegate->get_first_full_block_number();
+      if (first_full_block_number > 1)
+        user_data["first_full_block_number"] = first_full_block_number;
+
       return user_data;
     }
     void node_impl::parse_hello_user_data_for_peer(peer_connection* originating_peer, const fc::variant_object& user_data)
@@ -1710,11 +2303,35 @@ namespace bts { namespace net { namespace detail {
         originating_peer->node_id = user_data["node_id"].as<node_id_t>();
       if (user_data.contains("last_known_fork_block_number"))
         originating_peer->last_known_fork_block_number = user_data["last_known_fork_block_number"].as<uint32_t>();
+      if (user_data.contains("compact_blocks"))
+        originating_peer->supports_compact_blocks = user_data["compact_blocks"].as_bool();
+      if (user_data.contains("compression"))
+        originating_peer->supports_compression = user_data["compression"].as_string() == "lzma";
+      if (user_data.contains("block_headers"))
+        originating_peer->supports_block_headers = user_data["block_headers"].as_bool();
+      if (user_data.contains("first_full_block_number"))
+        originating_peer->first_full_block_number = user_data["first_full_block_number"].as<uint32_t>();
     }
 
     void node_impl::on_hello_message( peer_connection* originating_peer, const hello_message& hello_message_received )
     {
       VERIFY_CORRECT_THREAD();
+      // validate the node id.  Recovering the signer is the expensive part of the handshake, so it runs on a
+      // handshake thread, on copies, while this thread handles other peers
+      peer_connection_ptr originating_peer_ptr = originating_peer->shared_from_this();
+      fc::sha256::encoder shared_secret_encoder;
+      fc::sha512 shared_secret = originating_peer->get_shared_secret();
+      shared_secret_encoder.write(shared_secret.data(), sizeof(shared_secret));
+      const fc::sha256 shared_secret_hash = shared_secret_encoder.result();
+      const fc::ecc::compact_signature signed_shared_secret = hello_message_received.signed_shared_secret;
+      fc::ecc::public_key expected_node_public_key = next_handshake_thread().async( [signed_shared_secret, shared_secret_hash]() {
+        return fc::ecc::public_key(signed_shared_secret, shared_secret_hash, false);
+      }, "recover_hello_signer" ).wait();
+      if( _unverified_inbound_connections.find(originating_peer_ptr) == _unverified_inbound_connections.end() &&
+          _handshaking_connections.find(originating_peer_ptr) == _handshaking_connections.end() &&
+          _active_connections.find(originating_peer_ptr) == _active_connections.end() )
+        return; // we dropped the connection while the signature was being checked
+
       // this already_connected check must come before we fill in peer data below
       node_id_t peer_node_id = hello_message_received.node_public_key;
       try
@@ -1727,12 +2344,6 @@ namespace bts { namespace net { namespace detail {
       }
       bool already_connected_to_this_peer = is_already_connected_to_id(peer_node_id);
 
-      // validate the node id
-      fc::sha256::encoder shared_secret_encoder;
-      fc::sha512 shared_secret = originating_peer->get_shared_secret();
-      shared_secret_encoder.write(shared_secret.data(), sizeof(shared_secret));
-      fc::ecc::public_key expected_node_public_key(hello_message_received.signed_shared_secret, shared_secret_encoder.result(), false);
-
       // store off the data provided in the hello message
       originating_peer->user_agent = hello_message_received.user_agent;
       originating_peer->node_public_key = hello_message_received.node_public_key;
@@ -1770,6 +2381,11 @@ namespace bts { namespace net { namespace detail {
           disconnect_from_peer( originating_peer, "Invalid signature in hello message" );
           return;
         }
+        if( _unverified_inbound_connections.erase(originating_peer_ptr) )
+        {
+          _handshaking_connections.insert(originating_peer_ptr);
+          schedule_timeout_check(originating_peer_ptr, fc::time_point::now());
+        }
         if (hello_message_received.chain_id != _chain_id)
         {
           wlog("Received hello message from peer on a different chain: ${message}", ("message", hello_message_received));
@@ -2155,16 +2771,48 @@ namespace bts { namespace net { namespace detail {
       return max_number_of_unfetched_items;
     }
 
-    // get a blockchain synopsis that makes sense to send to the given peer.
-    // If the peer isn't yet syncing with us, this is just a synopsis of our active blockchain
-    // If the peer is syncing with us, it is a synopsis of our active blockchain plus the
-    //    blocks the peer has already told us it has
-    std::vector<item_hash_t> node_impl::create_blockchain_synopsis_for_peer( const peer_connection* peer )
+    // the number of sync blocks to keep requested from a peer.  Slower peers get proportionally smaller
+    // windows than the fastest one, so every peer drains its window at about the same rate, but each
+    // window holds at least two round trips' worth of the peer's blocks so it never runs dry while our
+    // next request is on its way.  Without a fastest_delivery_time the window isn't scaled down.
+    uint32_t node_impl::sync_request_window( const peer_connection_ptr& peer, const fc::microseconds& fastest_delivery_time ) const
     {
       VERIFY_CORRECT_THREAD();
-      item_hash_t reference_point = peer->last_block_delegate_has_seen;
-      uint32_t reference_point_block_num = peer->last_block_number_delegate_has_seen;
-      uint32_t number_of_blocks_after_reference_point = (uint32_t)peer->ids_of_items_to_get.size();
+      uint32_t window = _maximum_blocks_per_peer_during_syncing;
+      const int64_t delivery_time = peer->sync_block_delivery_time.count();
+      if( delivery_time > 0 )
+      {
+        if( fastest_delivery_time.count() > 0 )
+          window = (uint32_t)(window * fastest_delivery_time.count() / delivery_time);
+        const int64_t blocks_per_round_trip = peer->round_trip_delay.count() / delivery_time;
+        window = (uint32_t)std::max<int64_t>(window, 2 * blocks_per_round_trip);
+      }
+      return std::max<uint32_t>(1, std::min<uint32_t>(window, BTS_NET_MAX_SYNC_REQUEST_WINDOW));
+    }
+
+    // the number of received sync blocks we buffer before we stop requesting more: the configured limit,
+    // raised so that every peer can deliver a full window without suspending the others
+    uint32_t node_impl::sync_prefetch_limit() const
+    {
+      VERIFY_CORRECT_THREAD();
+      uint64_t total_windows = 0;
+      for( const peer_connection_ptr& peer : _active_connections )
+        if( peer->we_need_sync_items_from_peer )
+          total_windows += sync_request_window(peer, fc::microseconds());
+      return (uint32_t)std::max<uint64_t>(_maximum_number_of_sync_blocks_to_prefetch,
+                                          std::min<uint64_t>(2 * total_windows, BTS_NET_MAX_SYNC_BLOCKS_TO_PREFETCH));
+    }
+
+    // get a blockchain synopsis that makes sense to send to the given peer.
+    // If the peer isn't yet syncing with us, this is just a synopsis of our active blockchain
+    // If the peer is syncing with us, it is a synopsis of our active blockchain plus the
+    //    blocks the peer has already told us it has
+    std::vector<item_hash_t> node_impl::create_blockchain_synopsis_for_peer( const peer_connection* peer )
+    {
+      VERIFY_CORRECT_THREAD();
+      item_hash_t reference_point = peer->last_block_delegate_has_seen;
+      uint32_t reference_point_block_num = peer->last_block_number_delegate_has_seen;
+      uint32_t number_of_blocks_after_reference_point = (uint32_t)peer->ids_of_items_to_get.size();
 
       // when we call _delegate->get_blockchain_synopsis(), we may yield and there's a
       // chance this peer's state will change before we get control back.  Save off
@@ -2214,6 +2862,7 @@ namespace bts { namespace net { namespace detail {
            ( "peer", peer->get_remote_endpoint() )
            ( "blockchain_synopsis", blockchain_synopsis ) );
       peer->item_ids_requested_from_peer = boost::make_tuple( item_id(_sync_item_type, last_item_seen ), fc::time_point::now() );
+      schedule_timeout_check( peer, fc::time_point::now() + fc::seconds(active_peer_ignored_request_timeout_sec()) );
       peer->send_message( fetch_blockchain_item_ids_message(_sync_item_type, blockchain_synopsis ) );
     }
 
@@ -2249,7 +2898,10 @@ namespace bts { namespace net { namespace detail {
           uint32_t new_number_of_unfetched_items = calculate_unsynced_block_count_from_all_peers();
           _total_number_of_unfetched_items = new_number_of_unfetched_items;
           if( new_number_of_unfetched_items == 0 )
+          {
+            _validated_sync_block_headers.clear();
             _delegate->sync_status( blockchain_item_ids_inventory_message_received.item_type, 0 );
+          }
 
           return;
         }
@@ -2416,9 +3068,32 @@ namespace bts { namespace net { namespace detail {
            ( "type", fetch_items_message_received.item_type )
            ( "endpoint", originating_peer->get_remote_endpoint() ) );
 
+      if( fetch_items_message_received.item_type == bts::client::block_headers_message_type )
+      {
+        // all the headers go back in one message; only as many as we'd ever ask for
+        std::vector<item_hash_t> block_ids( fetch_items_message_received.items_to_fetch.begin(),
+                                            fetch_items_message_received.items_to_fetch.begin() +
+                                              std::min<size_t>( fetch_items_message_received.items_to_fetch.size(), BTS_NET_MAX_BLOCK_HEADERS_PER_REQUEST ) );
+        originating_peer->send_message( bts::client::block_headers_message( _delegate->get_block_headers( block_ids ) ),
+                                        traffic_class::sync_serving );
+        return;
+      }
+
       fc::optional<message> last_block_message_sent;
 
-      std::list<message> reply_messages;
+      // a compact block is requested by the id of the full block_message it stands for
+      const bool send_compact_blocks = fetch_items_message_received.item_type == bts::client::compact_block_message_type;
+      const uint32_t item_type = send_compact_blocks ? uint32_t(block_message_type) : fetch_items_message_received.item_type;
+      const auto reply_with = [&]( const message& requested_message, const item_hash_t& item_hash ) -> message {
+        if (item_type == block_message_type)
+          last_block_message_sent = requested_message;
+        if (send_compact_blocks)
+          return bts::client::compact_block_message(requested_message.as<bts::client::block_message>(), item_hash);
+        return requested_message;
+      };
+
+      // items still in the message cache are ones we're relaying; older ones serve a peer that's syncing
+      std::list<std::pair<message, traffic_class> > reply_messages;
       for( const item_hash_t& item_hash : fetch_items_message_received.items_to_fetch )
       {
         try
@@ -2427,9 +3102,7 @@ namespace bts { namespace net { namespace detail {
           dlog( "received item request for item ${id} from peer ${endpoint}, returning the item from my message cache",
                ( "endpoint", originating_peer->get_remote_endpoint() )
                ( "id", requested_message.id() ) );
-          reply_messages.push_back( requested_message );
-          if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
+          reply_messages.push_back( std::make_pair( reply_with( requested_message, item_hash ), peer_connection::traffic_class_of( requested_message ) ) );
           continue;
         }
         catch ( fc::key_not_found_exception& )
@@ -2437,7 +3110,7 @@ namespace bts { namespace net { namespace detail {
            // it wasn't in our local cache, that's ok ask the client
         }
 
-        item_id item_to_fetch( fetch_items_message_received.item_type, item_hash );
+        item_id item_to_fetch( item_type, item_hash );
         try
         {
           message requested_message = _delegate->get_item( item_to_fetch );
@@ -2445,14 +3118,13 @@ namespace bts { namespace net { namespace detail {
                ( "id", requested_message.id() )
                ( "size", requested_message.size )
                ( "endpoint", originating_peer->get_remote_endpoint() ) );
-          reply_messages.push_back( requested_message );
-          if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
+          reply_messages.push_back( std::make_pair( reply_with( requested_message, item_hash ),
+                                                    item_type == block_message_type ? traffic_class::sync_serving : peer_connection::traffic_class_of( requested_message ) ) );
           continue;
         }
         catch ( fc::key_not_found_exception& )
         {
-          reply_messages.push_back( item_not_available_message(item_to_fetch ) );
+          reply_messages.push_back( std::make_pair( message( item_not_available_message(item_to_fetch ) ), traffic_class::gossip ) );
           dlog( "received item request from peer ${endpoint} but we don't have it",
                ( "endpoint", originating_peer->get_remote_endpoint() ) );
         }
@@ -2467,8 +3139,12 @@ namespace bts { namespace net { namespace detail {
         originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(block.block_id);
       }
 
-      for( const message& reply : reply_messages )
-        originating_peer->send_message( reply );
+      for( const auto& reply : reply_messages )
+      {
+        if( reply.first.msg_type == bts::client::block_message_type || reply.first.msg_type == bts::client::compact_block_message_type )
+          ++originating_peer->blocks_served;
+        originating_peer->send_message( reply.first, reply.second );
+      }
     }
 
     void node_impl::on_item_not_available_message( peer_connection* originating_peer, const item_not_available_message& item_not_available_message_received )
@@ -2516,15 +3192,12 @@ namespace bts { namespace net { namespace detail {
       for( const item_hash_t& item_hash : item_ids_inventory_message_received.item_hashes_available )
       {
         item_id advertised_item_id( item_ids_inventory_message_received.item_type, item_hash );
-        bool we_advertised_this_item_to_a_peer = false;
+        // everything we advertise goes through the message cache.  The filters of what we advertised
+        // to each peer can't answer this, a false positive would make us skip an item we don't have
+        bool we_advertised_this_item_to_a_peer = _message_cache.has_message(item_hash);
         bool we_requested_this_item_from_a_peer = false;
         for( const peer_connection_ptr peer : _active_connections )
         {
-          if( peer->inventory_advertised_to_peer.find(advertised_item_id) != peer->inventory_advertised_to_peer.end() )
-          {
-            we_advertised_this_item_to_a_peer = true;
-            break;
-          }
           if( peer->items_requested_from_peer.find(advertised_item_id) != peer->items_requested_from_peer.end() )
             we_requested_this_item_from_a_peer = true;
         }
@@ -2540,6 +3213,12 @@ namespace bts { namespace net { namespace detail {
               originating_peer->is_inventory_advertised_to_us_list_full())
             break;
           originating_peer->inventory_peer_advertised_to_us.insert(peer_connection::timestamped_item_id(advertised_item_id, fc::time_point::now()));
+          if( advertised_item_id.item_type == bts::client::block_message_type )
+          {
+            block_propagation_trace& trace = trace_block( item_hash );
+            if( trace.data.first_inventory_time == fc::time_point() )
+              trace.data.first_inventory_time = fc::time_point::now();
+          }
           if( !we_requested_this_item_from_a_peer )
           {
             auto insert_result = _items_to_fetch.insert(prioritized_item_id(advertised_item_id, _items_to_fetch_sequence_counter++));
@@ -2605,8 +3284,11 @@ namespace bts { namespace net { namespace detail {
         }
       }
 
+      discard_received_messages( originating_peer_ptr );
+
       _closing_connections.erase( originating_peer_ptr );
       _handshaking_connections.erase( originating_peer_ptr );
+      _unverified_inbound_connections.erase( originating_peer_ptr );
       _terminating_connections.erase( originating_peer_ptr );
       if( _active_connections.find(originating_peer_ptr) != _active_connections.end() )
       {
@@ -2618,6 +3300,7 @@ namespace bts { namespace net { namespace detail {
           if (updated_peer_record)
           {
             updated_peer_record->last_seen_time = fc::time_point::now();
+            record_peer_performance(originating_peer_ptr, *updated_peer_record);
             _potential_peer_db.update_entry(*updated_peer_record);
           }
         }
@@ -2659,9 +3342,12 @@ namespace bts { namespace net { namespace detail {
 
       fc::oexception handle_message_exception;
 
+      const fc::time_point handling_start = fc::time_point::now();
       try
       {
         _delegate->handle_message(block_message_to_send, true);
+        ++_sync_blocks_handled;
+        _sync_block_handling_time = smooth_sync_time(_sync_block_handling_time, fc::time_point::now() - handling_start);
         wlog("Successfully pushed sync block ${num} (id:${id})",
              ("num", block_message_to_send.block.block_num)
              ("id", block_message_to_send.block_id));
@@ -2866,58 +3552,69 @@ namespace bts { namespace net { namespace detail {
 
       do
       {
-        std::copy(std::make_move_iterator(_new_received_sync_items.begin()),
-                  std::make_move_iterator(_new_received_sync_items.end()),
-                  std::front_inserter(_received_sync_items));
+        for (bts::client::block_message& new_block : _new_received_sync_items)
+        {
+          bts::blockchain::block_id_type new_block_id = new_block.block_id;
+          _received_sync_items.emplace(new_block_id, std::move(new_block));
+        }
         _new_received_sync_items.clear();
         dlog("currently ${count} sync items to consider", ("count", _received_sync_items.size()));
 
+        // the next block on the active chain or one of the forks is the first item left to get from
+        // some peer, so only those ids need to be looked up in the backlog
         block_processed_this_iteration = false;
-        for (auto received_block_iter = _received_sync_items.begin();
-             received_block_iter != _received_sync_items.end();
-             ++received_block_iter)
+        for (const peer_connection_ptr& peer : _active_connections)
         {
-
-          // find out if this block is the next block on the active chain or one of the forks
-          bool potential_first_block = false;
-          for (const peer_connection_ptr& peer : _active_connections)
+          ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
+          if (peer->ids_of_items_to_get.empty())
+            continue;
+          auto received_block_iter = _received_sync_items.find(peer->ids_of_items_to_get.front());
+          if (received_block_iter == _received_sync_items.end())
+            continue;
+
+          // it is, remove it from all sync peers lists and process it
+          bts::blockchain::block_id_type received_block_id = received_block_iter->first;
+          for (const peer_connection_ptr& peer_expecting_block : _active_connections)
           {
-            ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
-            if (!peer->ids_of_items_to_get.empty() &&
-                peer->ids_of_items_to_get.front() == received_block_iter->block_id)
+            if (!peer_expecting_block->ids_of_items_to_get.empty() &&
+                peer_expecting_block->ids_of_items_to_get.front() == received_block_id)
             {
-              potential_first_block = true;
-              peer->ids_of_items_to_get.pop_front();
-              peer->ids_of_items_being_processed.insert(received_block_iter->block_id);
+              peer_expecting_block->ids_of_items_to_get.pop_front();
+              peer_expecting_block->ids_of_items_being_processed.insert(received_block_id);
             }
           }
 
-          // if it is, process it, remove it from all sync peers lists
-          if (potential_first_block)
+          // we can get into an intersting situation near the end of synchronization.  We can be in
+          // sync with one peer who is sending us the last block on the chain via a regular inventory
+          // message, while at the same time still be synchronizing with a peer who is sending us the
+          // block through the sync mechanism.  Further, we must request both blocks because
+          // we don't know they're the same (for the peer in normal operation, it has only told us the
+          // message id, for the peer in the sync case we only known the block_id).
+          if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
+                        received_block_id) == _most_recent_blocks_accepted.end())
           {
-            // we can get into an intersting situation near the end of synchronization.  We can be in
-            // sync with one peer who is sending us the last block on the chain via a regular inventory
-            // message, while at the same time still be synchronizing with a peer who is sending us the
-            // block through the sync mechanism.  Further, we must request both blocks because
-            // we don't know they're the same (for the peer in normal operation, it has only told us the
-            // message id, for the peer in the sync case we only known the block_id).
-            if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
-                          received_block_iter->block_id) == _most_recent_blocks_accepted.end())
+            bts::client::block_message block_message_to_process = std::move(received_block_iter->second);
+            _received_sync_items.erase(received_block_iter);
+            auto received_time_iter = _sync_item_received_times.find(received_block_id);
+            if (received_time_iter != _sync_item_received_times.end())
             {
-              bts::client::block_message block_message_to_process = *received_block_iter;
-              _received_sync_items.erase(received_block_iter);
-              _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process](){ 
-                send_sync_block_to_node_delegate(block_message_to_process);
-              }, "send_sync_block_to_node_delegate"));
-              ++blocks_processed;
-              block_processed_this_iteration = true;
+              _sync_block_backlog_wait_time = smooth_sync_time(_sync_block_backlog_wait_time, fc::time_point::now() - received_time_iter->second);
+              _sync_item_received_times.erase(received_time_iter);
             }
-            else
-              dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
-
-            break; // start iterating _received_sync_items from the beginning
-          } // end if potential_first_block
-        } // end for each block in _received_sync_items
+            _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process](){ 
+              send_sync_block_to_node_delegate(block_message_to_process);
+            }, "send_sync_block_to_node_delegate"));
+            ++blocks_processed;
+          }
+          else
+          {
+            dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
+            _received_sync_items.erase(received_block_iter);
+            _sync_item_received_times.erase(received_block_id);
+          }
+          block_processed_this_iteration = true;
+          break; // the peers' next ids have changed, look them up again
+        } // end for each peer's next id
 
         if (_handle_message_calls_in_progress.size() >= _maximum_number_of_blocks_to_handle_at_one_time)
         {
@@ -2925,7 +3622,7 @@ namespace bts { namespace net { namespace detail {
                ("count", _handle_message_calls_in_progress.size()));
           //ulog("stopping processing sync block backlog because we have ${count} blocks in progress, total on hand: ${received}",
           //     ("count", _handle_message_calls_in_progress.size())("received", _received_sync_items.size()));
-          if (_received_sync_items.size() >= _maximum_number_of_sync_blocks_to_prefetch)
+          if (_received_sync_items.size() >= sync_prefetch_limit())
             _suspend_fetching_sync_blocks = true;
           break;
         }
@@ -2950,13 +3647,19 @@ namespace bts { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       dlog( "received a sync block from peer ${endpoint}", ("endpoint", originating_peer->get_remote_endpoint() ) );
 
-      // add it to the front of _received_sync_items, then process _received_sync_items to try to
+      // let the client start verifying it while the blocks before it are applied
+      _delegate->pre_validate_message( block_message_to_process );
+
+      // add it to _new_received_sync_items, then process _received_sync_items to try to
       // pass as many messages as possible to the client.
       _new_received_sync_items.push_front( block_message_to_process );
+      _sync_item_received_times[block_message_to_process.block_id] = fc::time_point::now();
       trigger_process_backlog_of_sync_blocks();
     }
 
+    /** message_to_process is the message block_message_to_process came in, which is handed on as it is */
     void node_impl::process_block_during_normal_operation( peer_connection* originating_peer,
+                                                           const message& message_to_process,
                                                            const bts::client::block_message& block_message_to_process,
                                                            const message_hash_type& message_hash )
     {
@@ -2966,6 +3669,7 @@ namespace bts { namespace net { namespace detail {
       std::list<peer_connection_ptr> peers_to_disconnect;
       std::string disconnect_reason;
       fc::oexception disconnect_exception;
+      bool relayed_before_validation = false;
 
       try
       {
@@ -2975,45 +3679,68 @@ namespace bts { namespace net { namespace detail {
         // block through the sync mechanism.  Further, we must request both blocks because
         // we don't know they're the same (for the peer in normal operation, it has only told us the
         // message id, for the peer in the sync case we only known the block_id).
-        fc::time_point message_validated_time;
+        item_id block_message_item_id(bts::client::message_type_enum::block_message_type, message_hash);
+        uint32_t block_number = block_message_to_process.block.block_num;
+        fc::time_point_sec block_time = block_message_to_process.block.timestamp;
+
+        const auto advertise_block = [&]( const fc::time_point& message_validated_time ) {
+          for (const peer_connection_ptr& peer : _active_connections)
+          {
+            ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
+
+            auto iter = peer->inventory_peer_advertised_to_us.find(block_message_item_id);
+            if (iter != peer->inventory_peer_advertised_to_us.end())
+            {
+              // this peer offered us the item.  It will eventually expire from the peer's 
+              // inventory_peer_advertised_to_us list after some time has passed (currently 2 minutes).
+              // For now, it will remain there, which will prevent us from offering the peer this 
+              // block back when we rebroadcast the block below
+              peer->last_block_delegate_has_seen = block_message_to_process.block_id;
+              peer->last_block_number_delegate_has_seen = block_number;
+              peer->last_block_time_delegate_has_seen = block_time;
+            }
+            peer->clear_old_inventory();
+          }
+          message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
+          broadcast( message_to_process, propagation_data );
+        };
+
         if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
                       block_message_to_process.block_id) == _most_recent_blocks_accepted.end())
         {
-          _delegate->handle_message(block_message_to_process, false);
-          message_validated_time = fc::time_point::now();
+          block_propagation_trace& trace = trace_block( message_hash );
+          trace.block_id = block_message_to_process.block_id;
+          trace.block_timestamp = block_message_to_process.block.timestamp;
+          trace.data.validation_start_time = fc::time_point::now();
+
+          // a block that builds on our head and is signed by its slot's delegate can go out while we
+          // apply it, which saves a block validation per hop.  If its body turns out to be invalid,
+          // we stop offering it and drop the peer that sent it to us
+          if (_fast_block_relay && _delegate->verify_block_header(message_to_process))
+          {
+            dlog( "header of block ${num} checks out, advertising it to other peers before applying it",
+                  ("num", block_number) );
+            advertise_block(fc::time_point::now());
+            relayed_before_validation = true;
+          }
+
+          _delegate->handle_message(message_to_process, false);
+          ++originating_peer->blocks_delivered_first;
           wlog("Successfully pushed block ${num} (id:${id})",
                ("num", block_message_to_process.block.block_num)
                ("id", block_message_to_process.block_id));
-          _most_recent_blocks_accepted.push_back(block_message_to_process.block_id);
+          if (!relayed_before_validation)
+          {
+            _most_recent_blocks_accepted.push_back(block_message_to_process.block_id);
+            dlog( "client validated the block, advertising it to other peers" );
+            advertise_block(fc::time_point::now());
+          }
         }
         else
-          dlog( "Already received and accepted this block (presumably through sync mechanism), treating it as accepted" );
-
-        dlog( "client validated the block, advertising it to other peers" );
-
-        item_id block_message_item_id(bts::client::message_type_enum::block_message_type, message_hash);
-        uint32_t block_number = block_message_to_process.block.block_num;
-        fc::time_point_sec block_time = block_message_to_process.block.timestamp;
-
-        for (const peer_connection_ptr& peer : _active_connections)
         {
-          ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
-
-          auto iter = peer->inventory_peer_advertised_to_us.find(block_message_item_id);
-          if (iter != peer->inventory_peer_advertised_to_us.end())
-          {
-            // this peer offered us the item.  It will eventually expire from the peer's 
-            // inventory_peer_advertised_to_us list after some time has passed (currently 2 minutes).
-            // For now, it will remain there, which will prevent us from offering the peer this 
-            // block back when we rebroadcast the block below
-            peer->last_block_delegate_has_seen = block_message_to_process.block_id;
-            peer->last_block_number_delegate_has_seen = block_number;
-            peer->last_block_time_delegate_has_seen = block_time;
-          }
-          peer->clear_old_inventory();
+          dlog( "Already received and accepted this block (presumably through sync mechanism), treating it as accepted" );
+          advertise_block(fc::time_point());
         }
-        message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
-        broadcast( block_message_to_process, propagation_data );
         _message_cache.block_accepted();
 
         if (is_hard_fork_block(block_number))
@@ -3062,6 +3789,21 @@ namespace bts { namespace net { namespace detail {
           if (!peer->ids_of_items_to_get.empty() &&
               peer->ids_of_items_to_get.front() == block_message_to_process.block_id)
             peers_to_disconnect.push_back(peer);
+
+        if (relayed_before_validation)
+        {
+          // the header was valid, so the peer relayed a body it can't have applied.  Take the block back
+          // as far as we still can, and don't hear from that peer again
+          _message_cache.erase_message(message_hash);
+          _new_inventory.erase(item_id(bts::client::block_message_type, message_hash));
+          _most_recent_blocks_accepted.erase(std::remove(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
+                                                         block_message_to_process.block_id),
+                                             _most_recent_blocks_accepted.end());
+          peer_connection_ptr originating_peer_ptr = originating_peer->shared_from_this();
+          if (_active_connections.find(originating_peer_ptr) != _active_connections.end() &&
+              std::find(peers_to_disconnect.begin(), peers_to_disconnect.end(), originating_peer_ptr) == peers_to_disconnect.end())
+            peers_to_disconnect.push_back(originating_peer_ptr);
+        }
       }
       for (const peer_connection_ptr& peer : peers_to_disconnect)
       {
@@ -3069,6 +3811,167 @@ namespace bts { namespace net { namespace detail {
         disconnect_from_peer(peer.get(), disconnect_reason, true, *disconnect_exception);
       }
     }
+    void node_impl::on_compact_block_message( peer_connection* originating_peer,
+                                              const bts::client::compact_block_message& compact_block_message_received )
+    {
+      VERIFY_CORRECT_THREAD();
+      const item_id requested_item( bts::client::block_message_type, compact_block_message_received.block_message_hash );
+      if( originating_peer->items_requested_from_peer.find( requested_item ) == originating_peer->items_requested_from_peer.end() )
+      {
+        wlog( "received a compact block ${block_id} I didn't ask for from peer ${endpoint}, ignoring it",
+              ( "block_id", compact_block_message_received.block_id )( "endpoint", originating_peer->get_remote_endpoint() ) );
+        return;
+      }
+
+      // every transaction we relayed in the last few blocks is still in the message cache, keyed by its id
+      bts::client::block_message rebuilt_block_message;
+      (bts::blockchain::signed_block_header&)rebuilt_block_message.block = compact_block_message_received.block_header;
+      rebuilt_block_message.block_id = compact_block_message_received.block_id;
+      rebuilt_block_message.block.user_transactions.reserve( compact_block_message_received.transaction_ids.size() );
+      bool missing_transaction = false;
+      for( const bts::blockchain::transaction_id_type& transaction_id : compact_block_message_received.transaction_ids )
+      {
+        fc::optional<message> cached_message = _message_cache.find_message_by_contents( transaction_id );
+        if( !cached_message || cached_message->msg_type != bts::client::trx_message_type )
+        {
+          missing_transaction = true;
+          break;
+        }
+        rebuilt_block_message.block.user_transactions.push_back( cached_message->as<bts::client::trx_message>().trx );
+      }
+
+      if( !missing_transaction )
+      {
+        message rebuilt_message( rebuilt_block_message );
+        const message_hash_type rebuilt_message_hash = rebuilt_message.id();
+        if( rebuilt_message_hash == requested_item.item_hash )
+        {
+          process_block_message( originating_peer, rebuilt_message, rebuilt_message_hash );
+          return;
+        }
+        wlog( "compact block ${block_id} from peer ${endpoint} does not rebuild the block I asked for",
+              ( "block_id", compact_block_message_received.block_id )( "endpoint", originating_peer->get_remote_endpoint() ) );
+      }
+
+      dlog( "can't rebuild compact block ${block_id} from my message cache, fetching the full block from ${endpoint}",
+            ( "block_id", compact_block_message_received.block_id )( "endpoint", originating_peer->get_remote_endpoint() ) );
+      originating_peer->items_requested_from_peer[ requested_item ] = fc::time_point::now();
+      schedule_timeout_check( originating_peer->shared_from_this(), fc::time_point::now() + fc::seconds(active_peer_ignored_request_timeout_sec()) );
+      originating_peer->send_message( fetch_items_message( bts::client::block_message_type,
+                                                           std::vector<item_hash_t>{ requested_item.item_hash } ) );
+    }
+
+    void node_impl::on_block_headers_message( peer_connection* originating_peer,
+                                              const bts::client::block_headers_message& block_headers_message_received )
+    {
+      VERIFY_CORRECT_THREAD();
+      if( originating_peer->block_headers_requested_from_peer.empty() )
+      {
+        wlog( "received block headers I didn't ask for from peer ${endpoint}, ignoring them",
+              ( "endpoint", originating_peer->get_remote_endpoint() ) );
+        return;
+      }
+      std::vector<item_hash_t> block_ids_requested;
+      std::swap( block_ids_requested, originating_peer->block_headers_requested_from_peer );
+      const std::vector<bts::blockchain::signed_block_header>& headers = block_headers_message_received.headers;
+
+      if( headers.size() > block_ids_requested.size() )
+      {
+        disconnect_from_peer( originating_peer, "You sent me more block headers than I asked for" );
+        return;
+      }
+
+      // find what the first header builds on: a header we've checked, or a block we already have.
+      // If it's neither (the peer switched forks, or the block is still being processed) we can't
+      // check this peer's headers, so fetch its blocks the old way
+      const item_hash_t parent_id = headers.empty() ? item_hash_t() : headers.front().previous;
+      uint32_t previous_block_number = 0;
+      fc::time_point_sec previous_block_time;
+      auto parent_iter = _validated_sync_block_headers.find( parent_id );
+      if( headers.empty() )
+        originating_peer->supports_block_headers = false;
+      else if( parent_iter != _validated_sync_block_headers.end() )
+      {
+        previous_block_number = parent_iter->second.block_num;
+        previous_block_time = parent_iter->second.timestamp;
+      }
+      else if( parent_id == item_hash_t() )
+        previous_block_time = _delegate->get_block_time( parent_id );
+      else if( _delegate->has_item( item_id( bts::client::block_message_type, parent_id ) ) )
+      {
+        previous_block_number = _delegate->get_block_number( parent_id );
+        previous_block_time = _delegate->get_block_time( parent_id );
+      }
+      else
+        originating_peer->supports_block_headers = false;
+
+      if( !originating_peer->supports_block_headers )
+      {
+        dlog( "can't check the block headers from peer ${endpoint}, fetching its sync blocks without them",
+              ( "endpoint", originating_peer->get_remote_endpoint() ) );
+        trigger_fetch_sync_items_loop();
+        return;
+      }
+
+      // we can't check the signees, which depend on the delegate list and keys as of each block, but we
+      // can make sure the peer offered us a well-formed chain before we download any of it
+      try
+      {
+        const fc::time_point_sec latest_plausible_block_time = _delegate->get_blockchain_now() + BTS_NET_FUTURE_SYNC_BLOCKS_GRACE_PERIOD_SEC;
+        item_hash_t previous_block_id = parent_id;
+        for( size_t i = 0; i < headers.size(); ++i )
+        {
+          const bts::blockchain::signed_block_header& header = headers[i];
+          FC_ASSERT( header.id() == block_ids_requested[i], "header is not for the block requested", ("block_id", block_ids_requested[i]) );
+          FC_ASSERT( header.previous == previous_block_id, "header does not follow the one before it", ("block_num", header.block_num) );
+          FC_ASSERT( header.block_num == previous_block_number + 1, "block numbers are not sequential", ("block_num", header.block_num) );
+          FC_ASSERT( header.timestamp.sec_since_epoch() % BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC == 0, "block time is not on a block interval", ("block_num", header.block_num) );
+          FC_ASSERT( header.block_num == 1 || header.timestamp > previous_block_time, "block time is not after the previous block's", ("block_num", header.block_num) );
+          FC_ASSERT( header.timestamp <= latest_plausible_block_time, "block time is in the future", ("block_num", header.block_num) );
+          header.signee(); // throws if the delegate signature is malformed
+          previous_block_id = block_ids_requested[i];
+          previous_block_number = header.block_num;
+          previous_block_time = header.timestamp;
+        }
+      }
+      catch ( const fc::exception& e )
+      {
+        wlog( "peer ${endpoint} sent me invalid block headers: ${e}",
+              ( "endpoint", originating_peer->get_remote_endpoint() )( "e", e.to_string() ) );
+        disconnect_from_peer( originating_peer, "You sent me invalid block headers", true, e );
+        return;
+      }
+
+      for( size_t i = 0; i < headers.size(); ++i )
+        _validated_sync_block_headers[ block_ids_requested[i] ] = headers[i];
+      dlog( "checked ${count} block headers from peer ${endpoint}",
+            ( "count", headers.size() )( "endpoint", originating_peer->get_remote_endpoint() ) );
+      trigger_fetch_sync_items_loop();
+    }
+
+    void node_impl::on_compressed_message( peer_connection* originating_peer,
+                                           const compressed_message& compressed_message_received )
+    {
+      VERIFY_CORRECT_THREAD();
+      message decompressed_message;
+      try
+      {
+        FC_ASSERT( compressed_message_received.msg_type != compressed_message::type, "compressed messages may not be nested" );
+        decompressed_message.msg_type = compressed_message_received.msg_type;
+        decompressed_message.data = compressed_message_received.decompress();
+        FC_ASSERT( decompressed_message.data.size() <= MAX_MESSAGE_SIZE, "decompressed message is larger than the maximum message size" );
+        decompressed_message.size = (uint32_t)decompressed_message.data.size();
+      }
+      catch ( const fc::exception& e )
+      {
+        wlog( "peer ${endpoint} sent me an invalid compressed message: ${e}",
+              ( "endpoint", originating_peer->get_remote_endpoint() )( "e", e.to_string() ) );
+        disconnect_from_peer( originating_peer, "You sent me an invalid compressed message", true, e );
+        return;
+      }
+      on_message( originating_peer, decompressed_message );
+    }
+
     void node_impl::process_block_message( peer_connection* originating_peer,
                                            const message& message_to_process,
                                            const message_hash_type& message_hash )
@@ -3083,7 +3986,7 @@ namespace bts { namespace net { namespace detail {
       if( item_iter != originating_peer->items_requested_from_peer.end() )
       {
         originating_peer->items_requested_from_peer.erase( item_iter );
-        process_block_during_normal_operation( originating_peer, block_message_to_process, message_hash );
+        process_block_during_normal_operation( originating_peer, message_to_process, block_message_to_process, message_hash );
         if (originating_peer->idle())
           trigger_fetch_items_loop();
         return;
@@ -3095,10 +3998,38 @@ namespace bts { namespace net { namespace detail {
                                                                                              block_message_to_process.block_id ) );
         if( sync_item_iter != originating_peer->sync_items_requested_from_peer.end() )
         {
+          // time per block: the first block of a batch counts from the request, the rest from the block before
+          const fc::time_point now = fc::time_point::now();
+          const fc::microseconds delivery_time = now - std::max(sync_item_iter->second, originating_peer->last_sync_block_received_time);
+          originating_peer->last_sync_block_received_time = now;
+          ++originating_peer->sync_blocks_received;
+          originating_peer->sync_block_delivery_time = smooth_sync_time(originating_peer->sync_block_delivery_time, delivery_time);
+          _sync_block_fetch_time = smooth_sync_time(_sync_block_fetch_time, delivery_time);
+
           originating_peer->sync_items_requested_from_peer.erase( sync_item_iter );
           _active_sync_requests.erase(block_message_to_process.block_id);
+          // the fetch loop tops the peer's window up once half of it has arrived
+          const bool sync_request_window_half_drained = originating_peer->idle() ||
+              originating_peer->sync_items_requested_from_peer.size() == originating_peer->sync_request_window / 2;
+
+          // a stalled block is requested from a second peer, so both copies may arrive
+          bool already_have_block = have_already_received_sync_item(block_message_to_process.block_id) ||
+                                    std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
+                                              block_message_to_process.block_id) != _most_recent_blocks_accepted.end();
+          for (const peer_connection_ptr& peer : _active_connections)
+            if (peer->ids_of_items_being_processed.find(block_message_to_process.block_id) != peer->ids_of_items_being_processed.end())
+              already_have_block = true;
+          if( already_have_block )
+          {
+            dlog( "received sync block ${block_id} again from peer ${endpoint}, dropping the duplicate",
+                  ("block_id", block_message_to_process.block_id)("endpoint", originating_peer->get_remote_endpoint()) );
+            if (sync_request_window_half_drained)
+              trigger_fetch_sync_items_loop();
+            return;
+          }
+
           process_block_during_sync( originating_peer, block_message_to_process, message_hash );
-          if (originating_peer->idle())
+          if (sync_request_window_half_drained)
             trigger_fetch_sync_items_loop();
           return;
         }
@@ -3255,35 +4186,60 @@ namespace bts { namespace net { namespace detail {
         if (originating_peer->idle())
           trigger_fetch_items_loop();
 
-        // Next: have the delegate process the message
-        fc::time_point message_validated_time;
-        try
+        // Next: have the delegate process the message.  That can take a while, so several are
+        // validated at once in their own tasks while we go on handling other peers' messages
+        for (auto validation_iter = _transaction_validations_in_progress.begin();
+             validation_iter != _transaction_validations_in_progress.end();)
         {
-          _delegate->handle_message(message_to_process, false);
-          message_validated_time = fc::time_point::now();
-        }
-        catch ( const insufficient_relay_fee& )
-        {
-          // flooding control.  The message was valid but we can't handle it now.
-          assert(message_to_process.msg_type == bts::client::trx_message_type); // we only support throttling transactions.
-          if (message_to_process.msg_type == bts::client::trx_message_type)
-            originating_peer->transaction_fetching_inhibited_until = fc::time_point::now() + fc::seconds(BTS_NET_INSUFFICIENT_RELAY_FEE_PENALTY_SEC);
-          return;
-        }
-        catch ( const fc::canceled_exception& )
-        {
-          throw;
+          if (validation_iter->ready())
+            validation_iter = _transaction_validations_in_progress.erase(validation_iter);
+          else
+            ++validation_iter;
         }
-        catch ( const fc::exception& e )
+        if (_transaction_validations_in_progress.size() >= BTS_NET_MAX_CONCURRENT_TRANSACTION_VALIDATIONS)
         {
-          wlog( "client rejected message sent by peer ${peer}, ${e}", ("peer", originating_peer->get_remote_endpoint() )("e", e.to_string() ) );
-          return;
+          _transaction_validations_in_progress.front().wait();
+          _transaction_validations_in_progress.pop_front();
         }
 
-        // finally, if the delegate validated the message, broadcast it to our other peers
-        message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
-        broadcast( message_to_process, propagation_data );
+        peer_connection_ptr originating_peer_ptr = originating_peer->shared_from_this();
+        _transaction_validations_in_progress.emplace_back(fc::async([this, originating_peer_ptr, message_to_process, message_receive_time](){
+          validate_ordinary_message(originating_peer_ptr, message_to_process, message_receive_time);
+        }, "validate_ordinary_message"));
+      }
+    }
+
+    void node_impl::validate_ordinary_message( const peer_connection_ptr& originating_peer,
+                                               const message& message_to_process, const fc::time_point& message_receive_time )
+    {
+      VERIFY_CORRECT_THREAD();
+      fc::time_point message_validated_time;
+      try
+      {
+        _delegate->handle_message(message_to_process, false);
+        message_validated_time = fc::time_point::now();
+      }
+      catch ( const insufficient_relay_fee& )
+      {
+        // flooding control.  The message was valid but we can't handle it now.
+        assert(message_to_process.msg_type == bts::client::trx_message_type); // we only support throttling transactions.
+        if (message_to_process.msg_type == bts::client::trx_message_type)
+          originating_peer->transaction_fetching_inhibited_until = fc::time_point::now() + fc::seconds(BTS_NET_INSUFFICIENT_RELAY_FEE_PENALTY_SEC);
+        return;
+      }
+      catch ( const fc::canceled_exception& )
+      {
+        throw;
+      }
+      catch ( const fc::exception& e )
+      {
+        wlog( "client rejected message sent by peer ${peer}, ${e}", ("peer", originating_peer->get_remote_endpoint() )("e", e.to_string() ) );
+        return;
       }
+
+      // finally, if the delegate validated the message, broadcast it to our other peers
+      message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
+      broadcast( message_to_process, propagation_data );
     }
 
     void node_impl::start_synchronizing_with_peer( const peer_connection_ptr& peer )
@@ -3308,6 +4264,13 @@ namespace bts { namespace net { namespace detail {
     void node_impl::new_peer_just_added( const peer_connection_ptr& peer )
     {
       VERIFY_CORRECT_THREAD();
+      // until it delivers sync blocks on this connection, rank it for syncing by how it did last time
+      if( peer->get_remote_endpoint() )
+      {
+        fc::optional<potential_peer_record> peer_record = _potential_peer_db.lookup_entry_for_endpoint( *peer->get_remote_endpoint() );
+        if( peer_record && peer->sync_block_delivery_time.count() == 0 )
+          peer->sync_block_delivery_time = peer_record->sync_block_delivery_time;
+      }
       peer->send_message(current_time_request_message(), 
                          offsetof(current_time_request_message, request_sent_time));
       start_synchronizing_with_peer( peer );
@@ -3373,6 +4336,24 @@ namespace bts { namespace net { namespace detail {
         wlog( "Exception thrown while terminating P2P connect loop, ignoring" );
       }
 
+      try
+      {
+        _process_received_messages_done.cancel_and_wait("node_impl::close()");
+        dlog("Process received messages task terminated");
+      }
+      catch ( const fc::canceled_exception& )
+      {
+        dlog("Process received messages task terminated");
+      }
+      catch ( const fc::exception& e )
+      {
+        wlog( "Exception thrown while terminating Process received messages task, ignoring: ${e}", ("e",e) );
+      }
+      catch (...)
+      {
+        wlog( "Exception thrown while terminating Process received messages task, ignoring" );
+      }
+
       try
       {
         _process_backlog_of_sync_blocks_done.cancel_and_wait("node_impl::close()");
@@ -3415,6 +4396,27 @@ namespace bts { namespace net { namespace detail {
       }
       _handle_message_calls_in_progress.clear();
 
+      for (fc::future<void>& transaction_validation : _transaction_validations_in_progress)
+      {
+        try
+        {
+          transaction_validation.cancel_and_wait("node_impl::close()");
+        }
+        catch ( const fc::canceled_exception& )
+        {
+        }
+        catch ( const fc::exception& e )
+        {
+          wlog("Exception thrown while terminating transaction validation task, ignoring: ${e}", ("e",e));
+        }
+        catch (...)
+        {
+          wlog("Exception thrown while terminating transaction validation task, ignoring");
+        }
+      }
+      _transaction_validations_in_progress.clear();
+      dlog("Transaction validation tasks terminated");
+
       try
       {
         _fetch_sync_items_loop_done.cancel("node_impl::close()");
@@ -3487,6 +4489,7 @@ namespace bts { namespace net { namespace detail {
       std::list<peer_connection_ptr> all_peers;
       boost::push_back(all_peers, _active_connections);
       boost::push_back(all_peers, _handshaking_connections);
+      boost::push_back(all_peers, _unverified_inbound_connections);
       boost::push_back(all_peers, _closing_connections);
 
       for (const peer_connection_ptr& peer : all_peers)
@@ -3508,6 +4511,8 @@ namespace bts { namespace net { namespace detail {
       // and delete all of the peer_connection objects
       _active_connections.clear();
       _handshaking_connections.clear();
+      _unverified_inbound_connections.clear();
+      _peer_timeout_checks.clear();
       _closing_connections.clear();
       all_peers.clear();
 
@@ -3576,6 +4581,15 @@ namespace bts { namespace net { namespace detail {
         wlog( "Exception thrown while terminating Bandwidth monitor loop, ignoring" );
       }
 
+      try
+      {
+        _stall_heartbeat_done.cancel_and_wait("node_impl::close()");
+      }
+      catch ( const fc::exception& e )
+      {
+        wlog( "Exception thrown while terminating stall heartbeat, ignoring: ${e}", ("e",e) );
+      }
+
       try
       {
         _dump_node_status_task_done.cancel_and_wait("node_impl::close()");
@@ -3591,10 +4605,36 @@ namespace bts { namespace net { namespace detail {
       }
     } // node_impl::close()
 
+    /** the handshake threads are started on first use and handed out round robin */
+    fc::thread& node_impl::next_handshake_thread()
+    {
+      VERIFY_CORRECT_THREAD();
+      if( _handshake_threads.empty() )
+        for( unsigned i = 0; i < BTS_NET_HANDSHAKE_THREADS; ++i )
+          _handshake_threads.emplace_back( new fc::thread( "p2p_handshake_" + std::to_string(i) ) );
+      fc::thread& handshake_thread = *_handshake_threads[_next_handshake_thread];
+      _next_handshake_thread = (_next_handshake_thread + 1) % _handshake_threads.size();
+      return handshake_thread;
+    }
+
     void node_impl::accept_connection_task( peer_connection_ptr new_peer )
     {
       VERIFY_CORRECT_THREAD();
-      new_peer->accept_connection(); // this blocks until the secure connection is fully negotiated
+      try
+      {
+        new_peer->accept_connection( &next_handshake_thread() ); // this blocks until the secure connection is fully negotiated
+      }
+      catch ( const fc::exception& e )
+      {
+        // the key exchange failed or we gave up on it; the read loop never started, so no one else will clean up
+        wlog( "Failed to negotiate a secure connection with inbound peer ${peer}: ${e}",
+              ( "peer", new_peer->get_remote_endpoint() )( "e", e ) );
+        _unverified_inbound_connections.erase( new_peer );
+        _terminating_connections.erase( new_peer );
+        _rate_limiter.remove_tcp_socket( &new_peer->get_socket() );
+        schedule_peer_for_deletion( new_peer );
+        throw;
+      }
       send_hello_message( new_peer );
     }
 
@@ -3611,8 +4651,16 @@ namespace bts { namespace net { namespace detail {
           ilog( "accepted inbound connection from ${remote_endpoint}", ("remote_endpoint", new_peer->get_socket().remote_endpoint() ) );
           if (_node_is_shutting_down)
             return;
+          if( _unverified_inbound_connections.size() >= BTS_NET_MAX_UNVERIFIED_INBOUND_CONNECTIONS )
+          {
+            wlog( "Refusing inbound connection from ${remote_endpoint}, ${count} connections are already handshaking",
+                  ("remote_endpoint", new_peer->get_socket().remote_endpoint())("count", _unverified_inbound_connections.size()) );
+            new_peer->get_socket().close();
+            continue;
+          }
           new_peer->connection_initiation_time = fc::time_point::now();
-          _handshaking_connections.insert( new_peer );
+          _unverified_inbound_connections.insert( new_peer );
+          schedule_timeout_check( new_peer, new_peer->connection_initiation_time + fc::seconds(BTS_NET_INBOUND_HANDSHAKE_TIMEOUT_SEC) );
           _rate_limiter.add_tcp_socket( &new_peer->get_socket() );
           std::weak_ptr<peer_connection> new_weak_peer(new_peer);
           new_peer->accept_or_connect_task_done = fc::async( [this, new_weak_peer]() {
@@ -3967,7 +5015,8 @@ namespace bts { namespace net { namespace detail {
              !_terminate_inactive_connections_loop_done.valid() &&
              !_fetch_updated_peer_lists_loop_done.valid() &&
              !_bandwidth_monitor_loop_done.valid() &&
-             !_dump_node_status_task_done.valid());
+             !_dump_node_status_task_done.valid() &&
+             !_stall_heartbeat_done.valid());
       if (_node_configuration.accept_incoming_connections)
         _accept_loop_complete = fc::async( [=](){ accept_loop(); }, "accept_loop");
       _p2p_network_connect_loop_done = fc::async( [=]() { p2p_network_connect_loop(); }, "p2p_network_connect_loop" );
@@ -3978,6 +5027,7 @@ namespace bts { namespace net { namespace detail {
       _fetch_updated_peer_lists_loop_done = fc::async([=](){ fetch_updated_peer_lists_loop(); }, "fetch_updated_peer_lists_loop");
       _bandwidth_monitor_loop_done = fc::async([=](){ bandwidth_monitor_loop(); }, "bandwidth_monitor_loop");
       _dump_node_status_task_done = fc::async([=](){ dump_node_status_task(); }, "dump_node_status_task");
+      _stall_heartbeat_done = fc::async([](){ bts::utilities::stall_detector::instance().heartbeat_loop( fc::milliseconds(100) ); }, "stall_heartbeat");
     }
 
     void node_impl::add_node(const fc::ip::endpoint& ep)
@@ -4008,6 +5058,7 @@ namespace bts { namespace net { namespace detail {
       new_peer->set_remote_endpoint( remote_endpoint );
       new_peer->connection_initiation_time = fc::time_point::now();
       _handshaking_connections.insert( new_peer );
+      schedule_timeout_check( new_peer, new_peer->connection_initiation_time + fc::seconds(_peer_inactivity_timeout) );
       _rate_limiter.add_tcp_socket( &new_peer->get_socket() );
 
       if (_node_is_shutting_down)
@@ -4050,8 +5101,10 @@ namespace bts { namespace net { namespace detail {
     void node_impl::move_peer_to_active_list(const peer_connection_ptr& peer)
     {
       VERIFY_CORRECT_THREAD();
+      schedule_timeout_check(peer, fc::time_point::now());
       _active_connections.insert(peer);
       _handshaking_connections.erase(peer);
+      _unverified_inbound_connections.erase(peer);
       _closing_connections.erase(peer);
       _terminating_connections.erase(peer);
     }
@@ -4059,8 +5112,10 @@ namespace bts { namespace net { namespace detail {
     void node_impl::move_peer_to_closing_list(const peer_connection_ptr& peer)
     {
       VERIFY_CORRECT_THREAD();
+      schedule_timeout_check(peer, fc::time_point::now());
       _active_connections.erase(peer);
       _handshaking_connections.erase(peer);
+      _unverified_inbound_connections.erase(peer);
       _closing_connections.insert(peer);
       _terminating_connections.erase(peer);
     }
@@ -4068,8 +5123,10 @@ namespace bts { namespace net { namespace detail {
     void node_impl::move_peer_to_terminating_list(const peer_connection_ptr& peer)
     {
       VERIFY_CORRECT_THREAD();
+      schedule_timeout_check(peer, fc::time_point::now());
       _active_connections.erase(peer);
       _handshaking_connections.erase(peer);
+      _unverified_inbound_connections.erase(peer);
       _closing_connections.erase(peer);
       _terminating_connections.insert(peer);
     }
@@ -4097,6 +5154,8 @@ namespace bts { namespace net { namespace detail {
         ilog( "  handshaking peer ${endpoint} in state ours(${our_state}) theirs(${their_state})",
              ( "endpoint", peer->get_remote_endpoint() )("our_state", peer->our_state )("their_state", peer->their_state ) );
       }
+      for( const peer_connection_ptr& peer : _unverified_inbound_connections )
+        ilog( "   unverified peer ${endpoint}", ( "endpoint", peer->get_remote_endpoint() ) );
 
       ilog( "--------- MEMORY USAGE ------------" );
       ilog( "node._active_sync_requests size: ${size}", ("size", _active_sync_requests.size() ) ); // TODO: un-break this
@@ -4275,6 +5334,8 @@ namespace bts { namespace net { namespace detail {
 
         if (peer->platform)
           peer_details["platform"] = *peer->platform;
+        if (peer->first_full_block_number > 1)
+          peer_details["first_full_block_number"] = peer->first_full_block_number;
         
         // provide these for debugging
         // warning: these are just approximations, if the peer is "downstream" of us, they may
@@ -4283,6 +5344,32 @@ namespace bts { namespace net { namespace detail {
         peer_details["current_head_block"] = peer->last_block_delegate_has_seen;
         peer_details["current_head_block_time"] = peer->last_block_time_delegate_has_seen;
 
+        // performance, for spotting slow peers.  Times are in microseconds, message counts are keyed by msg_type
+        peer_details["round_trip_delay"] = peer->round_trip_delay.count();
+        peer_details["clock_offset"] = peer->clock_offset.count();
+        peer_details["queued_message_count"] = peer->get_queued_message_count();
+        peer_details["received_messages_queued"] = peer->received_messages_queued;
+        peer_details["queued_message_bytes"] = peer->get_total_queued_messages_size();
+        peer_details["oldest_queued_message_age"] = peer->get_oldest_queued_message_age().count();
+        peer_details["blocks_served"] = peer->blocks_served;
+        peer_details["blocks_delivered_first"] = peer->blocks_delivered_first;
+        peer_details["sync_blocks_received"] = peer->sync_blocks_received;
+        peer_details["sync_block_delivery_time"] = peer->sync_block_delivery_time.count();
+        peer_details["sync_request_window"] = peer->sync_request_window;
+        const auto counts_by_type = [](const std::map<uint32_t, peer_connection::message_counts>& counts) {
+          fc::mutable_variant_object counts_object;
+          for (const auto& type_and_counts : counts)
+          {
+            fc::mutable_variant_object type_counts;
+            type_counts["messages"] = type_and_counts.second.messages;
+            type_counts["bytes"] = type_and_counts.second.bytes;
+            counts_object[std::to_string(type_and_counts.first)] = type_counts;
+          }
+          return counts_object;
+        };
+        peer_details["messages_sent"] = counts_by_type(peer->messages_sent_by_type);
+        peer_details["messages_received"] = counts_by_type(peer->messages_received_by_type);
+
         this_peer_status.info = peer_details;
         statuses.push_back(this_peer_status);
       }
@@ -4304,12 +5391,19 @@ namespace bts { namespace net { namespace detail {
         bts::client::block_message block_message_to_broadcast = item_to_broadcast.as<bts::client::block_message>();
         hash_of_message_contents = block_message_to_broadcast.block_id; // for debugging
         _most_recent_blocks_accepted.push_back( block_message_to_broadcast.block_id );
+
+        block_propagation_trace& trace = trace_block( item_to_broadcast.id() );
+        trace.block_id = block_message_to_broadcast.block_id;
+        trace.block_timestamp = block_message_to_broadcast.block.timestamp;
+        trace.data.received_time = propagation_data.received_time;
+        trace.data.validated_time = propagation_data.validated_time;
+        trace.data.originating_peer = propagation_data.originating_peer;
       }
       else if( item_to_broadcast.msg_type == bts::client::trx_message_type )
       {
         bts::client::trx_message transaction_message_to_broadcast = item_to_broadcast.as<bts::client::trx_message>();
         hash_of_message_contents = transaction_message_to_broadcast.trx.id(); // for debugging
-        dlog( "broadcasting trx: ${trx}", ("trx", transaction_message_to_broadcast) );
+        hot_dlog( "broadcasting trx: ${trx}", ("trx", transaction_message_to_broadcast) );
       }
       message_hash_type hash_of_item_to_broadcast = item_to_broadcast.id();
 
@@ -4326,6 +5420,28 @@ namespace bts { namespace net { namespace detail {
       broadcast( item_to_broadcast, propagation_data );
     }
 
+    std::vector<item_id> node_impl::get_items_peers_may_lack(const std::vector<item_id>& items) const
+    {
+      VERIFY_CORRECT_THREAD();
+      std::vector<item_id> result;
+      for( const item_id& item : items )
+      {
+        bool some_peer_may_lack_item = true;
+        for( const peer_connection_ptr& peer : _active_connections )
+        {
+          if( peer->peer_needs_sync_items_from_us )
+            continue;
+          some_peer_may_lack_item = !peer->inventory_advertised_to_peer.contains(item) &&
+                                    peer->inventory_peer_advertised_to_us.find(item) == peer->inventory_peer_advertised_to_us.end();
+          if( some_peer_may_lack_item )
+            break;
+        }
+        if( some_peer_may_lack_item )
+          result.push_back(item);
+      }
+      return result;
+    }
+
     void node_impl::sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers)
     {
       VERIFY_CORRECT_THREAD();
@@ -4366,6 +5482,10 @@ namespace bts { namespace net { namespace detail {
         _maximum_number_of_sync_blocks_to_prefetch = params["maximum_number_of_sync_blocks_to_prefetch"].as<uint32_t>();
       if (params.contains("maximum_blocks_per_peer_during_syncing"))
         _maximum_blocks_per_peer_during_syncing = params["maximum_blocks_per_peer_during_syncing"].as<uint32_t>();
+      if (params.contains("fast_block_relay"))
+        _fast_block_relay = params["fast_block_relay"].as<bool>();
+
+      _traffic_shaper.set_parameters(params);
 
       _desired_number_of_connections = std::min(_desired_number_of_connections, _maximum_number_of_connections);
 
@@ -4388,6 +5508,9 @@ namespace bts { namespace net { namespace detail {
         result["maximum_number_of_sync_blocks_to_prefetch"] = _maximum_number_of_sync_blocks_to_prefetch;
       if (_maximum_blocks_per_peer_during_syncing != BTS_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING)
       result["maximum_blocks_per_peer_during_syncing"] = _maximum_blocks_per_peer_during_syncing;
+      result["fast_block_relay"] = _fast_block_relay;
+      for (const fc::variant_object::entry& traffic_class_parameter : _traffic_shaper.get_parameters())
+        result[traffic_class_parameter.key()] = traffic_class_parameter.value();
       return result;
     }
 
@@ -4400,9 +5523,67 @@ namespace bts { namespace net { namespace detail {
     message_propagation_data node_impl::get_block_propagation_data( const bts::blockchain::block_id_type& block_id )
     {
       VERIFY_CORRECT_THREAD();
+      for( const auto& hash_and_trace : _block_propagation_traces )
+        if( hash_and_trace.second.block_id == block_id )
+          return hash_and_trace.second.data;
       return _message_cache.get_message_propagation_data( block_id );
     }
 
+    fc::variant_object node_impl::get_block_propagation_statistics()
+    {
+      VERIFY_CORRECT_THREAD();
+      // ignore a step whose start or end wasn't recorded
+      std::map<std::string, std::vector<int64_t> > durations_by_step;
+      const auto add_duration = [&]( const char* step, const fc::time_point& start, const fc::time_point& end ) {
+        if( start != fc::time_point() && end != fc::time_point() )
+          durations_by_step[step].push_back( ( end - start ).count() );
+      };
+      for( const auto& hash_and_trace : _block_propagation_traces )
+      {
+        const block_propagation_trace& trace = hash_and_trace.second;
+        const fc::time_point produced_time = trace.block_timestamp == fc::time_point_sec() ? fc::time_point() : fc::time_point( trace.block_timestamp );
+        add_duration( "produced_to_first_inventory", produced_time, trace.data.first_inventory_time );
+        add_duration( "first_inventory_to_fetch_requested", trace.data.first_inventory_time, trace.data.fetch_requested_time );
+        add_duration( "fetch_requested_to_received", trace.data.fetch_requested_time, trace.data.received_time );
+        add_duration( "validation", trace.data.validation_start_time, trace.data.validated_time );
+        add_duration( "validated_to_first_relay", trace.data.validated_time, trace.data.first_relay_time );
+        add_duration( "produced_to_validated", produced_time, trace.data.validated_time );
+        add_duration( "produced_to_first_relay", produced_time, trace.data.first_relay_time );
+      }
+
+      fc::mutable_variant_object statistics;
+      statistics["_note"] = "All times are in microseconds; produced times are block timestamps, so they include any clock difference with the producer";
+      for( auto& step_and_durations : durations_by_step )
+      {
+        std::vector<int64_t>& durations = step_and_durations.second;
+        std::sort( durations.begin(), durations.end() );
+        const auto percentile = [&]( unsigned p ) { return durations[ ( durations.size() - 1 ) * p / 100 ]; };
+        fc::mutable_variant_object step_statistics;
+        step_statistics["count"] = durations.size();
+        step_statistics["p50"] = percentile( 50 );
+        step_statistics["p90"] = percentile( 90 );
+        step_statistics["p99"] = percentile( 99 );
+        step_statistics["max"] = durations.back();
+        statistics[step_and_durations.first] = step_statistics;
+      }
+      return statistics;
+    }
+
+    node_impl::block_propagation_trace& node_impl::trace_block( const message_hash_type& message_hash )
+    {
+      VERIFY_CORRECT_THREAD();
+      auto iter = _block_propagation_traces.find( message_hash );
+      if( iter != _block_propagation_traces.end() )
+        return iter->second;
+      if( _block_propagation_trace_order.size() >= BTS_NET_BLOCK_PROPAGATION_TRACE_COUNT )
+      {
+        _block_propagation_traces.erase( _block_propagation_trace_order.front() );
+        _block_propagation_trace_order.pop_front();
+      }
+      _block_propagation_trace_order.push_back( message_hash );
+      return _block_propagation_traces[ message_hash ];
+    }
+
     node_id_t node_impl::get_node_id() const
     {
       VERIFY_CORRECT_THREAD();
@@ -4433,6 +5614,7 @@ namespace bts { namespace net { namespace detail {
     {
       VERIFY_CORRECT_THREAD();
       _rate_limiter.set_upload_limit( upload_bytes_per_second );
+      _traffic_shaper.set_total_rate( upload_bytes_per_second );
       _rate_limiter.set_download_limit( download_bytes_per_second );
     }
 
@@ -4488,6 +5670,76 @@ namespace bts { namespace net { namespace detail {
       return result;
     }
 
+    fc::variant_object node_impl::get_sync_stats() const
+    {
+      VERIFY_CORRECT_THREAD();
+      uint64_t blocks_requested = 0;
+      fc::variants peers;
+      for( const peer_connection_ptr& peer : _active_connections )
+      {
+        blocks_requested += peer->sync_items_requested_from_peer.size();
+        if( peer->sync_blocks_received == 0 && peer->sync_items_requested_from_peer.empty() )
+          continue;
+        fc::mutable_variant_object peer_stats;
+        peer_stats["endpoint"] = peer->get_remote_endpoint();
+        peer_stats["blocks_received"] = peer->sync_blocks_received;
+        peer_stats["blocks_requested"] = peer->sync_items_requested_from_peer.size();
+        peer_stats["block_delivery_time_us"] = peer->sync_block_delivery_time.count();
+        peers.emplace_back( std::move( peer_stats ) );
+      }
+
+      fc::mutable_variant_object per_block;
+      per_block["fetch_us"] = _sync_block_fetch_time.count();
+      per_block["backlog_wait_us"] = _sync_block_backlog_wait_time.count();
+      per_block["handling_us"] = _sync_block_handling_time.count();
+
+      fc::mutable_variant_object queues;
+      queues["blocks_requested"] = blocks_requested;
+      queues["blocks_waiting_for_earlier_blocks"] = _new_received_sync_items.size() + _received_sync_items.size();
+      queues["blocks_being_handled"] = _handle_message_calls_in_progress.size();
+
+      fc::mutable_variant_object result;
+      result["blocks_handled"] = _sync_blocks_handled;
+      result["per_block"] = per_block;
+      result["queues"] = queues;
+      result["peers"] = peers;
+      return result;
+    }
+
+    fc::variant_object node_impl::get_memory_stats() const
+    {
+      VERIFY_CORRECT_THREAD();
+      uint64_t sync_backlog_bytes = 0;
+      for( const bts::client::block_message& block : _new_received_sync_items )
+        sync_backlog_bytes += fc::raw::pack_size( block.block );
+      for( const auto& item : _received_sync_items )
+        sync_backlog_bytes += fc::raw::pack_size( item.second.block );
+
+      fc::mutable_variant_object send_queues;
+      uint64_t send_queue_bytes = 0;
+      for( const std::unordered_set<peer_connection_ptr>* connections : { &_handshaking_connections, &_active_connections } )
+        for( const peer_connection_ptr& peer : *connections )
+        {
+          const size_t queued_bytes = peer->get_total_queued_messages_size();
+          send_queue_bytes += queued_bytes;
+          const fc::optional<fc::ip::endpoint> endpoint = peer->get_remote_endpoint();
+          if( queued_bytes > 0 && endpoint )
+            send_queues[ std::string( *endpoint ) ] = queued_bytes;
+        }
+
+      const uint64_t message_cache_bytes = _message_cache.memory_usage();
+      fc::mutable_variant_object result;
+      result["message_cache_entries"] = _message_cache.size();
+      result["message_cache_bytes"] = message_cache_bytes;
+      result["sync_backlog_blocks"] = _new_received_sync_items.size() + _received_sync_items.size();
+      result["sync_backlog_bytes"] = sync_backlog_bytes;
+      result["items_to_fetch"] = _items_to_fetch.size();
+      result["send_queue_bytes"] = send_queue_bytes;
+      result["send_queues"] = send_queues;
+      result["total_bytes"] = message_cache_bytes + sync_backlog_bytes + send_queue_bytes;
+      return result;
+    }
+
     bool node_impl::is_hard_fork_block(uint32_t block_number) const
     {
       return std::binary_search(_hard_fork_block_numbers.begin(), _hard_fork_block_numbers.end(), block_number);
@@ -4594,6 +5846,11 @@ namespace bts { namespace net { namespace detail {
     INVOKE_IN_IMPL(broadcast, msg);
   }
 
+  std::vector<item_id> node::get_items_peers_may_lack( const std::vector<item_id>& items ) const
+  {
+    INVOKE_IN_IMPL(get_items_peers_may_lack, items);
+  }
+
   void node::sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers)
   {
     INVOKE_IN_IMPL(sync_from, current_head_block, hard_fork_block_numbers);
@@ -4629,6 +5886,11 @@ namespace bts { namespace net { namespace detail {
     INVOKE_IN_IMPL(get_block_propagation_data, block_id);
   }
 
+  fc::variant_object node::get_block_propagation_statistics()
+  {
+    INVOKE_IN_IMPL(get_block_propagation_statistics);
+  }
+
   node_id_t node::get_node_id() const
   {
     INVOKE_IN_IMPL(get_node_id);
@@ -4670,6 +5932,16 @@ namespace bts { namespace net { namespace detail {
     INVOKE_IN_IMPL(network_get_usage_stats);
   }
 
+  fc::variant_object node::get_memory_stats() const
+  {
+    INVOKE_IN_IMPL(get_memory_stats);
+  }
+
+  fc::variant_object node::get_sync_stats() const
+  {
+    INVOKE_IN_IMPL(get_sync_stats);
+  }
+
   void node::close()
   {
     wlog( ".... WARNING NOT DOING ANYTHING WHEN I SHOULD ......" );
@@ -4682,9 +5954,41 @@ namespace bts { namespace net { namespace detail {
     node_delegate* delegate;
     fc::future<void> message_sender_task_done;
     std::queue<message> messages_to_deliver;
+
+    struct link_state
+    {
+      node_info*       destination;
+      simulated_link   properties;
+      fc::microseconds busy_until; /// when the message last sent over it has been transmitted
+    };
+    std::vector<link_state> links;
+    std::set<message_hash_type> messages_seen;
+
     node_info(node_delegate* delegate) : delegate(delegate) {}
   };
 
+  struct simulated_network::scheduled_delivery
+  {
+    fc::microseconds arrival_time;
+    uint64_t         sequence; /// keeps deliveries arriving at the same time in the order they were sent
+    node_info*       sender;
+    node_info*       destination;
+    message          item;
+    bool             relay;
+
+    /** for std::push_heap, which keeps the greatest element first */
+    bool operator<(const scheduled_delivery& other) const
+    {
+      return std::tie(arrival_time, sequence) > std::tie(other.arrival_time, other.sequence);
+    }
+  };
+
+  simulated_network::simulated_network(const std::string& user_agent) :
+    node(user_agent),
+    connection_count(8),
+    next_delivery_sequence(0)
+  {}
+
   simulated_network::~simulated_network()
   {
     for( node_info* network_node_info : network_nodes )
@@ -4726,6 +6030,114 @@ namespace bts { namespace net { namespace detail {
     network_nodes.push_back(new node_info(node_delegate_to_add));
   }
 
+  simulated_network::node_info* simulated_network::find_node( node_delegate* delegate ) const
+  {
+    for (node_info* network_node_info : network_nodes)
+      if (network_node_info->delegate == delegate)
+        return network_node_info;
+    FC_THROW("node delegate is not part of the simulated network");
+  }
+
+  void simulated_network::connect_node_delegates( node_delegate* a, node_delegate* b, const simulated_link& link )
+  {
+    node_info* a_info = find_node(a);
+    node_info* b_info = find_node(b);
+    a_info->links.push_back(node_info::link_state{b_info, link, fc::microseconds()});
+    b_info->links.push_back(node_info::link_state{a_info, link, fc::microseconds()});
+  }
+
+  void simulated_network::set_random_seed( uint32_t seed )
+  {
+    random_generator.seed(seed);
+  }
+
+  void simulated_network::schedule( node_info* from, node_info* to, const message& item, fc::microseconds send_time, bool relay )
+  {
+    auto link = std::find_if(from->links.begin(), from->links.end(),
+                             [to](const node_info::link_state& state) { return state.destination == to; });
+    FC_ASSERT(link != from->links.end(), "node delegates are not linked");
+
+    // messages queue behind each other for the link's bandwidth, then travel for its latency
+    fc::microseconds transmit_time;
+    if (link->properties.bytes_per_second)
+      transmit_time = fc::microseconds((sizeof(message_header) + item.size) * 1000000 / link->properties.bytes_per_second);
+    const fc::microseconds start_time = std::max(send_time, link->busy_until);
+    link->busy_until = start_time + transmit_time;
+    fc::microseconds arrival_time = link->busy_until + link->properties.latency;
+    std::uniform_real_distribution<double> lost(0, 1);
+    while (lost(random_generator) < link->properties.loss_rate)
+      arrival_time += link->properties.latency + link->properties.latency + transmit_time;
+
+    scheduled_deliveries.push_back(scheduled_delivery{arrival_time, next_delivery_sequence++, from, to, item, relay});
+    std::push_heap(scheduled_deliveries.begin(), scheduled_deliveries.end());
+  }
+
+  void simulated_network::broadcast_from( node_delegate* origin, const message& item_to_broadcast )
+  {
+    node_info* origin_info = find_node(origin);
+    const message_hash_type message_id = item_to_broadcast.id();
+    origin_info->messages_seen.insert(message_id);
+    broadcast_times[message_id] = simulated_time;
+    for (const node_info::link_state& link : origin_info->links)
+      schedule(origin_info, link.destination, item_to_broadcast, simulated_time, true);
+  }
+
+  void simulated_network::send_to( node_delegate* from, node_delegate* to, const message& item_to_send )
+  {
+    schedule(find_node(from), find_node(to), item_to_send, simulated_time, false);
+  }
+
+  void simulated_network::deliver( const scheduled_delivery& delivery )
+  {
+    node_info* destination = delivery.destination;
+    const message_hash_type message_id = delivery.item.id();
+    if (delivery.relay && !destination->messages_seen.insert(message_id).second)
+      return;
+
+    const fc::time_point handling_start = fc::time_point::now();
+    try
+    {
+      destination->delegate->handle_message(delivery.item, !delivery.relay);
+    }
+    catch ( const fc::exception& e )
+    {
+      elog( "${r}", ("r",e.to_detail_string() ) );
+      return;
+    }
+    // the destination can't send anything on until it has finished with the message
+    const fc::microseconds handled_time = simulated_time + (fc::time_point::now() - handling_start);
+
+    auto broadcast_time = broadcast_times.find(message_id);
+    if (broadcast_time != broadcast_times.end())
+      delivery_delays[message_id].push_back(simulated_time - broadcast_time->second);
+
+    if (delivery.relay)
+      for (const node_info::link_state& link : destination->links)
+        if (link.destination != delivery.sender)
+          schedule(destination, link.destination, delivery.item, handled_time, true);
+  }
+
+  fc::microseconds simulated_network::run()
+  {
+    while (!scheduled_deliveries.empty())
+    {
+      std::pop_heap(scheduled_deliveries.begin(), scheduled_deliveries.end());
+      scheduled_delivery delivery = std::move(scheduled_deliveries.back());
+      scheduled_deliveries.pop_back();
+      simulated_time = std::max(simulated_time, delivery.arrival_time);
+      deliver(delivery);
+    }
+    return simulated_time;
+  }
+
+  std::vector<fc::microseconds> simulated_network::get_delivery_delays( const message_hash_type& message_id ) const
+  {
+    auto delays = delivery_delays.find(message_id);
+    if (delays == delivery_delays.end())
+      return std::vector<fc::microseconds>();
+    return delays->second;
+  }
+
   namespace detail
   {
 #define ROLLING_WINDOW_SIZE 1000
@@ -4798,6 +6210,16 @@ namespace bts { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(handle_message, message_to_handle, sync_mode);
     }
 
+    void statistics_gathering_node_delegate_wrapper::pre_validate_message( const message& message_to_validate )
+    {
+      INVOKE_AND_COLLECT_STATISTICS(pre_validate_message, message_to_validate);
+    }
+
+    bool statistics_gathering_node_delegate_wrapper::verify_block_header( const message& message_to_verify )
+    {
+      INVOKE_AND_COLLECT_STATISTICS(verify_block_header, message_to_verify);
+    }
+
     std::vector<item_hash_t> statistics_gathering_node_delegate_wrapper::get_item_ids(uint32_t item_type,
                                                                                   const std::vector<item_hash_t>& blockchain_synopsis,
                                                                                   uint32_t& remaining_item_count,
@@ -4842,6 +6264,11 @@ namespace bts { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(get_block_time, block_id);
     }
 
+    std::vector<bts::blockchain::signed_block_header> statistics_gathering_node_delegate_wrapper::get_block_headers(const std::vector<item_hash_t>& block_ids)
+    {
+      INVOKE_AND_COLLECT_STATISTICS(get_block_headers, block_ids);
+    }
+
     /** returns bts::blockchain::now() */
     fc::time_point_sec statistics_gathering_node_delegate_wrapper::get_blockchain_now()
     {
@@ -4860,6 +6287,11 @@ namespace bts { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(estimate_last_known_fork_from_git_revision_timestamp, unix_timestamp);
     }
 
+    uint32_t statistics_gathering_node_delegate_wrapper::get_first_full_block_number() const
+    {
+      INVOKE_AND_COLLECT_STATISTICS(get_first_full_block_number);
+    }
+
     void statistics_gathering_node_delegate_wrapper::error_encountered(const std::string& message, const fc::oexception& error)
     {
       INVOKE_AND_COLLECT_STATISTICS(error_encountered, message, error);
@@ -18,6 +18,7 @@ namespace bts { namespace net
       _node(delegate),
       _message_connection(this),
       _total_queued_messages_size(0),
+      next_timeout_check(fc::time_point::maximum()),
       direction(peer_connection_direction::unknown),
       is_firewalled(firewalled_state::unknown),
       our_state(our_connection_state::disconnected),
@@ -28,10 +29,21 @@ namespace bts { namespace net
       number_of_unfetched_item_ids(0),
       peer_needs_sync_items_from_us(true),
       we_need_sync_items_from_peer(true),
+      sync_request_window(0),
       last_block_number_delegate_has_seen(0),
       inhibit_fetching_sync_blocks(false),
+      supports_block_headers(false),
+      first_full_block_number(1),
+      inventory_advertised_to_peer(BTS_NET_INVENTORY_FILTER_CAPACITY),
+      inventory_advertised_to_peer_rotation_time(fc::time_point::now()),
+      blocks_served(0),
+      sync_blocks_received(0),
+      blocks_delivered_first(0),
       transaction_fetching_inhibited_until(fc::time_point::min()),
-      last_known_fork_block_number(0)
+      last_known_fork_block_number(0),
+      supports_compact_blocks(false),
+      supports_compression(false),
+      received_messages_queued(0)
 #ifndef NDEBUG
       ,_thread(&fc::thread::current()),
       _send_message_queue_tasks_running(0)
@@ -127,7 +139,7 @@ namespace bts { namespace net
       return _message_connection.get_socket();
     }
 
-    void peer_connection::accept_connection()
+    void peer_connection::accept_connection( fc::thread* key_exchange_thread )
     {
       VERIFY_CORRECT_THREAD();
 
@@ -142,7 +154,7 @@ namespace bts { namespace net
                 their_state == their_connection_state::disconnected );
         direction = peer_connection_direction::inbound;
         negotiation_status = connection_negotiation_status::accepting;
-        _message_connection.accept();           // perform key exchange
+        _message_connection.accept( key_exchange_thread ); // perform key exchange
         negotiation_status = connection_negotiation_status::accepted;
         _remote_endpoint = _message_connection.get_socket().remote_endpoint();
 
@@ -210,6 +222,9 @@ namespace bts { namespace net
     void peer_connection::on_message( message_oriented_connection* originating_connection, const message& received_message )
     {
       VERIFY_CORRECT_THREAD();
+      message_counts& counts = messages_received_by_type[received_message.msg_type];
+      ++counts.messages;
+      counts.bytes += received_message.size;
       _node->on_message( this, received_message );
     }
 
@@ -232,28 +247,55 @@ namespace bts { namespace net
 #endif
       while (!_queued_messages.empty())
       {
-        _queued_messages.front().transmission_start_time = fc::time_point::now();
-        try
+        // send whatever has piled up behind the front message in one write, so a burst of small
+        // messages doesn't cost a write each.  Nothing waits for more messages to arrive.
+        size_t batch_count = 0;
+        size_t batch_size = 0;
+        for (const queued_message& message_to_queue : _queued_messages)
+        {
+          if (batch_count != 0 &&
+              batch_size + message_to_queue.message_to_send.size > BTS_NET_MAX_COALESCED_SEND_SIZE)
+            break;
+          ++batch_count;
+          batch_size += message_to_queue.message_to_send.size;
+        }
+
+        // wait for our turn at the upload bandwidth; nothing is removed from the queue while we do
+        if (traffic_shaper* shaper = _node->get_traffic_shaper())
+          for (size_t i = 0; i < batch_count; ++i)
+            shaper->wait_to_send(_queued_messages[i].message_traffic_class, _queued_messages[i].message_to_send.size);
+
+        std::vector<const message*> messages_to_send;
+        messages_to_send.reserve(batch_count);
+        const fc::time_point transmission_start_time = fc::time_point::now();
+        for (size_t i = 0; i < batch_count; ++i)
         {
-          dlog("peer_connection::send_queued_messages_task() calling message_oriented_connection::send_message() "
-               "to send message of type ${type} for peer ${endpoint}",
-               ("type", _queued_messages.front().message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-          if (_queued_messages.front().message_send_time_field_offset != (size_t)-1)
+          queued_message& message_to_queue = _queued_messages[i];
+          message_to_queue.transmission_start_time = transmission_start_time;
+          if (message_to_queue.message_send_time_field_offset != (size_t)-1)
           {
             // patch the current time into the message.  Since this operates on the packed version of the structure,
             // it won't work for anything after a variable-length field
             std::vector<char> packed_current_time = fc::raw::pack(fc::time_point::now());
-            assert(_queued_messages.front().message_send_time_field_offset + packed_current_time.size() <= _queued_messages.front().message_to_send.data.size());
-            memcpy(_queued_messages.front().message_to_send.data.data() + _queued_messages.front().message_send_time_field_offset,
+            assert(message_to_queue.message_send_time_field_offset + packed_current_time.size() <= message_to_queue.message_to_send.data.size());
+            memcpy(message_to_queue.message_to_send.data.data() + message_to_queue.message_send_time_field_offset,
                    packed_current_time.data(), packed_current_time.size());
+            message_to_queue.message_to_send.reset_id();
           }
-          _message_connection.send_message(_queued_messages.front().message_to_send);
-          dlog("peer_connection::send_queued_messages_task()'s call to message_oriented_connection::send_message() completed normally for peer ${endpoint}",
+          messages_to_send.push_back(&message_to_queue.message_to_send);
+        }
+        try
+        {
+          dlog("peer_connection::send_queued_messages_task() calling message_oriented_connection::send_messages() "
+               "to send ${count} messages starting with type ${type} for peer ${endpoint}",
+               ("count", messages_to_send.size())("type", _queued_messages.front().message_to_send.msg_type)("endpoint", get_remote_endpoint()));
+          _message_connection.send_messages(messages_to_send);
+          dlog("peer_connection::send_queued_messages_task()'s call to message_oriented_connection::send_messages() completed normally for peer ${endpoint}",
                ("endpoint", get_remote_endpoint()));
         }
         catch (const fc::canceled_exception&)
         {
-          dlog("message_oriented_connection::send_message() was canceled, rethrowing canceled_exception");
+          dlog("message_oriented_connection::send_messages() was canceled, rethrowing canceled_exception");
           throw;
         }
         catch (const fc::exception& send_error)
@@ -271,26 +313,62 @@ namespace bts { namespace net
         }
         catch (const std::exception& e)
         {
-          elog("message_oriented_exception::send_message() threw a std::exception(): ${what}", ("what", e.what()));
+          elog("message_oriented_exception::send_messages() threw a std::exception(): ${what}", ("what", e.what()));
         }
         catch (...)
         {
-          elog("message_oriented_exception::send_message() threw an unhandled exception");
+          elog("message_oriented_exception::send_messages() threw an unhandled exception");
+        }
+        const fc::time_point transmission_finish_time = fc::time_point::now();
+        for (size_t i = 0; i < messages_to_send.size(); ++i)
+        {
+          _queued_messages.front().transmission_finish_time = transmission_finish_time;
+          _total_queued_messages_size -= _queued_messages.front().message_to_send.size;
+          _queued_messages.pop_front();
         }
-        _queued_messages.front().transmission_finish_time = fc::time_point::now();
-        _total_queued_messages_size -= _queued_messages.front().message_to_send.size;
-        _queued_messages.pop();
       }
       dlog("leaving peer_connection::send_queued_messages_task() due to queue exhaustion");
     }
 
+    traffic_class peer_connection::traffic_class_of(const message& message_to_classify)
+    {
+      if (message_to_classify.msg_type == block_message_type ||
+          message_to_classify.msg_type == bts::client::compact_block_message_type)
+        return traffic_class::block_relay;
+      if (message_to_classify.msg_type == trx_message_type)
+        return traffic_class::transaction_relay;
+      return traffic_class::gossip;
+    }
+
     void peer_connection::send_message(const message& message_to_send, size_t message_send_time_field_offset)
+    {
+      send_message(message_to_send, traffic_class_of(message_to_send), message_send_time_field_offset);
+    }
+
+    void peer_connection::send_message(const message& message_to_send, traffic_class message_traffic_class,
+                                       size_t message_send_time_field_offset)
     {
       VERIFY_CORRECT_THREAD();
       dlog("peer_connection::send_message() enqueueing message of type ${type} for peer ${endpoint}",
            ("type", message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-      _queued_messages.emplace(queued_message(message_to_send, message_send_time_field_offset));
-      _total_queued_messages_size += message_to_send.size;
+      // blocks are the bulk of sync traffic and compress well; the other messages are small or
+      // mostly hashes.  Messages that get a send time patched in must go out as they are.
+      if (supports_compression &&
+          message_to_send.msg_type == block_message_type &&
+          message_to_send.size >= BTS_NET_MIN_COMPRESSED_MESSAGE_SIZE &&
+          message_send_time_field_offset == (size_t)-1)
+      {
+        message compressed(compressed_message(message_to_send.msg_type, message_to_send.data));
+        const message& smaller = compressed.size < message_to_send.size ? compressed : message_to_send;
+        _queued_messages.emplace_back(queued_message(smaller, message_send_time_field_offset, message_traffic_class));
+      }
+      else
+        _queued_messages.emplace_back(queued_message(message_to_send, message_send_time_field_offset, message_traffic_class));
+      const message& queued = _queued_messages.back().message_to_send;
+      _total_queued_messages_size += queued.size;
+      message_counts& counts = messages_sent_by_type[queued.msg_type];
+      ++counts.messages;
+      counts.bytes += queued.size;
       if (_total_queued_messages_size > BTS_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES)
       {
         elog("send queue exceeded maximum size of ${max} bytes (current size ${current} bytes)",
@@ -382,6 +460,26 @@ namespace bts { namespace net
       return !items_requested_from_peer.empty() || !sync_items_requested_from_peer.empty() || item_ids_requested_from_peer;
     }
 
+    size_t peer_connection::get_queued_message_count() const
+    {
+      VERIFY_CORRECT_THREAD();
+      return _queued_messages.size();
+    }
+
+    size_t peer_connection::get_total_queued_messages_size() const
+    {
+      VERIFY_CORRECT_THREAD();
+      return _total_queued_messages_size;
+    }
+
+    fc::microseconds peer_connection::get_oldest_queued_message_age() const
+    {
+      VERIFY_CORRECT_THREAD();
+      if (_queued_messages.empty())
+        return fc::microseconds();
+      return fc::time_point::now() - _queued_messages.front().enqueue_time;
+    }
+
     bool peer_connection::idle()
     {
       VERIFY_CORRECT_THREAD();
@@ -405,20 +503,23 @@ namespace bts { namespace net
       VERIFY_CORRECT_THREAD();
       fc::time_point_sec oldest_inventory_to_keep(fc::time_point::now() - fc::minutes(BTS_NET_MAX_INVENTORY_SIZE_IN_MINUTES));
 
-      // expire old items from inventory_advertised_to_peer
-      auto oldest_inventory_to_keep_iter = inventory_advertised_to_peer.get<timestamp_index>().lower_bound(oldest_inventory_to_keep);
-      auto begin_iter = inventory_advertised_to_peer.get<timestamp_index>().begin();
-      unsigned number_of_elements_advertised_to_peer_to_discard = std::distance(begin_iter, oldest_inventory_to_keep_iter);
-      inventory_advertised_to_peer.get<timestamp_index>().erase(begin_iter, oldest_inventory_to_keep_iter);
+      // items advertised to the peer are remembered for between one and two expiry periods, or less
+      // if the filter fills up
+      if (inventory_advertised_to_peer.full() ||
+          inventory_advertised_to_peer_rotation_time < oldest_inventory_to_keep)
+      {
+        inventory_advertised_to_peer.rotate();
+        inventory_advertised_to_peer_rotation_time = fc::time_point::now();
+      }
 
-      // also expire items from inventory_peer_advertised_to_us
-      oldest_inventory_to_keep_iter = inventory_peer_advertised_to_us.get<timestamp_index>().lower_bound(oldest_inventory_to_keep);
-      begin_iter = inventory_peer_advertised_to_us.get<timestamp_index>().begin();
+      // expire old items from inventory_peer_advertised_to_us
+      auto oldest_inventory_to_keep_iter = inventory_peer_advertised_to_us.get<timestamp_index>().lower_bound(oldest_inventory_to_keep);
+      auto begin_iter = inventory_peer_advertised_to_us.get<timestamp_index>().begin();
       unsigned number_of_elements_peer_advertised_to_discard = std::distance(begin_iter, oldest_inventory_to_keep_iter);
       inventory_peer_advertised_to_us.get<timestamp_index>().erase(begin_iter, oldest_inventory_to_keep_iter);
-      dlog("Expiring old inventory for peer ${peer}: removing ${to_peer} items advertised to peer (${remain_to_peer} left), and ${to_us} advertised to us (${remain_to_us} left)",
+      dlog("Expiring old inventory for peer ${peer}: ${remain_to_peer} items advertised to peer remembered, removing ${to_us} advertised to us (${remain_to_us} left)",
            ("peer", get_remote_endpoint())
-           ("to_peer", number_of_elements_advertised_to_peer_to_discard)("remain_to_peer", inventory_advertised_to_peer.size())
+           ("remain_to_peer", inventory_advertised_to_peer.size())
            ("to_us", number_of_elements_peer_advertised_to_discard)("remain_to_us", inventory_peer_advertised_to_us.size()));
     }
     // we have a higher limit for blocks than transactions so we will still fetch blocks even when transactions are throttled
@@ -11,8 +11,11 @@
 #include <fc/io/json.hpp>
 
 #include <bts/net/peer_database.hpp>
+#include <bts/net/config.hpp>
 #include <bts/db/level_pod_map.hpp>
 
+#include <set>
+
 
 
 namespace bts { namespace net {
@@ -36,6 +39,7 @@ namespace bts { namespace net {
 
       const fc::time_point_sec& get_last_seen_time() const { return peer_record.last_seen_time; }
       const fc::ip::endpoint&   get_endpoint() const { return peer_record.endpoint; }
+      double                    get_selection_cost() const { return peer_record.selection_cost(); }
     };
 
     class peer_database_impl
@@ -43,6 +47,7 @@ namespace bts { namespace net {
     public:
       struct last_seen_time_index {};
       struct endpoint_index {};
+      struct selection_cost_index {};
       typedef boost::multi_index_container< potential_peer_database_entry, 
                                               indexed_by< ordered_non_unique< tag<last_seen_time_index>, 
                                                                               const_mem_fun< potential_peer_database_entry, 
@@ -55,7 +60,12 @@ namespace bts { namespace net {
                                                                                         &potential_peer_database_entry::get_endpoint 
                                                                                       >, 
                                                                          std::hash<fc::ip::endpoint>  
-                                                                       > 
+                                                                       >,
+                                                          ordered_non_unique< tag<selection_cost_index>,
+                                                                              const_mem_fun< potential_peer_database_entry,
+                                                                                             double,
+                                                                                             &potential_peer_database_entry::get_selection_cost>
+                                                                            >
                                                         > 
                                           > potential_peer_set;
     //private:
@@ -64,10 +74,19 @@ namespace bts { namespace net {
 
       potential_peer_set     _potential_peer_set;
 
+      /// changes not yet written to _leveldb, see flush()
+      // @{
+      std::set<uint32_t>     _keys_to_store;
+      std::set<uint32_t>     _keys_to_remove;
+      fc::time_point         _last_flush_time;
+      // @}
+      uint32_t               _next_database_key;
+
     public:
       void open(const fc::path& databaseFilename);
       void close();
       void clear();
+      void flush();
       void erase(const fc::ip::endpoint& endpointToErase);
       void update_entry(const potential_peer_record& updatedRecord);
       potential_peer_record lookup_or_create_entry_for_endpoint(const fc::ip::endpoint& endpointToLookup);
@@ -75,6 +94,8 @@ namespace bts { namespace net {
 
       peer_database::iterator begin() const;
       peer_database::iterator end() const;
+      peer_database::iterator begin_by_selection_cost() const;
+      peer_database::iterator end_by_selection_cost() const;
       size_t size() const;
     };
 
@@ -82,9 +103,18 @@ namespace bts { namespace net {
     {
     public:
       typedef peer_database_impl::potential_peer_set::index<peer_database_impl::last_seen_time_index>::type::iterator last_seen_time_index_iterator;
+      typedef peer_database_impl::potential_peer_set::index<peer_database_impl::selection_cost_index>::type::iterator selection_cost_index_iterator;
+      // only the one for the order we were created with is used
       last_seen_time_index_iterator _iterator;
+      selection_cost_index_iterator _selection_cost_iterator;
+      bool                          _by_selection_cost;
       peer_database_iterator_impl(const last_seen_time_index_iterator& iterator) :
-        _iterator(iterator)
+        _iterator(iterator),
+        _by_selection_cost(false)
+      {}
+      peer_database_iterator_impl(const selection_cost_index_iterator& iterator) :
+        _selection_cost_iterator(iterator),
+        _by_selection_cost(true)
       {}
     };
     peer_database_iterator::peer_database_iterator( const peer_database_iterator& c )
@@ -94,9 +124,22 @@ namespace bts { namespace net {
     {
       _leveldb.open(databaseFilename, true);
       _potential_peer_set.clear();
+      _keys_to_store.clear();
+      _keys_to_remove.clear();
+      _last_flush_time = fc::time_point::now();
 
-      for (auto iter = _leveldb.begin(); iter.valid(); ++iter)
-        _potential_peer_set.insert(potential_peer_database_entry(iter.key(), iter.value()));
+      try
+      {
+        for (auto iter = _leveldb.begin(); iter.valid(); ++iter)
+          _potential_peer_set.insert(potential_peer_database_entry(iter.key(), iter.value()));
+      }
+      catch (const fc::exception& e)
+      {
+        // records written before potential_peer_record gained fields don't unpack.  The database only
+        // remembers addresses to try, so start it over rather than failing to start the node
+        wlog("discarding unreadable peer database ${filename}: ${e}", ("filename", databaseFilename)("e", e.to_string()));
+        clear();
+      }
 #define MAXIMUM_PEERDB_SIZE 1000
       if (_potential_peer_set.size() > MAXIMUM_PEERDB_SIZE)
       {
@@ -109,14 +152,44 @@ namespace bts { namespace net {
           iter = _potential_peer_set.erase(iter);
         }
       }
+
+      uint32_t last_database_key = 0;
+      _leveldb.last(last_database_key);
+      _next_database_key = last_database_key + 1;
     }
 
     void peer_database_impl::close()
     {
+      try
+      {
+        flush();
+      }
+      catch (const fc::exception& e)
+      {
+        wlog("unable to save peer database changes: ${e}", ("e", e.to_string()));
+      }
       _leveldb.close();
       _potential_peer_set.clear();
     }
 
+    /** writes the records changed since the last flush in one batch */
+    void peer_database_impl::flush()
+    {
+      _last_flush_time = fc::time_point::now();
+      if (!_leveldb.is_open() || (_keys_to_store.empty() && _keys_to_remove.empty()))
+        return;
+
+      potential_peer_leveldb::write_batch batch = _leveldb.create_batch();
+      for (const potential_peer_database_entry& entry : _potential_peer_set)
+        if (_keys_to_store.find(entry.database_key) != _keys_to_store.end())
+          batch.store(entry.database_key, entry.peer_record);
+      for (uint32_t key_to_remove : _keys_to_remove)
+        batch.remove(key_to_remove);
+      batch.commit();
+      _keys_to_store.clear();
+      _keys_to_remove.clear();
+    }
+
     void peer_database_impl::clear()
     {
       auto iter = _leveldb.begin();
@@ -134,6 +207,8 @@ namespace bts { namespace net {
         }
       }
       _potential_peer_set.clear();
+      _keys_to_store.clear();
+      _keys_to_remove.clear();
     }
 
     void peer_database_impl::erase(const fc::ip::endpoint& endpointToErase)
@@ -141,7 +216,8 @@ namespace bts { namespace net {
       auto iter = _potential_peer_set.get<endpoint_index>().find(endpointToErase);
       if (iter != _potential_peer_set.get<endpoint_index>().end())
       {
-        _leveldb.remove(iter->database_key);
+        _keys_to_store.erase(iter->database_key);
+        _keys_to_remove.insert(iter->database_key);
         _potential_peer_set.get<endpoint_index>().erase(iter);
       }
     }
@@ -152,17 +228,30 @@ namespace bts { namespace net {
       if (iter != _potential_peer_set.get<endpoint_index>().end())
       {
         _potential_peer_set.get<endpoint_index>().modify(iter, [&updatedRecord](potential_peer_database_entry& entry) { entry.peer_record = updatedRecord; });
-        _leveldb.store(iter->database_key, updatedRecord);
+        _keys_to_store.insert(iter->database_key);
       }
       else
       {
-        uint32_t last_database_key;
-        _leveldb.last(last_database_key);
-        uint32_t new_database_key = last_database_key + 1;
+        uint32_t new_database_key = _next_database_key++;
         potential_peer_database_entry new_database_entry(new_database_key, updatedRecord);
         _potential_peer_set.get<endpoint_index>().insert(new_database_entry);
-        _leveldb.store(new_database_key, updatedRecord);
+        _keys_to_store.insert(new_database_key);
+        _keys_to_remove.erase(new_database_key);
       }
+
+      // connection attempts update records constantly, so they're saved in batches
+      if (fc::time_point::now() - _last_flush_time > fc::seconds(BTS_NET_PEER_DATABASE_FLUSH_INTERVAL_SEC))
+        flush();
+    }
+
+    double potential_peer_record::selection_cost() const
+    {
+      double cost = round_trip_delay.count() > 0 ? round_trip_delay.count() / 1000.0 : BTS_NET_UNMEASURED_PEER_ROUND_TRIP_DELAY_MS;
+      if (sync_block_delivery_time.count() > 0)
+        cost += sync_block_delivery_time.count() / 1000.0;
+      cost *= 1 + number_of_failed_connection_attempts;
+      cost /= 1 + std::min<uint32_t>(number_of_blocks_delivered_first, 100) / 10.0;
+      return cost;
     }
 
     potential_peer_record peer_database_impl::lookup_or_create_entry_for_endpoint(const fc::ip::endpoint& endpointToLookup)
@@ -191,6 +280,16 @@ namespace bts { namespace net {
       return peer_database::iterator(new peer_database_iterator_impl(_potential_peer_set.get<last_seen_time_index>().end()));
     }
 
+    peer_database::iterator peer_database_impl::begin_by_selection_cost() const
+    {
+      return peer_database::iterator(new peer_database_iterator_impl(_potential_peer_set.get<selection_cost_index>().begin()));
+    }
+
+    peer_database::iterator peer_database_impl::end_by_selection_cost() const
+    {
+      return peer_database::iterator(new peer_database_iterator_impl(_potential_peer_set.get<selection_cost_index>().end()));
+    }
+
     size_t peer_database_impl::size() const
     {
       return _potential_peer_set.size();
@@ -211,16 +310,23 @@ namespace bts { namespace net {
 
     void peer_database_iterator::increment()
     {
-      ++my->_iterator;
+      if (my->_by_selection_cost)
+        ++my->_selection_cost_iterator;
+      else
+        ++my->_iterator;
     }
 
     bool peer_database_iterator::equal(const peer_database_iterator& other) const
     {
+      if (my->_by_selection_cost)
+        return my->_selection_cost_iterator == other.my->_selection_cost_iterator;
       return my->_iterator == other.my->_iterator;
     }
 
     const potential_peer_record& peer_database_iterator::dereference() const
     {
+      if (my->_by_selection_cost)
+        return my->_selection_cost_iterator->peer_record;
       return my->_iterator->peer_record;
     }
 
@@ -234,7 +340,16 @@ namespace bts { namespace net {
   }
 
   peer_database::~peer_database()
-  {}
+  {
+    try
+    {
+      my->flush();
+    }
+    catch (const fc::exception& e)
+    {
+      wlog("unable to save peer database changes: ${e}", ("e", e.to_string()));
+    }
+  }
 
   void peer_database::open(const fc::path& databaseFilename)
   {
@@ -281,6 +396,21 @@ namespace bts { namespace net {
     return my->end();
   }
 
+  peer_database::iterator peer_database::begin_by_selection_cost() const
+  {
+    return my->begin_by_selection_cost();
+  }
+
+  peer_database::iterator peer_database::end_by_selection_cost() const
+  {
+    return my->end_by_selection_cost();
+  }
+
+  void peer_database::flush()
+  {
+    my->flush();
+  }
+
   size_t peer_database::size() const
   {
     return my->size();
@@ -288,12 +418,8 @@ namespace bts { namespace net {
     std::vector<potential_peer_record> peer_database::get_all()const
     {
         std::vector<potential_peer_record> results;
-        auto itr = my->_leveldb.begin();
-        while( itr.valid() )
-        {
-           results.push_back( itr.value() );
-           ++itr;
-        }
+        for( const detail::potential_peer_database_entry& entry : my->_potential_peer_set )
+           results.push_back( entry.peer_record );
         return results;
     }
 
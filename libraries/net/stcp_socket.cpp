@@ -10,6 +10,7 @@
 #include <fc/exception/exception.hpp>
 
 #include <bts/net/stcp_socket.hpp>
+#include <bts/net/config.hpp>
 
 namespace bts { namespace net {
 
@@ -25,9 +26,13 @@ stcp_socket::~stcp_socket()
 {
 }
 
-void stcp_socket::do_key_exchange()
+void stcp_socket::do_key_exchange( fc::thread* key_exchange_thread )
 {
-  _priv_key = fc::ecc::private_key::generate();
+  // the work only captures copies, so it may outlive a canceled wait
+  if( key_exchange_thread )
+    _priv_key = key_exchange_thread->async( [](){ return fc::ecc::private_key::generate(); }, "stcp_generate_key" ).wait();
+  else
+    _priv_key = fc::ecc::private_key::generate();
   fc::ecc::public_key pub = _priv_key.get_public_key();
   fc::ecc::public_key_data s = pub.serialize();
   std::shared_ptr<char> serialized_key_buffer(new char[sizeof(fc::ecc::public_key_data)], [](char* p){ delete[] p; });
@@ -37,7 +42,14 @@ void stcp_socket::do_key_exchange()
   fc::ecc::public_key_data rpub;
   memcpy((char*)&rpub, serialized_key_buffer.get(), sizeof(fc::ecc::public_key_data));
 
-  _shared_secret = _priv_key.get_shared_secret( rpub );
+  if( key_exchange_thread )
+  {
+    const fc::ecc::private_key priv_key = _priv_key;
+    _shared_secret = key_exchange_thread->async( [priv_key, rpub](){ return priv_key.get_shared_secret( rpub ); },
+                                                 "stcp_shared_secret" ).wait();
+  }
+  else
+    _shared_secret = _priv_key.get_shared_secret( rpub );
 //    ilog("shared secret ${s}", ("s", shared_secret) );
   _send_aes.init( fc::sha256::hash( (char*)&_shared_secret, sizeof(_shared_secret) ), 
                   fc::city_hash_crc_128((char*)&_shared_secret,sizeof(_shared_secret) ) );
@@ -77,7 +89,7 @@ size_t stcp_socket::readsome( char* buffer, size_t len )
     } buffer_in_use_checker(_read_buffer_in_use);
 #endif
 
-    const size_t read_buffer_length = 4096;
+    const size_t read_buffer_length = BTS_NET_STCP_BUFFER_SIZE;
     if (!_read_buffer)
       _read_buffer.reset(new char[read_buffer_length], [](char* p){ delete[] p; });
 
@@ -93,10 +105,24 @@ size_t stcp_socket::readsome( char* buffer, size_t len )
     return s;
 } FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
+/**
+ *   The caller's buffer is reference counted, so it stays alive for as long
+ *   as the socket operation does; read straight into it and decrypt in place
+ *   rather than going through _read_buffer.
+ */
 size_t stcp_socket::readsome( const std::shared_ptr<char>& buf, size_t len, size_t offset ) 
-{
-  return readsome(buf.get() + offset, len);
-}
+{ try {
+    assert( len > 0 && (len % 16) == 0 );
+
+    size_t s = _sock.readsome( buf, len, offset );
+    if( s % 16 )
+    {
+      _sock.read(buf, 16 - (s%16), offset + s);
+      s += 16-(s%16);
+    }
+    _recv_aes.decode( buf.get() + offset, s, buf.get() + offset );
+    return s;
+} FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
 bool stcp_socket::eof()const
 {
@@ -118,7 +144,7 @@ size_t stcp_socket::writesome( const char* buffer, size_t len )
     } buffer_in_use_checker(_write_buffer_in_use);
 #endif
 
-    const std::size_t write_buffer_length = 4096;
+    const std::size_t write_buffer_length = BTS_NET_STCP_BUFFER_SIZE;
     if (!_write_buffer)
       _write_buffer.reset(new char[write_buffer_length], [](char* p){ delete[] p; });
     len = std::min<size_t>(write_buffer_length, len);
@@ -154,9 +180,9 @@ void stcp_socket::close()
   }FC_RETHROW_EXCEPTIONS( warn, "error closing stcp socket" );
 }
 
-void stcp_socket::accept()
+void stcp_socket::accept( fc::thread* key_exchange_thread )
 {
-  do_key_exchange();
+  do_key_exchange( key_exchange_thread );
 }
 
 
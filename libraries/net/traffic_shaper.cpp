@@ -0,0 +1,134 @@
+#include <bts/net/traffic_shaper.hpp>
+#include <bts/net/config.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <algorithm>
+
+namespace bts { namespace net {
+
+  traffic_shaper::traffic_shaper() :
+    _shared_tokens(0),
+    _total_rate(0),
+    _last_refill_time(fc::time_point::now())
+  {
+    set_class_parameters( traffic_class::block_relay,       0,                                                3 );
+    set_class_parameters( traffic_class::transaction_relay, 0,                                                2 );
+    set_class_parameters( traffic_class::gossip,            BTS_NET_DEFAULT_GOSSIP_MINIMUM_UPLOAD_RATE,       1 );
+    set_class_parameters( traffic_class::sync_serving,      BTS_NET_DEFAULT_SYNC_SERVING_MINIMUM_UPLOAD_RATE, 0 );
+  }
+
+  void traffic_shaper::set_total_rate( uint32_t bytes_per_second )
+  {
+    refill();
+    _total_rate = bytes_per_second;
+  }
+
+  void traffic_shaper::set_class_parameters( traffic_class cls, uint32_t minimum_bytes_per_second, uint32_t priority )
+  {
+    refill();
+    bucket& class_bucket = _classes[ unsigned(cls) ];
+    class_bucket.minimum_rate = minimum_bytes_per_second;
+    class_bucket.priority = priority;
+    class_bucket.tokens = std::min<double>( class_bucket.tokens, minimum_bytes_per_second );
+  }
+
+  void traffic_shaper::refill()
+  {
+    const fc::time_point now = fc::time_point::now();
+    const double elapsed_seconds = double( (now - _last_refill_time).count() ) / fc::seconds(1).count();
+    _last_refill_time = now;
+    if( elapsed_seconds <= 0 )
+      return;
+
+    uint64_t total_minimum_rate = 0;
+    double overflow = 0;
+    for( bucket& class_bucket : _classes )
+    {
+      total_minimum_rate += class_bucket.minimum_rate;
+      const double added = class_bucket.minimum_rate * elapsed_seconds;
+      const double kept = std::max<double>( std::min<double>( added, class_bucket.minimum_rate - class_bucket.tokens ), 0 );
+      class_bucket.tokens += kept;
+      overflow += added - kept;
+    }
+    const double shared_rate = double( _total_rate > total_minimum_rate ? _total_rate - total_minimum_rate : 0 );
+    _shared_tokens = std::min<double>( _shared_tokens + shared_rate * elapsed_seconds + overflow, _total_rate );
+  }
+
+  bool traffic_shaper::higher_priority_waiting( traffic_class cls )const
+  {
+    const uint32_t priority = _classes[ unsigned(cls) ].priority;
+    for( const bucket& class_bucket : _classes )
+      if( class_bucket.priority > priority && class_bucket.tasks_waiting > 0 )
+        return true;
+    return false;
+  }
+
+  void traffic_shaper::wait_to_send( traffic_class cls, size_t bytes )
+  {
+    bucket& class_bucket = _classes[ unsigned(cls) ];
+    for( ;; )
+    {
+      if( _total_rate == 0 )
+        return;
+      refill();
+      if( class_bucket.tokens > 0 )
+      {
+        class_bucket.tokens -= bytes;
+        return;
+      }
+      if( _shared_tokens > 0 && !higher_priority_waiting( cls ) )
+      {
+        _shared_tokens -= bytes;
+        return;
+      }
+
+      // sleep about until the bucket we're short in is out of debt, waking often enough to take our turn
+      const double deficit = class_bucket.minimum_rate > 0 ? -class_bucket.tokens / class_bucket.minimum_rate
+                                                           : -_shared_tokens / _total_rate;
+      const int64_t sleep_ms = std::max<int64_t>( 5, std::min<int64_t>( 100, int64_t( deficit * 1000 ) ) );
+      ++class_bucket.tasks_waiting;
+      try
+      {
+        fc::usleep( fc::milliseconds( sleep_ms ) );
+      }
+      catch( ... )
+      {
+        --class_bucket.tasks_waiting;
+        throw;
+      }
+      --class_bucket.tasks_waiting;
+    }
+  }
+
+  void traffic_shaper::set_parameters( const fc::variant_object& params )
+  {
+    for( unsigned i = 0; i < traffic_class_count; ++i )
+    {
+      const traffic_class cls = traffic_class( i );
+      const std::string name = fc::reflector<traffic_class>::to_string( cls );
+      bucket& class_bucket = _classes[ i ];
+      uint32_t minimum_rate = class_bucket.minimum_rate;
+      uint32_t priority = class_bucket.priority;
+      if( params.contains( (name + "_minimum_upload_rate").c_str() ) )
+        minimum_rate = params[ name + "_minimum_upload_rate" ].as<uint32_t>();
+      if( params.contains( (name + "_upload_priority").c_str() ) )
+        priority = params[ name + "_upload_priority" ].as<uint32_t>();
+      set_class_parameters( cls, minimum_rate, priority );
+    }
+  }
+
+  fc::variant_object traffic_shaper::get_parameters()const
+  {
+    fc::mutable_variant_object result;
+    for( unsigned i = 0; i < traffic_class_count; ++i )
+    {
+      const std::string name = fc::reflector<traffic_class>::to_string( traffic_class( i ) );
+      result[ name + "_minimum_upload_rate" ] = _classes[ i ].minimum_rate;
+      result[ name + "_upload_priority" ] = _classes[ i ].priority;
+    }
+    return result;
+  }
+
+} } // bts::net
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <fc/io/raw_variant.hpp>
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <fc/variant.hpp>
+
+#include <string>
+
+namespace bts { namespace rpc {
+
+  /**
+   *  The binary protocol of the RPC listeners. A client that sends this byte before its first request speaks
+   *  it instead of JSON for the rest of the connection. Every message after it is a little endian uint32
+   *  length followed by that many bytes of an fc::raw packed binary_rpc_request or binary_rpc_response.
+   */
+  const char binary_rpc_magic = '\xb7';
+
+  /** the largest message either side accepts */
+  const uint32_t binary_rpc_max_message_size = 64 * 1024 * 1024;
+
+  struct binary_rpc_request
+  {
+    uint64_t                  id = 0;
+    std::string               method;
+    fc::variants              params;
+  };
+
+  /** carries the result, or an error if the call failed; responses come back in the order of the requests */
+  struct binary_rpc_response
+  {
+    uint64_t                  id = 0;
+    fc::optional<fc::variant> result;
+    fc::optional<std::string> error;
+  };
+
+} } // bts::rpc
+
+FC_REFLECT( bts::rpc::binary_rpc_request, (id)(method)(params) )
+FC_REFLECT( bts::rpc::binary_rpc_response, (id)(result)(error) )
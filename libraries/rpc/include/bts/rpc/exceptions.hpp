@@ -9,5 +9,6 @@ namespace bts { namespace rpc {
   FC_DECLARE_EXCEPTION( missing_parameter,  60001, "Missing Parameter" );
   FC_DECLARE_EXCEPTION( unknown_method,     60002, "Unknown Method" );
   FC_DECLARE_EXCEPTION( login_required,     60003, "Login Required" );
+  FC_DECLARE_EXCEPTION( server_busy,        60004, "Server Busy" );
 
 } } // bts::rpc
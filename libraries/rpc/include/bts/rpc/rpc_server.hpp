@@ -44,6 +44,13 @@ namespace bts { namespace rpc {
 
        method_map_type meta_help()const;
 
+       /** hit and miss counts of the HTTP call cache, in total and per method */
+       fc::variant_object get_call_cache_stats()const;
+       /** approximate bytes of the cached replies and their entries */
+       uint64_t           get_call_cache_memory_usage()const;
+       /** call and error counts, latency histograms, reply sizes and cache hit ratios of every method called so far */
+       fc::variant_object get_method_stats()const;
+
        void set_http_file_callback(  const http_callback_type& );
 
        fc::optional<fc::ip::endpoint> get_rpc_endpoint() const;
@@ -1,25 +1,35 @@
 #define DEFAULT_LOGGER "rpc"
 
 #include <bts/wallet/exceptions.hpp>
+#include <bts/rpc/binary_rpc.hpp>
 #include <bts/rpc/exceptions.hpp>
 #include <bts/rpc/rpc_server.hpp>
+#include <bts/blockchain/balance_operations.hpp>
 #include <bts/blockchain/config.hpp>
+#include <bts/blockchain/transaction_evaluation_state.hpp>
 #include <bts/blockchain/time.hpp>
 #include <bts/utilities/git_revision.hpp>
+#include <bts/utilities/json_parser.hpp>
 #include <bts/utilities/key_conversion.hpp>
+#include <bts/utilities/stall_detector.hpp>
 #include <bts/utilities/padding_ostream.hpp>
 #include <bts/net/stcp_socket.hpp>
 
 #include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <fc/compress/zlib.hpp>
+#include <fc/crypto/city.hpp>
 #include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/json.hpp>
 #include <fc/network/http/server.hpp>
 #include <fc/network/tcp_socket.hpp>
 #include <fc/crypto/digest.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/fstream.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/rpc/json_connection.hpp>
 #include <fc/thread/thread.hpp>
@@ -28,6 +38,8 @@
 #include <fc/thread/mutex.hpp>
 #include <fc/thread/scoped_lock.hpp>
 
+#include <algorithm>
+#include <deque>
 #include <iomanip>
 #include <limits>
 #include <sstream>
@@ -40,7 +52,314 @@ namespace bts { namespace rpc {
 
   namespace detail
   {
-    class rpc_server_impl : public bts::rpc_stubs::common_api_rpc_server
+    /** the most results each of the HTTP call caches holds before it is emptied */
+    static const size_t max_cached_calls = 10000;
+
+    static uint64_t hash_combine( uint64_t seed, const char* data, size_t size )
+    {
+       return seed ^ ( fc::city_hash64( data, size ) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2) );
+    }
+
+    /** hashes the parsed params directly, so a call cache lookup does not have to serialize them again */
+    static uint64_t hash_variant( const fc::variant& v, uint64_t seed )
+    {
+       const uint8_t type = v.get_type();
+       seed = hash_combine( seed, (const char*)&type, sizeof(type) );
+       switch( v.get_type() )
+       {
+          case fc::variant::null_type:
+             return seed;
+          case fc::variant::int64_type:
+          {
+             const int64_t value = v.as_int64();
+             return hash_combine( seed, (const char*)&value, sizeof(value) );
+          }
+          case fc::variant::uint64_type:
+          {
+             const uint64_t value = v.as_uint64();
+             return hash_combine( seed, (const char*)&value, sizeof(value) );
+          }
+          case fc::variant::double_type:
+          {
+             const double value = v.as_double();
+             return hash_combine( seed, (const char*)&value, sizeof(value) );
+          }
+          case fc::variant::bool_type:
+          {
+             const uint8_t value = v.as_bool();
+             return hash_combine( seed, (const char*)&value, sizeof(value) );
+          }
+          case fc::variant::string_type:
+          {
+             const std::string& value = v.get_string();
+             return hash_combine( seed, value.c_str(), value.size() );
+          }
+          case fc::variant::array_type:
+          {
+             const fc::variants& values = v.get_array();
+             const uint64_t size = values.size();
+             seed = hash_combine( seed, (const char*)&size, sizeof(size) );
+             for( const fc::variant& value : values )
+                seed = hash_variant( value, seed );
+             return seed;
+          }
+          case fc::variant::object_type:
+          {
+             const fc::variant_object& values = v.get_object();
+             const uint64_t size = values.size();
+             seed = hash_combine( seed, (const char*)&size, sizeof(size) );
+             for( const auto& entry : values )
+             {
+                seed = hash_combine( seed, entry.key().c_str(), entry.key().size() );
+                seed = hash_variant( entry.value(), seed );
+             }
+             return seed;
+          }
+          default:
+          {
+             const std::string value = fc::json::to_string( v );
+             return hash_combine( seed, value.c_str(), value.size() );
+          }
+       }
+    }
+
+    /** an array result with at least this many elements is streamed to the HTTP response */
+    static const size_t min_streamed_array_size = 100;
+    /** the size of the chunks a streamed reply is written in */
+    static const size_t streamed_chunk_size = 64 * 1024;
+
+    /**
+     *  Writes a reply to an HTTP response with chunked transfer encoding. Arrays and objects are serialized
+     *  one member at a time, so only a chunk of the text is held at once and the first chunk goes out
+     *  before the rest of the result has been serialized.
+     */
+    class chunked_reply_writer
+    {
+       public:
+          chunked_reply_writer( const fc::http::server::response& s ) : _response(s)
+          {
+             _response.add_header( "Transfer-Encoding", "chunked" );
+          }
+
+          /** also appends everything written from now on to capture, when it is set */
+          void set_capture( std::string* capture ) { _capture = capture; }
+
+          void write( const std::string& text )
+          {
+             _buffer += text;
+             if( _capture )
+                *_capture += text;
+             if( _buffer.size() >= streamed_chunk_size )
+                flush();
+          }
+
+          void write_variant( const fc::variant& v )
+          {
+             if( v.is_array() )
+             {
+                write( "[" );
+                bool first = true;
+                for( const fc::variant& value : v.get_array() )
+                {
+                   if( !first )
+                      write( "," );
+                   first = false;
+                   write_variant( value );
+                }
+                write( "]" );
+             }
+             else if( v.is_object() )
+             {
+                write( "{" );
+                bool first = true;
+                for( const auto& entry : v.get_object() )
+                {
+                   if( !first )
+                      write( "," );
+                   first = false;
+                   write( fc::json::to_string( entry.key() ) + ":" );
+                   write_variant( entry.value() );
+                }
+                write( "}" );
+             }
+             else
+             {
+                write( fc::json::to_string( v ) );
+             }
+          }
+
+          void flush()
+          {
+             if( _buffer.empty() )
+                return;
+             std::stringstream chunk_header;
+             chunk_header << std::hex << _buffer.size() << "\r\n";
+             _buffer += "\r\n";
+             const std::string header = chunk_header.str();
+             _response.write( header.c_str(), header.size() );
+             _response.write( _buffer.c_str(), _buffer.size() );
+             _bytes_written += _buffer.size() - 2;
+             _buffer.clear();
+          }
+
+          /** writes the last chunk; returns the size of the reply without the chunk framing */
+          uint64_t finish()
+          {
+             flush();
+             _response.write( "0\r\n\r\n", 5 );
+             return _bytes_written;
+          }
+
+       private:
+          const fc::http::server::response& _response;
+          std::string                       _buffer;
+          std::string*                      _capture = nullptr;
+          uint64_t                          _bytes_written = 0;
+    };
+
+    /** htdocs files larger than this are not kept in memory, and are read from disk on every request */
+    static const uint64_t max_static_asset_size = 16 * 1024 * 1024;
+    /** a deflated copy of a file is kept only if it saves at least this many bytes */
+    static const size_t min_deflate_savings = 256;
+    /** fc::http::reply has no name for it */
+    static const fc::http::reply::status_code http_not_modified = fc::http::reply::status_code( 304 );
+
+    /** one file of htdocs, kept in memory so it is served without touching the disk, see load_static_assets */
+    struct static_asset
+    {
+       std::string content;
+       std::string deflated; // empty if deflating did not pay
+       std::string etag;
+    };
+
+    enum subscription_topic
+    {
+       new_heads_topic,
+       pending_transactions_topic,
+       market_trades_topic,
+       order_book_topic
+    };
+
+    /** what one subscribe call on a json connection asked to be told about */
+    struct subscription
+    {
+       uint64_t                                       id = 0;
+       subscription_topic                             topic = new_heads_topic;
+       std::unordered_set<bts::blockchain::address>   addresses; // pending_transactions_topic
+       bts::blockchain::asset_id_type                 quote_id = 0; // market_trades_topic and order_book_topic
+       bts::blockchain::asset_id_type                 base_id = 0;
+    };
+
+    /** what one method has cost since the server started; latencies are kept in log2 microsecond buckets */
+    struct method_call_stats
+    {
+       enum { latency_buckets = 24 };
+
+       uint64_t              calls = 0;
+       uint64_t              errors = 0;
+       uint64_t              total_latency_us = 0;
+       uint64_t              max_latency_us = 0;
+       std::vector<uint64_t> latency_us = std::vector<uint64_t>( latency_buckets );
+       uint64_t              replies = 0; // HTTP replies, including cached ones
+       uint64_t              reply_bytes = 0;
+       uint64_t              max_reply_bytes = 0;
+       uint64_t              cache_hits = 0;
+       uint64_t              cache_misses = 0;
+       uint64_t              rejected = 0; // turned away by admission control, see admission_gate
+
+       static uint32_t latency_bucket( uint64_t us )
+       {
+          uint32_t bucket = 0;
+          while( us > 1 && bucket + 1 < latency_buckets )
+          {
+             us >>= 1;
+             ++bucket;
+          }
+          return bucket;
+       }
+
+       void record_call( uint64_t elapsed_us, bool failed )
+       {
+          ++calls;
+          if( failed )
+             ++errors;
+          total_latency_us += elapsed_us;
+          max_latency_us = std::max( max_latency_us, elapsed_us );
+          ++latency_us[latency_bucket( elapsed_us )];
+       }
+
+       void record_reply( uint64_t size )
+       {
+          ++replies;
+          reply_bytes += size;
+          max_reply_bytes = std::max( max_reply_bytes, size );
+       }
+    };
+
+    /**
+     *  Admits the calls of one cost class: up to max_running run at once and up to max_queued more wait for
+     *  a turn in arrival order. A call that finds the queue full, or is still waiting at its deadline, is
+     *  rejected with server_busy rather than piling up behind the others. All callers are tasks of the
+     *  RPC server's thread.
+     */
+    class admission_gate
+    {
+       public:
+          void enter( uint32_t max_running, uint32_t max_queued, const fc::time_point& deadline )
+          {
+             if( _running < max_running && _queue.empty() )
+             {
+                ++_running;
+                return;
+             }
+             if( _queue.size() >= max_queued )
+                FC_THROW_EXCEPTION( server_busy, "${queued} calls of this kind are already waiting", ("queued",_queue.size()) );
+
+             fc::promise<void>::ptr turn( new fc::promise<void>( "rpc admission" ) );
+             _queue.push_back( turn );
+             try
+             {
+                turn->wait_until( deadline );
+             }
+             catch( const fc::timeout_exception& )
+             {
+                abandon( turn, max_running );
+                FC_THROW_EXCEPTION( server_busy, "no turn to run came before the deadline" );
+             }
+             catch( ... )
+             {
+                abandon( turn, max_running );
+                throw;
+             }
+          }
+
+          /** ends a call that enter() admitted and hands its turn to the first waiting call */
+          void leave( uint32_t max_running )
+          {
+             --_running;
+             if( !_queue.empty() && _running < max_running )
+             {
+                ++_running;
+                _queue.front()->set_value();
+                _queue.pop_front();
+             }
+          }
+
+       private:
+          /** gives up a turn that was waited for, which leave() may have granted just as the wait ended */
+          void abandon( const fc::promise<void>::ptr& turn, uint32_t max_running )
+          {
+             if( turn->ready() )
+                leave( max_running );
+             else
+                _queue.erase( std::find( _queue.begin(), _queue.end(), turn ) );
+          }
+
+          uint32_t                            _running = 0;
+          std::deque<fc::promise<void>::ptr>  _queue;
+    };
+
+    class rpc_server_impl : public bts::rpc_stubs::common_api_rpc_server, public bts::blockchain::chain_observer
     {
        public:
          rpc_server_config                                 _config;
@@ -55,11 +374,26 @@ namespace bts { namespace rpc {
          fc::thread*                                       _thread;
          http_callback_type                                _http_file_callback;
          std::unordered_set<fc::rpc::json_connection_ptr>  _open_json_connections;
-         fc::mutex                                         _rpc_mutex; // locked to prevent executing two rpc calls at once
+         std::vector<fc::future<void>>                     _connection_tasks; // see start_connection
+         fc::mutex                                         _rpc_mutex; // locked to prevent executing two rpc calls at once, except cheap ones
+         admission_gate                                    _normal_calls;
+         admission_gate                                    _expensive_calls;
+
+         /** serialized results of HTTP calls by hash of method and params, see bts::api::method_cache_policy */
+         std::unordered_map<uint64_t,string>               _head_block_call_cache;
+         std::unordered_map<uint64_t,string>               _immutable_call_cache;
+         uint64_t                                          _call_cache_invalidations = 0;
+         bool                                              _observing_chain = false;
+
+         /** the files of htdocs by request path, e.g. "/index.html" */
+         std::unordered_map<string,static_asset>           _static_assets;
 
-         bool                                              _cache_enabled = true;
-         fc::time_point                                    _last_cache_clear_time;
-         std::unordered_map<string,string>                 _call_cache;
+         /** per method call counts, latencies and reply sizes, see record_method_call */
+         std::map<string,method_call_stats>                _method_stats;
+
+         /** the subscriptions made on each json connection, see subscribe() */
+         std::unordered_map<fc::rpc::json_connection*, std::vector<subscription>> _subscriptions;
+         uint64_t                                          _next_subscription_id = 1;
 
          typedef std::map<std::string, bts::api::method_data> method_map_type;
          method_map_type _method_map;
@@ -83,6 +417,61 @@ namespace bts { namespace rpc {
          virtual void verify_wallet_is_unlocked() const override;
          virtual void verify_connected_to_network() const override;
          virtual void store_method_metadata(const bts::api::method_data& method_metadata);
+         virtual void record_method_call(const char* method_name, const fc::time_point& start_time, bool failed) override
+         {
+            const fc::microseconds elapsed = fc::time_point::now() - start_time;
+            _method_stats[method_name].record_call( std::max<int64_t>( elapsed.count(), 0 ), failed );
+         }
+
+         virtual void state_changed( const bts::blockchain::pending_chain_state_ptr& state ) override
+         {
+            clear_head_block_call_cache();
+         }
+         virtual void block_applied( const bts::blockchain::block_summary& summary ) override
+         {
+            clear_head_block_call_cache();
+            publish_block( summary );
+         }
+         virtual void pending_transaction_stored( const bts::blockchain::transaction_evaluation_state_ptr& eval_state ) override
+         {
+            publish_pending_transaction( *eval_state );
+         }
+         virtual void notifications_dropped( uint32_t blocks_applied, uint32_t pending_transactions, uint32_t state_changes ) override
+         {
+            clear_head_block_call_cache();
+            publish_gap( blocks_applied, pending_transactions );
+         }
+         void observe_chain()
+         {
+            if( _observing_chain )
+               return;
+            _client->get_chain()->add_observer( this );
+            _observing_chain = true;
+         }
+
+         fc::variant subscribe( fc::rpc::json_connection* json_connection, const fc::variants& params );
+         fc::variant unsubscribe( fc::rpc::json_connection* json_connection, const fc::variants& params );
+         void publish( subscription_topic topic, const std::function<fc::ovariant( const subscription& )>& make_notice );
+         void publish_block( const bts::blockchain::block_summary& summary );
+         void publish_pending_transaction( const bts::blockchain::transaction_evaluation_state& eval_state );
+         void publish_gap( uint32_t blocks_applied, uint32_t pending_transactions );
+         void clear_head_block_call_cache()
+         {
+            _head_block_call_cache.clear();
+            ++_call_cache_invalidations;
+         }
+         std::unordered_map<uint64_t,string>* get_call_cache( bts::api::method_cache_policy policy )
+         {
+            switch( policy )
+            {
+               case bts::api::cache_per_head_block:
+                  return &_head_block_call_cache;
+               case bts::api::cache_immutable:
+                  return &_immutable_call_cache;
+               default:
+                  return nullptr;
+            }
+         }
 
          std::string help(const std::string& command_name) const;
 
@@ -147,6 +536,73 @@ namespace bts { namespace rpc {
             }
         }
 
+         /** reads every file of htdocs once, with its ETag and deflated form; files added later are read from disk */
+         void load_static_assets()
+         {
+            _static_assets.clear();
+            if( !fc::is_directory( _config.htdocs ) )
+               return;
+
+            const std::string root = _config.htdocs.generic_string();
+            uint64_t total_size = 0;
+            for( fc::recursive_directory_iterator itr( _config.htdocs ); itr != fc::recursive_directory_iterator(); ++itr )
+            {
+               const fc::path filename = *itr;
+               if( fc::is_directory( filename ) )
+                  continue;
+               const uint64_t file_size = fc::file_size( filename );
+               if( file_size == 0 || file_size > max_static_asset_size )
+                  continue;
+
+               static_asset asset;
+               fc::read_file_contents( filename, asset.content );
+
+               std::stringstream etag;
+               etag << "\"" << std::hex << fc::city_hash64( asset.content.c_str(), asset.content.size() ) << "\"";
+               asset.etag = etag.str();
+
+               std::string deflated = fc::zlib_compress( asset.content );
+               if( deflated.size() + min_deflate_savings <= asset.content.size() )
+                  asset.deflated = std::move( deflated );
+
+               std::string path = filename.generic_string().substr( root.size() );
+               if( path.empty() || path[0] != '/' )
+                  path = "/" + path;
+               total_size += asset.content.size() + asset.deflated.size();
+               _static_assets[path] = std::move( asset );
+            }
+            ilog( "Loaded ${count} files of ${htdocs} into memory, ${size} bytes", ("count",_static_assets.size())("htdocs",_config.htdocs)("size",total_size) );
+         }
+
+         /** answers a request for a file of htdocs from memory: not modified if the caller has it already, deflated if it accepts that */
+         fc::http::reply::status_code send_static_asset( const fc::http::request& r, const static_asset& asset,
+                                                         fc::http::reply::status_code status, const fc::http::server::response& s )
+         {
+            s.add_header( "ETag", asset.etag );
+            s.add_header( "Cache-Control", "no-cache" ); // revalidate, which the ETag makes cheap
+            s.add_header( "Vary", "Accept-Encoding" );
+
+            const std::string if_none_match = r.get_header( "If-None-Match" );
+            if( status == fc::http::reply::OK && ( if_none_match == "*" || if_none_match.find( asset.etag ) != std::string::npos ) )
+            {
+               s.set_status( http_not_modified );
+               s.set_length( 0 );
+               s.write( "", 0 );
+               return http_not_modified;
+            }
+
+            const std::string* body = &asset.content;
+            if( !asset.deflated.empty() && r.get_header( "Accept-Encoding" ).find( "deflate" ) != std::string::npos )
+            {
+               s.add_header( "Content-Encoding", "deflate" );
+               body = &asset.deflated;
+            }
+            s.set_status( status );
+            s.set_length( body->size() );
+            s.write( body->c_str(), body->size() );
+            return status;
+         }
+
          void handle_request( const fc::http::request& r, const fc::http::server::response& s )
          {
              fc::time_point begin_time = fc::time_point::now();
@@ -155,7 +611,11 @@ namespace bts { namespace rpc {
             // dlog( "${r}", ("r",r.path) );
              fc::http::reply::status_code status = fc::http::reply::OK;
 
-             s.add_header( "Connection", "close" );
+             /* keep the connection open for a client that pipelines its calls, and close it otherwise */
+             if( boost::iequals( r.get_header( "Connection" ), "keep-alive" ) )
+                s.add_header( "Connection", "keep-alive" );
+             else
+                s.add_header( "Connection", "close" );
 
              fc::oexception internal_server_error;
              bool invalid_request_error = false;
@@ -227,6 +687,10 @@ namespace bts { namespace rpc {
                 {
                    _http_file_callback( path, s );
                 }
+                else if( _static_assets.count( path ) )
+                {
+                    status = send_static_asset( r, _static_assets[path], fc::http::reply::OK, s );
+                }
                 else if( fc::exists( filename ) )
                 {
                     FC_ASSERT( !fc::is_directory( filename ) );
@@ -242,6 +706,11 @@ namespace bts { namespace rpc {
                     s.set_length( file_size );
                     s.write( (const char*)mr.get_address(), mr.get_size() );
                 }
+                else if( _static_assets.count( "/404.html" ) )
+                {
+                    fc_ilog( fc::logger::get("rpc"), "Not found ${path} (${file})", ("path",r.path)("file",filename));
+                    status = send_static_asset( r, _static_assets["/404.html"], fc::http::reply::NotFound, s );
+                }
                 else
                 {
                     fc_ilog( fc::logger::get("rpc"), "Not found ${path} (${file})", ("path",r.path)("file",filename));
@@ -300,100 +769,215 @@ namespace bts { namespace rpc {
              fc_ilog( fc::logger::get("rpc"), "Completed ${path} ${status} in ${ms}ms", ("path",r.path)("status",(int)status)("ms",(end_time - begin_time).count()/1000));
          }
 
-         fc::http::reply::status_code handle_http_rpc(const fc::http::request& r, const fc::http::server::response& s )
+         /**
+          *  Runs one call object of an HTTP request, and returns its serialized reply. Sets status to the HTTP
+          *  status the call would get on its own; throws if the object is not a valid call. When stream_to is
+          *  set and the result is a large array, the reply is written to it as it is serialized instead, and
+          *  nothing is returned.
+          */
+         fc::optional<std::string> execute_http_call( const fc::http::request& r, const fc::variant_object& rpc_call,
+                                                      fc::http::reply::status_code& status,
+                                                      const fc::http::server::response* stream_to = nullptr )
          {
-                fc::http::reply::status_code status = fc::http::reply::OK;
-                std::string str(r.body.data(),r.body.size());
-                //wlog( "RPC: ${r}", ("r",str) );
-                fc::string method_name;
-
-                fc::optional<std::string> invalid_rpc_request_message;
-
-                try {
-                   auto rpc_call = fc::json::from_string( str ).get_object();
-                   method_name = rpc_call["method"].as_string();
-                   auto params = rpc_call["params"].get_array();
+                fc::string method_name = rpc_call["method"].as_string();
+                auto params = rpc_call["params"].get_array();
 
-                   auto request_key = method_name + "=" + fc::json::to_string(rpc_call["params"]);
+                auto params_log = fc::json::to_string(rpc_call["params"]);
+                if(method_name.find("wallet") != std::string::npos || method_name.find("priv") != std::string::npos)
+                    params_log = "***";
+                fc_ilog( fc::logger::get("rpc"), "Processing ${path} ${method} (${params})", ("path",r.path)("method",method_name)("params",params_log));
 
+                auto call_itr = _alias_map.find( method_name );
+                if( call_itr == _alias_map.end() )
+                {
+                    fc_ilog( fc::logger::get("rpc"), "Invalid Method ${path} ${method}", ("path",r.path)("method",method_name));
+                    elog( "Invalid Method ${path} ${method}", ("path",r.path)("method",method_name));
+                    std::string message = "Invalid Method: " + method_name;
+                    fc::mutable_variant_object  result;
+                    result["id"]     =  rpc_call["id"];
+                    status = fc::http::reply::NotFound;
+                    result["error"] = fc::mutable_variant_object( "message", message );
+                    return fc::json::to_string( result );
+                }
 
-                   if( fc::time_point(bts::blockchain::now()) - _last_cache_clear_time  > fc::seconds(BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC) )
+                const bts::api::method_data& method_data = _method_map[call_itr->second];
+                auto call_cache = get_call_cache( method_data.cache_policy );
+                uint64_t request_key = 0;
+                const uint64_t invalidations_before_call = _call_cache_invalidations;
+                if( call_cache )
+                {
+                   request_key = hash_variant( rpc_call["params"], fc::city_hash64( method_data.name.c_str(), method_data.name.size() ) );
+                   auto cache_itr = call_cache->find( request_key );
+                   method_call_stats& stats = _method_stats[method_data.name];
+                   if( cache_itr != call_cache->end() )
                    {
-                      _last_cache_clear_time = bts::blockchain::now();
-                      _call_cache.clear();
+                      ++stats.cache_hits;
+                      status = fc::http::reply::OK;
+
+                      /* only the result is cached; the id is the caller's */
+                      auto reply = "{\"id\":" + fc::json::to_string( rpc_call["id"] ) + ",\"result\":" + cache_itr->second + "}";
+                      auto reply_log = reply.size() > 253 ? reply.substr(0,253) + ".." :  reply;
+                      fc_ilog( fc::logger::get("rpc"), "Cached result ${path} ${method}: ${reply}", ("path",r.path)("method",method_name)("reply",reply_log));
+                      stats.record_reply( reply.size() );
+                      return reply;
                    }
-                   else if( _cache_enabled )
+                   ++stats.cache_misses;
+                }
+
+                fc::mutable_variant_object  result;
+                result["id"]     =  rpc_call["id"];
+                try
+                {
+                   fc::variant call_result = dispatch_admitted_method(method_data, params);
+                   status = fc::http::reply::OK;
+
+                   /* a block applied while the call yielded may have made the result stale already */
+                   const bool store_in_cache = call_cache && invalidations_before_call == _call_cache_invalidations;
+                   if( store_in_cache && call_cache->size() >= max_cached_calls )
+                      call_cache->clear();
+
+                   if( stream_to && call_result.is_array() && call_result.get_array().size() >= min_streamed_array_size )
                    {
-                      auto cache_itr = _call_cache.find(request_key);
-                      if( cache_itr != _call_cache.end() )
-                      {
-                         status = fc::http::reply::OK;
-                         s.set_status( status );
-
-                         auto reply = cache_itr->second;
-                         s.set_length( reply.size() );
-                         s.write( reply.c_str(), reply.size() );
-                         auto reply_log = reply.size() > 253 ? reply.substr(0,253) + ".." :  reply;
-                         fc_ilog( fc::logger::get("rpc"), "Result ${path} ${method}: ${reply}", ("path",r.path)("method",method_name)("reply",reply_log));
-                         return status;
-                      }
+                      stream_to->set_status( status );
+                      chunked_reply_writer writer( *stream_to );
+                      writer.write( "{\"id\":" + fc::json::to_string( rpc_call["id"] ) + ",\"result\":" );
+                      std::string cached_result;
+                      if( store_in_cache )
+                         writer.set_capture( &cached_result );
+                      writer.write_variant( call_result );
+                      writer.set_capture( nullptr );
+                      writer.write( "}" );
+                      const uint64_t reply_size = writer.finish();
+                      _method_stats[method_data.name].record_reply( reply_size );
+                      if( store_in_cache )
+                         (*call_cache)[request_key] = std::move( cached_result );
+                      fc_ilog( fc::logger::get("rpc"), "Streamed result ${path} ${method}: ${size} bytes", ("path",r.path)("method",method_name)("size",reply_size));
+                      return fc::optional<std::string>();
                    }
 
+                   if( store_in_cache )
+                      (*call_cache)[request_key] = fc::json::to_string( call_result );
+                   result["result"] = std::move( call_result );
+                }
+                catch ( const fc::canceled_exception& )
+                {
+                    throw;
+                }
+                catch ( const fc::exception& e )
+                {
+                    status = fc::http::reply::InternalServerError;
+                    result["error"] = fc::mutable_variant_object("message",e.to_string())( "detail",e.to_detail_string() )("code",e.code());
+                }
+                //ilog( "${e}", ("e",result) );
+                std::string reply;
+                {
+                   bts::utilities::stall_detector::scope stall_scope( "rpc_reply" );
+                   reply = fc::json::to_string( result );
+                }
+                auto reply_log = reply.size() > 253 ? reply.substr(0,253) + ".." :  reply;
+                fc_ilog( fc::logger::get("rpc"), "Result ${path} ${method}: ${reply}", ("path",r.path)("method",method_name)("reply",reply_log));
+                _method_stats[method_data.name].record_reply( reply.size() );
+                return reply;
+         }
+
+         /** a method with a cache policy depends only on the chain state and its params, so it has no side effects */
+         bool is_read_only_call( const fc::variant& call ) const
+         {
+            if( !call.is_object() || !call.get_object().contains( "method" ) || !call.get_object()["method"].is_string() )
+               return false;
+            auto call_itr = _alias_map.find( call.get_object()["method"].as_string() );
+            if( call_itr == _alias_map.end() )
+               return true; // answered with an error without running anything
+            auto method_itr = _method_map.find( call_itr->second );
+            return method_itr != _method_map.end() && method_itr->second.cache_policy != bts::api::cache_never;
+         }
 
-                   auto params_log = fc::json::to_string(rpc_call["params"]);
-                   if(method_name.find("wallet") != std::string::npos || method_name.find("priv") != std::string::npos)
-                       params_log = "***";
-                   fc_ilog( fc::logger::get("rpc"), "Processing ${path} ${method} (${params})", ("path",r.path)("method",method_name)("params",params_log));
+         /** runs one entry of a batch; a malformed entry gets an error reply instead of failing the batch */
+         std::string execute_batched_http_call( const fc::http::request& r, const fc::variant& call )
+         {
+            fc::optional<std::string> invalid_rpc_request_message;
+            try
+            {
+               fc::http::reply::status_code status = fc::http::reply::OK;
+               return *execute_http_call( r, call.get_object(), status );
+            }
+            catch ( const fc::canceled_exception& )
+            {
+               throw;
+            }
+            catch ( const fc::exception& e )
+            {
+               invalid_rpc_request_message = e.to_string();
+            }
+            catch ( const std::exception& e )
+            {
+               invalid_rpc_request_message = e.what();
+            }
 
-                   auto call_itr = _alias_map.find( method_name );
-                   if( call_itr != _alias_map.end() )
-                   {
-                      fc::mutable_variant_object  result;
-                      result["id"]     =  rpc_call["id"];
-                      try
-                      {
-                         result["result"] = dispatch_authenticated_method(_method_map[call_itr->second], params);
-                      //   auto reply = fc::json::to_string( result );
-                         status = fc::http::reply::OK;
-                         s.set_status( status );
-                      }
-                      catch ( const fc::canceled_exception& )
-                      {
-                          throw;
-                      }
-                      catch ( const fc::exception& e )
-                      {
-                          status = fc::http::reply::InternalServerError;
-                          s.set_status( status );
-                          result["error"] = fc::mutable_variant_object("message",e.to_string())( "detail",e.to_detail_string() )("code",e.code());
-                      }
-                      //ilog( "${e}", ("e",result) );
-                      auto reply = fc::json::to_string( result );
-                      s.set_length( reply.size() );
-                      s.write( reply.c_str(), reply.size() );
-                      auto reply_log = reply.size() > 253 ? reply.substr(0,253) + ".." :  reply;
-                      fc_ilog( fc::logger::get("rpc"), "Result ${path} ${method}: ${reply}", ("path",r.path)("method",method_name)("reply",reply_log));
+            fc_ilog( fc::logger::get("rpc"), "Invalid RPC Request in batch ${path}: ${e}", ("path",r.path)("e",*invalid_rpc_request_message));
+            fc::mutable_variant_object result;
+            result["id"] = call.is_object() && call.get_object().contains( "id" ) ? call.get_object()["id"] : fc::variant();
+            result["error"] = fc::mutable_variant_object( "message", "Invalid RPC Request: " + *invalid_rpc_request_message );
+            return fc::json::to_string( result );
+         }
+
+         /**
+          *  Runs a JSON-RPC 2.0 batch and returns the array of replies, in the order of the calls. Consecutive
+          *  read-only calls run as concurrent tasks; a call with side effects waits for the calls before it,
+          *  and the calls after it wait for it.
+          */
+         std::string execute_http_batch( const fc::http::request& r, const fc::variants& calls )
+         {
+            FC_ASSERT( !calls.empty(), "A batch must contain at least one call" );
+            std::vector<std::string> replies( calls.size() );
+            std::vector<fc::future<void>> running;
+            for( size_t i = 0; i < calls.size(); ++i )
+            {
+               if( is_read_only_call( calls[i] ) )
+               {
+                  running.push_back( fc::async( [this, &r, &calls, &replies, i]{ replies[i] = execute_batched_http_call( r, calls[i] ); },
+                                                "rpc_batch_call" ) );
+                  continue;
+               }
+               for( auto& call : running )
+                  call.wait();
+               running.clear();
+               replies[i] = execute_batched_http_call( r, calls[i] );
+            }
+            for( auto& call : running )
+               call.wait();
+            return "[" + boost::join( replies, "," ) + "]";
+         }
+
+         fc::http::reply::status_code handle_http_rpc(const fc::http::request& r, const fc::http::server::response& s )
+         {
+                fc::http::reply::status_code status = fc::http::reply::OK;
+                //wlog( "RPC: ${r}", ("r",std::string(r.body.data(),r.body.size())) );
+                fc::string method_name;
 
-                      //if( _method_map[method_name].cached )
-                         //_call_cache[request_key] = reply;
+                fc::optional<std::string> invalid_rpc_request_message;
 
-                      return status;
+                try {
+                   auto request = bts::utilities::parse_json( r.body.data(), r.body.size() );
+                   fc::optional<std::string> reply;
+                   if( request.is_array() )
+                   {
+                      method_name = "batch";
+                      reply = execute_http_batch( r, request.get_array() );
                    }
                    else
                    {
-                       fc_ilog( fc::logger::get("rpc"), "Invalid Method ${path} ${method}", ("path",r.path)("method",method_name));
-                       elog( "Invalid Method ${path} ${method}", ("path",r.path)("method",method_name));
-                       std::string message = "Invalid Method: " + method_name;
-                       fc::mutable_variant_object  result;
-                       result["id"]     =  rpc_call["id"];
-                       status = fc::http::reply::NotFound;
-                       s.set_status( status );
-                       result["error"] = fc::mutable_variant_object( "message", message );
-                       auto reply = fc::json::to_string( result );
-                       s.set_length( reply.size() );
-                       s.write( reply.c_str(), reply.size() );
-                       return status;
+                      const auto& rpc_call = request.get_object();
+                      if( rpc_call.contains( "method" ) && rpc_call["method"].is_string() )
+                         method_name = rpc_call["method"].as_string();
+                      reply = execute_http_call( r, rpc_call, status, &s );
+                      if( !reply )
+                         return status; // already streamed
                    }
+                   s.set_status( status );
+                   s.set_length( reply->size() );
+                   s.write( reply->c_str(), reply->size() );
+                   return status;
                 }
                 catch ( const fc::canceled_exception& )
                 {
@@ -447,19 +1031,7 @@ namespace bts { namespace rpc {
 
               auto buf_istream = std::make_shared<fc::buffered_istream>( sock );
               auto buf_ostream = std::make_shared<fc::buffered_ostream>( sock );
-
-              auto json_con = std::make_shared<fc::rpc::json_connection>( std::move(buf_istream),
-                                                                          std::move(buf_ostream) );
-              register_methods( json_con );
-              auto receipt = _open_json_connections.insert(json_con);
-
-              json_con->exec().on_complete([this,receipt,sock](fc::exception_ptr e){
-                  ilog("json_con exited");
-                  sock->close();
-                  _open_json_connections.erase(receipt.first);
-                  if( e )
-                    elog("Connection exited with error: ${error}", ("error", e->what()));
-              });
+              start_connection( buf_istream, buf_ostream, [sock]{ sock->close(); } );
            }
          }
 
@@ -490,22 +1062,133 @@ namespace bts { namespace rpc {
 
               auto buf_istream = std::make_shared<fc::buffered_istream>( sock );
               auto buf_ostream = std::make_shared<utilities::padding_ostream<>>( sock );
-
-              auto json_con = std::make_shared<fc::rpc::json_connection>( std::move(buf_istream),
-                                                                          std::move(buf_ostream) );
-              register_methods( json_con );
-              auto receipt = _open_json_connections.insert(json_con);
-
-              json_con->exec().on_complete([this,receipt,sock](fc::exception_ptr e){
-                  ilog("json_con exited");
-                  sock->close();
-                  _open_json_connections.erase(receipt.first);
-                  if( e )
-                    elog("Connection exited with error: ${error}", ("error", e->what()));
-              });
+              start_connection( buf_istream, buf_ostream, [sock]{ sock->close(); } );
            }
          }
 
+         /**
+          *  Serves an accepted connection in a task of its own, as peeking at its first byte waits for the
+          *  client. A connection that starts with binary_rpc_magic speaks the binary protocol; any other
+          *  speaks JSON.
+          */
+         template<typename OutputStream>
+         void start_connection( const std::shared_ptr<fc::buffered_istream>& in, const std::shared_ptr<OutputStream>& out,
+                                const std::function<void()>& close_socket )
+         {
+           _connection_tasks.erase( std::remove_if( _connection_tasks.begin(), _connection_tasks.end(),
+                                                      []( const fc::future<void>& c ) { return c.ready(); } ),
+                                      _connection_tasks.end() );
+           _connection_tasks.push_back( fc::async( [this, in, out, close_socket]
+           {
+              try
+              {
+                if( in->peek() != binary_rpc_magic )
+                {
+                  start_json_connection( in, out, close_socket );
+                  return;
+                }
+                char magic;
+                in->read( &magic, sizeof(magic) );
+                serve_binary_connection( *in, *out );
+              }
+              catch ( const fc::canceled_exception& )
+              {
+                close_socket();
+                throw;
+              }
+              catch ( const fc::eof_exception& )
+              {
+              }
+              catch ( const fc::exception& e )
+              {
+                elog("Connection exited with error: ${error}", ("error", e.to_detail_string()));
+              }
+              close_socket();
+           }, "rpc_connection" ) );
+         }
+
+         template<typename OutputStream>
+         void start_json_connection( const std::shared_ptr<fc::buffered_istream>& in, const std::shared_ptr<OutputStream>& out,
+                                     const std::function<void()>& close_socket )
+         {
+            auto json_con = std::make_shared<fc::rpc::json_connection>( in, out );
+            register_methods( json_con );
+            auto receipt = _open_json_connections.insert(json_con);
+
+            json_con->exec().on_complete([this,receipt,close_socket](fc::exception_ptr e){
+                ilog("json_con exited");
+                close_socket();
+                _subscriptions.erase(receipt.first->get());
+                _open_json_connections.erase(receipt.first);
+                if( e )
+                  elog("Connection exited with error: ${error}", ("error", e->what()));
+            });
+         }
+
+         /** answers binary_rpc_request messages in order until the connection closes */
+         template<typename OutputStream>
+         void serve_binary_connection( fc::buffered_istream& in, OutputStream& out )
+         {
+            bool authenticated = false;
+            std::vector<char> message;
+            while( true )
+            {
+               uint32_t size = 0;
+               in.read( (char*)&size, sizeof(size) );
+               FC_ASSERT( size <= binary_rpc_max_message_size, "binary RPC request of ${size} bytes is too large", ("size",size) );
+               message.resize( size );
+               if( size )
+                  in.read( message.data(), size );
+               const auto request = fc::raw::unpack<binary_rpc_request>( message );
+
+               binary_rpc_response response;
+               response.id = request.id;
+               try
+               {
+                  response.result = execute_binary_call( request, authenticated );
+               }
+               catch ( const fc::canceled_exception& )
+               {
+                  throw;
+               }
+               catch ( const fc::exception& e )
+               {
+                  response.error = e.to_string();
+               }
+               catch ( const std::exception& e )
+               {
+                  response.error = std::string( e.what() );
+               }
+
+               const auto packed = fc::raw::pack( response );
+               const uint32_t packed_size = packed.size();
+               out.write( (const char*)&packed_size, sizeof(packed_size) );
+               out.write( packed.data(), packed.size() );
+               out.flush();
+            }
+         }
+
+         /** the binary counterpart of dispatch_method_from_json_connection, with login handled in place */
+         fc::variant execute_binary_call( const binary_rpc_request& request, bool& authenticated )
+         {
+            if( request.method == "login" )
+            {
+               FC_ASSERT( request.params.size() == 2 );
+               FC_ASSERT( request.params[0].as_string() == _config.rpc_user );
+               FC_ASSERT( request.params[1].as_string() == _config.rpc_password );
+               authenticated = true;
+               return fc::variant( true );
+            }
+
+            auto call_itr = _alias_map.find( request.method );
+            if( call_itr == _alias_map.end() )
+               FC_THROW_EXCEPTION( unknown_method, "Method \"${name}\" not found", ("name", request.method) );
+            const bts::api::method_data& method_data = _method_map[call_itr->second];
+            if( (method_data.prerequisites & bts::api::json_authenticated) && !authenticated )
+               FC_THROW_EXCEPTION( login_required, "not logged in" );
+            return dispatch_admitted_method( method_data, request.params );
+         }
+
          void register_methods( fc::rpc::json_connection_ptr con )
          {
             ilog( "login!" );
@@ -514,6 +1197,10 @@ namespace bts { namespace rpc {
             // the login method is a special case that is only used for raw json connections
             // (not for the CLI or HTTP(s) json rpc)
             con->add_method("login", boost::bind(&rpc_server_impl::login, this, capture_con, _1));
+            // so are subscriptions, which need a connection to push their notices on
+            con->add_method("subscribe", boost::bind(&rpc_server_impl::subscribe, this, capture_con, _1));
+            con->add_method("unsubscribe", boost::bind(&rpc_server_impl::unsubscribe, this, capture_con, _1));
+            observe_chain();
             for (const method_map_type::value_type& method : _method_map)
             {
               if (method.second.method)
@@ -538,13 +1225,50 @@ namespace bts { namespace rpc {
           if ((method_data.prerequisites & bts::api::json_authenticated) &&
               _authenticated_connection_set.find(con) == _authenticated_connection_set.end())
             FC_THROW_EXCEPTION( login_required, "not logged in");
-          return dispatch_authenticated_method(method_data, arguments);
+          return dispatch_admitted_method(method_data, arguments);
+        }
+
+        /** runs a call from the network once admission control lets it, see admission_gate */
+        fc::variant dispatch_admitted_method(const bts::api::method_data& method_data,
+                                             const fc::variants& arguments)
+        {
+          if (method_data.cost_class == bts::api::cost_cheap)
+            return dispatch_authenticated_method(method_data, arguments);
+
+          const bool expensive = method_data.cost_class == bts::api::cost_expensive;
+          admission_gate& gate = expensive ? _expensive_calls : _normal_calls;
+          const uint32_t max_running = std::max<uint32_t>( 1, expensive ? _config.max_expensive_calls : _config.max_normal_calls );
+          const uint32_t max_queued = expensive ? _config.max_queued_expensive_calls : _config.max_queued_normal_calls;
+          try
+          {
+            gate.enter( max_running, max_queued, fc::time_point::now() + fc::milliseconds( _config.call_queue_timeout_ms ) );
+          }
+          catch (const server_busy&)
+          {
+            ++_method_stats[method_data.name].rejected;
+            throw;
+          }
+
+          try
+          {
+            fc::variant result = dispatch_authenticated_method(method_data, arguments);
+            gate.leave( max_running );
+            return result;
+          }
+          catch (...)
+          {
+            gate.leave( max_running );
+            throw;
+          }
         }
 
         fc::variant dispatch_authenticated_method(const bts::api::method_data& method_data,
                                                   const fc::variants& arguments_from_caller)
         {
-          fc::scoped_lock<fc::mutex> lock(_rpc_mutex);
+          // cheap calls only read what they answer, so they need not wait for an expensive call to finish
+          std::unique_ptr<fc::scoped_lock<fc::mutex>> lock;
+          if (method_data.cost_class != bts::api::cost_cheap)
+            lock.reset(new fc::scoped_lock<fc::mutex>(_rpc_mutex));
 
           if (!method_data.method)
           {
@@ -673,6 +1397,216 @@ namespace bts { namespace rpc {
       return fc::variant( true );
     }
 
+    /**
+     *  Subscribes the connection to a topic, and returns the subscription id that its notices carry. Notices
+     *  are sent as "notice" notifications with the params [subscription id, notice]. The topics are:
+     *    new_heads                            every block applied
+     *    pending_transactions [addresses]     pending transactions signed by or depositing to the addresses
+     *    market_trades <quote> <base>         the trades of each block in the market
+     *    order_book <quote> <base>            the orders each block changed in the market; a balance of 0
+     *                                         means the order is gone
+     *  A server too busy to keep up may skip notices. It then sends a notice {"gap": true} with the number of
+     *  "blocks_skipped" or "transactions_skipped", and a subscriber should fetch what it missed.
+     */
+    fc::variant rpc_server_impl::subscribe(fc::rpc::json_connection* json_connection, const fc::variants& params)
+    {
+      verify_json_connection_is_authenticated( json_connection );
+      FC_ASSERT( params.size() >= 1, "subscribe takes a topic" );
+
+      subscription sub;
+      const std::string topic = params[0].as_string();
+      if( topic == "new_heads" )
+      {
+        sub.topic = new_heads_topic;
+      }
+      else if( topic == "pending_transactions" )
+      {
+        FC_ASSERT( params.size() == 2, "pending_transactions takes an array of addresses" );
+        sub.topic = pending_transactions_topic;
+        for( const std::string& address_string : params[1].as<std::vector<std::string>>() )
+          sub.addresses.insert( bts::blockchain::address( address_string ) );
+      }
+      else if( topic == "market_trades" || topic == "order_book" )
+      {
+        FC_ASSERT( params.size() == 3, "${topic} takes the quote and base symbols", ("topic",topic) );
+        sub.topic = topic == "market_trades" ? market_trades_topic : order_book_topic;
+        const auto chain = _client->get_chain();
+        const auto quote_record = chain->get_asset_record( params[1].as_string() );
+        const auto base_record = chain->get_asset_record( params[2].as_string() );
+        FC_ASSERT( quote_record.valid() && base_record.valid(), "Unknown asset" );
+        sub.quote_id = quote_record->id;
+        sub.base_id = base_record->id;
+      }
+      else
+      {
+        FC_THROW_EXCEPTION( fc::invalid_arg_exception, "Unknown topic \"${topic}\"", ("topic",topic) );
+      }
+
+      sub.id = _next_subscription_id++;
+      _subscriptions[json_connection].push_back( sub );
+      return fc::variant( sub.id );
+    }
+
+    fc::variant rpc_server_impl::unsubscribe(fc::rpc::json_connection* json_connection, const fc::variants& params)
+    {
+      FC_ASSERT( params.size() == 1, "unsubscribe takes a subscription id" );
+      const uint64_t id = params[0].as_uint64();
+      auto itr = _subscriptions.find( json_connection );
+      if( itr == _subscriptions.end() )
+        return fc::variant( false );
+      auto& subs = itr->second;
+      auto sub_itr = std::find_if( subs.begin(), subs.end(), [id]( const subscription& sub ) { return sub.id == id; } );
+      if( sub_itr == subs.end() )
+        return fc::variant( false );
+      subs.erase( sub_itr );
+      if( subs.empty() )
+        _subscriptions.erase( itr );
+      return fc::variant( true );
+    }
+
+    /** sends the notice make_notice returns, if any, to every subscriber of the topic */
+    void rpc_server_impl::publish( subscription_topic topic, const std::function<fc::ovariant( const subscription& )>& make_notice )
+    {
+      // collected first, as sending yields and connections may subscribe or go away meanwhile
+      std::vector<std::pair<fc::rpc::json_connection_ptr, fc::variants>> notices;
+      for( const fc::rpc::json_connection_ptr& con : _open_json_connections )
+      {
+        auto itr = _subscriptions.find( con.get() );
+        if( itr == _subscriptions.end() )
+          continue;
+        for( const subscription& sub : itr->second )
+        {
+          if( sub.topic != topic )
+            continue;
+          fc::ovariant notice = make_notice( sub );
+          if( notice )
+            notices.emplace_back( con, fc::variants{ fc::variant( sub.id ), *notice } );
+        }
+      }
+
+      for( const auto& notice : notices )
+      {
+        try
+        {
+          notice.first->notify( "notice", notice.second );
+        }
+        catch ( const fc::canceled_exception& )
+        {
+          throw;
+        }
+        catch ( const fc::exception& e )
+        {
+          wlog( "unable to send a subscription notice: ${e}", ("e",e.to_detail_string()) );
+        }
+      }
+    }
+
+    void rpc_server_impl::publish_block(const bts::blockchain::block_summary& summary)
+    {
+      if( _subscriptions.empty() )
+        return;
+
+      const bts::blockchain::full_block& block = summary.block_data;
+      publish( new_heads_topic, [&]( const subscription& ) -> fc::ovariant
+      {
+        return fc::variant( fc::mutable_variant_object( "block_num", block.block_num )
+                                                      ( "id", block.id() )
+                                                      ( "previous", block.previous )
+                                                      ( "timestamp", block.timestamp )
+                                                      ( "transaction_count", block.user_transactions.size() ) );
+      } );
+
+      if( !summary.applied_changes )
+        return;
+      const bts::blockchain::pending_chain_state& changes = *summary.applied_changes;
+
+      publish( market_trades_topic, [&]( const subscription& sub ) -> fc::ovariant
+      {
+        std::vector<bts::blockchain::market_transaction> trades;
+        for( const bts::blockchain::market_transaction& trade : changes.market_transactions )
+          if( trade.bid_price.quote_asset_id == sub.quote_id && trade.bid_price.base_asset_id == sub.base_id )
+            trades.push_back( trade );
+        if( trades.empty() )
+          return fc::ovariant();
+        return fc::variant( fc::mutable_variant_object( "block_num", block.block_num )( "trades", trades ) );
+      } );
+
+      publish( order_book_topic, [&]( const subscription& sub ) -> fc::ovariant
+      {
+        fc::variants orders;
+        const auto add_orders = [&]( const std::string& type, const std::map<bts::blockchain::market_index_key, bts::blockchain::order_record>& changed )
+        {
+          for( const auto& item : changed )
+          {
+            if( item.first.order_price.quote_asset_id != sub.quote_id || item.first.order_price.base_asset_id != sub.base_id )
+              continue;
+            orders.push_back( fc::mutable_variant_object( "type", type )
+                                                        ( "price", item.first.order_price )
+                                                        ( "owner", item.first.owner )
+                                                        ( "balance", item.second.balance ) );
+          }
+        };
+        add_orders( "bid", changes.bids );
+        add_orders( "ask", changes.asks );
+        add_orders( "short", changes.shorts );
+        if( orders.empty() )
+          return fc::ovariant();
+        return fc::variant( fc::mutable_variant_object( "block_num", block.block_num )( "orders", orders ) );
+      } );
+    }
+
+    /** tells the subscribers of the topics that lost notices how many of their blocks or transactions were skipped */
+    void rpc_server_impl::publish_gap( uint32_t blocks_applied, uint32_t pending_transactions )
+    {
+      if( _subscriptions.empty() )
+        return;
+
+      if( blocks_applied > 0 )
+      {
+        const auto make_notice = [&]( const subscription& ) -> fc::ovariant
+        {
+          return fc::variant( fc::mutable_variant_object( "gap", true )( "blocks_skipped", blocks_applied ) );
+        };
+        publish( new_heads_topic, make_notice );
+        publish( market_trades_topic, make_notice );
+        publish( order_book_topic, make_notice );
+      }
+
+      if( pending_transactions > 0 )
+      {
+        publish( pending_transactions_topic, [&]( const subscription& ) -> fc::ovariant
+        {
+          return fc::variant( fc::mutable_variant_object( "gap", true )( "transactions_skipped", pending_transactions ) );
+        } );
+      }
+    }
+
+    void rpc_server_impl::publish_pending_transaction(const bts::blockchain::transaction_evaluation_state& eval_state)
+    {
+      if( _subscriptions.empty() )
+        return;
+
+      std::unordered_set<bts::blockchain::address> involved( eval_state.signed_keys.begin(), eval_state.signed_keys.end() );
+      for( const bts::blockchain::operation& op : eval_state.trx.operations )
+      {
+        if( bts::blockchain::operation_type_enum( op.type ) != bts::blockchain::deposit_op_type )
+          continue;
+        const auto deposit = op.as<bts::blockchain::deposit_operation>();
+        if( bts::blockchain::withdraw_condition_types( deposit.condition.type ) == bts::blockchain::withdraw_signature_type )
+          involved.insert( deposit.condition.as<bts::blockchain::withdraw_with_signature>().owner );
+      }
+
+      publish( pending_transactions_topic, [&]( const subscription& sub ) -> fc::ovariant
+      {
+        for( const bts::blockchain::address& addr : involved )
+        {
+          if( sub.addresses.count( addr ) )
+            return fc::variant( fc::mutable_variant_object( "id", eval_state.trx.id() )( "transaction", eval_state.trx ) );
+        }
+        return fc::ovariant();
+      } );
+    }
+
     std::string rpc_server_impl::help(const std::string& command_name) const
     {
       std::string help_string;
@@ -744,6 +1678,8 @@ namespace bts { namespace rpc {
     {
       shutdown_rpc_server();
       wait_till_rpc_server_shutdown();
+      if( my->_observing_chain )
+        my->_client->get_chain()->remove_observer( my.get() );
       // just to be safe, destroy the  servers inside this try/catch block in case they throw
       my->_tcp_serv.reset();
       my->_httpd.reset();
@@ -758,7 +1694,6 @@ namespace bts { namespace rpc {
   {
     if (!cfg.is_valid())
       return false;
-    my->_cache_enabled = false;
 
     try
     {
@@ -797,11 +1732,10 @@ namespace bts { namespace rpc {
     if(!cfg.is_valid())
       return false;
 
-    my->_cache_enabled = false;
-
     try
     {
       my->_config = cfg;	  
+      my->load_static_assets();
 
       auto m = my.get();
       my->_httpd = std::make_shared<fc::http::server>();
@@ -826,6 +1760,7 @@ namespace bts { namespace rpc {
       }
 
       my->_httpd->on_request([m](const fc::http::request& r, const fc::http::server::response& s){ m->handle_request(r, s); });
+      my->observe_chain();
       return true;
     } FC_RETHROW_EXCEPTIONS(warn, "attempting to configure rpc server ${port}", ("port", cfg.rpc_endpoint)("config", cfg));
   }
@@ -904,6 +1839,9 @@ namespace bts { namespace rpc {
       my->_tcp_serv->close();
     if( my->_accept_loop_complete.valid() && !my->_accept_loop_complete.ready())
       my->_accept_loop_complete.cancel(__FUNCTION__);
+    for( auto& connection : my->_connection_tasks )
+      if( connection.valid() && !connection.ready() )
+        connection.cancel(__FUNCTION__);
   }
 
   std::string rpc_server::help(const std::string& command_name) const
@@ -916,6 +1854,69 @@ namespace bts { namespace rpc {
      return my->_method_map;
   }
 
+  fc::variant_object rpc_server::get_call_cache_stats() const
+  {
+    uint64_t total_hits = 0;
+    uint64_t total_misses = 0;
+    fc::mutable_variant_object methods;
+    for( const auto& item : my->_method_stats )
+    {
+      if( item.second.cache_hits == 0 && item.second.cache_misses == 0 )
+        continue;
+      total_hits += item.second.cache_hits;
+      total_misses += item.second.cache_misses;
+      methods[item.first] = fc::mutable_variant_object( "hits", item.second.cache_hits )( "misses", item.second.cache_misses );
+    }
+
+    fc::mutable_variant_object result;
+    result["hits"] = total_hits;
+    result["misses"] = total_misses;
+    result["head_block_entries"] = my->_head_block_call_cache.size();
+    result["immutable_entries"] = my->_immutable_call_cache.size();
+    result["head_block_invalidations"] = my->_call_cache_invalidations;
+    result["bytes"] = get_call_cache_memory_usage();
+    result["methods"] = methods;
+    return result;
+  }
+
+  uint64_t rpc_server::get_call_cache_memory_usage() const
+  {
+    uint64_t bytes = 0;
+    for( const std::unordered_map<uint64_t,string>* cache : { &my->_head_block_call_cache, &my->_immutable_call_cache } )
+      for( const auto& item : *cache )
+        bytes += sizeof( item ) + item.second.capacity() + 2 * sizeof( void* );
+    return bytes;
+  }
+
+  fc::variant_object rpc_server::get_method_stats() const
+  {
+    fc::mutable_variant_object methods;
+    for( const auto& item : my->_method_stats )
+    {
+      const detail::method_call_stats& stats = item.second;
+      fc::mutable_variant_object method;
+      method["calls"] = stats.calls;
+      method["errors"] = stats.errors;
+      method["average_latency_us"] = stats.calls ? stats.total_latency_us / stats.calls : 0;
+      method["max_latency_us"] = stats.max_latency_us;
+      method["rejected"] = stats.rejected;
+
+      /* bucket n counts the calls that took [2^n, 2^(n+1)) microseconds; trailing empty buckets are left out */
+      auto last_used = stats.latency_us.size();
+      while( last_used > 0 && stats.latency_us[last_used - 1] == 0 )
+        --last_used;
+      method["latency_histogram_log2_us"] = std::vector<uint64_t>( stats.latency_us.begin(), stats.latency_us.begin() + last_used );
+
+      method["http_replies"] = stats.replies;
+      method["average_reply_bytes"] = stats.replies ? stats.reply_bytes / stats.replies : 0;
+      method["max_reply_bytes"] = stats.max_reply_bytes;
+      if( stats.cache_hits || stats.cache_misses )
+        method["cache_hit_ratio"] = double( stats.cache_hits ) / ( stats.cache_hits + stats.cache_misses );
+      methods[item.first] = method;
+    }
+    return methods;
+  }
+
   fc::optional<fc::ip::endpoint> rpc_server::get_rpc_endpoint() const
   {
     if (my->_tcp_serv)
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <fc/optional.hpp>
+#include <fc/variant.hpp>
+
+namespace bts { namespace utilities {
+
+  const uint32_t max_json_depth = 512;
+
+  /**
+   *  Parses strict JSON straight from data into a variant, without copying the text into a string or
+   *  stream first.  Strings are found with a 16 byte at a time scan for their closing quote and are built
+   *  from the buffer in one copy when they have no escapes.  Values come out as fc::json::from_string
+   *  gives them: integers as uint64_t, or int64_t when negative, numbers with a decimal point as double.
+   *
+   *  @return an invalid optional for text it does not handle: anything outside strict JSON, exponents,
+   *          \\u escapes, integers over 19 digits and trailing text, all of which fc's parser treats
+   *          in its own ways
+   *  @throws fc::parse_error_exception if arrays and objects nest deeper than max_json_depth
+   */
+  fc::optional<fc::variant> try_parse_json( const char* data, size_t size );
+
+  /** try_parse_json, falling back to fc::json::from_string for what it does not handle */
+  fc::variant parse_json( const char* data, size_t size );
+
+} } // bts::utilities
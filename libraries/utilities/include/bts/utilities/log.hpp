@@ -0,0 +1,27 @@
+#pragma once
+
+#include <fc/log/logger.hpp>
+
+/**
+ *  Logging for code that runs per block or per transaction.
+ *
+ *  fc's logging macros build the variant arguments of a message before the logger gets to drop
+ *  it, which for a block or transaction costs more than the work being logged.  These check the
+ *  level of the default logger first and only then capture the arguments, and hot_dlog compiles
+ *  away entirely in release builds.  Arguments with side effects aren't evaluated when the
+ *  message is dropped.
+ */
+#define BTS_HOT_LOG( LOG_LEVEL, FORMAT, ... ) \
+  do { \
+    fc::logger bts_hot_log_logger = fc::logger::get( DEFAULT_LOGGER ); \
+    if( bts_hot_log_logger.is_enabled( fc::log_level::LOG_LEVEL ) ) \
+      bts_hot_log_logger.log( FC_LOG_MESSAGE( LOG_LEVEL, FORMAT, __VA_ARGS__ ) ); \
+  } while( 0 )
+
+#ifdef NDEBUG
+# define hot_dlog( FORMAT, ... ) do {} while( 0 )
+#else
+# define hot_dlog( FORMAT, ... ) BTS_HOT_LOG( debug, FORMAT, __VA_ARGS__ )
+#endif
+#define hot_ilog( FORMAT, ... ) BTS_HOT_LOG( info, FORMAT, __VA_ARGS__ )
+#define hot_wlog( FORMAT, ... ) BTS_HOT_LOG( warn, FORMAT, __VA_ARGS__ )
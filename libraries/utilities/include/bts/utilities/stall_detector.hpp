@@ -0,0 +1,78 @@
+#pragma once
+
+#include <fc/reflect/reflect.hpp>
+#include <fc/time.hpp>
+#include <fc/variant_object.hpp>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace bts { namespace utilities {
+
+  /**
+   *  @brief finds the tasks that keep an fc thread from running its other tasks
+   *
+   *  fc tasks are cooperative, so one that runs long without yielding holds up every other task of its
+   *  thread.  heartbeat_loop() runs as a task of a watched thread and sleeps a short interval at a time;
+   *  how late it wakes up is how long something ran on the thread without yielding.  Code that can run
+   *  for long without yielding is marked with a stall_detector::scope named like its fc::async
+   *  description, and a late heartbeat is blamed on the longest scope that ended on its thread since
+   *  the heartbeat before.
+   *
+   *  Scope durations and heartbeat delays are counted by name in power of two microsecond buckets.
+   *  Those over the threshold are also logged.
+   */
+  class stall_detector
+  {
+     public:
+        /** times the code from construction to destruction, which must not yield */
+        class scope
+        {
+           public:
+              /** @param description must outlive the scope, like the string literals given to fc::async */
+              explicit scope( const char* description );
+              ~scope();
+
+           private:
+              const char*    _description;
+              fc::time_point _start;
+        };
+
+        struct task_stats
+        {
+           uint64_t              count    = 0;
+           uint64_t              total_us = 0;
+           uint64_t              max_us   = 0;
+           std::vector<uint64_t> latency_histogram_log2_us;
+        };
+
+        static stall_detector& instance();
+
+        /** 0 stops the logging, the counting goes on */
+        void               set_threshold( const fc::microseconds& threshold );
+        fc::microseconds   get_threshold()const { return fc::microseconds( _threshold_us.load( std::memory_order_relaxed ) ); }
+
+        /** sleeps for interval at a time until canceled, counting how late each wake up is against the calling thread */
+        void               heartbeat_loop( const fc::microseconds& interval );
+
+        fc::variant_object get_stats()const;
+        void               clear();
+
+     private:
+        stall_detector();
+
+        void record( std::map<std::string, task_stats>& stats, const std::string& name, uint64_t elapsed_us );
+
+        std::atomic<int64_t>                 _threshold_us;
+        mutable std::mutex                   _mutex;
+        std::map<std::string, task_stats>    _tasks;      ///< scopes by description
+        std::map<std::string, task_stats>    _heartbeats; ///< heartbeat delays by thread name
+        std::map<std::string, task_stats>    _stalls;     ///< delays over the threshold by thread and the scope blamed
+  };
+
+} } // bts::utilities
+
+FC_REFLECT( bts::utilities::stall_detector::task_stats, (count)(total_us)(max_us)(latency_histogram_log2_us) )
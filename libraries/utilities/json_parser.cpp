@@ -0,0 +1,306 @@
+#include <bts/utilities/json_parser.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/io/json.hpp>
+#include <fc/variant_object.hpp>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define BTS_JSON_PARSER_SSE2
+#endif
+
+namespace bts { namespace utilities {
+
+  namespace {
+
+    /** the first '"' or '\\' in [pos, end), or end */
+    const char* find_quote_or_escape( const char* pos, const char* end )
+    {
+#ifdef BTS_JSON_PARSER_SSE2
+      const __m128i quote = _mm_set1_epi8( '"' );
+      const __m128i backslash = _mm_set1_epi8( '\\' );
+      while( end - pos >= 16 )
+      {
+        const __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pos ) );
+        const int mask = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( chunk, quote ),
+                                                          _mm_cmpeq_epi8( chunk, backslash ) ) );
+        if( mask != 0 )
+          return pos + __builtin_ctz( mask );
+        pos += 16;
+      }
+#endif
+      while( pos < end && *pos != '"' && *pos != '\\' )
+        ++pos;
+      return pos;
+    }
+
+    bool is_digit( char c ) { return c >= '0' && c <= '9'; }
+
+    /** a recursive descent parser of strict JSON; each parse_ function returns false on text it leaves to fc */
+    class strict_parser
+    {
+      public:
+        strict_parser( const char* data, size_t size )
+        :_pos( data ), _end( data + size ) {}
+
+        bool parse( fc::variant& result )
+        {
+          skip_whitespace();
+          if( !parse_value( result, 0 ) )
+            return false;
+          skip_whitespace();
+          return _pos == _end;
+        }
+
+      private:
+        void skip_whitespace()
+        {
+          while( _pos < _end && ( *_pos == ' ' || *_pos == '\n' || *_pos == '\r' || *_pos == '\t' ) )
+            ++_pos;
+        }
+
+        bool parse_value( fc::variant& result, uint32_t depth )
+        {
+          if( _pos == _end )
+            return false;
+
+          switch( *_pos )
+          {
+            case '{':
+              return parse_object( result, depth + 1 );
+            case '[':
+              return parse_array( result, depth + 1 );
+            case '"':
+            {
+              std::string str;
+              if( !parse_string( str ) )
+                return false;
+              result = fc::variant( std::move( str ) );
+              return true;
+            }
+            case 't':
+              result = fc::variant( true );
+              return parse_literal( "true", 4 );
+            case 'f':
+              result = fc::variant( false );
+              return parse_literal( "false", 5 );
+            case 'n':
+              result = fc::variant();
+              return parse_literal( "null", 4 );
+            default:
+              return parse_number( result );
+          }
+        }
+
+        bool parse_literal( const char* literal, size_t size )
+        {
+          if( size_t( _end - _pos ) < size || memcmp( _pos, literal, size ) != 0 )
+            return false;
+          _pos += size;
+          return true;
+        }
+
+        bool parse_object( fc::variant& result, uint32_t depth )
+        {
+          if( depth > max_json_depth )
+            FC_THROW_EXCEPTION( fc::parse_error_exception, "JSON nested deeper than ${max}", ("max",max_json_depth) );
+
+          ++_pos; // {
+          fc::mutable_variant_object obj;
+          skip_whitespace();
+          if( _pos < _end && *_pos == '}' )
+          {
+            ++_pos;
+            result = fc::variant( std::move( obj ) );
+            return true;
+          }
+
+          while( true )
+          {
+            std::string key;
+            fc::variant value;
+            if( _pos == _end || *_pos != '"' || !parse_string( key ) )
+              return false;
+            skip_whitespace();
+            if( _pos == _end || *_pos != ':' )
+              return false;
+            ++_pos;
+            skip_whitespace();
+            if( !parse_value( value, depth ) )
+              return false;
+            obj.set( std::move( key ), std::move( value ) );
+
+            skip_whitespace();
+            if( _pos == _end )
+              return false;
+            if( *_pos == '}' )
+            {
+              ++_pos;
+              result = fc::variant( std::move( obj ) );
+              return true;
+            }
+            if( *_pos != ',' )
+              return false;
+            ++_pos;
+            skip_whitespace();
+          }
+        }
+
+        bool parse_array( fc::variant& result, uint32_t depth )
+        {
+          if( depth > max_json_depth )
+            FC_THROW_EXCEPTION( fc::parse_error_exception, "JSON nested deeper than ${max}", ("max",max_json_depth) );
+
+          ++_pos; // [
+          fc::variants values;
+          skip_whitespace();
+          if( _pos < _end && *_pos == ']' )
+          {
+            ++_pos;
+            result = fc::variant( std::move( values ) );
+            return true;
+          }
+
+          while( true )
+          {
+            values.emplace_back();
+            if( !parse_value( values.back(), depth ) )
+              return false;
+
+            skip_whitespace();
+            if( _pos == _end )
+              return false;
+            if( *_pos == ']' )
+            {
+              ++_pos;
+              result = fc::variant( std::move( values ) );
+              return true;
+            }
+            if( *_pos != ',' )
+              return false;
+            ++_pos;
+            skip_whitespace();
+          }
+        }
+
+        bool parse_string( std::string& result )
+        {
+          ++_pos; // "
+          const char* stop = find_quote_or_escape( _pos, _end );
+          if( stop == _end )
+            return false;
+          if( *stop == '"' )
+          {
+            result.assign( _pos, stop );
+            _pos = stop + 1;
+            return true;
+          }
+
+          /* with escapes the string is built a run of plain text at a time */
+          while( true )
+          {
+            result.append( _pos, stop );
+            _pos = stop;
+            if( _pos == _end )
+              return false;
+            if( *_pos == '"' )
+            {
+              ++_pos;
+              return true;
+            }
+
+            ++_pos; // backslash
+            if( _pos == _end )
+              return false;
+            switch( *_pos )
+            {
+              case '"':  result += '"';  break;
+              case '\\': result += '\\'; break;
+              case '/':  result += '/';  break;
+              case 't':  result += '\t'; break;
+              case 'n':  result += '\n'; break;
+              case 'r':  result += '\r'; break;
+              default:   return false;
+            }
+            ++_pos;
+            stop = find_quote_or_escape( _pos, _end );
+          }
+        }
+
+        bool parse_number( fc::variant& result )
+        {
+          const char* start = _pos;
+          const bool negative = *_pos == '-';
+          if( negative )
+            ++_pos;
+
+          const char* digits = _pos;
+          bool dot = false;
+          while( _pos < _end && ( is_digit( *_pos ) || ( *_pos == '.' && !dot ) ) )
+          {
+            dot |= *_pos == '.';
+            ++_pos;
+          }
+
+          const size_t digit_count = _pos - digits - ( dot ? 1 : 0 );
+          if( digit_count == 0 || _pos[-1] == '.' )
+            return false;
+          /* fc reads a number running into letters, like an exponent, as a string */
+          if( _pos < _end && ( isalnum( static_cast<unsigned char>( *_pos ) ) || *_pos == '.' ) )
+            return false;
+
+          if( dot )
+          {
+            const std::string text( start, _pos );
+            result = fc::variant( strtod( text.c_str(), nullptr ) );
+            return true;
+          }
+
+          if( digit_count > 19 )
+            return false;
+          uint64_t value = 0;
+          for( const char* p = digits; p < _pos; ++p )
+            value = value * 10 + uint64_t( *p - '0' );
+          if( negative )
+          {
+            if( value > uint64_t( INT64_MAX ) )
+              return false;
+            result = fc::variant( -int64_t( value ) );
+          }
+          else
+          {
+            result = fc::variant( value );
+          }
+          return true;
+        }
+
+        const char* _pos;
+        const char* _end;
+    };
+
+  } // anonymous namespace
+
+  fc::optional<fc::variant> try_parse_json( const char* data, size_t size )
+  {
+    fc::variant result;
+    strict_parser parser( data, size );
+    if( !parser.parse( result ) )
+      return fc::optional<fc::variant>();
+    return result;
+  }
+
+  fc::variant parse_json( const char* data, size_t size )
+  {
+    auto result = try_parse_json( data, size );
+    if( result.valid() )
+      return std::move( *result );
+    return fc::json::from_string( std::string( data, size ) );
+  }
+
+} } // bts::utilities
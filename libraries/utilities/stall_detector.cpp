@@ -0,0 +1,137 @@
+#include <bts/utilities/stall_detector.hpp>
+
+#include <fc/log/logger.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <algorithm>
+#include <memory>
+
+namespace bts { namespace utilities {
+
+  namespace
+  {
+     /** the longest scope that ended on this thread since its last heartbeat */
+     struct longest_scope
+     {
+        const char* description = nullptr;
+        uint64_t    elapsed_us  = 0;
+     };
+     thread_local longest_scope longest_since_heartbeat;
+
+     size_t log2_bucket( uint64_t elapsed_us )
+     {
+        size_t bucket = 0;
+        while( elapsed_us > 1 )
+        {
+           elapsed_us >>= 1;
+           ++bucket;
+        }
+        return bucket;
+     }
+  }
+
+  stall_detector::scope::scope( const char* description )
+  :_description( description ),_start( fc::time_point::now() )
+  {
+  }
+
+  stall_detector::scope::~scope()
+  {
+     const uint64_t elapsed_us = std::max<int64_t>( ( fc::time_point::now() - _start ).count(), 0 );
+     if( elapsed_us > longest_since_heartbeat.elapsed_us )
+     {
+        longest_since_heartbeat.description = _description;
+        longest_since_heartbeat.elapsed_us = elapsed_us;
+     }
+
+     stall_detector& detector = stall_detector::instance();
+     detector.record( detector._tasks, _description, elapsed_us );
+     const int64_t threshold_us = detector._threshold_us.load( std::memory_order_relaxed );
+     if( threshold_us > 0 && elapsed_us > uint64_t( threshold_us ) )
+        wlog( "${task} ran for ${ms} ms without yielding", ("task",_description)("ms",elapsed_us / 1000) );
+  }
+
+  stall_detector& stall_detector::instance()
+  {
+     static std::unique_ptr<stall_detector> inst( new stall_detector() );
+     return *inst;
+  }
+
+  stall_detector::stall_detector()
+  :_threshold_us( 0 )
+  {
+  }
+
+  void stall_detector::set_threshold( const fc::microseconds& threshold )
+  {
+     _threshold_us.store( threshold.count(), std::memory_order_relaxed );
+  }
+
+  void stall_detector::heartbeat_loop( const fc::microseconds& interval )
+  {
+     const std::string thread_name = fc::thread::current().name();
+     longest_since_heartbeat = longest_scope();
+     while( true )
+     {
+        const fc::time_point due = fc::time_point::now() + interval;
+        fc::usleep( interval );
+        const uint64_t late_us = std::max<int64_t>( ( fc::time_point::now() - due ).count(), 0 );
+        const longest_scope blamed = longest_since_heartbeat;
+        longest_since_heartbeat = longest_scope();
+
+        record( _heartbeats, thread_name, late_us );
+        const int64_t threshold_us = _threshold_us.load( std::memory_order_relaxed );
+        if( threshold_us <= 0 || late_us <= uint64_t( threshold_us ) )
+           continue;
+
+        const std::string task = blamed.description != nullptr ? blamed.description : "an unmarked task";
+        record( _stalls, thread_name + ": " + task, late_us );
+        wlog( "thread ${thread} did not run its other tasks for ${ms} ms; the longest marked task since it last did was ${task} (${task_ms} ms)",
+              ("thread",thread_name)("ms",late_us / 1000)("task",task)("task_ms",blamed.elapsed_us / 1000) );
+     }
+  }
+
+  void stall_detector::record( std::map<std::string, task_stats>& stats, const std::string& name, uint64_t elapsed_us )
+  {
+     std::lock_guard<std::mutex> lock( _mutex );
+     task_stats& task = stats[ name ];
+     ++task.count;
+     task.total_us += elapsed_us;
+     task.max_us = std::max( task.max_us, elapsed_us );
+     const size_t bucket = log2_bucket( elapsed_us );
+     if( task.latency_histogram_log2_us.size() <= bucket )
+        task.latency_histogram_log2_us.resize( bucket + 1 );
+     ++task.latency_histogram_log2_us[ bucket ];
+  }
+
+  fc::variant_object stall_detector::get_stats()const
+  {
+     fc::mutable_variant_object tasks;
+     fc::mutable_variant_object heartbeats;
+     fc::mutable_variant_object stalls;
+     std::lock_guard<std::mutex> lock( _mutex );
+     for( const auto& item : _tasks )
+        tasks[ item.first ] = item.second;
+     for( const auto& item : _heartbeats )
+        heartbeats[ item.first ] = item.second;
+     for( const auto& item : _stalls )
+        stalls[ item.first ] = item.second;
+
+     fc::mutable_variant_object result;
+     result[ "threshold_us" ] = get_threshold().count();
+     result[ "tasks" ] = tasks;
+     result[ "heartbeats" ] = heartbeats;
+     result[ "stalls" ] = stalls;
+     return result;
+  }
+
+  void stall_detector::clear()
+  {
+     std::lock_guard<std::mutex> lock( _mutex );
+     _tasks.clear();
+     _heartbeats.clear();
+     _stalls.clear();
+  }
+
+} } // bts::utilities
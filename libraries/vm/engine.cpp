@@ -1,80 +1,345 @@
 #include <bts/vm/engine.hpp>
 
+#include <algorithm>
+
+/* gcc and clang can jump straight from one handler to the next instead of going back through a switch */
+#if defined( __GNUC__ )
+#  define BTS_VM_THREADED_DISPATCH
+#endif
+
 namespace bts { namespace vm {
-   void engine::execute( const vector<operation>& ops )
+
+   namespace
+   {
+      typedef engine::value value;
+
+      struct add_op  { template<typename T> T operator()( const T& a, const T& b )const { return a + b; } };
+      struct sub_op  { template<typename T> T operator()( const T& a, const T& b )const { return a - b; } };
+      struct mult_op { template<typename T> T operator()( const T& a, const T& b )const { return a * b; } };
+      struct div_op  { template<typename T> T operator()( const T& a, const T& b )const { return a / b; } };
+
+      struct lt_op   { template<typename T> bool operator()( const T& a, const T& b )const { return a < b; } };
+      struct gt_op   { template<typename T> bool operator()( const T& a, const T& b )const { return a > b; } };
+      struct lteq_op { template<typename T> bool operator()( const T& a, const T& b )const { return a <= b; } };
+      struct gteq_op { template<typename T> bool operator()( const T& a, const T& b )const { return a >= b; } };
+      struct eq_op   { template<typename T> bool operator()( const T& a, const T& b )const { return a == b; } };
+      struct neq_op  { template<typename T> bool operator()( const T& a, const T& b )const { return !(a == b); } };
+
+      inline bool is_number( const value& v )
+      {
+         return v.kind == value::int_kind || v.kind == value::real_kind;
+      }
+
+      inline double as_real( const value& v )
+      {
+         return v.kind == value::int_kind ? double( v.i ) : v.r;
+      }
+
+      /* two numbers stay unboxed; anything else goes through the variant operators */
+      template<typename Op>
+      void arithmetic( value& a, const value& b, Op op )
+      {
+         if( a.kind == value::int_kind && b.kind == value::int_kind )
+         {
+            a.i = op( a.i, b.i );
+         }
+         else if( is_number( a ) && is_number( b ) )
+         {
+            a.r = op( as_real( a ), as_real( b ) );
+            a.kind = value::real_kind;
+         }
+         else
+         {
+            a = value( op( a.to_variant(), b.to_variant() ) );
+         }
+      }
+
+      template<typename Op>
+      void compare( value& a, const value& b, Op op )
+      {
+         bool result;
+         if( a.kind == value::int_kind && b.kind == value::int_kind )
+            result = op( a.i, b.i );
+         else if( is_number( a ) && is_number( b ) )
+            result = op( as_real( a ), as_real( b ) );
+         else
+            result = op( a.to_variant(), b.to_variant() );
+
+         a.boxed = variant();
+         a.kind = value::bool_kind;
+         a.b = result;
+      }
+   }
+
+   engine::value::value( const variant& v )
+   : kind( null_kind ), i( 0 )
+   {
+      switch( v.get_type() )
+      {
+         case variant::null_type:
+            break;
+         case variant::int64_type:
+            kind = int_kind;
+            i = v.as_int64();
+            break;
+         case variant::uint64_type:
+            if( v.as_uint64() <= uint64_t( INT64_MAX ) )
+            {
+               kind = int_kind;
+               i = v.as_int64();
+            }
+            else
+            {
+               kind = variant_kind;
+               boxed = v;
+            }
+            break;
+         case variant::double_type:
+            kind = real_kind;
+            r = v.as_double();
+            break;
+         case variant::bool_type:
+            kind = bool_kind;
+            b = v.as_bool();
+            break;
+         default:
+            kind = variant_kind;
+            boxed = v;
+      }
+   }
+
+   variant engine::value::to_variant()const
+   {
+      switch( kind )
+      {
+         case int_kind:  return variant( i );
+         case real_kind: return variant( r );
+         case bool_kind: return variant( b );
+         case variant_kind: return boxed;
+         default: return variant();
+      }
+   }
+
+   engine::program engine::compile( const vector<operation>& ops )
+   {
+      program prog;
+      prog.code.reserve( ops.size() );
+
+      /* depth is relative to the top of the stack at entry; it goes negative when the program pops or
+       * reads values it did not push */
+      int32_t depth = 0;
+      int32_t lowest = 0;
+      int32_t highest = 0;
+
+      auto slot = [&]( int32_t index ) -> int32_t
+      {
+         lowest = std::min( lowest, index );
+         return index;
+      };
+
+      for( const operation& op : ops )
+      {
+         instruction ins;
+         ins.code = (op_code)op.code;
+         FC_ASSERT( ins.code <= PUSH_SIZE, "unknown op code ${c}", ("c",op.code) );
+
+         int32_t immediate = -1;
+         auto resolve = [&]( int16_t stack_index ) -> operand
+         {
+            operand result;
+            FC_ASSERT( stack_index >= 0, "negative stack offset ${i}", ("i",stack_index) );
+            if( stack_index == 0 )
+            {
+               if( immediate < 0 )
+               {
+                  immediate = prog.constants.size();
+                  prog.constants.emplace_back( op.arg0 );
+               }
+               result.immediate = true;
+               result.index = immediate;
+            }
+            else
+            {
+               result.immediate = false;
+               result.index = slot( depth - stack_index );
+            }
+            return result;
+         };
+
+         switch( ins.code )
+         {
+            case PUSH:
+            case PUSH_SIZE:
+               ins.arg1 = resolve( op.arg1 );
+               ++depth;
+               break;
+            case PUSH_CHILD:
+               ins.arg1 = resolve( op.arg1 );
+               ins.arg2 = resolve( op.arg2 );
+               ++depth;
+               break;
+            case SET:
+               FC_ASSERT( op.arg1 != 0 );
+               ins.arg1 = resolve( op.arg1 );
+               ins.arg2 = resolve( op.arg2 );
+               break;
+            case SET_CHILD:
+               FC_ASSERT( op.arg1 != 0 );
+               ins.arg1 = resolve( op.arg1 );
+               ins.arg2 = resolve( op.arg2 );
+               ins.arg3 = resolve( op.arg3 );
+               break;
+            case POP:
+               slot( depth - 1 );
+               --depth;
+               break;
+            case PUSH_INDEX:
+            case SET_INDEX:
+               break;
+            default: /* the binary and unary ops work on the top of the stack */
+               slot( depth - 1 );
+               ins.arg1 = resolve( op.arg1 );
+         }
+
+         highest = std::max( highest, depth );
+         prog.code.push_back( ins );
+      }
+
+      prog.min_stack = -lowest;
+      prog.max_growth = highest;
+      return prog;
+   }
+
+   void engine::execute( const program& prog )
+   {
+      if( prog.code.empty() ) return;
+
+      FC_ASSERT( stack.size() >= prog.min_stack, "program reads ${n} values below its own but the stack has ${s}",
+                 ("n",prog.min_stack)("s",stack.size()) );
+
+      /* nothing is pushed past the reserved size, so base stays valid for the whole run */
+      stack.reserve( stack.size() + prog.max_growth );
+      value* const base = stack.data() + stack.size();
+      const value* const constants = prog.constants.data();
+
+      auto load = [&]( const operand& o ) -> const value&
+      {
+         return o.immediate ? constants[ o.index ] : base[ o.index ];
+      };
+
+      const instruction* ip = prog.code.data();
+      const instruction* const end = ip + prog.code.size();
+
+#ifdef BTS_VM_THREADED_DISPATCH
+      /* in op_code order */
+      static const void* const handlers[] =
+      {
+         &&op_ADD, &&op_SUB, &&op_MULT, &&op_DIV, &&op_PUSH, &&op_LT, &&op_GT, &&op_LTEQ, &&op_GTEQ, &&op_EQ,
+         &&op_NEQ, &&op_NOT_OP, &&op_POP, &&op_PUSH_CHILD, &&op_SET_CHILD, &&op_PUSH_INDEX, &&op_SET_INDEX,
+         &&op_SET, &&op_PUSH_SIZE
+      };
+#  define VM_OP( name ) op_##name:
+#  define VM_NEXT()     if( ++ip == end ) goto done; goto *handlers[ ip->code ]
+      goto *handlers[ ip->code ];
+      {
+#else
+#  define VM_OP( name ) case name:
+#  define VM_NEXT()     continue
+      for( ; ip != end; ++ip ) switch( ip->code )
+      {
+#endif
+         VM_OP( PUSH )
+            stack.push_back( load( ip->arg1 ) );
+            VM_NEXT();
+         VM_OP( SET )
+            base[ ip->arg1.index ] = load( ip->arg2 );
+            VM_NEXT();
+         VM_OP( POP )
+            stack.pop_back();
+            VM_NEXT();
+         VM_OP( ADD )
+            arithmetic( stack.back(), load( ip->arg1 ), add_op() );
+            VM_NEXT();
+         VM_OP( MULT )
+            arithmetic( stack.back(), load( ip->arg1 ), mult_op() );
+            VM_NEXT();
+         VM_OP( SUB )
+            arithmetic( stack.back(), load( ip->arg1 ), sub_op() );
+            VM_NEXT();
+         VM_OP( DIV )
+         {
+            const value& divisor = load( ip->arg1 );
+            FC_ASSERT( !(stack.back().kind == value::int_kind && divisor.kind == value::int_kind && divisor.i == 0),
+                       "division by zero" );
+            arithmetic( stack.back(), divisor, div_op() );
+            VM_NEXT();
+         }
+         VM_OP( LT )
+            compare( stack.back(), load( ip->arg1 ), lt_op() );
+            VM_NEXT();
+         VM_OP( GT )
+            compare( stack.back(), load( ip->arg1 ), gt_op() );
+            VM_NEXT();
+         VM_OP( LTEQ )
+            compare( stack.back(), load( ip->arg1 ), lteq_op() );
+            VM_NEXT();
+         VM_OP( GTEQ )
+            compare( stack.back(), load( ip->arg1 ), gteq_op() );
+            VM_NEXT();
+         VM_OP( EQ )
+            compare( stack.back(), load( ip->arg1 ), eq_op() );
+            VM_NEXT();
+         VM_OP( NEQ )
+            compare( stack.back(), load( ip->arg1 ), neq_op() );
+            VM_NEXT();
+         VM_OP( NOT_OP )
+         {
+            const value& operand = load( ip->arg1 );
+            const bool result = operand.kind == value::bool_kind ? !operand.b : !operand.to_variant().as_bool();
+            value& top = stack.back();
+            top.boxed = variant();
+            top.kind = value::bool_kind;
+            top.b = result;
+            VM_NEXT();
+         }
+         VM_OP( PUSH_CHILD )
+         {
+            // read object from arg1 location, read child name from arg2 location and store a copy of the object at the end of the stack.
+            const value& object = load( ip->arg1 );
+            const value& name = load( ip->arg2 );
+            stack.emplace_back( object.boxed.get_object()[ name.boxed.get_string() ] );
+            VM_NEXT();
+         }
+         VM_OP( SET_CHILD )
+         {
+            value& object = base[ ip->arg1.index ];
+            fc::mutable_variant_object mutable_obj( object.boxed.get_object() );
+            mutable_obj[ load( ip->arg2 ).boxed.get_string() ] = load( ip->arg3 ).to_variant();
+            object.boxed = variant_object( std::move( mutable_obj ) );
+            VM_NEXT();
+         }
+         VM_OP( PUSH_INDEX )
+            VM_NEXT();
+         VM_OP( SET_INDEX )
+            VM_NEXT();
+         VM_OP( PUSH_SIZE ) // push number of items in array or object located at arg1
+            stack.emplace_back( variant( load( ip->arg1 ).to_variant().size() ) );
+            VM_NEXT();
+      }
+#ifdef BTS_VM_THREADED_DISPATCH
+done:
+      return;
+#endif
+#undef VM_OP
+#undef VM_NEXT
+   }
+
+   fc::variants engine::get_stack()const
    {
-       uint32_t pcount = 0;
-       if( ops.size() == 0 ) return;
-
-
-       while( pcount < ops.size() )
-       {
-          const operation& op = ops[pcount];
-          switch( (op_code)op.code )
-          {
-             case PUSH:
-                stack.emplace_back( get_value( op.arg0, op.arg1 ) );
-                break;
-             case SET:
-                FC_ASSERT( op.arg1 != 0 );
-                stack[ stack.size() - op.arg1 ] = get_value( op.arg0, op.arg2 );
-                break;
-             case POP:
-                stack.pop_back();
-                break;
-             case ADD:
-                stack.back() = stack.back() + get_value( op.arg0, op.arg1 ); 
-                break;
-             case MULT:
-                stack.back() = stack.back() * get_value( op.arg0, op.arg1 ); 
-                break;
-             case SUB:
-                stack.back() = stack.back() - get_value( op.arg0, op.arg1 ); 
-                break;
-             case DIV:
-                stack.back() = stack.back() / get_value( op.arg0, op.arg1 ); 
-                break;
-             case LT:
-                stack.back() = stack.back() < get_value( op.arg0, op.arg1 ); 
-                break;
-             case GT:
-                stack.back() = stack.back() > get_value( op.arg0, op.arg1 ); 
-                break;
-             case LTEQ:
-                stack.back() = stack.back() <= get_value( op.arg0, op.arg1 ); 
-                break;
-             case GTEQ:
-                stack.back() = stack.back() >= get_value( op.arg0, op.arg1 ); 
-                break;
-             case EQ:
-                stack.back() = stack.back() == get_value( op.arg0, op.arg1 ); 
-                break;
-             case NEQ:
-                stack.back() = !(stack.back() == get_value( op.arg0, op.arg1 ) ); 
-                break;
-             case NOT_OP:
-                stack.back() = !get_value( op.arg0, op.arg1 ).as_bool();
-                break;
-             case PUSH_CHILD: 
-                // read object from arg1 location, read child name from arg2 location and store a copy of the object at the end of the stack.
-                stack.emplace_back( get_object( op.arg0, op.arg1 )[ get_string( op.arg0, op.arg2 )] );
-                break;
-             case SET_CHILD: 
-             {
-                fc::mutable_variant_object mutable_obj( get_object( op.arg1 ) );
-                mutable_obj[ get_string( op.arg0, op.arg2 )] = get_value( op.arg0, op.arg3 );
-                get_object( op.arg1 ) = std::move(mutable_obj);
-             }
-             break;
-             case PUSH_INDEX: 
-                break;
-             case SET_INDEX: 
-                break;
-             case PUSH_SIZE: // push number of items in array or object located at arg1
-                stack.emplace_back( variant(get_value( op.arg0, op.arg1 ).size()) );
-                break;
-          };
-          ++pcount;
-       }
+      fc::variants result;
+      result.reserve( stack.size() );
+      for( const value& v : stack )
+         result.push_back( v.to_variant() );
+      return result;
    }
-}} 
+}}
@@ -2,6 +2,8 @@
 #include <fc/reflect/reflect.hpp>
 #include <fc/exception/exception.hpp>
 #include <fc/io/enum_type.hpp>
+#include <fc/variant.hpp>
+#include <fc/variant_object.hpp>
 #include <vector>
 
 namespace bts { namespace vm {
@@ -44,30 +46,70 @@ namespace bts { namespace vm {
              fc::variant                     arg0;
           };
 
-          void execute( const vector<operation>& ops );
-
-          const variant&      get_value( const variant& op_value, uint16_t stack_index )
+          /** an operand or stack slot: numbers and bools are kept unboxed, anything else as a variant */
+          struct value
           {
-             return stack_index ? stack[stack.size() - stack_index] : op_value;
-          }
+             enum kind_type : uint8_t
+             {
+                null_kind,
+                int_kind,
+                real_kind,
+                bool_kind,
+                variant_kind
+             };
+
+             value() : kind( null_kind ), i( 0 ) {}
+             explicit value( const variant& v );
+
+             variant to_variant()const;
 
-          fc::variant_object& get_object( uint16_t stack_index )
+             kind_type    kind;
+             union
+             {
+                int64_t   i;
+                double    r;
+                bool      b;
+             };
+             variant      boxed;
+          };
+
+          /** where an instruction reads an argument: one of the program's constants, or a slot relative to
+           *  the top of the stack at entry to the program */
+          struct operand
           {
-             FC_ASSERT( stack_index != 0 );
-             return stack[stack.size()-stack_index].get_object();
-          }
+             bool         immediate = true;
+             int32_t      index = 0;
+          };
 
-          const fc::variant_object& get_object( const variant& op_value, uint16_t stack_index )
+          struct instruction
           {
-             return stack_index ? stack[stack.size()-stack_index].get_object() : op_value.get_object();
-          }
-          const std::string& get_string( const variant& op_value, uint16_t stack_index )
+             op_code      code;
+             operand      arg1;
+             operand      arg2;
+             operand      arg3;
+          };
+
+          /**
+           *  operations with their stack offsets resolved against a stack depth that is tracked while compiling,
+           *  so execute checks the stack once on entry instead of on every operand
+           */
+          struct program
           {
-             return stack_index ? stack[stack.size()-stack_index].get_string() : op_value.get_string();
-          }
+             vector<instruction> code;
+             vector<value>       constants;
+             uint32_t            min_stack = 0;  /** values the program reads from below its own pushes */
+             uint32_t            max_growth = 0; /** most values the program has pushed at any one time */
+          };
+
+          static program compile( const vector<operation>& ops );
+
+          void execute( const program& prog );
+          void execute( const vector<operation>& ops ) { execute( compile( ops ) ); }
+
+          fc::variants get_stack()const;
 
        private:
-          fc::variants stack;
+          vector<value> stack;
    };
 
 } }
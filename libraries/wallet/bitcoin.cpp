@@ -25,8 +25,11 @@ uint32_t wallet::import_bitcoin_wallet(
    FC_ASSERT( is_unlocked() );
 
    auto keys = bitcoin::import_bitcoin_wallet( wallet_dat, wallet_dat_passphrase );
-   for( const auto& key : keys )
-      import_private_key( key, account_name );
+   {
+      wallet_db_batch batch( my->_wallet_db );
+      for( const auto& key : keys )
+         import_private_key( key, account_name );
+   }
 
    scan_chain( 0, 1 );
    ulog( "Successfully imported ${x} keys from ${file}", ("x",keys.size())("file",wallet_dat.filename()) );
@@ -48,8 +51,11 @@ uint32_t wallet::import_multibit_wallet(
 
    auto keys = bitcoin::import_multibit_wallet( wallet_dat, wallet_dat_passphrase );
 
-   for( const auto& key : keys )
-      import_private_key( key, account_name );
+   {
+      wallet_db_batch batch( my->_wallet_db );
+      for( const auto& key : keys )
+         import_private_key( key, account_name );
+   }
 
    scan_chain( 0, 1 );
    ulog( "Successfully imported ${x} keys from ${file}", ("x",keys.size())("file",wallet_dat.filename()) );
@@ -71,8 +77,11 @@ uint32_t wallet::import_electrum_wallet(
 
    auto keys = bitcoin::import_electrum_wallet( wallet_dat, wallet_dat_passphrase );
 
-   for( const auto& key : keys )
-      import_private_key( key, account_name );
+   {
+      wallet_db_batch batch( my->_wallet_db );
+      for( const auto& key : keys )
+         import_private_key( key, account_name );
+   }
 
    scan_chain( 0, 1 );
    ulog( "Successfully imported ${x} keys from ${file}", ("x",keys.size())("file",wallet_dat.filename()) );
@@ -94,8 +103,11 @@ uint32_t wallet::import_armory_wallet(
 
    auto keys = bitcoin::import_armory_wallet( wallet_dat, wallet_dat_passphrase );
 
-   for( const auto& key : keys )
-      import_private_key( key, account_name );
+   {
+      wallet_db_batch batch( my->_wallet_db );
+      for( const auto& key : keys )
+         import_private_key( key, account_name );
+   }
 
    scan_chain( 0, 1 );
    ulog( "Successfully imported ${x} keys from ${file}", ("x",keys.size())("file",wallet_dat.filename()) );
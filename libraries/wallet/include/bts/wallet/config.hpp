@@ -10,3 +10,12 @@
 #define BTS_WALLET_DEFAULT_TRANSACTION_FEE              100000 // 1 XCL
 
 #define BTS_WALLET_DEFAULT_TRANSACTION_EXPIRATION_SEC   3600
+
+/** a rescan decrypts the memos of this many blocks at once on the scanner threads before it applies them in order */
+#define BTS_WALLET_SCAN_CHUNK_SIZE                      100
+
+/** how many child keys past the last used one of each account a rescan recognizes, unless the key_lookahead setting says otherwise */
+#define BTS_WALLET_DEFAULT_KEY_LOOKAHEAD                20
+
+/** a wallet_host keeps the wallets it hosts unlocked this long */
+#define BTS_WALLET_HOST_UNLOCK_TIME_SEC                 (60*60*24*365)
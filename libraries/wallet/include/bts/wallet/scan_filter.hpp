@@ -0,0 +1,34 @@
+#pragma once
+
+#include <bts/blockchain/address.hpp>
+#include <bts/blockchain/types.hpp>
+
+#include <vector>
+
+namespace bts { namespace wallet {
+   using namespace bts::blockchain;
+
+   /**
+    *  A bloom filter over the addresses and account ids the wallet holds private keys for. A rescan tests the
+    *  addresses and accounts a transaction touches against it, and only runs the full scan_transaction on a hit;
+    *  a false positive costs that full scan, there are no false negatives.
+    */
+   class scan_filter
+   {
+      public:
+         explicit scan_filter( size_t expected_items );
+
+         void insert( const address& addr );
+         void insert( const account_id_type& account_id );
+
+         bool may_contain( const address& addr )const;
+         bool may_contain( const account_id_type& account_id )const;
+
+      private:
+         void insert( uint64_t hash );
+         bool may_contain( uint64_t hash )const;
+
+         std::vector<uint64_t> _bits;
+   };
+
+} } // bts::wallet
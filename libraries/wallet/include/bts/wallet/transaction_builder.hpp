@@ -231,6 +231,15 @@ namespace bts { namespace wallet {
        *partially signed transaction. To determine if all necessary signatures are present, use the is_signed() method.
        */
       wallet_transaction_record& sign();
+      /**
+       * @brief The two halves of sign(), for signing many transactions at once
+       *
+       * signing_keys() sets the expiration and returns the keys the wallet has for the required signatures. The
+       * transaction may then be signed with them on any thread, after which cache() completes the notices and caches
+       * it in the wallet.
+       */
+      std::vector<fc::ecc::private_key> signing_keys();
+      wallet_transaction_record& cache();
       bool is_signed() const
       {
          return required_signatures.size() == trx.signatures.size();
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <bts/blockchain/address.hpp>
+#include <bts/blockchain/types.hpp>
+
+#include <fc/crypto/sha256.hpp>
+#include <fc/crypto/sha512.hpp>
+#include <fc/optional.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+namespace bts { namespace wallet {
+
+   using bts::blockchain::address;
+   using bts::blockchain::private_key_type;
+
+   /**
+    *  @brief the private keys a wallet has decrypted while it is unlocked
+    *
+    *  The key secrets are kept in pages of their own that are locked in memory where the OS allows it, so
+    *  they are not swapped out, and left out of core dumps where it supports that.  clear() zeroes the
+    *  pages before giving them back.  The cache only answers for the password it was enabled with, so
+    *  keys decrypted with any other password are never mixed in.
+    *
+    *  Like the wallet_db that owns it, it is only used from the wallet's thread.
+    */
+   class unlocked_key_cache
+   {
+      public:
+         unlocked_key_cache();
+         ~unlocked_key_cache();
+
+         unlocked_key_cache( const unlocked_key_cache& ) = delete;
+         unlocked_key_cache& operator=( const unlocked_key_cache& ) = delete;
+
+         /** drops any cached keys and starts caching the keys decrypted with password */
+         void enable( const fc::sha512& password );
+         /** zeroes and frees the cached keys and stops caching until the next enable */
+         void clear();
+
+         bool   is_enabled_for( const fc::sha512& password )const;
+         size_t size()const { return _secrets.size(); }
+
+         fc::optional<private_key_type> get( const address& key_address )const;
+         void                           store( const address& key_address, const private_key_type& key );
+
+      private:
+         char* allocate_secret();
+
+         struct page
+         {
+            char*  data = nullptr;
+            bool   locked = false;
+         };
+
+         std::vector<page>                   _pages;
+         size_t                              _page_size;
+         size_t                              _used_in_last_page;
+         std::unordered_map<address, char*>  _secrets;
+         bool                                _enabled;
+         /** the hash of the password the keys were decrypted with, so the password itself is not copied */
+         fc::sha256                          _password_hash;
+   };
+
+} } // bts::wallet
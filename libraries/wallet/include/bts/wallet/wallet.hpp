@@ -19,6 +19,15 @@ namespace bts { namespace wallet {
    typedef map<string, int64_t> account_vote_summary_type;
    typedef std::pair<order_type_enum, vector<string>> order_description;
 
+   /** one transfer of wallet::transfer_batch, with the arguments of wallet_transfer */
+   struct transfer_request
+   {
+       string amount;
+       string asset_symbol;
+       string to_account_name;
+       string memo_message;
+   };
+
    enum delegate_status_flags
    {
        any_delegate_status      = 0x00,
@@ -57,6 +66,7 @@ namespace bts { namespace wallet {
          bool    is_enabled()const;
          bool    is_open()const;
          string  get_wallet_name()const;
+         variant_object get_memory_stats()const;
 
          void    export_to_json( const path& filename )const;
          void    create_from_json( const path& filename, const string& wallet_name, const string& passphrase );
@@ -127,6 +137,17 @@ namespace bts { namespace wallet {
 
          void scan_chain( uint32_t start = 0, uint32_t end = -1, bool fast_scan = false );
 
+         /**
+          *  A hosted wallet leaves reading blocks to its wallet_host, which reads each block once for all the
+          *  wallets it hosts; it does not scan on its own when unlocked or when a block it cannot settle arrives.
+          */
+         void set_hosted( bool hosted );
+         bool is_hosted()const;
+         /** settles the block from its applied changes if it concerns nothing in the wallet, false if it must be scanned */
+         bool settle_block( const block_summary& summary );
+         /** applies blocks, consecutive from first_block_num and already read from the chain, as scan_chain would */
+         void scan_blocks( uint32_t first_block_num, const vector<full_block>& blocks );
+
          wallet_transaction_record         scan_transaction( const string& transaction_id_prefix, bool overwrite_existing );
          transaction_ledger_entry          scan_transaction_experimental( const string& transaction_id_prefix, bool overwrite_existing );
 
@@ -277,6 +298,19 @@ namespace bts { namespace wallet {
                  bool sign = true
                  );
 
+         /**
+          *  Builds, signs and caches one transaction for each transfer, all paid by paying_account_name. The
+          *  inputs of every transaction are selected before any of them is signed, without selecting the same
+          *  balance twice, then they are signed on the scanner threads and stored in one wallet write.
+          *
+          *  @return the builders, whose records are ready to broadcast and whose notifications are ready to send
+          */
+         vector<transaction_builder_ptr> transfer_batch(
+                 const string& paying_account_name,
+                 const vector<transfer_request>& transfers,
+                 vote_selection_method selection_method = vote_recommended
+                 );
+
          /**
           *  This transfer works like a bitcoin transaction combining multiple inputs
           *  and producing a single output.
@@ -476,11 +510,13 @@ namespace bts { namespace wallet {
          vector<wallet_transaction_record>  get_transaction_history( const string& account_name = string(),
                                                                      uint32_t start_block_num = 0,
                                                                      uint32_t end_block_num = -1,
-                                                                     const string& asset_symbol = "" )const;
+                                                                     const string& asset_symbol = "",
+                                                                     int32_t limit = 0 )const;
          vector<pretty_transaction>         get_pretty_transaction_history( const string& account_name = string(),
                                                                             uint32_t start_block_num = 0,
                                                                             uint32_t end_block_num = -1,
-                                                                            const string& asset_symbol = "" )const;
+                                                                            const string& asset_symbol = "",
+                                                                            int32_t limit = 0 )const;
 
          void                               remove_transaction_record( const string& record_id );
 
@@ -518,3 +554,4 @@ namespace bts { namespace wallet {
 } } // bts::wallet
 
 FC_REFLECT_ENUM( bts::wallet::vote_selection_method, (vote_none)(vote_all)(vote_random)(vote_recommended) )
+FC_REFLECT( bts::wallet::transfer_request, (amount)(asset_symbol)(to_account_name)(memo_message) )
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <bts/wallet/unlocked_key_cache.hpp>
 #include <bts/wallet/wallet_records.hpp>
 
+#include <tuple>
+
 namespace bts { namespace wallet {
 
    namespace detail { class wallet_db_impl; }
@@ -17,12 +20,28 @@ namespace bts { namespace wallet {
 
          bool is_open()const;
 
+         /** approximate bytes held by the in-memory record maps and indexes, by map */
+         variant_object get_memory_stats()const;
+
+         /**
+          *  Collects every record write until the matching commit_batch into one synced LevelDB write. Batches
+          *  nest and only the outermost commit writes; lookups see the batched records. See wallet_db_batch.
+          */
+         void begin_batch();
+         void commit_batch();
+
          private_key_type   get_private_key( const fc::sha512& password, int index );
 
          private_key_type   new_private_key( const fc::sha512& password,
                                              const address& parent_account_address = address(),
                                              bool store_key = true );
 
+         extended_private_key    get_master_private_key( const fc::sha512& password )const;
+         /** the key new_private_key derives for parent_account_address at key_index */
+         static private_key_type derive_child_key( const extended_private_key& master_key,
+                                                   const address& parent_account_address,
+                                                   int32_t key_index );
+
          void        set_property( const property_enum property_id, const fc::variant& v, const bool sync = true );
          fc::variant get_property( const property_enum property_id )const;
 
@@ -39,7 +58,18 @@ namespace bts { namespace wallet {
 
          vector<wallet_transaction_record> get_pending_transactions()const;
 
+         /** reads the record from disk; transactions are not kept in memory */
          owallet_transaction_record lookup_transaction( const transaction_id_type& record_id )const;
+         vector<transaction_id_type> get_transaction_ids()const;
+
+         /**
+          *  Keeps the private keys decrypted with password until clear_unlocked_keys, so that scanning and
+          *  signing stop decrypting them again on every call. See unlocked_key_cache.
+          */
+         void                          cache_unlocked_keys( const fc::sha512& password );
+         void                          clear_unlocked_keys();
+         /** the private key of addr decrypted with password, served from the unlocked key cache when it can be */
+         optional<private_key_type>    lookup_private_key( const address& addr, const fc::sha512& password )const;
 
          map<private_key_type, string> get_account_private_keys( const fc::sha512& password )const;
          string                        get_account_name( const address& account_address )const;
@@ -50,6 +80,11 @@ namespace bts { namespace wallet {
 
          vector<wallet_balance_record>  get_all_balances( const string& account_name, uint32_t limit );
          owallet_balance_record lookup_balance( const balance_id_type& balance_id )const;
+         /** calls visit with the cached balances of asset_id, largest first, until it returns false */
+         void visit_balances_by_amount( asset_id_type asset_id, const function<bool( const wallet_balance_record& )>& visit )const;
+         /** the cached balances summed per owning account and asset, an empty account_name means all accounts */
+         map<string, map<asset_id_type, share_type>> get_account_balance_totals( const string& account_name )const;
+         map<string, vector<balance_id_type>>        get_account_balance_ids( const string& account_name )const;
          owallet_key_record     lookup_key( const address& address )const;
 
 
@@ -80,10 +115,15 @@ namespace bts { namespace wallet {
          void                           change_password( const fc::sha512& old_password,
                                                          const fc::sha512& new_password );
 
-         const unordered_map< transaction_id_type, wallet_transaction_record >& get_transactions()const
-         {
-            return transactions;
-         }
+         /** reads every transaction record from disk, for history queries; use lookup_transaction for one */
+         unordered_map< transaction_id_type, wallet_transaction_record > get_transactions()const;
+         /**
+          *  Calls visit with the transactions between start_block_num and end_block_num in history order, or the
+          *  reverse of it, until it returns false; only the visited records are read from disk. History order is
+          *  confirmed transactions by block and time, then pending ones by time.
+          */
+         void visit_transaction_history( uint32_t start_block_num, uint32_t end_block_num, bool reverse,
+                                         const function<bool( const wallet_transaction_record& )>& visit )const;
          const unordered_map< balance_id_type,wallet_balance_record >& get_balances()const
          {
             return balances;
@@ -106,7 +146,6 @@ namespace bts { namespace wallet {
          /** maps wallet_record_index to accounts */
          unordered_map<int32_t, wallet_account_record>                  accounts;
          unordered_map<address, wallet_key_record>                      keys;
-         unordered_map<transaction_id_type, wallet_transaction_record>  transactions;
          unordered_map<balance_id_type,wallet_balance_record>           balances;
          map<property_enum, wallet_property_record>                     properties;
          map<string, wallet_setting_record>                             settings;
@@ -119,10 +158,24 @@ namespace bts { namespace wallet {
          // Cache to lookup keys
          unordered_map<address, address>                                btc_to_bts_address;
 
-         // Cache to lookup transactions
-         unordered_map<transaction_id_type, transaction_id_type>        id_to_transaction_record_index;
+         // Cache to select balances: the balances of each asset ordered by amount
+         map<asset_id_type, set<pair<share_type, balance_id_type>>>    balance_ids_by_amount;
+         // Running totals of the cached balances per owner and asset, folded into accounts when queried
+         unordered_map<address, map<asset_id_type, share_type>>         balance_totals_by_owner;
+
+         // Transactions stay on disk; these index them by record id and track the pending ones
+         unordered_map<transaction_id_type, int32_t>                    transaction_record_indexes;
+         unordered_set<transaction_id_type>                             unconfirmed_transaction_ids;
+
+         // Orders the transactions for visit_transaction_history: (pending, block_num, timestamp, record_id)
+         typedef std::tuple<bool, uint32_t, time_point_sec, transaction_id_type> transaction_history_key;
+         set<transaction_history_key>                                   transaction_history_index;
+         unordered_map<transaction_id_type, transaction_history_key>    transaction_history_keys;
 
          void remove_item( int32_t index );
+         void unindex_balance( const balance_id_type& balance_id );
+         /** the name of the account holding the private key for owner, empty if the wallet has no such key */
+         string owner_account_name( const address& owner )const;
          /**
           *  This is private
           */
@@ -140,4 +193,25 @@ namespace bts { namespace wallet {
         unique_ptr<detail::wallet_db_impl> my;
    };
 
+   /** keeps a wallet_db batch open for its lifetime, e.g. while one block is scanned or one file imported */
+   class wallet_db_batch
+   {
+      public:
+         explicit wallet_db_batch( wallet_db& db ) : _db( db ) { _db.begin_batch(); }
+         ~wallet_db_batch()
+         {
+            try
+            {
+               _db.commit_batch();
+            }
+            catch( const fc::exception& e )
+            {
+               elog( "Error committing wallet batch: ${e}", ("e",e.to_detail_string()) );
+            }
+         }
+
+      private:
+         wallet_db& _db;
+   };
+
 } } // bts::wallet
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <bts/wallet/wallet.hpp>
+
+namespace bts { namespace wallet {
+
+   /**
+    *  Keeps many wallets of one data directory open and unlocked at once and scans the chain for all of them
+    *  together: each block is read from the chain once and handed to every hosted wallet that still needs it,
+    *  instead of every wallet running its own scan_chain over the same blocks.
+    */
+   class wallet_host : public chain_observer
+   {
+      public:
+         wallet_host( chain_database_ptr chain, const path& data_dir );
+         virtual ~wallet_host();
+
+         wallet_ptr      open_wallet( const string& wallet_name, const string& password );
+         void            close_wallet( const string& wallet_name );
+         void            close_all();
+
+         wallet_ptr      get_wallet( const string& wallet_name )const;
+         vector<string>  list_wallets()const;
+
+         /** brings every hosted wallet up to the head block, reading from the earliest block any of them needs */
+         void            scan_chain();
+
+         virtual void state_changed( const pending_chain_state_ptr& state )override {}
+         virtual void block_applied( const block_summary& summary )override;
+
+      private:
+         chain_database_ptr         _chain;
+         path                       _data_dir;
+         map<string, wallet_ptr>    _wallets;
+   };
+
+   typedef shared_ptr<wallet_host> wallet_host_ptr;
+
+} } // bts::wallet
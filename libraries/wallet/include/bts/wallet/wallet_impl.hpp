@@ -1,5 +1,6 @@
 #pragma once
 
+#include <bts/wallet/scan_filter.hpp>
 #include <bts/wallet/wallet_db.hpp>
 
 #include <bts/blockchain/account_operations.hpp>
@@ -14,6 +15,7 @@ class wallet_impl : public chain_observer
    public:
        wallet*                                    self = nullptr;
        bool                                       _is_enabled = true;
+       bool                                       _is_hosted = false;
        wallet_db                                  _wallet_db;
        chain_database_ptr                         _blockchain;
        path                                       _data_directory;
@@ -27,6 +29,34 @@ class wallet_impl : public chain_observer
        vector<std::unique_ptr<fc::thread>>        _scanner_threads;
        float                                      _scan_progress = 0;
 
+       /**
+        *  Memo decryption results for the deposits of the blocks scan_chain_task is applying, by hash of the
+        *  deposit condition; the key is the one that decrypted the memo, or the result is invalid if none did.
+        *  See prescan_memos.
+        */
+       unordered_map<fc::ripemd160, pair<private_key_type, omemo_status>> _prescanned_memos;
+
+       /** the wallet's addresses and accounts while scan_chain_task runs, see transaction_may_concern_wallet */
+       std::unique_ptr<scan_filter>               _scan_filter;
+
+       /**
+        *  The account and child key index of the keys each of the wallet's accounts would generate next, by every
+        *  address form of them. A scan that sees one of these used generates the account's keys up to it.
+        *  See refill_key_lookahead.
+        */
+       struct lookahead_key
+       {
+           address                                account_address;
+           int32_t                                gen_seq_number = 0;
+       };
+       unordered_map<address, lookahead_key>      _key_lookahead;
+
+       /**
+        *  While wallet::transfer_batch plans its transactions, the amounts they withdraw from each balance. None of
+        *  them is in the pending state yet, so withdraw_to_transaction leaves these amounts alone. Null otherwise.
+        */
+       unordered_map<balance_id_type, share_type>* _planned_withdrawals = nullptr;
+
        struct login_record
        {
            private_key_type key;
@@ -63,6 +93,8 @@ class wallet_impl : public chain_observer
        *  This method is called anytime a block is applied to the chain.
        */
       virtual void block_applied( const block_summary& summary )override;
+      bool block_needs_scan( const block_summary& summary )const;
+      void apply_account_changes( const pending_chain_state& changes );
 
       void scan_market_transaction(
               const market_transaction& mtrx,
@@ -77,6 +109,13 @@ class wallet_impl : public chain_observer
       void scan_state();
 
       void scan_block( uint32_t block_num, const vector<private_key_type>& keys, const time_point_sec& received_time );
+      void scan_block( uint32_t block_num, const full_block& block, const vector<private_key_type>& keys, const time_point_sec& received_time );
+      void prescan_memos( const vector<full_block>& blocks, const vector<private_key_type>& keys );
+      void build_scan_filter();
+      uint32_t earliest_key_birth()const;
+      bool transaction_may_concern_wallet( const signed_transaction& transaction )const;
+      void refill_key_lookahead();
+      void claim_lookahead_keys( const signed_transaction& transaction );
 
       wallet_transaction_record scan_transaction(
               const signed_transaction& transaction,
@@ -143,6 +182,8 @@ class wallet_impl : public chain_observer
 
       void scan_balances();
       void scan_registered_accounts();
+      share_type planned_withdrawal( const balance_id_type& balance_id )const;
+      void plan_withdrawal( const balance_id_type& balance_id, share_type amount );
       void withdraw_to_transaction( const asset& amount_to_withdraw,
                                     const string& from_account_name,
                                     signed_transaction& trx,
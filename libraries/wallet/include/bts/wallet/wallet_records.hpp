@@ -81,7 +81,8 @@ namespace bts { namespace wallet {
       transaction_scanning,
       last_unlocked_scanned_block_number,
       default_transaction_priority_fee,
-      transaction_expiration_sec
+      transaction_expiration_sec,
+      wallet_birth_block_num
    };
 
    /** Used to store key/value property pairs.
@@ -144,6 +145,10 @@ namespace bts { namespace wallet {
         * relative to the account address.
         */
        uint32_t                 gen_seq_number = 0;
+       /** the head block when the key was created, before which it cannot have been used; unset for
+        * imported keys and keys of wallets restored from a brain key, which may have been used at any time
+        */
+       optional<uint32_t>       birth_block_num;
 
        address                  get_address()const { return address( public_key ); }
        bool                     has_private_key()const;
@@ -296,6 +301,7 @@ FC_REFLECT_ENUM( bts::wallet::property_enum,
         (last_unlocked_scanned_block_number)
         (default_transaction_priority_fee)
         (transaction_expiration_sec)
+        (wallet_birth_block_num)
         )
 
 FC_REFLECT( bts::wallet::wallet_property,
@@ -325,6 +331,7 @@ FC_REFLECT( bts::wallet::key_data,
         (valid_from_signature)
         (memo)
         (gen_seq_number)
+        (birth_block_num)
         )
 
 FC_REFLECT( bts::wallet::ledger_entry,
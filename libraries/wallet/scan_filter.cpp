@@ -0,0 +1,67 @@
+#include <bts/wallet/scan_filter.hpp>
+
+#include <fc/crypto/city.hpp>
+
+namespace bts { namespace wallet {
+
+   namespace
+   {
+      /* about 1% false positives at 10 bits per item */
+      const size_t   bits_per_item = 10;
+      const uint32_t num_hashes    = 7;
+
+      /* account ids are hashed with a different seed so they cannot collide with addresses on purpose */
+      const uint64_t account_id_seed = 0x9e3779b97f4a7c15ULL;
+   }
+
+   scan_filter::scan_filter( size_t expected_items )
+   : _bits( std::max<size_t>( 1, (expected_items * bits_per_item + 63) / 64 ) )
+   {
+   }
+
+   void scan_filter::insert( const address& addr )
+   {
+      insert( fc::city_hash64( addr.addr.data(), addr.addr.data_size() ) );
+   }
+
+   void scan_filter::insert( const account_id_type& account_id )
+   {
+      insert( fc::city_hash64( (const char*)&account_id.value, sizeof( account_id.value ) ) ^ account_id_seed );
+   }
+
+   bool scan_filter::may_contain( const address& addr )const
+   {
+      return may_contain( fc::city_hash64( addr.addr.data(), addr.addr.data_size() ) );
+   }
+
+   bool scan_filter::may_contain( const account_id_type& account_id )const
+   {
+      return may_contain( fc::city_hash64( (const char*)&account_id.value, sizeof( account_id.value ) ) ^ account_id_seed );
+   }
+
+   /* the bit positions are derived from the one hash by double hashing */
+   void scan_filter::insert( uint64_t hash )
+   {
+      const uint64_t num_bits = _bits.size() * 64;
+      const uint64_t step = (hash >> 32) | 1;
+      for( uint32_t i = 0; i < num_hashes; ++i )
+      {
+         const uint64_t bit = (hash + i * step) % num_bits;
+         _bits[ bit / 64 ] |= uint64_t( 1 ) << (bit % 64);
+      }
+   }
+
+   bool scan_filter::may_contain( uint64_t hash )const
+   {
+      const uint64_t num_bits = _bits.size() * 64;
+      const uint64_t step = (hash >> 32) | 1;
+      for( uint32_t i = 0; i < num_hashes; ++i )
+      {
+         const uint64_t bit = (hash + i * step) % num_bits;
+         if( !(_bits[ bit / 64 ] & (uint64_t( 1 ) << (bit % 64))) )
+            return false;
+      }
+      return true;
+   }
+
+} } // bts::wallet
@@ -501,17 +501,29 @@ transaction_builder& transaction_builder::finalize()
 
 wallet_transaction_record& transaction_builder::sign()
 {
-   auto chain_id = _wimpl->_blockchain->chain_id();
+   const auto chain_id = _wimpl->_blockchain->chain_id();
+   for( const auto& key : signing_keys() )
+      trx.sign(key, chain_id);
+   return cache();
+}
+
+std::vector<fc::ecc::private_key> transaction_builder::signing_keys()
+{
    trx.expiration = blockchain::now() + _wimpl->self->get_transaction_expiration();
 
+   std::vector<fc::ecc::private_key> keys;
    for( auto address : required_signatures )
    {
       //Ignore exceptions; this function operates on a best-effort basis, and doesn't actually have to succeed.
       try {
-         trx.sign(_wimpl->self->get_private_key(address), chain_id);
+         keys.push_back(_wimpl->self->get_private_key(address));
       } catch( ... ) {}
    }
+   return keys;
+}
 
+wallet_transaction_record& transaction_builder::cache()
+{
    for( auto& notice : notices )
       notice.first.trx = trx;
 
@@ -1,6 +1,7 @@
 // TODO: Everything in this file needs to be rewritten in transaction_ledger_experimental.cpp
 // When GitHub issue #845 is done, then this file can be deleted
 
+#include <bts/wallet/config.hpp>
 #include <bts/wallet/exceptions.hpp>
 #include <bts/wallet/wallet.hpp>
 #include <bts/wallet/wallet_impl.hpp>
@@ -278,11 +279,32 @@ void wallet_impl::scan_registered_accounts()
 
 void wallet_impl::scan_block( uint32_t block_num, const vector<private_key_type>& keys, const time_point_sec& received_time )
 { try {
-    const full_block& block = _blockchain->get_block( block_num );
+    scan_block( block_num, _blockchain->get_block( block_num ), keys, received_time );
+} FC_CAPTURE_AND_RETHROW( (block_num)(received_time) ) }
+
+void wallet_impl::scan_block( uint32_t block_num, const full_block& block, const vector<private_key_type>& keys, const time_point_sec& received_time )
+{ try {
+    wallet_db_batch batch( _wallet_db );
     for( const signed_transaction& transaction : block.user_transactions )
     {
         try
         {
+            /* A transaction the wallet has no record of, and that touches none of its addresses, has nothing to scan */
+            if( !_key_lookahead.empty() ) claim_lookahead_keys( transaction );
+            bool may_concern_wallet = true;
+            if( _scan_filter )
+            {
+                try
+                {
+                    may_concern_wallet = transaction_may_concern_wallet( transaction );
+                }
+                catch( ... )
+                {
+                }
+            }
+            if( !may_concern_wallet && !_wallet_db.lookup_transaction( transaction.id() ).valid() )
+                continue;
+
             scan_transaction( transaction, block_num, block.timestamp, keys, received_time );
         }
         catch( ... )
@@ -303,6 +325,284 @@ void wallet_impl::scan_block( uint32_t block_num, const vector<private_key_type>
     }
 } FC_CAPTURE_AND_RETHROW( (block_num)(received_time) ) }
 
+void wallet_impl::build_scan_filter()
+{
+    const auto& keys = _wallet_db.get_keys();
+    const auto& accounts = _wallet_db.get_accounts();
+    _scan_filter.reset( new scan_filter( keys.size() + accounts.size() ) );
+
+    /* Contacts' keys are included because account updates are recorded for them too */
+    for( const auto& item : keys )
+        _scan_filter->insert( item.first );
+    for( const auto& item : accounts )
+    {
+        if( item.second.id != 0 )
+            _scan_filter->insert( item.second.id );
+    }
+}
+
+/**
+ *  The first block a rescan must look at: no key with a private key, and so none of the wallet's accounts, can
+ *  have been used before it. Returns 0 when any such key may be older than its record, and for wallets
+ *  without a recorded birth, whose lookahead keys could have been handed out by an earlier copy of the wallet.
+ */
+uint32_t wallet_impl::earliest_key_birth()const
+{
+    const auto wallet_birth = _wallet_db.get_property( wallet_birth_block_num );
+    if( wallet_birth.is_null() ) return 0;
+
+    uint32_t earliest = wallet_birth.as<uint32_t>();
+    for( const auto& item : _wallet_db.get_keys() )
+    {
+        const wallet_key_record& key = item.second;
+        if( !key.has_private_key() ) continue;
+        if( !key.birth_block_num.valid() ) return 0;
+        earliest = std::min( earliest, *key.birth_block_num );
+    }
+    return earliest;
+}
+
+/**
+ *  Derives the public keys of the next key_lookahead child keys of each of the wallet's accounts, spread over
+ *  the scanner threads, and indexes them by every address form a deposit could use.
+ */
+void wallet_impl::refill_key_lookahead()
+{ try {
+    _key_lookahead.clear();
+    if( !self->is_unlocked() ) return;
+
+    uint32_t lookahead = BTS_WALLET_DEFAULT_KEY_LOOKAHEAD;
+    const auto setting = _wallet_db.lookup_setting( "key_lookahead" );
+    if( setting.valid() ) lookahead = setting->value.as<uint32_t>();
+    if( lookahead == 0 ) return;
+
+    vector<lookahead_key> wanted;
+    for( const auto& item : _wallet_db.get_accounts() )
+    {
+        const wallet_account_record& account = item.second;
+        if( !account.is_my_account ) continue;
+        for( uint32_t i = 1; i <= lookahead; ++i )
+            wanted.push_back( lookahead_key{ account.account_address, int32_t( account.last_used_gen_sequence + i ) } );
+    }
+    if( wanted.empty() ) return;
+
+    const auto master_key = _wallet_db.get_master_private_key( _wallet_password );
+    vector<public_key_type> public_keys( wanted.size() );
+    const uint32_t num_tasks = std::min<size_t>( _num_scanner_threads, wanted.size() );
+    vector<fc::future<void>> derive_progress;
+    derive_progress.reserve( num_tasks );
+    for( uint32_t t = 0; t < num_tasks; ++t )
+    {
+        derive_progress.push_back( _scanner_threads[ t ]->async( [&,t]()
+        {
+            for( size_t i = t; i < wanted.size(); i += num_tasks )
+            {
+                const auto& key = wanted[ i ];
+                public_keys[ i ] = wallet_db::derive_child_key( master_key, key.account_address, key.gen_seq_number ).get_public_key();
+            }
+        }, "refill_key_lookahead" ) );
+    }
+    for( auto& progress : derive_progress )
+        progress.wait();
+
+    for( size_t i = 0; i < wanted.size(); ++i )
+    {
+        const auto& key = public_keys[ i ];
+        _key_lookahead[ address( key ) ] = wanted[ i ];
+        _key_lookahead[ address( pts_address( key, false, 28 ) ) ] = wanted[ i ];
+        _key_lookahead[ address( pts_address( key, true, 28 ) ) ] = wanted[ i ];
+        _key_lookahead[ address( pts_address( key, false, 56 ) ) ] = wanted[ i ];
+        _key_lookahead[ address( pts_address( key, true, 56 ) ) ] = wanted[ i ];
+        _key_lookahead[ address( pts_address( key, false, 0 ) ) ] = wanted[ i ];
+        _key_lookahead[ address( pts_address( key, true, 0 ) ) ] = wanted[ i ];
+    }
+} FC_CAPTURE_AND_RETHROW() }
+
+/**
+ *  Generates and stores the keys of each account up to any lookahead key the deposits of transaction pay to,
+ *  so the scan that follows recognizes them, and then moves the lookahead past them.
+ */
+void wallet_impl::claim_lookahead_keys( const signed_transaction& transaction )
+{ try {
+    bool claimed = false;
+    for( const auto& op : transaction.operations )
+    {
+        if( operation_type_enum( op.type ) != deposit_op_type ) continue;
+        const auto condition = op.as<deposit_operation>().condition;
+        if( (withdraw_condition_types) condition.type != withdraw_signature_type ) continue;
+
+        const auto lookahead_itr = _key_lookahead.find( condition.get_owner() );
+        if( lookahead_itr == _key_lookahead.end() ) continue;
+        const lookahead_key key = lookahead_itr->second;
+
+        auto account = _wallet_db.lookup_account( key.account_address );
+        while( account.valid() && int32_t( account->last_used_gen_sequence ) < key.gen_seq_number )
+        {
+            const auto new_key = _wallet_db.new_private_key( _wallet_password, key.account_address );
+            if( _scan_filter ) _scan_filter->insert( address( new_key.get_public_key() ) );
+            account = _wallet_db.lookup_account( key.account_address );
+        }
+        claimed = true;
+    }
+
+    if( claimed ) refill_key_lookahead();
+} FC_CAPTURE_AND_RETHROW( (transaction) ) }
+
+/**
+ *  Tests the addresses and accounts each operation of transaction touches against _scan_filter. Returns true
+ *  if any may belong to the wallet, or if an operation cannot be judged without a full scan.
+ */
+bool wallet_impl::transaction_may_concern_wallet( const signed_transaction& transaction )const
+{ try {
+    const auto account_may_concern_wallet = [&]( const account_id_type& account_id ) -> bool
+    {
+        if( _scan_filter->may_contain( account_id ) )
+            return true;
+        /* registered during the scan, so not in the filter under its id yet */
+        const auto account_rec = _blockchain->get_account_record( account_id );
+        return !account_rec.valid() || _scan_filter->may_contain( address( account_rec->owner_key ) );
+    };
+
+    for( const auto& op : transaction.operations )
+    {
+        switch( operation_type_enum( op.type ) )
+        {
+            case withdraw_op_type:
+            {
+                const auto balance_rec = _blockchain->get_balance_record( op.as<withdraw_operation>().balance_id );
+                if( !balance_rec.valid() || _scan_filter->may_contain( balance_rec->owner() ) )
+                    return true;
+                break;
+            }
+            case withdraw_pay_op_type:
+                if( account_may_concern_wallet( op.as<withdraw_pay_operation>().account_id ) )
+                    return true;
+                break;
+            case deposit_op_type:
+            {
+                const auto condition = op.as<deposit_operation>().condition;
+                if( (withdraw_condition_types) condition.type != withdraw_signature_type )
+                    return true;
+                const auto deposit = condition.as<withdraw_with_signature>();
+                if( deposit.memo )
+                {
+                    /* the owner of a titan deposit is derived per transfer; only a prescan can rule it out */
+                    const auto prescanned = _prescanned_memos.find( fc::ripemd160::hash( condition.data.data(), condition.data.size() ) );
+                    if( prescanned == _prescanned_memos.end() || prescanned->second.second.valid() )
+                        return true;
+                }
+                else if( _scan_filter->may_contain( deposit.owner ) )
+                {
+                    return true;
+                }
+                break;
+            }
+            case bid_op_type:
+                if( _scan_filter->may_contain( op.as<bid_operation>().bid_index.owner ) )
+                    return true;
+                break;
+            case ask_op_type:
+                if( _scan_filter->may_contain( op.as<ask_operation>().ask_index.owner ) )
+                    return true;
+                break;
+            case short_op_v2_type:
+                if( _scan_filter->may_contain( op.as<short_operation>().short_index.owner ) )
+                    return true;
+                break;
+            case register_account_op_type:
+                if( _scan_filter->may_contain( address( op.as<register_account_operation>().owner_key ) ) )
+                    return true;
+                break;
+            case update_account_op_type:
+                if( account_may_concern_wallet( op.as<update_account_operation>().account_id ) )
+                    return true;
+                break;
+#ifndef PTS_SUPPRESS_ASSETS
+            case create_asset_op_type:
+            {
+                const auto issuer_account_id = op.as<create_asset_operation>().issuer_account_id;
+                if( issuer_account_id != asset_record::market_issued_asset && account_may_concern_wallet( issuer_account_id ) )
+                    return true;
+                break;
+            }
+#endif
+            default:
+                /* claims, burns, issues and feeds only change what the operations above recorded */
+                break;
+        }
+    }
+    return false;
+} FC_CAPTURE_AND_RETHROW() }
+
+/**
+ *  Tries every key on the memo of every titan deposit in blocks, spread over the scanner threads, and records
+ *  the outcome in _prescanned_memos so scan_deposit does not have to wait for the decryption of each deposit
+ *  in turn.
+ */
+void wallet_impl::prescan_memos( const vector<full_block>& blocks, const vector<private_key_type>& keys )
+{ try {
+    vector<fc::ripemd160> memo_ids;
+    vector<withdraw_with_signature> deposits;
+    for( const full_block& block : blocks )
+    {
+        for( const signed_transaction& transaction : block.user_transactions )
+        {
+            for( const auto& op : transaction.operations )
+            {
+                if( operation_type_enum( op.type ) != deposit_op_type )
+                    continue;
+                try
+                {
+                    const auto condition = op.as<deposit_operation>().condition;
+                    if( (withdraw_condition_types) condition.type != withdraw_signature_type )
+                        continue;
+                    auto deposit = condition.as<withdraw_with_signature>();
+                    if( !deposit.memo )
+                        continue;
+                    memo_ids.push_back( fc::ripemd160::hash( condition.data.data(), condition.data.size() ) );
+                    deposits.push_back( std::move( deposit ) );
+                }
+                catch( ... )
+                {
+                }
+            }
+        }
+    }
+
+    vector<pair<private_key_type, omemo_status>> results( deposits.size() );
+    vector<fc::future<void>> scan_progress;
+    scan_progress.reserve( _num_scanner_threads );
+    for( uint32_t t = 0; t < _num_scanner_threads; ++t )
+    {
+        scan_progress.push_back( _scanner_threads[ t ]->async( [&,t]()
+        {
+            for( size_t i = t; i < deposits.size(); i += _num_scanner_threads )
+            {
+                for( const auto& key : keys )
+                {
+                    try
+                    {
+                        const omemo_status status = deposits[ i ].decrypt_memo_data( key );
+                        if( status.valid() && address( status->owner_private_key.get_public_key() ) == deposits[ i ].owner )
+                        {
+                            results[ i ] = std::make_pair( key, status );
+                            break;
+                        }
+                    }
+                    catch( ... )
+                    {
+                    }
+                }
+            }
+        }, "prescan memos" ) );
+    }
+    for( auto& fut : scan_progress )
+        fut.wait();
+
+    for( size_t i = 0; i < deposits.size(); ++i )
+        _prescanned_memos[ memo_ids[ i ] ] = std::move( results[ i ] );
+} FC_CAPTURE_AND_RETHROW() }
+
 wallet_transaction_record wallet_impl::scan_transaction(
         const signed_transaction& transaction,
         uint32_t block_num,
@@ -991,96 +1291,129 @@ bool wallet_impl::scan_deposit( const deposit_operation& op, const vector<privat
        case withdraw_signature_type:
        {
           auto deposit = op.condition.as<withdraw_with_signature>();
-          // TODO: lookup if cached key and work with it only
-          // if( _wallet_db.has_private_key( deposit.owner ) )
           if( deposit.memo ) /* titan transfer */
           {
-             vector< fc::future<void> > scan_key_progress;
-             scan_key_progress.resize( keys.size() );
-             for( uint32_t i = 0; i < keys.size(); ++i )
+             /* If a rescan already tried the keys on this memo, only the key that decrypted it is tried again */
+             const vector<private_key_type>* scan_keys = &keys;
+             vector<private_key_type> prescanned_keys;
+             const auto prescanned = _prescanned_memos.find( fc::ripemd160::hash( op.condition.data.data(), op.condition.data.size() ) );
+             if( prescanned != _prescanned_memos.end() )
+             {
+                if( prescanned->second.second.valid() )
+                   prescanned_keys.push_back( prescanned->second.first );
+                scan_keys = &prescanned_keys;
+             }
+             else
              {
-                const auto& key = keys[i];
-                scan_key_progress[i] = fc::async([&,i](){
-                   omemo_status status;
-                   _scanner_threads[ i % _num_scanner_threads ]->async( [&]()
-                       { status =  deposit.decrypt_memo_data( key ); }, "decrypt memo" ).wait();
-                   /* If I've successfully decrypted then it's for me */
-                   if( status.valid() && address( status->owner_private_key.get_public_key() ) == deposit.owner )
+                /* A memo opened before had its owner key stored by cache_memo, along with the address of the key that opened it */
+                const auto owner_key_rec = _wallet_db.lookup_key( deposit.owner );
+                if( owner_key_rec.valid() && owner_key_rec->has_private_key() )
+                {
+                   const auto account_key = _wallet_db.lookup_private_key( owner_key_rec->account_address, _wallet_password );
+                   if( account_key.valid() )
                    {
-                      cache_deposit = true;
-                      _wallet_db.cache_memo( *status, key, _wallet_password );
+                      prescanned_keys.push_back( *account_key );
+                      scan_keys = &prescanned_keys;
+                   }
+                }
+             }
 
-                      auto new_entry = true;
-                      if( status->memo_flags == from_memo )
+             /* Each scanner thread tries its share of the keys; what they decrypt is applied here in key order */
+             const uint32_t num_tasks = std::min<size_t>( _num_scanner_threads, scan_keys->size() );
+             vector<omemo_status> statuses( scan_keys->size() );
+             vector< fc::future<void> > scan_key_progress;
+             scan_key_progress.reserve( num_tasks );
+             for( uint32_t t = 0; t < num_tasks; ++t )
+             {
+                scan_key_progress.push_back( _scanner_threads[ t ]->async( [&,t]()
+                {
+                   for( size_t i = t; i < scan_keys->size(); i += num_tasks )
+                   {
+                      try
                       {
-                         for( auto& entry : trx_rec.ledger_entries )
-                         {
-                             if( !entry.from_account.valid() ) continue;
-                             if( !entry.memo_from_account.valid() )
-                             {
-                                 const auto a1 = self->get_key_label( *entry.from_account );
-                                 const auto a2 = self->get_key_label( status->from );
-                                 if( a1 != a2 ) continue;
-                             }
-
-                             new_entry = false;
-                             if( !entry.memo_from_account.valid() )
-                                 entry.from_account = status->from;
-                             entry.to_account = key.get_public_key();
-                             entry.amount = amount;
-                             entry.memo = status->get_message();
-                             break;
-                         }
-                         if( new_entry )
-                         {
-                             auto entry = ledger_entry();
-                             entry.from_account = status->from;
-                             entry.to_account = key.get_public_key();
-                             entry.amount = amount;
-                             entry.memo = status->get_message();
-                             trx_rec.ledger_entries.push_back( entry );
-                         }
+                         statuses[ i ] = deposit.decrypt_memo_data( (*scan_keys)[ i ] );
                       }
-                      else // to_memo
+                      catch ( const fc::exception& e )
                       {
-                         for( auto& entry : trx_rec.ledger_entries )
-                         {
-                             if( !entry.from_account.valid() ) continue;
-                             const auto a1 = self->get_key_label( *entry.from_account );
-                             const auto a2 = self->get_key_label( key.get_public_key() );
-                             if( a1 != a2 ) continue;
-
-                             new_entry = false;
-                             entry.from_account = key.get_public_key();
-                             entry.to_account = status->from;
-                             entry.amount = amount;
-                             entry.memo = status->get_message();
-                             break;
-                         }
-                         if( new_entry )
-                         {
-                             auto entry = ledger_entry();
-                             entry.from_account = key.get_public_key();
-                             entry.to_account = status->from;
-                             entry.amount = amount;
-                             entry.memo = status->get_message();
-                             trx_rec.ledger_entries.push_back( entry );
-                         }
+                         elog( "unexpected exception ${e}", ("e",e.to_detail_string()) );
                       }
                    }
-               });
-             } // for each key
-
+                }, "decrypt memos" ) );
+             }
              for( auto& fut : scan_key_progress )
+                fut.wait();
+
+             for( uint32_t i = 0; i < scan_keys->size(); ++i )
              {
-                try {
-                   fut.wait();
-                }
-                catch ( const fc::exception& e )
+                const auto& key = (*scan_keys)[i];
+                const omemo_status& status = statuses[ i ];
+                /* If I've successfully decrypted then it's for me */
+                if( status.valid() && address( status->owner_private_key.get_public_key() ) == deposit.owner )
                 {
-                   elog( "unexpected exception ${e}", ("e",e.to_detail_string()) );
+                   cache_deposit = true;
+                   _wallet_db.cache_memo( *status, key, _wallet_password );
+                   if( _scan_filter )
+                      _scan_filter->insert( deposit.owner );
+
+                   auto new_entry = true;
+                   if( status->memo_flags == from_memo )
+                   {
+                      for( auto& entry : trx_rec.ledger_entries )
+                      {
+                          if( !entry.from_account.valid() ) continue;
+                          if( !entry.memo_from_account.valid() )
+                          {
+                              const auto a1 = self->get_key_label( *entry.from_account );
+                              const auto a2 = self->get_key_label( status->from );
+                              if( a1 != a2 ) continue;
+                          }
+
+                          new_entry = false;
+                          if( !entry.memo_from_account.valid() )
+                              entry.from_account = status->from;
+                          entry.to_account = key.get_public_key();
+                          entry.amount = amount;
+                          entry.memo = status->get_message();
+                          break;
+                      }
+                      if( new_entry )
+                      {
+                          auto entry = ledger_entry();
+                          entry.from_account = status->from;
+                          entry.to_account = key.get_public_key();
+                          entry.amount = amount;
+                          entry.memo = status->get_message();
+                          trx_rec.ledger_entries.push_back( entry );
+                      }
+                   }
+                   else // to_memo
+                   {
+                      for( auto& entry : trx_rec.ledger_entries )
+                      {
+                          if( !entry.from_account.valid() ) continue;
+                          const auto a1 = self->get_key_label( *entry.from_account );
+                          const auto a2 = self->get_key_label( key.get_public_key() );
+                          if( a1 != a2 ) continue;
+
+                          new_entry = false;
+                          entry.from_account = key.get_public_key();
+                          entry.to_account = status->from;
+                          entry.amount = amount;
+                          entry.memo = status->get_message();
+                          break;
+                      }
+                      if( new_entry )
+                      {
+                          auto entry = ledger_entry();
+                          entry.from_account = key.get_public_key();
+                          entry.to_account = status->from;
+                          entry.amount = amount;
+                          entry.memo = status->get_message();
+                          trx_rec.ledger_entries.push_back( entry );
+                      }
+                   }
                 }
-             }
+             } // for each key
              break;
           }
           else /* market cancel or cover proceeds */
@@ -1174,12 +1507,13 @@ vector<wallet_transaction_record> wallet::get_transactions( const string& transa
        FC_THROW_EXCEPTION( invalid_transaction_id, "Invalid transaction id!", ("transaction_id_prefix",transaction_id_prefix) );
 
    auto transactions = vector<wallet_transaction_record>();
-   const auto records = my->_wallet_db.get_transactions();
-   for( const auto& record : records )
+   const auto record_ids = my->_wallet_db.get_transaction_ids();
+   for( const auto& record_id : record_ids )
    {
-       const auto transaction_id = string( record.first );
+       const auto transaction_id = string( record_id );
        if( string( transaction_id ).find( transaction_id_prefix ) != 0 ) continue;
-       transactions.push_back( record.second );
+       const auto record = my->_wallet_db.lookup_transaction( record_id );
+       if( record.valid() ) transactions.push_back( *record );
    }
    return transactions;
 } FC_CAPTURE_AND_RETHROW() }
@@ -1201,6 +1535,7 @@ void wallet_impl::cache_transaction( const signed_transaction& transaction, wall
    record.trx = transaction;
    record.created_time = blockchain::now();
    record.received_time = record.created_time;
+   wallet_db_batch batch( _wallet_db );
    _wallet_db.store_transaction( record );
 
    for( const auto& op : transaction.operations )
@@ -1211,18 +1546,19 @@ void wallet_impl::cache_transaction( const signed_transaction& transaction, wall
 } FC_CAPTURE_AND_RETHROW() }
 
 /**
- * @return the list of all transactions related to this wallet
+ * @return the transactions related to this wallet in history order; a positive limit keeps the first ones and a
+ * negative limit the last ones, and only those are read from the wallet
  */
 vector<wallet_transaction_record> wallet::get_transaction_history( const string& account_name,
                                                                    uint32_t start_block_num,
                                                                    uint32_t end_block_num,
-                                                                   const string& asset_symbol )const
+                                                                   const string& asset_symbol,
+                                                                   int32_t limit )const
 { try {
    FC_ASSERT( is_open() );
    if( end_block_num != uint32_t(-1) ) FC_ASSERT( start_block_num <= end_block_num );
 
    vector<wallet_transaction_record> history_records;
-   const auto& transactions = my->_wallet_db.get_transactions();
 
    asset_id_type asset_id = 0;
    if( !asset_symbol.empty() && asset_symbol != BTS_BLOCKCHAIN_SYMBOL )
@@ -1237,13 +1573,9 @@ vector<wallet_transaction_record> wallet::get_transaction_history( const string&
        }
    }
 
-   for( const auto& item : transactions )
+   const auto collect = [&]( const wallet_transaction_record& tx_record ) -> bool
    {
-       const auto& tx_record = item.second;
-
-       if( tx_record.block_num < start_block_num ) continue;
-       if( end_block_num != uint32_t(-1) && tx_record.block_num > end_block_num ) continue;
-       if( tx_record.ledger_entries.empty() ) continue; /* TODO: Temporary */
+       if( tx_record.ledger_entries.empty() ) return true; /* TODO: Temporary */
 
        if( !account_name.empty() )
        {
@@ -1263,7 +1595,7 @@ vector<wallet_transaction_record> wallet::get_transaction_history( const string&
                    if( match ) break;
                }
            }
-           if( !match ) continue;
+           if( !match ) return true;
        }
 
        if( asset_id != 0 )
@@ -1272,11 +1604,15 @@ vector<wallet_transaction_record> wallet::get_transaction_history( const string&
            for( const auto& entry : tx_record.ledger_entries )
                match |= entry.amount.amount > 0 && entry.amount.asset_id == asset_id;
            match |= tx_record.fee.amount > 0 && tx_record.fee.asset_id == asset_id;
-           if( !match ) continue;
+           if( !match ) return true;
        }
 
        history_records.push_back( tx_record );
-   }
+       return limit == 0 || history_records.size() < uint32_t( std::abs( limit ) );
+   };
+
+   my->_wallet_db.visit_transaction_history( start_block_num, end_block_num, limit < 0, collect );
+   if( limit < 0 ) std::reverse( history_records.begin(), history_records.end() );
 
    return history_records;
 } FC_CAPTURE_AND_RETHROW() }
@@ -1284,12 +1620,15 @@ vector<wallet_transaction_record> wallet::get_transaction_history( const string&
 vector<pretty_transaction> wallet::get_pretty_transaction_history( const string& account_name,
                                                                    uint32_t start_block_num,
                                                                    uint32_t end_block_num,
-                                                                   const string& asset_symbol )const
+                                                                   const string& asset_symbol,
+                                                                   int32_t limit )const
 { try {
 
     // TODO: Validate all input
 
-    const auto& history = get_transaction_history( account_name, start_block_num, end_block_num, asset_symbol );
+    /* Running balances are tallied from start_block_num on, so the last rows still need every row before them */
+    const auto& history = get_transaction_history( account_name, start_block_num, end_block_num, asset_symbol,
+                                                   std::max( limit, 0 ) );
     vector<pretty_transaction> pretties;
     pretties.reserve( history.size() );
     for( const auto& item : history ) pretties.push_back( to_pretty_trx( item ) );
@@ -1306,8 +1645,6 @@ vector<pretty_transaction> wallet::get_pretty_transaction_history( const string&
     };
     std::sort( pretties.begin(), pretties.end(), sorter );
 
-    // TODO: Handle pagination
-
     const auto errors = get_pending_transaction_errors();
     for( auto& trx : pretties )
     {
@@ -1392,17 +1729,20 @@ vector<pretty_transaction> wallet::get_pretty_transaction_history( const string&
         }
     }
 
+    if( limit < 0 && uint32_t( -limit ) < pretties.size() )
+        pretties.erase( pretties.begin(), pretties.end() + limit );
+
     return pretties;
 } FC_CAPTURE_AND_RETHROW() }
 
 void wallet::remove_transaction_record( const string& record_id )
 {
-    const auto& records = my->_wallet_db.get_transactions();
-    for( const auto& record : records )
+    const auto record_ids = my->_wallet_db.get_transaction_ids();
+    for( const auto& item : record_ids )
     {
-       if( string( record.first ).find( record_id ) == 0 )
+       if( string( item ).find( record_id ) == 0 )
        {
-           my->_wallet_db.remove_transaction( record.first );
+           my->_wallet_db.remove_transaction( item );
            return;
        }
     }
@@ -1511,11 +1851,15 @@ wallet_transaction_record wallet::get_transaction( const string& transaction_id_
     if( transaction_id_prefix.size() > string( transaction_id_type() ).size() )
         FC_THROW_EXCEPTION( invalid_transaction_id, "Invalid transaction ID!", ("transaction_id_prefix",transaction_id_prefix) );
 
-    const auto& items = my->_wallet_db.get_transactions();
-    for( const auto& item : items )
+    const auto record_ids = my->_wallet_db.get_transaction_ids();
+    for( const auto& record_id : record_ids )
     {
-        if( string( item.first ).find( transaction_id_prefix ) == 0 )
-            return item.second;
+        if( string( record_id ).find( transaction_id_prefix ) == 0 )
+        {
+            const auto record = my->_wallet_db.lookup_transaction( record_id );
+            if( record.valid() )
+                return *record;
+        }
     }
 
     FC_THROW_EXCEPTION( transaction_not_found, "Transaction not found!", ("transaction_id_prefix",transaction_id_prefix) );
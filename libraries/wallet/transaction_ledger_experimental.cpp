@@ -559,12 +559,12 @@ set<pretty_transaction_experimental> wallet::transaction_history_experimental( c
 
    set<pretty_transaction_experimental> history;
 
-   const auto& transactions = my->_wallet_db.get_transactions();
-   for( const auto& item : transactions )
+   const auto record_ids = my->_wallet_db.get_transaction_ids();
+   for( const auto& record_id : record_ids )
    {
        try
        {
-           scan_transaction_experimental( string( item.second.record_id ), false );
+           scan_transaction_experimental( string( record_id ), false );
        }
        catch( ... )
        {
@@ -0,0 +1,151 @@
+#include <bts/wallet/unlocked_key_cache.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <openssl/crypto.h>
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace bts { namespace wallet {
+
+   namespace {
+
+      const size_t secret_size = sizeof( fc::sha256 );
+
+      size_t system_page_size()
+      {
+#ifdef _WIN32
+         SYSTEM_INFO info;
+         GetSystemInfo( &info );
+         return info.dwPageSize;
+#else
+         return sysconf( _SC_PAGESIZE );
+#endif
+      }
+
+      char* allocate_page( size_t size )
+      {
+#ifdef _WIN32
+         return static_cast<char*>( VirtualAlloc( nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE ) );
+#else
+         void* data = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+         if( data == MAP_FAILED ) return nullptr;
+#ifdef MADV_DONTDUMP
+         madvise( data, size, MADV_DONTDUMP );
+#endif
+         return static_cast<char*>( data );
+#endif
+      }
+
+      bool lock_page( char* data, size_t size )
+      {
+#ifdef _WIN32
+         return VirtualLock( data, size ) != 0;
+#else
+         return mlock( data, size ) == 0;
+#endif
+      }
+
+      void free_page( char* data, size_t size, bool locked )
+      {
+#ifdef _WIN32
+         if( locked ) VirtualUnlock( data, size );
+         VirtualFree( data, 0, MEM_RELEASE );
+#else
+         if( locked ) munlock( data, size );
+         munmap( data, size );
+#endif
+      }
+
+   } // anonymous namespace
+
+   unlocked_key_cache::unlocked_key_cache()
+   :_page_size( system_page_size() ),
+    _used_in_last_page( 0 ),
+    _enabled( false )
+   {
+   }
+
+   unlocked_key_cache::~unlocked_key_cache()
+   {
+      clear();
+   }
+
+   void unlocked_key_cache::enable( const fc::sha512& password )
+   {
+      clear();
+      _password_hash = fc::sha256::hash( password.data(), password.data_size() );
+      _enabled = true;
+   }
+
+   void unlocked_key_cache::clear()
+   {
+      for( const page& p : _pages )
+      {
+         OPENSSL_cleanse( p.data, _page_size );
+         free_page( p.data, _page_size, p.locked );
+      }
+      _pages.clear();
+      _used_in_last_page = 0;
+      _secrets.clear();
+      _enabled = false;
+      _password_hash = fc::sha256();
+   }
+
+   bool unlocked_key_cache::is_enabled_for( const fc::sha512& password )const
+   {
+      return _enabled && _password_hash == fc::sha256::hash( password.data(), password.data_size() );
+   }
+
+   fc::optional<private_key_type> unlocked_key_cache::get( const address& key_address )const
+   {
+      const auto itr = _secrets.find( key_address );
+      if( itr == _secrets.end() ) return fc::optional<private_key_type>();
+
+      fc::sha256 secret;
+      memcpy( secret.data(), itr->second, secret_size );
+      const private_key_type key = private_key_type::regenerate( secret );
+      OPENSSL_cleanse( secret.data(), secret_size );
+      return key;
+   }
+
+   void unlocked_key_cache::store( const address& key_address, const private_key_type& key )
+   { try {
+      FC_ASSERT( _enabled );
+      if( _secrets.count( key_address ) ) return;
+
+      char* slot = allocate_secret();
+      fc::sha256 secret = key.get_secret();
+      memcpy( slot, secret.data(), secret_size );
+      OPENSSL_cleanse( secret.data(), secret_size );
+      _secrets[ key_address ] = slot;
+   } FC_CAPTURE_AND_RETHROW( (key_address) ) }
+
+   char* unlocked_key_cache::allocate_secret()
+   {
+      if( _pages.empty() || _used_in_last_page + secret_size > _page_size )
+      {
+         page p;
+         p.data = allocate_page( _page_size );
+         FC_ASSERT( p.data != nullptr, "Unable to allocate memory for decrypted keys" );
+         p.locked = lock_page( p.data, _page_size );
+         if( !p.locked && _pages.empty() )
+            wlog( "Unable to lock the memory of decrypted wallet keys, they may be swapped to disk" );
+         _pages.push_back( p );
+         _used_in_last_page = 0;
+      }
+
+      char* slot = _pages.back().data + _used_in_last_page;
+      _used_in_last_page += secret_size;
+      return slot;
+   }
+
+} } // bts::wallet
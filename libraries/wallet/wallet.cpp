@@ -49,15 +49,106 @@ namespace detail {
        if( !self->get_transaction_scanning() ) return;
        if( summary.block_data.block_num <= self->get_last_scanned_block_number() ) return;
        if( _scan_in_progress.valid() && !_scan_in_progress.ready() ) return;
+       if( _is_hosted ) return; /* the wallet_host settles or scans the block */
+
+       /* The next block in line can often be settled from its applied changes alone, without scanning it */
+       if( self->settle_block( summary ) ) return;
 
        self->scan_chain( self->get_last_scanned_block_number(), summary.block_data.block_num );
    }
 
+   /**
+    *  Returns true if the block changed anything the wallet keeps a ledger of: one of its balances, orders or
+    *  transactions, or a titan deposit that may be for it. Only then do the transactions have to be scanned.
+    */
+   bool wallet_impl::block_needs_scan( const block_summary& summary )const
+   {
+       const auto is_my_address = [&]( const address& addr ) -> bool
+       {
+           if( _key_lookahead.count( addr ) > 0 ) return true;
+           const auto key_rec = _wallet_db.lookup_key( addr );
+           return key_rec.valid() && key_rec->has_private_key();
+       };
+
+       const pending_chain_state& changes = *summary.applied_changes;
+       for( const auto& item : changes.balances )
+       {
+           if( is_my_address( item.second.owner() ) || _wallet_db.lookup_balance( item.first ).valid() )
+               return true;
+       }
+       for( const auto& orders : { &changes.bids, &changes.asks, &changes.shorts } )
+       {
+           for( const auto& item : *orders )
+           {
+               if( is_my_address( item.first.owner ) )
+                   return true;
+           }
+       }
+       for( const auto& item : changes.collateral )
+       {
+           if( is_my_address( item.first.owner ) )
+               return true;
+       }
+       for( const market_transaction& trx : changes.market_transactions )
+       {
+           if( is_my_address( trx.bid_owner ) || is_my_address( trx.ask_owner ) )
+               return true;
+       }
+       for( const auto& item : changes.accounts )
+       {
+           if( is_my_address( address( item.second.owner_key ) ) )
+               return true;
+       }
+
+       for( const signed_transaction& trx : summary.block_data.user_transactions )
+       {
+           if( _wallet_db.lookup_transaction( trx.id() ).valid() )
+               return true;
+           for( const auto& op : trx.operations )
+           {
+               if( operation_type_enum( op.type ) != deposit_op_type )
+                   continue;
+               const auto condition = op.as<deposit_operation>().condition;
+               if( (withdraw_condition_types) condition.type == withdraw_signature_type
+                   && condition.as<withdraw_with_signature>().memo.valid() )
+                   return true;
+           }
+       }
+       return false;
+   }
+
+   /** updates the wallet's copies of the accounts a block changed */
+   void wallet_impl::apply_account_changes( const pending_chain_state& changes )
+   {
+       for( const auto& item : changes.accounts )
+       {
+           auto account = _wallet_db.lookup_account( item.first );
+           if( !account.valid() )
+               continue;
+           blockchain::account_record& brec = *account;
+           brec = item.second;
+           _wallet_db.cache_account( *account, false );
+       }
+   }
+
    vector<wallet_transaction_record> wallet_impl::get_pending_transactions()const
    {
        return _wallet_db.get_pending_transactions();
    }
 
+   share_type wallet_impl::planned_withdrawal( const balance_id_type& balance_id )const
+   {
+       if( _planned_withdrawals == nullptr ) return 0;
+       const auto itr = _planned_withdrawals->find( balance_id );
+       return itr != _planned_withdrawals->end() ? itr->second : 0;
+   }
+
+   void wallet_impl::plan_withdrawal( const balance_id_type& balance_id, share_type amount )
+   {
+       if( _planned_withdrawals != nullptr )
+           (*_planned_withdrawals)[ balance_id ] += amount;
+   }
+
    void wallet_impl::withdraw_to_transaction(
            const asset& amount_to_withdraw,
            const string& from_account_name,
@@ -68,12 +159,53 @@ namespace detail {
       FC_ASSERT( !from_account_name.empty() );
       auto amount_remaining = amount_to_withdraw;
 
+      /* Select from the cached balances of the asset, largest first, so a few inputs cover the amount */
+      const auto pending_state = _blockchain->get_pending_state();
+      vector<pair<balance_record, share_type>> selected;
+      _wallet_db.visit_balances_by_amount( amount_to_withdraw.asset_id, [&]( const wallet_balance_record& cached ) -> bool
+      {
+          const auto key_record = _wallet_db.lookup_key( cached.owner() );
+          if( !key_record.valid() || !key_record->has_private_key() ) return true;
+
+          const auto account_address = key_record->account_address;
+          const auto account_record = _wallet_db.lookup_account( account_address );
+          const auto name = account_record.valid() ? account_record->name : string( account_address );
+          if( name != from_account_name ) return true;
+
+          const auto pending_record = pending_state->get_balance_record( cached.id() );
+          if( !pending_record.valid() ) return true;
+          const asset balance = pending_record->get_balance();
+          if( balance.amount <= 0 || balance.asset_id != amount_remaining.asset_id ) return true;
+
+          const share_type available = balance.amount - planned_withdrawal( cached.id() );
+          if( available <= 0 ) return true;
+
+          const share_type amount = std::min( available, amount_remaining.amount );
+          selected.push_back( std::make_pair( *pending_record, amount ) );
+          amount_remaining.amount -= amount;
+          return amount_remaining.amount > 0;
+      } );
+
+      if( amount_remaining.amount <= 0 )
+      {
+          for( const auto& item : selected )
+          {
+              trx.withdraw( item.first.id(), item.second );
+              required_signatures.insert( item.first.owner() );
+              plan_withdrawal( item.first.id(), item.second );
+          }
+          return;
+      }
+
+      /* The cache is missing balances, fall back to scanning the chain */
+      amount_remaining = amount_to_withdraw;
       const account_balance_record_summary_type balance_records = self->get_account_balance_records( from_account_name );
       if( balance_records.find( from_account_name ) == balance_records.end() )
          FC_CAPTURE_AND_THROW( insufficient_funds, (from_account_name)(amount_to_withdraw)(balance_records) );
       for( const auto& record : balance_records.at( from_account_name ) )
       {
-          const asset balance = record.get_balance();
+          asset balance = record.get_balance();
+          balance.amount -= planned_withdrawal( record.id() );
           if( balance.amount <= 0 || balance.asset_id != amount_remaining.asset_id )
               continue;
 
@@ -81,12 +213,14 @@ namespace detail {
           {
               trx.withdraw( record.id(), balance.amount );
               required_signatures.insert( record.owner() );
+              plan_withdrawal( record.id(), balance.amount );
               amount_remaining -= balance;
           }
           else
           {
               trx.withdraw( record.id(), amount_remaining.amount );
               required_signatures.insert( record.owner() );
+              plan_withdrawal( record.id(), amount_remaining.amount );
               return;
           }
       }
@@ -108,7 +242,7 @@ namespace detail {
           if( balance_record.genesis_info.valid()
                   && balance_record.get_balance().asset_id == 0
                   && balance_record.condition.type == withdraw_signature_type
-                  && balance_record.condition.as<withdraw_with_signature>().owner == source_addr ) {
+                  && balance_record.owner() == source_addr ) {
               record = balance_record;
           }
       } );
@@ -233,6 +367,15 @@ namespace detail {
         const auto now = blockchain::now();
         _scan_progress = 0;
 
+        const uint32_t earliest = earliest_key_birth();
+        if( start < earliest )
+        {
+            ulog( "Skipping blocks before ${n}, which are older than every wallet key...", ("n",earliest) );
+            start = earliest;
+            if( start > min_end )
+                self->set_last_scanned_block_number( min_end );
+        }
+
         // Collect private keys
         const auto account_keys = _wallet_db.get_account_private_keys( _wallet_password );
         vector<private_key_type> private_keys;
@@ -259,11 +402,51 @@ namespace detail {
         if( min_end > start + 1 )
             ulog( "Beginning scan at block ${n}...", ("n",start) );
 
+        try
+        {
+            refill_key_lookahead();
+        }
+        catch( ... )
+        {
+        }
+
+        /* Each chunk has its memos decrypted on the scanner threads at once, then its blocks applied in order */
+        _prescanned_memos.clear();
+        vector<full_block> chunk;
+        uint32_t chunk_start = start;
         for( auto block_num = start; !_scan_in_progress.canceled() && block_num <= min_end; ++block_num )
         {
+            if( block_num == chunk_start )
+            {
+                /* rebuilt per chunk to pick up keys created while the scan yields */
+                build_scan_filter();
+                _prescanned_memos.clear();
+                chunk.clear();
+                const auto chunk_end = std::min<size_t>( min_end, chunk_start + BTS_WALLET_SCAN_CHUNK_SIZE - 1 );
+                for( auto chunk_block_num = chunk_start; chunk_block_num <= chunk_end; ++chunk_block_num )
+                {
+                    try
+                    {
+                        chunk.push_back( _blockchain->get_block( chunk_block_num ) );
+                    }
+                    catch( ... )
+                    {
+                        chunk.push_back( full_block() );
+                    }
+                }
+                try
+                {
+                    prescan_memos( chunk, private_keys );
+                }
+                catch( ... )
+                {
+                }
+                chunk_start += chunk.size();
+            }
+
             try
             {
-                scan_block( block_num, private_keys, now );
+                scan_block( block_num, chunk[ block_num + chunk.size() - chunk_start ], private_keys, now );
             }
             catch( ... )
             {
@@ -290,6 +473,8 @@ namespace detail {
                     fc::usleep( fc::microseconds( 100 ) );
             }
         }
+        _prescanned_memos.clear();
+        _scan_filter.reset();
 
         // Update local accounts
         {
@@ -312,6 +497,8 @@ namespace detail {
       }
       catch(...)
       {
+        _prescanned_memos.clear();
+        _scan_filter.reset();
         _scan_progress = -1;
         ulog( "Scan failure." );
         throw;
@@ -504,6 +691,8 @@ namespace detail {
           }
 
           _wallet_db.set_master_key( epk, _wallet_password);
+          if( brainkey.empty() )
+             _wallet_db.set_property( wallet_birth_block_num, variant( _blockchain->get_head_block_num() ) );
 
           self->set_version( BTS_WALLET_VERSION );
           self->set_automatic_backups( true );
@@ -928,6 +1117,11 @@ namespace detail {
       return my->_wallet_db.is_open();
    }
 
+   variant_object wallet::get_memory_stats()const
+   {
+      return my->_wallet_db.get_memory_stats();
+   }
+
    string wallet::get_wallet_name()const
    {
       return my->_current_wallet_path.filename().generic_string();
@@ -1080,6 +1274,7 @@ namespace detail {
           my->_wallet_password = fc::sha512::hash( password.c_str(), password.size() );
           if( !my->_wallet_db.validate_password( my->_wallet_password ) )
               FC_THROW_EXCEPTION( invalid_password, "Invalid password!" );
+          my->_wallet_db.cache_unlocked_keys( my->_wallet_password );
 
           my->upgrade_version_unlocked();
 
@@ -1089,9 +1284,9 @@ namespace detail {
           wallet_lock_state_changed( false );
           ilog( "Wallet unlocked until time: ${t}", ("t", fc::time_point_sec(*my->_scheduled_lock_time)) );
 
-          /* Scan blocks we have missed while locked */
+          /* Scan blocks we have missed while locked, unless the wallet_host will */
           const uint32_t first = get_last_scanned_block_number();
-          if( first < my->_blockchain->get_head_block_num() )
+          if( !my->_is_hosted && first < my->_blockchain->get_head_block_num() )
             scan_chain( first, my->_blockchain->get_head_block_num() );
       }
       catch( ... )
@@ -1121,6 +1316,7 @@ namespace detail {
         wlog("Unexpected exception from wallet's login_map_cleaner()");
       }
       my->_wallet_password     = fc::sha512();
+      my->_wallet_db.clear_unlocked_keys();
       my->_scheduled_lock_time = fc::optional<fc::time_point>();
       wallet_lock_state_changed( true );
       ilog( "Wallet locked at time: ${t}", ("t",blockchain::now()) );
@@ -1513,6 +1709,80 @@ namespace detail {
 
    } FC_CAPTURE_AND_RETHROW( (account_name) ) }
 
+   void wallet::set_hosted( bool hosted )
+   {
+      my->_is_hosted = hosted;
+   }
+
+   bool wallet::is_hosted()const
+   {
+      return my->_is_hosted;
+   }
+
+   bool wallet::settle_block( const block_summary& summary )
+   { try {
+      const uint32_t block_num = summary.block_data.block_num;
+      if( block_num != get_last_scanned_block_number() + 1 || !summary.applied_changes ) return false;
+      if( my->block_needs_scan( summary ) ) return false;
+
+      my->apply_account_changes( *summary.applied_changes );
+      set_last_scanned_block_number( block_num );
+      return true;
+   } FC_CAPTURE_AND_RETHROW() }
+
+   void wallet::scan_blocks( uint32_t first_block_num, const vector<full_block>& blocks )
+   { try {
+      FC_ASSERT( is_open() );
+      FC_ASSERT( is_unlocked() );
+      FC_ASSERT( !my->_scan_in_progress.valid() || my->_scan_in_progress.ready(), "The wallet is already scanning!" );
+      if( !get_transaction_scanning() ) return;
+
+      const uint32_t next_block_num = get_last_scanned_block_number() + 1;
+      if( blocks.empty() || first_block_num + blocks.size() <= next_block_num ) return;
+
+      const auto now = blockchain::now();
+      const auto account_keys = my->_wallet_db.get_account_private_keys( my->_wallet_password );
+      vector<private_key_type> private_keys;
+      private_keys.reserve( account_keys.size() );
+      for( const auto& item : account_keys )
+          private_keys.push_back( item.first );
+
+      try
+      {
+          try
+          {
+              my->refill_key_lookahead();
+              my->prescan_memos( blocks, private_keys );
+          }
+          catch( ... )
+          {
+          }
+          my->build_scan_filter();
+
+          for( uint32_t i = 0; i < blocks.size(); ++i )
+          {
+              const uint32_t block_num = first_block_num + i;
+              if( block_num < next_block_num ) continue;
+              try
+              {
+                  my->scan_block( block_num, blocks[ i ], private_keys, now );
+              }
+              catch( ... )
+              {
+              }
+              set_last_scanned_block_number( block_num );
+          }
+      }
+      catch( ... )
+      {
+          my->_prescanned_memos.clear();
+          my->_scan_filter.reset();
+          throw;
+      }
+      my->_prescanned_memos.clear();
+      my->_scan_filter.reset();
+   } FC_CAPTURE_AND_RETHROW( (first_block_num) ) }
+
    void wallet::scan_chain( uint32_t start, uint32_t end, bool fast_scan )
    { try {
       FC_ASSERT( is_open() );
@@ -1580,10 +1850,9 @@ namespace detail {
       FC_ASSERT( is_open() );
       FC_ASSERT( is_unlocked() );
 
-      auto key = my->_wallet_db.lookup_key( addr );
+      const auto key = my->_wallet_db.lookup_private_key( addr, my->_wallet_password );
       FC_ASSERT( key.valid() );
-      FC_ASSERT( key->has_private_key() );
-      return key->decrypt_private_key( my->_wallet_password );
+      return *key;
    } FC_CAPTURE_AND_RETHROW( (addr) ) }
 
    void wallet::set_delegate_block_production( const string& delegate_name, bool enabled )
@@ -1986,6 +2255,7 @@ namespace detail {
    uint32_t wallet::regenerate_keys( const string& account_name, uint32_t count )
    { try {
       uint32_t regenerated_keys = 0;
+      wallet_db_batch batch( my->_wallet_db );
       for( uint32_t i = 0; i < count; ++i )
       {
          fc::oexception regenerate_key_error;
@@ -2719,6 +2989,70 @@ namespace detail {
          return record;
    } FC_CAPTURE_AND_RETHROW( (amount_to_transfer_symbol)(from_account_name)(to_address_amounts)(memo_message) ) }
 
+   vector<transaction_builder_ptr> wallet::transfer_batch(
+           const string& paying_account_name,
+           const vector<transfer_request>& transfers,
+           vote_selection_method selection_method )
+   { try {
+       FC_ASSERT( is_open() );
+       FC_ASSERT( is_unlocked() );
+       FC_ASSERT( !transfers.empty() );
+
+       const auto payer = get_account( paying_account_name );
+
+       // none of the transactions reaches the pending state before they are all signed, so the inputs each
+       // one selects are set aside for the rest
+       vector<transaction_builder_ptr> builders;
+       builders.reserve( transfers.size() );
+       unordered_map<balance_id_type, share_type> planned_withdrawals;
+       my->_planned_withdrawals = &planned_withdrawals;
+       try
+       {
+           for( const auto& transfer : transfers )
+           {
+               const asset amount = my->_blockchain->to_ugly_asset( transfer.amount, transfer.asset_symbol );
+               const auto recipient = get_account( transfer.to_account_name );
+               auto builder = create_transaction_builder();
+               builder->deposit_asset( payer, recipient, amount, transfer.memo_message, selection_method, payer.owner_key )
+                       .finalize();
+               builders.push_back( builder );
+           }
+       }
+       catch( ... )
+       {
+           my->_planned_withdrawals = nullptr;
+           throw;
+       }
+       my->_planned_withdrawals = nullptr;
+
+       // the keys are looked up here, signing with them needs nothing from the wallet
+       const auto chain_id = my->_blockchain->chain_id();
+       vector<vector<private_key_type>> keys( builders.size() );
+       for( size_t i = 0; i < builders.size(); ++i )
+           keys[ i ] = builders[ i ]->signing_keys();
+
+       const uint32_t num_tasks = std::min<size_t>( my->_num_scanner_threads, builders.size() );
+       vector<fc::future<void>> sign_progress;
+       sign_progress.reserve( num_tasks );
+       for( uint32_t t = 0; t < num_tasks; ++t )
+       {
+           sign_progress.push_back( my->_scanner_threads[ t ]->async( [&,t]()
+           {
+               for( size_t i = t; i < builders.size(); i += num_tasks )
+                   for( const auto& key : keys[ i ] )
+                       builders[ i ]->transaction_record.trx.sign( key, chain_id );
+           }, "transfer_batch_sign" ) );
+       }
+       for( auto& progress : sign_progress )
+           progress.wait();
+
+       wallet_db_batch batch( my->_wallet_db );
+       for( const auto& builder : builders )
+           builder->cache();
+
+       return builders;
+   } FC_CAPTURE_AND_RETHROW( (paying_account_name)(transfers)(selection_method) ) }
+
    wallet_transaction_record wallet::register_account(
            const string& account_to_register,
            const variant& public_data,
@@ -3206,6 +3540,11 @@ namespace detail {
          }
       }
 
+      // other nodes don't relay a transaction with more market operations than one fee pays for
+      const size_t market_operations = builder->transaction_record.trx.market_operation_count();
+      if( market_operations > BTS_BLOCKCHAIN_MAX_MARKET_OPERATIONS_PER_TRANSACTION )
+         FC_CAPTURE_AND_THROW( too_many_market_operations, (market_operations) );
+
       builder->finalize();
 
       if( sign )
@@ -3648,7 +3987,7 @@ namespace detail {
                 ("name",account_name) );
 
       FC_ASSERT( opt_key->has_private_key() );
-      return opt_key->decrypt_private_key( my->_wallet_password );
+      return *my->_wallet_db.lookup_private_key( opt_key->get_address(), my->_wallet_password );
    } FC_CAPTURE_AND_RETHROW( (account_name) ) }
 
    /**
@@ -3753,6 +4092,14 @@ namespace detail {
 
    account_balance_id_summary_type wallet::get_account_balance_ids( const string& account_name, bool include_empty )const
    { try {
+      FC_ASSERT( is_open() );
+      /* Balances are removed from the wallet cache when they empty, so only empty ones need the chain */
+      if( !include_empty )
+      {
+          if( !account_name.empty() ) get_account( account_name ); /* Just to check input */
+          return my->_wallet_db.get_account_balance_ids( account_name );
+      }
+
       map<string, vector<balance_id_type>> balance_ids;
 
       map<string, vector<balance_record>> items = get_account_balance_records( account_name, include_empty );
@@ -3770,6 +4117,13 @@ namespace detail {
 
    account_balance_summary_type wallet::get_account_balances( const string& account_name, bool include_empty )const
    { try {
+      FC_ASSERT( is_open() );
+      if( !include_empty )
+      {
+          if( !account_name.empty() ) get_account( account_name ); /* Just to check input */
+          return my->_wallet_db.get_account_balance_totals( account_name );
+      }
+
       map<string, map<asset_id_type, share_type>> balances;
 
       map<string, vector<balance_record>> items = get_account_balance_records( account_name, include_empty );
@@ -3790,23 +4144,31 @@ namespace detail {
 
    account_balance_summary_type wallet::get_account_yield( const string& account_name )const
    { try {
+      FC_ASSERT( is_open() );
       map<string, map<asset_id_type, share_type>> yield_summary;
       const auto pending_state = my->_blockchain->get_pending_state();
 
-      map<string, vector<balance_record>> items = get_account_balance_records( account_name );
-      for( const auto& item : items )
+      /* Only market issued assets yield, so only balances in those need their records */
+      map<asset_id_type, oasset_record> asset_records;
+      const auto account_balance_ids = get_account_balance_ids( account_name );
+      for( const auto& item : account_balance_ids )
       {
           const auto& name = item.first;
-          const auto& records = item.second;
+          const auto& balance_ids = item.second;
 
-          for( const auto& record : records )
+          for( const auto& balance_id : balance_ids )
           {
-              const auto balance = record.get_balance();
-              // TODO: Memoize these
-              const auto asset_rec = pending_state->get_asset_record( balance.asset_id );
+              const auto record = my->_wallet_db.lookup_balance( balance_id );
+              if( !record.valid() ) continue;
+
+              const auto balance = record->get_balance();
+              auto asset_itr = asset_records.find( balance.asset_id );
+              if( asset_itr == asset_records.end() )
+                  asset_itr = asset_records.emplace( balance.asset_id, pending_state->get_asset_record( balance.asset_id ) ).first;
+              const auto& asset_rec = asset_itr->second;
               if( !asset_rec.valid() || !asset_rec->is_market_issued() ) continue;
 
-              const auto yield = record.calculate_yield( pending_state->now(), balance.amount,
+              const auto yield = record->calculate_yield( pending_state->now(), balance.amount,
                                  asset_rec->collected_fees, asset_rec->current_share_supply );
               yield_summary[ name ][ yield.asset_id ] += yield.amount;
           }
@@ -3960,25 +4322,26 @@ namespace detail {
    {
       map<order_id_type, market_order> order_map;
 
-      const auto filter = [&]( const market_order& order ) -> bool
+      for( const auto& item : my->_wallet_db.get_keys() )
       {
-          const auto okey = my->_wallet_db.lookup_key( order.get_owner() );
-          if( !okey.valid() || !okey->has_private_key() )
-              return false;
-
-          if( account_name == "ALL" )
-              return true;
+          if( order_map.size() >= limit )
+              break;
 
-          const auto oaccount = my->_wallet_db.lookup_account( okey->account_address );
-          if( !oaccount.valid() )
-              return false;
+          const auto& key = item.second;
+          if( !key.has_private_key() )
+              continue;
 
-          return oaccount->name == account_name;
-      };
+          if( account_name != "ALL" )
+          {
+              const auto oaccount = my->_wallet_db.lookup_account( key.account_address );
+              if( !oaccount.valid() || oaccount->name != account_name )
+                  continue;
+          }
 
-      const auto orders = my->_blockchain->get_market_orders( filter, limit );
-      for( const auto& order : orders )
-          order_map[ order.get_id() ] = order;
+          const auto orders = my->_blockchain->get_market_orders_by_owner( item.first, limit - order_map.size() );
+          for( const auto& order : orders )
+              order_map[ order.get_id() ] = order;
+      }
 
       return order_map;
    }
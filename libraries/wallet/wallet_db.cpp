@@ -13,18 +13,45 @@ namespace bts { namespace wallet {
      class wallet_db_impl
      {
         public:
+           typedef bts::db::level_map<int32_t,generic_wallet_record> record_map_type;
+
            wallet_db*                                        self = nullptr;
-           bts::db::level_map<int32_t,generic_wallet_record> _records;
+           record_map_type                                   _records;
+
+           /** the open batch, see wallet_db::begin_batch */
+           std::unique_ptr<record_map_type::write_batch>     _batch;
+           uint32_t                                          _batch_depth = 0;
+           /** what the open batch will write by record index, so reads see it; invalid if it removes the record */
+           unordered_map<int32_t, fc::optional<generic_wallet_record>> _batched_records;
+
+           /** the keys decrypted while the wallet is unlocked, see wallet_db::cache_unlocked_keys */
+           unlocked_key_cache                                _unlocked_keys;
 
            void store_generic_record( const generic_wallet_record& record, bool sync = true )
            { try {
                auto index = record.get_wallet_record_index();
                FC_ASSERT( index != 0 );
                FC_ASSERT( _records.is_open() );
-               _records.store( index, record, sync );
+               if( _batch )
+               {
+                  _batch->store( index, record );
+                  _batched_records[ index ] = record;
+               }
+               else
+               {
+                  _records.store( index, record, sync );
+               }
                load_generic_record( record );
            } FC_CAPTURE_AND_RETHROW( (record) ) }
 
+           fc::optional<generic_wallet_record> fetch_record( int32_t index )
+           {
+               auto itr = _batched_records.find( index );
+               if( itr != _batched_records.end() )
+                  return itr->second;
+               return _records.fetch_optional( index );
+           }
+
            void load_generic_record( const generic_wallet_record& record, bool overwrite = true )
            { try {
                switch( wallet_record_type_enum(record.type) )
@@ -39,7 +66,7 @@ namespace bts { namespace wallet {
                        load_key_record( record.as<wallet_key_record>(), overwrite );
                        break;
                    case transaction_record_type:
-                       load_transaction_record( record.as<wallet_transaction_record>(), overwrite );
+                       load_transaction_record( record, overwrite );
                        break;
                    case balance_record_type:
                        load_balance_record( record.as<wallet_balance_record>(), overwrite );
@@ -107,12 +134,34 @@ namespace bts { namespace wallet {
               self->btc_to_bts_address[ address(pts_address(key,true,0) )  ] = bts_addr;
            } FC_CAPTURE_AND_RETHROW( (key_to_load) ) }
 
-           void load_transaction_record( const wallet_transaction_record& rec, bool overwrite )
+           /** only indexes the record; decoding every transaction on open is what made large wallets slow to open */
+           void load_transaction_record( const generic_wallet_record& record, bool overwrite )
            { try {
-              auto itr = self->transactions.find( rec.record_id );
-              if( !overwrite) FC_ASSERT( itr == self->transactions.end(), "Duplicate transaction found in wallet!" );
-              self->transactions[ rec.record_id ] = rec;
-           } FC_CAPTURE_AND_RETHROW( (rec) ) }
+              FC_ASSERT( record.data.is_object() );
+              const auto& data = record.data.get_object();
+              const auto record_id = data["record_id"].as<transaction_id_type>();
+
+              auto itr = self->transaction_record_indexes.find( record_id );
+              if( !overwrite) FC_ASSERT( itr == self->transaction_record_indexes.end(), "Duplicate transaction found in wallet!" );
+              self->transaction_record_indexes[ record_id ] = record.get_wallet_record_index();
+
+              const bool is_virtual = data.contains( "is_virtual" ) && data["is_virtual"].as_bool();
+              const bool is_confirmed = data.contains( "is_confirmed" ) && data["is_confirmed"].as_bool();
+              if( !is_virtual && !is_confirmed )
+                 self->unconfirmed_transaction_ids.insert( record_id );
+              else
+                 self->unconfirmed_transaction_ids.erase( record_id );
+
+              const uint32_t block_num = data.contains( "block_num" ) ? data["block_num"].as<uint32_t>() : 0;
+              const time_point_sec created_time = data.contains( "created_time" ) ? data["created_time"].as<time_point_sec>() : time_point_sec();
+              const time_point_sec received_time = data.contains( "received_time" ) ? data["received_time"].as<time_point_sec>() : time_point_sec();
+              const auto history_key = std::make_tuple( !is_confirmed, block_num, std::min( created_time, received_time ), record_id );
+              const auto key_itr = self->transaction_history_keys.find( record_id );
+              if( key_itr != self->transaction_history_keys.end() )
+                 self->transaction_history_index.erase( key_itr->second );
+              self->transaction_history_keys[ record_id ] = history_key;
+              self->transaction_history_index.insert( history_key );
+           } FC_CAPTURE_AND_RETHROW( (record) ) }
 
            void load_balance_record( const wallet_balance_record& rec, bool overwrite )
            { try {
@@ -121,7 +170,10 @@ namespace bts { namespace wallet {
                   auto itr = self->balances.find( rec.id() );
                   FC_ASSERT( itr == self->balances.end(), "Duplicate balance record" );
               }
+              self->unindex_balance( rec.id() );
               self->balances[ rec.id() ] = rec;
+              self->balance_ids_by_amount[ rec.condition.asset_id ].insert( std::make_pair( rec.balance, rec.id() ) );
+              self->balance_totals_by_owner[ rec.owner() ][ rec.condition.asset_id ] += rec.balance;
            } FC_CAPTURE_AND_RETHROW( (rec) ) }
 
            void load_property_record( const wallet_property_record& property_rec, bool overwrite )
@@ -158,6 +210,7 @@ namespace bts { namespace wallet {
       try
       {
           my->_records.open( wallet_file, true );
+          uint32_t records_loaded = 0;
           for( auto itr = my->_records.begin(); itr.valid(); ++itr )
           {
              auto record = itr.value();
@@ -165,7 +218,8 @@ namespace bts { namespace wallet {
              {
                 my->load_generic_record( record );
                 // prevent hanging on large wallets
-                fc::usleep( fc::microseconds(1000) );
+                if( ++records_loaded % 1000 == 0 )
+                   fc::usleep( fc::microseconds(1000) );
              }
              catch (const fc::canceled_exception&)
              {
@@ -186,14 +240,23 @@ namespace bts { namespace wallet {
 
    void wallet_db::close()
    {
+      my->_batch.reset(); // commits what is left of an open batch
+      my->_batch_depth = 0;
+      my->_batched_records.clear();
       my->_records.close();
+      my->_unlocked_keys.clear();
 
       wallet_master_key.reset();
 
       accounts.clear();
       keys.clear();
-      transactions.clear();
+      transaction_record_indexes.clear();
+      unconfirmed_transaction_ids.clear();
+      transaction_history_index.clear();
+      transaction_history_keys.clear();
       balances.clear();
+      balance_ids_by_amount.clear();
+      balance_totals_by_owner.clear();
       properties.clear();
       settings.clear();
 
@@ -205,6 +268,25 @@ namespace bts { namespace wallet {
 
    bool wallet_db::is_open()const { return my->_records.is_open(); }
 
+   void wallet_db::begin_batch()
+   {
+      FC_ASSERT( is_open() );
+      if( my->_batch_depth++ == 0 )
+         my->_batch.reset( new detail::wallet_db_impl::record_map_type::write_batch( my->_records.create_batch( true ) ) );
+   }
+
+   void wallet_db::commit_batch()
+   { try {
+      FC_ASSERT( my->_batch_depth > 0 );
+      if( --my->_batch_depth > 0 )
+         return;
+
+      std::unique_ptr<detail::wallet_db_impl::record_map_type::write_batch> batch = std::move( my->_batch );
+      my->_batched_records.clear();
+      if( batch )
+         batch->commit();
+   } FC_CAPTURE_AND_RETHROW() }
+
    void wallet_db::store_generic_record( const generic_wallet_record& record, bool sync )
    {
        FC_ASSERT( is_open() );
@@ -262,6 +344,25 @@ namespace bts { namespace wallet {
       return new_priv_key;
    }
 
+   extended_private_key wallet_db::get_master_private_key( const fc::sha512& password )const
+   {
+      FC_ASSERT( wallet_master_key.valid() );
+      return wallet_master_key->decrypt_key( password );
+   }
+
+   private_key_type wallet_db::derive_child_key( const extended_private_key& master_key,
+                                                 const address& parent_account_address,
+                                                 int32_t key_index )
+   {
+      if( key_index < 10000 )
+         return master_key.child( key_index );
+
+      fc::sha256::encoder enc;
+      fc::raw::pack( enc, parent_account_address );
+      fc::raw::pack( enc, key_index );
+      return master_key.child( enc.result() );
+   }
+
    private_key_type wallet_db::new_private_key( const fc::sha512& password,
                                                 const address& parent_account_address,
                                                 bool store_key )
@@ -270,14 +371,7 @@ namespace bts { namespace wallet {
 
       const auto master_ext_priv_key = wallet_master_key->decrypt_key( password );
       const auto key_index = new_key_child_index( parent_account_address );
-      auto new_priv_key = master_ext_priv_key.child( key_index );
-      if( key_index >= 10000 )
-      {
-          fc::sha256::encoder enc;
-          fc::raw::pack( enc, parent_account_address );
-          fc::raw::pack( enc, key_index );
-          new_priv_key = master_ext_priv_key.child( enc.result() );
-      }
+      const auto new_priv_key = derive_child_key( master_ext_priv_key, parent_account_address, key_index );
 
       if( !store_key )
         return new_priv_key;
@@ -287,6 +381,12 @@ namespace bts { namespace wallet {
       new_key.encrypt_private_key( password, new_priv_key );
       new_key.gen_seq_number = key_index;
 
+      /* keys derived from a master key this wallet generated are no older than the wallet; the index alone
+         says nothing, as a restored backup derives again indexes it had already used */
+      const auto wallet_birth = get_property( wallet_birth_block_num );
+      if( !wallet_birth.is_null() )
+         new_key.birth_block_num = wallet_birth.as<uint32_t>();
+
       // if there is no parent account address, then the account_address of this key is itself
       if( parent_account_address == address() )
          new_key.account_address = address( new_key.public_key );
@@ -341,12 +441,102 @@ namespace bts { namespace wallet {
    }
 
    owallet_transaction_record wallet_db::lookup_transaction( const transaction_id_type& record_id )const
+   { try {
+      auto itr = transaction_record_indexes.find( record_id );
+      if( itr == transaction_record_indexes.end() ) return owallet_transaction_record();
+      const auto record = my->fetch_record( itr->second );
+      if( !record.valid() ) return owallet_transaction_record();
+      return record->as<wallet_transaction_record>();
+   } FC_CAPTURE_AND_RETHROW( (record_id) ) }
+
+   /* counts the fixed size of each entry and node, not what the records own on the heap */
+   template<typename Container>
+   static uint64_t approximate_container_bytes( const Container& container )
+   {
+      return container.size() * ( sizeof( typename Container::value_type ) + 4 * sizeof( void* ) );
+   }
+
+   variant_object wallet_db::get_memory_stats()const
+   {
+      fc::mutable_variant_object maps;
+      uint64_t total_bytes = 0;
+      const auto add = [&]( const char* name, uint64_t bytes )
+      {
+         maps[ name ] = bytes;
+         total_bytes += bytes;
+      };
+      add( "accounts", approximate_container_bytes( accounts ) );
+      add( "keys", approximate_container_bytes( keys ) );
+      add( "balances", approximate_container_bytes( balances ) );
+      add( "properties", approximate_container_bytes( properties ) );
+      add( "settings", approximate_container_bytes( settings ) );
+      add( "account_indexes", approximate_container_bytes( address_to_account_wallet_record_index )
+                              + approximate_container_bytes( name_to_account_wallet_record_index )
+                              + approximate_container_bytes( account_id_to_wallet_record_index ) );
+      add( "btc_to_bts_address", approximate_container_bytes( btc_to_bts_address ) );
+      add( "balance_indexes", approximate_container_bytes( balance_ids_by_amount )
+                              + approximate_container_bytes( balance_totals_by_owner ) );
+      add( "transaction_indexes", approximate_container_bytes( transaction_record_indexes )
+                                  + approximate_container_bytes( unconfirmed_transaction_ids )
+                                  + approximate_container_bytes( transaction_history_index )
+                                  + approximate_container_bytes( transaction_history_keys ) );
+
+      fc::mutable_variant_object result;
+      result["maps"] = maps;
+      result["total_bytes"] = total_bytes;
+      return result;
+   }
+
+   vector<transaction_id_type> wallet_db::get_transaction_ids()const
    {
-      auto itr = transactions.find( record_id );
-      if( itr != transactions.end() ) return itr->second;
-      return owallet_transaction_record();
+      vector<transaction_id_type> record_ids;
+      record_ids.reserve( transaction_record_indexes.size() );
+      for( const auto& item : transaction_record_indexes )
+         record_ids.push_back( item.first );
+      return record_ids;
    }
 
+   unordered_map<transaction_id_type, wallet_transaction_record> wallet_db::get_transactions()const
+   { try {
+      unordered_map<transaction_id_type, wallet_transaction_record> transactions;
+      for( const auto& item : transaction_record_indexes )
+      {
+         const auto record = lookup_transaction( item.first );
+         if( record.valid() )
+            transactions[ item.first ] = *record;
+      }
+      return transactions;
+   } FC_CAPTURE_AND_RETHROW() }
+
+   void wallet_db::visit_transaction_history( uint32_t start_block_num, uint32_t end_block_num, bool reverse,
+                                              const function<bool( const wallet_transaction_record& )>& visit )const
+   { try {
+      /* Confirmed transactions are contiguous by block; the few pending ones are filtered one by one */
+      const auto in_range = [&]( const transaction_history_key& key ) -> bool
+      {
+         const uint32_t block_num = std::get<1>( key );
+         return block_num >= start_block_num && block_num <= end_block_num;
+      };
+      const auto confirmed_begin = transaction_history_index.lower_bound(
+              std::make_tuple( false, start_block_num, time_point_sec(), transaction_id_type() ) );
+      const auto confirmed_end = transaction_history_index.lower_bound(
+              std::make_tuple( true, uint32_t( 0 ), time_point_sec(), transaction_id_type() ) );
+
+      vector<const transaction_history_key*> keys;
+      for( auto itr = confirmed_begin; itr != confirmed_end && in_range( *itr ); ++itr )
+         keys.push_back( &*itr );
+      for( auto itr = confirmed_end; itr != transaction_history_index.end(); ++itr )
+         if( in_range( *itr ) ) keys.push_back( &*itr );
+      if( reverse ) std::reverse( keys.begin(), keys.end() );
+
+      for( const auto key : keys )
+      {
+         const auto record = lookup_transaction( std::get<3>( *key ) );
+         if( !record.valid() ) continue;
+         if( !visit( *record ) ) return;
+      }
+   } FC_CAPTURE_AND_RETHROW( (start_block_num)(end_block_num)(reverse) ) }
+
    void wallet_db::store_setting(const string& name, const variant& value)
    {
        auto orec = lookup_setting(name);
@@ -421,11 +611,11 @@ namespace bts { namespace wallet {
    vector<wallet_transaction_record> wallet_db::get_pending_transactions()const
    {
        vector<wallet_transaction_record> transaction_records;
-       for( const auto& item : transactions )
+       for( const auto& record_id : unconfirmed_transaction_ids )
        {
-           const auto& transaction_record = item.second;
-           if( !transaction_record.is_virtual && !transaction_record.is_confirmed )
-               transaction_records.push_back( transaction_record );
+           const auto transaction_record = lookup_transaction( record_id );
+           if( transaction_record.valid() )
+               transaction_records.push_back( *transaction_record );
        }
        return transaction_records;
    }
@@ -434,6 +624,7 @@ namespace bts { namespace wallet {
    { try {
       FC_ASSERT( is_open() );
       FC_ASSERT( !fc::exists( filename ) );
+      FC_ASSERT( !my->_batch, "Cannot export the wallet while a batch is open" );
 
       const auto dir = fc::absolute( filename ).parent_path();
       if( !fc::exists( dir ) )
@@ -460,6 +651,7 @@ namespace bts { namespace wallet {
       FC_ASSERT( is_open() );
 
       auto records = fc::json::from_file<std::vector<generic_wallet_record>>( filename );
+      wallet_db_batch batch( *this );
       for( const auto& record : records )
          store_generic_record( record );
    } FC_CAPTURE_AND_RETHROW( (filename) ) }
@@ -507,13 +699,11 @@ namespace bts { namespace wallet {
            const auto& public_key = public_key_item.first;
            const auto& account_name = public_key_item.second;
 
-           const auto key_record = lookup_key( public_key );
-           if( !key_record.valid() || !key_record->has_private_key() )
-               continue;
-
            try
            {
-               private_keys[ key_record->decrypt_private_key( password ) ] = account_name;
+               const auto private_key = lookup_private_key( address( public_key ), password );
+               if( private_key.valid() )
+                   private_keys[ *private_key ] = account_name;
            }
            catch( const fc::exception& e )
            {
@@ -523,6 +713,34 @@ namespace bts { namespace wallet {
        return private_keys;
    } FC_CAPTURE_AND_RETHROW() }
 
+   void wallet_db::cache_unlocked_keys( const fc::sha512& password )
+   {
+      my->_unlocked_keys.enable( password );
+   }
+
+   void wallet_db::clear_unlocked_keys()
+   {
+      my->_unlocked_keys.clear();
+   }
+
+   optional<private_key_type> wallet_db::lookup_private_key( const address& addr, const fc::sha512& password )const
+   { try {
+      const bool cached = my->_unlocked_keys.is_enabled_for( password );
+      if( cached )
+      {
+         const auto private_key = my->_unlocked_keys.get( addr );
+         if( private_key.valid() ) return private_key;
+      }
+
+      const auto key_record = lookup_key( addr );
+      if( !key_record.valid() || !key_record->has_private_key() )
+         return optional<private_key_type>();
+
+      const auto private_key = key_record->decrypt_private_key( password );
+      if( cached ) my->_unlocked_keys.store( addr, private_key );
+      return private_key;
+   } FC_CAPTURE_AND_RETHROW( (addr) ) }
+
    owallet_balance_record wallet_db::lookup_balance( const balance_id_type& balance_id )const
    {
       auto itr = balances.find( balance_id );
@@ -530,6 +748,81 @@ namespace bts { namespace wallet {
       return itr->second;
    }
 
+   void wallet_db::visit_balances_by_amount( asset_id_type asset_id, const function<bool( const wallet_balance_record& )>& visit )const
+   {
+      const auto index_itr = balance_ids_by_amount.find( asset_id );
+      if( index_itr == balance_ids_by_amount.end() ) return;
+      for( auto itr = index_itr->second.rbegin(); itr != index_itr->second.rend(); ++itr )
+      {
+         const auto balance_itr = balances.find( itr->second );
+         if( balance_itr == balances.end() ) continue;
+         if( !visit( balance_itr->second ) ) return;
+      }
+   }
+
+   void wallet_db::unindex_balance( const balance_id_type& balance_id )
+   {
+      const auto balance_itr = balances.find( balance_id );
+      if( balance_itr == balances.end() ) return;
+      const wallet_balance_record& rec = balance_itr->second;
+
+      const auto owner_itr = balance_totals_by_owner.find( rec.owner() );
+      if( owner_itr != balance_totals_by_owner.end() )
+      {
+         const auto total_itr = owner_itr->second.find( rec.condition.asset_id );
+         if( total_itr != owner_itr->second.end() )
+         {
+            total_itr->second -= rec.balance;
+            if( total_itr->second == 0 ) owner_itr->second.erase( total_itr );
+         }
+         if( owner_itr->second.empty() ) balance_totals_by_owner.erase( owner_itr );
+      }
+
+      const auto index_itr = balance_ids_by_amount.find( rec.condition.asset_id );
+      if( index_itr == balance_ids_by_amount.end() ) return;
+      index_itr->second.erase( std::make_pair( rec.balance, balance_id ) );
+      if( index_itr->second.empty() ) balance_ids_by_amount.erase( index_itr );
+   }
+
+   string wallet_db::owner_account_name( const address& owner )const
+   {
+      const auto key_record = lookup_key( owner );
+      if( !key_record.valid() || !key_record->has_private_key() ) return string();
+
+      const auto account_address = key_record->account_address;
+      const auto account_record = lookup_account( account_address );
+      return account_record.valid() ? account_record->name : string( account_address );
+   }
+
+   map<string, map<asset_id_type, share_type>> wallet_db::get_account_balance_totals( const string& account_name )const
+   {
+      map<string, map<asset_id_type, share_type>> totals;
+      for( const auto& owner_item : balance_totals_by_owner )
+      {
+         const string name = owner_account_name( owner_item.first );
+         if( name.empty() ) continue;
+         if( !account_name.empty() && name != account_name ) continue;
+
+         auto& account_totals = totals[ name ];
+         for( const auto& total_item : owner_item.second )
+            account_totals[ total_item.first ] += total_item.second;
+      }
+      return totals;
+   }
+
+   map<string, vector<balance_id_type>> wallet_db::get_account_balance_ids( const string& account_name )const
+   {
+      map<string, vector<balance_id_type>> balance_ids;
+      for( const auto& item : balances )
+      {
+         const string name = owner_account_name( item.second.owner() );
+         if( name.empty() ) continue;
+         if( !account_name.empty() && name != account_name ) continue;
+         balance_ids[ name ].push_back( item.first );
+      }
+      return balance_ids;
+   }
+
    vector<wallet_balance_record> wallet_db::get_all_balances( const string& account_name, uint32_t limit )
    {
        auto ret = vector<wallet_balance_record>();
@@ -751,8 +1044,6 @@ namespace bts { namespace wallet {
       if( trx_to_store.wallet_record_index == 0 )
          trx_to_store.wallet_record_index = new_wallet_record_index();
       store_record( trx_to_store, sync );
-
-      transactions[ trx_to_store.record_id ] = trx_to_store;
    } FC_CAPTURE_AND_RETHROW( (trx_to_store) ) }
 
    void wallet_db::cache_account( const wallet_account_record& war, const bool sync )
@@ -770,6 +1061,12 @@ namespace bts { namespace wallet {
    { try {
        try
        {
+           if( my->_batch )
+           {
+               my->_batch->remove( index );
+               my->_batched_records[ index ] = fc::optional<generic_wallet_record>();
+               return;
+           }
 #ifndef BTS_TEST_NETWORK
            my->_records.remove( index, true ); // Sync
 #else
@@ -811,6 +1108,10 @@ namespace bts { namespace wallet {
       FC_ASSERT( old_key, "unable to change password because old password was invalid" );
       set_master_key( *old_key, new_password );
 
+      const bool was_cached = my->_unlocked_keys.is_enabled_for( old_password );
+      my->_unlocked_keys.clear();
+      if( was_cached ) my->_unlocked_keys.enable( new_password );
+
       for( auto key : keys )
       {
          if( key.second.has_private_key() )
@@ -825,6 +1126,7 @@ namespace bts { namespace wallet {
    void wallet_db::remove_balance( const balance_id_type& balance_id )
    {
       remove_item( balances[balance_id].wallet_record_index );
+      unindex_balance( balance_id );
       balances.erase(balance_id);
    }
 
@@ -833,7 +1135,15 @@ namespace bts { namespace wallet {
       const auto rec = lookup_transaction( record_id );
       if( !rec.valid() ) return;
       remove_item( rec->wallet_record_index );
-      transactions.erase( record_id );
+      transaction_record_indexes.erase( record_id );
+      unconfirmed_transaction_ids.erase( record_id );
+
+      const auto key_itr = transaction_history_keys.find( record_id );
+      if( key_itr != transaction_history_keys.end() )
+      {
+         transaction_history_index.erase( key_itr->second );
+         transaction_history_keys.erase( key_itr );
+      }
    }
 
 } } // bts::wallet
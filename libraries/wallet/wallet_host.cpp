@@ -0,0 +1,157 @@
+#include <bts/wallet/config.hpp>
+#include <bts/wallet/exceptions.hpp>
+#include <bts/wallet/wallet_host.hpp>
+
+namespace bts { namespace wallet {
+
+   wallet_host::wallet_host( chain_database_ptr chain, const path& data_dir )
+   : _chain( chain ), _data_dir( data_dir )
+   {
+      _chain->add_observer( this );
+   }
+
+   wallet_host::~wallet_host()
+   {
+      _chain->remove_observer( this );
+      close_all();
+   }
+
+   wallet_ptr wallet_host::open_wallet( const string& wallet_name, const string& password )
+   { try {
+      FC_ASSERT( _wallets.find( wallet_name ) == _wallets.end(), "Wallet is already hosted!" );
+
+      const auto hosted_wallet = std::make_shared<wallet>( _chain );
+      hosted_wallet->set_data_directory( _data_dir );
+      hosted_wallet->open( wallet_name );
+      hosted_wallet->set_hosted( true );
+      hosted_wallet->unlock( password, BTS_WALLET_HOST_UNLOCK_TIME_SEC );
+      _wallets[ wallet_name ] = hosted_wallet;
+
+      scan_chain();
+      return hosted_wallet;
+   } FC_CAPTURE_AND_RETHROW( (wallet_name) ) }
+
+   void wallet_host::close_wallet( const string& wallet_name )
+   { try {
+      const auto itr = _wallets.find( wallet_name );
+      if( itr == _wallets.end() ) FC_CAPTURE_AND_THROW( no_such_wallet, (wallet_name) );
+      itr->second->close();
+      _wallets.erase( itr );
+   } FC_CAPTURE_AND_RETHROW( (wallet_name) ) }
+
+   void wallet_host::close_all()
+   {
+      for( const auto& item : _wallets )
+      {
+         try
+         {
+            item.second->close();
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "Error closing hosted wallet ${w}: ${e}", ("w",item.first)("e",e.to_detail_string()) );
+         }
+      }
+      _wallets.clear();
+   }
+
+   wallet_ptr wallet_host::get_wallet( const string& wallet_name )const
+   { try {
+      const auto itr = _wallets.find( wallet_name );
+      if( itr == _wallets.end() ) FC_CAPTURE_AND_THROW( no_such_wallet, (wallet_name) );
+      return itr->second;
+   } FC_CAPTURE_AND_RETHROW( (wallet_name) ) }
+
+   vector<string> wallet_host::list_wallets()const
+   {
+      vector<string> wallet_names;
+      wallet_names.reserve( _wallets.size() );
+      for( const auto& item : _wallets )
+         wallet_names.push_back( item.first );
+      return wallet_names;
+   }
+
+   void wallet_host::scan_chain()
+   { try {
+      const uint32_t head_block_num = _chain->get_head_block_num();
+
+      /* Wallets that are further along skip the blocks they already have in scan_blocks */
+      uint32_t block_num = head_block_num + 1;
+      for( const auto& item : _wallets )
+      {
+         if( !item.second->is_unlocked() ) continue;
+         block_num = std::min( block_num, item.second->get_last_scanned_block_number() + 1 );
+      }
+
+      vector<full_block> chunk;
+      while( block_num <= head_block_num )
+      {
+         chunk.clear();
+         const uint32_t chunk_end = std::min<uint32_t>( head_block_num, block_num + BTS_WALLET_SCAN_CHUNK_SIZE - 1 );
+         for( uint32_t chunk_block_num = block_num; chunk_block_num <= chunk_end; ++chunk_block_num )
+         {
+            try
+            {
+               chunk.push_back( _chain->get_block( chunk_block_num ) );
+            }
+            catch( ... )
+            {
+               chunk.push_back( full_block() );
+            }
+         }
+
+         for( const auto& item : _wallets )
+         {
+            try
+            {
+               item.second->scan_blocks( block_num, chunk );
+            }
+            catch( const fc::exception& e )
+            {
+               wlog( "Error scanning hosted wallet ${w}: ${e}", ("w",item.first)("e",e.to_detail_string()) );
+            }
+         }
+
+         block_num = chunk_end + 1;
+         fc::yield();
+      }
+   } FC_CAPTURE_AND_RETHROW() }
+
+   /**
+    *  Each hosted wallet that cannot settle the block from its applied changes is scanned up to it, with the
+    *  missing blocks read once for all of them.
+    */
+   void wallet_host::block_applied( const block_summary& summary )
+   {
+      const uint32_t block_num = summary.block_data.block_num;
+      bool needs_scan = false;
+      for( const auto& item : _wallets )
+      {
+         const auto& hosted_wallet = item.second;
+         if( !hosted_wallet->is_open() || !hosted_wallet->is_unlocked() ) continue;
+         if( hosted_wallet->get_last_scanned_block_number() >= block_num ) continue;
+         try
+         {
+            if( hosted_wallet->settle_block( summary ) ) continue;
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "Error settling block ${n} for hosted wallet ${w}: ${e}", ("n",block_num)("w",item.first)("e",e.to_detail_string()) );
+         }
+         needs_scan = true;
+      }
+
+      if( needs_scan )
+      {
+         try
+         {
+            scan_chain();
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "Error scanning hosted wallets at block ${n}: ${e}", ("n",block_num)("e",e.to_detail_string()) );
+         }
+      }
+   }
+
+} } // bts::wallet
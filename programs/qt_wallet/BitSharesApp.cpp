@@ -489,8 +489,14 @@ void BitSharesApp::prepareStartupSequence(ClientWrapper* client, Html5Viewer* vi
     QMessageBox::critical(nullptr, QApplication::tr("Critical Error"), errorString);
     exit(1);
   });
+  //The last known balances stay on the splash screen above the status until the web interface replaces it
+  auto balancesText = std::make_shared<QString>();
+  client->connect(client, &ClientWrapper::wallet_preview, [=](QStringList balances) {
+    *balancesText = tr("Last known balances (updating):") + "\n" + balances.join("\n") + "\n\n";
+    splash->showMessage(*balancesText, Qt::AlignCenter | Qt::AlignBottom, Qt::black);
+  });
   client->connect(client, &ClientWrapper::status_update, [=](QString messageString) {
-    splash->showMessage(messageString, Qt::AlignCenter | Qt::AlignBottom, Qt::black);
+    splash->showMessage(*balancesText + messageString, Qt::AlignCenter | Qt::AlignBottom, Qt::black);
   });
 }
 
@@ -4,6 +4,7 @@
 #include <bts/net/upnp.hpp>
 #include <bts/net/config.hpp>
 #include <bts/db/exception.hpp>
+#include <bts/wallet/wallet_db.hpp>
 
 #include <QApplication>
 #include <QResource>
@@ -13,6 +14,7 @@
 #include <QMessageBox>
 #include <QDir>
 
+#include <cmath>
 #include <iostream>
 
 void ClientWrapper::get_htdocs_file( const fc::path& filename, const fc::http::server::response& r )
@@ -55,6 +57,37 @@ void ClientWrapper::get_htdocs_file( const fc::path& filename, const fc::http::s
   return give_200((const char*)file_to_send.data(), file_to_send.size());
 }
 
+QStringList ClientWrapper::read_last_known_balances(const fc::path& wallet_file)
+{
+  QStringList balances;
+  if (!fc::exists(wallet_file))
+    return balances;
+
+  try
+  {
+    bts::wallet::wallet_db db;
+    db.open(wallet_file);
+    const int decimals = int(std::log10(double(BTS_BLOCKCHAIN_PRECISION)));
+    for (const auto& account : db.get_account_balance_totals(""))
+    {
+      const auto base_total = account.second.find(bts::blockchain::asset_id_type(0));
+      if (base_total == account.second.end() || base_total->second == 0)
+        continue;
+      balances << tr("%1: %2 %3").arg(QString::fromStdString(account.first))
+                                 .arg(double(base_total->second) / BTS_BLOCKCHAIN_PRECISION, 0, 'f', decimals)
+                                 .arg(BTS_BLOCKCHAIN_SYMBOL);
+    }
+    db.close();
+  }
+  catch (const fc::exception& e)
+  {
+    //An old or damaged wallet is upgraded or reported when the client opens it; the preview is simply skipped
+    wlog("Unable to read the last known balances from ${file}: ${e}", ("file", wallet_file)("e", e.to_detail_string()));
+    balances.clear();
+  }
+  return balances;
+}
+
 ClientWrapper::ClientWrapper(QObject *parent)
   : QObject(parent),
     _bitshares_thread("bitshares"),
@@ -142,6 +175,14 @@ void ClientWrapper::initialize(INotifier* notifier)
     try
     {
       main_thread->async( [&]{ Q_EMIT status_update(tr("Starting %1").arg(qApp->applicationName())); });
+
+      //Startup is staged: the balances the wallet saw last are shown read-only first, since opening the chain
+      //(and possibly reindexing it) and catching up with the network can take minutes. The wallet database is
+      //closed again before the client opens the wallet itself.
+      const QStringList last_known_balances = read_last_known_balances(fc::path(data_dir.toStdWString()) / "wallets" / default_wallet_name);
+      if (!last_known_balances.isEmpty())
+        main_thread->async( [=]{ Q_EMIT wallet_preview(last_known_balances); });
+
       _client = std::make_shared<bts::client::client>("qt_wallet");
       _client->open( data_dir.toStdWString(), fc::optional<fc::path>(), [=](float progress) {
          main_thread->async( [=]{ Q_EMIT status_update(tr("Reindexing database... Approximately %1% complete.").arg(progress, 0, 'f', 0)); } );
@@ -2,6 +2,7 @@
 
 #include <QObject>
 #include <QSettings>
+#include <QStringList>
 #include <QVariant>
 
 #include <bts/rpc/rpc_server.hpp>
@@ -51,6 +52,8 @@ public Q_SLOTS:
     void initialized();
     void status_update(QString statusString);
     void error(QString errorString);
+    /// The balances the default wallet last saw, one line per account, sent before the chain is opened
+    void wallet_preview(QStringList balances);
 
   private:
     bts::client::config                  _cfg;
@@ -66,4 +69,6 @@ public Q_SLOTS:
     std::unordered_map<std::string, std::vector<char>> _web_package;
 
     void get_htdocs_file(const fc::path& filename, const fc::http::server::response& r);
+    /// Reads the cached balances straight from the wallet database, without the chain or the wallet password
+    QStringList read_last_known_balances(const fc::path& wallet_file);
 };
@@ -0,0 +1,376 @@
+/**
+ *  Generates a synthetic chain of production scale in a data directory, for benchmarks and reindex tests.
+ *
+ *  The accounts and balances go into a genesis file, which the chain database imports in bulk when it
+ *  opens, rather than into blocks: --accounts registered names and --balances genesis balances, next to
+ *  the 101 delegates and a market issued USD. The chain then gets --blocks blocks of simulated time,
+ *  each holding --orders-per-block asks and shorts on the USD market and --transfers-per-block transfers
+ *  from the genesis balances to the accounts. Asks and shorts both sell XTS, so they never match each
+ *  other and the book only grows. Every --fork-every blocks the chain switches to a fork that replaces
+ *  its last --fork-length blocks. Keys derive from --seed, so the same options give the same chain.
+ *
+ *  The directory ends up holding chain/, which a client opens with --data-dir, and genesis.json with
+ *  the delegate keys in genesis.json.keypairs, which bts_benchmarks takes for --genesis and --keypairs
+ *  and a client for --genesis-config when it rebuilds the index.
+ */
+#include <bts/blockchain/chain_database.hpp>
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/genesis_config.hpp>
+#include <bts/blockchain/time.hpp>
+#include <bts/utilities/key_conversion.hpp>
+
+#include <fc/crypto/ripemd160.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/crypto/sha512.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <unordered_map>
+
+using namespace bts::blockchain;
+
+static fc::ecc::private_key generated_key( const std::string& seed, const std::string& kind, uint64_t n )
+{
+   return fc::ecc::private_key::regenerate( fc::sha256::hash( seed + "/" + kind + "/" + std::to_string( n ) ) );
+}
+
+struct funded_balance
+{
+   fc::ecc::private_key key;
+   balance_id_type      id;
+   share_type           remaining = 0;
+};
+
+class chain_generator
+{
+   public:
+      chain_generator( const std::string& seed ) : _seed( seed ), _random( std::hash<std::string>()( seed ) ){}
+
+      /** writes genesis.json and genesis.json.keypairs into dir */
+      fc::path write_genesis( const fc::path& dir, const fc::time_point_sec& timestamp, uint32_t accounts, uint32_t balances )
+      {
+         genesis_block_config config;
+         config.timestamp = timestamp;
+         asset_config usd;
+         usd.symbol = "USD";
+         usd.name = "United States Dollar";
+         usd.description = "Synthetic market issued asset";
+         usd.precision = 10000;
+         config.market_assets.push_back( usd );
+
+         const fc::path genesis = dir / "genesis.json";
+         std::ofstream keypairs( ( genesis.string() + ".keypairs" ).c_str() );
+         for( uint32_t n = 0; n < BTS_BLOCKCHAIN_NUM_DELEGATES; ++n )
+         {
+            const auto key = generated_key( _seed, "delegate", n );
+            const public_key_type public_key( key.get_public_key() );
+            name_config delegate;
+            delegate.name = "delegate-" + std::to_string( n );
+            delegate.owner = public_key;
+            delegate.delegate_pay_rate = 100;
+            config.names.push_back( delegate );
+            _delegate_keys[ public_key ] = key;
+            keypairs << std::string( public_key ) << "   " << bts::utilities::key_to_wif( key ) << "\n";
+         }
+
+         _account_addresses.reserve( accounts );
+         for( uint32_t n = 0; n < accounts; ++n )
+         {
+            const public_key_type public_key( generated_key( _seed, "account", n ).get_public_key() );
+            name_config account;
+            account.name = "account-" + std::to_string( n );
+            account.owner = public_key;
+            config.names.push_back( account );
+            _account_addresses.push_back( address( public_key ) );
+         }
+
+         config.balances.reserve( balances );
+         _genesis_keys.reserve( balances );
+         for( uint32_t n = 0; n < balances; ++n )
+         {
+            const auto key = generated_key( _seed, "balance", n );
+            const pts_address owner( key.get_public_key(), true, 56 );
+            config.balances.emplace_back( owner, 1000 );
+            _genesis_keys[ address( owner ) ] = key;
+            if( ( n + 1 ) % 100000 == 0 )
+               std::cerr << "derived " << ( n + 1 ) << " genesis balances\n";
+         }
+
+         fc::json::save_to_file( config, genesis, false );
+         return genesis;
+      }
+
+      void open( const fc::path& dir, const fc::path& genesis )
+      {
+         _db = std::make_shared<chain_database>();
+         _db->open( dir / "chain", genesis );
+         // the transactions are signed all the same, so a reindex still checks every signature
+         _db->skip_signature_verification( true );
+
+         /* genesis balances have random slates, so their ids are only known once the chain holds them */
+         _db->scan_balances( [&]( const balance_record& balance )
+         {
+            const auto key = _genesis_keys.find( balance.owner() );
+            if( key != _genesis_keys.end() )
+               _funded.push_back( funded_balance{ key->second, balance.id(), balance.balance } );
+         } );
+         _genesis_keys.clear();
+         FC_ASSERT( !_funded.empty(), "the genesis holds no balances" );
+
+         const oasset_record usd = _db->get_asset_record( "USD" );
+         FC_ASSERT( usd.valid() );
+         _usd_id = usd->id;
+         _slot = _db->get_genesis_timestamp();
+      }
+
+      /** a block of orders and transfers on the head block */
+      void push_block( uint32_t orders, uint32_t transfers )
+      {
+         const uint32_t start = _db->get_head_block_num();
+         for( uint32_t n = 0; n < orders; ++n )
+            _db->store_pending_transaction( make_order( n % 2 == 0 ) );
+         for( uint32_t n = 0; n < transfers; ++n )
+            _db->store_pending_transaction( make_transfer() );
+         _orders += orders;
+         _transfers += transfers;
+
+         next_slot();
+         full_block block = _db->generate_block( _slot );
+         sign( block, _db->get_slot_signee( _slot, _db->get_active_delegates() ) );
+         _db->push_block( block );
+         FC_ASSERT( _db->get_head_block_num() == start + 1 );
+      }
+
+      /**
+       *  Pushes length blocks on the head block, then a fork of length + 1 empty blocks from the block
+       *  before them, which the chain switches to. Returns false, pushing nothing, when the blocks would
+       *  span a change of the active delegates or need a delegate twice, as the fork is signed with the
+       *  delegate state of the block it forks from.
+       */
+      bool push_fork( uint32_t length, uint32_t orders, uint32_t transfers )
+      {
+         const uint32_t fork_point = _db->get_head_block_num();
+         if( ( fork_point + length ) / BTS_BLOCKCHAIN_NUM_DELEGATES != fork_point / BTS_BLOCKCHAIN_NUM_DELEGATES )
+            return false;
+
+         const auto active = _db->get_active_delegates();
+         std::set<account_id_type> signers;
+         fc::time_point_sec slot = _slot;
+         for( uint32_t n = 0; n < 2 * length + 1; ++n )
+         {
+            slot += BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
+            if( !signers.insert( _db->get_slot_signee( slot, active ).id ).second )
+               return false;
+         }
+
+         const block_id_type fork_from = _db->get_head_block_id();
+         for( uint32_t n = 0; n < length; ++n )
+            push_block( orders, transfers );
+
+         block_id_type previous = fork_from;
+         for( uint32_t n = 0; n <= length; ++n )
+         {
+            next_slot();
+            full_block block;
+            block.previous = previous;
+            block.block_num = fork_point + n + 1;
+            block.timestamp = _slot;
+            block.transaction_digest = digest_block( (const signed_block_header&)block ).calculate_transaction_digest();
+            sign( block, _db->get_slot_signee( _slot, active ) );
+            _db->push_block( block );
+            previous = block.id();
+         }
+         FC_ASSERT( _db->get_head_block_id() == previous, "the chain did not switch to the fork" );
+         ++_forks;
+         return true;
+      }
+
+      void close()
+      {
+         std::cerr << "head block " << _db->get_head_block_num() << ", " << _orders << " orders, "
+                   << _transfers << " transfers, " << _forks << " forks\n";
+         _db->close();
+      }
+
+   private:
+      /** the secret a delegate commits to in a block on previous, derived as the wallet does */
+      static secret_hash_type block_secret( const fc::ecc::private_key& key, const block_id_type& previous )
+      {
+         fc::sha512::encoder key_enc;
+         fc::raw::pack( key_enc, key );
+         fc::sha512::encoder enc;
+         fc::raw::pack( enc, key_enc.result() );
+         fc::raw::pack( enc, previous );
+         return fc::ripemd160::hash( enc.result() );
+      }
+
+      void sign( full_block& block, const account_record& signee )
+      {
+         const auto key = _delegate_keys.find( signee.active_key() );
+         FC_ASSERT( key != _delegate_keys.end() && signee.delegate_info.valid() );
+         if( signee.delegate_info->blocks_produced > 0 )
+         {
+            const auto last = _db->get_block_header( signee.delegate_info->last_block_num_produced );
+            block.previous_secret = block_secret( key->second, last.previous );
+         }
+         block.next_secret_hash = fc::ripemd160::hash( block_secret( key->second, block.previous ) );
+         block.sign( key->second );
+      }
+
+      void next_slot()
+      {
+         _slot += BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
+         bts::blockchain::start_simulated_time( fc::time_point( _slot ) );
+      }
+
+      /** the next genesis balance holding amount and the fee, round robin */
+      funded_balance& spend( share_type amount )
+      {
+         for( size_t tried = 0; tried < _funded.size(); ++tried )
+         {
+            funded_balance& balance = _funded[ _next_funded++ % _funded.size() ];
+            if( balance.remaining >= amount + fee )
+            {
+               balance.remaining -= amount + fee;
+               return balance;
+            }
+         }
+         FC_THROW( "the genesis balances are spent, generate fewer blocks or more balances" );
+      }
+
+      signed_transaction make_order( bool ask )
+      {
+         const share_type amount = std::uniform_int_distribution<share_type>( 1, 100 )( _random ) * BTS_BLOCKCHAIN_PRECISION;
+         const funded_balance& from = spend( amount );
+         const address owner( from.key.get_public_key() );
+
+         signed_transaction trx;
+         trx.expiration = _slot + BTS_BLOCKCHAIN_MAX_TRANSACTION_EXPIRATION_SEC / 2;
+         trx.withdraw( from.id, amount + fee );
+         // a thousand price levels on each side
+         const double level = std::uniform_int_distribution<int>( 1, 1000 )( _random );
+         if( ask )
+            trx.ask( asset( amount, 0 ), price( 0.01 + level / 10000, _usd_id, 0 ), owner );
+         else
+            trx.short_sell( asset( amount, 0 ), price( level / 10000, _usd_id, 0 ), owner );
+         trx.sign( from.key, _db->chain_id() );
+         return trx;
+      }
+
+      signed_transaction make_transfer()
+      {
+         const share_type amount = BTS_BLOCKCHAIN_PRECISION;
+         const funded_balance& from = spend( amount );
+         const auto to = std::uniform_int_distribution<size_t>( 0, _account_addresses.size() - 1 )( _random );
+
+         signed_transaction trx;
+         trx.expiration = _slot + BTS_BLOCKCHAIN_MAX_TRANSACTION_EXPIRATION_SEC / 2;
+         trx.withdraw( from.id, amount + fee );
+         trx.deposit( _account_addresses[ to ], asset( amount, 0 ), 0 );
+         trx.sign( from.key, _db->chain_id() );
+         return trx;
+      }
+
+      static const share_type fee = BTS_BLOCKCHAIN_PRECISION;
+
+      std::string                                           _seed;
+      std::mt19937_64                                       _random;
+      chain_database_ptr                                    _db;
+      std::map<public_key_type, fc::ecc::private_key>       _delegate_keys;
+      std::vector<address>                                  _account_addresses;
+      std::unordered_map<address, fc::ecc::private_key>     _genesis_keys;
+      std::vector<funded_balance>                           _funded;
+      size_t                                                _next_funded = 0;
+      asset_id_type                                         _usd_id = 0;
+      fc::time_point_sec                                    _slot;
+      uint64_t                                              _orders = 0;
+      uint64_t                                              _transfers = 0;
+      uint32_t                                              _forks = 0;
+};
+
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()("help",                                                                                     "display this help message")
+                              ("data-dir",            boost::program_options::value<std::string>(),                       "directory to generate the chain in, which must not hold one")
+                              ("seed",                boost::program_options::value<std::string>()->default_value( "bts_chain_generator" ), "text to derive every key and choice from")
+                              ("timestamp",           boost::program_options::value<std::string>()->default_value( "20150101T000000" ),     "time of the genesis block")
+                              ("accounts",            boost::program_options::value<uint32_t>()->default_value( 10000 ),   "accounts registered in the genesis, besides the delegates")
+                              ("balances",            boost::program_options::value<uint32_t>()->default_value( 1000000 ), "balances in the genesis")
+                              ("blocks",              boost::program_options::value<uint32_t>()->default_value( 1000 ),    "length of the chain to produce")
+                              ("orders-per-block",    boost::program_options::value<uint32_t>()->default_value( 100 ),     "asks and shorts in each block")
+                              ("transfers-per-block", boost::program_options::value<uint32_t>()->default_value( 50 ),      "transfers in each block")
+                              ("fork-every",          boost::program_options::value<uint32_t>()->default_value( 100 ),     "blocks between forks, 0 for none")
+                              ("fork-length",         boost::program_options::value<uint32_t>()->default_value( 2 ),       "blocks each fork replaces");
+   boost::program_options::variables_map options;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), options );
+      boost::program_options::notify( options );
+   }
+   catch( const boost::program_options::error& e )
+   {
+      std::cerr << e.what() << "\n" << option_config << "\n";
+      return 1;
+   }
+   if( options.count( "help" ) || !options.count( "data-dir" ) )
+   {
+      std::cout << option_config << "\n";
+      return options.count( "help" ) ? 0 : 1;
+   }
+
+   try
+   {
+      const fc::path dir( options["data-dir"].as<std::string>() );
+      FC_ASSERT( !fc::exists( dir / "chain" ), "${dir} already holds a chain", ("dir",dir) );
+      fc::create_directories( dir );
+
+      const uint32_t blocks = options["blocks"].as<uint32_t>();
+      const uint32_t orders = options["orders-per-block"].as<uint32_t>();
+      const uint32_t transfers = options["transfers-per-block"].as<uint32_t>();
+      const uint32_t fork_every = options["fork-every"].as<uint32_t>();
+      const uint32_t fork_length = options["fork-length"].as<uint32_t>();
+      FC_ASSERT( options["accounts"].as<uint32_t>() > 0 && options["balances"].as<uint32_t>() > 0 );
+      FC_ASSERT( fork_length > 0 && 2 * fork_length + 1 <= BTS_BLOCKCHAIN_NUM_DELEGATES, "a fork must take 1 to 50 blocks" );
+
+      chain_generator generator( options["seed"].as<std::string>() );
+      const fc::path genesis = generator.write_genesis( dir, fc::time_point_sec::from_iso_string( options["timestamp"].as<std::string>() ),
+                                                        options["accounts"].as<uint32_t>(), options["balances"].as<uint32_t>() );
+      generator.open( dir, genesis );
+
+      uint32_t since_fork = 0;
+      for( uint32_t n = 0; n < blocks; )
+      {
+         // a fork that cannot be signed here is tried again on the next block
+         if( fork_every > 0 && since_fork >= fork_every && n + fork_length + 1 <= blocks
+             && generator.push_fork( fork_length, orders, transfers ) )
+         {
+            n += fork_length + 1;
+            since_fork = 0;
+            continue;
+         }
+         generator.push_block( orders, transfers );
+         ++n;
+         ++since_fork;
+         if( n % 100 == 0 )
+            std::cerr << "pushed " << n << " of " << blocks << " blocks\n";
+      }
+      generator.close();
+   }
+   catch( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -57,7 +57,7 @@ int main( int argc, char** argv )
 
   if (option_variables.count("binary-out"))
   {
-    std::ofstream genesis_bin(option_variables["binary-out"].as<std::string>());
+    std::ofstream genesis_bin(option_variables["binary-out"].as<std::string>(), std::ios::out | std::ios::binary);
     fc::raw::pack(genesis_bin, genesis_config);
   }
 
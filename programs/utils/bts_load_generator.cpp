@@ -0,0 +1,289 @@
+/**
+ *  Measures how many transfers a node accepts and puts in blocks per second.
+ *
+ *  The load keys are derived from --seed, so runs with the same seed reuse them. With --fund, the balance
+ *  --funding-balance owned by --funding-key, for example a delegate key of a test genesis, first pays
+ *  --amount to each load key, in transactions of up to 100 deposits, and the run waits until the last of
+ *  them is in a block.
+ *
+ *  The load transactions are built and signed offline on --threads worker threads before any is sent.
+ *  Each withdraws the relay fee and a few shares from a load key and deposits the shares back, so the
+ *  balance id of a key never changes and it can sign --per-key transactions; keep that under the
+ *  pending pool's limit per signer. They are sent through network_broadcast_transaction on the JSON-RPC
+ *  port of the node at --rate per second, by --connections tasks at a time.
+ *
+ *  At the end it reports the transactions accepted per second, how long network_broadcast_transaction
+ *  took to take each into the pending pool, and how long until each was in a block, which a task finds
+ *  by reading every new block while the run goes on.
+ */
+#include <bts/blockchain/block.hpp>
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/transaction.hpp>
+#include <bts/blockchain/withdraw_types.hpp>
+#include <bts/rpc/rpc_client.hpp>
+#include <bts/utilities/key_conversion.hpp>
+
+#include <fc/crypto/sha256.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+
+using namespace bts::blockchain;
+
+/** the balance a key owns when deposits to its address name no slate */
+static balance_id_type balance_of( const fc::ecc::private_key& key )
+{
+   return withdraw_condition( withdraw_with_signature( address( key.get_public_key() ) ), 0, 0 ).get_address();
+}
+
+static std::vector<fc::ecc::private_key> derive_keys( const std::string& seed, uint32_t count )
+{
+   std::vector<fc::ecc::private_key> keys;
+   keys.reserve( count );
+   for( uint32_t i = 0; i < count; ++i )
+      keys.push_back( fc::ecc::private_key::regenerate( fc::sha256::hash( seed + "/" + std::to_string( i ) ) ) );
+   return keys;
+}
+
+/** signs the transactions on threads worker threads, each taking every threads-th one */
+static void sign_in_parallel( std::vector<signed_transaction>& trxs, const std::vector<const fc::ecc::private_key*>& signers,
+                              const digest_type& chain_id, uint32_t threads )
+{
+   std::vector<std::unique_ptr<fc::thread>> workers;
+   std::vector<fc::future<void>> done;
+   for( uint32_t w = 0; w < threads; ++w )
+   {
+      workers.emplace_back( new fc::thread( "signer_" + std::to_string( w ) ) );
+      done.push_back( workers.back()->async( [&, w]()
+      {
+         for( size_t i = w; i < trxs.size(); i += threads )
+            trxs[ i ].sign( *signers[ i ], chain_id );
+      }, "sign_load" ) );
+   }
+   for( auto& d : done )
+      d.wait();
+}
+
+/** how long each of a set of transactions took, kept to report percentiles */
+struct latency_summary
+{
+   std::vector<int64_t> microseconds;
+
+   void print( std::ostream& out, const char* title )
+   {
+      out << title << ": ";
+      if( microseconds.empty() )
+      {
+         out << "none\n";
+         return;
+      }
+      std::sort( microseconds.begin(), microseconds.end() );
+      const auto at = [&]( double fraction ) { return double( microseconds[ size_t( fraction * ( microseconds.size() - 1 ) ) ] ) / 1000; };
+      out << std::fixed << std::setprecision( 1 )
+          << "p50 " << at( 0.5 ) << " ms, p90 " << at( 0.9 ) << " ms, p99 " << at( 0.99 ) << " ms, max " << at( 1 ) << " ms"
+          << " over " << microseconds.size() << " transactions\n";
+   }
+};
+
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()("help",                                                                                   "display this help message")
+                              ("rpc-endpoint",    boost::program_options::value<std::string>(),                      "JSON-RPC endpoint of the node, as ip:port")
+                              ("rpc-user",        boost::program_options::value<std::string>()->default_value( "" ),  "JSON-RPC user name")
+                              ("rpc-password",    boost::program_options::value<std::string>()->default_value( "" ),  "JSON-RPC password")
+                              ("seed",            boost::program_options::value<std::string>()->default_value( "load" ), "string the load keys are derived from")
+                              ("keys",            boost::program_options::value<uint32_t>()->default_value( 1000 ),   "number of load keys")
+                              ("per-key",         boost::program_options::value<uint32_t>()->default_value( 50 ),     "transactions signed by each load key")
+                              ("fund",                                                                                   "fund the load keys before the run")
+                              ("funding-key",     boost::program_options::value<std::string>(),                      "WIF key owning the funding balance")
+                              ("funding-balance", boost::program_options::value<std::string>(),                      "balance id paying for the load keys")
+                              ("amount",          boost::program_options::value<int64_t>(),                          "shares given to each load key, enough for its transactions by default")
+                              ("threads",         boost::program_options::value<uint32_t>()->default_value( 4 ),      "threads signing the transactions")
+                              ("rate",            boost::program_options::value<uint32_t>()->default_value( 100 ),    "transactions sent per second")
+                              ("connections",     boost::program_options::value<uint32_t>()->default_value( 8 ),      "calls to the node in flight at once");
+   boost::program_options::variables_map options;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), options );
+      boost::program_options::notify( options );
+   }
+   catch( const boost::program_options::error& e )
+   {
+      std::cerr << e.what() << "\n" << option_config << "\n";
+      return 1;
+   }
+   if( options.count( "help" ) || !options.count( "rpc-endpoint" ) )
+   {
+      std::cout << option_config << "\n";
+      return options.count( "help" ) ? 0 : 1;
+   }
+
+   try
+   {
+      const auto rpc = std::make_shared<bts::rpc::rpc_client>();
+      rpc->connect_to( fc::ip::endpoint::from_string( options["rpc-endpoint"].as<std::string>() ) );
+      if( !options["rpc-user"].as<std::string>().empty() )
+         FC_ASSERT( rpc->login( options["rpc-user"].as<std::string>(), options["rpc-password"].as<std::string>() ), "login failed" );
+
+      const fc::variant_object info = rpc->blockchain_get_info();
+      const digest_type chain_id = info["blockchain_id"].as<digest_type>();
+      const share_type fee = info["relay_fee"].as<share_type>();
+      const uint32_t key_count = options["keys"].as<uint32_t>();
+      const uint32_t per_key = options["per-key"].as<uint32_t>();
+      FC_ASSERT( key_count > 0 && per_key > 0 );
+      const uint32_t threads = std::max<uint32_t>( 1, options["threads"].as<uint32_t>() );
+      const auto keys = derive_keys( options["seed"].as<std::string>(), key_count );
+      const fc::time_point_sec expiration = fc::time_point::now() + fc::hours( 1 );
+
+      if( options.count( "fund" ) )
+      {
+         FC_ASSERT( options.count( "funding-key" ) && options.count( "funding-balance" ), "--fund needs --funding-key and --funding-balance" );
+         const fc::optional<fc::ecc::private_key> funding_key = bts::utilities::wif_to_key( options["funding-key"].as<std::string>() );
+         FC_ASSERT( funding_key.valid(), "invalid funding key" );
+         const balance_id_type funding_balance( options["funding-balance"].as<std::string>() );
+         // transaction k deposits k shares back to the key on top of the fee, see below
+         const share_type amount = options.count( "amount" ) ? share_type( options["amount"].as<int64_t>() )
+                                                             : share_type( per_key ) * ( fee + per_key );
+
+         std::vector<signed_transaction> funding;
+         for( uint32_t first = 0; first < key_count; first += 100 )
+         {
+            signed_transaction trx;
+            trx.expiration = expiration;
+            const uint32_t last = std::min( first + 100, key_count );
+            trx.withdraw( funding_balance, amount * ( last - first ) + fee );
+            for( uint32_t i = first; i < last; ++i )
+               trx.deposit( address( keys[ i ].get_public_key() ), asset( amount, 0 ), 0 );
+            trx.sign( *funding_key, chain_id );
+            funding.push_back( trx );
+         }
+         for( const auto& trx : funding )
+            rpc->network_broadcast_transaction( trx );
+         std::cerr << "sent " << funding.size() << " funding transactions, waiting for them to be in a block\n";
+
+         const balance_id_type last_funded = balance_of( keys.back() );
+         while( true )
+         {
+            try
+            {
+               if( rpc->blockchain_get_balance( last_funded ).balance >= amount )
+                  break;
+            }
+            catch( const fc::exception& )
+            {
+            }
+            fc::usleep( fc::seconds( 1 ) );
+         }
+      }
+
+      // key i % key_count signs transaction i, so the keys take turns and each has per_key at most
+      const size_t total = size_t( key_count ) * per_key;
+      std::vector<signed_transaction> trxs( total );
+      std::vector<const fc::ecc::private_key*> signers( total );
+      for( size_t i = 0; i < total; ++i )
+      {
+         const auto& key = keys[ i % key_count ];
+         const share_type shares = share_type( i / key_count ) + 1; // keeps the transactions of a key distinct
+         trxs[ i ].expiration = expiration;
+         trxs[ i ].withdraw( balance_of( key ), fee + shares );
+         trxs[ i ].deposit( address( key.get_public_key() ), asset( shares, 0 ), 0 );
+         signers[ i ] = &key;
+      }
+      const fc::time_point signing_start = fc::time_point::now();
+      sign_in_parallel( trxs, signers, chain_id, threads );
+      std::cerr << "signed " << total << " transactions in "
+                << ( fc::time_point::now() - signing_start ).count() / 1000 << " ms\n";
+
+      std::unordered_map<transaction_id_type, fc::time_point> sent_at;
+      latency_summary accept_latency;
+      latency_summary inclusion_latency;
+      uint64_t accepted = 0;
+      uint64_t rejected = 0;
+      bool sending = true;
+      // transactions dropped from the pool never show up, so the wait for the last ones is bounded
+      fc::time_point give_up = fc::time_point::maximum();
+
+      fc::future<void> block_watcher = fc::async( [&]()
+      {
+         uint32_t next_block = rpc->blockchain_get_block_count() + 1;
+         while( sending || ( inclusion_latency.microseconds.size() < accepted && fc::time_point::now() < give_up ) )
+         {
+            const uint32_t head = rpc->blockchain_get_block_count();
+            for( ; next_block <= head; ++next_block )
+            {
+               const fc::optional<digest_block> block = rpc->blockchain_get_block( std::to_string( next_block ) );
+               if( !block.valid() ) continue;
+               const fc::time_point now = fc::time_point::now();
+               for( const auto& id : block->user_transaction_ids )
+               {
+                  const auto itr = sent_at.find( id );
+                  if( itr != sent_at.end() )
+                     inclusion_latency.microseconds.push_back( ( now - itr->second ).count() );
+               }
+            }
+            fc::usleep( fc::milliseconds( 200 ) );
+         }
+      }, "watch_blocks" );
+
+      // each sender sends every connections-th transaction when its turn at the rate comes
+      const uint32_t rate = std::max<uint32_t>( 1, options["rate"].as<uint32_t>() );
+      const uint32_t connections = std::max<uint32_t>( 1, options["connections"].as<uint32_t>() );
+      const fc::time_point start = fc::time_point::now();
+      std::vector<fc::future<void>> senders;
+      for( uint32_t c = 0; c < connections; ++c )
+      {
+         senders.push_back( fc::async( [&, c]()
+         {
+            for( size_t i = c; i < total; i += connections )
+            {
+               const fc::time_point due = start + fc::microseconds( int64_t( i ) * 1000000 / rate );
+               if( due > fc::time_point::now() )
+                  fc::usleep( due - fc::time_point::now() );
+               const fc::time_point sent = fc::time_point::now();
+               try
+               {
+                  rpc->network_broadcast_transaction( trxs[ i ] );
+                  const fc::time_point done = fc::time_point::now();
+                  sent_at[ trxs[ i ].id() ] = sent;
+                  accept_latency.microseconds.push_back( ( done - sent ).count() );
+                  ++accepted;
+               }
+               catch( const fc::exception& e )
+               {
+                  if( rejected++ < 10 )
+                     std::cerr << "rejected: " << e.to_string() << "\n";
+               }
+            }
+         }, "send_load" ) );
+      }
+      for( auto& sender : senders )
+         sender.wait();
+      const fc::microseconds sending_time = fc::time_point::now() - start;
+      sending = false;
+      give_up = fc::time_point::now() + fc::seconds( 10 * BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC );
+      std::cerr << "sent " << total << " transactions, waiting for the accepted ones to be in a block\n";
+      block_watcher.wait();
+
+      std::cout << "accepted " << accepted << " and rejected " << rejected << " transactions in "
+                << sending_time.count() / 1000 << " ms, "
+                << std::fixed << std::setprecision( 1 ) << double( accepted ) * 1000000 / std::max<int64_t>( sending_time.count(), 1 )
+                << " accepted per second\n";
+      accept_latency.print( std::cout, "pending pool latency" );
+      inclusion_latency.print( std::cout, "inclusion latency" );
+   }
+   catch( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,224 @@
+/**
+ *  Replays the blocks of an existing chain through a fresh chain_database and reports where the time went.
+ *
+ *  The blocks are read from the raw block store of --source, either raw_chain/block_log or the legacy
+ *  raw_chain/block_id_to_block_data_db, in the order of raw_chain/block_num_to_id_db; the source client
+ *  must not be running. Every block up to --last is pushed, since a block can only be applied on top of
+ *  the state its predecessors left, but only the blocks from --first on are timed. For each of those a CSV
+ *  row gives the time spent recovering signatures, executing markets, applying transactions, saving the
+ *  undo state, applying the changes and in total; the slowest blocks are summarized at the end.
+ */
+#include <bts/blockchain/block_log.hpp>
+#include <bts/blockchain/chain_database.hpp>
+#include <bts/db/level_map.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/json.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+using namespace bts::blockchain;
+
+/** reads blocks by number from the raw block store of a data directory */
+class raw_block_source
+{
+   public:
+      explicit raw_block_source( const fc::path& data_dir )
+      {
+         const fc::path raw_chain = data_dir / "raw_chain";
+         FC_ASSERT( fc::exists( raw_chain / "block_num_to_id_db" ), "${dir} holds no chain", ("dir",data_dir) );
+         _num_to_id.open( raw_chain / "block_num_to_id_db", false );
+
+         if( fc::exists( raw_chain / "block_log" ) )
+         {
+            _log.open( raw_chain / "block_log" );
+            _id_to_offset.open( raw_chain / "block_id_to_block_offset_db", false );
+         }
+         else
+         {
+            FC_ASSERT( fc::exists( raw_chain / "block_id_to_block_data_db" ), "${dir} holds no blocks", ("dir",data_dir) );
+            _id_to_block.open( raw_chain / "block_id_to_block_data_db", false );
+         }
+      }
+
+      uint32_t last_block_num()
+      {
+         uint32_t block_num = 0;
+         block_id_type block_id;
+         _num_to_id.last( block_num, block_id );
+         return block_num;
+      }
+
+      full_block fetch( uint32_t block_num )
+      {
+         const block_id_type block_id = _num_to_id.fetch( block_num );
+         if( _log.is_open() )
+            return _log.read( _id_to_offset.fetch( block_id ) );
+         return _id_to_block.fetch( block_id );
+      }
+
+   private:
+      bts::db::level_map<uint32_t, block_id_type>   _num_to_id;
+      block_log                                     _log;
+      bts::db::level_map<block_id_type, uint64_t>   _id_to_offset;
+      bts::db::level_map<block_id_type, full_block> _id_to_block;
+};
+
+static void print_csv_header( std::ostream& out )
+{
+   out << "block_num,block_id,transactions,recover_signers_us,execute_markets_us,apply_transactions_us,"
+          "save_undo_state_us,apply_changes_us,total_us\n";
+}
+
+static void print_csv_row( std::ostream& out, const block_timing& timing )
+{
+   out << timing.block_num << ','
+       << std::string( timing.block_id ) << ','
+       << timing.transaction_count << ','
+       << timing.recover_signers.count() << ','
+       << timing.execute_markets.count() << ','
+       << timing.apply_transactions.count() << ','
+       << timing.save_undo_state.count() << ','
+       << timing.apply_changes.count() << ','
+       << timing.total.count() << '\n';
+}
+
+static void print_summary( std::ostream& out, std::vector<block_timing> timings, uint32_t top )
+{
+   fc::microseconds recover_signers, execute_markets, apply_transactions, save_undo_state, apply_changes, total;
+   for( const auto& timing : timings )
+   {
+      recover_signers    += timing.recover_signers;
+      execute_markets    += timing.execute_markets;
+      apply_transactions += timing.apply_transactions;
+      save_undo_state    += timing.save_undo_state;
+      apply_changes      += timing.apply_changes;
+      total              += timing.total;
+   }
+
+   const auto ms = []( const fc::microseconds& us ) { return double( us.count() ) / 1000; };
+   out << std::fixed << std::setprecision( 3 );
+   out << "Replayed " << timings.size() << " blocks in " << ms( total ) << " ms\n";
+   out << "  recover_signers     " << std::setw( 14 ) << ms( recover_signers ) << " ms\n";
+   out << "  execute_markets     " << std::setw( 14 ) << ms( execute_markets ) << " ms\n";
+   out << "  apply_transactions  " << std::setw( 14 ) << ms( apply_transactions ) << " ms\n";
+   out << "  save_undo_state     " << std::setw( 14 ) << ms( save_undo_state ) << " ms\n";
+   out << "  apply_changes       " << std::setw( 14 ) << ms( apply_changes ) << " ms\n";
+
+   top = std::min<uint32_t>( top, timings.size() );
+   std::partial_sort( timings.begin(), timings.begin() + top, timings.end(),
+                      []( const block_timing& a, const block_timing& b ) { return a.total > b.total; } );
+
+   out << "\nSlowest blocks:\n";
+   out << std::setw( 10 ) << "BLOCK" << std::setw( 8 ) << "TRXS"
+       << std::setw( 12 ) << "SIGNERS" << std::setw( 12 ) << "MARKETS" << std::setw( 12 ) << "TRXS_APPLY"
+       << std::setw( 12 ) << "UNDO" << std::setw( 12 ) << "CHANGES" << std::setw( 12 ) << "TOTAL_MS" << "\n";
+   for( uint32_t i = 0; i < top; ++i )
+   {
+      const auto& timing = timings[ i ];
+      out << std::setw( 10 ) << timing.block_num << std::setw( 8 ) << timing.transaction_count
+          << std::setw( 12 ) << ms( timing.recover_signers ) << std::setw( 12 ) << ms( timing.execute_markets )
+          << std::setw( 12 ) << ms( timing.apply_transactions ) << std::setw( 12 ) << ms( timing.save_undo_state )
+          << std::setw( 12 ) << ms( timing.apply_changes ) << std::setw( 12 ) << ms( timing.total ) << "\n";
+   }
+}
+
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()("help",                                                                              "display this help message")
+                              ("source",   boost::program_options::value<std::string>(),                           "data directory of the chain to replay")
+                              ("genesis",  boost::program_options::value<std::string>(),                           "genesis file of that chain, if it is not the builtin one")
+                              ("first",    boost::program_options::value<uint32_t>()->default_value( 1 ),          "first block to time")
+                              ("last",     boost::program_options::value<uint32_t>()->default_value( 0 ),          "last block to replay, 0 for the head of the source")
+                              ("csv",      boost::program_options::value<std::string>(),                           "write the per block CSV here instead of stdout")
+                              ("slowest",  boost::program_options::value<uint32_t>()->default_value( 20 ),         "number of slowest blocks to summarize")
+                              ("data-dir", boost::program_options::value<std::string>(),                           "directory for the replayed chain, a temporary one if not given");
+   boost::program_options::variables_map options;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), options );
+      boost::program_options::notify( options );
+   }
+   catch( const boost::program_options::error& e )
+   {
+      std::cerr << e.what() << "\n" << option_config << "\n";
+      return 1;
+   }
+   if( options.count( "help" ) || !options.count( "source" ) )
+   {
+      std::cout << option_config << "\n";
+      return options.count( "help" ) ? 0 : 1;
+   }
+
+   try
+   {
+      raw_block_source source( fc::path( options["source"].as<std::string>() ) );
+      const uint32_t first = std::max<uint32_t>( 1, options["first"].as<uint32_t>() );
+      uint32_t last = options["last"].as<uint32_t>();
+      if( last == 0 )
+         last = source.last_block_num();
+      FC_ASSERT( first <= last, "nothing to replay between blocks ${first} and ${last}", ("first",first)("last",last) );
+
+      std::unique_ptr<fc::temp_directory> temp_dir;
+      fc::path data_dir;
+      if( options.count( "data-dir" ) )
+      {
+         data_dir = fc::path( options["data-dir"].as<std::string>() );
+         FC_ASSERT( !fc::exists( data_dir / "raw_chain" ), "${dir} already holds a chain", ("dir",data_dir) );
+      }
+      else
+      {
+         temp_dir.reset( new fc::temp_directory() );
+         data_dir = temp_dir->path();
+      }
+
+      fc::optional<fc::path> genesis;
+      if( options.count( "genesis" ) )
+         genesis = fc::path( options["genesis"].as<std::string>() );
+
+      const auto db = std::make_shared<chain_database>();
+      db->open( data_dir, genesis );
+
+      std::ofstream csv_file;
+      if( options.count( "csv" ) )
+         csv_file.open( options["csv"].as<std::string>().c_str() );
+      std::ostream& csv = csv_file.is_open() ? csv_file : std::cout;
+      print_csv_header( csv );
+
+      std::vector<block_timing> timings;
+      timings.reserve( last - first + 1 );
+      const auto record = [&]( const block_timing& timing )
+      {
+         timings.push_back( timing );
+         print_csv_row( csv, timing );
+      };
+
+      for( uint32_t block_num = db->get_head_block_num() + 1; block_num <= last; ++block_num )
+      {
+         if( block_num == first )
+            db->set_block_timing_callback( record );
+         db->push_block( source.fetch( block_num ) );
+         if( block_num % 10000 == 0 )
+            std::cerr << "replayed block " << block_num << " of " << last << "\n";
+      }
+      db->set_block_timing_callback( std::function<void( const block_timing& )>() );
+      db->close();
+
+      print_summary( std::cerr, std::move( timings ), options["slowest"].as<uint32_t>() );
+   }
+   catch( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -5,12 +5,15 @@
 #include <fc/io/raw_variant.hpp>
 #include <fc/network/ip.hpp>
 #include <fc/network/resolve.hpp>
+#include <fc/thread/thread.hpp>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <queue>
 
 #include <bts/blockchain/chain_database.hpp>
 #include <bts/net/peer_connection.hpp>
+#include <bts/net/peer_database.hpp>
 #include <bts/client/client.hpp>
 
 #include <boost/program_options/options_description.hpp>
@@ -18,6 +21,23 @@
 #define PARAM_GENESIS   "genesis"
 #define PARAM_PORT      "port"
 #define PARAM_SEEDER    "seeder"
+#define PARAM_CONCURRENCY "concurrency"
+#define PARAM_TIMEOUT   "timeout"
+#define PARAM_OUTPUT    "output"
+
+/** what was learned about one reachable peer; written out as a line of JSON as soon as it has been probed */
+struct crawled_peer
+{
+  fc::ip::endpoint                               endpoint;
+  bts::net::node_id_t                            node_id;
+  fc::microseconds                               connect_time;
+  fc::microseconds                               round_trip_delay;  /// from sending our hello to receiving theirs
+  fc::optional<uint32_t>                         head_block_number;
+  fc::optional<bts::blockchain::block_id_type>   head_block_id;
+  fc::optional<fc::time_point_sec>               head_block_time;
+  uint32_t                                       peers_reported = 0;
+};
+FC_REFLECT( crawled_peer, (endpoint)(node_id)(connect_time)(round_trip_delay)(head_block_number)(head_block_id)(head_block_time)(peers_reported) )
 
 class peer_probe : public bts::net::peer_connection_delegate
 {
@@ -30,6 +50,10 @@ public:
   bool _connection_was_rejected;
   bool _done;
   fc::promise<void>::ptr _probe_complete_promise;
+  fc::microseconds _connect_time;
+  fc::time_point _hello_sent_time;
+  fc::microseconds _round_trip_delay;
+  fc::variant_object _user_data;
 
 public:
   peer_probe() :
@@ -43,12 +67,15 @@ public:
 
   void start(const fc::ip::endpoint& endpoint_to_probe,
              const fc::ecc::private_key& my_node_id,
-             const bts::blockchain::digest_type& chain_id)
+             const bts::blockchain::digest_type& chain_id,
+             const fc::microseconds& timeout = fc::seconds(10))
   {
+    const fc::time_point connect_start = fc::time_point::now();
     fc::future<void> connect_task = fc::async([=](){ _connection->connect_to(endpoint_to_probe); }, "connect_task");
     try
     {
-      connect_task.wait(fc::seconds(10));
+      connect_task.wait(timeout);
+      _connect_time = fc::time_point::now() - connect_start;
     }
     catch (const fc::timeout_exception&)
     {
@@ -70,6 +97,7 @@ public:
                                   chain_id,
                                   fc::variant_object());
 
+    _hello_sent_time = fc::time_point::now();
     _connection->send_message(hello);
   }
 
@@ -111,7 +139,9 @@ public:
   void on_hello_message(bts::net::peer_connection* originating_peer,
                         const bts::net::hello_message& hello_message_received)
   {
+    _round_trip_delay = fc::time_point::now() - _hello_sent_time;
     _node_id = hello_message_received.node_public_key;
+    _user_data = hello_message_received.user_data;
     if (hello_message_received.user_data.contains("node_id"))
       originating_peer->node_id = hello_message_received.user_data["node_id"].as<bts::net::node_id_t>();
     originating_peer->send_message(bts::net::connection_rejected_message());
@@ -171,9 +201,42 @@ public:
     _probe_complete_promise->set_value();
   }
 
-  void wait()
+  void wait(const fc::microseconds& timeout = fc::microseconds::maximum())
+  {
+    try
+    {
+      _probe_complete_promise->wait(timeout);
+    }
+    catch (const fc::timeout_exception&)
+    {
+      ilog("timeout probing node ${endpoint}", ("endpoint", _connection->get_remote_endpoint()));
+      _connection->destroy_connection();
+      throw;
+    }
+  }
+
+  crawled_peer result(const fc::ip::endpoint& endpoint) const
   {
-    _probe_complete_promise->wait();
+    crawled_peer peer;
+    peer.endpoint = endpoint;
+    peer.node_id = _node_id;
+    peer.connect_time = _connect_time;
+    peer.round_trip_delay = _round_trip_delay;
+    peer.peers_reported = _peers.size();
+    try
+    {
+      if (_user_data.contains("last_known_block_number"))
+        peer.head_block_number = _user_data["last_known_block_number"].as<uint32_t>();
+      if (_user_data.contains("last_known_block_hash"))
+        peer.head_block_id = _user_data["last_known_block_hash"].as<bts::blockchain::block_id_type>();
+      if (_user_data.contains("last_known_block_time"))
+        peer.head_block_time = _user_data["last_known_block_time"].as<fc::time_point_sec>();
+    }
+    catch (const fc::exception&)
+    {
+      // older nodes may not send these, or send them in another form
+    }
+    return peer;
   }
 };
 
@@ -187,7 +250,13 @@ boost::program_options::options_description desc("Allowed options");
     (PARAM_PORT, boost::program_options::value<uint16_t>(),
             "Default network port number")
     (PARAM_SEEDER, boost::program_options::value<std::vector<std::string>>(),
-            "Seed node address or hostname");
+            "Seed node address or hostname")
+    (PARAM_CONCURRENCY, boost::program_options::value<uint32_t>()->default_value(32),
+            "Most nodes to probe at once")
+    (PARAM_TIMEOUT, boost::program_options::value<uint32_t>()->default_value(10),
+            "Seconds to give each node to connect, and again to answer")
+    (PARAM_OUTPUT, boost::program_options::value<std::string>(),
+            "File to append a line of JSON to for every node probed (default: peers.json in the data directory)");
 
     boost::program_options::positional_options_description p;
     p.add(PARAM_SEEDER, -1);
@@ -231,7 +300,6 @@ int main(int argc, char** argv)
   validate_options(opts);
 
   std::queue<fc::ip::endpoint> nodes_to_visit;
-  std::set<fc::ip::endpoint> nodes_to_visit_set;
   std::set<fc::ip::endpoint> nodes_already_visited;
 
   fc::path data_dir = fc::temp_directory_path() / "map_bts_network";
@@ -256,49 +324,105 @@ int main(int argc, char** argv)
   std::map<bts::net::node_id_t, std::vector<bts::net::address_info> > connections_by_node_id;
   //std::map<bts::net::node_id_t, fc::ip::endpoint> all_known_nodes;
 
-  while (!nodes_to_visit.empty())
-  {
-    bts::net::address_info this_node_info;
-    this_node_info.direction = bts::net::peer_connection_direction::outbound;
-    this_node_info.firewalled = bts::net::firewalled_state::not_firewalled;
+  const uint32_t concurrency = std::max<uint32_t>(1, opts[PARAM_CONCURRENCY].as<uint32_t>());
+  const fc::microseconds timeout = fc::seconds(opts[PARAM_TIMEOUT].as<uint32_t>());
+  const fc::path output_path = opts.count(PARAM_OUTPUT) ? fc::path(opts[PARAM_OUTPUT].as<std::string>())
+                                                         : data_dir / "peers.json";
+  std::ofstream output_stream(output_path.string().c_str(), std::ios::out | std::ios::app);
+  std::vector<bts::net::potential_peer_record> measured_peers;
 
-    this_node_info.remote_endpoint = nodes_to_visit.front();;
-    nodes_to_visit.pop();
-    nodes_to_visit_set.erase(this_node_info.remote_endpoint);
-    nodes_already_visited.insert(this_node_info.remote_endpoint);
+  // every endpoint is probed at most once: it is marked when queued, not when visited
+  std::set<fc::ip::endpoint> nodes_seen;
+  {
+    std::queue<fc::ip::endpoint> seeds;
+    std::swap(seeds, nodes_to_visit);
+    while (!seeds.empty())
+    {
+      if (nodes_seen.insert(seeds.front()).second)
+        nodes_to_visit.push(seeds.front());
+      seeds.pop();
+    }
+  }
 
-    peer_probe probe;
-    try
+  uint32_t probes_in_flight = 0;
+  const auto crawl = [&]()
+  {
+    while (!nodes_to_visit.empty() || probes_in_flight > 0)
     {
-      probe.start(this_node_info.remote_endpoint,
-                  my_node_id,
-                  chain_db->chain_id());
-      probe.wait();
+      if (nodes_to_visit.empty())
+      {
+        // another crawler's probe may still turn up more nodes
+        fc::usleep(fc::milliseconds(100));
+        continue;
+      }
 
-      this_node_info.node_id = probe._node_id;
+      bts::net::address_info this_node_info;
+      this_node_info.direction = bts::net::peer_connection_direction::outbound;
+      this_node_info.firewalled = bts::net::firewalled_state::not_firewalled;
 
-      connections_by_node_id[this_node_info.node_id] = probe._peers;
-      if (address_info_by_node_id.find(probe._node_id) == address_info_by_node_id.end())
-        address_info_by_node_id[probe._node_id] = this_node_info;
+      this_node_info.remote_endpoint = nodes_to_visit.front();
+      nodes_to_visit.pop();
+      nodes_already_visited.insert(this_node_info.remote_endpoint);
 
-      for (const bts::net::address_info& info : probe._peers)
+      ++probes_in_flight;
+      peer_probe probe;
+      try
       {
-        if (nodes_already_visited.find(info.remote_endpoint) == nodes_already_visited.end() &&
-            info.firewalled == bts::net::firewalled_state::not_firewalled &&
-            nodes_to_visit_set.find(info.remote_endpoint) == nodes_to_visit_set.end())
+        probe.start(this_node_info.remote_endpoint,
+                    my_node_id,
+                    chain_db->chain_id(),
+                    timeout);
+        probe.wait(timeout);
+
+        this_node_info.node_id = probe._node_id;
+
+        connections_by_node_id[this_node_info.node_id] = probe._peers;
+        if (address_info_by_node_id.find(probe._node_id) == address_info_by_node_id.end())
+          address_info_by_node_id[probe._node_id] = this_node_info;
+
+        for (const bts::net::address_info& info : probe._peers)
         {
-          nodes_to_visit.push(info.remote_endpoint);
-          nodes_to_visit_set.insert(info.remote_endpoint);
+          if (info.firewalled == bts::net::firewalled_state::not_firewalled &&
+              nodes_seen.insert(info.remote_endpoint).second)
+            nodes_to_visit.push(info.remote_endpoint);
+          if (address_info_by_node_id.find(info.node_id) == address_info_by_node_id.end())
+            address_info_by_node_id[info.node_id] = info;
         }
-        if (address_info_by_node_id.find(info.node_id) == address_info_by_node_id.end())
-          address_info_by_node_id[info.node_id] = info;
+
+        const crawled_peer peer = probe.result(this_node_info.remote_endpoint);
+        output_stream << fc::json::to_string(peer) << "\n" << std::flush;
+
+        bts::net::potential_peer_record record(this_node_info.remote_endpoint, fc::time_point::now(),
+                                               bts::net::last_connection_succeeded);
+        record.last_connection_attempt_time = fc::time_point::now();
+        record.number_of_successful_connection_attempts = 1;
+        record.round_trip_delay = peer.round_trip_delay;
+        measured_peers.push_back(record);
       }
+      catch (const fc::exception&)
+      {
+      }
+      --probes_in_flight;
+      std::cout << "Traversed " << nodes_already_visited.size() << " of " << nodes_seen.size() << " known nodes, "
+                << probes_in_flight << " probes in flight\n";
     }
-    catch (const fc::exception&)
-    {
-    }
-    std::cout << "Traversed " << nodes_already_visited.size() << " of " << (nodes_already_visited.size() + nodes_to_visit.size()) << " known nodes\n";
-  }
+  };
+
+  std::vector<fc::future<void>> crawlers;
+  crawlers.reserve(concurrency);
+  for (uint32_t i = 0; i < concurrency; ++i)
+    crawlers.push_back(fc::async(crawl, "map_pts_network crawler"));
+  for (auto& crawler : crawlers)
+    crawler.wait();
+
+  // peers sorted the way the node's latency-aware peer selection would try them
+  std::sort(measured_peers.begin(), measured_peers.end(),
+            [](const bts::net::potential_peer_record& a, const bts::net::potential_peer_record& b) {
+              return a.selection_cost() < b.selection_cost();
+            });
+  fc::json::save_to_file(measured_peers, data_dir / "potential_peers.json");
+  std::cout << "Wrote " << measured_peers.size() << " measured peers to " << (data_dir / "potential_peers.json").generic_string()
+            << " and every probe to " << output_path.generic_string() << "\n";
 
   bts::net::node_id_t seed_node_id;
   std::set<bts::net::node_id_t> non_firewalled_nodes_set;
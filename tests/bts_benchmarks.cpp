@@ -0,0 +1,444 @@
+/**
+ *  Repeatable micro and macro benchmarks of the chain hot paths, for tracking performance between releases.
+ *
+ *  The micro benchmarks time level_map and cached_level_map stores, reads and iteration, mail message
+ *  packing, and parsing a large JSON-RPC request with fc's parser and with bts::utilities::parse_json.
+ *  The macro benchmarks open a fresh chain from a genesis file with simulated time, fund a set of keys,
+ *  and time evaluating transactions of each kind, pushing blocks full of transfers, executing a
+ *  synthetic market and rescanning those blocks with a wallet. Keys and books are derived from fixed seeds
+ *  and the iteration counts are fixed, so two runs do the same work; --scale multiplies the counts and
+ *  --filter runs only the benchmarks whose names contain the given text.
+ *
+ *  The results go to stdout, or --output, as one JSON document holding the git revision and, for every
+ *  benchmark, the iterations, seconds and operations per second. Progress goes to stderr.
+ */
+#include <bts/blockchain/chain_database.hpp>
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/time.hpp>
+#include <bts/db/cached_level_map.hpp>
+#include <bts/db/level_map.hpp>
+#include <bts/mail/message.hpp>
+#include <bts/utilities/git_revision.hpp>
+#include <bts/utilities/json_parser.hpp>
+#include <bts/utilities/key_conversion.hpp>
+#include <bts/wallet/wallet.hpp>
+
+#include <fc/crypto/elliptic.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/time.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+
+using namespace bts::blockchain;
+
+struct benchmark_result
+{
+   std::string name;
+   uint64_t    iterations = 0;
+   double      seconds = 0;
+   double      per_second = 0;
+};
+
+struct benchmark_report
+{
+   std::string                   revision;
+   std::vector<benchmark_result> results;
+};
+
+FC_REFLECT( benchmark_result, (name)(iterations)(seconds)(per_second) )
+FC_REFLECT( benchmark_report, (revision)(results) )
+
+class benchmarks
+{
+   public:
+      benchmarks( const std::string& filter, double scale )
+      : _filter( filter ), _scale( scale )
+      {
+         report.revision = bts::utilities::git_revision_sha;
+      }
+
+      bool enabled( const std::string& name )const
+      {
+         return _filter.empty() || name.find( _filter ) != std::string::npos;
+      }
+
+      /** a base iteration count, scaled */
+      uint64_t iterations( uint64_t base )const
+      {
+         return std::max<uint64_t>( 1, uint64_t( base * _scale ) );
+      }
+
+      /** times body( 0 ) ... body( count - 1 ) */
+      template<typename Body>
+      void run( const std::string& name, uint64_t count, Body body )
+      {
+         if( !enabled( name ) ) return;
+         const auto start = fc::time_point::now();
+         for( uint64_t i = 0; i < count; ++i )
+            body( i );
+         record( name, count, fc::time_point::now() - start );
+      }
+
+      void record( const std::string& name, uint64_t count, const fc::microseconds& elapsed )
+      {
+         benchmark_result result;
+         result.name = name;
+         result.iterations = count;
+         result.seconds = double( elapsed.count() ) / 1000000;
+         result.per_second = result.seconds > 0 ? count / result.seconds : 0;
+         report.results.push_back( result );
+         std::cerr << std::left << std::setw( 40 ) << name << result.per_second << " per second\n";
+      }
+
+      benchmark_report report;
+
+   private:
+      std::string _filter;
+      double      _scale;
+};
+
+static fc::ecc::private_key benchmark_key( const std::string& purpose, uint32_t n )
+{
+   return fc::ecc::private_key::regenerate( fc::sha256::hash( "bts_benchmarks " + purpose + std::to_string( n ) ) );
+}
+
+static void benchmark_level_map( benchmarks& b )
+{
+   const uint64_t count = b.iterations( 100000 );
+   const std::string value( 100, 'x' );
+
+   fc::temp_directory dir;
+   bts::db::level_map<uint32_t, std::string> db;
+   db.open( dir.path() / "level_map" );
+
+   b.run( "level_map/store", count, [&]( uint64_t i ) { db.store( uint32_t( i ), value ); } );
+   b.run( "level_map/fetch", count, [&]( uint64_t i ) { db.fetch( uint32_t( ( i * 7919 ) % count ) ); } );
+
+   if( b.enabled( "level_map/iterate" ) )
+   {
+      uint64_t visited = 0;
+      const auto start = fc::time_point::now();
+      for( auto itr = db.begin(); itr.valid(); ++itr )
+      {
+         itr.value();
+         ++visited;
+      }
+      b.record( "level_map/iterate", visited, fc::time_point::now() - start );
+   }
+   db.close();
+}
+
+static void benchmark_cached_level_map( benchmarks& b )
+{
+   const uint64_t count = b.iterations( 100000 );
+   const std::string value( 100, 'x' );
+
+   fc::temp_directory dir;
+   bts::db::cached_level_map<uint32_t, std::string> db;
+   db.open( dir.path() / "cached_level_map", true, 0, false );
+
+   b.run( "cached_level_map/store", count, [&]( uint64_t i ) { db.store( uint32_t( i ), value ); } );
+   if( b.enabled( "cached_level_map/flush" ) )
+   {
+      const auto start = fc::time_point::now();
+      db.flush();
+      b.record( "cached_level_map/flush", count, fc::time_point::now() - start );
+   }
+   b.run( "cached_level_map/fetch", count, [&]( uint64_t i ) { db.fetch_optional( uint32_t( ( i * 7919 ) % count ) ); } );
+   db.close();
+}
+
+static void benchmark_message( benchmarks& b )
+{
+   const uint64_t count = b.iterations( 20000 );
+
+   bts::mail::signed_email_message email;
+   email.subject = "bts_benchmarks";
+   email.body = std::string( 4096, 'x' );
+   email.sign( benchmark_key( "mail", 0 ) );
+   const bts::mail::message msg( email );
+   const std::vector<char> packed = fc::raw::pack( msg );
+
+   b.run( "message/pack", count, [&]( uint64_t ) { fc::raw::pack( msg ); } );
+   b.run( "message/unpack", count, [&]( uint64_t ) { fc::raw::unpack<bts::mail::message>( packed ); } );
+   b.run( "message/open_email", count, [&]( uint64_t ) { msg.as<bts::mail::signed_email_message>(); } );
+}
+
+/* a JSON-RPC batch of private key imports and transaction broadcasts, as the RPC server receives it */
+static std::string benchmark_rpc_request( uint32_t calls )
+{
+   fc::variants batch;
+   for( uint32_t i = 0; i < calls; ++i )
+   {
+      fc::mutable_variant_object call;
+      call( "jsonrpc", "2.0" )( "id", i );
+      if( i % 2 == 0 )
+      {
+         call( "method", "wallet_import_private_key" );
+         call( "params", fc::variants{ bts::utilities::key_to_wif( benchmark_key( "json", i ) ),
+                                       "account" + std::to_string( i ), false } );
+      }
+      else
+      {
+         signed_transaction trx;
+         trx.expiration = fc::time_point_sec( 1400000000 + i );
+         trx.withdraw( address( benchmark_key( "json", i ).get_public_key() ), 100000 + i );
+         trx.deposit( address( benchmark_key( "json", i + 1 ).get_public_key() ), asset( 90000 + i ), 0 );
+         trx.sign( benchmark_key( "json", i ), digest_type() );
+         call( "method", "blockchain_broadcast_transaction" );
+         call( "params", fc::variants{ fc::variant( trx ) } );
+      }
+      batch.push_back( fc::variant( call ) );
+   }
+   return fc::json::to_string( batch );
+}
+
+static void benchmark_json( benchmarks& b )
+{
+   const uint64_t count = b.iterations( 200 );
+   const std::string request = benchmark_rpc_request( 500 );
+
+   b.run( "json/fc_parse", count, [&]( uint64_t ) { fc::json::from_string( request ); } );
+   b.run( "json/parse", count, [&]( uint64_t ) { bts::utilities::parse_json( request.data(), request.size() ); } );
+}
+
+/* the delegate signing keys of the genesis file, as listed one per line next to it */
+static std::map<public_key_type, fc::ecc::private_key> load_delegate_keys( const fc::path& keypairs )
+{
+   std::map<public_key_type, fc::ecc::private_key> keys;
+   std::ifstream in( keypairs.string().c_str() );
+   std::string public_key, wif;
+   while( in >> public_key >> wif )
+   {
+      const auto key = bts::utilities::wif_to_key( wif );
+      FC_ASSERT( key.valid(), "invalid key in ${file}", ("file",keypairs) );
+      keys[ public_key_type( key->get_public_key() ) ] = *key;
+   }
+   return keys;
+}
+
+struct funded_key
+{
+   fc::ecc::private_key key;
+   balance_id_type      balance_id;
+};
+
+static signed_transaction make_transfer( const chain_database_ptr& db, const funded_key& from, const address& to,
+                                         share_type amount )
+{
+   signed_transaction trx;
+   trx.expiration = db->now() + BTS_BLOCKCHAIN_MAX_TRANSACTION_EXPIRATION_SEC / 2;
+   trx.withdraw( from.balance_id, amount + BTS_BLOCKCHAIN_PRECISION );
+   trx.deposit( to, asset( amount, 0 ), 0 );
+   trx.sign( from.key, db->chain_id() );
+   return trx;
+}
+
+static void benchmark_chain( benchmarks& b, const fc::path& genesis, const fc::path& keypairs )
+{
+   const uint32_t blocks = b.iterations( 100 );
+   const uint32_t transfers_per_block = 50;
+   const uint32_t evaluations = b.iterations( 2000 );
+
+   const auto delegate_keys = load_delegate_keys( keypairs );
+
+   fc::temp_directory data_dir;
+   const auto db = std::make_shared<chain_database>();
+   db->open( data_dir.path() / "chain", genesis );
+
+   const oasset_record base_asset = db->get_asset_record( asset_id_type( 0 ) );
+   FC_ASSERT( base_asset.valid() );
+   bts::blockchain::start_simulated_time( fc::time_point( base_asset->registration_date ) + fc::seconds( BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC ) );
+
+   /* one balance per transfer, so every transaction in the run is distinct and valid */
+   std::vector<funded_key> funded;
+   const uint32_t funded_count = std::max<uint32_t>( evaluations, blocks * transfers_per_block );
+   funded.reserve( funded_count );
+   {
+      std::unordered_map<balance_id_type, balance_record> balances;
+      balances.reserve( funded_count );
+      for( uint32_t n = 0; n < funded_count; ++n )
+      {
+         const auto key = benchmark_key( "balance", n );
+         balance_record balance( address( key.get_public_key() ), asset( 1000 * BTS_BLOCKCHAIN_PRECISION, 0 ), 0 );
+         balance.last_update = db->now();
+         funded.push_back( funded_key{ key, balance.id() } );
+         balances.emplace( balance.id(), balance );
+      }
+      db->store_balance_records( balances );
+   }
+   const address recipient( benchmark_key( "recipient", 0 ).get_public_key() );
+
+   if( b.enabled( "evaluate/transfer" ) )
+   {
+      std::vector<signed_transaction> transactions;
+      transactions.reserve( evaluations );
+      for( uint32_t n = 0; n < evaluations; ++n )
+         transactions.push_back( make_transfer( db, funded[ n ], recipient, BTS_BLOCKCHAIN_PRECISION ) );
+      b.run( "evaluate/transfer", evaluations, [&]( uint64_t i ) { db->evaluate_transaction( transactions[ i ] ); } );
+   }
+
+   if( b.enabled( "evaluate/register_account" ) )
+   {
+      std::vector<signed_transaction> transactions;
+      transactions.reserve( evaluations );
+      for( uint32_t n = 0; n < evaluations; ++n )
+      {
+         const public_key_type owner = funded[ n ].key.get_public_key();
+         signed_transaction trx;
+         trx.expiration = db->now() + BTS_BLOCKCHAIN_MAX_TRANSACTION_EXPIRATION_SEC / 2;
+         trx.withdraw( funded[ n ].balance_id, BTS_BLOCKCHAIN_PRECISION );
+         trx.register_account( "bench-account-" + std::to_string( n ), fc::variant(), owner, owner );
+         trx.sign( funded[ n ].key, db->chain_id() );
+         transactions.push_back( trx );
+      }
+      b.run( "evaluate/register_account", evaluations, [&]( uint64_t i ) { db->evaluate_transaction( transactions[ i ] ); } );
+   }
+
+   /* blocks of transfers signed by the scheduled delegate; only push_block is timed */
+   const uint32_t first_block = db->get_head_block_num() + 1;
+   if( b.enabled( "push_block" ) || b.enabled( "wallet/scan_block" ) )
+   {
+      fc::microseconds elapsed;
+      uint32_t next_transfer = 0;
+      for( uint32_t n = 0; n < blocks; ++n )
+      {
+         for( uint32_t t = 0; t < transfers_per_block; ++t )
+            db->store_pending_transaction( make_transfer( db, funded[ next_transfer++ ], recipient, BTS_BLOCKCHAIN_PRECISION ) );
+
+         bts::blockchain::advance_time( BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC );
+         const auto timestamp = bts::blockchain::get_slot_start_time( bts::blockchain::now() );
+         const account_record signee = db->get_slot_signee( timestamp, db->get_active_delegates() );
+         const auto key = delegate_keys.find( signee.active_key() );
+         FC_ASSERT( key != delegate_keys.end(), "no key for delegate ${d} in ${file}", ("d",signee.name)("file",keypairs) );
+
+         full_block block = db->generate_block( timestamp );
+         block.sign( key->second );
+
+         const auto start = fc::time_point::now();
+         db->push_block( block );
+         elapsed += fc::time_point::now() - start;
+      }
+      b.record( "push_block", blocks, elapsed );
+      b.record( "push_block/transactions", blocks * transfers_per_block, elapsed );
+   }
+
+   if( b.enabled( "wallet/scan_block" ) )
+   {
+      fc::temp_directory wallet_dir;
+      bts::wallet::wallet wallet( db );
+      wallet.set_data_directory( wallet_dir.path() );
+      wallet.create( "benchmark", "benchmark-password" );
+      wallet.unlock( "benchmark-password", 3600 );
+      wallet.import_private_key( benchmark_key( "recipient", 0 ), "recipient", true );
+      for( uint32_t n = 0; n < transfers_per_block; ++n )
+         wallet.import_private_key( funded[ n ].key, "sender" + std::to_string( n ), true );
+
+      const uint32_t last_block = db->get_head_block_num();
+      const auto start = fc::time_point::now();
+      wallet.scan_chain( first_block, last_block );
+      b.record( "wallet/scan_block", last_block - first_block + 1, fc::time_point::now() - start );
+      wallet.close();
+   }
+
+   if( b.enabled( "market_engine/execute" ) )
+   {
+      const uint32_t depth = 1000;
+      const uint32_t markets = b.iterations( 100 );
+      std::mt19937 random( 1 );
+      std::uniform_real_distribution<double> band( -0.05, 0.05 );
+      std::uniform_int_distribution<share_type> amount( 1000, 1000000 );
+
+      asset_record quote;
+      quote.id = db->new_asset_id();
+      quote.symbol = "BENCH";
+      quote.name = "bts_benchmarks";
+      quote.issuer_account_id = asset_record::market_issued_asset;
+      quote.precision = BTS_BLOCKCHAIN_PRECISION;
+      quote.maximum_share_supply = BTS_BLOCKCHAIN_MAX_SHARES;
+      quote.registration_date = db->now();
+      quote.last_update = db->now();
+      db->store_asset_record( quote );
+      const asset_id_type base_id = 0;
+
+      uint32_t next_owner = 0;
+      const auto owner = [&]() { return address( benchmark_key( "order", next_owner++ ).get_public_key() ); };
+      for( uint32_t i = 0; i < depth; ++i )
+      {
+         db->store_bid_record( market_index_key( price( 1 + band( random ), quote.id, base_id ), owner() ), order_record( amount( random ) ) );
+         db->store_ask_record( market_index_key( price( 1 + band( random ), quote.id, base_id ), owner() ), order_record( amount( random ) ) );
+      }
+      for( const auto& delegate_id : db->get_active_delegates() )
+         db->set_feed( feed_record{ feed_index{ quote.id, delegate_id }, fc::variant( price( 1, quote.id, base_id ) ), db->now() } );
+
+      const auto timestamp = db->now() + BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
+      b.run( "market_engine/execute", markets, [&]( uint64_t )
+      {
+         db->set_dirty_markets( { std::make_pair( quote.id, base_id ) } );
+         db->simulate_markets( timestamp );
+      } );
+   }
+
+   db->close();
+}
+
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()("help",                                                                                           "display this help message")
+                              ("genesis",  boost::program_options::value<std::string>()->default_value( "test_genesis.json" ),          "genesis file to open the chain with")
+                              ("keypairs", boost::program_options::value<std::string>()->default_value( "test_genesis.json.keypairs" ), "delegate keys of the genesis file")
+                              ("filter",   boost::program_options::value<std::string>()->default_value( "" ),                          "run only benchmarks whose name contains this")
+                              ("scale",    boost::program_options::value<double>()->default_value( 1 ),                                 "multiply every iteration count by this")
+                              ("output",   boost::program_options::value<std::string>(),                                                "write the JSON results here instead of stdout");
+   boost::program_options::variables_map options;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), options );
+      boost::program_options::notify( options );
+   }
+   catch( const boost::program_options::error& e )
+   {
+      std::cerr << e.what() << "\n" << option_config << "\n";
+      return 1;
+   }
+   if( options.count( "help" ) )
+   {
+      std::cout << option_config << "\n";
+      return 0;
+   }
+
+   try
+   {
+      benchmarks b( options["filter"].as<std::string>(), options["scale"].as<double>() );
+
+      benchmark_level_map( b );
+      benchmark_cached_level_map( b );
+      benchmark_message( b );
+      benchmark_json( b );
+      benchmark_chain( b, fc::path( options["genesis"].as<std::string>() ), fc::path( options["keypairs"].as<std::string>() ) );
+
+      const std::string json = fc::json::to_pretty_string( b.report );
+      if( options.count( "output" ) )
+         std::ofstream( options["output"].as<std::string>().c_str() ) << json << "\n";
+      else
+         std::cout << json << "\n";
+   }
+   catch( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -1,6 +1,14 @@
 #define BOOST_TEST_MODULE BlockchainTests2cc
 #include <boost/test/unit_test.hpp>
 #include "dev_fixture.hpp"
+#include <bts/blockchain/pts_config.hpp>
+#include <bts/blockchain/hashing.hpp>
+#include <bts/blockchain/unique_transaction_set.hpp>
+#include <bts/db/level_map.hpp>
+#include <bts/net/timer_wheel.hpp>
+#include <bts/utilities/json_parser.hpp>
+
+#include <limits>
 
 
 BOOST_FIXTURE_TEST_CASE( basic_commands, chain_fixture )
@@ -725,12 +733,513 @@ BOOST_FIXTURE_TEST_CASE( malicious_trading, chain_fixture )
 } FC_LOG_AND_RETHROW() }
 #endif
 
+/**
+ *  A block's writes to the unified store are batched until the block is applied, and everything read while
+ *  applying it, iterators included, must see them.
+ */
+BOOST_AUTO_TEST_CASE( unified_store_iterators_see_batch )
+{ try {
+   fc::temp_directory dir;
+   bts::db::unified_store store;
+   bts::db::level_map<uint32_t, std::string> table;
+   bts::db::level_map<uint32_t, std::string> other;
+   table.register_with( store, 1 );
+   other.register_with( store, 2 );
+   store.open( dir.path() / "unified_db" );
+   table.open( store, 1 );
+   other.open( store, 2 );
+
+   table.store( 1, "one" );
+   table.store( 3, "three" );
+   other.store( 2, "other" );
+
+   const auto keys = [&]( bool backward ) -> vector<uint32_t>
+   {
+      vector<uint32_t> result;
+      if( backward )
+         for( auto itr = table.last(); itr.valid(); --itr ) result.push_back( itr.key() );
+      else
+         for( auto itr = table.begin(); itr.valid(); ++itr ) result.push_back( itr.key() );
+      return result;
+   };
+
+   store.begin_batch();
+   table.store( 2, "two" );
+   table.remove( 3 );
+   table.store( 4, "four" );
+   table.store( 1, "uno" );
+
+   BOOST_CHECK( keys( false ) == vector<uint32_t>( { 1, 2, 4 } ) );
+   BOOST_CHECK( keys( true ) == vector<uint32_t>( { 4, 2, 1 } ) );
+   BOOST_CHECK_EQUAL( table.begin().value(), "uno" );
+   BOOST_CHECK_EQUAL( table.find( 2 ).value(), "two" );
+   BOOST_CHECK( !table.find( 3 ).valid() );
+   BOOST_CHECK_EQUAL( table.lower_bound( 3 ).key(), 4u );
+
+   // turning around in the middle of the merged records
+   auto itr = table.find( 2 );
+   --itr;
+   BOOST_CHECK_EQUAL( itr.key(), 1u );
+   ++itr;
+   BOOST_CHECK_EQUAL( itr.key(), 2u );
+   ++itr;
+   BOOST_CHECK_EQUAL( itr.key(), 4u );
+
+   // an iterator keeps the writes it started with
+   auto before = table.begin();
+   table.store( 0, "zero" );
+   BOOST_CHECK_EQUAL( before.key(), 1u );
+   BOOST_CHECK_EQUAL( table.begin().key(), 0u );
+
+   // nor do later writes to the keys it already saw reach it
+   table.store( 1, "ein" );
+   table.remove( 2 );
+   BOOST_CHECK_EQUAL( before.value(), "uno" );
+   ++before;
+   BOOST_CHECK_EQUAL( before.key(), 2u );
+   BOOST_CHECK_EQUAL( before.value(), "two" );
+   BOOST_CHECK_EQUAL( table.begin().value(), "zero" );
+   BOOST_CHECK_EQUAL( table.find( 1 ).value(), "ein" );
+   BOOST_CHECK( !table.find( 2 ).valid() );
+   table.store( 2, "two" );
+   table.store( 1, "uno" );
+
+   uint32_t last_key = 0;
+   std::string last_value;
+   BOOST_REQUIRE( table.last( last_key, last_value ) );
+   BOOST_CHECK_EQUAL( last_key, 4u );
+   BOOST_CHECK_EQUAL( last_value, "four" );
+
+   auto others = other.begin();
+   BOOST_REQUIRE( others.valid() );
+   BOOST_CHECK_EQUAL( others.key(), 2u );
+   BOOST_CHECK( !(++others).valid() );
+
+   store.commit_batch();
+   BOOST_CHECK( keys( false ) == vector<uint32_t>( { 0, 1, 2, 4 } ) );
+   BOOST_CHECK( keys( true ) == vector<uint32_t>( { 4, 2, 1, 0 } ) );
+
+   table.close();
+   other.close();
+   store.close();
+} FC_LOG_AND_RETHROW() }
+
+/** keys neither of which sorts before the other, as price's operator== only compares the ratio */
+template<typename Key>
+static bool equivalent_keys( const Key& a, const Key& b )
+{
+   return !( a < b ) && !( b < a );
+}
+
+/** some market index keys with negative and positive asset ids and ratios in both halves of the 64.64 value */
+static vector<market_index_key> sample_market_index_keys()
+{
+   vector<market_index_key> keys;
+   const vector<fc::uint128> ratios{ fc::uint128( 0, 0 ), fc::uint128( 0, 1 ), fc::uint128( 0, 255 ), fc::uint128( 0, 256 ),
+                                     fc::uint128( 1, 0 ), fc::uint128( 1, 1 ), fc::uint128( uint64_t( -1 ), uint64_t( -1 ) ) };
+   for( const int32_t quote : { -1, 0, 1, 256 } )
+      for( const int32_t base : { 0, 22 } )
+         for( const auto& ratio : ratios )
+            for( uint32_t n = 0; n < 3; ++n )
+            {
+               address owner;
+               owner.addr = fc::ripemd160::hash( std::to_string( n ) );
+               keys.emplace_back( price( ratio, base, quote ), owner );
+            }
+   return keys;
+}
+
+/**
+ *  Every key must decode to itself, and the bytewise order of the encodings must be the order the legacy
+ *  comparator gave the fc::raw packed keys, or tables would change order when they are re-encoded.
+ */
+template<typename Key>
+static void check_ordered_key_encoding( const vector<Key>& keys )
+{
+   typedef bts::db::key_format<Key, false> legacy_format;
+   vector<std::string> encoded;
+   vector<std::string> packed;
+   for( const auto& key : keys )
+   {
+      std::string out;
+      bts::db::ordered_key_encode( out, key );
+      bts::db::ordered_key_reader in( out.data(), out.size() );
+      Key decoded;
+      bts::db::ordered_key_decode( in, decoded );
+      BOOST_CHECK( equivalent_keys( decoded, key ) );
+      std::string again;
+      bts::db::ordered_key_encode( again, decoded );
+      BOOST_CHECK( again == out );
+      encoded.push_back( out );
+
+      std::string legacy;
+      legacy_format::pack( legacy, key );
+      packed.push_back( legacy );
+   }
+
+   const auto sign = []( int order ) { return ( order > 0 ) - ( order < 0 ); };
+   for( size_t i = 0; i < keys.size(); ++i )
+      for( size_t j = 0; j < keys.size(); ++j )
+      {
+         const int order = sign( encoded[ i ].compare( encoded[ j ] ) );
+         BOOST_CHECK_EQUAL( order, sign( legacy_format::comparator()->Compare( packed[ i ], packed[ j ] ) ) );
+         BOOST_CHECK_EQUAL( order, keys[ i ] < keys[ j ] ? -1 : ( keys[ j ] < keys[ i ] ? 1 : 0 ) );
+      }
+}
+
+BOOST_AUTO_TEST_CASE( ordered_key_order_matches_legacy_comparator )
+{ try {
+   check_ordered_key_encoding( vector<int64_t>{ std::numeric_limits<int64_t>::min(), -256, -1, 0, 1, 255, 256,
+                                                std::numeric_limits<int64_t>::max() } );
+   check_ordered_key_encoding( vector<uint32_t>{ 0, 1, 255, 256, 65536, std::numeric_limits<uint32_t>::max() } );
+   check_ordered_key_encoding( vector<std::string>{ "", std::string( 1, 0 ), std::string( "a\0", 2 ), std::string( "a\0b", 3 ),
+                                                    "a", "ab", "b", "\xff", std::string( "\xff\0", 2 ) } );
+   check_ordered_key_encoding( sample_market_index_keys() );
+
+   vector<market_history_key> history;
+   for( const int32_t quote : { 0, 3 } )
+      for( const int32_t base : { -1, 0, 7 } )
+         for( const auto granularity : { market_history_key::each_block, market_history_key::each_day } )
+            for( const uint32_t seconds : { 0u, 1u, 86400u } )
+               history.emplace_back( quote, base, granularity, fc::time_point_sec( seconds ) );
+   check_ordered_key_encoding( history );
+} FC_LOG_AND_RETHROW() }
+
+/** a table written by an older version, with fc::raw packed keys, keeps every record and its order once re-encoded */
+BOOST_AUTO_TEST_CASE( level_map_rekeys_legacy_table )
+{ try {
+   typedef bts::db::key_format<market_index_key, false> legacy_format;
+   fc::temp_directory dir;
+   const fc::path table_dir = dir.path() / "table";
+
+   std::map<market_index_key, uint32_t> records;
+   for( const auto& key : sample_market_index_keys() )
+      records.emplace( key, uint32_t( records.size() ) );
+   {
+      leveldb::Options options;
+      options.create_if_missing = true;
+      options.comparator = legacy_format::comparator();
+      fc::create_directories( table_dir );
+      leveldb::DB* raw_db = nullptr;
+      BOOST_REQUIRE( leveldb::DB::Open( options, table_dir.to_native_ansi_path(), &raw_db ).ok() );
+      std::unique_ptr<leveldb::DB> db( raw_db );
+      for( const auto& item : records )
+      {
+         std::string key;
+         legacy_format::pack( key, item.first );
+         const auto value = fc::raw::pack( item.second );
+         BOOST_REQUIRE( db->Put( leveldb::WriteOptions(), key, leveldb::Slice( value.data(), value.size() ) ).ok() );
+      }
+   }
+
+   bts::db::level_map<market_index_key, uint32_t> table;
+   table.open( table_dir );
+   BOOST_CHECK( bts::db::has_ordered_keys( table_dir ) );
+   BOOST_CHECK( !fc::exists( fc::path( table_dir.string() + "-rekey" ) ) );
+
+   auto expected = records.begin();
+   for( auto itr = table.begin(); itr.valid(); ++itr, ++expected )
+   {
+      BOOST_REQUIRE( expected != records.end() );
+      BOOST_CHECK( equivalent_keys( itr.key(), expected->first ) );
+      BOOST_CHECK_EQUAL( itr.value(), expected->second );
+   }
+   BOOST_CHECK( expected == records.end() );
+   for( const auto& item : records )
+      BOOST_CHECK_EQUAL( table.fetch( item.first ), item.second );
+
+   // a range ends where the same range of the sorted map does
+   const auto lower = std::next( records.begin(), 10 );
+   const auto upper = std::next( records.begin(), 30 );
+   size_t in_range = 0;
+   for( auto itr = table.range( lower->first, upper->first ); itr.valid(); ++itr )
+      ++in_range;
+   BOOST_CHECK_EQUAL( in_range, 20u );
+
+   // once re-encoded the table is opened as it is
+   table.close();
+   table.open( table_dir );
+   BOOST_CHECK_EQUAL( table.size(), records.size() );
+   table.close();
+} FC_LOG_AND_RETHROW() }
+
+/** the accelerated sha256 must agree with the reference on known vectors and on every padding case */
+BOOST_AUTO_TEST_CASE( hash_engine_backends_match_reference )
+{ try {
+   hash_engine& engine = hash_engine::instance();
+   const std::string original = engine.backend_name();
+
+   vector<std::string> backends{ "reference" };
+   if( engine.select_backend( "sha_ni" ) )
+      backends.push_back( "sha_ni" );
+   else
+      BOOST_TEST_MESSAGE( "sha_ni is not supported here, only the reference backend is checked" );
+
+   const vector<std::pair<std::string, std::string>> vectors{
+      { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+      { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+      { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" } };
+
+   std::string data( 1031, 0 );
+   for( size_t i = 0; i < data.size(); ++i )
+      data[ i ] = char( i * 89 + 3 );
+
+   for( const auto& name : backends )
+   {
+      BOOST_TEST_MESSAGE( "checking the " << name << " backend" );
+      BOOST_REQUIRE( engine.select_backend( name ) );
+      for( const auto& item : vectors )
+         BOOST_CHECK_EQUAL( engine.sha256( item.first.data(), item.first.size() ).str(), item.second );
+
+      vector<hash_engine::buffer> buffers;
+      for( size_t size = 0; size <= data.size(); size += ( size < 200 ? 1 : 37 ) )
+      {
+         // odd offsets too, so no backend can count on aligned input
+         const size_t offset = size % 3;
+         if( offset + size > data.size() ) continue;
+         buffers.push_back( hash_engine::buffer{ data.data() + offset, size } );
+         BOOST_CHECK( engine.sha256( data.data() + offset, size ) == fc::sha256::hash( data.data() + offset, size ) );
+         BOOST_CHECK( engine.id_hash( data.data() + offset, size )
+                      == fc::ripemd160::hash( fc::sha512::hash( data.data() + offset, size ) ) );
+      }
+
+      vector<fc::sha256> batch( buffers.size() );
+      engine.sha256( buffers.data(), buffers.size(), batch.data() );
+      vector<fc::ripemd160> ids( buffers.size() );
+      engine.id_hash( buffers.data(), buffers.size(), ids.data() );
+      for( size_t i = 0; i < buffers.size(); ++i )
+      {
+         BOOST_CHECK( batch[ i ] == fc::sha256::hash( buffers[ i ].data, buffers[ i ].size ) );
+         BOOST_CHECK( ids[ i ] == engine.id_hash( buffers[ i ].data, buffers[ i ].size ) );
+      }
+   }
+
+   BOOST_CHECK( !engine.select_backend( "no_such_backend" ) );
+   BOOST_REQUIRE( engine.select_backend( original ) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( unique_transaction_set_tracks_expirations )
+{ try {
+   const auto digest = []( uint32_t n ) { return fc::sha256::hash( std::to_string( n ) ); };
+   const fc::time_point_sec start( 1400000000 );
+   unique_transaction_set set;
+
+   BOOST_CHECK( set.insert( start, digest( 0 ) ) );
+   BOOST_CHECK( !set.insert( start, digest( 0 ) ) );
+   BOOST_CHECK( set.contains( start, digest( 0 ) ) );
+   // a digest is only known with the expiration it was stored under
+   BOOST_CHECK( !set.contains( start + 1, digest( 0 ) ) );
+   BOOST_CHECK_EQUAL( set.size(), 1u );
+
+   // enough digests in one bucket to grow its table several times, and a few in each later second
+   for( uint32_t n = 1; n < 1000; ++n )
+      BOOST_CHECK( set.insert( start + ( n % 2 ), digest( n ) ) );
+   for( uint32_t n = 1000; n < 1100; ++n )
+      BOOST_CHECK( set.insert( start + ( n - 1000 ), digest( n ) ) );
+   BOOST_CHECK_EQUAL( set.size(), 1100u );
+   for( uint32_t n = 1; n < 1000; ++n )
+      BOOST_CHECK( set.contains( start + ( n % 2 ), digest( n ) ) );
+
+   set.erase( start, digest( 2 ) );
+   BOOST_CHECK( !set.contains( start, digest( 2 ) ) );
+   BOOST_CHECK( set.contains( start, digest( 4 ) ) );
+   BOOST_CHECK_EQUAL( set.size(), 1099u );
+   BOOST_CHECK( set.insert( start, digest( 2 ) ) );
+
+   // purging drops what expires before now and keeps what expires at or after it, inside a bucket too
+   const fc::time_point_sec now = start + 50 + BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC / 2;
+   set.purge_expired( now );
+   for( uint32_t n = 1000; n < 1100; ++n )
+   {
+      const fc::time_point_sec expiration = start + ( n - 1000 );
+      BOOST_CHECK_EQUAL( set.contains( expiration, digest( n ) ), !( expiration < now ) );
+   }
+   BOOST_CHECK( !set.contains( start, digest( 0 ) ) );
+   BOOST_CHECK_EQUAL( set.size(), size_t( ( start + 99 ).sec_since_epoch() - now.sec_since_epoch() + 1 ) );
+
+   // popped blocks bring back digests that expire before the first bucket left
+   BOOST_CHECK( set.insert( start, digest( 0 ) ) );
+   BOOST_CHECK( set.contains( start, digest( 0 ) ) );
+
+   set.clear();
+   BOOST_CHECK_EQUAL( set.size(), 0u );
+   BOOST_CHECK( !set.contains( start + 99, digest( 1099 ) ) );
+} FC_LOG_AND_RETHROW() }
+
+/** every value comes out of the first expire() at or after its deadline, across the levels of the wheel */
+BOOST_AUTO_TEST_CASE( timer_wheel_expires_values_at_their_deadline )
+{ try {
+   // whole seconds, so each deadline falls on a tick
+   const fc::time_point base( fc::seconds( fc::time_point::now().sec_since_epoch() + 10 ) );
+   const vector<uint32_t> delays{ 0, 1, 5, 63, 64, 65, 200, 4095, 4096, 4097, 10000, 10000 };
+
+   bts::net::timer_wheel<uint32_t> wheel;
+   for( uint32_t i = 0; i < delays.size(); ++i )
+      wheel.schedule( base + fc::seconds( delays[ i ] ), i );
+   BOOST_CHECK_EQUAL( wheel.size(), delays.size() );
+
+   vector<bool> expired( delays.size(), false );
+   for( uint32_t elapsed = 0; elapsed <= 10000; ++elapsed )
+   {
+      for( const uint32_t i : wheel.expire( base + fc::seconds( elapsed ) ) )
+      {
+         BOOST_CHECK_EQUAL( delays[ i ], elapsed );
+         BOOST_CHECK( !expired[ i ] );
+         expired[ i ] = true;
+      }
+   }
+   BOOST_CHECK( std::find( expired.begin(), expired.end(), false ) == expired.end() );
+   BOOST_CHECK_EQUAL( wheel.size(), 0u );
+
+   // a late expire() returns everything due, earliest first
+   for( uint32_t i = delays.size(); i-- > 0; )
+      wheel.schedule( base + fc::seconds( 20000 + delays[ i ] ), i );
+   const auto late = wheel.expire( base + fc::seconds( 40000 ) );
+   BOOST_REQUIRE_EQUAL( late.size(), delays.size() );
+   for( size_t i = 1; i < late.size(); ++i )
+      BOOST_CHECK( delays[ late[ i - 1 ] ] <= delays[ late[ i ] ] );
+   BOOST_CHECK( wheel.expire( base + fc::seconds( 40001 ) ).empty() );
+} FC_LOG_AND_RETHROW() }
+
+/** what the fast parser accepts must parse as fc's parser gives it, and what it leaves must still parse */
+BOOST_AUTO_TEST_CASE( json_parser_matches_fc )
+{ try {
+   const std::string long_text( 100, 'x' );
+   const vector<std::string> handled{
+      "{}", "[]", "null", "true", "false", "0", "-1", "9223372036854775807", "-9223372036854775807", "1.5", "-0.25",
+      "\"\"", "\"plain\"", "\"" + long_text + "\"", "\"" + long_text + "\\\"" + long_text + "\"",
+      "\"tab\\tnew\\nline \\\\ slash\\/ \\b\\f\\r\"", "\"utf8 \xc3\xa9\xe2\x82\xac\"",
+      " { \"method\" : \"wallet_import_private_key\", \"params\" : [ \"5K\", null, true, [ 1, 2, [ ] ] ], \"id\" : 7 }\n",
+      "[{\"a\":{\"b\":[{\"c\":\"" + long_text + "\"}]}},-3,4.0]" };
+   for( const auto& text : handled )
+   {
+      const auto fast = bts::utilities::try_parse_json( text.data(), text.size() );
+      BOOST_REQUIRE_MESSAGE( fast.valid(), text );
+      BOOST_CHECK_EQUAL( fc::json::to_string( *fast ), fc::json::to_string( fc::json::from_string( text ) ) );
+      BOOST_CHECK_EQUAL( fast->get_type(), fc::json::from_string( text ).get_type() );
+   }
+
+   const vector<std::string> left_to_fc{ "1e5", "\"\\u00e9\"", "123456789012345678901", "[1] 2", "{'a':1}" };
+   for( const auto& text : left_to_fc )
+   {
+      BOOST_CHECK_MESSAGE( !bts::utilities::try_parse_json( text.data(), text.size() ).valid(), text );
+      fc::optional<fc::variant> expected;
+      try { expected = fc::json::from_string( text ); } catch( const fc::exception& ) {}
+      if( expected.valid() )
+         BOOST_CHECK_EQUAL( fc::json::to_string( bts::utilities::parse_json( text.data(), text.size() ) ),
+                            fc::json::to_string( *expected ) );
+   }
+
+   const std::string deep = std::string( bts::utilities::max_json_depth + 1, '[' ) + std::string( bts::utilities::max_json_depth + 1, ']' );
+   BOOST_CHECK_THROW( bts::utilities::try_parse_json( deep.data(), deep.size() ), fc::parse_error_exception );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( timetest )
 { 
   auto block_time =  fc::variant( "20140617T024645" ).as<fc::time_point_sec>();
   auto now =  fc::variant( "20140617T024332" ).as<fc::time_point_sec>();
   elog( "delta: ${d}", ("d", (block_time - now).to_seconds() ) );
 }
+
+/**
+ *  The unclaimed genesis total is kept as balances are stored, and must count the same balances as a
+ *  full scan does; with verify_asset_totals every read compares the two.
+ */
+BOOST_FIXTURE_TEST_CASE( unclaimed_genesis_matches_scan, chain_fixture )
+{ try {
+   exec( clienta, "wallet_delegate_set_block_production ALL true" );
+   const auto chain = clienta->get_chain();
+   chain->verify_asset_totals( true );
+
+   const asset genesis_total = chain->unclaimed_genesis();
+   BOOST_CHECK( genesis_total.amount > 0 );
+   produce_block( clienta );
+   BOOST_CHECK( chain->unclaimed_genesis() == genesis_total );
+
+   // spending a genesis balance claims it
+   exec( clienta, std::string( "wallet_transfer 100 " ) + BTS_BLOCKCHAIN_SYMBOL + " delegate31 delegate33 claim" );
+   produce_block( clienta );
+   const asset claimed_total = chain->unclaimed_genesis();
+   BOOST_CHECK( claimed_total < genesis_total );
+
+   produce_block( clienta );
+   BOOST_CHECK( chain->unclaimed_genesis() == claimed_total );
+} FC_LOG_AND_RETHROW() }
+
+#ifndef PTS_SUPPRESS_ASSETS
+/**
+ *  Issuing checks the supply, so issues of one asset in a block big enough to be evaluated in parallel
+ *  must be accepted or rejected exactly as serial evaluation would, even though each worker sees the
+ *  supply from before the block.
+ */
+BOOST_FIXTURE_TEST_CASE( parallel_issues_respect_max_supply, chain_fixture )
+{ try {
+   exec( clienta, "wallet_delegate_set_block_production ALL true" );
+   exec( clienta, "wallet_asset_create PAR Parallel delegate1 \"issued in parallel\" null 1000 1" );
+   produce_block( clienta );
+
+   const auto chain = clienta->get_chain();
+   const auto asset_rec = chain->get_asset_record( "PAR" );
+   BOOST_REQUIRE( asset_rec.valid() );
+   BOOST_REQUIRE_EQUAL( asset_rec->maximum_share_supply, 1000 );
+
+   // pushes a block of one transaction per amount, each issuing it to another delegate
+   auto push_issues = [&]( const vector<share_type>& amounts ) -> bool
+   {
+      const auto& delegates = clienta->get_wallet()->get_my_delegates( enabled_delegate_status | active_delegate_status );
+      const auto next_block_time = clienta->get_wallet()->get_next_producible_block_timestamp( delegates );
+      FC_ASSERT( next_block_time.valid() );
+      bts::blockchain::advance_time( (int32_t)((*next_block_time - bts::blockchain::now()).count()/1000000) );
+
+      full_block block = chain->generate_block( *next_block_time );
+      block.user_transactions.clear();
+      for( size_t i = 0; i < amounts.size(); ++i )
+      {
+         signed_transaction trx;
+         trx.expiration = bts::blockchain::now() + BTS_BLOCKCHAIN_MAX_TRANSACTION_EXPIRATION_SEC / 2;
+         trx.issue( asset( amounts[ i ], asset_rec->id ) );
+         trx.deposit( address( delegate_private_keys[ i ].get_public_key() ), asset( amounts[ i ], asset_rec->id ), 0 );
+         trx.sign( delegate_private_keys[ 1 ], chain->chain_id() );
+         block.user_transactions.push_back( trx );
+      }
+      block.transaction_digest = digest_block( block ).calculate_transaction_digest();
+      clienta->get_wallet()->sign_block( block );
+
+      const auto head_num = chain->get_head_block_num();
+      try
+      {
+         chain->push_block( block );
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "${e}", ("e",e.to_detail_string()) );
+      }
+      bts::blockchain::advance_time( 7 );
+      return chain->get_head_block_num() == head_num + 1;
+   };
+
+   // every issue fits: serial and parallel evaluation are compared, and must agree
+   chain->verify_parallel_transactions( true );
+   BOOST_REQUIRE( push_issues( vector<share_type>( BTS_BLOCKCHAIN_MIN_PARALLEL_TRANSACTIONS, 50 ) ) );
+   const share_type supply = 50 * BTS_BLOCKCHAIN_MIN_PARALLEL_TRANSACTIONS;
+   BOOST_CHECK_EQUAL( chain->get_asset_record( asset_rec->id )->current_share_supply, supply );
+
+   // each issue fits the supply before the block, but not all of them together
+   vector<share_type> over_issue( BTS_BLOCKCHAIN_MIN_PARALLEL_TRANSACTIONS, 1 );
+   over_issue.front() = over_issue.back() = 1000 - supply;
+   for( const bool verify : { false, true } )
+   {
+      chain->verify_parallel_transactions( verify );
+      BOOST_CHECK( !push_issues( over_issue ) );
+      BOOST_CHECK_EQUAL( chain->get_asset_record( asset_rec->id )->current_share_supply, supply );
+   }
+
+   // serially, as blocks with fewer transactions are evaluated
+   BOOST_CHECK( !push_issues( { 1000 - supply, 1000 - supply } ) );
+   BOOST_CHECK_EQUAL( chain->get_asset_record( asset_rec->id )->current_share_supply, supply );
+} FC_LOG_AND_RETHROW() }
+#endif
 //BOOST_FIXTURE_TEST_CASE( fork_testing, chain_fixture )
 //{
 //   produce_block(clientb);
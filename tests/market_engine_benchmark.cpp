@@ -0,0 +1,160 @@
+/**
+ *  Measures market execution on synthetic order books.
+ *
+ *  A fresh chain is opened from a genesis file and one market issued asset is added against the base
+ *  asset. Its book is filled with bids, asks, shorts and margin positions around a mid price, then the
+ *  market is executed for a number of blocks through chain_database::simulate_markets, each time with
+ *  every active delegate publishing a feed that moved by up to the given volatility. Nothing is applied,
+ *  so every block matches against the same book.
+ */
+#include <bts/blockchain/chain_database.hpp>
+#include <bts/blockchain/config.hpp>
+
+#include <fc/crypto/elliptic.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/time.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+
+using namespace bts::blockchain;
+
+static std::atomic<uint64_t> allocations( 0 );
+
+void* operator new( std::size_t size )
+{
+   ++allocations;
+   if( void* p = std::malloc( size ? size : 1 ) ) return p;
+   throw std::bad_alloc();
+}
+void operator delete( void* p )noexcept { std::free( p ); }
+
+static address owner( uint32_t n )
+{
+   return address( fc::ecc::private_key::regenerate( fc::sha256::hash( "market_engine_benchmark" + std::to_string( n ) ) ).get_public_key() );
+}
+
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()("help",                                                                                    "display this help message")
+                              ("genesis",    boost::program_options::value<std::string>()->default_value( "test_genesis.json" ), "genesis file to open the chain with")
+                              ("depth",      boost::program_options::value<uint32_t>()->default_value( 1000 ),   "bids and asks in the book, each")
+                              ("spread",     boost::program_options::value<double>()->default_value( 0.05 ),     "orders are priced within this fraction of the mid price")
+                              ("shorts",     boost::program_options::value<uint32_t>()->default_value( 200 ),    "shorts in the book")
+                              ("covers",     boost::program_options::value<uint32_t>()->default_value( 200 ),    "margin positions in the book")
+                              ("volatility", boost::program_options::value<double>()->default_value( 0.02 ),     "largest move of the feed price between blocks, as a fraction")
+                              ("blocks",     boost::program_options::value<uint32_t>()->default_value( 100 ),    "blocks to execute")
+                              ("seed",       boost::program_options::value<uint32_t>()->default_value( 1 ),      "seed for the synthetic book and feeds");
+   boost::program_options::variables_map options;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), options );
+      boost::program_options::notify( options );
+   }
+   catch( const boost::program_options::error& e )
+   {
+      std::cerr << e.what() << "\n" << option_config << "\n";
+      return 1;
+   }
+   if( options.count( "help" ) )
+   {
+      std::cout << option_config << "\n";
+      return 0;
+   }
+
+   try
+   {
+      const uint32_t depth      = options["depth"].as<uint32_t>();
+      const double   spread     = options["spread"].as<double>();
+      const uint32_t shorts     = options["shorts"].as<uint32_t>();
+      const uint32_t covers     = options["covers"].as<uint32_t>();
+      const double   volatility = options["volatility"].as<double>();
+      const uint32_t blocks     = options["blocks"].as<uint32_t>();
+      std::mt19937 random( options["seed"].as<uint32_t>() );
+      std::uniform_real_distribution<double> band( -spread, spread );
+      std::uniform_real_distribution<double> move( -volatility, volatility );
+      std::uniform_int_distribution<share_type> amount( 1000, 1000000 );
+
+      fc::temp_directory data_dir;
+      const auto db = std::make_shared<chain_database>();
+      db->open( data_dir.path(), fc::path( options["genesis"].as<std::string>() ) );
+
+      asset_record quote;
+      quote.id = db->new_asset_id();
+      quote.symbol = "BENCH";
+      quote.name = "market_engine_benchmark";
+      quote.issuer_account_id = asset_record::market_issued_asset;
+      quote.precision = BTS_BLOCKCHAIN_PRECISION;
+      quote.maximum_share_supply = BTS_BLOCKCHAIN_MAX_SHARES;
+      quote.registration_date = db->now();
+      quote.last_update = db->now();
+      db->store_asset_record( quote );
+      const asset_id_type base_id = 0;
+
+      const double mid = 1.0;
+      const auto expiration = db->now() + BTS_BLOCKCHAIN_MAX_SHORT_PERIOD_SEC;
+      uint32_t next_owner = 0;
+      for( uint32_t i = 0; i < depth; ++i )
+      {
+         db->store_bid_record( market_index_key( price( mid * ( 1 + band( random ) ), quote.id, base_id ), owner( next_owner++ ) ),
+                               order_record( amount( random ) ) );
+         db->store_ask_record( market_index_key( price( mid * ( 1 + band( random ) ), quote.id, base_id ), owner( next_owner++ ) ),
+                               order_record( amount( random ) ) );
+      }
+      for( uint32_t i = 0; i < shorts; ++i )
+      {
+         db->store_short_record( market_index_key( price( 0.01 + 0.1 * ( i % 10 ) / 10, quote.id, base_id ), owner( next_owner++ ) ),
+                                 order_record( amount( random ) ) );
+      }
+      for( uint32_t i = 0; i < covers; ++i )
+      {
+         const share_type payoff = amount( random );
+         // some positions have already expired and are covered regardless of the feed
+         const auto expires = i % 8 == 0 ? db->now() - 1 : expiration;
+         db->store_collateral_record( market_index_key( price( mid * ( 1 + band( random ) ), quote.id, base_id ), owner( next_owner++ ) ),
+                                      collateral_record( 2 * payoff, payoff, price( 0.05, quote.id, base_id ), expires ) );
+      }
+
+      const auto delegates = db->get_active_delegates();
+      const auto timestamp = db->now() + BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
+      uint64_t matches = 0;
+      uint64_t allocated = 0;
+      fc::microseconds elapsed;
+      for( uint32_t b = 0; b < blocks; ++b )
+      {
+         const price feed( mid * ( 1 + move( random ) ), quote.id, base_id );
+         for( const auto& delegate_id : delegates )
+            db->set_feed( feed_record{ feed_index{ quote.id, delegate_id }, fc::variant( feed ), db->now() } );
+         db->set_dirty_markets( { std::make_pair( quote.id, base_id ) } );
+
+         const uint64_t allocations_before = allocations;
+         const auto start = fc::time_point::now();
+         const auto state = db->simulate_markets( timestamp );
+         elapsed += fc::time_point::now() - start;
+         allocated += allocations - allocations_before;
+         matches += state->market_transactions.size();
+      }
+
+      const double seconds = double( elapsed.count() ) / 1000000;
+      std::cout << "blocks:               " << blocks << "\n"
+                << "orders matched:       " << matches << "\n"
+                << "matched per second:   " << ( seconds > 0 ? matches / seconds : 0 ) << "\n"
+                << "allocations per match:" << ( matches ? double( allocated ) / matches : 0 ) << "\n"
+                << "ms per block:         " << ( blocks ? double( elapsed.count() ) / 1000 / blocks : 0 ) << "\n";
+
+      db->close();
+   }
+   catch( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,204 @@
+/**
+ *  Measures block propagation and sync over a simulated network.
+ *
+ *  Hundreds of lightweight node delegates are joined into a random graph by bts::net::simulated_network
+ *  links with the given latency, bandwidth and loss. Blocks are broadcast from random delegates and relayed
+ *  by every delegate that accepts them; each delegate spends the given validation time on each block. The
+ *  percentiles of the simulated time until each delegate had each block are reported. Then a fresh delegate
+ *  is linked to one of them and sent the whole chain, and the simulated time that took is reported as the
+ *  sync time.
+ */
+#include <bts/client/messages.hpp>
+#include <bts/net/node.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/time.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+
+using namespace bts::net;
+
+/** accepts every message after spending the validation time on it */
+class benchmark_delegate : public node_delegate
+{
+   public:
+      explicit benchmark_delegate( fc::microseconds validation_time ) : _validation_time( validation_time ) {}
+
+      bool handle_message( const message&, bool )override
+      {
+         const auto start = fc::time_point::now();
+         while( fc::time_point::now() - start < _validation_time )
+            ;
+         ++messages_handled;
+         return false;
+      }
+
+      bool has_item( const item_id& )override { return false; }
+      std::vector<item_hash_t> get_item_ids( uint32_t, const std::vector<item_hash_t>&, uint32_t& remaining_item_count, uint32_t )override
+      {
+         remaining_item_count = 0;
+         return std::vector<item_hash_t>();
+      }
+      message get_item( const item_id& )override { FC_THROW( "not supported by the benchmark" ); }
+      fc::sha256 get_chain_id()const override { return fc::sha256(); }
+      std::vector<item_hash_t> get_blockchain_synopsis( uint32_t, const item_hash_t&, uint32_t )override { return std::vector<item_hash_t>(); }
+      void sync_status( uint32_t, uint32_t )override {}
+      void connection_count_changed( uint32_t )override {}
+      uint32_t get_block_number( const item_hash_t& )override { return 0; }
+      fc::time_point_sec get_block_time( const item_hash_t& )override { return fc::time_point_sec::min(); }
+      std::vector<bts::blockchain::signed_block_header> get_block_headers( const std::vector<item_hash_t>& )override
+      {
+         return std::vector<bts::blockchain::signed_block_header>();
+      }
+      fc::time_point_sec get_blockchain_now()override { return fc::time_point::now(); }
+      item_hash_t get_head_block_id()const override { return item_hash_t(); }
+      uint32_t estimate_last_known_fork_from_git_revision_timestamp( uint32_t )const override { return 0; }
+      void error_encountered( const std::string&, const fc::oexception& )override {}
+
+      uint64_t messages_handled = 0;
+
+   private:
+      fc::microseconds _validation_time;
+};
+
+static message make_block_message( uint32_t block_size, std::mt19937& random )
+{
+   message block;
+   block.msg_type = bts::client::block_message_type;
+   block.data.resize( block_size );
+   for( char& c : block.data )
+      c = char( random() );
+   block.size = block_size;
+   return block;
+}
+
+static double percentile( std::vector<fc::microseconds>& delays, double fraction )
+{
+   if( delays.empty() )
+      return 0;
+   std::sort( delays.begin(), delays.end() );
+   return double( delays[ std::min<size_t>( delays.size() - 1, size_t( delays.size() * fraction ) ) ].count() ) / 1000;
+}
+
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()("help",                                                                                   "display this help message")
+                              ("nodes",       boost::program_options::value<uint32_t>()->default_value( 300 ),    "node delegates in the network")
+                              ("connections", boost::program_options::value<uint32_t>()->default_value( 8 ),      "links each node opens to random others")
+                              ("min-latency", boost::program_options::value<uint32_t>()->default_value( 20 ),     "shortest one way link latency, in milliseconds")
+                              ("max-latency", boost::program_options::value<uint32_t>()->default_value( 200 ),    "longest one way link latency, in milliseconds")
+                              ("bandwidth",   boost::program_options::value<uint64_t>()->default_value( 1000000 ), "link bandwidth in bytes per second, 0 for unlimited")
+                              ("loss",        boost::program_options::value<double>()->default_value( 0.01 ),     "fraction of messages lost and sent again")
+                              ("blocks",      boost::program_options::value<uint32_t>()->default_value( 20 ),     "blocks to broadcast")
+                              ("block-size",  boost::program_options::value<uint32_t>()->default_value( 20000 ),  "bytes in each block message")
+                              ("validation",  boost::program_options::value<uint32_t>()->default_value( 1000 ),   "time each node spends on a block, in microseconds")
+                              ("sync-blocks", boost::program_options::value<uint32_t>()->default_value( 1000 ),   "blocks a new node syncs from one neighbour")
+                              ("seed",        boost::program_options::value<uint32_t>()->default_value( 1 ),      "seed for the topology, links and blocks");
+   boost::program_options::variables_map options;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), options );
+      boost::program_options::notify( options );
+   }
+   catch( const boost::program_options::error& e )
+   {
+      std::cerr << e.what() << "\n" << option_config << "\n";
+      return 1;
+   }
+   if( options.count( "help" ) )
+   {
+      std::cout << option_config << "\n";
+      return 0;
+   }
+
+   try
+   {
+      const uint32_t nodes       = std::max<uint32_t>( options["nodes"].as<uint32_t>(), 2 );
+      const uint32_t connections = options["connections"].as<uint32_t>();
+      const uint32_t blocks      = options["blocks"].as<uint32_t>();
+      const uint32_t block_size  = options["block-size"].as<uint32_t>();
+      const uint32_t sync_blocks = options["sync-blocks"].as<uint32_t>();
+      const fc::microseconds validation_time( options["validation"].as<uint32_t>() );
+      std::mt19937 random( options["seed"].as<uint32_t>() );
+      std::uniform_int_distribution<uint32_t> latency_ms( options["min-latency"].as<uint32_t>(),
+                                                          std::max( options["min-latency"].as<uint32_t>(), options["max-latency"].as<uint32_t>() ) );
+      std::uniform_int_distribution<uint32_t> any_node( 0, nodes - 1 );
+
+      const auto network = std::make_shared<simulated_network>( "network_simulation_benchmark" );
+      network->set_random_seed( options["seed"].as<uint32_t>() );
+      network->set_connection_count( connections );
+
+      std::vector<std::unique_ptr<benchmark_delegate>> delegates;
+      for( uint32_t i = 0; i < nodes; ++i )
+      {
+         delegates.emplace_back( new benchmark_delegate( validation_time ) );
+         network->add_node_delegate( delegates.back().get() );
+      }
+
+      auto random_link = [&]() {
+         simulated_link link;
+         link.latency = fc::milliseconds( latency_ms( random ) );
+         link.bytes_per_second = options["bandwidth"].as<uint64_t>();
+         link.loss_rate = options["loss"].as<double>();
+         return link;
+      };
+
+      std::set<std::pair<uint32_t, uint32_t>> linked;
+      for( uint32_t i = 0; i < nodes; ++i )
+      {
+         for( uint32_t c = 0; c < std::min( connections, nodes - 1 ); ++c )
+         {
+            uint32_t other = any_node( random );
+            if( other == i || !linked.insert( std::minmax( i, other ) ).second )
+               continue;
+            network->connect_node_delegates( delegates[i].get(), delegates[other].get(), random_link() );
+         }
+      }
+
+      std::vector<fc::microseconds> delays;
+      uint64_t deliveries = 0;
+      for( uint32_t b = 0; b < blocks; ++b )
+      {
+         const message block = make_block_message( block_size, random );
+         network->broadcast_from( delegates[ any_node( random ) ].get(), block );
+         network->run();
+         const auto block_delays = network->get_delivery_delays( block.id() );
+         deliveries += block_delays.size();
+         delays.insert( delays.end(), block_delays.begin(), block_delays.end() );
+      }
+
+      delegates.emplace_back( new benchmark_delegate( validation_time ) );
+      benchmark_delegate* const syncing = delegates.back().get();
+      benchmark_delegate* const source = delegates[ any_node( random ) ].get();
+      network->add_node_delegate( syncing );
+      network->connect_node_delegates( syncing, source, random_link() );
+      const fc::microseconds sync_start = network->run();
+      for( uint32_t b = 0; b < sync_blocks; ++b )
+         network->send_to( source, syncing, make_block_message( block_size, random ) );
+      const fc::microseconds sync_time = network->run() - sync_start;
+
+      std::cout << "nodes:                " << nodes << "\n"
+                << "links:                " << linked.size() << "\n"
+                << "blocks:               " << blocks << "\n"
+                << "nodes reached:        " << ( blocks ? 100.0 * deliveries / ( double( blocks ) * ( nodes - 1 ) ) : 0 ) << "%\n"
+                << "propagation p50 ms:   " << percentile( delays, 0.5 ) << "\n"
+                << "propagation p90 ms:   " << percentile( delays, 0.9 ) << "\n"
+                << "propagation p99 ms:   " << percentile( delays, 0.99 ) << "\n"
+                << "propagation max ms:   " << percentile( delays, 1.0 ) << "\n"
+                << "sync blocks:          " << syncing->messages_handled << " of " << sync_blocks << "\n"
+                << "sync seconds:         " << double( sync_time.count() ) / 1000000 << "\n";
+   }
+   catch( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
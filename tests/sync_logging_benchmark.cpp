@@ -0,0 +1,91 @@
+/**
+ *  Measures what logging costs a sync.
+ *
+ *  The first blocks of an existing chain are pushed into fresh chain databases opened from the same
+ *  genesis file, once with the default logger taking every level and once with it taking none, and the
+ *  blocks per second of each run are reported. Messages are captured but not written anywhere, so the
+ *  difference is the cost of building them.
+ */
+#include <bts/blockchain/chain_database.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/time.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+
+using namespace bts::blockchain;
+
+static double blocks_per_second( const std::vector<full_block>& blocks, const fc::path& genesis, fc::log_level level )
+{
+   fc::logger::get( DEFAULT_LOGGER ).set_log_level( level );
+
+   fc::temp_directory data_dir;
+   const auto db = std::make_shared<chain_database>();
+   db->open( data_dir.path(), genesis );
+
+   const auto start = fc::time_point::now();
+   for( const auto& block : blocks )
+      db->push_block( block );
+   const double seconds = double( ( fc::time_point::now() - start ).count() ) / 1000000;
+
+   db->close();
+   return seconds > 0 ? blocks.size() / seconds : 0;
+}
+
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()("help",                                                                   "display this help message")
+                              ("source",  boost::program_options::value<std::string>(),                         "data directory of the chain to replay")
+                              ("genesis", boost::program_options::value<std::string>(),                         "genesis file the chain was started from")
+                              ("blocks",  boost::program_options::value<uint32_t>()->default_value( 10000 ),     "blocks to replay");
+   boost::program_options::variables_map options;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), options );
+      boost::program_options::notify( options );
+   }
+   catch( const boost::program_options::error& e )
+   {
+      std::cerr << e.what() << "\n" << option_config << "\n";
+      return 1;
+   }
+   if( options.count( "help" ) || !options.count( "source" ) || !options.count( "genesis" ) )
+   {
+      std::cout << option_config << "\n";
+      return options.count( "help" ) ? 0 : 1;
+   }
+
+   try
+   {
+      const fc::path genesis( options["genesis"].as<std::string>() );
+
+      std::vector<full_block> blocks;
+      {
+         const auto source = std::make_shared<chain_database>();
+         source->open( fc::path( options["source"].as<std::string>() ), genesis );
+         const uint32_t count = std::min( options["blocks"].as<uint32_t>(), source->get_head_block_num() );
+         blocks.reserve( count );
+         for( uint32_t n = 1; n <= count; ++n )
+            blocks.push_back( source->get_block( n ) );
+         source->close();
+      }
+
+      const double with_logging = blocks_per_second( blocks, genesis, fc::log_level::all );
+      const double without_logging = blocks_per_second( blocks, genesis, fc::log_level::off );
+
+      std::cout << "blocks:                     " << blocks.size() << "\n"
+                << "blocks per second, logging: " << with_logging << "\n"
+                << "blocks per second, silent:  " << without_logging << "\n";
+   }
+   catch( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
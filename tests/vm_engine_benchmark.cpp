@@ -0,0 +1,143 @@
+/**
+ *  Measures bts::vm::engine on a straight line arithmetic program.
+ *
+ *  The same operations are run through a plain variant interpreter, the way engine::execute used to work,
+ *  and through the compiled program, and the instructions per second of each are reported. The compile is
+ *  timed separately since a program that is run many times only pays for it once.
+ */
+#include <bts/vm/engine.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/time.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+
+using bts::vm::engine;
+
+static engine::operation make_op( engine::op_code code, int16_t arg1, const fc::variant& arg0 = fc::variant() )
+{
+   engine::operation op;
+   op.code = code;
+   op.arg1 = arg1;
+   op.arg2 = 0;
+   op.arg3 = 0;
+   op.arg0 = arg0;
+   return op;
+}
+
+/* each block pushes two values, mixes them and the values below, compares and pops back to where it started */
+static std::vector<engine::operation> make_program( uint32_t blocks )
+{
+   std::vector<engine::operation> ops;
+   ops.push_back( make_op( engine::PUSH, 0, fc::variant( int64_t( 1 ) ) ) );
+   for( uint32_t n = 0; n < blocks; ++n )
+   {
+      ops.push_back( make_op( engine::PUSH, 0, fc::variant( int64_t( n ) ) ) );
+      ops.push_back( make_op( engine::ADD, 2 ) );
+      ops.push_back( make_op( engine::MULT, 0, fc::variant( int64_t( 3 ) ) ) );
+      ops.push_back( make_op( engine::SUB, 0, fc::variant( int64_t( 7 ) ) ) );
+      ops.push_back( make_op( engine::PUSH, 1 ) );
+      ops.push_back( make_op( engine::DIV, 0, fc::variant( 2.5 ) ) );
+      ops.push_back( make_op( engine::LT, 2 ) );
+      ops.push_back( make_op( engine::POP, 0 ) );
+      ops.push_back( make_op( engine::POP, 0 ) );
+   }
+   return ops;
+}
+
+/* the operations this program uses, interpreted on a variant stack */
+static void interpret( fc::variants& stack, const std::vector<engine::operation>& ops )
+{
+   auto get_value = [&]( const engine::operation& op ) -> const fc::variant&
+   {
+      return op.arg1 ? stack[ stack.size() - op.arg1 ] : op.arg0;
+   };
+   for( const auto& op : ops )
+   {
+      switch( (engine::op_code)op.code )
+      {
+         case engine::PUSH: stack.emplace_back( get_value( op ) ); break;
+         case engine::POP:  stack.pop_back(); break;
+         case engine::ADD:  stack.back() = stack.back() + get_value( op ); break;
+         case engine::SUB:  stack.back() = stack.back() - get_value( op ); break;
+         case engine::MULT: stack.back() = stack.back() * get_value( op ); break;
+         case engine::DIV:  stack.back() = stack.back() / get_value( op ); break;
+         case engine::LT:   stack.back() = stack.back() < get_value( op ); break;
+         default: FC_ASSERT( false, "not used by the benchmark" );
+      }
+   }
+}
+
+static double seconds_since( const fc::time_point& start )
+{
+   return double( ( fc::time_point::now() - start ).count() ) / 1000000;
+}
+
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()("help",                                                                 "display this help message")
+                              ("blocks", boost::program_options::value<uint32_t>()->default_value( 1000 ), "blocks of 9 operations in the program")
+                              ("runs",   boost::program_options::value<uint32_t>()->default_value( 1000 ), "times to run the program");
+   boost::program_options::variables_map options;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), options );
+      boost::program_options::notify( options );
+   }
+   catch( const boost::program_options::error& e )
+   {
+      std::cerr << e.what() << "\n" << option_config << "\n";
+      return 1;
+   }
+   if( options.count( "help" ) )
+   {
+      std::cout << option_config << "\n";
+      return 0;
+   }
+
+   try
+   {
+      const uint32_t runs = options["runs"].as<uint32_t>();
+      const auto ops = make_program( options["blocks"].as<uint32_t>() );
+      const double instructions = double( ops.size() ) * runs;
+
+      auto start = fc::time_point::now();
+      fc::variants variant_stack;
+      for( uint32_t n = 0; n < runs; ++n )
+      {
+         variant_stack.clear();
+         interpret( variant_stack, ops );
+      }
+      const double interpreted = seconds_since( start );
+
+      start = fc::time_point::now();
+      const auto prog = engine::compile( ops );
+      const double compiled_in = seconds_since( start );
+
+      start = fc::time_point::now();
+      for( uint32_t n = 0; n < runs; ++n )
+      {
+         engine vm;
+         vm.execute( prog );
+      }
+      const double compiled = seconds_since( start );
+
+      engine check;
+      check.execute( prog );
+      FC_ASSERT( check.get_stack() == variant_stack, "compiled program left a different stack" );
+
+      std::cout << ops.size() << " operations, " << runs << " runs\n";
+      std::cout << "variant interpreter: " << ( interpreted > 0 ? instructions / interpreted : 0 ) << " instructions/s\n";
+      std::cout << "compiled program:    " << ( compiled > 0 ? instructions / compiled : 0 ) << " instructions/s"
+                << " (compiled in " << compiled_in * 1000 << " ms)\n";
+   }
+   catch( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}